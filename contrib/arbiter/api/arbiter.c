@@ -40,6 +40,50 @@ static char *arbiter_unix_sock_dir;
 
 typedef unsigned xid_t;
 
+// ------ request span recorder ------
+// One span per arbiter round trip: when the command left this backend and
+// when the reply came back. Laying a dump of these next to the server-side
+// flight recorder (src/server.c, dumped with SIGUSR1) splits a commit
+// latency spike into its backend, network and arbiter-queueing components.
+
+#define TRACE_SPANS 1024
+
+typedef struct ArbiterSpan
+{
+	xid_t cmd;
+	unsigned long long start_ns; // before the first write()
+	unsigned long long sent_ns;  // command fully handed to the kernel
+	unsigned long long done_ns;  // reply fully received
+} ArbiterSpan;
+
+static ArbiterSpan trace_spans[TRACE_SPANS];
+static unsigned long long span_count; // total spans ever recorded
+static ArbiterSpan cur_span;
+
+static unsigned long long arbiter_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void ArbiterTraceDump(void)
+{
+	unsigned long long i = 0;
+
+	if (span_count > TRACE_SPANS)
+		i = span_count - TRACE_SPANS;
+	elog(LOG, "arbiter client trace: %llu spans recorded, dumping %llu",
+		 span_count, span_count - i);
+	for (; i < span_count; i++)
+	{
+		ArbiterSpan *s = trace_spans + i % TRACE_SPANS;
+		elog(LOG, "arbiter span: cmd '%c' at %llu send %lluns wait %lluns",
+			 (char) s->cmd, s->start_ns,
+			 s->sent_ns - s->start_ns, s->done_ns - s->sent_ns);
+	}
+}
+
 static void DiscardConnection()
 {
 	if (connected)
@@ -103,6 +147,10 @@ static int arbiter_recv_results(ArbiterConn arbiter, int maxlen, xid_t *results)
 		}
 		recved += newbytes;
 	}
+
+	cur_span.done_ns = arbiter_now_ns();
+	trace_spans[span_count++ % TRACE_SPANS] = cur_span;
+
 	return needed / sizeof(xid_t);
 }
 
@@ -111,11 +159,17 @@ static bool ArbiterConnect(ArbiterConn conn)
 {
 	int sd;
 
-	if (conn->host == NULL)
+	if ((conn->host == NULL) || (conn->host[0] == '/'))
 	{
-		// use a UNIX socket
+		// use a UNIX socket: either the local sockhub (host == NULL), or the
+		// fastpath socket of a co-located arbiter (host is a socket path),
+		// which skips both sockhub and the loopback TCP stack
 		struct sockaddr sock;
-		int len = offsetof(struct sockaddr, sa_data) + snprintf(sock.sa_data, sizeof(sock.sa_data), "%s/sh.unix", arbiter_unix_sock_dir);
+		int len;
+		if (conn->host)
+			len = offsetof(struct sockaddr, sa_data) + snprintf(sock.sa_data, sizeof(sock.sa_data), "%s", conn->host);
+		else
+			len = offsetof(struct sockaddr, sa_data) + snprintf(sock.sa_data, sizeof(sock.sa_data), "%s/sh.unix", arbiter_unix_sock_dir);
 		sock.sa_family = AF_UNIX;
 
 		sd = socket(AF_UNIX, SOCK_STREAM, 0);
@@ -197,6 +251,10 @@ static bool arbiter_send_command(ArbiterConn arbiter, xid_t cmd, int argc, ...)
 	char *cursor = buf;
 
 	ShubMessageHdr *msg = (ShubMessageHdr*)cursor;
+
+	cur_span.cmd = cmd;
+	cur_span.start_ns = arbiter_now_ns();
+
 	msg->chan = 0;
 	msg->code = MSG_FIRST_USER_CODE;
 	msg->size = sizeof(xid_t) * (argc + 1);
@@ -229,6 +287,56 @@ static bool arbiter_send_command(ArbiterConn arbiter, xid_t cmd, int argc, ...)
 		}
 		sent += newbytes;
 	}
+	cur_span.sent_ns = arbiter_now_ns();
+	return true;
+}
+
+/* Same as arbiter_send_command(), but takes the arguments as an array. */
+static bool arbiter_send_command_vec(ArbiterConn arbiter, xid_t cmd, int argc, xid_t *argv)
+{
+	int i;
+	int sent;
+	char buf[COMMAND_BUFFER_SIZE];
+	int datasize;
+	char *cursor = buf;
+
+	ShubMessageHdr *msg = (ShubMessageHdr*)cursor;
+
+	cur_span.cmd = cmd;
+	cur_span.start_ns = arbiter_now_ns();
+
+	msg->chan = 0;
+	msg->code = MSG_FIRST_USER_CODE;
+	msg->size = sizeof(xid_t) * (argc + 1);
+	cursor += sizeof(ShubMessageHdr);
+
+	*(xid_t*)cursor = cmd;
+	cursor += sizeof(xid_t);
+
+	for (i = 0; i < argc; i++)
+	{
+		*(xid_t*)cursor = argv[i];
+		cursor += sizeof(xid_t);
+	}
+
+	datasize = cursor - buf;
+	assert(msg->size + sizeof(ShubMessageHdr) == datasize);
+	assert(datasize <= COMMAND_BUFFER_SIZE);
+
+	sent = 0;
+	while (sent < datasize)
+	{
+		int newbytes = write(arbiter->sock, buf + sent, datasize - sent);
+		if (newbytes == -1)
+		{
+			DiscardConnection();
+			/* no ERROR here: the caller has waiters to take care of */
+			elog(WARNING, "Failed to send a command to arbiter");
+			return false;
+		}
+		sent += newbytes;
+	}
+	cur_span.sent_ns = arbiter_now_ns();
 	return true;
 }
 
@@ -249,6 +357,18 @@ void ArbiterConfig(char *servers, char *sock_dir)
 	while (hostport)
 	{
 		fprintf(stderr, "hostport = '%s'\n", hostport);
+
+		if (hostport[0] == '/')
+		{
+			// a unix socket path of a co-located arbiter: always connect
+			// directly, even when a sockhub socket directory is configured
+			conns[connum].host = strdup(hostport);
+			conns[connum].port = 0;
+			connum++;
+			hostport = strtok_r(NULL, ",", &hstate);
+			continue;
+		}
+
 		host = strtok_r(hostport, ":", &pstate);
 		fprintf(stderr, "host = '%s'\n", hostport);
 		if (!host) break;
@@ -304,7 +424,11 @@ static ArbiterConn GetConnection()
 			nanosleep(&timeout, NULL);
 
 			tries--;
-			if (c->host)
+			if (c->host && c->host[0] == '/')
+			{
+				elog(WARNING, "Failed to connect to arbiter at unix socket %s", c->host);
+			}
+			else if (c->host)
 			{
 				elog(WARNING, "Failed to connect to arbiter at tcp %s:%d", c->host, c->port);
 			}
@@ -429,6 +553,50 @@ failure:
 	);
 }
 
+bool ArbiterGetSnapshotBatch(TransactionId *xids, int nXids, Snapshot snapshot, TransactionId *gxmin)
+{
+	int i;
+	int reslen;
+	xid_t results[RESULTS_SIZE];
+	ArbiterConn arbiter = GetConnection();
+	if (!arbiter) {
+		goto failure;
+	}
+
+	assert(snapshot != NULL);
+	assert(nXids > 0);
+	assert(sizeof(ShubMessageHdr) + sizeof(xid_t) * (nXids + 1) <= COMMAND_BUFFER_SIZE);
+
+	// command
+	if (!arbiter_send_command_vec(arbiter, CMD_SNAPSHOT_BATCH, nXids, xids)) goto failure;
+
+	// response
+	reslen = arbiter_recv_results(arbiter, RESULTS_SIZE, results);
+	if (reslen < 4) goto failure;
+	if (results[0] != RES_OK) goto failure;
+	*gxmin = results[1];
+	ArbiterInitSnapshot(snapshot);
+	snapshot->xmin = results[2];
+	snapshot->xmax = results[3];
+	snapshot->xcnt = reslen - 4;
+
+	for (i = 0; i < snapshot->xcnt; i++)
+	{
+		snapshot->xip[i] = results[4 + i];
+	}
+
+	return true;
+failure:
+	DiscardConnection();
+	fprintf(
+		stderr,
+		"ArbiterGetSnapshotBatch: failed to"
+		" get the snapshot for %d transactions\n",
+		nXids
+	);
+	return false;
+}
+
 XidStatus ArbiterSetTransStatus(TransactionId xid, XidStatus status, bool wait)
 {
 	int reslen;
@@ -477,6 +645,90 @@ failure:
 	return -1;
 }
 
+// is an asynchronous request awaiting its reply on the current connection?
+static bool async_pending = false;
+
+bool ArbiterSetTransStatusBegin(TransactionId xid, XidStatus status, bool wait)
+{
+	ArbiterConn arbiter;
+
+	assert(!async_pending);
+
+	arbiter = GetConnection();
+	if (!arbiter) {
+		goto failure;
+	}
+
+	switch (status)
+	{
+		case TRANSACTION_STATUS_COMMITTED:
+			if (!arbiter_send_command(arbiter, CMD_FOR, 2, xid, wait)) goto failure;
+			break;
+		case TRANSACTION_STATUS_ABORTED:
+			if (!arbiter_send_command(arbiter, CMD_AGAINST, 2, xid, wait)) goto failure;
+			break;
+		default:
+			assert(false); // should not happen
+			goto failure;
+	}
+
+	async_pending = true;
+	return true;
+failure:
+	DiscardConnection();
+	fprintf(
+		stderr,
+		"ArbiterSetTransStatusBegin: failed to send the vote"
+		" %s the transaction xid = %d\n",
+		(status == TRANSACTION_STATUS_COMMITTED) ? "for" : "against",
+		xid
+	);
+	return false;
+}
+
+XidStatus ArbiterSetTransStatusEnd(void)
+{
+	int reslen;
+	xid_t results[RESULTS_SIZE];
+
+	assert(async_pending);
+	async_pending = false;
+
+	if (!connected) goto failure;
+
+	reslen = arbiter_recv_results(conns + leader, RESULTS_SIZE, results);
+	if (reslen != 1) goto failure;
+	switch (results[0])
+	{
+		case RES_TRANSACTION_COMMITTED:
+			return TRANSACTION_STATUS_COMMITTED;
+		case RES_TRANSACTION_ABORTED:
+			return TRANSACTION_STATUS_ABORTED;
+		case RES_TRANSACTION_INPROGRESS:
+			return TRANSACTION_STATUS_IN_PROGRESS;
+		default:
+			goto failure;
+	}
+failure:
+	DiscardConnection();
+	fprintf(stderr, "ArbiterSetTransStatusEnd: failed to collect the verdict\n");
+	return -1;
+}
+
+bool ArbiterAsyncResultReady(void)
+{
+	fd_set readfds;
+	struct timeval timeout = {0, 0};
+	int sock;
+
+	if (!async_pending || !connected) return true; // ...End() will not block
+
+	sock = conns[leader].sock;
+	FD_ZERO(&readfds);
+	FD_SET(sock, &readfds);
+	return select(sock + 1, &readfds, NULL, NULL, &timeout) > 0;
+}
+
 XidStatus ArbiterGetTransStatus(TransactionId xid, bool wait)
 {
 	int reslen;
@@ -553,6 +805,36 @@ failure:
 	return 0;
 }
 
+bool ArbiterReserveSequence(unsigned key, int amount, long long *first, long long *last)
+{
+	int reslen;
+	xid_t results[RESULTS_SIZE];
+	ArbiterConn arbiter = GetConnection();
+	if (!arbiter) {
+		goto failure;
+	}
+
+	// command
+	if (!arbiter_send_command(arbiter, CMD_SEQUENCE, 2, key, amount)) goto failure;
+
+	// response: RES_OK and the range bounds as hi/lo word pairs
+	reslen = arbiter_recv_results(arbiter, RESULTS_SIZE, results);
+	if (reslen != 5) goto failure;
+	if (results[0] != RES_OK) goto failure;
+	*first = ((long long)results[1] << 32) | results[2];
+	*last = ((long long)results[3] << 32) | results[4];
+	return true;
+failure:
+	DiscardConnection();
+	fprintf(
+		stderr,
+		"ArbiterReserveSequence: failed to lease"
+		" %d values of sequence %u\n",
+		amount, key
+	);
+	return false;
+}
+
 bool ArbiterDetectDeadLock(int port, TransactionId xid, void* data, int size)
 {
 	int msg_size = size + sizeof(xid)*3;
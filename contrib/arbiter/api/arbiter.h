@@ -29,6 +29,16 @@ TransactionId ArbiterStartTransaction(Snapshot snapshot, TransactionId *gxmin, i
  */
 void ArbiterGetSnapshot(TransactionId xid, Snapshot snapshot, TransactionId *gxmin);
 
+/**
+ * Asks the arbiter for one fresh snapshot on behalf of 'nXids' transactions in
+ * a single round trip. The arbiter records the snapshot for every listed
+ * transaction and sends it back once; 'snapshot' and 'gxmin' are filled the
+ * same way as by ArbiterGetSnapshot(). Returns 'false' on failure instead of
+ * raising an error, so that the caller can wake up the backends waiting for
+ * this batch and let them retry on their own.
+ */
+bool ArbiterGetSnapshotBatch(TransactionId *xids, int nXids, Snapshot snapshot, TransactionId *gxmin);
+
 /**
  * Commits transaction only once all participants have called this function,
  * does not change CLOG otherwise. Set 'wait' to 'true' if you want this call
@@ -44,6 +54,29 @@ XidStatus ArbiterSetTransStatus(TransactionId xid, XidStatus status, bool wait);
  */
 XidStatus ArbiterGetTransStatus(TransactionId xid, bool wait);
 
+/**
+ * Asynchronous variant of ArbiterSetTransStatus(): sends the vote and returns
+ * without waiting for the verdict, so the caller can overlap the network
+ * round trip with local work. Returns 'true' if the vote was sent. Collect
+ * the verdict with ArbiterSetTransStatusEnd(). At most one asynchronous
+ * request may be in flight per backend, and no other Arbiter* call may be
+ * made until it completes.
+ */
+bool ArbiterSetTransStatusBegin(TransactionId xid, XidStatus status, bool wait);
+
+/**
+ * Completes ArbiterSetTransStatusBegin(): waits for the verdict and returns
+ * it, or -1 on failure.
+ */
+XidStatus ArbiterSetTransStatusEnd(void);
+
+/**
+ * Returns 'true' once the reply to the asynchronous request in flight is
+ * ready, i.e. the matching ...End() call will not block. Use it to keep
+ * doing local work while the arbiter is thinking.
+ */
+bool ArbiterAsyncResultReady(void);
+
 /**
  * Reserves at least 'nXids' successive xids for local transactions. The xids
  * reserved are not less than 'xid' in value. Returns the actual number of xids
@@ -53,6 +86,15 @@ XidStatus ArbiterGetTransStatus(TransactionId xid, bool wait);
  */
 int ArbiterReserve(TransactionId xid, int nXids, TransactionId *first);
 
+/**
+ * Leases 'amount' successive values of the cluster-wide sequence identified
+ * by 'key' (a hash of the sequence name, chosen by the caller). Fills 'first'
+ * and 'last' on success and returns true. For a given key the leased values
+ * are unique across the whole cluster and grow monotonically, but ranges
+ * leased by different nodes interleave, so the observed values have gaps.
+ */
+bool ArbiterReserveSequence(unsigned key, int amount, long long *first, long long *last);
+
 /**
  * Detect global deadlock. This function sends serialized local resource graph
  * to the arbiter which appends them to the global graph. Once a cycle is
@@ -63,4 +105,11 @@ int ArbiterReserve(TransactionId xid, int nXids, TransactionId *first);
  */
 bool ArbiterDetectDeadLock(int port, TransactionId xid, void* graph, int size);
 
+/**
+ * Writes this backend's recent arbiter round-trip spans (command, send time
+ * and reply wait, in nanoseconds) to the server log. The counterpart of the
+ * arbiter daemon's flight recorder, which is dumped with SIGUSR1.
+ */
+void ArbiterTraceDump(void);
+
 #endif
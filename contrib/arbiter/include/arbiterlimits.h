@@ -16,10 +16,26 @@
 #define SOCKET_BUFFER_SIZE (1024 * 1024)
 
 #define MAX_SERVERS 16
-#define HEARTBEAT_TIMEOUT_MS 20
-#define ELECTION_TIMEOUT_MS_MIN 150
-#define ELECTION_TIMEOUT_MS_MAX 300
+
+/*
+ * Max consensus groups per arbiter process. Each group is an independent raft
+ * quorum replicating the votes of the transactions it owns; group number g
+ * talks over base port + g on every peer.
+ */
+#define MAX_GROUPS 8
+/*
+ * Explicit heartbeats are only sent on channels that have been idle for the
+ * heartbeat timeout; data traffic carries liveness for free. That keeps the
+ * tighter timeouts below from costing bandwidth on a loaded cluster.
+ */
+#define HEARTBEAT_TIMEOUT_MS 10
+#define ELECTION_TIMEOUT_MS_MIN 100
+#define ELECTION_TIMEOUT_MS_MAX 200
 #define RAFT_LOGLEN 1024
 #define RAFT_KEEP_APPLIED 512 /* how many applied entries to keep during compaction */
+#define RAFT_UPDATE_BATCH 64 /* max log entries per update message; mind the MTU */
+#define RAFT_PIPELINE_WINDOW 4 /* max update messages in flight per follower */
+#define RAFT_SNAPSHOT_MAXSIZE (1024 * 1024) /* max serialized state machine snapshot */
+#define RAFT_SNAPSHOT_CHUNK (32 * 1024) /* snapshot bytes per message; must fit a udp datagram */
 
 #endif
@@ -22,6 +22,7 @@ typedef struct clogfile_t {
 	xid_t min;
 	xid_t max;
 	void *data; // ptr for mmap
+	bool dirty; // has unsynced status changes
 } clogfile_t;
 
 // Open a clog file with the gived id. Create before opening if 'create' is
@@ -38,8 +39,13 @@ bool clogfile_close(clogfile_t *clogfile);
 // Get the status of the specified global commit from the clog file.
 int clogfile_get_status(clogfile_t *clogfile, xid_t xid);
 
-// Set the status of the specified global commit in the clog file. Return
-// 'true' on success, 'false' otherwise.
+// Set the status of the specified global commit in the clog file. The change
+// is not durable until clogfile_sync(). Return 'true' on success, 'false'
+// otherwise.
 bool clogfile_set_status(clogfile_t *clogfile, xid_t xid, int status);
 
+// Make the accumulated status changes durable (no-op unless compiled with
+// SYNC or the file is clean). Return 'true' on success, 'false' otherwise.
+bool clogfile_sync(clogfile_t *clogfile);
+
 #endif
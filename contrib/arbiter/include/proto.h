@@ -7,8 +7,10 @@
 #define CMD_FOR      'y'
 #define CMD_AGAINST  'n'
 #define CMD_SNAPSHOT 't'
+#define CMD_SNAPSHOT_BATCH 'T'
 #define CMD_STATUS   's'
 #define CMD_DEADLOCK 'd'
+#define CMD_SEQUENCE 'q'
 
 #define RES_FAILED 0xDEADBEEF
 #define RES_OK 0xC0FFEE
@@ -3,6 +3,7 @@
 
 #include <arpa/inet.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include "arbiterlimits.h"
 
 #define NOBODY -1
@@ -46,6 +47,13 @@ typedef struct raft_entry_t {
 
 typedef void (*raft_applier_t)(int action, int argument);
 
+// serialize the state machine covering arguments in [minarg;maxarg] into
+// 'buf' (at most 'maxlen' bytes); return the size, or -1 if it does not fit
+typedef int (*raft_snapshooter_t)(int minarg, int maxarg, char *buf, int maxlen);
+
+// install a serialized state machine snapshot received from the leader
+typedef bool (*raft_snapshot_applier_t)(int minarg, int maxarg, char *data, int len);
+
 typedef struct raft_log_t {
 	int first;
 	int size;    // number of entries past first
@@ -55,19 +63,37 @@ typedef struct raft_log_t {
 } raft_log_t;
 
 typedef struct raft_server_t {
-	int seqno;  // the rpc sequence number
-	int tosend; // index of the next entry to send
-	int acked;  // index of the highest entry known to be replicated
+	int seqno;        // the rpc sequence number of the last sent message
+	int lastackseqno; // the seqno of the last accepted reply
+	int tosend;       // index of the next entry to send
+	int acked;        // index of the highest entry known to be replicated
+	int silence;      // ms since we last sent anything to this server
+	int snapoffset;   // next snapshot byte to send, when the follower is
+	                  // so far behind that it needs a snapshot
 
 	char *host;
 	int port;
 	struct sockaddr_in addr;
 } raft_server_t;
 
+// a serialized state machine snapshot being sent or reassembled
+typedef struct raft_snapshot_t {
+	bool valid;
+	int index;  // log index of the snapshot entry it corresponds to
+	int term;   // term of that entry
+	int minarg;
+	int maxarg;
+	int size;   // total serialized size
+	int offset; // reassembly progress (unused on the sending side)
+	char data[RAFT_SNAPSHOT_MAXSIZE];
+} raft_snapshot_t;
+
 typedef struct raft_t {
 	int term;   // current term (latest term we have seen)
 	int vote;   // who received our vote in current term
 	int role;
+	bool campaign_ok; // may this node start an election? used by main.c to
+	                  // anchor the leadership of all groups to one node
 	int me;     // my id
 	int votes;  // how many votes are for me (if candidate)
 	int leader; // the id of the leader
@@ -81,14 +107,23 @@ typedef struct raft_t {
 	int timer;
 
 	raft_applier_t applier;
+
+	raft_snapshooter_t snapshooter;        // NULL disables snapshot transfer
+	raft_snapshot_applier_t snapapplier;
+	raft_snapshot_t outsnap; // leader: cached serialized snapshot
+	raft_snapshot_t insnap;  // follower: snapshot being reassembled
 } raft_t;
 
 #define RAFT_LOG(RAFT, INDEX) ((RAFT)->log.entries[(INDEX) % (RAFT_LOGLEN)])
 
-#define RAFT_MSG_UPDATE 0 // append entry
-#define RAFT_MSG_DONE   1 // entry appended
-#define RAFT_MSG_CLAIM  2 // vote for me
-#define RAFT_MSG_VOTE   3 // my vote
+#define RAFT_MSG_UPDATE   0 // append entry
+#define RAFT_MSG_DONE     1 // entry appended
+#define RAFT_MSG_CLAIM    2 // vote for me
+#define RAFT_MSG_VOTE     3 // my vote
+#define RAFT_MSG_SNAPSHOT 4 // install a snapshot chunk
+#define RAFT_MSG_SNAPPED  5 // snapshot chunk installed
+
+#define RAFT_MSG_MAX      6
 
 typedef struct raft_msg_t {
 	int msgtype;
@@ -99,15 +134,20 @@ typedef struct raft_msg_t {
 
 typedef struct raft_msg_update_t {
 	raft_msg_t msg;
-	int previndex; // the index of the preceding log entry
-	int prevterm;  // the term of the preceding log entry
-
-	bool empty;    // the message is just a heartbeat if empty
-	raft_entry_t entry;
+	int previndex; // the index of the log entry preceding the batch
+	int prevterm;  // the term of the log entry preceding the batch
 
 	int acked;     // the leader's acked number
+
+	bool empty;    // the message is just a heartbeat if empty
+	int nentries;  // number of entries in the batch
+	raft_entry_t entries[RAFT_UPDATE_BATCH]; // only the first 'nentries' are sent
 } raft_msg_update_t;
 
+// the on-wire size of an update message carrying NENTRIES entries
+#define RAFT_MSG_UPDATE_SIZE(NENTRIES) \
+	(offsetof(raft_msg_update_t, entries) + (NENTRIES) * sizeof(raft_entry_t))
+
 typedef struct raft_msg_done_t {
 	raft_msg_t msg;
 	int index; // the index of the appended entry
@@ -115,6 +155,31 @@ typedef struct raft_msg_done_t {
 	bool success;
 } raft_msg_done_t;
 
+// InstallSnapshot: the state machine serialized by the leader is transferred
+// in chunks; the snapshot log entry itself is installed by the follower when
+// the last chunk arrives, truncating everything before it
+typedef struct raft_msg_snapshot_t {
+	raft_msg_t msg;
+	int index;     // log index of the snapshot entry
+	int term;      // term of the snapshot entry
+	int minarg;    // as in the snapshot entry
+	int maxarg;
+	int totalsize; // total serialized snapshot size
+	int offset;    // offset of this chunk
+	int nbytes;    // bytes in this chunk
+	char data[RAFT_SNAPSHOT_CHUNK];
+} raft_msg_snapshot_t;
+
+// the on-wire size of a snapshot message carrying NBYTES bytes
+#define RAFT_MSG_SNAPSHOT_SIZE(NBYTES) \
+	(offsetof(raft_msg_snapshot_t, data) + (NBYTES))
+
+typedef struct raft_msg_snapped_t {
+	raft_msg_t msg;
+	int offset; // the next byte the follower expects
+	bool success;
+} raft_msg_snapped_t;
+
 typedef struct raft_msg_claim_t {
 	raft_msg_t msg;
 	int index; // the index of my last entry
@@ -130,6 +195,11 @@ typedef struct raft_msg_vote_t {
 void raft_init(raft_t *r);
 bool raft_add_server(raft_t *r, char *host, int port);
 bool raft_set_myid(raft_t *r, int myid);
+void raft_set_snapshot_handlers(
+	raft_t *r,
+	raft_snapshooter_t snapshooter,
+	raft_snapshot_applier_t snapapplier
+);
 
 // log actions
 bool raft_emit(raft_t *r, int action, int argument);
@@ -2,6 +2,7 @@
 #define SERVER_H
 
 #include <stdbool.h>
+#include <stdio.h>
 #include "int.h"
 
 /*
@@ -28,6 +29,14 @@ typedef void (*onconnect_callback_t)(client_t client);
  */
 typedef void (*ondisconnect_callback_t)(client_t client);
 
+/*
+ * The server will call this function right before sending buffered replies
+ * over a socket. Use it to make the acknowledged state durable in one batch
+ * (group commit): the callback runs once per flush, however many replies got
+ * buffered.
+ */
+typedef void (*onflush_callback_t)(void);
+
 /*
  * Creates a new server that will listen on 'host:port' and call the specified
  * callbacks. Returns the server handle to use in other methods.
@@ -41,10 +50,19 @@ server_t server_init(
 );
 
 /*
- * Assigns the given raft socket to the server. The server will add the socket
- * to the 'select' calls and give you the incoming messages.
+ * Registers a raft socket with the server. The server will add the socket to
+ * the 'select' calls and report its readiness through the server_tick()
+ * result. Up to MAX_GROUPS sockets can be registered; returns the index of
+ * the registered socket (its bit position in the server_tick() mask), or -1
+ * on failure.
+ */
+int server_add_raft_socket(server_t server, int sock);
+
+/*
+ * Sets the callback invoked before buffered replies are sent. Pass NULL to
+ * remove it.
  */
-void server_set_raft_socket(server_t server, int sock);
+void server_set_onflush(server_t server, onflush_callback_t onflush);
 
 /*
  * Starts the server. Returns 'true' on success, 'false' otherwise.
@@ -52,10 +70,24 @@ void server_set_raft_socket(server_t server, int sock);
 bool server_start(server_t server);
 
 /*
- * The main server loop. Returns true if there is a raft message ready, or NULL
- * if timed out. Use the callbacks and signal handlers to add more logic.
+ * Additionally listens on a unix socket at 'path', so backends co-located
+ * with the arbiter can skip the loopback TCP stack. Call after
+ * server_start(). Returns 'true' on success, 'false' otherwise.
+ */
+bool server_listen_unix(server_t server, char *path);
+
+/*
+ * The main server loop. Returns a mask with bit i set when the i-th
+ * registered raft socket has a message ready, or 0 if none (e.g. on timeout).
+ * Use the callbacks and signal handlers to add more logic.
+ */
+int server_tick(server_t server, int timeout_ms);
+
+/*
+ * Dumps the in-memory flight recorder (nanosecond-stamped receive, dispatch
+ * and flush events of the last few thousand messages) to 'out'.
  */
-bool server_tick(server_t server, int timeout_ms);
+void server_dump_trace(FILE *out);
 
 /*
  * Closes all client connections on the server and refuses to accept new ones.
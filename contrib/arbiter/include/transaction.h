@@ -17,7 +17,6 @@ typedef struct L2List
 
 typedef struct Transaction {
     L2List elem;
-    struct Transaction* collision;
 	xid_t xid;
     xid_t xmin;
 
@@ -0,0 +1,365 @@
+/*
+ * Benchmark client for sockhub: measures message throughput and round-trip
+ * latency for a configurable number of connections, payload size and number
+ * of in-flight messages per connection, and emits one machine-readable CSV
+ * line per run.  Use it either against bench-server directly or through a
+ * sockhub instance (host "localhost" connects to the /tmp/pPORT unix socket,
+ * like test-client).  See run-bench.sh for sweeping a parameter grid.
+ */
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/utsname.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <netdb.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stddef.h>
+#include <assert.h>
+
+#include "sockhub.h"
+
+#define MAX_CONNECT_ATTEMPTS 10
+#define MAX_WINDOW 1024
+
+/*
+ * Power-of-two round-trip latency histogram: bucket B counts round trips
+ * that took less than 2^B microseconds.
+ */
+#define LATENCY_BUCKETS 32
+
+typedef struct
+{
+    int sd;
+    int inflight;
+    long sent;
+    long received;
+    long stamps[MAX_WINDOW]; /* send timestamps of in-flight messages, FIFO */
+    int stamp_head;
+    int stamp_tail;
+} Connection;
+
+static long latency_hist[LATENCY_BUCKETS];
+static long latency_max;
+static long latency_sum;
+
+static long now_usec(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long)tv.tv_sec*1000000 + tv.tv_usec;
+}
+
+static void record_latency(long usec)
+{
+    int bucket = 0;
+    long us = usec;
+    while (us > 0 && bucket < LATENCY_BUCKETS-1) {
+        us >>= 1;
+        bucket += 1;
+    }
+    latency_hist[bucket] += 1;
+    latency_sum += usec;
+    if (usec > latency_max) {
+        latency_max = usec;
+    }
+}
+
+static long latency_percentile(double percent)
+{
+    long total = 0;
+    long seen = 0;
+    int b;
+    for (b = 0; b < LATENCY_BUCKETS; b++) {
+        total += latency_hist[b];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    for (b = 0; b < LATENCY_BUCKETS; b++) {
+        seen += latency_hist[b];
+        if ((double)seen * 100.0 >= (double)total * percent) {
+            break;
+        }
+    }
+    return 1L << b;
+}
+
+static int resolve_host_by_name(const char *hostname, unsigned* addrs, unsigned* n_addrs)
+{
+    struct sockaddr_in sin;
+    struct hostent* hp;
+    unsigned i;
+
+    sin.sin_addr.s_addr = inet_addr(hostname);
+    if (sin.sin_addr.s_addr != INADDR_NONE) {
+        memcpy(&addrs[0], &sin.sin_addr.s_addr, sizeof(sin.sin_addr.s_addr));
+        *n_addrs = 1;
+        return 1;
+    }
+
+    hp = gethostbyname(hostname);
+    if (hp == NULL || hp->h_addrtype != AF_INET) {
+        return 0;
+    }
+    for (i = 0; hp->h_addr_list[i] != NULL && i < *n_addrs; i++) {
+        memcpy(&addrs[i], hp->h_addr_list[i], sizeof(addrs[i]));
+    }
+    *n_addrs = i;
+    return 1;
+}
+
+static int connect_to_server(char const* host, int port, int max_attempts)
+{
+    struct sockaddr_in sock_inet;
+    unsigned addrs[128];
+    unsigned i, n_addrs = sizeof(addrs) / sizeof(addrs[0]);
+    int rc;
+    int sd;
+
+    if (strcmp(host, "localhost") == 0) {
+        struct sockaddr sock;
+        int len = offsetof(struct sockaddr, sa_data) + sprintf(sock.sa_data, "/tmp/p%u", port);
+        sock.sa_family = AF_UNIX;
+        sd = socket(sock.sa_family,  SOCK_STREAM, 0);
+        if (sd < 0) {
+            return -1;
+        }
+
+        while (1) {
+            do {
+                rc = connect(sd, &sock, len);
+            } while (rc < 0 && errno == EINTR);
+
+             if (rc < 0) {
+                if (errno != ENOENT && errno != ECONNREFUSED && errno != EINPROGRESS) {
+                    return -1;
+                }
+                if (max_attempts-- != 0) {
+                    sleep(1);
+                } else {
+                    return -1;
+                }
+             } else {
+                 break;
+             }
+        }
+    } else {
+        sock_inet.sin_family = AF_INET;
+        sock_inet.sin_port = htons(port);
+        if (!resolve_host_by_name(host, addrs, &n_addrs)) {
+            return -1;
+        }
+        sd = socket(AF_INET, SOCK_STREAM, 0);
+        if (sd < 0) {
+            return -1;
+        }
+        while (1) {
+            int rc = -1;
+            for (i = 0; i < n_addrs; ++i) {
+                memcpy(&sock_inet.sin_addr, &addrs[i], sizeof sock_inet.sin_addr);
+                do {
+                    rc = connect(sd, (struct sockaddr*)&sock_inet, sizeof(sock_inet));
+                } while (rc < 0 && errno == EINTR);
+
+                if (rc >= 0 || errno == EINPROGRESS) {
+                    break;
+                }
+            }
+            if (rc < 0) {
+                if (errno != ENOENT && errno != ECONNREFUSED && errno != EINPROGRESS) {
+                    return -1;
+                }
+                if (max_attempts-- != 0) {
+                    sleep(1);
+                } else {
+                    return -1;
+                }
+            } else {
+                int optval = 1;
+                setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, (char const*)&optval, sizeof(int));
+                break;
+            }
+        }
+    }
+    return sd;
+}
+
+int main(int argc, char* argv[])
+{
+    char const* host;
+    int port;
+    int n_connections = 1;
+    int n_iterations = 10000;
+    int payload = sizeof(int);
+    int window = 1;
+    char const* label = "sockhub";
+    char const* csv_file = NULL;
+    Connection* conns;
+    char* msg_buf;
+    int msg_size;
+    int i;
+    int rc;
+    long total;
+    long received = 0;
+    long start;
+    long elapsed;
+    fd_set inset;
+    int max_fd = 0;
+
+    if (argc < 3) {
+      Usage:
+        fprintf(stderr, "Usage: ./bench-client HOST PORT [OPTIONS]\n"
+                "Options:\n"
+                "\t-c N\tnumber of connections (1)\n"
+                "\t-n N\tnumber of messages per connection (10000)\n"
+                "\t-s N\tpayload size in bytes (4)\n"
+                "\t-w N\tmessages in flight per connection (1)\n"
+                "\t-L STR\tlabel for CSV output\n"
+                "\t-o FILE\tappend a CSV result line to FILE\n");
+        return 1;
+    }
+    host = argv[1];
+    port = atoi(argv[2]);
+    for (i = 3; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            switch (argv[i][1]) {
+              case 'c':
+                n_connections = atoi(argv[++i]);
+                continue;
+              case 'n':
+                n_iterations = atoi(argv[++i]);
+                continue;
+              case 's':
+                payload = atoi(argv[++i]);
+                continue;
+              case 'w':
+                window = atoi(argv[++i]);
+                continue;
+              case 'L':
+                label = argv[++i];
+                continue;
+              case 'o':
+                csv_file = argv[++i];
+                continue;
+            }
+        }
+        goto Usage;
+    }
+    if (payload < (int)sizeof(int)) {
+        payload = sizeof(int);
+    }
+    if (window < 1 || window > MAX_WINDOW) {
+        fprintf(stderr, "Window must be in 1..%d\n", MAX_WINDOW);
+        return 1;
+    }
+
+    msg_size = sizeof(ShubMessageHdr) + payload;
+    msg_buf = (char*)malloc(msg_size);
+    memset(msg_buf, '?', msg_size);
+
+    conns = (Connection*)calloc(n_connections, sizeof(Connection));
+    FD_ZERO(&inset);
+    for (i = 0; i < n_connections; i++) {
+        conns[i].sd = connect_to_server(host, port, MAX_CONNECT_ATTEMPTS);
+        if (conns[i].sd < 0) {
+            perror("Failed to connect to socket");
+            return 1;
+        }
+        FD_SET(conns[i].sd, &inset);
+        if (conns[i].sd > max_fd) {
+            max_fd = conns[i].sd;
+        }
+    }
+
+    total = (long)n_connections * n_iterations;
+    start = now_usec();
+
+    while (received < total) {
+        fd_set events;
+        for (i = 0; i < n_connections; i++) {
+            Connection* c = &conns[i];
+            while (c->inflight < window && c->sent < n_iterations) {
+                ShubMessageHdr* hdr = (ShubMessageHdr*)msg_buf;
+                hdr->code = MSG_FIRST_USER_CODE;
+                hdr->size = payload;
+                hdr->chan = 0;
+                c->stamps[c->stamp_tail] = now_usec();
+                c->stamp_tail = (c->stamp_tail + 1) % MAX_WINDOW;
+                rc = ShubWriteSocket(c->sd, msg_buf, msg_size);
+                assert(rc);
+                c->sent += 1;
+                c->inflight += 1;
+            }
+        }
+        events = inset;
+        rc = select(max_fd+1, &events, NULL, NULL, NULL);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Failed to select socket");
+            return 1;
+        }
+        for (i = 0; i < n_connections; i++) {
+            Connection* c = &conns[i];
+            if (c->inflight != 0 && FD_ISSET(c->sd, &events)) {
+                /*
+                 * The server echoes messages in order, so the oldest
+                 * timestamp always belongs to the message just received.
+                 */
+                rc = ShubReadSocket(c->sd, msg_buf, msg_size);
+                assert(rc);
+                record_latency(now_usec() - c->stamps[c->stamp_head]);
+                c->stamp_head = (c->stamp_head + 1) % MAX_WINDOW;
+                c->inflight -= 1;
+                c->received += 1;
+                received += 1;
+            }
+        }
+    }
+
+    elapsed = now_usec() - start;
+    if (elapsed == 0) {
+        elapsed = 1;
+    }
+
+    {
+        double msg_per_sec = (double)total * 1000000 / elapsed;
+        double mb_per_sec = msg_per_sec * msg_size / (1024*1024);
+        long avg = latency_sum / total;
+        long p50 = latency_percentile(50);
+        long p99 = latency_percentile(99);
+
+        printf("%ld messages of %d bytes on %d connections (window %d) in %f sec: "
+               "%f msg/sec, %f Mb/sec, latency avg=%ld p50<%ld p99<%ld max=%ld usec\n",
+               total, msg_size, n_connections, window, (double)elapsed/1000000,
+               msg_per_sec, mb_per_sec, avg, p50, p99, latency_max);
+
+        if (csv_file != NULL) {
+            FILE* f = fopen(csv_file, "a");
+            if (f == NULL) {
+                perror("Failed to open CSV file");
+                return 1;
+            }
+            if (ftell(f) == 0) {
+                fprintf(f, "label,connections,window,payload,messages,elapsed_usec,"
+                        "msg_per_sec,mb_per_sec,avg_usec,p50_usec,p99_usec,max_usec\n");
+            }
+            fprintf(f, "%s,%d,%d,%d,%ld,%ld,%f,%f,%ld,%ld,%ld,%ld\n",
+                    label, n_connections, window, payload, total, elapsed,
+                    msg_per_sec, mb_per_sec, avg, p50, p99, latency_max);
+            fclose(f);
+        }
+    }
+    return 0;
+}
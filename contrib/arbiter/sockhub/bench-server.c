@@ -0,0 +1,138 @@
+/*
+ * Echo server for bench-client.  Unlike test-server it handles messages of
+ * any size: each message is read completely and sent back unchanged, so the
+ * chan assigned by sockhub survives the round trip and responses are routed
+ * back to the right local connection.
+ */
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/utsname.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <netdb.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "sockhub.h"
+
+#define BUFFER_SIZE 64*1024
+#define LISTEN_QUEUE_SIZE 100
+
+int main(int argc, char* argv[])
+{
+    int sd;
+    int i;
+    int max_fd;
+    struct sockaddr_in sock;
+    fd_set inset;
+    int port;
+    int optval = 1;
+    char buf[BUFFER_SIZE];
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: ./bench-server PORT\n");
+        return 1;
+    }
+    port = atoi(argv[1]);
+
+    sd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sd < 0) {
+        perror("Failed to connect to socket");
+        return 1;
+    }
+    setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, (char const*)&optval, sizeof(optval));
+    setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, (char const*)&optval, sizeof(optval));
+
+    sock.sin_family = AF_INET;
+    sock.sin_addr.s_addr = htonl(INADDR_ANY);
+    sock.sin_port = htons(port);
+    if (bind(sd, (struct sockaddr*)&sock, sizeof(sock))) {
+        perror("Failed to bind socket");
+        return 1;
+    }
+    if (listen(sd, LISTEN_QUEUE_SIZE) < 0) {
+        perror("Failed to listen socket");
+        return 1;
+    }
+    FD_ZERO(&inset);
+    FD_SET(sd, &inset);
+    max_fd = sd;
+
+    while (1) {
+        fd_set events = inset;
+        int rc = select(max_fd+1, &events, NULL, NULL, NULL);
+        if (rc > 0) {
+            for (i = 0; i <= max_fd; i++) {
+                if (FD_ISSET(i, &events)) {
+                    if (i == sd) {
+                        int s = accept(sd, NULL, NULL);
+                        if (s < 0) {
+                            perror("Failed to accept socket");
+                        } else {
+                            FD_SET(s, &inset);
+                            if (s > max_fd) {
+                                max_fd = s;
+                            }
+                        }
+                    } else {
+                        int available = ShubReadSocketEx(i, buf, sizeof(ShubMessageHdr), sizeof(buf));
+                        if (available >= (int)sizeof(ShubMessageHdr)) {
+                            int pos = 0;
+                            while (pos < available) {
+                                ShubMessageHdr* hdr;
+                                int msg_size;
+                                if (pos + (int)sizeof(ShubMessageHdr) > available) {
+                                    rc = ShubReadSocket(i, buf + available, pos + sizeof(ShubMessageHdr) - available);
+                                    assert(rc);
+                                    available = pos + sizeof(ShubMessageHdr);
+                                }
+                                hdr = (ShubMessageHdr*)&buf[pos];
+                                if (hdr->code == MSG_DISCONNECT) {
+                                    assert(hdr->size == 0);
+                                    memmove(buf + pos, buf + pos + sizeof(ShubMessageHdr), available - pos - sizeof(ShubMessageHdr));
+                                    available -= sizeof(ShubMessageHdr);
+                                    continue;
+                                }
+                                msg_size = sizeof(ShubMessageHdr) + hdr->size;
+                                assert(msg_size <= (int)sizeof(buf));
+                                if (pos + msg_size > (int)sizeof(buf)) {
+                                    /*
+                                     * Message doesn't fit in the buffer tail: echo the
+                                     * complete messages accumulated so far, then shift
+                                     * it to the beginning.
+                                     */
+                                    rc = ShubWriteSocket(i, buf, pos);
+                                    assert(rc);
+                                    memmove(buf, buf + pos, available - pos);
+                                    available -= pos;
+                                    pos = 0;
+                                }
+                                if (pos + msg_size > available) {
+                                    rc = ShubReadSocket(i, buf + available, pos + msg_size - available);
+                                    assert(rc);
+                                    available = pos + msg_size;
+                                }
+                                pos += msg_size;
+                            }
+                            rc = ShubWriteSocket(i, buf, pos);
+                            assert(rc);
+                        } else {
+                            perror("Failed to read socket");
+                            close(i);
+                            FD_CLR(i, &inset);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#!/bin/sh
+# Sweep bench-client over message sizes, connection counts and sockhub
+# buffer sizes, collecting everything into one CSV file.  Without arguments
+# everything runs on this host; pass a host name to benchmark across the
+# network (bench-server and sockhub must already run there).
+host=${1:-127.0.0.1}
+port=5001
+hub_port=5002
+n_iters=${N_ITERS:-100000}
+out=${OUT:-bench-results.csv}
+
+rm -f $out
+
+local_run=""
+if [ "$host" = "127.0.0.1" ]; then
+    local_run=yes
+    ./bench-server $port &
+    server_pid=$!
+    sleep 1
+fi
+
+# direct connections to the server, bypassing sockhub
+for size in 4 64 1024 8192; do
+    for conns in 1 10 50; do
+        ./bench-client $host $port -c $conns -s $size -n $n_iters -L direct -o $out
+        ./bench-client $host $port -c $conns -s $size -n $n_iters -w 32 -L direct -o $out
+    done
+done
+
+# through sockhub with different buffer sizes
+for bufsize in 4096 65536 1048576; do
+    if [ -n "$local_run" ]; then
+        ./sockhub -h $host:$port -f /tmp/p$hub_port -b $bufsize &
+        hub_pid=$!
+        sleep 1
+    fi
+    for size in 4 64 1024 8192; do
+        for conns in 1 10 50; do
+            ./bench-client localhost $hub_port -c $conns -s $size -n $n_iters -L sockhub-b$bufsize -o $out
+            ./bench-client localhost $hub_port -c $conns -s $size -n $n_iters -w 32 -L sockhub-b$bufsize -o $out
+        done
+    done
+    if [ -n "$local_run" ]; then
+        kill $hub_pid
+        rm -f /tmp/p$hub_port
+    fi
+done
+
+if [ -n "$local_run" ]; then
+    kill $server_pid
+fi
+
+echo "Results written to $out"
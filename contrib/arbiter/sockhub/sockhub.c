@@ -61,6 +61,7 @@ void ShubInitParams(ShubParams* params)
     memset(params, 0, sizeof(*params));
     params->buffer_size = 64*1024;
     params->queue_size = 100;
+    params->chan_queue_size = 1024*1024;
     params->max_attempts = 10;
     params->error_handler = default_error_handler;
     params->leader = NULL;
@@ -145,6 +146,71 @@ static int resolve_host_by_name(const char *hostname, unsigned* addrs, unsigned*
 
 
 
+/*
+ * Enable or disable polling of the peer socket for input. It is disabled
+ * while some channel queue is overloaded: the hub stops fetching responses,
+ * the peer's send buffer fills up and the pressure propagates back to the
+ * producing backends instead of ballooning hub memory.
+ */
+static void enable_peer_input(Shub* shub, int enable)
+{
+    if (shub->output < 0) {
+        return;
+    }
+#ifdef USE_EPOLL
+    {
+        struct epoll_event ev;
+        ev.events = enable ? EPOLLIN : 0;
+        ev.data.fd = shub->output;
+        if (epoll_ctl(shub->epollfd, EPOLL_CTL_MOD, shub->output, &ev) < 0) {
+            shub->params->error_handler("Failed to modify epoll set", SHUB_RECOVERABLE_ERROR);
+        }
+    }
+#else
+    if (enable) {
+        FD_SET(shub->output, &shub->inset);
+    } else {
+        FD_CLR(shub->output, &shub->inset);
+    }
+#endif
+}
+
+/* Enable or disable polling of a local channel for write readiness */
+static void watch_chan_output(Shub* shub, int chan, int enable)
+{
+#ifdef USE_EPOLL
+    struct epoll_event ev;
+    ev.events = EPOLLIN | (enable ? EPOLLOUT : 0);
+    ev.data.fd = chan;
+    if (epoll_ctl(shub->epollfd, EPOLL_CTL_MOD, chan, &ev) < 0) {
+        shub->params->error_handler("Failed to modify epoll set", SHUB_RECOVERABLE_ERROR);
+    }
+#else
+    if (enable) {
+        FD_SET(chan, &shub->outset);
+    } else {
+        FD_CLR(chan, &shub->outset);
+    }
+#endif
+}
+
+static ShubChanBuffer* chan_buffer(Shub* shub, int chan)
+{
+    if (chan >= shub->max_chans) {
+        int n = shub->max_chans ? shub->max_chans*2 : 64;
+        while (n <= chan) {
+            n *= 2;
+        }
+        shub->chans = realloc(shub->chans, n*sizeof(ShubChanBuffer));
+        if (shub->chans == NULL) {
+            shub->params->error_handler("Failed to allocate channel buffer array", SHUB_FATAL_ERROR);
+        }
+        memset(shub->chans + shub->max_chans, 0, (n - shub->max_chans)*sizeof(ShubChanBuffer));
+        shub->max_chans = n;
+    }
+    return &shub->chans[chan];
+}
+
 static void close_socket(Shub* shub, int fd)
 {
 #ifdef USE_EPOLL
@@ -152,10 +218,24 @@ static void close_socket(Shub* shub, int fd)
         char buf[ERR_BUF_SIZE];
         sprintf(buf, "Failed to remove socket %d from epoll set", fd);
         shub->params->error_handler(buf, SHUB_RECOVERABLE_ERROR);
-    }           
+    }
 #else
     FD_CLR(fd, &shub->inset);
+    FD_CLR(fd, &shub->outset);
 #endif
+    if (fd < shub->max_chans) {
+        ShubChanBuffer* cb = &shub->chans[fd];
+        free(cb->data);
+        cb->data = NULL;
+        cb->size = 0;
+        cb->used = 0;
+        if (cb->overloaded) {
+            cb->overloaded = 0;
+            if (--shub->n_overloaded == 0) {
+                enable_peer_input(shub, 1);
+            }
+        }
+    }
     close(fd);
 }
 
@@ -256,6 +336,10 @@ static void reconnect(Shub* shub)
 				setsockopt(shub->output, SOL_SOCKET, SO_RCVBUF, (const char*) &optval, sizeof(int));
 
                 ShubAddSocket(shub, shub->output);
+                if (shub->n_overloaded != 0) {
+                    /* some channel queue is still over limit: keep peer input paused */
+                    enable_peer_input(shub, 0);
+                }
                 return;
             }
         }
@@ -281,6 +365,100 @@ static void notify_disconnect(Shub* shub, int chan)
     }
 }
 
+/*
+ * Send a response to a local channel without blocking the hub loop. Whatever
+ * the socket does not accept immediately is queued in the per-channel buffer
+ * and flushed later when the socket reports write readiness. When the queue
+ * of some channel exceeds chan_queue_size reading from the peer is paused
+ * until it drains, so the memory used by slow channels stays bounded.
+ * Returns zero on socket failure (the caller is expected to close the
+ * channel as for a failed ShubWriteSocket).
+ */
+static int write_to_channel(Shub* shub, int chan, char const* data, int size)
+{
+    ShubChanBuffer* cb = chan_buffer(shub, chan);
+
+    if (cb->used == 0) {
+        /* no backlog: write directly until the socket would block */
+        while (size != 0) {
+            int n = send(chan, data, size, MSG_DONTWAIT);
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            if (n <= 0) {
+                return 0;
+            }
+            data += n;
+            size -= n;
+        }
+        if (size == 0) {
+            return 1;
+        }
+        watch_chan_output(shub, chan, 1);
+    }
+    if (cb->used + size > cb->size) {
+        int n = cb->size ? cb->size*2 : 8192;
+        while (n < cb->used + size) {
+            n *= 2;
+        }
+        cb->data = realloc(cb->data, n);
+        if (cb->data == NULL) {
+            shub->params->error_handler("Failed to allocate channel buffer", SHUB_FATAL_ERROR);
+        }
+        cb->size = n;
+    }
+    memcpy(cb->data + cb->used, data, size);
+    cb->used += size;
+    if (!cb->overloaded && cb->used > shub->params->chan_queue_size) {
+        cb->overloaded = 1;
+        if (shub->n_overloaded++ == 0) {
+            enable_peer_input(shub, 0);
+        }
+    }
+    return 1;
+}
+
+/*
+ * Flush the pending queue of a channel which became writable. Only as much
+ * as the socket accepts right now is sent, so one draining channel can not
+ * monopolize the loop. Returns zero if the channel failed and was closed.
+ */
+static int flush_channel(Shub* shub, int chan)
+{
+    ShubChanBuffer* cb;
+    int sent = 0;
+
+    if (chan >= shub->max_chans) {
+        return 1;
+    }
+    cb = &shub->chans[chan];
+    while (sent < cb->used) {
+        int n = send(chan, cb->data + sent, cb->used - sent, MSG_DONTWAIT);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n <= 0) {
+            shub->params->error_handler("Failed to write to local socket", SHUB_RECOVERABLE_ERROR);
+            close_socket(shub, chan);
+            notify_disconnect(shub, chan);
+            return 0;
+        }
+        sent += n;
+    }
+    memmove(cb->data, cb->data + sent, cb->used - sent);
+    cb->used -= sent;
+    if (cb->used == 0) {
+        watch_chan_output(shub, chan, 0);
+    }
+    if (cb->overloaded && cb->used <= shub->params->chan_queue_size/2) {
+        cb->overloaded = 0;
+        if (--shub->n_overloaded == 0) {
+            enable_peer_input(shub, 1);
+        }
+    }
+    return 1;
+}
+
 static void recovery(Shub* shub)
 {
 #ifndef USE_EPOLL
@@ -324,6 +502,9 @@ void ShubInitialize(Shub* shub, ShubParams* params)
         shub->params->error_handler("Failed to listen local socket", SHUB_FATAL_ERROR);
     }
     shub->output = -1;
+    shub->chans = NULL;
+    shub->max_chans = 0;
+    shub->n_overloaded = 0;
 #ifdef USE_EPOLL
     shub->epollfd = epoll_create(MAX_EVENTS);
     if (shub->epollfd < 0) { 
@@ -331,6 +512,7 @@ void ShubInitialize(Shub* shub, ShubParams* params)
     }   
 #else
     FD_ZERO(&shub->inset);
+    FD_ZERO(&shub->outset);
     shub->max_fd = 0;
 #endif
     ShubAddSocket(shub, shub->input);
@@ -364,18 +546,26 @@ void ShubLoop(Shub* shub)
 
     while (!stop) { 
         int i, rc;
+        /*
+         * Adaptive flush policy: while the output buffer is empty we can wait
+         * indefinitely, but once something is staged we only poll, so the
+         * buffer is flushed as soon as no backend has more data queued
+         * instead of after a fixed delay.
+         */
 #ifdef USE_EPOLL
         struct epoll_event events[MAX_EVENTS];
-        rc = epoll_wait(shub->epollfd, events, MAX_EVENTS, shub->in_buffer_used == 0 ? -1 : shub->params->delay);
+        rc = epoll_wait(shub->epollfd, events, MAX_EVENTS, shub->in_buffer_used == 0 ? -1 : 0);
 #else
         fd_set events;
+        fd_set outevents;
         struct timeval tm;
         int max_fd = shub->max_fd;
 
-        tm.tv_sec = shub->params->delay/1000;
-        tm.tv_usec = shub->params->delay % 1000 * 1000;
+        tm.tv_sec = 0;
+        tm.tv_usec = 0;
         events = shub->inset;
-        rc = select(max_fd+1, &events, NULL, NULL, shub->in_buffer_used == 0 ? NULL : &tm);
+        outevents = shub->outset;
+        rc = select(max_fd+1, &events, &outevents, NULL, shub->in_buffer_used == 0 ? NULL : &tm);
 #endif
         if (rc < 0) { 
             if (errno != EINTR) {                
@@ -398,9 +588,14 @@ void ShubLoop(Shub* shub)
                             notify_disconnect(shub, i);
                             close_socket(shub, i);
                         }
-                    } else if (events[j].events & EPOLLIN) { 
+                    } else if ((events[j].events & EPOLLOUT) && !flush_channel(shub, i)) {
+                        /* channel failed while flushing its queue */
+                    } else if (events[j].events & EPOLLIN) {
 #else
                 for (i = 0; i <= max_fd; i++) {
+                    if (FD_ISSET(i, &outevents) && !flush_channel(shub, i)) {
+                        continue; /* channel failed while flushing its queue */
+                    }
                     if (FD_ISSET(i, &events)) {
 #endif
                         if (i == shub->input) { /* accept incomming connection */ 
@@ -431,7 +626,7 @@ void ShubLoop(Shub* shub)
                                 pos += sizeof(ShubMessageHdr) + hdr->size;
                                 if (firstHdr != NULL && (firstHdr->chan != chan || pos > available)) {
                                     assert(hdr > firstHdr);
-                                    if (!ShubWriteSocket(firstHdr->chan, firstHdr, (char*)hdr - (char*)firstHdr)) {
+                                    if (!write_to_channel(shub, firstHdr->chan, (char*)firstHdr, (char*)hdr - (char*)firstHdr)) {
                                         shub->params->error_handler("Failed to write to local socket", SHUB_RECOVERABLE_ERROR);
                                         close_socket(shub, firstHdr->chan);
                                         notify_disconnect(shub, firstHdr->chan);
@@ -449,7 +644,7 @@ void ShubLoop(Shub* shub)
                                     } else {
                                         /* read rest of message if it doesn't fit in the buffer */
                                         int tail = pos - available;
-                                        if (!ShubWriteSocket(chan, hdr, available)) {
+                                        if (!write_to_channel(shub, chan, (char*)hdr, available)) {
                                             shub->params->error_handler("Failed to write to local socket", SHUB_RECOVERABLE_ERROR);
                                             close_socket(shub, chan);
                                             chan = -1;
@@ -461,7 +656,7 @@ void ShubLoop(Shub* shub)
                                                 reconnect(shub);
                                                 continue;
                                             }
-                                            if (chan >= 0 && !ShubWriteSocket(chan, shub->out_buffer, n)) {
+                                            if (chan >= 0 && !write_to_channel(shub, chan, shub->out_buffer, n)) {
                                                 shub->params->error_handler("Failed to write to local socket", SHUB_RECOVERABLE_ERROR);
                                                 close_socket(shub, chan);
                                                 notify_disconnect(shub, chan);
@@ -477,7 +672,7 @@ void ShubLoop(Shub* shub)
                             }
                             if (firstHdr != NULL) {
                                assert(&shub->out_buffer[pos] > (char*)firstHdr);
-                                if (!ShubWriteSocket(firstHdr->chan, firstHdr, &shub->out_buffer[pos] - (char*)firstHdr)) {
+                                if (!write_to_channel(shub, firstHdr->chan, (char*)firstHdr, &shub->out_buffer[pos] - (char*)firstHdr)) {
                                     shub->params->error_handler("Failed to write to local socket", SHUB_RECOVERABLE_ERROR);
                                     close_socket(shub, firstHdr->chan);
                                     notify_disconnect(shub, firstHdr->chan);
@@ -587,9 +782,13 @@ void ShubLoop(Shub* shub)
                         }
                     }
                 }
-                if (shub->params->delay != 0) {
-                    continue;
-                }
+                /*
+                 * Other backends may have queued more requests already: poll
+                 * again (with zero timeout, see above) and keep coalescing
+                 * into the buffer. It is flushed below when a poll finds no
+                 * pending input, or inline when it becomes full.
+                 */
+                continue;
             }
             if (shub->in_buffer_used != 0) { /* if buffer is not empty... */
                 /* ...then send it */
@@ -43,17 +43,32 @@ typedef struct host_t
     struct host_t *prev;
 } host_t;
 
-typedef struct 
+typedef struct
 {
     int buffer_size;
     int delay;
     int queue_size;
     int max_attempts;
+    int chan_queue_size; /* max bytes queued for one slow local channel before
+                            reading from the peer is paused (backpressure) */
     char const* file;
     host_t *leader;
     ShubErrorHandler error_handler;
 } ShubParams;
-   
+
+/*
+ * Pending output of one local channel. Responses for a channel whose socket
+ * is not ready to accept them are queued here instead of blocking the hub
+ * loop, so a slow backend does not delay delivery to the other channels.
+ */
+typedef struct
+{
+    char* data;
+    int   size;       /* allocated size */
+    int   used;
+    int   overloaded; /* queue has grown over chan_queue_size */
+} ShubChanBuffer;
+
 typedef struct
 {
     int    output;
@@ -63,11 +78,16 @@ typedef struct
 #else
     int    max_fd;
     fd_set inset;
+    fd_set outset;
 #endif
     char*  in_buffer;
     char*  out_buffer;
     int    in_buffer_used;
     int    out_buffer_used;
+    ShubChanBuffer* chans; /* indexed by channel socket descriptor */
+    int    max_chans;
+    int    n_overloaded;   /* number of overloaded channels: while non-zero
+                              the peer socket is not polled for input */
     ShubParams* params;
 } Shub;
 
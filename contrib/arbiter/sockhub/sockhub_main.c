@@ -25,6 +25,12 @@ int main(int argc, char* argv[])
               case 'b':
                 params.buffer_size = atoi(argv[++i]);
                 continue;
+              case 'c':
+                params.chan_queue_size = atoi(argv[++i]);
+                continue;
+              case 'q':
+                params.queue_size = atoi(argv[++i]);
+                continue;
               case 'r':
                 params.max_attempts = atoi(argv[++i]);
                 continue;
@@ -35,8 +41,9 @@ int main(int argc, char* argv[])
                 "Options:\n"
                 "\t-h HOST:PORT\tremote address\n"
                 "\t-f FILE\tunix socket file name\n"
-                "\t-d DELAY\tdelay for waiting income requests (milliseconds)\n"
+                "\t-d DELAY\tobsolete, the flush is adaptive now (accepted and ignored)\n"
                 "\t-b SIZE\tbuffer size\n"
+                "\t-c SIZE\tmax bytes queued for a slow local channel before backpressure\n"
                 "\t-q SIZE\tlisten queue size\n"
                 "\t-r N\tmaximun connect attempts\n"
              );
@@ -50,6 +50,7 @@ bool clogfile_open_by_id(clogfile_t *clogfile, char *datadir, int fileid, bool c
 		return false;
 	}
 
+	clogfile->dirty = false;
 	clogfile->data = mmap(
 		NULL, BYTES_PER_FILE,
 		PROT_READ | PROT_WRITE,
@@ -62,6 +63,13 @@ bool clogfile_open_by_id(clogfile_t *clogfile, char *datadir, int fileid, bool c
 		shout("cannot mmap clog file '%s': %s\n", clogfile->path, strerror(errno));
 		return false;
 	}
+
+	// status lookups hop around the file, so readahead would only pollute
+	// the page cache; this is just a hint, so a failure is not fatal
+	if (madvise(clogfile->data, BYTES_PER_FILE, MADV_RANDOM)) {
+		shout("cannot madvise clog file '%s': %s\n", clogfile->path, strerror(errno));
+	}
+
 	return true;
 }
 
@@ -93,18 +101,30 @@ int clogfile_get_status(clogfile_t *clogfile, xid_t xid) {
 	return ((*p) >> (BITS_PER_COMMIT * suboffset)) & COMMIT_MASK; // AND-out all other status
 }
 
-// Set the status of the specified global commit in the clog file. Return
-// 'true' on success, 'false' otherwise.
+// Set the status of the specified global commit in the clog file. The change
+// only marks the file dirty; concurrent status updates are made durable with
+// a single msync in clogfile_sync() (group commit). Return 'true' on success,
+// 'false' otherwise.
 bool clogfile_set_status(clogfile_t *clogfile, xid_t xid, int status) {
 	off64_t offset = XID_TO_OFFSET(xid);
 	int suboffset = XID_TO_SUBOFFSET(xid);
 	char *p = ((char*)clogfile->data + offset);
 	*p &= ~(COMMIT_MASK << (BITS_PER_COMMIT * suboffset));   // AND-out the old status
 	*p |= status << (BITS_PER_COMMIT * suboffset); // OR-in the new status
+	clogfile->dirty = true;
+	return true;
+}
+
+// Make the accumulated status changes durable (no-op unless compiled with
+// SYNC or the file is clean). Return 'true' on success, 'false' otherwise.
+bool clogfile_sync(clogfile_t *clogfile) {
 	#ifdef SYNC
-	if (msync(clogfile->data, BYTES_PER_FILE, MS_SYNC)) {
-		shout("cannot msync clog file '%s': %s\n", clogfile->path, strerror(errno));
-		return false;
+	if (clogfile->dirty) {
+		if (msync(clogfile->data, BYTES_PER_FILE, MS_SYNC)) {
+			shout("cannot msync clog file '%s': %s\n", clogfile->path, strerror(errno));
+			return false;
+		}
+		clogfile->dirty = false;
 	}
 	#endif
 	return true;
@@ -131,25 +131,36 @@ static bool recursiveTraverseGraph(Vertex* root, Vertex* v, int marker)
     v->visited = marker;
     for (l = v->outgoingEdges.next; l != &v->outgoingEdges; l = e->node.next) {
         e = (Edge*)l;
-        if (e->dst == root) { 
+        if (e->dst == root) {
             return true;
-        } else if (e->dst->visited != marker && recursiveTraverseGraph(root, e->dst, marker)) { /* loop */
+        } else if (e->dst->visited != marker
+                   && !l2_list_is_empty(&e->dst->outgoingEdges) /* a vertex without outgoing edges can not close a cycle */
+                   && recursiveTraverseGraph(root, e->dst, marker)) { /* loop */
             return true;
-        } 
+        }
     }
-    return false;        
+    return false;
 }
 
 bool detectDeadLock(Graph* graph, xid_t root)
 {
     Vertex* v;
-    for (v = graph->hashtable[root % MAX_TRANSACTIONS]; v != NULL; v = v->next) { 
-        if (v->xid == root) { 
-            if (recursiveTraverseGraph(v, v, ++graph->marker)) { 
+    for (v = graph->hashtable[root % MAX_TRANSACTIONS]; v != NULL; v = v->next) {
+        if (v->xid == root) {
+            /*
+             * A cycle through the root needs both an edge out of it and an
+             * edge into it, so most requests are answered without touching
+             * the graph at all: the typical victim waits for a transaction
+             * nobody waits for.
+             */
+            if (v->nIncomingEdges == 0 || l2_list_is_empty(&v->outgoingEdges)) {
+                return false;
+            }
+            if (recursiveTraverseGraph(v, v, ++graph->marker)) {
                 return true;
             }
             break;
         }
     }
-    return false;        
+    return false;
 }
@@ -25,7 +25,32 @@ static xid_t get_global_xmin();
 L2List active_transactions = {&active_transactions, &active_transactions};
 L2List* free_transactions;
 
-Transaction* transaction_hash[MAX_TRANSACTIONS];
+/*
+ * In-flight transactions are indexed by an open-addressing hash table with
+ * linear probing. The xid key is stored inline in the slot, so a probe only
+ * touches the table itself and never has to chase a pointer into the
+ * Transaction until the key matches; with chaining every hop was a cache
+ * miss. The table is twice MAX_TRANSACTIONS and a power of two, so it can
+ * never get more than half full and the mask replaces the modulo.
+ *
+ * Deleted slots become tombstones so later probe sequences stay intact.
+ * Once enough tombstones pile up we rebuild the whole table in one pass
+ * from the active_transactions list, which is much cheaper than shifting
+ * entries back on every delete.
+ */
+#define TXN_TABLE_SIZE (MAX_TRANSACTIONS * 2) /* must be a power of two */
+#define TXN_TABLE_MASK (TXN_TABLE_SIZE - 1)
+#define TXN_TOMBSTONE ((Transaction*)-1)
+#define TXN_MAX_TOMBSTONES (TXN_TABLE_SIZE / 4)
+#define TXN_PREFETCH_DIST 4
+
+typedef struct TxnSlot {
+	xid_t xid;          /* valid only when t points to a live transaction */
+	Transaction *t;     /* NULL = empty, TXN_TOMBSTONE = deleted */
+} TxnSlot;
+
+static TxnSlot txn_table[TXN_TABLE_SIZE];
+static int txn_tombstones;
 
 /*
  * We reserve the local xids if they fit between (prev, next) range, and
@@ -34,10 +59,79 @@ Transaction* transaction_hash[MAX_TRANSACTIONS];
 xid_t prev_gxid, next_gxid;
 xid_t global_xmin = INVALID_XID;
 
-static Transaction *find_transaction(xid_t xid) {    
-	Transaction *t;    
-	for (t = transaction_hash[xid % MAX_TRANSACTIONS]; t != NULL && t->xid != xid; t = t->collision);
-	return t;
+static inline unsigned txn_hash(xid_t xid) {
+	/* multiplicative (Fibonacci) hashing to break up sequential xids */
+	return (unsigned)(xid * 2654435761u) & TXN_TABLE_MASK;
+}
+
+static Transaction *find_transaction(xid_t xid) {
+	unsigned i = txn_hash(xid);
+
+	while (true) {
+		TxnSlot *slot = &txn_table[i & TXN_TABLE_MASK];
+
+		/* overlap the next probe's cache miss with this comparison */
+		__builtin_prefetch(&txn_table[(i + TXN_PREFETCH_DIST) & TXN_TABLE_MASK]);
+
+		if (slot->t == NULL) {
+			return NULL; /* an empty slot terminates the probe sequence */
+		}
+		if (slot->t != TXN_TOMBSTONE && slot->xid == xid) {
+			return slot->t;
+		}
+		i++;
+	}
+}
+
+static void txn_table_insert(Transaction *t) {
+	unsigned i = txn_hash(t->xid);
+	TxnSlot *slot;
+
+	for (;;) {
+		slot = &txn_table[i & TXN_TABLE_MASK];
+		if (slot->t == NULL || slot->t == TXN_TOMBSTONE) {
+			break;
+		}
+		assert(slot->xid != t->xid); /* no duplicate xids */
+		i++;
+	}
+	if (slot->t == TXN_TOMBSTONE) {
+		txn_tombstones--;
+	}
+	slot->xid = t->xid;
+	slot->t = t;
+}
+
+/*
+ * Bulk-expire all tombstones: wipe the table and reinsert the live
+ * transactions from the active list in a single pass.
+ */
+static void txn_table_expire(void) {
+	L2List *elem;
+
+	memset(txn_table, 0, sizeof(txn_table));
+	txn_tombstones = 0;
+	for (elem = active_transactions.next; elem != &active_transactions; elem = elem->next) {
+		txn_table_insert((Transaction*)elem);
+	}
+}
+
+static void txn_table_delete(xid_t xid) {
+	unsigned i = txn_hash(xid);
+	TxnSlot *slot;
+
+	for (;;) {
+		slot = &txn_table[i & TXN_TABLE_MASK];
+		assert(slot->t != NULL); /* the transaction must be in the table */
+		if (slot->t != TXN_TOMBSTONE && slot->xid == xid) {
+			break;
+		}
+		i++;
+	}
+	slot->t = TXN_TOMBSTONE;
+	if (++txn_tombstones > TXN_MAX_TOMBSTONES) {
+		txn_table_expire();
+	}
 }
 
 typedef struct client_userdata_t {
@@ -53,9 +147,38 @@ typedef struct client_userdata_t {
 } client_userdata_t;
 
 clog_t clg;
-raft_t raft;
 bool use_raft;
 
+/*
+ * A consensus group: an independent raft quorum, with its own UDP socket on
+ * every peer (base port + group number), replicating the commit/abort votes
+ * of the transactions it owns. A transaction is owned by the group
+ * xid % ngroups, so a vote never involves more than one group and the groups
+ * replicate their logs in parallel. The xid allocation machinery (terms,
+ * RESERVE, SEQUENCE) stays tied to group 0, and the clog is shared by all
+ * groups, which is safe because each group only ever writes the statuses of
+ * its own xids.
+ *
+ * Leadership of all groups is anchored to one node: only the leader of
+ * group 0 campaigns in the other groups (see the campaign_ok updates in the
+ * main loop), so after elections settle, clients keep seeing a single leader
+ * for the whole process. While a takeover is in progress a vote can land on
+ * a group this node does not lead yet; such commands fail and the client
+ * retries.
+ */
+typedef struct ArbiterGroup {
+	int id;
+	raft_t raft;
+} ArbiterGroup;
+
+static ArbiterGroup groups[MAX_GROUPS];
+static int ngroups = 1;
+
+/* the group whose raft callbacks are currently being served */
+static ArbiterGroup *curgroup = &groups[0];
+
+#define GROUP_FOR_XID(XID) (&groups[(XID) % ngroups])
+
 #define CLIENT_USERDATA(CLIENT) ((client_userdata_t*)client_get_userdata(CLIENT))
 #define CLIENT_ID(CLIENT) (CLIENT_USERDATA(CLIENT)->id)
 #define CLIENT_SNAPSENT(CLIENT) (CLIENT_USERDATA(CLIENT)->snapshots_sent)
@@ -77,10 +200,9 @@ static void free_client_userdata(client_userdata_t *cd) {
 
 inline static void free_transaction(Transaction* t) {
 	assert(transaction_pop_listener(t, 's') == NULL);
-	Transaction** tpp;
-	for (tpp = &transaction_hash[t->xid % MAX_TRANSACTIONS]; *tpp != t; tpp = &(*tpp)->collision);
-	*tpp = t->collision;
+	/* leave the active list first: a bulk-expire rebuilds the table from it */
 	l2_list_unlink(&t->elem);
+	txn_table_delete(t->xid);
 	t->elem.next = free_transactions;
 	free_transactions = &t->elem;
 	if (t->xmin == global_xmin) { 
@@ -145,7 +267,7 @@ static void apply_clog_update(int action, int argument) {
 		shout("APPLY: failed to write to clog, xid=%u\n", xid);
 	}
 
-	if (!use_raft || (raft.role == ROLE_LEADER)) {
+	if (!use_raft || (curgroup->raft.role == ROLE_LEADER)) {
 		Transaction *t = find_transaction(xid);
 		if (t == NULL) {
 			debug("APPLY: xid=%u is not active\n", xid);
@@ -157,6 +279,77 @@ static void apply_clog_update(int action, int argument) {
 	}
 }
 
+/*
+ * Serialize the statuses of xids in [minarg;maxarg], two bits each, so that
+ * the raft module can bring a lagging follower up to date after the log
+ * entries recording those votes have been compacted away. Transactions
+ * still in progress are carried over as well: they sit in the clog as DOUBT
+ * since BEGIN marks them so.
+ */
+static int serialize_clog_snapshot(int minarg, int maxarg, char *buf, int maxlen) {
+	xid_t minxid = (xid_t)minarg;
+	xid_t maxxid = (xid_t)maxarg;
+	int nxids = maxxid - minxid + 1;
+	int nbytes = (nxids + 3) / 4;
+	int i;
+
+	if (nbytes > maxlen) {
+		shout(
+			"clog snapshot %u-%u needs %d bytes,"
+			" but only %d are available\n",
+			minxid, maxxid, nbytes, maxlen
+		);
+		return -1;
+	}
+
+	memset(buf, 0, nbytes);
+	for (i = 0; i < nxids; i++) {
+		int status;
+
+		/*
+		 * Serialize only the xids this group owns: the statuses of foreign
+		 * xids travel through their own group's log, and a snapshot of this
+		 * group must not be able to clobber them on the follower.
+		 */
+		if (GROUP_FOR_XID(minxid + i) != curgroup)
+			continue;
+
+		status = clog_read(clg, minxid + i);
+		buf[i / 4] |= status << ((i % 4) * 2);
+	}
+	return nbytes;
+}
+
+static bool apply_clog_snapshot(int minarg, int maxarg, char *data, int len) {
+	xid_t minxid = (xid_t)minarg;
+	xid_t maxxid = (xid_t)maxarg;
+	int nxids = maxxid - minxid + 1;
+	int i;
+
+	if (len != (nxids + 3) / 4) {
+		shout(
+			"clog snapshot %u-%u has wrong size %d\n",
+			minxid, maxxid, len
+		);
+		return false;
+	}
+
+	for (i = 0; i < nxids; i++) {
+		int status = (data[i / 4] >> ((i % 4) * 2)) & 3;
+		if (status == BLANK) continue;
+		/* belt and braces: never let a snapshot touch foreign xids */
+		if (GROUP_FOR_XID(minxid + i) != curgroup) continue;
+		if (!clog_write(clg, minxid + i, status)) {
+			shout(
+				"failed to write xid %u from a clog snapshot\n",
+				minxid + i
+			);
+			return false;
+		}
+	}
+	return true;
+}
+
 static int next_client_id = 0;
 static void onconnect(client_t client) {
 	client_userdata_t *cd = create_client_userdata(next_client_id++);
@@ -169,12 +362,15 @@ static void ondisconnect(client_t client) {
 	debug("[%d, %p] disconnected\n", CLIENT_ID(client), client);
 	
 	if ((t = CLIENT_XPART(client))) {
+		ArbiterGroup *g = GROUP_FOR_XID(t->xid);
 		transaction_remove_listener(t, 's', client);
 		if (use_raft) {
-			if (raft.role == ROLE_LEADER) {
-				raft_emit(&raft, NEGATIVE, t->xid);
+			if (g->raft.role == ROLE_LEADER) {
+				curgroup = g;
+				raft_emit(&g->raft, NEGATIVE, t->xid);
 			}
 		} else {
+			curgroup = g;
 			apply_clog_update(NEGATIVE, t->xid);
 		}
 	}
@@ -198,8 +394,10 @@ static void debug_cmd(client_t client, int argc, xid_t *argv) {
 		case CMD_FOR     : cmdname =      "FOR"; break;
 		case CMD_AGAINST : cmdname =  "AGAINST"; break;
 		case CMD_SNAPSHOT: cmdname = "SNAPSHOT"; break;
+		case CMD_SNAPSHOT_BATCH: cmdname = "SNAPSHOT_BATCH"; break;
 		case CMD_STATUS  : cmdname =   "STATUS"; break;
 		case CMD_DEADLOCK: cmdname = "DEADLOCK"; break;
+		case CMD_SEQUENCE: cmdname = "SEQUENCE"; break;
 		default          : cmdname =  "unknown";
 	}
 	debug("[%d] %s", CLIENT_ID(client), cmdname);
@@ -222,8 +420,12 @@ static void debug_cmd(client_t client, int argc, xid_t *argv) {
 		} \
 	} while (0)
 
+/*
+ * Client-facing leadership is the leadership of group 0: a node that leads
+ * the anchor group will acquire (or already holds) the other groups too.
+ */
 #define CHECKLEADER(CLIENT) \
-	CHECK(!use_raft || (raft.role == ROLE_LEADER), CLIENT, "not a leader")
+	CHECK(!use_raft || (groups[0].raft.role == ROLE_LEADER), CLIENT, "not a leader")
 
 static xid_t max_of_xids(xid_t a, xid_t b) {
 	return a > b ? a : b;
@@ -253,7 +455,7 @@ static void onhello(client_t client, int argc, xid_t *argv) {
 	CHECK(argc == 1, client, "HELLO: wrong number of arguments");
 
 	debug("[%d] HELLO\n", CLIENT_ID(client));
-	if (raft.role == ROLE_LEADER) {
+	if (groups[0].raft.role == ROLE_LEADER) {
 		client_message_shortcut(client, RES_OK);
 	} else {
 		client_message_shortcut(client, RES_FAILED);
@@ -262,11 +464,11 @@ static void onhello(client_t client, int argc, xid_t *argv) {
 
 /* the greatest gxid we can provide on BEGIN or RESERVE */
 static xid_t last_xid_in_term() {
-	return raft.term * XIDS_PER_TERM - 1;
+	return groups[0].raft.term * XIDS_PER_TERM - 1;
 }
 
 static xid_t first_xid_in_term() {
-	return (raft.term - 1) * XIDS_PER_TERM;
+	return (groups[0].raft.term - 1) * XIDS_PER_TERM;
 }
 
 static int xid2term(xid_t xid) {
@@ -290,11 +492,11 @@ static bool xid_is_disturbing(xid_t xid) {
 static void set_next_gxid(xid_t value) {
         assert(next_gxid < value); /* the value should only grow */
 
-	if (use_raft && raft.role == ROLE_LEADER) {
+	if (use_raft && groups[0].raft.role == ROLE_LEADER) {
 		assert(xid_is_safe(value));
 		if (xid_is_disturbing(value)) {
 			/* Time to worry has come. */
-			raft_ensure_term(&raft, xid2term(value));
+			raft_ensure_term(&groups[0].raft, xid2term(value));
 		} else {
 			/*
 			 * It is either too early to worry,
@@ -374,6 +576,88 @@ static void onreserve(client_t client, int argc, xid_t *argv) {
 	client_message_finish(client);
 }
 
+/*
+ * Cluster-wide sequence counters, keyed by a client-provided hash of the
+ * sequence name. The counters live only in the leader's memory; reuse of
+ * values after a restart or a leader change is prevented the same way as for
+ * gxids: every allocation is confined to the current raft term, and a new
+ * term starts past everything the previous terms could have handed out.
+ */
+#define MAX_SEQUENCES 64
+#define SEQ_VALUES_PER_TERM ((unsigned long long)1 << 32)
+
+typedef struct Sequence {
+	xid_t key;
+	unsigned long long next;
+} Sequence;
+
+static Sequence sequences[MAX_SEQUENCES];
+static int sequences_count = 0;
+
+static void onsequence(client_t client, int argc, xid_t *argv) {
+	CHECK(argc == 3, client, "SEQUENCE: wrong number of arguments");
+
+	xid_t key = argv[1];
+	int amount = argv[2];
+	unsigned long long term_floor, last_in_term, first, last;
+	Sequence *seq = NULL;
+	xid_t ok = RES_OK;
+	xid_t word;
+	int i;
+
+	CHECK(amount > 0, client, "SEQUENCE: amount must be positive");
+
+	for (i = 0; i < sequences_count; i++) {
+		if (sequences[i].key == key) {
+			seq = sequences + i;
+			break;
+		}
+	}
+	if (seq == NULL) {
+		CHECK(
+			sequences_count < MAX_SEQUENCES,
+			client,
+			"SEQUENCE: too many sequences"
+		);
+		seq = sequences + sequences_count++;
+		seq->key = key;
+		seq->next = 0;
+	}
+
+	term_floor = (unsigned long long)(groups[0].raft.term - 1) * SEQ_VALUES_PER_TERM;
+	last_in_term = (unsigned long long)groups[0].raft.term * SEQ_VALUES_PER_TERM - 1;
+	if (seq->next <= term_floor) {
+		seq->next = term_floor + 1;
+	}
+
+	first = seq->next;
+	last = first + amount - 1;
+	CHECK(
+		last <= last_in_term,
+		client,
+		"SEQUENCE: not enough values left in this term"
+	);
+	seq->next = last + 1;
+
+	debug(
+		"[%d] SEQUENCE: leased range %llu-%llu of sequence %u\n",
+		CLIENT_ID(client),
+		first, last, key
+	);
+
+	client_message_start(client);
+	client_message_append(client, sizeof(xid_t), &ok);
+	word = (xid_t)(first >> 32);
+	client_message_append(client, sizeof(xid_t), &word);
+	word = (xid_t)first;
+	client_message_append(client, sizeof(xid_t), &word);
+	word = (xid_t)(last >> 32);
+	client_message_append(client, sizeof(xid_t), &word);
+	word = (xid_t)last;
+	client_message_append(client, sizeof(xid_t), &word);
+	client_message_finish(client);
+}
+
 static xid_t get_global_xmin() {
 	xid_t xmin = next_gxid;
 	Transaction *t;
@@ -425,8 +709,7 @@ static void onbegin(client_t client, int argc, xid_t *argv) {
 		t->fixed_size = false;
 	}
 
-	t->collision = transaction_hash[t->xid % MAX_TRANSACTIONS];
-	transaction_hash[t->xid % MAX_TRANSACTIONS] = t;
+	txn_table_insert(t);
 
 	CLIENT_SNAPSENT(client) = 0;
 	CLIENT_XPART(client) = t;
@@ -509,6 +792,17 @@ static void onvote(client_t client, int argc, xid_t *argv, int vote) {
 		return;
 	}
 
+	/*
+	 * During a leadership takeover this node may lead the anchor group but
+	 * not yet the group owning this xid. Fail the vote before counting it,
+	 * so the client can retry it elsewhere.
+	 */
+	CHECK(
+		!use_raft || (GROUP_FOR_XID(xid)->raft.role == ROLE_LEADER),
+		client,
+		"VOTE: the group owning this xid has no local leader yet"
+	);
+
 	if (vote == POSITIVE) {
 		t->votes_for += 1;
 	} else if (vote == NEGATIVE) {
@@ -530,8 +824,10 @@ static void onvote(client_t client, int argc, xid_t *argv, int vote) {
 					client,
 					"VOTE: couldn't queue for transaction finish"
 				);
-				raft_emit(&raft, s, t->xid);
+				curgroup = GROUP_FOR_XID(t->xid);
+				raft_emit(&curgroup->raft, s, t->xid);
 			} else {
+				curgroup = GROUP_FOR_XID(t->xid);
 				apply_clog_update(s, t->xid);
 				if (s == POSITIVE) {
 					client_message_shortcut(client, RES_TRANSACTION_COMMITTED);
@@ -612,6 +908,50 @@ static void onsnapshot(client_t client, int argc, xid_t *argv) {
 	} client_message_finish(client);
 }
 
+/*
+ * A batched version of SNAPSHOT. The client sends the xids of several local
+ * transactions at once; we generate a single fresh snapshot, record it in the
+ * snapshot ring of every listed transaction (so that participants of the same
+ * global transaction connected from other nodes see the same sequence of
+ * snapshots), and send just one reply. This allows a node to coalesce the
+ * per-command snapshot requests of all its backends into one round trip.
+ *
+ * Unlike SNAPSHOT, this command does not make the sending client a participant
+ * of any of the listed transactions: participation is established by the
+ * BEGIN/SNAPSHOT commands each backend issues over its own channel when the
+ * transaction is started or joined.
+ */
+static void onsnapshotbatch(client_t client, int argc, xid_t *argv) {
+	static Snapshot snapshot_now;
+	int i;
+
+	CHECK(argc >= 2, client, "SNAPSHOT_BATCH: wrong number of arguments");
+
+	gen_snapshot(&snapshot_now);
+	snapshot_now.times_sent = 1;
+
+	for (i = 1; i < argc; i++) {
+		Transaction *t = find_transaction(argv[i]);
+		if (t == NULL) {
+			debug(
+				"[%d] SNAPSHOT_BATCH: xid=%u not found: still using current snapshot\n",
+				CLIENT_ID(client), argv[i]
+			);
+			continue;
+		}
+		*transaction_next_snapshot(t) = snapshot_now;
+	}
+
+	xid_t ok = RES_OK;
+	client_message_start(client); {
+		client_message_append(client, sizeof(xid_t), &ok);
+		client_message_append(client, sizeof(xid_t), &global_xmin);
+		client_message_append(client, sizeof(xid_t), &snapshot_now.xmin);
+		client_message_append(client, sizeof(xid_t), &snapshot_now.xmax);
+		client_message_append(client, sizeof(xid_t) * snapshot_now.nactive, snapshot_now.active);
+	} client_message_finish(client);
+}
+
 static void onstatus(client_t client, int argc, xid_t *argv) {
 	if (argc != 3) {
 		shout(
@@ -668,6 +1008,17 @@ static void onnoise(client_t client, int argc, xid_t *argv) {
 
 static Graph graph;
 
+/*
+ * Invoked by the server before it sends buffered replies: makes all status
+ * changes accumulated during the batch durable with a single msync per dirty
+ * clog file, instead of one per transaction (group commit).
+ */
+static void flush_clog(void) {
+	if (!clog_sync(clg)) {
+		shout("failed to sync the clog before replying\n");
+	}
+}
+
 static void ondeadlock(client_t client, int argc, xid_t *argv) {
     int port;
     xid_t root;
@@ -702,6 +1053,10 @@ static void oncmd(client_t client, int argc, xid_t *argv) {
 			CHECKLEADER(client);
 			onreserve(client, argc, argv);
 			break;
+		case CMD_SEQUENCE:
+			CHECKLEADER(client);
+			onsequence(client, argc, argv);
+			break;
 		case CMD_BEGIN:
 			CHECKLEADER(client);
 			onbegin(client, argc, argv);
@@ -718,6 +1073,10 @@ static void oncmd(client_t client, int argc, xid_t *argv) {
 			CHECKLEADER(client);
 			onsnapshot(client, argc, argv);
 			break;
+		case CMD_SNAPSHOT_BATCH:
+			CHECKLEADER(client);
+			onsnapshotbatch(client, argc, argv);
+			break;
 		case CMD_STATUS:
 			CHECKLEADER(client);
 			onstatus(client, argc, argv);
@@ -742,14 +1101,17 @@ static void onmessage(client_t client, size_t len, char *data) {
 
 static void usage(char *prog) {
 	printf(
-		"Usage: %s -i ID -r HOST:PORT [-r HOST:PORT ...] [-d DATADIR] [-k] [-l LOGFILE]\n"
+		"Usage: %s -i ID -r HOST:PORT [-r HOST:PORT ...] [-n NGROUPS] [-d DATADIR] [-k] [-l LOGFILE] [-u SOCKPATH]\n"
 		"   arbiter will try to kill the other one running at\n"
 		"   the same DATADIR.\n"
 		"   -r : Listen on the HOST and PORT. Specify multiple times to enable Raft protocol.\n"
 		"   -i : A number to distinguish this instance among the Raft peers.\n"
+		"   -n : Shard the commit votes over NGROUPS independent Raft groups (at most %d).\n"
+		"        Group number g uses PORT+g on every peer; give the same -n everywhere.\n"
 		"   -l : Run as a daemon and write output to LOGFILE.\n"
+		"   -u : Also listen on a unix socket at SOCKPATH for co-located backends.\n"
 		"   -k : Just kill the other arbiter and exit.\n",
-		prog
+		prog, MAX_GROUPS
 	);
 }
 
@@ -828,6 +1190,12 @@ void kill_the_elder(char *datadir) {
 	}
 }
 
+static volatile sig_atomic_t dump_trace_requested = 0;
+void request_trace_dump(int signum) {
+	/* just raise the flag; the main loop dumps between ticks */
+	dump_trace_requested = 1;
+}
+
 char *pidpath;
 void die(int signum) {
 	shout("terminated\n");
@@ -839,17 +1207,23 @@ void die(int signum) {
 
 char *datadir = DEFAULT_DATADIR;
 char *logfilename = NULL;
+char *unixsockpath = NULL;
 bool daemonize = false;
 bool assassin = false;
 
 bool configure(int argc, char **argv) {
-	raft_init(&raft);
 	int myid = NOBODY;
+	int g, i;
+
+	for (g = 0; g < MAX_GROUPS; g++) {
+		groups[g].id = g;
+		raft_init(&groups[g].raft);
+	}
 
     initGraph(&graph);
 
 	int opt;
-	while ((opt = getopt(argc, argv, "hd:i:r:l:k")) != -1) {
+	while ((opt = getopt(argc, argv, "hd:i:r:n:l:ku:")) != -1) {
 		char *host;
 		char *portstr;
 		int port;
@@ -868,7 +1242,15 @@ bool configure(int argc, char **argv) {
 				} else {
 					port = DEFAULT_LISTENPORT;
 				}
-				raft_add_server(&raft, host, port);
+				raft_add_server(&groups[0].raft, host, port);
+				break;
+			case 'n':
+				ngroups = atoi(optarg);
+				if ((ngroups < 1) || (ngroups > MAX_GROUPS)) {
+					shout("the number of groups should be between 1 and %d\n", MAX_GROUPS);
+					usage(argv[0]);
+					return false;
+				}
 				break;
 			case 'l':
 				logfilename = optarg;
@@ -880,22 +1262,42 @@ bool configure(int argc, char **argv) {
 			case 'k':
 				assassin = true;
 				break;
+			case 'u':
+				unixsockpath = optarg;
+				break;
 			default:
 				usage(argv[0]);
 				return false;
 		}
 	}
 
-	if (raft.servernum < 1) {
+	if (groups[0].raft.servernum < 1) {
 		shout("please, specify -r HOST:PORT at least once\n");
 		usage(argv[0]);
 		return false;
 	}
-	use_raft = raft.servernum > 1;
+	use_raft = groups[0].raft.servernum > 1;
 
-	if (!raft_set_myid(&raft, myid)) {
-		usage(argv[0]);
-		return false;
+	/*
+	 * Every group has the same peers; group number g talks over base
+	 * port + g. The host strings are shared, raft_add_server does not copy
+	 * them.
+	 */
+	for (g = 1; g < ngroups; g++) {
+		for (i = 0; i < groups[0].raft.servernum; i++) {
+			raft_add_server(
+				&groups[g].raft,
+				groups[0].raft.servers[i].host,
+				groups[0].raft.servers[i].port + g
+			);
+		}
+	}
+
+	for (g = 0; g < ngroups; g++) {
+		if (!raft_set_myid(&groups[g].raft, myid)) {
+			usage(argv[0]);
+			return false;
+		}
 	}
 
 	return true;
@@ -932,7 +1334,7 @@ int main(int argc, char **argv) {
 		shout("could not set last used xid to %u\n", last_used_xid);
 		return EXIT_FAILURE;
 	}
-	raft.term = xid2term(next_gxid);
+	groups[0].raft.term = xid2term(next_gxid);
 
 	prev_gxid = next_gxid - 1;
 	debug("initial next_gxid = %u\n", next_gxid);
@@ -941,6 +1343,17 @@ int main(int argc, char **argv) {
 		return EXIT_FAILURE;
 	}
 
+	{
+		int g;
+		for (g = 0; g < ngroups; g++) {
+			raft_set_snapshot_handlers(
+				&groups[g].raft,
+				serialize_clog_snapshot,
+				apply_clog_snapshot
+			);
+		}
+	}
+
 	if (daemonize) {
 		if (daemon(true, true) == -1) {
 			shout("could not daemonize: %s\n", strerror(errno));
@@ -951,58 +1364,98 @@ int main(int argc, char **argv) {
 	pidpath = join_path(datadir, "arbiter.pid");
 	signal(SIGTERM, die);
 	signal(SIGINT, die);
+	signal(SIGUSR1, request_trace_dump);
 
 	write_pid(pidpath, getpid());
 
 
-	int raftsock = raft_create_udp_socket(&raft);
-	if (raftsock == -1) {
-		die(EXIT_FAILURE);
-	}
-
 	server_t server = server_init(
-		raft.servers[raft.me].host, raft.servers[raft.me].port,
+		groups[0].raft.servers[groups[0].raft.me].host,
+		groups[0].raft.servers[groups[0].raft.me].port,
 		onmessage, onconnect, ondisconnect
 	);
 
-	server_set_raft_socket(server, raftsock);
+	{
+		int g;
+		for (g = 0; g < ngroups; g++) {
+			int raftsock = raft_create_udp_socket(&groups[g].raft);
+			if (raftsock == -1) {
+				die(EXIT_FAILURE);
+			}
+			if (server_add_raft_socket(server, raftsock) != g) {
+				die(EXIT_FAILURE);
+			}
+		}
+	}
+
+	server_set_onflush(server, flush_clog);
 
 	if (!server_start(server)) {
 		return EXIT_FAILURE;
 	}
 
+	if (unixsockpath && !server_listen_unix(server, unixsockpath)) {
+		return EXIT_FAILURE;
+	}
+
 	mstimer_t t;
 	mstimer_reset(&t);
 	int old_term = 0;
 	while (true) {
 		int ms = mstimer_reset(&t);
-		raft_msg_t *m = NULL;
+		int raftmask;
+		int g;
 
 		if (use_raft) {
-			raft_tick(&raft, ms);
+			for (g = 0; g < ngroups; g++) {
+				/*
+				 * Leadership anchoring: only the leader of group 0 campaigns
+				 * in the other groups, so that all groups converge to the
+				 * same leader and clients keep seeing a single one.
+				 */
+				groups[g].raft.campaign_ok =
+					(g == 0) || (groups[0].raft.role == ROLE_LEADER);
+				curgroup = &groups[g];
+				raft_tick(&groups[g].raft, ms);
+			}
 		}
 
 		/* The client interaction is done in server_tick. */
-		if (server_tick(server, HEARTBEAT_TIMEOUT_MS)) {
-			m = raft_recv_message(&raft);
-			assert(m); /* m should not be NULL, because the message should be ready to recv */
+		raftmask = server_tick(server, HEARTBEAT_TIMEOUT_MS);
+
+		if (dump_trace_requested) {
+			dump_trace_requested = 0;
+			server_dump_trace(stderr);
 		}
 
 		if (use_raft) {
-			int applied = raft_apply(&raft, apply_clog_update);
-			if (applied) {
-				debug("applied %d updates\n", applied);
-			}
+			for (g = 0; g < ngroups; g++) {
+				int applied;
+				raft_msg_t *m = NULL;
+
+				curgroup = &groups[g];
 
-			if (m) {
-				raft_handle_message(&raft, m);
+				if (raftmask & (1 << g)) {
+					m = raft_recv_message(&groups[g].raft);
+					assert(m); /* m should not be NULL, because the message should be ready to recv */
+				}
+
+				applied = raft_apply(&groups[g].raft, apply_clog_update);
+				if (applied) {
+					debug("group %d: applied %d updates\n", g, applied);
+				}
+
+				if (m) {
+					raft_handle_message(&groups[g].raft, m);
+				}
 			}
+			curgroup = &groups[0];
 
-			server_set_enabled(server, raft.role == ROLE_LEADER);
+			server_set_enabled(server, groups[0].raft.role == ROLE_LEADER);
 
 			/* Update the gxid limits based on current term and leadership. */
-			if (old_term < raft.term) {
-				if (raft.role == ROLE_FOLLOWER) {
+			if (old_term < groups[0].raft.term) {
+				if (groups[0].raft.role == ROLE_FOLLOWER) {
 					/*
 					 * If we become a leader, we will use
 					 * the range of xids after the current
@@ -1012,7 +1465,7 @@ int main(int argc, char **argv) {
 					set_next_gxid(prev_gxid + 1);
 					shout("updated range to %u-%u\n", prev_gxid, next_gxid);
 				}
-				old_term = raft.term;
+				old_term = groups[0].raft.term;
 			}
 		} else {
 			server_set_enabled(server, true);
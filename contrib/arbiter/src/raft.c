@@ -8,8 +8,11 @@
 
 static void raft_server_init(raft_server_t *s) {
 	s->seqno = 0;
+	s->lastackseqno = 0;
 	s->tosend = 0;
 	s->acked = 0;
+	s->silence = 0;
+	s->snapoffset = 0;
 
 	s->host = DEFAULT_LISTENHOST;
 	s->port = DEFAULT_LISTENPORT;
@@ -69,6 +72,7 @@ void raft_init(raft_t *r) {
 	r->term = 0;
 	r->vote = NOBODY;
 	r->role = ROLE_FOLLOWER;
+	r->campaign_ok = true;
 	r->votes = 0;
 	r->me = NOBODY;
 	r->leader = NOBODY;
@@ -79,6 +83,20 @@ void raft_init(raft_t *r) {
 	r->log.applied = 0;
 
 	r->servernum = 0;
+
+	r->snapshooter = NULL;
+	r->snapapplier = NULL;
+	r->outsnap.valid = false;
+	r->insnap.valid = false;
+}
+
+void raft_set_snapshot_handlers(
+	raft_t *r,
+	raft_snapshooter_t snapshooter,
+	raft_snapshot_applier_t snapapplier
+) {
+	r->snapshooter = snapshooter;
+	r->snapapplier = snapapplier;
 }
 
 int raft_apply(raft_t *r, raft_applier_t applier) {
@@ -154,14 +172,34 @@ int raft_create_udp_socket(raft_t *r) {
 
 static bool msg_size_is(raft_msg_t *m, int mlen) {
 	switch (m->msgtype) {
-		case RAFT_MSG_UPDATE:
-			return mlen == sizeof(raft_msg_update_t);
+		case RAFT_MSG_UPDATE: {
+			raft_msg_update_t *mu = (raft_msg_update_t*)m;
+			if (mlen < (int)RAFT_MSG_UPDATE_SIZE(0)) {
+				return false;
+			}
+			if ((mu->nentries < 0) || (mu->nentries > RAFT_UPDATE_BATCH)) {
+				return false;
+			}
+			return mlen == (int)RAFT_MSG_UPDATE_SIZE(mu->nentries);
+		}
 		case RAFT_MSG_DONE:
 			return mlen == sizeof(raft_msg_done_t);
 		case RAFT_MSG_CLAIM:
 			return mlen == sizeof(raft_msg_claim_t);
 		case RAFT_MSG_VOTE:
 			return mlen == sizeof(raft_msg_vote_t);
+		case RAFT_MSG_SNAPSHOT: {
+			raft_msg_snapshot_t *ms = (raft_msg_snapshot_t*)m;
+			if (mlen < (int)RAFT_MSG_SNAPSHOT_SIZE(0)) {
+				return false;
+			}
+			if ((ms->nbytes < 0) || (ms->nbytes > RAFT_SNAPSHOT_CHUNK)) {
+				return false;
+			}
+			return mlen == (int)RAFT_MSG_SNAPSHOT_SIZE(ms->nbytes);
+		}
+		case RAFT_MSG_SNAPPED:
+			return mlen == sizeof(raft_msg_snapped_t);
 	}
 	return false;
 }
@@ -169,7 +207,7 @@ static bool msg_size_is(raft_msg_t *m, int mlen) {
 static void raft_send(raft_t *r, int dst, void *m, int mlen) {
 	assert(msg_size_is((raft_msg_t*)m, mlen));
 	assert(((raft_msg_t*)m)->msgtype >= 0);
-	assert(((raft_msg_t*)m)->msgtype < 4);
+	assert(((raft_msg_t*)m)->msgtype < RAFT_MSG_MAX);
 	assert(dst >= 0);
 	assert(dst < r->servernum);
 	assert(dst != r->me);
@@ -186,6 +224,90 @@ static void raft_send(raft_t *r, int dst, void *m, int mlen) {
 			"failed to send a msg to [%d]: %s\n",
 			dst, strerror(errno)
 		);
+	} else {
+		// any message we send proves to the peer that we are alive
+		server->silence = 0;
+	}
+}
+
+/*
+ * The follower is so far behind that the entries it needs have been
+ * compacted away: transfer the serialized state machine instead. The
+ * serialization is cached in r->outsnap and rebuilt only when the snapshot
+ * entry changes (i.e. after another compaction), so catching up several
+ * followers costs one serialization. Chunks are pipelined the same way as
+ * update messages; 'snapoffset' only advances when an ack arrives, so lost
+ * chunks are retransmitted on the next beat.
+ */
+static void raft_send_snapshot(raft_t *r, int dst) {
+	raft_server_t *s = r->servers + dst;
+	raft_snapshot_t *snap = &r->outsnap;
+	int index = r->log.first;
+	raft_entry_t *e = &RAFT_LOG(r, index);
+	raft_msg_snapshot_t m;
+	int window;
+
+	assert(e->snapshot);
+
+	if (r->snapshooter == NULL) {
+		shout(
+			"cannot catch follower %d up: it needs a snapshot,"
+			" but no snapshooter has been set\n", dst
+		);
+		return;
+	}
+
+	if (
+		!snap->valid || (snap->index != index) || (snap->term != e->term) ||
+		(snap->minarg != e->minarg) || (snap->maxarg != e->maxarg)
+	) {
+		int size = r->snapshooter(e->minarg, e->maxarg, snap->data, sizeof(snap->data));
+		if (size < 0) {
+			shout(
+				"failed to serialize a snapshot covering %d-%d,"
+				" cannot catch follower %d up\n",
+				e->minarg, e->maxarg, dst
+			);
+			return;
+		}
+		snap->valid = true;
+		snap->index = index;
+		snap->term = e->term;
+		snap->minarg = e->minarg;
+		snap->maxarg = e->maxarg;
+		snap->size = size;
+	}
+
+	if (s->snapoffset > snap->size) {
+		// the cached snapshot has been rebuilt since we started sending
+		s->snapoffset = 0;
+	}
+
+	for (window = 0; window < RAFT_PIPELINE_WINDOW; window++) {
+		int offset = s->snapoffset + window * RAFT_SNAPSHOT_CHUNK;
+		if ((offset > snap->size) || ((window > 0) && (offset == snap->size))) {
+			break;
+		}
+
+		m.msg.msgtype = RAFT_MSG_SNAPSHOT;
+		m.msg.term = r->term;
+		m.msg.from = r->me;
+		m.index = snap->index;
+		m.term = snap->term;
+		m.minarg = snap->minarg;
+		m.maxarg = snap->maxarg;
+		m.totalsize = snap->size;
+		m.offset = offset;
+		m.nbytes = min(RAFT_SNAPSHOT_CHUNK, snap->size - offset);
+		memcpy(m.data, snap->data + offset, m.nbytes);
+
+		s->seqno++;
+		m.msg.seqno = s->seqno;
+		debug(
+			"[to %d] snapshot chunk %d-%d of %d\n",
+			dst, m.offset, m.offset + m.nbytes, m.totalsize
+		);
+		raft_send(r, dst, &m, RAFT_MSG_SNAPSHOT_SIZE(m.nbytes));
 	}
 }
 
@@ -206,41 +328,77 @@ static void raft_beat(raft_t *r, int dst) {
 	raft_server_t *s = r->servers + dst;
 
 	raft_msg_update_t m;
+	int tosend = s->tosend;
+	int window;
+
+	/*
+	 * Send up to RAFT_PIPELINE_WINDOW update messages, each carrying up to
+	 * RAFT_UPDATE_BATCH entries, without waiting for the replies. 'tosend' is
+	 * only advanced when a reply arrives, so anything lost in flight gets
+	 * retransmitted on the next beat; the follower appends duplicates
+	 * idempotently.
+	 */
+	for (window = 0; window < RAFT_PIPELINE_WINDOW; window++) {
+		m.msg.msgtype = RAFT_MSG_UPDATE;
+		m.msg.term = r->term;
+		m.msg.from = r->me;
+		m.acked = r->log.acked;
+
+		if (tosend < r->log.first + r->log.size) {
+			if ((tosend <= r->log.first) && RAFT_LOG(r, r->log.first).snapshot) {
+				// the entries the follower needs have been compacted away
+				raft_send_snapshot(r, dst);
+				return;
+			}
 
-	m.msg.msgtype = RAFT_MSG_UPDATE;
-	m.msg.term = r->term;
-	m.msg.from = r->me;
-
-	if (s->tosend < r->log.first + r->log.size) {
-		raft_entry_t *e = &RAFT_LOG(r, s->tosend);
-		if (e->snapshot) {
-			// TODO: implement snapshot sending
-			shout("tosend = %d, first = %d, size = %d\n", s->tosend, r->log.first, r->log.size);
-			assert(false); // snapshot sending not implemented
+			// the follower is a bit behind: send a batch of entries
+			int n = 0;
+			m.previndex = tosend - 1;
+			if (m.previndex >= 0) {
+				m.prevterm = RAFT_LOG(r, m.previndex).term;
+			} else {
+				m.prevterm = -1;
+			}
+			while ((n < RAFT_UPDATE_BATCH) && (tosend + n < r->log.first + r->log.size)) {
+				raft_entry_t *e = &RAFT_LOG(r, tosend + n);
+				// only the very first entry can be a snapshot, and that
+				// case has been diverted to raft_send_snapshot() above
+				assert(!e->snapshot);
+				m.entries[n++] = *e;
+			}
+			m.nentries = n;
+			m.empty = false;
+			tosend += n;
+		} else {
+			if (window > 0) {
+				// everything has been sent already, no need for a heartbeat
+				break;
+			}
+			if (s->silence < HEARTBEAT_TIMEOUT_MS) {
+				// the recent data traffic already carried our liveness,
+				// no need for an explicit heartbeat
+				break;
+			}
+			// the channel has been idle: send an explicit heartbeat
+			m.empty = true;
+			m.nentries = 0;
 		}
 
-		// the follower is a bit behind: send an update
-		m.previndex = s->tosend - 1;
-		if (m.previndex >= 0) {
-			m.prevterm = RAFT_LOG(r, m.previndex).term;
-		} else {
-			m.prevterm = -1;
+		s->seqno++;
+		m.msg.seqno = s->seqno;
+		if (!m.empty) {
+			debug(
+				"[to %d] update with seqno = %d, previndex = %d, nentries = %d\n",
+				dst, m.msg.seqno, m.previndex, m.nentries
+			);
 		}
-		m.entry = *e;
-		m.empty = false;
-	} else {
-		// the follower is up to date: send a heartbeat
-		m.empty = true;
-	}
-	m.acked = r->log.acked;
 
-	s->seqno++;
-	m.msg.seqno = s->seqno;
-	if (!m.empty) {
-		debug("[to %d] update with seqno = %d, tosend = %d, previndex = %d\n", dst, m.msg.seqno, s->tosend, m.previndex);
-	}
+		raft_send(r, dst, &m, RAFT_MSG_UPDATE_SIZE(m.nentries));
 
-	raft_send(r, dst, &m, sizeof(m));
+		if (m.empty) {
+			break;
+		}
+	}
 }
 
 static void raft_claim(raft_t *r) {
@@ -274,10 +432,21 @@ static void raft_claim(raft_t *r) {
 }
 
 void raft_tick(raft_t *r, int msec) {
+	int i;
+	for (i = 0; i < r->servernum; i++) {
+		if (i == r->me) continue;
+		r->servers[i].silence += msec;
+	}
+
 	r->timer -= msec;
 	if (r->timer < 0) {
 		switch (r->role) {
 			case ROLE_FOLLOWER:
+				if (!r->campaign_ok) {
+					// wait for the anchored leader to claim this group
+					r->leader = NOBODY;
+					break;
+				}
 				debug(
 					"lost the leader,"
 					" claiming leadership\n"
@@ -288,6 +457,11 @@ void raft_tick(raft_t *r, int msec) {
 				raft_claim(r);
 				break;
 			case ROLE_CANDIDATE:
+				if (!r->campaign_ok) {
+					debug("campaigning disallowed, standing down\n");
+					r->role = ROLE_FOLLOWER;
+					break;
+				}
 				debug(
 					"the vote failed,"
 					" claiming leadership\n"
@@ -467,13 +641,127 @@ static void raft_handle_update(raft_t *r, raft_msg_update_t *m) {
 		return;
 	}
 
-	if (!log_append(&r->log, m->previndex, m->prevterm, &m->entry)) {
-		debug("log_append failed\n");
+	{
+		// append the whole batch; each entry becomes the predecessor of the next
+		int i = 0;
+		int previndex = m->previndex;
+		int prevterm = m->prevterm;
+		while (i < m->nentries) {
+			if (!log_append(&r->log, previndex, prevterm, &m->entries[i])) {
+				break;
+			}
+			previndex++;
+			prevterm = m->entries[i].term;
+			i++;
+		}
+		if (i == 0) {
+			debug("log_append failed\n");
+			goto finish;
+		}
+		// report the last entry we have appended, even if the batch was cut short
+		reply.index = m->previndex + i;
+		reply.term = RAFT_LOG(r, reply.index).term;
+	}
+
+	reply.success = true;
+finish:
+	raft_send(r, sender, &reply, sizeof(reply));
+}
+
+static void raft_handle_snapshot(raft_t *r, raft_msg_snapshot_t *m) {
+	int sender = m->msg.from;
+	raft_snapshot_t *snap = &r->insnap;
+
+	raft_msg_snapped_t reply;
+	reply.msg.msgtype = RAFT_MSG_SNAPPED;
+	reply.msg.term = r->term;
+	reply.msg.from = r->me;
+	reply.msg.seqno = m->msg.seqno;
+	reply.success = false;
+	reply.offset = 0;
+
+	if (m->msg.term < r->term) {
+		debug("refuse old snapshot message %d < %d\n", m->msg.term, r->term);
+		goto finish;
+	}
+
+	if (sender != r->leader) {
+		shout("changing leader to %d\n", sender);
+		r->leader = sender;
+	}
+
+	raft_reset_timer(r);
+
+	if (r->snapapplier == NULL) {
+		shout("got a snapshot chunk, but no snapshot applier has been set\n");
 		goto finish;
 	}
-	reply.index = r->log.first + r->log.size - 1;
-	reply.term = RAFT_LOG(r, reply.index).term;
 
+	if (m->index < r->log.first + r->log.size) {
+		// we already have entries at and past the snapshot; tell the leader
+		// the transfer is complete so it proceeds with regular updates
+		reply.offset = m->totalsize;
+		reply.success = true;
+		goto finish;
+	}
+
+	if (
+		!snap->valid || (snap->index != m->index) || (snap->term != m->term) ||
+		(snap->minarg != m->minarg) || (snap->maxarg != m->maxarg)
+	) {
+		// a transfer of a different snapshot begins
+		snap->valid = true;
+		snap->index = m->index;
+		snap->term = m->term;
+		snap->minarg = m->minarg;
+		snap->maxarg = m->maxarg;
+		snap->size = m->totalsize;
+		snap->offset = 0;
+	}
+
+	if (m->totalsize > (int)sizeof(snap->data)) {
+		shout("the snapshot is too big (%d bytes)\n", m->totalsize);
+		snap->valid = false;
+		goto finish;
+	}
+
+	if (m->offset == snap->offset) {
+		memcpy(snap->data + snap->offset, m->data, m->nbytes);
+		snap->offset += m->nbytes;
+	}
+	// else: a duplicate or out of order chunk; just report our progress,
+	// the leader will retransmit from there
+
+	if (snap->offset == snap->size) {
+		// the transfer is complete: install the state and truncate the log
+		raft_entry_t *slot;
+
+		if (!r->snapapplier(snap->minarg, snap->maxarg, snap->data, snap->size)) {
+			shout("failed to apply the snapshot\n");
+			snap->valid = false;
+			goto finish;
+		}
+
+		r->log.first = snap->index;
+		r->log.size = 1;
+		slot = &RAFT_LOG(r, snap->index);
+		slot->snapshot = true;
+		slot->term = snap->term;
+		slot->minarg = snap->minarg;
+		slot->maxarg = snap->maxarg;
+		// the snapshot covers everything up to and including its entry
+		r->log.applied = snap->index + 1;
+		if (r->log.acked < r->log.applied) {
+			r->log.acked = r->log.applied;
+		}
+		snap->valid = false;
+		debug(
+			"installed a snapshot: index = %d, args %d-%d\n",
+			snap->index, snap->minarg, snap->maxarg
+		);
+	}
+
+	reply.offset = snap->valid ? snap->offset : m->totalsize;
 	reply.success = true;
 finish:
 	raft_send(r, sender, &reply, sizeof(reply));
@@ -520,36 +808,32 @@ static void raft_handle_done(raft_t *r, raft_msg_done_t *m) {
 	}
 
 	raft_server_t *server = r->servers + sender;
-	if (m->msg.seqno != server->seqno) {
-		debug("[from %d] ============= mseqno(%d) != sseqno(%d)\n", sender, m->msg.seqno, server->seqno);
+	// with pipelining accept any reply we have not seen yet, not just the latest
+	if ((m->msg.seqno <= server->lastackseqno) || (m->msg.seqno > server->seqno)) {
+		debug("[from %d] ============= mseqno(%d) not in (%d;%d]\n", sender, m->msg.seqno, server->lastackseqno, server->seqno);
 		return;
 	}
-	server->seqno++;
+	server->lastackseqno = m->msg.seqno;
 	if (m->msg.term < r->term) {
 		debug("[from %d] ============= msgterm(%d) != term(%d)\n", sender, m->term, r->term);
 		return;
 	}
 
 	if (m->success) {
-		debug("[from %d] ============= done\n", sender);
-		server->tosend++;
+		debug("[from %d] ============= done up to %d\n", sender, m->index);
+		// the reply tells the last appended index; replies to overlapping
+		// retransmits may arrive out of order, so never move backwards
+		if (m->index + 1 > server->tosend) {
+			server->tosend = m->index + 1;
+		}
 		server->acked = server->tosend;
 		raft_refresh_acked(r);
 	} else {
 		debug("[from %d] ============= refused\n", sender);
-		if (server->tosend > 0) {
-			// the client should have specified the last index it had gotten
-			if (server->tosend == m->index + 1) {
-				shout(
-					"[from %d] the last index I have is %d, but"
-					" I still refuse, this should not happen\n",
-					sender, m->index
-				);
-				assert(false);
-			}
+		// the follower has specified the last index it has gotten
+		if (m->index + 1 < server->tosend) {
 			server->tosend = m->index + 1;
 		}
-		assert(server->tosend >= server->acked); // FIXME: remove this, because 'tosend' is actually allowed to be less than 'acked' if the follower has restarted
 	}
 
 	if (server->tosend < r->log.first + r->log.size) {
@@ -558,6 +842,52 @@ static void raft_handle_done(raft_t *r, raft_msg_done_t *m) {
 	}
 }
 
+static void raft_handle_snapped(raft_t *r, raft_msg_snapped_t *m) {
+	if (r->role != ROLE_LEADER) {
+		return;
+	}
+
+	int sender = m->msg.from;
+	if (sender == r->me) {
+		return;
+	}
+
+	raft_server_t *server = r->servers + sender;
+	if ((m->msg.seqno <= server->lastackseqno) || (m->msg.seqno > server->seqno)) {
+		debug("[from %d] ============= mseqno(%d) not in (%d;%d]\n", sender, m->msg.seqno, server->lastackseqno, server->seqno);
+		return;
+	}
+	server->lastackseqno = m->msg.seqno;
+	if (m->msg.term < r->term) {
+		return;
+	}
+
+	if (!m->success) {
+		debug("[from %d] ============= snapshot chunk refused\n", sender);
+		return;
+	}
+
+	// acks to pipelined chunks may arrive out of order: never move backwards
+	if (m->offset > server->snapoffset) {
+		server->snapoffset = m->offset;
+	}
+
+	if (r->outsnap.valid && (server->snapoffset >= r->outsnap.size)) {
+		// the follower has the whole snapshot: resume regular updates
+		debug("[from %d] ============= snapshot installed\n", sender);
+		server->snapoffset = 0;
+		server->tosend = r->outsnap.index + 1;
+		if (server->tosend > server->acked) {
+			server->acked = server->tosend;
+		}
+		raft_refresh_acked(r);
+	}
+
+	if (server->tosend < r->log.first + r->log.size) {
+		raft_beat(r, sender);
+	}
+}
+
 static void raft_set_term(raft_t *r, int term) {
 	assert(term > r->term);
 	r->term = term;
@@ -615,8 +945,8 @@ finish:
 static void raft_handle_vote(raft_t *r, raft_msg_vote_t *m) {
 	int sender = m->msg.from;
 	raft_server_t *server = r->servers + sender;
-	if (m->msg.seqno != server->seqno) return;
-	server->seqno++;
+	if ((m->msg.seqno <= server->lastackseqno) || (m->msg.seqno > server->seqno)) return;
+	server->lastackseqno = m->msg.seqno;
 	if (m->msg.term < r->term) return;
 
 	if (r->role != ROLE_CANDIDATE) return;
@@ -643,7 +973,7 @@ void raft_handle_message(raft_t *r, raft_msg_t *m) {
 	}
 
 	assert(m->msgtype >= 0);
-	assert(m->msgtype < 4);
+	assert(m->msgtype < RAFT_MSG_MAX);
 	switch (m->msgtype) {
 		case RAFT_MSG_UPDATE:
 			raft_handle_update(r, (raft_msg_update_t *)m);
@@ -651,6 +981,12 @@ void raft_handle_message(raft_t *r, raft_msg_t *m) {
 		case RAFT_MSG_DONE:
 			raft_handle_done(r, (raft_msg_done_t *)m);
 			break;
+		case RAFT_MSG_SNAPSHOT:
+			raft_handle_snapshot(r, (raft_msg_snapshot_t *)m);
+			break;
+		case RAFT_MSG_SNAPPED:
+			raft_handle_snapped(r, (raft_msg_snapped_t *)m);
+			break;
 		case RAFT_MSG_CLAIM:
 			raft_handle_claim(r, (raft_msg_claim_t *)m);
 			break;
@@ -662,7 +998,8 @@ void raft_handle_message(raft_t *r, raft_msg_t *m) {
 	}
 }
 
-static char buf[1024];
+// big enough for any message type, including a full snapshot chunk
+static char buf[sizeof(raft_msg_snapshot_t)];
 
 raft_msg_t *raft_recv_message(raft_t *r) {
 	struct sockaddr_in addr;
@@ -10,6 +10,7 @@
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/socket.h>
@@ -17,11 +18,70 @@
 #include <netinet/tcp.h>
 #include <netinet/in.h>
 
+#include <time.h>
+
 #include "server.h"
 #include "arbiterlimits.h"
 #include "util.h"
 #include "sockhub.h"
 
+/*
+ * ------ flight recorder ------
+ *
+ * A fixed ring of timestamped events on the message path, cheap enough to
+ * stay on in production. When a latency spike is being chased, the ring is
+ * dumped on demand (the daemon dumps it on SIGUSR1) and the gaps between
+ * 'r' (bytes received), 'd'/'D' (dispatch to the main logic and back) and
+ * 'f' (replies flushed to the socket) tell whether the time went to the
+ * network, to arbiter queueing, or to the logic itself.
+ */
+#define TRACE_RING_SIZE 8192
+
+typedef struct trace_event_t {
+	unsigned long long ns; /* CLOCK_MONOTONIC */
+	char point; /* 'r', 'd', 'D' or 'f' */
+	int fd;
+	unsigned int chan; /* meaningful for 'd' and 'D' only */
+	unsigned int aux; /* bytes for 'r'/'f', message size for 'd'/'D' */
+} trace_event_t;
+
+static trace_event_t trace_ring[TRACE_RING_SIZE];
+static unsigned long long trace_count; /* total events ever recorded */
+
+static unsigned long long now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void trace_point(char point, int fd, unsigned int chan, unsigned int aux) {
+	trace_event_t *e = trace_ring + trace_count++ % TRACE_RING_SIZE;
+	e->ns = now_ns();
+	e->point = point;
+	e->fd = fd;
+	e->chan = chan;
+	e->aux = aux;
+}
+
+void server_dump_trace(FILE *out) {
+	unsigned long long i = 0;
+	unsigned long long prev = 0;
+
+	if (trace_count > TRACE_RING_SIZE) {
+		i = trace_count - TRACE_RING_SIZE;
+	}
+	fprintf(out, "flight recorder: %llu events recorded, dumping %llu\n",
+			trace_count, trace_count - i);
+	for (; i < trace_count; i++) {
+		trace_event_t *e = trace_ring + i % TRACE_RING_SIZE;
+		fprintf(out, "%020llu +%-9llu %c fd=%d chan=%u aux=%u\n",
+				e->ns, prev ? e->ns - prev : 0,
+				e->point, e->fd, e->chan, e->aux);
+		prev = e->ns;
+	}
+	fflush(out);
+}
+
 typedef struct buffer_t {
 	int ready; /* number of bytes that are ready to be sent/processed */
 	ShubMessageHdr *curmessage;
@@ -39,6 +99,7 @@ typedef struct client_data_t {
 typedef struct stream_data_t {
 	int fd;
 	bool good; /* 'false': stop serving this stream and disconnect when possible */
+	struct server_data_t *server;
 	buffer_t input;
 	buffer_t output;
 
@@ -53,6 +114,7 @@ typedef struct server_data_t {
 	int port;
 
 	int listener; /* the listening socket */
+	int unix_listener; /* the local fastpath listening socket, -1 if none */
 #ifdef USE_EPOLL
 	int epollfd;
 #else
@@ -65,10 +127,12 @@ typedef struct server_data_t {
 	onmessage_callback_t onmessage;
 	onconnect_callback_t onconnect;
 	ondisconnect_callback_t ondisconnect;
+	onflush_callback_t onflush;
 
 	bool enabled;
 
-	stream_data_t raft_stream;
+	stream_data_t raft_streams[MAX_GROUPS];
+	int raft_streamnum;
 } server_data_t;
 
 /* Returns the created socket, or -1 if failed. */
@@ -104,7 +168,48 @@ static int create_listening_socket(const char *host, int port) {
 	if (listen(s, LISTEN_QUEUE_SIZE) == -1) {
 		shout("failed to listen the socket: %s\n", strerror(errno));
 		return -1;
-	}    
+	}
+
+	/*
+	 * Make the listener non-blocking so that a single readiness event can be
+	 * drained completely with repeated accept() calls.
+	 */
+	if (fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK) == -1) {
+		shout("cannot make the listening socket non-blocking: %s\n", strerror(errno));
+		return -1;
+	}
+
+	return s;
+}
+
+/* Returns the created socket, or -1 if failed. */
+static int create_listening_unix_socket(const char *path) {
+	struct sockaddr addr;
+	int len;
+	int s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s == -1) {
+		shout("cannot create the unix listening socket: %s\n", strerror(errno));
+		return -1;
+	}
+
+	addr.sa_family = AF_UNIX;
+	len = ((char*)addr.sa_data - (char*)&addr) + snprintf(addr.sa_data, sizeof(addr.sa_data), "%s", path);
+	unlink(path);
+	debug("binding unix socket '%s'\n", path);
+	if (bind(s, &addr, len) == -1) {
+		shout("cannot bind the unix listening socket: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (listen(s, LISTEN_QUEUE_SIZE) == -1) {
+		shout("failed to listen the unix socket: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK) == -1) {
+		shout("cannot make the unix listening socket non-blocking: %s\n", strerror(errno));
+		return -1;
+	}
 
 	return s;
 }
@@ -123,6 +228,7 @@ server_t server_init(
 	server->onmessage = onmessage;
 	server->onconnect = onconnect;
 	server->ondisconnect = ondisconnect;
+	server->onflush = NULL;
 
 #ifdef USE_EPOLL
     server->epollfd = epoll_create(MAX_EVENTS);
@@ -135,15 +241,24 @@ server_t server_init(
 	server->maxfd = 0;
 #endif
 
-	server->raft_stream.fd = -1;
-	server->raft_stream.good = false;
-	server->raft_stream.input.ready = false;
-	server->raft_stream.input.data = NULL;
-	server->raft_stream.output.ready = false;
-	server->raft_stream.output.data = NULL;
-	server->raft_stream.output.data = NULL;
-	server->raft_stream.clients = NULL;
-	server->raft_stream.next = NULL;
+	server->unix_listener = -1;
+
+	server->raft_streamnum = 0;
+	{
+		int i;
+		for (i = 0; i < MAX_GROUPS; i++) {
+			stream_t rs = &server->raft_streams[i];
+			rs->fd = -1;
+			rs->good = false;
+			rs->server = server;
+			rs->input.ready = false;
+			rs->input.data = NULL;
+			rs->output.ready = false;
+			rs->output.data = NULL;
+			rs->clients = NULL;
+			rs->next = NULL;
+		}
+	}
 	server->enabled = false;
 
 	return server;
@@ -178,10 +293,20 @@ static bool server_remove_socket(server_t server, int sock) {
 	return true;
 }
 
-void server_set_raft_socket(server_t server, int sock) {
-	server->raft_stream.fd = sock;
-	bool good = server_add_socket(server, sock, &server->raft_stream);
-	server->raft_stream.good = good;
+void server_set_onflush(server_t server, onflush_callback_t onflush) {
+	server->onflush = onflush;
+}
+
+int server_add_raft_socket(server_t server, int sock) {
+	stream_t stream;
+	assert(server->raft_streamnum < MAX_GROUPS);
+	stream = &server->raft_streams[server->raft_streamnum];
+	stream->fd = sock;
+	stream->good = server_add_socket(server, sock, stream);
+	if (!stream->good) {
+		return -1;
+	}
+	return server->raft_streamnum++;
 }
 
 bool server_start(server_t server) {
@@ -197,6 +322,15 @@ bool server_start(server_t server) {
 	return server_add_socket(server, server->listener, NULL);
 }
 
+bool server_listen_unix(server_t server, char *path) {
+	server->unix_listener = create_listening_unix_socket(path);
+	if (server->unix_listener == -1) {
+		return false;
+	}
+
+	return server_add_socket(server, server->unix_listener, NULL);
+}
+
 static bool stream_flush(stream_t stream) {
 	char *cursor;
 	ShubMessageHdr *msg;
@@ -206,6 +340,15 @@ static bool stream_flush(stream_t stream) {
 		return true;
 	}
 
+	/*
+	 * Give the main logic a chance to make the acknowledged state durable
+	 * before any of the buffered replies leaves the server. This also covers
+	 * the mid-tick flushes caused by a full output buffer.
+	 */
+	if (stream->server->onflush) {
+		stream->server->onflush();
+	}
+
 	cursor = stream->output.data;
 	while (tosend > 0) {
 		/* repeat sending until we send everything */
@@ -219,6 +362,7 @@ static bool stream_flush(stream_t stream) {
 		tosend -= sent;
 		assert(tosend >= 0);
 	}
+	trace_point('f', stream->fd, 0, stream->output.ready);
 
 	stream->output.ready = 0;
 	msg = stream->output.curmessage;
@@ -239,8 +383,9 @@ static void server_flush(server_t server) {
 	}
 }
 
-static void stream_init(stream_t stream, int fd) {
+static void stream_init(server_t server, stream_t stream, int fd) {
 	int i;
+	stream->server = server;
 	stream->input.data = malloc(BUFFER_SIZE);
 	assert(stream->input.data);
 	stream->input.curmessage = NULL;
@@ -407,39 +552,64 @@ bool client_redirect(client_t client, unsigned addr, int port) {
 	return true;
 }
 
-static bool server_accept(server_t server) {
+static bool server_accept_from(server_t server, int listener) {
 	int fd;
 	stream_t s;
+	int optval;
 
 	debug("a new connection is queued\n");
 
-	fd = accept(server->listener, NULL, NULL);
-	if (fd == -1) {
-		shout("failed to accept a connection: %s\n", strerror(errno));
-		return false;
-	}
-	debug("a new connection fd=%d accepted\n", fd);
-	
-	if (!server->enabled) {
-		shout("server disabled, disconnecting the accepted connection fd=%d\n", fd);
-		// FIXME: redirect instead of disconnecting
-		close(fd);
-		return false;
+	/*
+	 * With a level-triggered poll a single readiness event may stand for a
+	 * whole backlog of queued connections, so keep accepting until the
+	 * non-blocking listener is drained.
+	 */
+	while ((fd = accept(listener, NULL, NULL)) != -1) {
+		debug("a new connection fd=%d accepted\n", fd);
+
+		if (!server->enabled) {
+			shout("server disabled, disconnecting the accepted connection fd=%d\n", fd);
+			// FIXME: redirect instead of disconnecting
+			close(fd);
+			continue;
+		}
+
+		/* the accepted socket does not necessarily inherit this from the listener */
+		optval = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char const*)&optval, sizeof(optval));
+
+		s = server->free_chain;
+		if (s == NULL) {
+			s = malloc(sizeof(stream_data_t));
+		} else {
+			server->free_chain = s->next;
+		}
+		/* add new stream */
+		s->next = server->used_chain;
+		server->used_chain = s;
+
+		stream_init(server, s, fd);
+
+		if (!server_add_socket(server, fd, s)) {
+			s->good = false;
+			return false;
+		}
 	}
 
-	s = server->free_chain;
-	if (s == NULL) { 
-		s = malloc(sizeof(stream_data_t));
-	} else { 
-		server->free_chain = s->next;
+	if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+		shout("failed to accept a connection: %s\n", strerror(errno));
+		return false;
 	}
-	/* add new stream */
-	s->next = server->used_chain;
-	server->used_chain = s;
 
-	stream_init(s, fd);
+	return true;
+}
 
-	return server_add_socket(server, fd, s);
+static bool server_accept(server_t server) {
+	bool ok = server_accept_from(server, server->listener);
+	if (server->unix_listener != -1) {
+		ok &= server_accept_from(server, server->unix_listener);
+	}
+	return ok;
 }
 
 static client_t stream_get_client(stream_t stream, unsigned int chan, bool *isnew) {
@@ -486,6 +656,7 @@ static bool server_stream_handle(server_t server, stream_t stream) {
 	}
 
 	debug("recved %d bytes\n", recved);
+	trace_point('r', stream->fd, 0, recved);
 	stream->input.ready += recved;
 
 	cursor = stream->input.data;
@@ -510,7 +681,9 @@ static bool server_stream_handle(server_t server, stream_t stream) {
 				}
 				client->stream = NULL;
 			} else {
+				trace_point('d', stream->fd, msg->chan, msg->size);
 				server->onmessage(client, msg->size, (char*)msg + sizeof(ShubMessageHdr));
+				trace_point('D', stream->fd, msg->chan, msg->size);
 			}
 			cursor += header_and_data;
 			toprocess -= header_and_data;
@@ -537,27 +710,28 @@ static bool server_stream_handle(server_t server, stream_t stream) {
 	return true;
 }
 
-bool server_tick(server_t server, int timeout_ms) {
+int server_tick(server_t server, int timeout_ms) {
 
 	int i;
 	int numready;
-	bool raft_ready = false;
+	int raft_ready = 0;
 #ifdef USE_EPOLL
 	struct epoll_event events[MAX_EVENTS];
 	numready = epoll_wait(server->epollfd, events, MAX_EVENTS, timeout_ms);
 	if (numready < 0) {
 		shout("failed to epoll: %s\n", strerror(errno));
-		return false;
+		return 0;
 	}
-	for (i = 0; i < numready; i++) { 
+	for (i = 0; i < numready; i++) {
 		stream_t stream = (stream_t)events[i].data.ptr;
 
-		if (stream == NULL) { 
+		if (stream == NULL) {
 			server_accept(server);
-		} else if (stream == &server->raft_stream) {
-			raft_ready = true;
+		} else if ((stream >= server->raft_streams) &&
+				   (stream < server->raft_streams + server->raft_streamnum)) {
+			raft_ready |= 1 << (stream - server->raft_streams);
 		} else {
-			if (events[i].events & EPOLLERR) {
+			if (events[i].events & (EPOLLERR | EPOLLHUP)) {
 				stream->good = false;
 			} else if (events[i].events & EPOLLIN) {
 				server_stream_handle(server, stream);
@@ -565,26 +739,34 @@ bool server_tick(server_t server, int timeout_ms) {
 		}
 	}
 #else
+	stream_t s;
 	fd_set readfds = server->all;
 	struct timeval timeout = ms2tv(timeout_ms);
 	numready = select(server->maxfd + 1, &readfds, NULL, NULL, &timeout);
 	if (numready == -1) {
 		shout("failed to select: %s\n", strerror(errno));
-		return false;
+		return 0;
 	}
 
 	if (FD_ISSET(server->listener, &readfds)) {
 		numready--;
-		server_accept(server);
+		server_accept_from(server, server->listener);
 	}
 
-	if ((server->raft_stream.good) && FD_ISSET(server->raft_stream.fd, &readfds)) {
+	if ((server->unix_listener != -1) && FD_ISSET(server->unix_listener, &readfds)) {
 		numready--;
-		raft_ready = true;
+		server_accept_from(server, server->unix_listener);
 	}
 
-	stream_t s;
-	for (s = server_used_chain; (s != NULL) && (numready > 0); s = s->next) {
+	for (i = 0; i < server->raft_streamnum; i++) {
+		stream_t rs = &server->raft_streams[i];
+		if (rs->good && FD_ISSET(rs->fd, &readfds)) {
+			numready--;
+			raft_ready |= 1 << i;
+		}
+	}
+
+	for (s = server->used_chain; (s != NULL) && (numready > 0); s = s->next) {
 		if (FD_ISSET(s->fd, &readfds)) {
 			server_stream_handle(server, s);
 			numready--;
@@ -0,0 +1,9 @@
+/* contrib/colscan/colscan--1.0.sql */
+
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION colscan" to load this file. \quit
+
+CREATE FUNCTION colscan_store(regclass)
+RETURNS bigint
+AS 'MODULE_PATHNAME', 'colscan_store'
+LANGUAGE C STRICT;
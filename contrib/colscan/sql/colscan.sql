@@ -0,0 +1,29 @@
+CREATE EXTENSION colscan;
+CREATE TABLE colscan_tab (id int4, big int8, val float8, flag bool);
+INSERT INTO colscan_tab
+  SELECT g, g * 100000, g * 0.25, g % 3 = 0
+  FROM generate_series(1, 1000) g;
+INSERT INTO colscan_tab VALUES (NULL, NULL, NULL, NULL);
+-- snapshot the table into its columnar side-file
+SELECT colscan_store('colscan_tab');
+-- scans now go through the custom provider
+EXPLAIN (COSTS OFF) SELECT sum(big) FROM colscan_tab;
+SELECT count(*), count(id), sum(id), sum(big), sum(val) FROM colscan_tab;
+SELECT count(*) FROM colscan_tab WHERE flag;
+SELECT count(*) FROM colscan_tab WHERE id IS NULL;
+SELECT id, big, val FROM colscan_tab WHERE id BETWEEN 4 AND 6;
+-- disabling the provider falls back to the heap, with the same answers
+SET colscan.enable = off;
+EXPLAIN (COSTS OFF) SELECT sum(big) FROM colscan_tab;
+SELECT count(*), count(id), sum(id), sum(big), sum(val) FROM colscan_tab;
+RESET colscan.enable;
+-- the side-file is a static snapshot: new rows appear after a refresh
+INSERT INTO colscan_tab VALUES (2000, 200000000, 500.0, true);
+SELECT count(*) FROM colscan_tab;
+SELECT colscan_store('colscan_tab');
+SELECT count(*) FROM colscan_tab;
+-- only fixed-width pass-by-value columns can be stored
+CREATE TABLE colscan_bad (t text);
+SELECT colscan_store('colscan_bad');
+DROP TABLE colscan_bad;
+DROP TABLE colscan_tab;
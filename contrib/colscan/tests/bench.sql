@@ -0,0 +1,36 @@
+-- Benchmark for the colscan custom scan provider.
+--
+-- Run with:  psql -f tests/bench.sql
+--
+-- Builds a 10M-row table of fixed-width columns, snapshots it into its
+-- columnar side-file, and times the same aggregate queries through the
+-- heap (colscan.enable = off) and through the columnar custom scan.
+
+CREATE EXTENSION IF NOT EXISTS colscan;
+
+DROP TABLE IF EXISTS colscan_bench;
+CREATE TABLE colscan_bench (id int4, big int8, val float8, flag bool);
+INSERT INTO colscan_bench
+  SELECT g, g * 17, random() * 1000, g % 7 = 0
+  FROM generate_series(1, 10000000) g;
+VACUUM ANALYZE colscan_bench;
+
+SELECT colscan_store('colscan_bench');
+
+\timing on
+
+\echo === heap scan ===
+SET colscan.enable = off;
+SELECT count(*), sum(big), avg(val) FROM colscan_bench;
+SELECT count(*) FROM colscan_bench WHERE flag;
+SELECT sum(val) FROM colscan_bench WHERE id % 100 = 0;
+
+\echo === columnar custom scan ===
+SET colscan.enable = on;
+SELECT count(*), sum(big), avg(val) FROM colscan_bench;
+SELECT count(*) FROM colscan_bench WHERE flag;
+SELECT sum(val) FROM colscan_bench WHERE id % 100 = 0;
+
+\timing off
+
+DROP TABLE colscan_bench;
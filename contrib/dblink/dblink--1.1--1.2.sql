@@ -0,0 +1,21 @@
+/* contrib/dblink/dblink--1.1--1.2.sql */
+
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION dblink UPDATE TO '1.2'" to load this file. \quit
+
+CREATE FUNCTION dblink_send_batch(text, text[])
+RETURNS int4
+AS 'MODULE_PATHNAME', 'dblink_send_batch'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION dblink_get_batch_status(text,
+    OUT stmt_number int4, OUT status text)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'dblink_get_batch_status'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION dblink_get_batch_status(text, bool,
+    OUT stmt_number int4, OUT status text)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'dblink_get_batch_status'
+LANGUAGE C STRICT;
@@ -652,6 +652,58 @@ dblink_send_query(PG_FUNCTION_ARGS)
 	PG_RETURN_INT32(retval);
 }
 
+/*
+ * Send a batch of statements on a named connection in one round trip.
+ *
+ * The statements are shipped as a single simple-protocol query, so the
+ * remote server executes them in order (as one implicit transaction when
+ * no explicit transaction control is included) and returns one result per
+ * statement.  The results are then harvested, in the same order, with
+ * dblink_get_result() or dblink_get_batch_status().  This avoids paying
+ * one network round trip per statement when fanning out to remote nodes.
+ */
+PG_FUNCTION_INFO_V1(dblink_send_batch);
+Datum
+dblink_send_batch(PG_FUNCTION_ARGS)
+{
+	char	   *conname = NULL;
+	PGconn	   *conn = NULL;
+	remoteConn *rconn = NULL;
+	char	  **statements;
+	int			nstatements;
+	StringInfoData buf;
+	int			i;
+	int			retval;
+
+	DBLINK_GET_NAMED_CONN;
+
+	statements = get_text_array_contents(PG_GETARG_ARRAYTYPE_P(1),
+										 &nstatements);
+	if (nstatements <= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("statement array must not be empty")));
+
+	initStringInfo(&buf);
+	for (i = 0; i < nstatements; i++)
+	{
+		if (statements[i] == NULL)
+			ereport(ERROR,
+					(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+					 errmsg("statement array must not contain nulls")));
+		if (i > 0)
+			appendStringInfoString(&buf, ";\n");
+		appendStringInfoString(&buf, statements[i]);
+	}
+
+	/* async batch send */
+	retval = PQsendQuery(conn, buf.data);
+	if (retval != 1)
+		elog(NOTICE, "could not send batch: %s", PQerrorMessage(conn));
+
+	PG_RETURN_INT32(retval);
+}
+
 PG_FUNCTION_INFO_V1(dblink_get_result);
 Datum
 dblink_get_result(PG_FUNCTION_ARGS)
@@ -659,6 +711,94 @@ dblink_get_result(PG_FUNCTION_ARGS)
 	return dblink_record_internal(fcinfo, true);
 }
 
+#define DBLINK_BATCH_COLS	2
+
+/*
+ * Harvest the command status of every pending result on a named
+ * connection, in the order the statements were sent.
+ *
+ * Returns one row per statement, giving its position in the batch and its
+ * command status (e.g. "UPDATE 1", "SELECT 3").  Statements that return
+ * rows can instead be collected individually, and in order, with repeated
+ * dblink_get_result() calls; this function is the convenient form when
+ * the batch is DML and only success matters.  With fail_on_error = false,
+ * a failed statement is reported as a NOTICE and produces a "FAILED"
+ * status row, and harvesting continues.
+ */
+PG_FUNCTION_INFO_V1(dblink_get_batch_status);
+Datum
+dblink_get_batch_status(PG_FUNCTION_ARGS)
+{
+	char	   *conname = NULL;
+	PGconn	   *conn = NULL;
+	remoteConn *rconn = NULL;
+	bool		fail = true;	/* default to backward compatible */
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	PGresult   *res;
+	int			stmt_number = 0;
+
+	prepTuplestoreResult(fcinfo);
+
+	DBLINK_INIT;
+	DBLINK_GET_NAMED_CONN;
+	if (PG_NARGS() == 2)
+		fail = PG_GETARG_BOOL(1);
+
+	/* create the tuplestore in per-query memory */
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	tupdesc = CreateTemplateTupleDesc(DBLINK_BATCH_COLS, false);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 1, "stmt_number",
+					   INT4OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 2, "status",
+					   TEXTOID, -1, 0);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	while ((res = PQgetResult(conn)) != NULL)
+	{
+		Datum		values[DBLINK_BATCH_COLS];
+		bool		nulls[DBLINK_BATCH_COLS];
+
+		CHECK_FOR_INTERRUPTS();
+
+		stmt_number++;
+
+		memset(nulls, 0, sizeof(nulls));
+		values[0] = Int32GetDatum(stmt_number);
+
+		if (PQresultStatus(res) == PGRES_COMMAND_OK ||
+			PQresultStatus(res) == PGRES_TUPLES_OK)
+		{
+			values[1] = CStringGetTextDatum(PQcmdStatus(res));
+			PQclear(res);
+		}
+		else
+		{
+			/* dblink_res_error clears the result; with fail it ereports */
+			dblink_res_error(conname, res,
+							 "could not execute batch statement", fail);
+			values[1] = CStringGetTextDatum("FAILED");
+		}
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
 static Datum
 dblink_record_internal(FunctionCallInfo fcinfo, bool is_async)
 {
@@ -393,6 +393,20 @@ SELECT dblink_cancel_query('dtest1');
 SELECT dblink_error_message('dtest1');
 SELECT dblink_disconnect('dtest1');
 
+-- test asynchronous batch execution
+SELECT dblink_connect('dtest1', connection_parameters());
+SELECT dblink_send_batch('dtest1', ARRAY[
+ 'select count(*) from foo',
+ 'update foo set f2 = f2 where f1 = 0',
+ 'select f1 from foo where f1 < 3 order by f1']);
+SELECT * FROM dblink_get_batch_status('dtest1');
+SELECT dblink_send_batch('dtest1', ARRAY[
+ 'select f1 from foo where f1 < 2 order by f1',
+ 'select f2 from foo where f1 = 2']);
+SELECT * from dblink_get_result('dtest1') as t1(f1 int);
+SELECT * from dblink_get_result('dtest1') as t2(f2 text);
+SELECT dblink_disconnect('dtest1');
+
 -- test foreign data wrapper functionality
 CREATE ROLE dblink_regression_test;
 DO $d$
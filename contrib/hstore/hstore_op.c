@@ -5,6 +5,7 @@
 
 #include "access/hash.h"
 #include "access/htup_details.h"
+#include "access/tuptoaster.h"
 #include "catalog/pg_type.h"
 #include "funcapi.h"
 #include "utils/builtins.h"
@@ -12,6 +13,15 @@
 
 #include "hstore.h"
 
+/*
+ * Detoast an hstore argument through the shared untoast cache, so that
+ * extracting several keys from the same wide column detoasts it only once.
+ * The result may be owned by the cache and must be treated as read-only;
+ * see heap_tuple_untoast_attr_cached().
+ */
+#define PG_GETARG_HS_CACHED(x) \
+	((HStore *) heap_tuple_untoast_attr_cached((struct varlena *) DatumGetPointer(PG_GETARG_DATUM(x))))
+
 /* old names for C functions */
 HSTORE_POLLUTE(hstore_fetchval, fetchval);
 HSTORE_POLLUTE(hstore_exists, exists);
@@ -130,7 +140,7 @@ PG_FUNCTION_INFO_V1(hstore_fetchval);
 Datum
 hstore_fetchval(PG_FUNCTION_ARGS)
 {
-	HStore	   *hs = PG_GETARG_HS(0);
+	HStore	   *hs = PG_GETARG_HS_CACHED(0);
 	text	   *key = PG_GETARG_TEXT_PP(1);
 	HEntry	   *entries = ARRPTR(hs);
 	text	   *out;
@@ -151,7 +161,7 @@ PG_FUNCTION_INFO_V1(hstore_exists);
 Datum
 hstore_exists(PG_FUNCTION_ARGS)
 {
-	HStore	   *hs = PG_GETARG_HS(0);
+	HStore	   *hs = PG_GETARG_HS_CACHED(0);
 	text	   *key = PG_GETARG_TEXT_PP(1);
 	int			idx = hstoreFindKey(hs, NULL,
 									VARDATA_ANY(key), VARSIZE_ANY_EXHDR(key));
@@ -232,7 +242,7 @@ PG_FUNCTION_INFO_V1(hstore_defined);
 Datum
 hstore_defined(PG_FUNCTION_ARGS)
 {
-	HStore	   *hs = PG_GETARG_HS(0);
+	HStore	   *hs = PG_GETARG_HS_CACHED(0);
 	text	   *key = PG_GETARG_TEXT_PP(1);
 	HEntry	   *entries = ARRPTR(hs);
 	int			idx = hstoreFindKey(hs, NULL,
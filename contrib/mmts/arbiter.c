@@ -6,6 +6,8 @@
  */
 
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -86,9 +88,10 @@ typedef struct
 	nodemask_t     disabledNodeMask; /* bitmask of disabled nodes at the sender of message */
 } MtmArbiterMessage;
 
-typedef struct 
+typedef struct
 {
 	int used;
+	int sent; /* bytes of the current content already written to the socket */
 	MtmArbiterMessage data[BUFFER_SIZE];
 } MtmBuffer;
 
@@ -203,11 +206,27 @@ static void MtmDisconnect(int node)
 	sockets[node] = -1;
 }
 
+static void MtmSetNonBlocking(int sd)
+{
+	int flags = fcntl(sd, F_GETFL, 0);
+	if (flags < 0 || fcntl(sd, F_SETFL, flags | O_NONBLOCK) < 0) {
+		elog(WARNING, "Arbiter failed to switch socket to non-blocking mode: %d", errno);
+	}
+}
+
 static bool MtmWriteSocket(int sd, void const* buf, int size)
 {
     char* src = (char*)buf;
     while (size != 0) {
         int n = send(sd, src, size, 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            /* the socket is non-blocking but the caller wants everything sent */
+            struct pollfd pfd;
+            pfd.fd = sd;
+            pfd.events = POLLOUT;
+            poll(&pfd, 1, -1);
+            continue;
+        }
         if (n <= 0) {
 			return false;
         }
@@ -330,11 +349,14 @@ static void MtmOpenConnections()
 			connStr = end;
 		}
 		hosts[i] = host;
-		if (i+1 != MtmNodeId) { 
+		if (i+1 != MtmNodeId) {
 			sockets[i] = MtmConnectSocket(host, MtmArbiterPort + i + 1, MtmConnectAttempts);
-			if (sockets[i] < 0) { 
+			if (sockets[i] < 0) {
 				MtmDropNode(i+1, false);
-			} 
+			} else {
+				/* after the blocking handshake, pipeline the vote traffic */
+				MtmSetNonBlocking(sockets[i]);
+			}
 		} else {
 			sockets[i] = -1;
 		}
@@ -349,14 +371,15 @@ static void MtmOpenConnections()
 
 static bool MtmSendToNode(int node, void const* buf, int size)
 {
-	while (!MtmWriteSocket(sockets[node], buf, size)) { 
+	while (!MtmWriteSocket(sockets[node], buf, size)) {
 		elog(WARNING, "Arbiter failed to write socket: %d", errno);
 		close(sockets[node]);
 		sockets[node] = MtmConnectSocket(hosts[node], MtmArbiterPort + node + 1, MtmReconnectAttempts);
-		if (sockets[node] < 0) { 
+		if (sockets[node] < 0) {
 			MtmDropNode(node+1, false);
 			return false;
 		}
+		MtmSetNonBlocking(sockets[node]);
 	}
 	return true;
 }
@@ -441,12 +464,14 @@ static void MtmAcceptIncomingConnections()
 static void MtmAppendBuffer(MtmBuffer* txBuffer, TransactionId xid, int node, MtmTransState* ts)
 {
 	MtmBuffer* buf = &txBuffer[node];
-	if (buf->used == BUFFER_SIZE) { 
-		if (!MtmSendToNode(node, buf->data, buf->used*sizeof(MtmArbiterMessage))) {			
+	if (buf->used == BUFFER_SIZE) {
+		if (!MtmSendToNode(node, (char*)buf->data + buf->sent, buf->used*sizeof(MtmArbiterMessage) - buf->sent)) {
 			buf->used = 0;
+			buf->sent = 0;
 			return;
 		}
 		buf->used = 0;
+		buf->sent = 0;
 	}
 	MTM_TRACE("Send message %s CSN=%ld to node %d from node %d for global transaction %d/local transaction %d\n", 
 			  messageText[ts->cmd], ts->csn, node+1, MtmNodeId, ts->gtid.xid, ts->xid);
@@ -475,6 +500,68 @@ static void MtmBroadcastMessage(MtmBuffer* txBuffer, MtmTransState* ts)
 	Assert(n == ds->nNodes);
 }
 
+/*
+ * Flush the per-node buffers over the non-blocking sockets, serving all the
+ * peers in parallel: a peer with a full TCP window only delays its own
+ * buffer instead of stalling the whole round as the old sequential blocking
+ * sends did. We only return to waiting for new votes once everything is on
+ * the wire (or the unreachable peers are dropped), so nothing lingers
+ * unsent.
+ */
+static void MtmFlushBuffers(MtmBuffer* txBuffer, int nNodes)
+{
+	static struct pollfd* fds;
+	bool pending;
+
+	if (fds == NULL) {
+		fds = (struct pollfd*)palloc(sizeof(struct pollfd)*nNodes);
+	}
+
+	do {
+		int i;
+		int npending = 0;
+		pending = false;
+		for (i = 0; i < nNodes; i++) {
+			MtmBuffer* buf = &txBuffer[i];
+			int size = buf->used*sizeof(MtmArbiterMessage);
+			while (buf->sent < size) {
+				int n = send(sockets[i], (char*)buf->data + buf->sent, size - buf->sent, 0);
+				if (n > 0) {
+					buf->sent += n;
+					continue;
+				}
+				if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+					/* the peer is slow: serve the others and come back */
+					fds[npending].fd = sockets[i];
+					fds[npending].events = POLLOUT;
+					npending += 1;
+					pending = true;
+					break;
+				}
+				elog(WARNING, "Arbiter failed to write socket: %d", errno);
+				close(sockets[i]);
+				sockets[i] = MtmConnectSocket(hosts[i], MtmArbiterPort + i + 1, MtmReconnectAttempts);
+				if (sockets[i] < 0) {
+					MtmDropNode(i+1, false);
+					buf->used = 0;
+					buf->sent = 0;
+					break;
+				}
+				MtmSetNonBlocking(sockets[i]);
+				/* resend the whole buffer on the fresh connection */
+				buf->sent = 0;
+			}
+			if (buf->sent == size) {
+				buf->used = 0;
+				buf->sent = 0;
+			}
+		}
+		if (pending) {
+			poll(fds, npending, -1);
+		}
+	} while (pending);
+}
+
 static void MtmTransSender(Datum arg)
 {
 	int nNodes = MtmNodes;
@@ -485,12 +572,13 @@ static void MtmTransSender(Datum arg)
 
 	MtmOpenConnections();
 
-	for (i = 0; i < nNodes; i++) { 
+	for (i = 0; i < nNodes; i++) {
 		txBuffer[i].used = 0;
+		txBuffer[i].sent = 0;
 	}
 
 	while (true) {
-		MtmTransState* ts;		
+		MtmTransState* ts;
 		PGSemaphoreLock(&ds->votingSemaphore);
 		CHECK_FOR_INTERRUPTS();
 
@@ -511,19 +599,36 @@ static void MtmTransSender(Datum arg)
 		ds->votingTransactions = NULL;
 		MtmUnlock();
 
-		for (i = 0; i < nNodes; i++) { 
-			if (txBuffer[i].used != 0) { 
-				MtmSendToNode(i, txBuffer[i].data, txBuffer[i].used*sizeof(MtmArbiterMessage));
-				txBuffer[i].used = 0;
-			}
-		}		
+		MtmFlushBuffers(txBuffer, nNodes);
 	}
 }
 
+/*
+ * Backends to be woken up after the current message batch. SetLatch on
+ * another process costs a kill() syscall; issuing it while MtmLock is held
+ * exclusively would stall every committing backend behind the arbiter for
+ * the whole batch during vote storms, so MtmWakeUpBackend only marks the
+ * transaction done and queues the wakeup, and the latches are set after
+ * MtmUnlock. A batch holds at most BUFFER_SIZE messages and each message
+ * wakes at most one backend, so the queue cannot overflow.
+ */
+static int wakeQueue[BUFFER_SIZE];
+static int nWakeQueued;
+
 static void MtmWakeUpBackend(MtmTransState* ts)
 {
 	ts->done = true;
-	SetLatch(&ProcGlobal->allProcs[ts->procno].procLatch); 
+	Assert(nWakeQueued < BUFFER_SIZE);
+	wakeQueue[nWakeQueued++] = ts->procno;
+}
+
+static void MtmSendQueuedWakeUps(void)
+{
+	int i;
+	for (i = 0; i < nWakeQueued; i++) {
+		SetLatch(&ProcGlobal->allProcs[wakeQueue[i]].procLatch);
+	}
+	nWakeQueued = 0;
 }
 
 #if !USE_EPOLL
@@ -661,10 +766,22 @@ static void MtmTransReceiver(Datum arg)
 								ts->status = TRANSACTION_STATUS_UNKNOWN;
 								MtmAdjustSubtransactions(ts);
 								MtmSendNotificationMessage(ts);
+								if (MtmSpeculativeCommit) {
+									/* Outcome is decided and final CSN is assigned: release the backend
+									 * without waiting for COMMITTED acknowledgements from replicas.
+									 * Lagging replicas keep the transaction in-doubt, so snapshots
+									 * taken there still wait on its CSN.
+									 */
+									MtmWakeUpBackend(ts);
+								}
 							}
 							break;
 						case MSG_COMMITTED:
-							Assert(ts->status == TRANSACTION_STATUS_UNKNOWN);
+							/* With speculative commit the backend may already have finished
+							 * the transaction and marked the state committed
+							 */
+							Assert(ts->status == TRANSACTION_STATUS_UNKNOWN
+								   || ts->status == TRANSACTION_STATUS_COMMITTED);
 							Assert(ts->nVotes < ds->nNodes);
 							if (++ts->nVotes == ds->nNodes) { 									
 								/* All nodes have the same CSN */
@@ -727,7 +844,9 @@ static void MtmTransReceiver(Datum arg)
 					}
 				}
 				MtmUnlock();
-				
+
+				MtmSendQueuedWakeUps();
+
 				rxBuffer[i].used -= nResponses*sizeof(MtmArbiterMessage);
 				if (rxBuffer[i].used != 0) { 
 					memmove(rxBuffer[i].data, (char*)rxBuffer[i].data + nResponses*sizeof(MtmArbiterMessage), rxBuffer[i].used);
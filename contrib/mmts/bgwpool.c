@@ -1,4 +1,5 @@
 #include "postgres.h"
+#include "access/xact.h"
 #include "fmgr.h"
 #include "miscadmin.h"
 #include "postmaster/postmaster.h"
@@ -7,6 +8,7 @@
 #include "storage/spin.h"
 #include "storage/pg_sema.h"
 #include "storage/shmem.h"
+#include "utils/memutils.h"
 
 #include "bgwpool.h"
 
@@ -19,12 +21,95 @@ typedef struct
 size_t n_snapshots;
 size_t n_active;
 
+/*
+ * Ring entries are preceded by an 8 byte header: the item size followed by
+ * the id of the origin node it was received from (0 for unattributed items).
+ * The origin travels with the item so that the worker draining it can credit
+ * the bytes back to that origin's fair-share account.
+ */
+#define RING_ENTRY_HEADER 8
+
+static bool BgwRingHasRoom(size_t head, size_t tail, size_t ringSize, size_t size)
+{
+    return !((head <= tail && ringSize - tail < size + RING_ENTRY_HEADER && head < size)
+             || (head > tail && head - tail < size + RING_ENTRY_HEADER));
+}
+
+/*
+ * Charge 'size' bytes to the origin's account, blocking while the origin is
+ * over its weighted share of the pool queue space and other origins have
+ * work queued. The share is computed against the origins which currently
+ * have bytes queued, so a lone busy origin may still use the whole queue;
+ * fairness only kicks in under contention. This is what keeps one node
+ * replaying a large backlog from filling every ring and starving timely
+ * transactions from the other nodes: its receiver is throttled here instead.
+ */
+static void BgwPoolOriginAdmit(BgwPool* pool, int origin, size_t size)
+{
+    if (origin <= 0 || origin > BGWPOOL_MAX_ORIGINS) {
+        return;
+    }
+    while (true) {
+        int weightSum = 0;
+        bool othersPending = false;
+        int i;
+
+        SpinLockAcquire(&pool->originLock);
+        for (i = 1; i <= BGWPOOL_MAX_ORIGINS; i++) {
+            if (pool->originUsed[i] != 0 || i == origin) {
+                weightSum += pool->originWeight[i];
+                if (i != origin && pool->originUsed[i] != 0) {
+                    othersPending = true;
+                }
+            }
+        }
+        if (!othersPending
+            || pool->originUsed[origin] + size
+               <= pool->totalQueueSize * pool->originWeight[origin] / weightSum)
+        {
+            pool->originUsed[origin] += size;
+            SpinLockRelease(&pool->originLock);
+            return;
+        }
+        SpinLockRelease(&pool->originLock);
+        pg_usleep(1000);
+    }
+}
+
+static void BgwPoolOriginRelease(BgwPool* pool, int origin, size_t size)
+{
+    if (origin <= 0 || origin > BGWPOOL_MAX_ORIGINS) {
+        return;
+    }
+    SpinLockAcquire(&pool->originLock);
+    Assert(pool->originUsed[origin] >= size);
+    pool->originUsed[origin] -= size;
+    SpinLockRelease(&pool->originLock);
+}
+
+void BgwPoolSetOriginWeight(BgwPool* pool, int origin, int weight)
+{
+    if (origin <= 0 || origin > BGWPOOL_MAX_ORIGINS) {
+        return;
+    }
+    if (weight < 1) {
+        weight = 1;
+    }
+    SpinLockAcquire(&pool->originLock);
+    pool->originWeight[origin] = weight;
+    SpinLockRelease(&pool->originLock);
+}
+
 static void BgwPoolMainLoop(Datum arg)
 {
     BgwPoolExecutorCtx* ctx = (BgwPoolExecutorCtx*)arg;
     int id = ctx->id;
     BgwPool* pool = ctx->constructor();
+    BgwPoolShard* shard = &pool->shards[id % pool->nShards];
+    MemoryContext workContext;
+    sigjmp_buf localSigjmpBuf;
     int size;
+    int origin;
     void* work;
 
     BackgroundWorkerUnblockSignals();
@@ -32,47 +117,130 @@ static void BgwPoolMainLoop(Datum arg)
 
     elog(WARNING, "Start background worker %d", id);
 
-    while(true) { 
-        PGSemaphoreLock(&pool->available);
-        SpinLockAcquire(&pool->lock);
-        size = *(int*)&pool->queue[pool->head];
-        Assert(size < pool->size);
-        work = palloc(size);
-        pool->active -= 1;
-        if (pool->head + size + 4 > pool->size) { 
-            memcpy(work, pool->queue, size);
-            pool->head = INTALIGN(size);
-        } else { 
-            memcpy(work, &pool->queue[pool->head+4], size);
-            pool->head += 4 + INTALIGN(size);
-        }
-        if (pool->size == pool->head) { 
-            pool->head = 0;
+    workContext = AllocSetContextCreate(TopMemoryContext,
+                                        "BgwPoolWork",
+                                        ALLOCSET_DEFAULT_MINSIZE,
+                                        ALLOCSET_DEFAULT_INITSIZE,
+                                        ALLOCSET_DEFAULT_MAXSIZE);
+
+    /*
+     * Recover from errors which escape the executor instead of exiting. The
+     * process then keeps its relation and catalog caches warm, while a
+     * replacement worker would repeat the whole connection setup, and only
+     * after the bgw_restart_time delay; during reconnect storms that left the
+     * pool understaffed for seconds at a time. FATAL errors still terminate
+     * the worker as usual.
+     */
+    if (sigsetjmp(localSigjmpBuf, 1) != 0)
+    {
+        error_context_stack = NULL;
+        HOLD_INTERRUPTS();
+        EmitErrorReport();
+        AbortCurrentTransaction();
+        FlushErrorState();
+        MemoryContextSwitchTo(TopMemoryContext);
+        RESUME_INTERRUPTS();
+        elog(LOG, "Background worker %d recovered from error", id);
+    }
+    PG_exception_stack = &localSigjmpBuf;
+
+    while(true) {
+        /*
+         * Work items live in the worker's own context, reset before each
+         * item. The executor switches to its own contexts and may error out,
+         * so resetting here is what reliably reclaims the previous item.
+         */
+        MemoryContextSwitchTo(workContext);
+        MemoryContextResetAndDeleteChildren(workContext);
+
+        PGSemaphoreLock(&shard->available);
+        SpinLockAcquire(&shard->lock);
+        if (shard->prioActive > 0) {
+            /* Drain the priority lane before the normal ring */
+            size = *(int*)&shard->prioQueue[shard->prioHead];
+            origin = *(int*)&shard->prioQueue[shard->prioHead+4];
+            Assert(size < (int)shard->prioSize);
+            work = palloc(size);
+            shard->prioActive -= 1;
+            if (shard->prioHead + size + RING_ENTRY_HEADER > shard->prioSize) {
+                memcpy(work, shard->prioQueue, size);
+                shard->prioHead = INTALIGN(size);
+            } else {
+                memcpy(work, &shard->prioQueue[shard->prioHead+RING_ENTRY_HEADER], size);
+                shard->prioHead += RING_ENTRY_HEADER + INTALIGN(size);
+            }
+            if (shard->prioSize == shard->prioHead) {
+                shard->prioHead = 0;
+            }
+        } else {
+            size = *(int*)&shard->queue[shard->head];
+            origin = *(int*)&shard->queue[shard->head+4];
+            Assert(size < (int)shard->size);
+            work = palloc(size);
+            shard->active -= 1;
+            if (shard->head + size + RING_ENTRY_HEADER > shard->size) {
+                memcpy(work, shard->queue, size);
+                shard->head = INTALIGN(size);
+            } else {
+                memcpy(work, &shard->queue[shard->head+RING_ENTRY_HEADER], size);
+                shard->head += RING_ENTRY_HEADER + INTALIGN(size);
+            }
+            if (shard->size == shard->head) {
+                shard->head = 0;
+            }
         }
-        if (pool->producerBlocked) {
-            pool->producerBlocked = false;
-            PGSemaphoreUnlock(&pool->overflow);
+        if (shard->producerBlocked) {
+            shard->producerBlocked = false;
+            PGSemaphoreUnlock(&shard->overflow);
         }
-        SpinLockRelease(&pool->lock);
+        SpinLockRelease(&shard->lock);
+        BgwPoolOriginRelease(pool, origin, size);
         pool->executor(id, work, size);
-        pfree(work);
     }
 }
 
-void BgwPoolInit(BgwPool* pool, BgwPoolExecutor executor, char const* dbname, size_t queueSize)
+void BgwPoolInit(BgwPool* pool, BgwPoolExecutor executor, char const* dbname, size_t queueSize, int nWorkers)
 {
-    pool->queue = (char*)ShmemAlloc(queueSize);
+    int i;
+    size_t shardSize;
+    size_t prioSize;
+
+    if (nWorkers > BGWPOOL_MAX_WORKERS) {
+        nWorkers = BGWPOOL_MAX_WORKERS;
+    }
     pool->executor = executor;
-    PGSemaphoreCreate(&pool->available);
-    PGSemaphoreCreate(&pool->overflow);
-    PGSemaphoreReset(&pool->available);
-    PGSemaphoreReset(&pool->overflow);
-    SpinLockInit(&pool->lock);
-    pool->producerBlocked = false;
-    pool->head = 0;
-    pool->tail = 0;
-    pool->size = queueSize;
-    pool->active = 0;
+    pool->nShards = nWorkers;
+    pool->nActiveShards = nWorkers;
+    /* carve the priority lane out of each shard, keeping the total size */
+    shardSize = INTALIGN(queueSize / nWorkers - 3);
+    prioSize = INTALIGN(shardSize / 8);
+    shardSize -= prioSize;
+    pool->totalQueueSize = 0;
+    SpinLockInit(&pool->originLock);
+    for (i = 0; i <= BGWPOOL_MAX_ORIGINS; i++) {
+        pool->originUsed[i] = 0;
+        pool->originWeight[i] = BGWPOOL_DEFAULT_ORIGIN_WEIGHT;
+    }
+    for (i = 0; i < nWorkers; i++) {
+        BgwPoolShard* shard = &pool->shards[i];
+        shard->queue = (char*)ShmemAlloc(shardSize);
+        shard->prioQueue = (char*)ShmemAlloc(prioSize);
+        PGSemaphoreCreate(&shard->available);
+        PGSemaphoreCreate(&shard->overflow);
+        PGSemaphoreReset(&shard->available);
+        PGSemaphoreReset(&shard->overflow);
+        SpinLockInit(&shard->lock);
+        shard->producerBlocked = false;
+        shard->head = 0;
+        shard->tail = 0;
+        shard->size = shardSize;
+        shard->active = 0;
+        shard->prioHead = 0;
+        shard->prioTail = 0;
+        shard->prioSize = prioSize;
+        shard->prioActive = 0;
+        pool->totalQueueSize += shardSize + prioSize;
+    }
     strcpy(pool->dbname, dbname);
 }
 
@@ -86,8 +254,8 @@ void BgwPoolStart(int nWorkers, BgwPoolConstructor constructor)
 	worker.bgw_start_time = BgWorkerStart_ConsistentState;
 	worker.bgw_main = BgwPoolMainLoop;
 	worker.bgw_restart_time = 10; /* Wait 10 seconds for restart before crash */
-    
-    for (i = 0; i < nWorkers; i++) { 
+
+    for (i = 0; i < nWorkers; i++) {
         BgwPoolExecutorCtx* ctx = (BgwPoolExecutorCtx*)malloc(sizeof(BgwPoolExecutorCtx));
         snprintf(worker.bgw_name, BGW_MAXLEN, "bgw_pool_worker_%d", i+1);
         ctx->id = i;
@@ -97,38 +265,212 @@ void BgwPoolStart(int nWorkers, BgwPoolConstructor constructor)
     }
 }
 
-void BgwPoolExecute(BgwPool* pool, void* work, size_t size)
+/*
+ * Change the number of pool workers which receive new work items. All
+ * registered workers keep running: a deactivated worker first drains the
+ * items already queued on its shard and then just sleeps on its semaphore,
+ * keeping its caches warm, so growing the pool again is instantaneous and
+ * never spawns a process. Note that resizing changes the affinity-to-worker
+ * mapping, so items sharing an affinity but enqueued on opposite sides of a
+ * resize may execute concurrently, as if their worker had been restarted.
+ * Returns the resulting active worker count.
+ */
+int BgwPoolResize(BgwPool* pool, int nWorkers)
+{
+    if (nWorkers < 1) {
+        nWorkers = 1;
+    }
+    if (nWorkers > pool->nShards) {
+        nWorkers = pool->nShards;
+    }
+    pool->nActiveShards = nWorkers;
+    elog(LOG, "Background worker pool resized to %d active workers of %d",
+         nWorkers, pool->nShards);
+    return nWorkers;
+}
+
+/* Returns true if the work item was enqueued, false if the shard is full. */
+static bool BgwShardExecute(BgwPoolShard* shard, int origin, void* work, size_t size)
 {
-    Assert(size+4 <= pool->size);
- 
-    SpinLockAcquire(&pool->lock);
-    while (true) { 
-        if ((pool->head <= pool->tail && pool->size - pool->tail < size + 4 && pool->head < size) 
-            || (pool->head > pool->tail && pool->head - pool->tail < size + 4))
+    SpinLockAcquire(&shard->lock);
+    if (!BgwRingHasRoom(shard->head, shard->tail, shard->size, size))
+    {
+        SpinLockRelease(&shard->lock);
+        return false;
+    }
+    shard->active += 1;
+    n_snapshots += 1;
+    n_active += shard->active;
+    *(int*)&shard->queue[shard->tail] = size;
+    *(int*)&shard->queue[shard->tail+4] = origin;
+    if (shard->size - shard->tail >= size + RING_ENTRY_HEADER) {
+        memcpy(&shard->queue[shard->tail+RING_ENTRY_HEADER], work, size);
+        shard->tail += RING_ENTRY_HEADER + INTALIGN(size);
+    } else {
+        memcpy(shard->queue, work, size);
+        shard->tail = INTALIGN(size);
+    }
+    if (shard->tail == shard->size) {
+        shard->tail = 0;
+    }
+    PGSemaphoreUnlock(&shard->available);
+    SpinLockRelease(&shard->lock);
+    return true;
+}
+
+/*
+ * Try to enqueue the work item into the shard's priority lane. Unlike the
+ * normal ring this never blocks: if the lane is full the caller just falls
+ * back to the normal path, so the lane degrades to the old behavior under
+ * saturation instead of stalling small transactions behind each other.
+ */
+static bool BgwShardExecutePriority(BgwPoolShard* shard, int origin, void* work, size_t size)
+{
+    SpinLockAcquire(&shard->lock);
+    if (!BgwRingHasRoom(shard->prioHead, shard->prioTail, shard->prioSize, size))
+    {
+        SpinLockRelease(&shard->lock);
+        return false;
+    }
+    shard->prioActive += 1;
+    *(int*)&shard->prioQueue[shard->prioTail] = size;
+    *(int*)&shard->prioQueue[shard->prioTail+4] = origin;
+    if (shard->prioSize - shard->prioTail >= size + RING_ENTRY_HEADER) {
+        memcpy(&shard->prioQueue[shard->prioTail+RING_ENTRY_HEADER], work, size);
+        shard->prioTail += RING_ENTRY_HEADER + INTALIGN(size);
+    } else {
+        memcpy(shard->prioQueue, work, size);
+        shard->prioTail = INTALIGN(size);
+    }
+    if (shard->prioTail == shard->prioSize) {
+        shard->prioTail = 0;
+    }
+    PGSemaphoreUnlock(&shard->available);
+    SpinLockRelease(&shard->lock);
+    return true;
+}
+
+/*
+ * Enqueue the work item into the shard selected by the affinity key, blocking
+ * if it is full. All work items with the same affinity go through the same
+ * worker and so are executed in FIFO order relative to each other, while
+ * items with different affinities can be executed concurrently. Affinity
+ * items never use the priority lane: jumping the queue within an affinity
+ * stream would reorder potentially conflicting transactions.
+ */
+void BgwPoolExecuteAffinity(BgwPool* pool, int origin, uint32 affinity, void* work, size_t size)
+{
+    BgwPoolShard* shard = &pool->shards[affinity % pool->nActiveShards];
+
+    Assert(size+RING_ENTRY_HEADER <= shard->size);
+
+    BgwPoolOriginAdmit(pool, origin, size);
+
+    while (!BgwShardExecute(shard, origin, work, size)) {
+        SpinLockAcquire(&shard->lock);
+        if (!BgwRingHasRoom(shard->head, shard->tail, shard->size, size))
         {
-            pool->producerBlocked = true;
-            SpinLockRelease(&pool->lock);
-            PGSemaphoreLock(&pool->overflow);
-            SpinLockAcquire(&pool->lock);
+            shard->producerBlocked = true;
+            SpinLockRelease(&shard->lock);
+            PGSemaphoreLock(&shard->overflow);
         } else {
-            pool->active += 1;
-            n_snapshots += 1;
-            n_active += pool->active;
-            *(int*)&pool->queue[pool->tail] = size;
-            if (pool->size - pool->tail >= size + 4) { 
-                memcpy(&pool->queue[pool->tail+4], work, size);
-                pool->tail += 4 + INTALIGN(size);
-            } else { 
-                memcpy(pool->queue, work, size);
-                pool->tail = INTALIGN(size);
+            SpinLockRelease(&shard->lock);
+        }
+    }
+}
+
+/*
+ * Check whether more work items are queued for the worker 'id', without
+ * dequeueing anything. Used by the executor to decide if it can keep the
+ * current group transaction open: more work may still arrive after this
+ * returns false, but then it will just start a new group.
+ */
+bool BgwPoolHaveMoreWork(BgwPool* pool, int id)
+{
+    BgwPoolShard* shard = &pool->shards[id % pool->nShards];
+    bool more;
+
+    SpinLockAcquire(&shard->lock);
+    more = shard->active > 0 || shard->prioActive > 0;
+    SpinLockRelease(&shard->lock);
+    return more;
+}
+
+void BgwPoolGetStatus(BgwPool* pool, BgwPoolStatus* status)
+{
+    int i;
+
+    status->nPendingWorkItems = 0;
+    status->usedBytes = 0;
+    status->totalBytes = 0;
+    for (i = 0; i < pool->nShards; i++) {
+        BgwPoolShard* shard = &pool->shards[i];
+        SpinLockAcquire(&shard->lock);
+        status->nPendingWorkItems += shard->active + shard->prioActive;
+        status->usedBytes += shard->tail >= shard->head
+            ? shard->tail - shard->head
+            : shard->size - shard->head + shard->tail;
+        status->usedBytes += shard->prioTail >= shard->prioHead
+            ? shard->prioTail - shard->prioHead
+            : shard->prioSize - shard->prioHead + shard->prioTail;
+        status->totalBytes += shard->size + shard->prioSize;
+        SpinLockRelease(&shard->lock);
+    }
+}
+
+void BgwPoolExecute(BgwPool* pool, int origin, bool priority, void* work, size_t size)
+{
+    /*
+     * Each producer round-robins between the active shards starting at its
+     * own offset, so concurrent producers mostly touch different locks. The
+     * counter runs free and is taken modulo the active shard count at use,
+     * which keeps it valid across pool resizes.
+     */
+    static uint32 rrobin = 0;
+    static bool rrobinSeeded = false;
+    int nActive;
+    int i;
+
+    Assert(size+RING_ENTRY_HEADER <= pool->shards[0].size);
+
+    if (!rrobinSeeded) {
+        rrobin = (uint32)MyProcPid;
+        rrobinSeeded = true;
+    }
+
+    BgwPoolOriginAdmit(pool, origin, size);
+
+    if (priority && size + RING_ENTRY_HEADER <= pool->shards[0].prioSize) {
+        nActive = pool->nActiveShards;
+        for (i = 0; i < nActive; i++) {
+            BgwPoolShard* shard = &pool->shards[rrobin++ % nActive];
+            if (BgwShardExecutePriority(shard, origin, work, size)) {
+                return;
+            }
+        }
+        /* every lane is full: go through the normal rings below */
+    }
+
+    while (true) {
+        nActive = pool->nActiveShards;
+        for (i = 0; i < nActive; i++) {
+            BgwPoolShard* shard = &pool->shards[rrobin++ % nActive];
+            if (BgwShardExecute(shard, origin, work, size)) {
+                return;
             }
-            if (pool->tail == pool->size) {
-                pool->tail = 0;
+        }
+        /* All shards are full: wait for a worker to drain the next one */
+        {
+            BgwPoolShard* shard = &pool->shards[rrobin % nActive];
+            SpinLockAcquire(&shard->lock);
+            if (!BgwRingHasRoom(shard->head, shard->tail, shard->size, size))
+            {
+                shard->producerBlocked = true;
+                SpinLockRelease(&shard->lock);
+                PGSemaphoreLock(&shard->overflow);
+            } else {
+                SpinLockRelease(&shard->lock);
             }
-            PGSemaphoreUnlock(&pool->available);
-            break;
         }
     }
-    SpinLockRelease(&pool->lock);            
 }
-
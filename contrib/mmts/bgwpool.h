@@ -8,10 +8,24 @@
 typedef void(*BgwPoolExecutor)(int id, void* work, size_t size);
 
 #define MAX_DBNAME_LEN 30
+#define BGWPOOL_MAX_WORKERS 64
+#define BGWPOOL_MAX_ORIGINS 64         /* matches MTM_MAX_NODES; origin 0 is unattributed */
+#define BGWPOOL_DEFAULT_ORIGIN_WEIGHT 4
+#define BGWPOOL_SMALL_ITEM_SIZE 1024   /* items up to this size may use the priority lane */
 
+/*
+ * The pool queue is sharded: each worker owns a ring buffer protected by its
+ * own spinlock, and producers distribute work items round-robin between the
+ * shards, skipping the full ones. So concurrent producers (one receiver per
+ * peer node) do not serialize on a single lock.
+ *
+ * Besides the normal ring each shard has a small priority lane, drained
+ * first by the worker, which small transactions may use to overtake bulky
+ * ones queued ahead of them. The single 'available' semaphore counts the
+ * items in both rings.
+ */
 typedef struct
 {
-    BgwPoolExecutor executor;
     volatile slock_t lock;
     PGSemaphoreData available;
     PGSemaphoreData overflow;
@@ -19,17 +33,61 @@ typedef struct
     size_t tail;
     size_t size;
     size_t active;
+    size_t prioHead;
+    size_t prioTail;
+    size_t prioSize;
+    size_t prioActive;
     bool   producerBlocked;
-    char   dbname[MAX_DBNAME_LEN];
     char*  queue;
+    char*  prioQueue;
+} BgwPoolShard;
+
+typedef struct
+{
+    BgwPoolExecutor executor;
+    int    nShards;
+    volatile int nActiveShards; /* shards receiving new work; the remaining
+                                 * workers stay resident but idle */
+    /*
+     * Weighted fair admission between origin nodes: each origin's queued
+     * bytes are tracked, and a producer whose origin is over its weighted
+     * share of the queue space while other origins have work pending waits
+     * before enqueueing. Weights default to BGWPOOL_DEFAULT_ORIGIN_WEIGHT;
+     * catch-up streams lower theirs so backlog replay cannot crowd out
+     * timely transactions.
+     */
+    volatile slock_t originLock;
+    size_t originUsed[BGWPOOL_MAX_ORIGINS + 1];
+    int    originWeight[BGWPOOL_MAX_ORIGINS + 1];
+    size_t totalQueueSize;
+    char   dbname[MAX_DBNAME_LEN];
+    BgwPoolShard shards[BGWPOOL_MAX_WORKERS];
 } BgwPool;
 
+/* Snapshot of the pool queue state, for monitoring */
+typedef struct
+{
+    int    nPendingWorkItems;  /* work items enqueued but not yet picked up */
+    size_t usedBytes;          /* bytes occupied in the ring buffers */
+    size_t totalBytes;         /* total ring buffer capacity */
+} BgwPoolStatus;
+
 typedef BgwPool*(*BgwPoolConstructor)(void);
 
 extern void BgwPoolStart(int nWorkers, BgwPoolConstructor constructor);
 
-extern void BgwPoolInit(BgwPool* pool, BgwPoolExecutor executor, char const* dbname, size_t queueSize);
+extern void BgwPoolInit(BgwPool* pool, BgwPoolExecutor executor, char const* dbname, size_t queueSize, int nWorkers);
+
+extern int BgwPoolResize(BgwPool* pool, int nWorkers);
+
+extern void BgwPoolExecute(BgwPool* pool, int origin, bool priority, void* work, size_t size);
+
+extern void BgwPoolExecuteAffinity(BgwPool* pool, int origin, uint32 affinity, void* work, size_t size);
+
+extern void BgwPoolSetOriginWeight(BgwPool* pool, int origin, int weight);
+
+extern void BgwPoolGetStatus(BgwPool* pool, BgwPoolStatus* status);
 
-extern void BgwPoolExecute(BgwPool* pool, void* work, size_t size);
+extern bool BgwPoolHaveMoreWork(BgwPool* pool, int id);
 
 #endif
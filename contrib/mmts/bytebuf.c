@@ -1,20 +1,69 @@
 #include "postgres.h"
+#include "miscadmin.h"
+#include "storage/fd.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
 #include "bytebuf.h"
 
 #define INIT_BUF_SIZE 1024
 
+#define SPILL_DIR "base/" PG_TEMP_FILES_DIR
+
+int ByteBufferSpillThreshold;
+
 void ByteBufferAlloc(ByteBuffer* buf)
 {
     buf->size = INIT_BUF_SIZE;
     buf->data = palloc(buf->size);
     buf->used = 0;
+    buf->fd = -1;
+    buf->spilled = 0;
+}
+
+/*
+ * Write a chunk to the spill file, creating the file on first use. Once a
+ * buffer starts spilling its memory part stops growing, so receiver memory
+ * stays bounded by the spill threshold however large the buffered
+ * transaction gets.
+ */
+static void ByteBufferSpillWrite(ByteBuffer* buf, void* data, int len)
+{
+    if (buf->fd < 0) {
+        static int spillSeqno;
+        mkdir(SPILL_DIR, S_IRWXU); /* ignore failure: the directory may exist */
+        snprintf(buf->path, sizeof buf->path, SPILL_DIR "/mtm_spill.%d.%d",
+                 MyProcPid, spillSeqno++);
+        buf->fd = open(buf->path, O_RDWR|O_CREAT|O_TRUNC|PG_BINARY, S_IRUSR|S_IWUSR);
+        if (buf->fd < 0) {
+            elog(ERROR, "failed to create spill file \"%s\": %m", buf->path);
+        }
+    }
+    if (write(buf->fd, data, len) != len) {
+        elog(ERROR, "failed to write spill file \"%s\": %m", buf->path);
+    }
+    buf->spilled += len;
 }
 
 void ByteBufferAppend(ByteBuffer* buf, void* data, int len)
 {
-    if (buf->used + len > buf->size) { 
-        buf->size = buf->used + len > buf->size*2 ? buf->used + len : buf->size*2;
-        buf->data = (char*)repalloc(buf->data, buf->size);
+    if (buf->used + len > buf->size) {
+        if (ByteBufferSpillThreshold != 0
+            && (buf->fd >= 0 || buf->used + len > ByteBufferSpillThreshold))
+        {
+            ByteBufferSpillWrite(buf, buf->data, buf->used);
+            buf->used = 0;
+            if (len > buf->size) {
+                /* too large even for the emptied buffer: spill it directly */
+                ByteBufferSpillWrite(buf, data, len);
+                return;
+            }
+        } else {
+            buf->size = buf->used + len > buf->size*2 ? buf->used + len : buf->size*2;
+            buf->data = (char*)repalloc(buf->data, buf->size);
+        }
     }
     memcpy(&buf->data[buf->used], data, len);
     buf->used += len;
@@ -25,12 +74,48 @@ void ByteBufferAppendInt32(ByteBuffer* buf, int data)
     ByteBufferAppend(buf, &data, sizeof data);
 }
 
+bool ByteBufferIsSpilled(ByteBuffer* buf)
+{
+    return buf->fd >= 0;
+}
+
+/*
+ * Flush the tail of a spilled buffer and close the file, handing its
+ * ownership over: ByteBufferReset will not remove the file any more, the
+ * consumer of the returned path is expected to delete it. The path stays
+ * valid until the buffer spills again.
+ */
+char const* ByteBufferSpillFinish(ByteBuffer* buf)
+{
+    Assert(buf->fd >= 0);
+    if (buf->used != 0) {
+        ByteBufferSpillWrite(buf, buf->data, buf->used);
+        buf->used = 0;
+    }
+    close(buf->fd);
+    buf->fd = -1;
+    buf->spilled = 0;
+    return buf->path;
+}
+
+static void ByteBufferDiscardSpill(ByteBuffer* buf)
+{
+    if (buf->fd >= 0) {
+        close(buf->fd);
+        unlink(buf->path);
+        buf->fd = -1;
+        buf->spilled = 0;
+    }
+}
+
 void ByteBufferFree(ByteBuffer* buf)
 {
+    ByteBufferDiscardSpill(buf);
     pfree(buf->data);
 }
 
 void ByteBufferReset(ByteBuffer* buf)
 {
+    ByteBufferDiscardSpill(buf);
     buf->used = 0;
 }
@@ -6,12 +6,24 @@ typedef struct
     char* data;
     int size;
     int used;
+    int fd;          /* spill file descriptor, or -1 if not spilled */
+    uint64 spilled;  /* number of bytes already written to the spill file */
+    char path[MAXPGPATH]; /* spill file path */
 } ByteBuffer;
 
+/*
+ * When non-zero, a buffer growing past this number of bytes is spilled to a
+ * temporary file instead of ballooning in memory. Set from the
+ * multimaster.spill_threshold GUC.
+ */
+extern int ByteBufferSpillThreshold;
+
 extern void ByteBufferAlloc(ByteBuffer* buf);
 extern void ByteBufferAppend(ByteBuffer* buf, void* data, int len);
 extern void ByteBufferAppendInt32(ByteBuffer* buf, int data);
 extern void ByteBufferFree(ByteBuffer* buf);
 extern void ByteBufferReset(ByteBuffer* buf);
+extern bool ByteBufferIsSpilled(ByteBuffer* buf);
+extern char const* ByteBufferSpillFinish(ByteBuffer* buf);
 
 #endif
@@ -17,4 +17,98 @@ CREATE FUNCTION mtm.get_snapshot() RETURNS bigint
 AS 'MODULE_PATHNAME','mtm_get_snapshot'
 LANGUAGE C;
 
+-- CSN of the last transaction committed by this backend, or NULL if none.
+-- Pass it to mtm.wait_for_csn() on another node to get read-your-writes
+-- consistency when switching nodes between transactions.
+CREATE FUNCTION mtm.get_last_csn() RETURNS bigint
+AS 'MODULE_PATHNAME','mtm_get_last_csn'
+LANGUAGE C;
+
+CREATE FUNCTION mtm.wait_for_csn(csn bigint, origin integer, timeout_ms integer default -1) RETURNS bool
+AS 'MODULE_PATHNAME','mtm_wait_for_csn'
+LANGUAGE C;
+
+-- Change the number of pool workers applying replicated transactions on this
+-- node. Deactivated workers stay resident with warm caches, so growing the
+-- pool back is immediate. Returns the resulting active worker count (clamped
+-- to multimaster.workers).
+-- Exclude the table from replication: its changes are dropped by the sending
+-- node while reading WAL, before entering the reorder buffer. The declaration
+-- lives in shared memory keyed by the table's current relfilenode, so repeat
+-- it on every node, after a server restart and after operations that rewrite
+-- the table (TRUNCATE, VACUUM FULL, CLUSTER, ALTER TABLE ... TYPE).
+CREATE FUNCTION mtm.make_table_local(rel regclass) RETURNS void
+AS 'MODULE_PATHNAME','mtm_make_table_local'
+LANGUAGE C;
+
+CREATE FUNCTION mtm.pool_resize(n integer) RETURNS integer
+AS 'MODULE_PATHNAME','mtm_pool_resize'
+LANGUAGE C;
+
+CREATE FUNCTION mtm.get_cluster_state(
+	OUT status text,
+	OUT disabled_node_mask bigint,
+	OUT connected_node_mask bigint,
+	OUT n_nodes integer,
+	OUT n_receivers integer,
+	OUT n_lockers integer,
+	OUT queue_used bigint,
+	OUT queue_size bigint,
+	OUT pending_work_items integer,
+	OUT vote_latency_p50 bigint,
+	OUT vote_latency_p90 bigint,
+	OUT vote_latency_p99 bigint,
+	OUT vote_latency_max bigint)
+RETURNS record
+AS 'MODULE_PATHNAME','mtm_get_cluster_state'
+LANGUAGE C;
+
+CREATE FUNCTION mtm.get_nodes_state(
+	OUT id integer,
+	OUT enabled bool,
+	OUT connected bool,
+	OUT received_lsn bigint,
+	OUT apply_lag_sec float8,
+	OUT last_message_age_sec float8)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME','mtm_get_nodes_state'
+LANGUAGE C;
+
+-- Cluster status, bgw pool queue depth and vote latency percentiles (usec,
+-- histogram bucket upper bounds) of this node.
+CREATE VIEW mtm.cluster_state AS SELECT * FROM mtm.get_cluster_state();
+
+-- Per-node status and receiver lag as seen from this node: apply_lag_sec is
+-- the delivery delay of the last replicated message (beware of clock skew
+-- between nodes), last_message_age_sec tells how long ago the node was heard
+-- from at all.
+CREATE VIEW mtm.nodes_state AS SELECT * FROM mtm.get_nodes_state();
+
+CREATE FUNCTION mtm.get_conflict_stats(
+	OUT relation regclass,
+	OUT insert_exists bigint,
+	OUT update_missing bigint,
+	OUT delete_missing bigint)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME','mtm_get_conflict_stats'
+LANGUAGE C;
+
+CREATE FUNCTION mtm.get_hot_keys(
+	OUT relation regclass,
+	OUT key text,
+	OUT estimated_count bigint)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME','mtm_get_hot_keys'
+LANGUAGE C;
+
+-- Conflicts seen by apply workers on this node since server start, per
+-- relation: remote INSERTs hitting an existing unique key, and remote
+-- UPDATEs/DELETEs whose target row is already gone.
+CREATE VIEW mtm.conflict_stats AS SELECT * FROM mtm.get_conflict_stats();
+
+-- Replica identity keys involved in the most conflicts on this node.
+-- Counts come from a count-min sketch, so they are upper-bound estimates;
+-- key text is truncated to 63 bytes.
+CREATE VIEW mtm.hot_keys AS SELECT * FROM mtm.get_hot_keys();
+
 CREATE TABLE IF NOT EXISTS mtm.ddl_log (issued timestamp with time zone not null, query text);
@@ -11,6 +11,7 @@
 
 #include "postgres.h"
 #include "fmgr.h"
+#include "funcapi.h"
 #include "miscadmin.h"
 #include "libpq-fe.h"
 #include "postmaster/postmaster.h"
@@ -32,6 +33,8 @@
 #include "storage/proc.h"
 #include "executor/executor.h"
 #include "access/twophase.h"
+#include "access/hash.h"
+#include "access/heapam.h"
 #include "utils/guc.h"
 #include "utils/hsearch.h"
 #include "utils/tqual.h"
@@ -44,6 +47,7 @@
 #include "storage/pmsignal.h"
 #include "storage/proc.h"
 #include "utils/syscache.h"
+#include "utils/timestamp.h"
 #include "replication/walsender.h"
 #include "replication/walsender_private.h"
 #include "replication/slot.h"
@@ -61,6 +65,8 @@ typedef struct {
 	bool  isReplicated;   /* transaction on replica */
 	bool  isDistributed;  /* transaction performed INSERT/UPDATE/DELETE and has to be replicated to other nodes */
 	bool  containsDML;    /* transaction contains DML statements */
+	bool  isApplyGroup;   /* local transaction grouping several applied remote transactions:
+						     each member votes for itself, so the group as a whole does not */
     csn_t snapshot;       /* transaction snaphsot   */
 } MtmCurrentTrans;
 
@@ -88,6 +94,14 @@ PG_FUNCTION_INFO_V1(mtm_start_replication);
 PG_FUNCTION_INFO_V1(mtm_stop_replication);
 PG_FUNCTION_INFO_V1(mtm_drop_node);
 PG_FUNCTION_INFO_V1(mtm_get_snapshot);
+PG_FUNCTION_INFO_V1(mtm_get_last_csn);
+PG_FUNCTION_INFO_V1(mtm_wait_for_csn);
+PG_FUNCTION_INFO_V1(mtm_pool_resize);
+PG_FUNCTION_INFO_V1(mtm_make_table_local);
+PG_FUNCTION_INFO_V1(mtm_get_cluster_state);
+PG_FUNCTION_INFO_V1(mtm_get_nodes_state);
+PG_FUNCTION_INFO_V1(mtm_get_conflict_stats);
+PG_FUNCTION_INFO_V1(mtm_get_hot_keys);
 
 static Snapshot MtmGetSnapshot(Snapshot snapshot);
 static void MtmSetTransactionStatus(TransactionId xid, int nsubxids, TransactionId *subxids, XidStatus status, XLogRecPtr lsn);
@@ -109,10 +123,12 @@ static BgwPool* MtmPoolConstructor(void);
 static bool MtmRunUtilityStmt(PGconn* conn, char const* sql);
 static void MtmBroadcastUtilityStmt(char const* sql, bool ignoreError);
 static void MtmVoteForTransaction(MtmTransState* ts);
+static void MtmRecordVoteLatency(timestamp_t latency);
 
 static HTAB* xid2state;
 static MtmCurrentTrans dtmTx;
 static MtmState* dtm;
+static csn_t MtmLastCommitCsn; /* CSN of last commit in this backend, for mtm.get_last_csn() */
 
 static TransactionManager MtmTM = { 
 	PgTransactionIdGetStatus, 
@@ -129,6 +145,10 @@ static TransactionManager MtmTM = {
 
 bool  MtmDoReplication;
 char* MtmDatabaseName;
+bool  MtmBinaryBasetypes;
+bool  MtmDeferredIndexes;
+bool  MtmSpeculativeCommit;
+bool  MtmUseWalCompression;
 
 char* MtmConnStrs;
 int   MtmNodeId;
@@ -137,12 +157,18 @@ int   MtmNodes;
 int   MtmConnectAttempts;
 int   MtmConnectTimeout;
 int   MtmReconnectAttempts;
+int   MtmReplicationStreams;
+int   MtmCatchupStreams;
+int   MtmCatchupLag;
+int   MtmApplyGroupSize;
 
 static int MtmQueueSize;
 static int MtmWorkers;
 static int MtmVacuumDelay;
+static int MtmMaxSnapshotAge;
 static int MtmMinRecoveryLag;
 static int MtmMaxRecoveryLag;
+static int MtmLocalReadStaleness;
 
 static ExecutorFinish_hook_type PreviousExecutorFinishHook;
 static ProcessUtility_hook_type PreviousProcessUtilityHook;
@@ -181,7 +207,7 @@ timestamp_t MtmGetCurrentTime(void)
 {
     struct timeval tv;
     gettimeofday(&tv, NULL);
-    return (timestamp_t)tv.tv_sec*USEC + tv.tv_usec + dtm->timeShift;
+    return (timestamp_t)tv.tv_sec*USEC + tv.tv_usec + pg_atomic_read_u64(&dtm->timeShift);
 }
 
 void MtmSleep(timestamp_t interval)
@@ -197,22 +223,34 @@ void MtmSleep(timestamp_t interval)
     }
 }
     
+/*
+ * Advance the hybrid logical clock with a lock-free max-merge: take the
+ * maximum of the current time and the last issued CSN plus one. The CAS loop
+ * lets concurrent backends assign CSNs without serializing on MtmLock; a
+ * failed CAS refreshes 'old' with the value published by the winner.
+ */
 csn_t MtmAssignCSN()
 {
     csn_t csn = MtmGetCurrentTime();
-    if (csn <= dtm->csn) { 
-        csn = ++dtm->csn;
-    } else { 
-        dtm->csn = csn;
+    uint64 old = pg_atomic_read_u64(&dtm->csn);
+    while (true) {
+        if (csn <= (csn_t)old) {
+            if (pg_atomic_compare_exchange_u64(&dtm->csn, &old, old + 1)) {
+                return (csn_t)(old + 1);
+            }
+        } else {
+            if (pg_atomic_compare_exchange_u64(&dtm->csn, &old, (uint64)csn)) {
+                return csn;
+            }
+        }
     }
-    return csn;
 }
 
 csn_t MtmSyncClock(csn_t global_csn)
 {
     csn_t local_csn;
-    while ((local_csn = MtmAssignCSN()) < global_csn) { 
-        dtm->timeShift += global_csn - local_csn;
+    while ((local_csn = MtmAssignCSN()) < global_csn) {
+        pg_atomic_fetch_add_u64(&dtm->timeShift, global_csn - local_csn);
     }
     return local_csn;
 }
@@ -310,6 +348,20 @@ bool MtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
         }
         else
         {
+			/*
+			 * The transaction is not known to us. If it could have been pruned
+			 * from xid2state past our snapshot because of
+			 * multimaster.max_snapshot_age, its CSN is lost and we can not
+			 * decide visibility correctly any more: give up on this snapshot
+			 * rather than return a possibly wrong answer. Local transactions
+			 * have snapshot == INVALID_CSN (maximal value) and never get here.
+			 */
+			if (dtmTx.snapshot < dtm->prunedCsn && TransactionIdPrecedes(xid, dtm->oldestXid))
+			{
+				csn_t prunedCsn = dtm->prunedCsn;
+				MtmUnlock();
+				elog(ERROR, "Snapshot too old: snapshot %ld precedes pruned horizon %ld", dtmTx.snapshot, prunedCsn);
+			}
             MTM_TUPLE_TRACE("%d: visibility check is skept for transaction %u in snapshot %lu\n", getpid(), xid, dtmTx.snapshot);
             break;
         }
@@ -381,29 +433,49 @@ void MtmAdjustSubtransactions(MtmTransState* ts)
  * This function takes XID which PostgreSQL consider to be the latest and try to find XID which
  * is older than it more than MtmVacuumDelay.
  * If no such XID can be located, then return previously observed oldest XID
+ *
+ * When multimaster.max_snapshot_age is set, the cutoff is additionally
+ * bounded by wall-clock age: entries older than that many seconds are pruned
+ * even if some long-running transaction still holds the oldest xmin back.
+ * The CSN up to which such pruning has advanced is remembered in
+ * dtm->prunedCsn, and a transaction whose snapshot predates it gets
+ * "snapshot too old" if it actually stumbles over a pruned entry
+ * (see MtmXidInMVCCSnapshot).
  */
-static TransactionId 
+static TransactionId
 MtmAdjustOldestXid(TransactionId xid)
 {
-    if (TransactionIdIsValid(xid)) { 
+    if (TransactionIdIsValid(xid)) {
         MtmTransState *ts, *prev = NULL;
-        
+        timestamp_t cutoff_time = 0;
+
 		MtmLock(LW_EXCLUSIVE);
         ts = (MtmTransState*)hash_search(xid2state, &xid, HASH_FIND, NULL);
-        if (ts != NULL) { 
-            timestamp_t cutoff_time = ts->csn - MtmVacuumDelay*USEC;
-			for (ts = dtm->transListHead; ts != NULL && ts->csn < cutoff_time; prev = ts, ts = ts->next) { 
+        if (ts != NULL) {
+            cutoff_time = ts->csn - MtmVacuumDelay*USEC;
+        }
+        if (MtmMaxSnapshotAge >= 0) {
+            timestamp_t stale_cutoff = MtmGetCurrentTime() - MtmMaxSnapshotAge*USEC;
+            if (cutoff_time < stale_cutoff) {
+                cutoff_time = stale_cutoff;
+            }
+        }
+        if (cutoff_time != 0) {
+			for (ts = dtm->transListHead; ts != NULL && ts->csn < cutoff_time; prev = ts, ts = ts->next) {
 				Assert(ts->status == TRANSACTION_STATUS_COMMITTED || ts->status == TRANSACTION_STATUS_ABORTED || ts->status == TRANSACTION_STATUS_IN_PROGRESS);
-				if (prev != NULL) { 
+				if (prev != NULL) {
 					/* Remove information about too old transactions */
 					hash_search(xid2state, &prev->xid, HASH_REMOVE, NULL);
 				}
 			}
         }
-        if (prev != NULL) { 
+        if (prev != NULL) {
             dtm->transListHead = prev;
-            dtm->oldestXid = xid = prev->xid;            
-        } else { 
+            dtm->oldestXid = xid = prev->xid;
+            if (prev->csn > dtm->prunedCsn) {
+                dtm->prunedCsn = prev->csn;
+            }
+        } else {
             xid = dtm->oldestXid;
         }
 		MtmUnlock();
@@ -414,6 +486,7 @@ MtmAdjustOldestXid(TransactionId xid)
 static void MtmInitialize()
 {
 	bool found;
+	int i;
 
 	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
 	dtm = (MtmState*)ShmemInitStruct(MULTIMASTER_NAME, sizeof(MtmState), &found);
@@ -422,8 +495,10 @@ static void MtmInitialize()
 		dtm->status = MTM_INITIALIZATION;
 		dtm->recoverySlot = 0;
 		dtm->locks = GetNamedLWLockTranche(MULTIMASTER_NAME);
-		dtm->csn = MtmGetCurrentTime();
+		pg_atomic_init_u64(&dtm->timeShift, 0);
+		pg_atomic_init_u64(&dtm->csn, MtmGetCurrentTime());
 		dtm->oldestXid = FirstNormalTransactionId;
+		dtm->prunedCsn = 0;
         dtm->nNodes = MtmNodes;
 		dtm->disabledNodeMask = 0;
 		dtm->pglogicalNodeMask = 0;
@@ -434,11 +509,23 @@ static void MtmInitialize()
         dtm->transListHead = NULL;
         dtm->transListTail = &dtm->transListHead;		
         dtm->nReceivers = 0;
-		dtm->timeShift = 0;
+		for (i = 0; i < MTM_MAX_NODES; i++) {
+			pg_atomic_init_u64(&dtm->appliedCsn[i], 0);
+			pg_atomic_init_u64(&dtm->catchupLsn[i], 0);
+			pg_atomic_init_u64(&dtm->receiverStats[i].receivedLsn, 0);
+			pg_atomic_init_u64(&dtm->receiverStats[i].lastRecvTime, 0);
+			pg_atomic_init_u64(&dtm->receiverStats[i].lastSendTime, 0);
+		}
+		memset(dtm->voteLatencyHist, 0, sizeof(dtm->voteLatencyHist));
+		dtm->voteLatencyMax = 0;
+		dtm->nLocalTables = 0;
+		dtm->nConflictRels = 0;
+		memset(dtm->conflictSketch, 0, sizeof(dtm->conflictSketch));
+		memset(dtm->hotKeys, 0, sizeof(dtm->hotKeys));
 		PGSemaphoreCreate(&dtm->votingSemaphore);
 		PGSemaphoreReset(&dtm->votingSemaphore);
 		SpinLockInit(&dtm->spinlock);
-        BgwPoolInit(&dtm->pool, MtmExecutor, MtmDatabaseName, MtmQueueSize);
+        BgwPoolInit(&dtm->pool, MtmExecutor, MtmDatabaseName, MtmQueueSize, MtmWorkers);
 		RegisterXactCallback(MtmXactCallback, NULL);
 		dtmTx.snapshot = INVALID_CSN;
 		dtmTx.xid = InvalidTransactionId;
@@ -471,15 +558,43 @@ MtmXactCallback(XactEvent event, void *arg)
 	}
 }
 
-static void 
+static void
 MtmBeginTransaction(MtmCurrentTrans* x)
 {
-    if (x->snapshot == INVALID_CSN) { 
+    if (x->snapshot == INVALID_CSN) {
+		/*
+		 * Local-read mode: serve read-only transactions with a snapshot that
+		 * is multimaster.local_read_staleness milliseconds in the past.  CSNs
+		 * are hybrid-clock timestamps, so such a snapshot can be derived from
+		 * the local clock without MtmLock.  Because every transaction that is
+		 * still in doubt has a CSN above the bound, the visibility check never
+		 * has to wait for voting to complete, i.e. lagging nodes serve such
+		 * reads without any arbiter traffic.  Commits that the receivers have
+		 * not applied yet are simply not visible, which is the staleness the
+		 * setting permits.  Note that this catches transactions that are
+		 * read-only at start (default_transaction_read_only), not a later SET
+		 * TRANSACTION READ ONLY.
+		 */
+		if (MtmLocalReadStaleness > 0 && XactReadOnly && IsNormalProcessingMode()
+			&& !am_walsender && !IsBackgroundWorker && !IsAutoVacuumWorkerProcess())
+		{
+			x->xid = GetCurrentTransactionIdIfAny();
+			x->isReplicated = false;
+			x->isDistributed = false;
+			x->containsDML = false;
+			x->isApplyGroup = false;
+			x->snapshot = MtmGetCurrentTime() - (csn_t)MtmLocalReadStaleness*1000;
+			x->gtid.xid = InvalidTransactionId;
+
+			MTM_TRACE("MtmLocalTransaction: read-only transaction %u uses stale local snapshot %lu\n", x->xid, x->snapshot);
+			return;
+		}
 		MtmLock(LW_EXCLUSIVE);
 		x->xid = GetCurrentTransactionIdIfAny();
         x->isReplicated = false;
         x->isDistributed = IsNormalProcessingMode() && dtm->status == MTM_ONLINE && MtmDoReplication && !am_walsender && !IsBackgroundWorker && !IsAutoVacuumWorkerProcess();
 		x->containsDML = false;
+		x->isApplyGroup = false;
         x->snapshot = MtmAssignCSN();	
 		x->gtid.xid = InvalidTransactionId;
 		MtmUnlock();
@@ -561,7 +676,8 @@ static void MtmPrepareTransaction(MtmCurrentTrans* x)
 	ts->gtid = x->gtid;
 	ts->cmd = MSG_INVALID;
 	ts->procno = MyProc->pgprocno;
-	ts->nVotes = 0; 
+	ts->nVotes = 0;
+	ts->nSubxids = 0;
 	ts->done = false;
 				  
 	if (TransactionIdIsValid(x->gtid.xid)) { 
@@ -618,6 +734,7 @@ MtmEndTransaction(MtmCurrentTrans* x, bool commit)
 	x->snapshot = INVALID_CSN;
 	x->xid = InvalidTransactionId;
 	x->gtid.xid = InvalidTransactionId;
+	x->isApplyGroup = false;
 	MtmCheckSlots();
 }
 
@@ -670,13 +787,17 @@ MtmCommitTransaction(TransactionId xid, int nsubxids, TransactionId *subxids)
 	MTM_TRACE("%d: MtmCommitTransaction begin commit of %d CSN=%ld\n", getpid(), xid, ts->csn);
 	MtmAddSubtransactions(ts, subxids, nsubxids);
 
-	MtmVoteForTransaction(ts); 
+	MtmVoteForTransaction(ts);
 
 	MtmUnlock();
 
 	MTM_TRACE("%d: MtmCommitTransaction %d status=%d\n", getpid(), xid, ts->status);
 
-	return ts->status != TRANSACTION_STATUS_ABORTED;
+	if (ts->status != TRANSACTION_STATUS_ABORTED) {
+		MtmLastCommitCsn = ts->csn;
+		return true;
+	}
+	return false;
 }
 	
 static void 
@@ -719,7 +840,26 @@ MtmSetTransactionStatus(TransactionId xid, int nsubxids, TransactionId *subxids,
 	MTM_TRACE("%d: MtmSetTransactionStatus %u(%u) = %u, isDistributed=%d\n", getpid(), xid, dtmTx.xid, status, dtmTx.isDistributed);
 	if (xid == dtmTx.xid && dtmTx.isDistributed)
 	{
-		if (status == TRANSACTION_STATUS_ABORTED || !dtmTx.containsDML || dtm->status == MTM_RECOVERY)
+		if (dtmTx.isApplyGroup)
+		{
+			/*
+			 * Group of applied remote transactions: every member has already
+			 * voted for itself and has its own MtmTransState with the CSN
+			 * assigned during voting, so do not vote for the enclosing local
+			 * transaction, just propagate the final status to the members.
+			 */
+			int i;
+			MtmLock(LW_EXCLUSIVE);
+			for (i = 0; i < nsubxids; i++)
+			{
+				MtmTransState* sts = (MtmTransState*)hash_search(xid2state, &subxids[i], HASH_FIND, NULL);
+				if (sts != NULL) {
+					sts->status = status;
+				}
+			}
+			MtmUnlock();
+		}
+		else if (status == TRANSACTION_STATUS_ABORTED || !dtmTx.containsDML || dtm->status == MTM_RECOVERY)
 		{
 			MtmFinishTransaction(xid, nsubxids, subxids, status);	
 			MTM_TRACE("Finish transaction %d, status=%d, DML=%d\n", xid, status, dtmTx.containsDML);
@@ -774,6 +914,71 @@ _PG_init(void)
 	if (!process_shared_preload_libraries_in_progress)
 		return;
 
+	DefineCustomBoolVariable(
+		"multimaster.binary_basetypes",
+		"Use binary datum representation on the replication wire",
+		"When enabled, receivers negotiate internal binary format for builtin base types "
+		"with the sender, avoiding output/input function calls on every replicated row. "
+		"The sender falls back to text transfer for a column when the nodes are not binary compatible",
+		&MtmBinaryBasetypes,
+		true,
+		PGC_BACKEND,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomBoolVariable(
+		"multimaster.deferred_indexes",
+		"Defer non-unique index maintenance during apply until transaction commit",
+		"When enabled, apply workers buffer entries for non-unique btree indexes and insert "
+		"them sorted per index at commit, so bulk changes update each index in key order "
+		"instead of randomly per row. Unique and exclusion-constraint indexes are always "
+		"maintained immediately to keep conflict detection synchronous",
+		&MtmDeferredIndexes,
+		false,
+		PGC_BACKEND,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomBoolVariable(
+		"multimaster.compression",
+		"Compress the replication streams between nodes",
+		"When enabled, receivers set wal_sender_compression on their replication "
+		"connections, making the remote walsender pglz-compress the payload of each "
+		"stream data message. Useful on bandwidth-limited inter-node links; WAL "
+		"typically compresses several times",
+		&MtmUseWalCompression,
+		false,
+		PGC_BACKEND,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomBoolVariable(
+		"multimaster.speculative_commit",
+		"Return commit to the client as soon as the global outcome is decided",
+		"The outcome of a distributed transaction is fixed at the coordinator once all nodes "
+		"voted PREPARED: no abort path remains and the final commit CSN is assigned. "
+		"With this option the backend is released at that point instead of waiting for the "
+		"last acknowledgement round from all replicas. Transactions on nodes which have not "
+		"yet applied the commit stay in-doubt and concurrent snapshots wait for them, so "
+		"visibility is still fenced by CSN",
+		&MtmSpeculativeCommit,
+		false,
+		PGC_BACKEND,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
 	DefineCustomIntVariable(
 		"multimaster.min_recovery_lag",
 		"Minamal lag of WAL-sender performing recovery after which cluster is locked until recovery is completed",
@@ -806,6 +1011,40 @@ _PG_init(void)
 		NULL
 	);
 
+	DefineCustomIntVariable(
+		"multimaster.local_read_staleness",
+		"Maximal staleness (milliseconds) of local snapshots used for read-only transactions, 0 to disable",
+		"When non-zero, transactions which are read-only at start are served from a local snapshot "
+		"this many milliseconds in the past instead of acquiring a global one, so they never wait for "
+		"in-doubt distributed transactions and produce no arbiter traffic",
+		&MtmLocalReadStaleness,
+		0,
+		0,
+		INT_MAX,
+		PGC_USERSET,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomIntVariable(
+		"multimaster.apply_group_size",
+		"Maximal number of small replicated transactions from one origin node which are applied in one local commit cycle",
+		"Each member of the group is applied in its own subtransaction and votes for itself, but the group shares "
+		"one local WAL flush and one vote round trip, which speeds up apply of streams of small transactions. "
+		"Value 1 disables grouping",
+		&MtmApplyGroupSize,
+		16,
+		1,
+		1000,
+		PGC_BACKEND,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
 	DefineCustomIntVariable(
 		"multimaster.vacuum_delay",
 		"Minimal age of records which can be vacuumed (seconds)",
@@ -821,6 +1060,24 @@ _PG_init(void)
 		NULL
 	);
 
+	DefineCustomIntVariable(
+		"multimaster.max_snapshot_age",
+		"Maximal age (seconds) of transaction state kept for old snapshots, -1 to disable",
+		"When set, finished transaction records older than this are pruned even if some long-running "
+		"transaction still holds the oldest xmin back. A transaction whose snapshot is older than the "
+		"pruned horizon gets a \"snapshot too old\" error if it visits a tuple of a pruned transaction; "
+		"everything else proceeds unaffected",
+		&MtmMaxSnapshotAge,
+		-1,
+		-1,
+		INT_MAX,
+		PGC_BACKEND,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
 	DefineCustomIntVariable(
 		"multimaster.workers",
 		"Number of multimaster executor workers per node",
@@ -851,6 +1108,69 @@ _PG_init(void)
 		NULL
 	);
 
+	DefineCustomIntVariable(
+		"multimaster.replication_streams",
+		"Number of parallel replication streams per node pair",
+		"Each remote node is served by this many receiver/walsender pairs, with transactions hash-partitioned by xid between the streams",
+		&MtmReplicationStreams,
+		1,
+		1,
+		64,
+		PGC_BACKEND,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomIntVariable(
+		"multimaster.catchup_streams",
+		"Number of temporary extra replication streams used to catch up after an outage",
+		"When a receiver reconnects and finds itself more than multimaster.catchup_lag bytes behind the remote node, "
+		"the accumulated backlog is hash-partitioned by xid between the regular stream and this many extra streams; "
+		"once the backlog is drained the extra streams go silent and replication returns to a single stream. "
+		"Zero disables catch-up acceleration. Only effective with multimaster.replication_streams = 1",
+		&MtmCatchupStreams,
+		0,
+		0,
+		63,
+		PGC_BACKEND,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomIntVariable(
+		"multimaster.catchup_lag",
+		"Replication lag (bytes) above which the extra catch-up streams are engaged",
+		NULL,
+		&MtmCatchupLag,
+		16*1024*1024,
+		1,
+		INT_MAX,
+		PGC_BACKEND,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomIntVariable(
+		"multimaster.spill_threshold",
+		"Receive buffer size above which a transaction is spilled to disk",
+		"Zero disables spilling and restores the old grow-in-memory behaviour",
+		&ByteBufferSpillThreshold,
+		64*1024*1024,
+		0,
+		INT_MAX,
+		PGC_BACKEND,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
 	DefineCustomIntVariable(
 		"multimaster.arbiter_port",
 		"Base value for assigning arbiter ports",
@@ -1014,12 +1334,128 @@ void MtmJoinTransaction(GlobalTransactionId* gtid, csn_t globalSnapshot)
 	}
 	dtmTx.gtid = *gtid;
 	dtmTx.xid = GetCurrentTransactionId();
-	dtmTx.snapshot = globalSnapshot;	
+	dtmTx.snapshot = globalSnapshot;
 	dtmTx.isReplicated = true;
 	dtmTx.isDistributed = true;
 	dtmTx.containsDML = true;
 }
- 
+
+/*
+ * Apply-side group commit: several small remote transactions from the same
+ * origin node are applied in one local transaction, each in its own
+ * subtransaction to preserve per-transaction atomicity, and share one local
+ * commit cycle (one WAL flush) and one vote round trip with the coordinator.
+ *
+ * Start the enclosing local transaction for a group and join the first
+ * member. Returns false if grouping is not possible (recovery stream):
+ * the caller has to apply the transaction the usual non-grouped way then.
+ */
+bool MtmGroupApplyBegin(GlobalTransactionId* gtid, csn_t globalSnapshot)
+{
+	MtmJoinTransaction(gtid, globalSnapshot);
+	if (!TransactionIdIsValid(gtid->xid) || dtm->status == MTM_RECOVERY) {
+		/* recovery transactions do not vote, so there is nothing to group */
+		return false;
+	}
+	dtmTx.isApplyGroup = true;
+	return true;
+}
+
+/*
+ * Join a subsequent member of an apply group: synchronize the local clock
+ * with the member's snapshot, which becomes the visibility snapshot for
+ * applying its changes.
+ */
+void MtmGroupApplyJoin(GlobalTransactionId* gtid, csn_t globalSnapshot)
+{
+	csn_t localSnapshot;
+
+	Assert(dtmTx.isApplyGroup);
+
+	MtmLock(LW_EXCLUSIVE);
+	localSnapshot = MtmSyncClock(globalSnapshot);
+	MtmUnlock();
+
+	if (globalSnapshot < localSnapshot - MtmVacuumDelay * USEC)
+	{
+		elog(ERROR, "Too old snapshot: requested %ld, current %ld", globalSnapshot, localSnapshot);
+	}
+	dtmTx.gtid = *gtid;
+	dtmTx.snapshot = globalSnapshot;
+}
+
+/*
+ * Send READY to the coordinator of every member of the group. The members
+ * are keyed by their subtransaction XIDs, so each one runs the usual voting
+ * protocol with its own coordinator; notifications for the whole group are
+ * queued under one lock acquisition and picked up by mtm-sender in one batch.
+ */
+void MtmGroupApplyVote(int nMembers, TransactionId* xids, GlobalTransactionId* gtids)
+{
+	int i, j;
+
+	MtmLock(LW_EXCLUSIVE);
+	for (i = 0; i < nMembers; i++)
+	{
+		MtmTransState* ts = hash_search(xid2state, &xids[i], HASH_ENTER, NULL);
+		ts->status = TRANSACTION_STATUS_IN_PROGRESS;
+		ts->snapshot = INVALID_CSN;
+		ts->csn = MtmAssignCSN();
+		ts->gtid = gtids[i];
+		ts->procno = MyProc->pgprocno;
+		ts->nVotes = 0;
+		ts->nSubxids = 0;
+		ts->done = false;
+		for (j = 0; j < MtmNodes; j++) {
+			ts->xids[j] = InvalidTransactionId;
+		}
+		MtmTransactionListAppend(ts);
+		ts->cmd = MSG_READY;
+		MtmSendNotificationMessage(ts);
+	}
+	MtmUnlock();
+}
+
+/*
+ * Wait until the voting of all members of the group is completed.
+ * Returns true if all members have been committed, false if at least one
+ * of them has been aborted (the caller has to abort the whole group then).
+ */
+bool MtmGroupApplyWait(int nMembers, TransactionId* xids)
+{
+	timestamp_t voteStart = MtmGetCurrentTime();
+	bool allCommitted = true;
+	int i;
+
+	MtmLock(LW_SHARED);
+	for (i = 0; i < nMembers; i++)
+	{
+		MtmTransState* ts = hash_search(xid2state, &xids[i], HASH_FIND, NULL);
+		Assert(ts != NULL);
+		while (!ts->done) {
+			MtmUnlock();
+			WaitLatch(&MyProc->procLatch, WL_LATCH_SET, -1);
+			ResetLatch(&MyProc->procLatch);
+			MtmLock(LW_SHARED);
+		}
+		if (ts->status == TRANSACTION_STATUS_ABORTED) {
+			allCommitted = false;
+		}
+	}
+	MtmUnlock();
+	MtmRecordVoteLatency(MtmGetCurrentTime() - voteStart);
+	return allCommitted;
+}
+
+/*
+ * Check whether more work is queued for the given apply worker: used to
+ * decide if the current apply group may be kept open for the next work item.
+ */
+bool MtmMoreApplyWorkPending(int workerId)
+{
+	return BgwPoolHaveMoreWork(&dtm->pool, workerId);
+}
+
 void MtmReceiverStarted(int nodeId)
 {
 	SpinLockAcquire(&dtm->spinlock);	
@@ -1033,6 +1469,14 @@ void MtmReceiverStarted(int nodeId)
 	SpinLockRelease(&dtm->spinlock);	
 }
 
+void MtmUpdateReceiverStats(int nodeId, uint64 walEnd, timestamp_t sendTime, timestamp_t recvTime)
+{
+	MtmReceiverStats* stats = &dtm->receiverStats[nodeId-1];
+	pg_atomic_write_u64(&stats->receivedLsn, walEnd);
+	pg_atomic_write_u64(&stats->lastRecvTime, recvTime);
+	pg_atomic_write_u64(&stats->lastSendTime, sendTime);
+}
+
 csn_t MtmTransactionSnapshot(TransactionId xid)
 {
 	MtmTransState* ts;
@@ -1040,7 +1484,7 @@ csn_t MtmTransactionSnapshot(TransactionId xid)
 
 	MtmLock(LW_SHARED);
     ts = hash_search(xid2state, &xid, HASH_FIND, NULL);
-    if (ts != NULL) { 
+    if (ts != NULL) {
 		snapshot = ts->snapshot;
 	}
 	MtmUnlock();
@@ -1048,6 +1492,39 @@ csn_t MtmTransactionSnapshot(TransactionId xid)
     return snapshot;
 }
 
+csn_t MtmTransactionCsn(TransactionId xid)
+{
+	MtmTransState* ts;
+	csn_t csn = INVALID_CSN;
+
+	MtmLock(LW_SHARED);
+    ts = hash_search(xid2state, &xid, HASH_FIND, NULL);
+    if (ts != NULL) {
+		csn = ts->csn;
+	}
+	MtmUnlock();
+
+    return csn;
+}
+
+/*
+ * Max-merge the origin commit CSN of an applied transaction into the applied
+ * high-water mark of its origin node. Called by apply workers after the local
+ * commit succeeds, so mtm.wait_for_csn() observing the new value is
+ * guaranteed to see the transaction's effects.
+ */
+void MtmUpdateAppliedCsn(int nodeId, csn_t csn)
+{
+	uint64 old;
+
+	if (csn == INVALID_CSN || nodeId < 1 || nodeId > MTM_MAX_NODES) {
+		return;
+	}
+	old = pg_atomic_read_u64(&dtm->appliedCsn[nodeId-1]);
+	while (old < (uint64)csn
+		   && !pg_atomic_compare_exchange_u64(&dtm->appliedCsn[nodeId-1], &old, (uint64)csn));
+}
+
 MtmSlotMode MtmReceiverSlotMode(int nodeId)
 {
 	while (dtm->status != MTM_CONNECTED && dtm->status != MTM_ONLINE) { 		
@@ -1113,6 +1590,289 @@ mtm_get_snapshot(PG_FUNCTION_ARGS)
 	PG_RETURN_INT64(dtmTx.snapshot);
 }
 
+Datum
+mtm_get_last_csn(PG_FUNCTION_ARGS)
+{
+	if (MtmLastCommitCsn == 0) {
+		PG_RETURN_NULL();
+	}
+	PG_RETURN_INT64(MtmLastCommitCsn);
+}
+
+/*
+ * Block until the apply workers have committed all transactions of the
+ * specified origin node with commit CSN <= the given one. Together with
+ * mtm.get_last_csn() this provides a read-your-writes fence for clients
+ * switching nodes between transactions. Returns false on timeout
+ * (timeout_ms < 0 means wait forever).
+ */
+Datum
+mtm_wait_for_csn(PG_FUNCTION_ARGS)
+{
+	csn_t csn = (csn_t)PG_GETARG_INT64(0);
+	int origin = PG_GETARG_INT32(1);
+	int timeout_ms = PG_GETARG_INT32(2);
+	timestamp_t deadline = 0;
+
+	if (origin < 1 || origin > MtmNodes) {
+		elog(ERROR, "Invalid origin node %d", origin);
+	}
+	if (origin == MtmNodeId) {
+		/* Local commits are visible immediately */
+		PG_RETURN_BOOL(true);
+	}
+	if (timeout_ms >= 0) {
+		deadline = MtmGetCurrentTime() + (timestamp_t)timeout_ms*1000;
+	}
+	while (pg_atomic_read_u64(&dtm->appliedCsn[origin-1]) < (uint64)csn) {
+		if (timeout_ms >= 0 && MtmGetCurrentTime() >= deadline) {
+			PG_RETURN_BOOL(false);
+		}
+		CHECK_FOR_INTERRUPTS();
+		MtmSleep(1000);
+	}
+	PG_RETURN_BOOL(true);
+}
+
+static char const* const MtmNodeStatusNames[] =
+{
+	"Initialization",
+	"Offline",
+	"Connected",
+	"Online",
+	"Recovery"
+};
+
+/*
+ * Latency below which 'percent' of the vote round trips completed, rounded
+ * up to the histogram bucket's upper bound (2^bucket usec).
+ */
+static int64 MtmVoteLatencyPercentile(uint64 const* hist, double percent)
+{
+	uint64 total = 0;
+	uint64 seen = 0;
+	int b;
+
+	for (b = 0; b < MTM_VOTE_LATENCY_BUCKETS; b++) {
+		total += hist[b];
+	}
+	if (total == 0) {
+		return 0;
+	}
+	for (b = 0; b < MTM_VOTE_LATENCY_BUCKETS; b++) {
+		seen += hist[b];
+		if ((double)seen * 100.0 >= (double)total * percent) {
+			break;
+		}
+	}
+	return (int64)1 << b;
+}
+
+Datum
+mtm_pool_resize(PG_FUNCTION_ARGS)
+{
+	int nWorkers = PG_GETARG_INT32(0);
+
+	PG_RETURN_INT32(BgwPoolResize(&dtm->pool, nWorkers));
+}
+
+Datum
+mtm_make_table_local(PG_FUNCTION_ARGS)
+{
+	MtmMakeTableLocal(PG_GETARG_OID(0));
+	PG_RETURN_VOID();
+}
+
+Datum
+mtm_get_cluster_state(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupdesc;
+	Datum values[13];
+	bool nulls[13];
+	uint64 hist[MTM_VOTE_LATENCY_BUCKETS];
+	timestamp_t maxLatency;
+	BgwPoolStatus poolStatus;
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) {
+		elog(ERROR, "return type must be a row type");
+	}
+	tupdesc = BlessTupleDesc(tupdesc);
+
+	BgwPoolGetStatus(&dtm->pool, &poolStatus);
+
+	SpinLockAcquire(&dtm->spinlock);
+	memcpy(hist, dtm->voteLatencyHist, sizeof(hist));
+	maxLatency = dtm->voteLatencyMax;
+	SpinLockRelease(&dtm->spinlock);
+
+	MemSet(nulls, 0, sizeof(nulls));
+	values[0] = CStringGetTextDatum(MtmNodeStatusNames[dtm->status]);
+	values[1] = Int64GetDatum((int64)dtm->disabledNodeMask);
+	values[2] = Int64GetDatum((int64)dtm->pglogicalNodeMask);
+	values[3] = Int32GetDatum(dtm->nNodes);
+	values[4] = Int32GetDatum(dtm->nReceivers);
+	values[5] = Int32GetDatum(dtm->nLockers);
+	values[6] = Int64GetDatum((int64)poolStatus.usedBytes);
+	values[7] = Int64GetDatum((int64)poolStatus.totalBytes);
+	values[8] = Int32GetDatum(poolStatus.nPendingWorkItems);
+	values[9] = Int64GetDatum(MtmVoteLatencyPercentile(hist, 50));
+	values[10] = Int64GetDatum(MtmVoteLatencyPercentile(hist, 90));
+	values[11] = Int64GetDatum(MtmVoteLatencyPercentile(hist, 99));
+	values[12] = Int64GetDatum((int64)maxLatency);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+Datum
+mtm_get_nodes_state(PG_FUNCTION_ARGS)
+{
+	FuncCallContext* funcctx;
+	int nodeId;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		TupleDesc tupdesc;
+		MemoryContext oldcontext;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+		if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) {
+			elog(ERROR, "return type must be a row type");
+		}
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+		funcctx->max_calls = MtmNodes;
+		MemoryContextSwitchTo(oldcontext);
+	}
+	funcctx = SRF_PERCALL_SETUP();
+	nodeId = funcctx->call_cntr + 1;
+	if (nodeId <= (int)funcctx->max_calls)
+	{
+		Datum values[6];
+		bool nulls[6];
+		HeapTuple tuple;
+
+		MemSet(nulls, 0, sizeof(nulls));
+		values[0] = Int32GetDatum(nodeId);
+		values[1] = BoolGetDatum(!BIT_CHECK(dtm->disabledNodeMask, nodeId-1));
+		values[2] = BoolGetDatum(BIT_CHECK(dtm->pglogicalNodeMask, nodeId-1));
+		if (nodeId == MtmNodeId) {
+			/* there is no receiver for our own node */
+			nulls[3] = nulls[4] = nulls[5] = true;
+		} else {
+			MtmReceiverStats* stats = &dtm->receiverStats[nodeId-1];
+			uint64 receivedLsn = pg_atomic_read_u64(&stats->receivedLsn);
+			timestamp_t recvTime = pg_atomic_read_u64(&stats->lastRecvTime);
+			timestamp_t sendTime = pg_atomic_read_u64(&stats->lastSendTime);
+
+			if (recvTime == 0) {
+				/* no message received from this node yet */
+				nulls[3] = nulls[4] = nulls[5] = true;
+			} else {
+				values[3] = Int64GetDatum((int64)receivedLsn);
+				values[4] = Float8GetDatum(sendTime < recvTime
+										   ? (double)(recvTime - sendTime) / USEC
+										   : 0.0);
+				values[5] = Float8GetDatum((double)(GetCurrentTimestamp() - recvTime) / USEC);
+			}
+		}
+		tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+		SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+	}
+	SRF_RETURN_DONE(funcctx);
+}
+
+Datum
+mtm_get_conflict_stats(PG_FUNCTION_ARGS)
+{
+	FuncCallContext* funcctx;
+	MtmConflictRelStats* stats;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		TupleDesc tupdesc;
+		MemoryContext oldcontext;
+		int n;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+		if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) {
+			elog(ERROR, "return type must be a row type");
+		}
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+		/* snapshot the counters so the result is consistent across rows */
+		stats = (MtmConflictRelStats*)palloc(sizeof(dtm->conflictRels));
+		SpinLockAcquire(&dtm->spinlock);
+		n = dtm->nConflictRels;
+		memcpy(stats, dtm->conflictRels, n*sizeof(*stats));
+		SpinLockRelease(&dtm->spinlock);
+		funcctx->user_fctx = stats;
+		funcctx->max_calls = n;
+		MemoryContextSwitchTo(oldcontext);
+	}
+	funcctx = SRF_PERCALL_SETUP();
+	if (funcctx->call_cntr < funcctx->max_calls)
+	{
+		Datum values[4];
+		bool nulls[4];
+
+		stats = (MtmConflictRelStats*)funcctx->user_fctx + funcctx->call_cntr;
+		MemSet(nulls, 0, sizeof(nulls));
+		values[0] = ObjectIdGetDatum(stats->reloid);
+		values[1] = Int64GetDatum((int64)stats->counts[MTM_CONFLICT_INSERT_EXISTS]);
+		values[2] = Int64GetDatum((int64)stats->counts[MTM_CONFLICT_UPDATE_MISSING]);
+		values[3] = Int64GetDatum((int64)stats->counts[MTM_CONFLICT_DELETE_MISSING]);
+		SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(heap_form_tuple(funcctx->tuple_desc, values, nulls)));
+	}
+	SRF_RETURN_DONE(funcctx);
+}
+
+Datum
+mtm_get_hot_keys(PG_FUNCTION_ARGS)
+{
+	FuncCallContext* funcctx;
+	MtmHotKey* keys;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		TupleDesc tupdesc;
+		MemoryContext oldcontext;
+		int n = 0;
+		int i;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+		if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) {
+			elog(ERROR, "return type must be a row type");
+		}
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+		keys = (MtmHotKey*)palloc(sizeof(dtm->hotKeys));
+		SpinLockAcquire(&dtm->spinlock);
+		for (i = 0; i < MTM_MAX_HOT_KEYS; i++) {
+			if (dtm->hotKeys[i].reloid != InvalidOid) {
+				keys[n++] = dtm->hotKeys[i];
+			}
+		}
+		SpinLockRelease(&dtm->spinlock);
+		funcctx->user_fctx = keys;
+		funcctx->max_calls = n;
+		MemoryContextSwitchTo(oldcontext);
+	}
+	funcctx = SRF_PERCALL_SETUP();
+	if (funcctx->call_cntr < funcctx->max_calls)
+	{
+		Datum values[3];
+		bool nulls[3];
+
+		keys = (MtmHotKey*)funcctx->user_fctx + funcctx->call_cntr;
+		MemSet(nulls, 0, sizeof(nulls));
+		values[0] = ObjectIdGetDatum(keys->reloid);
+		values[1] = CStringGetTextDatum(keys->key);
+		values[2] = Int64GetDatum((int64)keys->count);
+		SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(heap_form_tuple(funcctx->tuple_desc, values, nulls)));
+	}
+	SRF_RETURN_DONE(funcctx);
+}
+
 /*
  * Execute statement with specified parameters and check its result
  */
@@ -1328,20 +2088,98 @@ MtmExecutorFinish(QueryDesc *queryDesc)
     }
 }        
 
+/*
+ * Dispatch a replicated transaction to the background worker pool.
+ * To let non-conflicting transactions be applied concurrently while
+ * potentially conflicting ones keep their receive order, the transaction is
+ * routed by the relation it touches: transactions on the same relation always
+ * go to the same worker, which applies them in FIFO order, while transactions
+ * on disjoint relations are spread across the workers. The relation name is
+ * extracted from the first 'R' record of the serialized transaction; if the
+ * transaction does not match the expected layout (e.g. it touches no
+ * relation at all), fall back to plain round-robin dispatch.
+ */
 void MtmExecute(void* work, int size)
 {
-    BgwPoolExecute(&dtm->pool, work, size);
+    char* data = (char*)work;
+    int origin = 0;
+
+    /* the 'B' record starts with the origin node id, sent in network order */
+    if (size >= 5 && data[0] == 'B')
+    {
+        origin = ((unsigned char)data[1] << 24) | ((unsigned char)data[2] << 16)
+               | ((unsigned char)data[3] << 8) | (unsigned char)data[4];
+        if (origin < 0 || origin > BGWPOOL_MAX_ORIGINS)
+            origin = 0;
+    }
+
+    /* 'B' + node(4) + xid(4) + snapshot(8) is followed by the first relation record */
+    if (size > 17+1+2 && data[0] == 'B' && data[17] == 'R')
+    {
+        char* p = data + 18;
+        int nspnamelen = (unsigned char)*p++;
+        if (18 + 1 + nspnamelen + 1 <= size)
+        {
+            char* key = p; /* hash schema and relation names together */
+            int relnamelen = (unsigned char)p[nspnamelen];
+            p += nspnamelen + 1;
+            if (p + relnamelen - data <= size)
+            {
+                uint32 affinity = DatumGetUInt32(hash_any((unsigned char*)key, nspnamelen + 1 + relnamelen));
+                BgwPoolExecuteAffinity(&dtm->pool, origin, affinity, work, size);
+                return;
+            }
+        }
+    }
+    BgwPoolExecute(&dtm->pool, origin, size <= BGWPOOL_SMALL_ITEM_SIZE, work, size);
 }
-    
-static BgwPool* 
+
+/*
+ * Hand a transaction spilled to disk by the receiver over to the pool.  Only
+ * a tiny work item referencing the spill file goes through the queue; the
+ * worker reads the file back, applies it and removes it. No affinity is used
+ * since peeking at the first relation would mean reading the file here.
+ */
+void MtmExecuteSpilled(int nodeId, char const* path)
+{
+    char work[1 + MAXPGPATH];
+    int size = strlen(path) + 2;
+
+    work[0] = 'F';
+    strcpy(work + 1, path);
+    /* the item itself is tiny, but it stands for a huge transaction: no priority */
+    BgwPoolExecute(&dtm->pool, nodeId, false, work, size);
+}
+
+static BgwPool*
 MtmPoolConstructor(void)
 {
     return &dtm->pool;
 }
 
-static void 
+static void
+MtmRecordVoteLatency(timestamp_t latency)
+{
+	int bucket = 0;
+	timestamp_t us = latency;
+
+	while (us > 0 && bucket < MTM_VOTE_LATENCY_BUCKETS-1) {
+		us >>= 1;
+		bucket += 1;
+	}
+	SpinLockAcquire(&dtm->spinlock);
+	dtm->voteLatencyHist[bucket] += 1;
+	if (latency > dtm->voteLatencyMax) {
+		dtm->voteLatencyMax = latency;
+	}
+	SpinLockRelease(&dtm->spinlock);
+}
+
+static void
 MtmVoteForTransaction(MtmTransState* ts)
 {
+	timestamp_t voteStart = MtmGetCurrentTime();
+
 	if (!MtmIsCoordinator(ts)) {
 		ts->cmd = ts->status == TRANSACTION_STATUS_ABORTED ? MSG_ABORTED : MSG_READY;
 		MtmSendNotificationMessage(ts); /* send READY message to coordinator */
@@ -1361,6 +2199,7 @@ MtmVoteForTransaction(MtmTransState* ts)
 		MtmLock(LW_SHARED);
 	}
 	MTM_TRACE("%d: Node %d receives response...\n", getpid(), MtmNodeId);
+	MtmRecordVoteLatency(MtmGetCurrentTime() - voteStart);
 }
 
 HTAB* MtmCreateHash(void)
@@ -1382,8 +2221,143 @@ HTAB* MtmCreateHash(void)
 	return htab;
 }
 
-MtmState*	
+MtmState*
 MtmGetState(void)
 {
 	return dtm;
 }
+
+/*
+ * Register the current relfilenode of the relation in the shared local-tables
+ * array, excluding its changes from replication. The walsender consults the
+ * array while reading WAL, before the changes are buffered (see
+ * pg_decode_relfilenode_filter), so it can not use catalog lookups and goes
+ * by relfilenode alone. Consequently the registration does not survive a
+ * server restart or a table rewrite which assigns a new relfilenode; it has
+ * to be repeated then. A stale entry is harmless: its relfilenode never
+ * appears in WAL again.
+ */
+void MtmMakeTableLocal(Oid relid)
+{
+	Relation rel = heap_open(relid, AccessShareLock);
+	RelFileNode rnode = rel->rd_node;
+	int i;
+
+	heap_close(rel, AccessShareLock);
+
+	SpinLockAcquire(&dtm->spinlock);
+	for (i = 0; i < dtm->nLocalTables; i++) {
+		if (RelFileNodeEquals(dtm->localTables[i], rnode)) {
+			SpinLockRelease(&dtm->spinlock);
+			return;
+		}
+	}
+	if (dtm->nLocalTables == MTM_MAX_LOCAL_TABLES) {
+		SpinLockRelease(&dtm->spinlock);
+		elog(ERROR, "Can not register more than %d local tables", MTM_MAX_LOCAL_TABLES);
+	}
+	dtm->localTables[dtm->nLocalTables] = rnode;
+	/* publish the entry before making it visible to lock-free readers */
+	pg_write_barrier();
+	dtm->nLocalTables += 1;
+	SpinLockRelease(&dtm->spinlock);
+}
+
+/*
+ * Check whether the relfilenode belongs to a table registered as local.
+ * Called by the walsender for every decoded heap record, so it scans the
+ * array without taking the spinlock; the publication protocol in
+ * MtmMakeTableLocal() makes that safe.
+ */
+bool MtmIsLocalRelFileNode(RelFileNode* rnode)
+{
+	int n;
+	int i;
+
+	if (dtm == NULL) { /* plugin used without shared_preload_libraries */
+		return false;
+	}
+	n = dtm->nLocalTables;
+	pg_read_barrier();
+	for (i = 0; i < n; i++) {
+		if (RelFileNodeEquals(dtm->localTables[i], *rnode)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Record a replication conflict detected by an apply worker: bump the
+ * per-relation counter for this conflict type and feed the replica identity
+ * key into the count-min sketch backing the hot-key table. A conflict aborts
+ * the whole apply transaction, so this path is not hot and doing the
+ * bookkeeping under the spinlock is acceptable.
+ */
+void MtmLogConflict(Oid reloid, MtmConflictType type, char const* key)
+{
+	uint32 h1;
+	uint32 h2;
+	uint32 estimate = ~(uint32)0;
+	int    i;
+	int    victim;
+
+	if (dtm == NULL) {
+		return;
+	}
+	h1 = DatumGetUInt32(hash_any((unsigned char const*)key, strlen(key)));
+	/* make it odd so the sketch rows use genuinely different positions */
+	h2 = DatumGetUInt32(hash_uint32(h1 ^ reloid)) | 1;
+
+	SpinLockAcquire(&dtm->spinlock);
+
+	for (i = 0; i < dtm->nConflictRels; i++) {
+		if (dtm->conflictRels[i].reloid == reloid) {
+			break;
+		}
+	}
+	if (i == dtm->nConflictRels) {
+		if (i < MTM_MAX_CONFLICT_RELS) {
+			memset(&dtm->conflictRels[i], 0, sizeof(dtm->conflictRels[i]));
+			dtm->conflictRels[i].reloid = reloid;
+			dtm->nConflictRels += 1;
+		} else {
+			i = -1; /* table full: lose per-relation attribution, keep the sketch */
+		}
+	}
+	if (i >= 0) {
+		dtm->conflictRels[i].counts[type] += 1;
+	}
+
+	/* bump the sketch; the minimum of the rows is the key's estimate */
+	for (i = 0; i < MTM_CMS_DEPTH; i++) {
+		uint32* cell = &dtm->conflictSketch[i][(h1 + i*h2) % MTM_CMS_WIDTH];
+		if (*cell != ~(uint32)0) {
+			*cell += 1;
+		}
+		if (*cell < estimate) {
+			estimate = *cell;
+		}
+	}
+
+	/* refresh the key's entry in the top-K table, or evict the weakest one */
+	victim = 0;
+	for (i = 0; i < MTM_MAX_HOT_KEYS; i++) {
+		MtmHotKey* hk = &dtm->hotKeys[i];
+		if (hk->reloid == reloid && strncmp(hk->key, key, MTM_HOT_KEY_LEN-1) == 0) {
+			hk->count = estimate;
+			victim = -1;
+			break;
+		}
+		if (hk->count < dtm->hotKeys[victim].count) {
+			victim = i;
+		}
+	}
+	if (victim >= 0 && estimate > dtm->hotKeys[victim].count) {
+		MtmHotKey* hk = &dtm->hotKeys[victim];
+		hk->reloid = reloid;
+		hk->count = estimate;
+		strlcpy(hk->key, key, MTM_HOT_KEY_LEN);
+	}
+	SpinLockRelease(&dtm->spinlock);
+}
@@ -1,6 +1,9 @@
 #ifndef __MULTIMASTER_H__
 #define __MULTIMASTER_H__
 
+#include "port/atomics.h"
+#include "storage/relfilenode.h"
+
 #include "bytebuf.h"
 #include "bgwpool.h"
 
@@ -18,8 +21,9 @@
 #define MULTIMASTER_SCHEMA_NAME         "mtm"
 #define MULTIMASTER_DDL_TABLE           "ddl_log"
 #define MULTIMASTER_SLOT_PATTERN        "mtm_slot_%d"
-#define MULTIMASTER_MIN_PROTO_VERSION   1
-#define MULTIMASTER_MAX_PROTO_VERSION   1
+/* version 2: COMMIT message carries the origin commit CSN */
+#define MULTIMASTER_MIN_PROTO_VERSION   2
+#define MULTIMASTER_MAX_PROTO_VERSION   2
 
 #define Natts_mtm_ddl_log 2
 #define Anum_mtm_ddl_log_issued		1
@@ -88,6 +92,54 @@ typedef struct MtmTransState
 	TransactionId xids[1];             /* transaction ID at replicas: varying size MtmNodes */
 } MtmTransState;
 
+#define MTM_MAX_NODES 64              /* limited by nodemask_t width */
+#define MTM_MAX_LOCAL_TABLES 256      /* capacity of the local-tables registry */
+#define MTM_VOTE_LATENCY_BUCKETS 24   /* log2 usec histogram of vote round trips */
+#define MTM_MAX_CONFLICT_RELS 64      /* capacity of per-relation conflict counters */
+#define MTM_CMS_DEPTH 4               /* rows of the hot-key count-min sketch */
+#define MTM_CMS_WIDTH 1024            /* counters per sketch row */
+#define MTM_MAX_HOT_KEYS 16           /* tracked top conflicting keys */
+#define MTM_HOT_KEY_LEN 64            /* stored key text, longer keys are truncated */
+
+/*
+ * Conflicts detected while applying remote transactions. Apply aborts the
+ * transaction in all three cases, so these count rollbacks forced on the
+ * origin node's traffic.
+ */
+typedef enum
+{
+	MTM_CONFLICT_INSERT_EXISTS,  /* remote INSERT hit an existing unique key */
+	MTM_CONFLICT_UPDATE_MISSING, /* remote UPDATE found no tuple: delete-update */
+	MTM_CONFLICT_DELETE_MISSING, /* remote DELETE found no tuple: delete-delete */
+	MTM_N_CONFLICT_TYPES
+} MtmConflictType;
+
+typedef struct
+{
+	Oid    reloid;
+	uint64 counts[MTM_N_CONFLICT_TYPES];
+} MtmConflictRelStats;
+
+typedef struct
+{
+	Oid    reloid;
+	uint32 count;                      /* sketch estimate when last bumped */
+	char   key[MTM_HOT_KEY_LEN];       /* replica identity key, textual */
+} MtmHotKey;
+
+/*
+ * Per-node statistics maintained by the logical receiver attached to that
+ * node. Updated lock-free so the receiver hot loop doesn't take MtmLock.
+ * Times are TimestampTz-epoch microseconds as carried by the replication
+ * protocol.
+ */
+typedef struct
+{
+	pg_atomic_uint64 receivedLsn;      /* latest remote walEnd received from this node */
+	pg_atomic_uint64 lastRecvTime;     /* local time when the last message arrived */
+	pg_atomic_uint64 lastSendTime;     /* remote sendTime of the last message */
+} MtmReceiverStats;
+
 typedef struct
 {
 	MtmNodeStatus status;              /* Status of this node */
@@ -96,6 +148,8 @@ typedef struct
 	PGSemaphoreData votingSemaphore;   /* semaphore used to notify mtm-sender about new responses to coordinator */
 	LWLockPadded *locks;               /* multimaster lock tranche */
 	TransactionId oldestXid;           /* XID of oldest transaction visible by any active transaction (local or global) */
+	csn_t prunedCsn;                   /* highest CSN up to which xid2state entries have been pruned; snapshots older
+										  than this get "snapshot too old" when they hit a missing entry */
 	nodemask_t disabledNodeMask;       /* bitmask of disabled nodes (so no more than 64 nodes in multimaster:) */
 	nodemask_t pglogicalNodeMask;      /* bitmask of started pglogic receivers */
 	nodemask_t walSenderLockerMask;    /* Mask of WAL-senders IDs locking the cluster */
@@ -103,8 +157,8 @@ typedef struct
     int    nNodes;                     /* number of active nodes */
     int    nReceivers;                 /* number of initialized logical receivers (used to determine moment when Mtm intialization is completed */
 	int    nLockers;                   /* number of lockers */
-	long   timeShift;                  /* local time correction */
-	csn_t  csn;                        /* last obtained CSN: used to provide unique acending CSNs based on system time */
+	pg_atomic_uint64 timeShift;        /* local time correction, updated lock-free */
+	pg_atomic_uint64 csn;              /* last obtained CSN: used to provide unique ascending CSNs based on system time, advanced with a lock-free max-merge */
 	MtmTransState* votingTransactions; /* L1-list of replicated transactions sendings notifications to coordinator.
 									 	 This list is used to pass information to mtm-sender BGW */
     MtmTransState* transListHead;      /* L1 list of all finished transactions present in xid2state hash.
@@ -112,6 +166,22 @@ typedef struct
     MtmTransState** transListTail;     /* Tail of L1 list of all finished transactionds, used to append new elements.
 								  		  This list is expected to be in CSN ascending order, by strict order may be violated */
     BgwPool pool;                      /* Pool of background workers for applying logical replication patches */
+	pg_atomic_uint64 appliedCsn[MTM_MAX_NODES]; /* max origin commit CSN applied from each node, advanced
+												   lock-free by apply workers; used by mtm.wait_for_csn() */
+	pg_atomic_uint64 catchupLsn[MTM_MAX_NODES]; /* remote LSN up to which the catch-up window towards each node
+												   extends, 0 when no window is open; published by the regular
+												   receiver at reconnect, read by the catch-up receivers */
+	MtmReceiverStats receiverStats[MTM_MAX_NODES]; /* per-node receiver statistics */
+	uint64 voteLatencyHist[MTM_VOTE_LATENCY_BUCKETS]; /* histogram of vote round-trip times, protected by spinlock */
+	timestamp_t voteLatencyMax;        /* worst vote round trip seen, protected by spinlock */
+	int    nLocalTables;               /* used entries in localTables; appends are serialized by spinlock,
+										  readers (walsender decoding hot path) scan lock-free */
+	RelFileNode localTables[MTM_MAX_LOCAL_TABLES]; /* relfilenodes of tables excluded from replication,
+													  registered by mtm.make_table_local() */
+	int    nConflictRels;              /* used entries in conflictRels, protected by spinlock */
+	MtmConflictRelStats conflictRels[MTM_MAX_CONFLICT_RELS]; /* per-relation conflict counters */
+	uint32 conflictSketch[MTM_CMS_DEPTH][MTM_CMS_WIDTH]; /* count-min sketch over conflicting keys */
+	MtmHotKey hotKeys[MTM_MAX_HOT_KEYS]; /* top conflicting keys by sketch estimate */
 } MtmState;
 
 #define MtmIsCoordinator(ts) (ts->gtid.node == MtmNodeId)
@@ -124,17 +194,34 @@ extern char* MtmDatabaseName;
 extern int   MtmConnectAttempts;
 extern int   MtmConnectTimeout;
 extern int   MtmReconnectAttempts;
+extern int   MtmReplicationStreams;
+extern int   MtmCatchupStreams;
+extern int   MtmCatchupLag;
+extern int   MtmApplyGroupSize;
+extern bool  MtmBinaryBasetypes;
+extern bool  MtmDeferredIndexes;
+extern bool  MtmSpeculativeCommit;
+extern bool  MtmUseWalCompression;
 
 extern void  MtmArbiterInitialize(void);
 extern int   MtmStartReceivers(char* nodes, int nodeId);
 extern csn_t MtmTransactionSnapshot(TransactionId xid);
+extern csn_t MtmTransactionCsn(TransactionId xid);
+extern void  MtmUpdateAppliedCsn(int nodeId, csn_t csn);
 extern csn_t MtmAssignCSN(void);
 extern csn_t MtmSyncClock(csn_t csn);
 extern void  MtmJoinTransaction(GlobalTransactionId* gtid, csn_t snapshot);
+extern bool  MtmGroupApplyBegin(GlobalTransactionId* gtid, csn_t snapshot);
+extern void  MtmGroupApplyJoin(GlobalTransactionId* gtid, csn_t snapshot);
+extern void  MtmGroupApplyVote(int nMembers, TransactionId* xids, GlobalTransactionId* gtids);
+extern bool  MtmGroupApplyWait(int nMembers, TransactionId* xids);
+extern bool  MtmMoreApplyWorkPending(int workerId);
 extern void  MtmReceiverStarted(int nodeId);
+extern void  MtmUpdateReceiverStats(int nodeId, uint64 walEnd, timestamp_t sendTime, timestamp_t recvTime);
 extern MtmSlotMode MtmReceiverSlotMode(int nodeId);
 extern void  MtmExecute(void* work, int size);
 extern void  MtmExecutor(int id, void* work, size_t size);
+extern void  MtmExecuteSpilled(int nodeId, char const* path);
 extern HTAB* MtmCreateHash(void);
 extern void  MtmSendNotificationMessage(MtmTransState* ts);
 extern void  MtmAdjustSubtransactions(MtmTransState* ts);
@@ -145,4 +232,7 @@ extern MtmState* MtmGetState(void);
 extern timestamp_t MtmGetCurrentTime(void);
 extern void  MtmSleep(timestamp_t interval);
 extern bool  MtmIsRecoveredNode(int nodeId);
+extern void  MtmMakeTableLocal(Oid relid);
+extern bool  MtmIsLocalRelFileNode(RelFileNode* rnode);
+extern void  MtmLogConflict(Oid reloid, MtmConflictType type, char const* key);
 #endif
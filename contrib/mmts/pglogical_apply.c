@@ -1,4 +1,6 @@
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include "postgres.h"
 
 #include "funcapi.h"
@@ -15,6 +17,7 @@
 #include "catalog/dependency.h"
 #include "catalog/index.h"
 #include "catalog/namespace.h"
+#include "catalog/pg_am.h"
 #include "catalog/pg_type.h"
 
 #include "executor/spi.h"
@@ -26,6 +29,7 @@
 #include "parser/parse_type.h"
 
 #include "replication/logical.h"
+#include "replication/origin.h"
 
 #include "storage/ipc.h"
 #include "storage/lmgr.h"
@@ -38,9 +42,13 @@
 #include "tcop/utility.h"
 
 #include "utils/array.h"
+#include "utils/datum.h"
+#include "utils/tuplesort.h"
 #include "utils/tqual.h"
 #include "utils/builtins.h"
 #include "utils/datetime.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/snapmgr.h"
@@ -56,6 +64,36 @@ typedef struct TupleData
 	bool		changed[MaxTupleAttributeNumber];
 } TupleData;
 
+/*
+ * Deferred index maintenance. With multimaster.deferred_indexes enabled,
+ * entries for non-unique btree indexes are buffered here instead of being
+ * inserted row by row, and are applied sorted per index right before the
+ * apply transaction commits (or when the buffers outgrow work_mem). Bulk
+ * changes then hit each index in key order - mostly sequential I/O - instead
+ * of spraying random leaf page updates across all indexes for every row.
+ * Unique and exclusion-constraint indexes stay on the synchronous path so
+ * conflict detection is not delayed, and so the replica identity lookups of
+ * later changes in the same transaction keep working.
+ */
+typedef struct DeferredIndexBuffer
+{
+	Oid			indexoid;
+	Oid			heapoid;
+	int			nkeys;			   /* index columns */
+	int			nentries;
+	int			capacity;
+	ItemPointerData *tids;
+	Datum	   *values;			   /* nkeys Datums per entry */
+	bool	   *isnull;			   /* nkeys flags per entry */
+} DeferredIndexBuffer;
+
+#define MAX_DEFERRED_INDEXES 32
+
+static DeferredIndexBuffer deferredIndexes[MAX_DEFERRED_INDEXES];
+static int  nDeferredIndexes;
+static Size deferredIndexBytes;
+static MemoryContext DeferredIndexContext;
+
 static Relation read_rel(StringInfo s, LOCKMODE mode);
 static void read_tuple_parts(StringInfo s, Relation rel, TupleData *tup);
 static EState* create_rel_estate(Relation rel);
@@ -71,6 +109,238 @@ static void process_remote_commit(StringInfo s);
 static void process_remote_insert(StringInfo s, Relation rel);
 static void process_remote_update(StringInfo s, Relation rel);
 static void process_remote_delete(StringInfo s, Relation rel);
+static void apply_group_finish(void);
+
+/*
+ * Apply-side group commit state. With multimaster.apply_group_size > 1
+ * consecutive replicated transactions from the same origin node are applied
+ * as subtransactions of one local transaction, so the whole group shares one
+ * WAL flush and one wait for the vote round trips of all members. Each member
+ * still runs the ordinary per-gtid voting protocol, keyed by its
+ * subtransaction XID (see MtmGroupApplyVote). The group stays open between
+ * work items of this worker and is closed when the size limit is reached,
+ * the origin changes, or the worker's queue drains.
+ */
+static bool MtmApplyGroupActive;
+static int  MtmApplyGroupOrigin;
+static int  MtmApplyGroupCount;
+static int  MtmApplyWorkerId;
+static TransactionId* MtmApplyGroupXids;
+static GlobalTransactionId* MtmApplyGroupGtids;
+static csn_t MtmApplyGroupMaxCsn;  /* max origin commit CSN in the current group */
+static int  MtmApplyLastOrigin;    /* origin node of the current plain (non-group) transaction */
+
+/*
+ * Replication origin ids used to tag the WAL we write while applying peer
+ * transactions, one per origin node, looked up (and created on first use)
+ * lazily.  Tagged records let a decoder drop peer transactions before they
+ * enter the reorder buffer (see pg_decode_origin_filter) instead of
+ * decoding the whole transaction only to throw it away in write_begin.
+ */
+static RepOriginId MtmNodeOriginIds[MTM_MAX_NODES];
+
+/* Must be called inside a transaction: may write the origin catalog. */
+static RepOriginId
+origin_id_for_node(int node)
+{
+	Assert(node > 0 && node <= MTM_MAX_NODES);
+	if (MtmNodeOriginIds[node-1] == InvalidRepOriginId)
+	{
+		char name[32];
+
+		snprintf(name, sizeof(name), MULTIMASTER_NAME "_node_%d", node);
+		MtmNodeOriginIds[node-1] = replorigin_by_name(name, true);
+		if (MtmNodeOriginIds[node-1] == InvalidRepOriginId)
+			MtmNodeOriginIds[node-1] = replorigin_create(name);
+	}
+	return MtmNodeOriginIds[node-1];
+}
+
+/*
+ * Apply workers used to resolve the type input function for every attribute
+ * of every row, and the btree equality operator for every index column of
+ * every UPDATE/DELETE, which made SearchCatCache the hottest function in
+ * apply profiles even for single-table workloads.  Instead we resolve these
+ * descriptors once per relation (or index), keep them for the whole apply
+ * session and drop an entry when the relation's relcache entry is
+ * invalidated, so DDL on the origin is still picked up.
+ */
+typedef struct MtmApplyCachedAttr
+{
+	bool		input_valid;	/* input_fn/typioparam initialized? */
+	bool		receive_valid;	/* receive_fn/typioparam initialized? */
+	FmgrInfo	input_fn;		/* type input function, 't' format */
+	FmgrInfo	receive_fn;		/* type receive function, 's' format */
+	Oid			typioparam;
+} MtmApplyCachedAttr;
+
+typedef struct MtmApplyRelEntry
+{
+	Oid			relid;			/* hash key, must be first */
+	int			natts;
+	MtmApplyCachedAttr *attrs;	/* natts entries */
+} MtmApplyRelEntry;
+
+typedef struct MtmApplyIdxEntry
+{
+	Oid			idxrelid;		/* hash key, must be first */
+	int			nkeys;
+	RegProcedure *eq_opcodes;	/* btree equality proc per index column */
+} MtmApplyIdxEntry;
+
+static HTAB *MtmApplyRelCache;
+static HTAB *MtmApplyIdxCache;
+static MemoryContext MtmApplyCacheContext;
+
+/*
+ * Replicated DDL (see MtmProcessDDLCommand and the ddl_log handling in
+ * process_remote_insert) is applied with SPI in the middle of the apply
+ * stream, and a single migration transaction easily produces hundreds of
+ * relcache invalidation messages.  Sweeping both caches once per message
+ * made DDL apply quadratic in the number of cached relations.  Instead the
+ * callback only queues the invalidated relid (or flags a total flush when
+ * the queue overflows or a global invalidation arrives), and the queue is
+ * drained in one pass over the caches at the next lookup.
+ */
+#define MTM_APPLY_INVAL_QUEUE_SIZE 64
+
+static Oid	MtmApplyPendingInvals[MTM_APPLY_INVAL_QUEUE_SIZE];
+static int	MtmApplyPendingInvalCount;	/* -1 means flush everything */
+
+static void
+MtmApplyCacheCallback(Datum arg, Oid relid)
+{
+	int			i;
+
+	if (MtmApplyPendingInvalCount < 0)
+		return;					/* already flushing everything */
+
+	if (relid == InvalidOid ||
+		MtmApplyPendingInvalCount >= MTM_APPLY_INVAL_QUEUE_SIZE)
+	{
+		MtmApplyPendingInvalCount = -1;
+		return;
+	}
+
+	for (i = 0; i < MtmApplyPendingInvalCount; i++)
+	{
+		if (MtmApplyPendingInvals[i] == relid)
+			return;
+	}
+	MtmApplyPendingInvals[MtmApplyPendingInvalCount++] = relid;
+}
+
+static bool
+MtmApplyInvalMatches(Oid relid, Oid *pending, int npending)
+{
+	int			i;
+
+	if (npending < 0)
+		return true;			/* flushing everything */
+	for (i = 0; i < npending; i++)
+	{
+		if (pending[i] == relid)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Drain the queued invalidations in a single pass over both caches.  Must
+ * run before any cached entry is consumed, so the getters below call it
+ * first.  The queue is copied and reset up front: dropping an entry can in
+ * principle fire further callbacks, and those should queue for the next
+ * round rather than grow the set we are iterating over.
+ */
+static void
+MtmApplyCacheProcessInvals(void)
+{
+	HASH_SEQ_STATUS status;
+	MtmApplyRelEntry *rentry;
+	MtmApplyIdxEntry *ientry;
+	Oid			pending[MTM_APPLY_INVAL_QUEUE_SIZE];
+	int			npending = MtmApplyPendingInvalCount;
+
+	if (npending == 0)
+		return;
+	if (npending > 0)
+		memcpy(pending, MtmApplyPendingInvals, npending * sizeof(Oid));
+	MtmApplyPendingInvalCount = 0;
+
+	hash_seq_init(&status, MtmApplyRelCache);
+	while ((rentry = hash_seq_search(&status)) != NULL)
+	{
+		if (MtmApplyInvalMatches(rentry->relid, pending, npending))
+		{
+			if (rentry->attrs != NULL)
+				pfree(rentry->attrs);
+			hash_search(MtmApplyRelCache, &rentry->relid, HASH_REMOVE, NULL);
+		}
+	}
+
+	hash_seq_init(&status, MtmApplyIdxCache);
+	while ((ientry = hash_seq_search(&status)) != NULL)
+	{
+		if (MtmApplyInvalMatches(ientry->idxrelid, pending, npending))
+		{
+			if (ientry->eq_opcodes != NULL)
+				pfree(ientry->eq_opcodes);
+			hash_search(MtmApplyIdxCache, &ientry->idxrelid, HASH_REMOVE, NULL);
+		}
+	}
+}
+
+static void
+MtmApplyCacheInit(void)
+{
+	HASHCTL		ctl;
+
+	MtmApplyCacheContext = AllocSetContextCreate(TopMemoryContext,
+												 "MtmApplyCache",
+												 ALLOCSET_DEFAULT_MINSIZE,
+												 ALLOCSET_DEFAULT_INITSIZE,
+												 ALLOCSET_DEFAULT_MAXSIZE);
+
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(Oid);
+	ctl.entrysize = sizeof(MtmApplyRelEntry);
+	ctl.hcxt = MtmApplyCacheContext;
+	MtmApplyRelCache = hash_create("MtmApplyRelCache", 32, &ctl,
+								   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	ctl.entrysize = sizeof(MtmApplyIdxEntry);
+	MtmApplyIdxCache = hash_create("MtmApplyIdxCache", 32, &ctl,
+								   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	CacheRegisterRelcacheCallback(MtmApplyCacheCallback, (Datum) 0);
+}
+
+static MtmApplyRelEntry *
+MtmGetApplyRelEntry(Relation rel)
+{
+	MtmApplyRelEntry *entry;
+	bool		found;
+	Oid			relid = RelationGetRelid(rel);
+
+	if (MtmApplyRelCache == NULL)
+		MtmApplyCacheInit();
+	MtmApplyCacheProcessInvals();
+
+	entry = hash_search(MtmApplyRelCache, &relid, HASH_ENTER, &found);
+	if (!found || entry->natts != RelationGetDescr(rel)->natts)
+	{
+		if (found && entry->attrs != NULL)
+			pfree(entry->attrs);
+		entry->natts = 0;
+		entry->attrs = NULL;
+		entry->attrs = (MtmApplyCachedAttr *)
+			MemoryContextAllocZero(MtmApplyCacheContext,
+								   RelationGetDescr(rel)->natts *
+								   sizeof(MtmApplyCachedAttr));
+		entry->natts = RelationGetDescr(rel)->natts;
+	}
+	return entry;
+}
 
 /*
  * Search the index 'idxrel' for a tuple identified by 'skey' in 'rel'.
@@ -198,6 +468,40 @@ build_index_scan_keys(EState *estate, ScanKey *scan_keys, TupleData *tup)
 	}
 }
 
+/*
+ * Render the replica identity key of 'tup' (the columns of 'idxrel') as a
+ * comma-separated text string, for conflict reporting.  Returns a palloc'd
+ * string in the current memory context.
+ */
+static char *
+format_identity_key(Relation rel, Relation idxrel, TupleData *tup)
+{
+	StringInfoData s;
+	int			attoff;
+
+	initStringInfo(&s);
+	for (attoff = 0; attoff < RelationGetNumberOfAttributes(idxrel); attoff++)
+	{
+		int			mainattno = idxrel->rd_index->indkey.values[attoff] - 1;
+
+		if (attoff > 0)
+			appendStringInfoChar(&s, ',');
+		if (tup->isnull[mainattno])
+			appendStringInfoString(&s, "null");
+		else
+		{
+			Oid			typoutput;
+			bool		isvarlena;
+
+			getTypeOutputInfo(RelationGetDescr(rel)->attrs[mainattno]->atttypid,
+							  &typoutput, &isvarlena);
+			appendStringInfoString(&s, OidOutputFunctionCall(typoutput,
+													tup->values[mainattno]));
+		}
+	}
+	return s.data;
+}
+
 /*
  * Setup a ScanKey for a search in the relation 'rel' for a tuple 'key' that
  * is setup to match 'rel' (*NOT* idxrel!).
@@ -208,52 +512,83 @@ static bool
 build_index_scan_key(ScanKey skey, Relation rel, Relation idxrel, TupleData *tup)
 {
 	int			attoff;
-	Datum		indclassDatum;
 	Datum		indkeyDatum;
 	bool		isnull;
-	oidvector  *opclass;
 	int2vector  *indkey;
 	bool		hasnulls = false;
-
-	indclassDatum = SysCacheGetAttr(INDEXRELID, idxrel->rd_indextuple,
-									Anum_pg_index_indclass, &isnull);
-	Assert(!isnull);
-	opclass = (oidvector *) DatumGetPointer(indclassDatum);
+	MtmApplyIdxEntry *ientry;
+	bool		found;
+	Oid			idxrelid = RelationGetRelid(idxrel);
 
 	indkeyDatum = SysCacheGetAttr(INDEXRELID, idxrel->rd_indextuple,
 									Anum_pg_index_indkey, &isnull);
 	Assert(!isnull);
 	indkey = (int2vector *) DatumGetPointer(indkeyDatum);
 
+	if (MtmApplyIdxCache == NULL)
+		MtmApplyCacheInit();
+	MtmApplyCacheProcessInvals();
 
-	for (attoff = 0; attoff < RelationGetNumberOfAttributes(idxrel); attoff++)
+	/*
+	 * Resolve the btree equality procs for this index once and reuse them
+	 * for all subsequent rows; the entry is dropped by the relcache
+	 * invalidation callback if the index definition changes.
+	 */
+	ientry = hash_search(MtmApplyIdxCache, &idxrelid, HASH_ENTER, &found);
+	if (!found || ientry->nkeys != RelationGetNumberOfAttributes(idxrel))
 	{
-		Oid			operator;
-		Oid			opfamily;
-		RegProcedure regop;
-		int			pkattno = attoff + 1;
-		int			mainattno = indkey->values[attoff];
-		Oid			atttype = attnumTypeId(rel, mainattno);
-		Oid			optype = get_opclass_input_type(opclass->values[attoff]);
+		Datum		indclassDatum;
+		oidvector  *opclass;
+
+		indclassDatum = SysCacheGetAttr(INDEXRELID, idxrel->rd_indextuple,
+										Anum_pg_index_indclass, &isnull);
+		Assert(!isnull);
+		opclass = (oidvector *) DatumGetPointer(indclassDatum);
+
+		if (found && ientry->eq_opcodes != NULL)
+			pfree(ientry->eq_opcodes);
+		/* don't mark the entry valid until the lookups below succeed */
+		ientry->nkeys = 0;
+		ientry->eq_opcodes = NULL;
+		ientry->eq_opcodes = (RegProcedure *)
+			MemoryContextAlloc(MtmApplyCacheContext,
+							   RelationGetNumberOfAttributes(idxrel) *
+							   sizeof(RegProcedure));
+
+		for (attoff = 0; attoff < RelationGetNumberOfAttributes(idxrel); attoff++)
+		{
+			Oid			operator;
+			Oid			opfamily;
+			int			mainattno = indkey->values[attoff];
+			Oid			atttype = attnumTypeId(rel, mainattno);
+			Oid			optype = get_opclass_input_type(opclass->values[attoff]);
 
-		opfamily = get_opclass_family(opclass->values[attoff]);
+			opfamily = get_opclass_family(opclass->values[attoff]);
 
-		operator = get_opfamily_member(opfamily, optype,
-									   optype,
-									   BTEqualStrategyNumber);
+			operator = get_opfamily_member(opfamily, optype,
+										   optype,
+										   BTEqualStrategyNumber);
 
-		if (!OidIsValid(operator))
-			elog(ERROR,
-				 "could not lookup equality operator for type %u, optype %u in opfamily %u",
-				 atttype, optype, opfamily);
+			if (!OidIsValid(operator))
+				elog(ERROR,
+					 "could not lookup equality operator for type %u, optype %u in opfamily %u",
+					 atttype, optype, opfamily);
 
-		regop = get_opcode(operator);
+			ientry->eq_opcodes[attoff] = get_opcode(operator);
+		}
+		ientry->nkeys = RelationGetNumberOfAttributes(idxrel);
+	}
+
+	for (attoff = 0; attoff < RelationGetNumberOfAttributes(idxrel); attoff++)
+	{
+		int			pkattno = attoff + 1;
+		int			mainattno = indkey->values[attoff];
 
 		/* FIXME: convert type? */
 		ScanKeyInit(&skey[attoff],
 					pkattno,
 					BTEqualStrategyNumber,
-					regop,
+					ientry->eq_opcodes[attoff],
 					tup->values[mainattno - 1]);
 
 		if (tup->isnull[mainattno - 1])
@@ -265,6 +600,234 @@ build_index_scan_key(ScanKey skey, Relation rel, Relation idxrel, TupleData *tup
 	return hasnulls;
 }
 
+/*
+ * Forget all buffered index entries; called when the apply transaction is
+ * aborted (the heap tuples they point to are dead anyway).
+ */
+static void
+deferred_indexes_reset(void)
+{
+	nDeferredIndexes = 0;
+	deferredIndexBytes = 0;
+	if (DeferredIndexContext != NULL)
+		MemoryContextReset(DeferredIndexContext);
+}
+
+/*
+ * Insert the buffered entries, sorted in key order per index.
+ * Must be called before the apply transaction commits.
+ */
+static void
+deferred_indexes_flush(void)
+{
+	int			i;
+
+	for (i = 0; i < nDeferredIndexes; i++)
+	{
+		DeferredIndexBuffer *buf = &deferredIndexes[i];
+		Relation	heapRel;
+		Relation	idxRel;
+		Tuplesortstate *sortstate;
+		IndexTuple	itup;
+		bool		should_free;
+		int			j;
+
+		/* the apply transaction already holds RowExclusiveLock on the heap */
+		heapRel = heap_open(buf->heapoid, NoLock);
+		idxRel = index_open(buf->indexoid, RowExclusiveLock);
+
+		sortstate = tuplesort_begin_index_btree(heapRel, idxRel, false,
+												work_mem, false);
+		for (j = 0; j < buf->nentries; j++)
+			tuplesort_putindextuplevalues(sortstate, idxRel,
+										  &buf->tids[j],
+										  &buf->values[j * buf->nkeys],
+										  &buf->isnull[j * buf->nkeys]);
+		tuplesort_performsort(sortstate);
+
+		while ((itup = tuplesort_getindextuple(sortstate, true,
+											   &should_free)) != NULL)
+		{
+			Datum		values[INDEX_MAX_KEYS];
+			bool		isnull[INDEX_MAX_KEYS];
+			int			k;
+
+			for (k = 0; k < buf->nkeys; k++)
+				values[k] = index_getattr(itup, k + 1,
+										  RelationGetDescr(idxRel),
+										  &isnull[k]);
+			index_insert(idxRel, values, isnull, &itup->t_tid,
+						 heapRel, UNIQUE_CHECK_NO);
+			if (should_free)
+				pfree(itup);
+		}
+		tuplesort_end(sortstate);
+
+		index_close(idxRel, NoLock);
+		heap_close(heapRel, NoLock);
+	}
+	deferred_indexes_reset();
+}
+
+static bool
+index_in_deferred_buffer(Oid indexoid)
+{
+	int			i;
+
+	for (i = 0; i < nDeferredIndexes; i++)
+	{
+		if (deferredIndexes[i].indexoid == indexoid)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Buffer one entry for a deferrable index.
+ */
+static void
+deferred_index_append(Relation idxRel, Relation heapRel,
+					  ItemPointer tid, Datum *values, bool *isnull)
+{
+	DeferredIndexBuffer *buf = NULL;
+	TupleDesc	idxDesc = RelationGetDescr(idxRel);
+	MemoryContext oldctx;
+	int			i;
+
+	if (DeferredIndexContext == NULL)
+		DeferredIndexContext = AllocSetContextCreate(TopMemoryContext,
+													 "DeferredIndexContext",
+													 ALLOCSET_DEFAULT_MINSIZE,
+													 ALLOCSET_DEFAULT_INITSIZE,
+													 ALLOCSET_DEFAULT_MAXSIZE);
+
+	for (i = 0; i < nDeferredIndexes; i++)
+	{
+		if (deferredIndexes[i].indexoid == RelationGetRelid(idxRel))
+		{
+			buf = &deferredIndexes[i];
+			break;
+		}
+	}
+	if (buf == NULL)
+	{
+		Assert(nDeferredIndexes < MAX_DEFERRED_INDEXES);
+		buf = &deferredIndexes[nDeferredIndexes++];
+		buf->indexoid = RelationGetRelid(idxRel);
+		buf->heapoid = RelationGetRelid(heapRel);
+		buf->nkeys = RelationGetNumberOfAttributes(idxRel);
+		buf->nentries = 0;
+		buf->capacity = 1024;
+		buf->tids = (ItemPointerData *)
+			MemoryContextAlloc(DeferredIndexContext,
+							   buf->capacity * sizeof(ItemPointerData));
+		buf->values = (Datum *)
+			MemoryContextAlloc(DeferredIndexContext,
+							   buf->capacity * buf->nkeys * sizeof(Datum));
+		buf->isnull = (bool *)
+			MemoryContextAlloc(DeferredIndexContext,
+							   buf->capacity * buf->nkeys * sizeof(bool));
+	}
+	else if (buf->nentries >= buf->capacity)
+	{
+		buf->capacity *= 2;
+		buf->tids = (ItemPointerData *)
+			repalloc(buf->tids, buf->capacity * sizeof(ItemPointerData));
+		buf->values = (Datum *)
+			repalloc(buf->values, buf->capacity * buf->nkeys * sizeof(Datum));
+		buf->isnull = (bool *)
+			repalloc(buf->isnull, buf->capacity * buf->nkeys * sizeof(bool));
+	}
+
+	oldctx = MemoryContextSwitchTo(DeferredIndexContext);
+	buf->tids[buf->nentries] = *tid;
+	for (i = 0; i < buf->nkeys; i++)
+	{
+		Form_pg_attribute att = idxDesc->attrs[i];
+		Datum	   *dst = &buf->values[buf->nentries * buf->nkeys + i];
+
+		buf->isnull[buf->nentries * buf->nkeys + i] = isnull[i];
+		if (isnull[i])
+			*dst = (Datum) 0;
+		else
+		{
+			*dst = datumCopy(values[i], att->attbyval, att->attlen);
+			if (!att->attbyval)
+				deferredIndexBytes += datumGetSize(*dst, false, att->attlen);
+		}
+		deferredIndexBytes += sizeof(Datum) + sizeof(bool);
+	}
+	deferredIndexBytes += sizeof(ItemPointerData);
+	buf->nentries += 1;
+	MemoryContextSwitchTo(oldctx);
+}
+
+/*
+ * Deferred-mode replacement for ExecInsertIndexTuples: non-unique btrees
+ * are buffered, everything else (unique, exclusion constraints, other AMs,
+ * or when the buffer table is full) is inserted immediately as usual.
+ */
+static void
+deferred_index_inserts(EState *estate, TupleTableSlot *slot)
+{
+	ResultRelInfo *relinfo = estate->es_result_relation_info;
+	Relation	heapRel = relinfo->ri_RelationDesc;
+	ItemPointer tid = &slot->tts_tuple->t_self;
+	ExprContext *econtext = GetPerTupleExprContext(estate);
+	int			i;
+
+	econtext->ecxt_scantuple = slot;
+
+	for (i = 0; i < relinfo->ri_NumIndices; i++)
+	{
+		Relation	idxRel = relinfo->ri_IndexRelationDescs[i];
+		IndexInfo  *indexInfo = relinfo->ri_IndexRelationInfo[i];
+		Datum		values[INDEX_MAX_KEYS];
+		bool		isnull[INDEX_MAX_KEYS];
+
+		if (idxRel == NULL)
+			continue;
+		if (!indexInfo->ii_ReadyForInserts)
+			continue;
+
+		/* evaluate partial-index predicate as ExecInsertIndexTuples does */
+		if (indexInfo->ii_Predicate != NIL)
+		{
+			List	   *predicate = indexInfo->ii_PredicateState;
+
+			if (predicate == NIL)
+			{
+				predicate = (List *)
+					ExecPrepareExpr((Expr *) indexInfo->ii_Predicate, estate);
+				indexInfo->ii_PredicateState = predicate;
+			}
+			if (!ExecQual(predicate, econtext, false))
+				continue;
+		}
+
+		FormIndexDatum(indexInfo, slot, estate, values, isnull);
+
+		if (!indexInfo->ii_Unique &&
+			indexInfo->ii_ExclusionOps == NULL &&
+			idxRel->rd_rel->relam == BTREE_AM_OID &&
+			(nDeferredIndexes < MAX_DEFERRED_INDEXES ||
+			 index_in_deferred_buffer(RelationGetRelid(idxRel))))
+		{
+			deferred_index_append(idxRel, heapRel, tid, values, isnull);
+		}
+		else
+		{
+			index_insert(idxRel, values, isnull, tid, heapRel,
+						 indexInfo->ii_Unique
+						 ? UNIQUE_CHECK_YES : UNIQUE_CHECK_NO);
+		}
+	}
+
+	/* keep the buffers bounded: spill them sorted when they outgrow work_mem */
+	if (deferredIndexBytes > (Size) work_mem * 1024)
+		deferred_indexes_flush();
+}
+
 static void
 UserTableUpdateIndexes(EState *estate, TupleTableSlot *slot)
 {
@@ -288,6 +851,11 @@ UserTableUpdateOpenIndexes(EState *estate, TupleTableSlot *slot)
 
 	if (estate->es_result_relation_info->ri_NumIndices > 0)
 	{
+		if (MtmDeferredIndexes)
+		{
+			deferred_index_inserts(estate, slot);
+			return;
+		}
 		recheckIndexes = ExecInsertIndexTuples(slot,
 											   &slot->tts_tuple->t_self,
 											   estate, false, NULL, NIL);
@@ -328,26 +896,107 @@ process_remote_begin(StringInfo s)
 	GlobalTransactionId gtid;
 	csn_t snapshot;
 
-	gtid.node = pq_getmsgint(s, 4); 
-	gtid.xid = pq_getmsgint(s, 4); 
-	snapshot = pq_getmsgint64(s);    
-    SetCurrentStatementStartTimestamp();     
+	gtid.node = pq_getmsgint(s, 4);
+	gtid.xid = pq_getmsgint(s, 4);
+	snapshot = pq_getmsgint64(s);
+	MtmApplyLastOrigin = gtid.node;
+
+	if (MtmApplyGroupSize > 1)
+	{
+		if (MtmApplyGroupXids == NULL)
+		{
+			MtmApplyGroupXids = (TransactionId*)
+				MemoryContextAlloc(TopMemoryContext, MtmApplyGroupSize*sizeof(TransactionId));
+			MtmApplyGroupGtids = (GlobalTransactionId*)
+				MemoryContextAlloc(TopMemoryContext, MtmApplyGroupSize*sizeof(GlobalTransactionId));
+		}
+		if (MtmApplyGroupActive
+			&& (MtmApplyGroupOrigin != gtid.node || MtmApplyGroupCount >= MtmApplyGroupSize))
+		{
+			apply_group_finish();
+		}
+		if (!MtmApplyGroupActive)
+		{
+			SetCurrentStatementStartTimestamp();
+			StartTransactionCommand();
+			replorigin_session_origin = origin_id_for_node(gtid.node);
+			if (MtmGroupApplyBegin(&gtid, snapshot))
+			{
+				MtmApplyGroupActive = true;
+				MtmApplyGroupOrigin = gtid.node;
+				MtmApplyGroupCount = 0;
+			}
+			/* else: recovery transaction, apply it as a plain transaction */
+		}
+		else
+		{
+			MtmGroupApplyJoin(&gtid, snapshot);
+		}
+		if (MtmApplyGroupActive)
+		{
+			BeginInternalSubTransaction(NULL);
+			MtmApplyGroupXids[MtmApplyGroupCount] = GetCurrentTransactionId();
+			MtmApplyGroupGtids[MtmApplyGroupCount] = gtid;
+			MTM_TRACE("REMOTE begin node=%d xid=%d snapshot=%ld group member %d\n",
+					  gtid.node, gtid.xid, snapshot, MtmApplyGroupCount);
+		}
+		return;
+	}
+
+    SetCurrentStatementStartTimestamp();
 	StartTransactionCommand();
+	replorigin_session_origin = origin_id_for_node(gtid.node);
     MtmJoinTransaction(&gtid, snapshot);
 
 	MTM_TRACE("REMOTE begin node=%d xid=%d snapshot=%ld\n", gtid.node, gtid.xid, snapshot);
 }
 
+/*
+ * Close the current apply group: vote for all its members at once, wait for
+ * the results and commit or abort the enclosing local transaction. A single
+ * rejected member aborts the whole group: apply order is resent during node
+ * recovery, so the other members will be reapplied then.
+ */
+static void
+apply_group_finish(void)
+{
+	int n = MtmApplyGroupCount;
+	csn_t maxCsn = MtmApplyGroupMaxCsn;
+
+	MtmApplyGroupActive = false;
+	MtmApplyGroupCount = 0;
+	MtmApplyGroupMaxCsn = 0;
+
+	/* complete the group's work before voting on it */
+	deferred_indexes_flush();
+
+	MtmGroupApplyVote(n, MtmApplyGroupXids, MtmApplyGroupGtids);
+	if (MtmGroupApplyWait(n, MtmApplyGroupXids))
+	{
+		CommitTransactionCommand();
+		MtmUpdateAppliedCsn(MtmApplyGroupOrigin, maxCsn);
+	}
+	else
+	{
+		elog(WARNING, "Apply group of %d transactions from node %d is aborted because voting rejected some of its members",
+			 n, MtmApplyGroupOrigin);
+		AbortCurrentTransaction();
+	}
+}
+
 static void
 read_tuple_parts(StringInfo s, Relation rel, TupleData *tup)
 {
 	TupleDesc	desc = RelationGetDescr(rel);
+	MtmApplyRelEntry *entry;
 	int			i;
 	int			rnatts;
 	char		action;
 
 	action = pq_getmsgbyte(s);
 
+	entry = MtmGetApplyRelEntry(rel);
+
 	if (action != 'T')
 		elog(ERROR, "expected TUPLE, got %c", action);
 
@@ -394,23 +1043,31 @@ read_tuple_parts(StringInfo s, Relation rel, TupleData *tup)
 				break;
 			case 's': /* send/recv format */
 				{
-					Oid typreceive;
-					Oid typioparam;
+					MtmApplyCachedAttr *catt = &entry->attrs[i];
 					StringInfoData buf;
 
 					tup->isnull[i] = false;
 					len = pq_getmsgint(s, 4); /* read length */
 
-					getTypeBinaryInputInfo(att->atttypid,
-										   &typreceive, &typioparam);
+					if (!catt->receive_valid)
+					{
+						Oid typreceive;
+
+						getTypeBinaryInputInfo(att->atttypid,
+											   &typreceive, &catt->typioparam);
+						fmgr_info_cxt(typreceive, &catt->receive_fn,
+									  MtmApplyCacheContext);
+						catt->receive_valid = true;
+					}
 
 					/* create StringInfo pointing into the bigger buffer */
 					initStringInfo(&buf);
 					/* and data */
 					buf.data = (char *) pq_getmsgbytes(s, len);
 					buf.len = len;
-					tup->values[i] = OidReceiveFunctionCall(
-						typreceive, &buf, typioparam, att->atttypmod);
+					tup->values[i] = ReceiveFunctionCall(
+						&catt->receive_fn, &buf, catt->typioparam,
+						att->atttypmod);
 
 					if (buf.len != buf.cursor)
 						ereport(ERROR,
@@ -420,17 +1077,27 @@ read_tuple_parts(StringInfo s, Relation rel, TupleData *tup)
 				}
 			case 't': /* text format */
 				{
-					Oid typinput;
-					Oid typioparam;
+					MtmApplyCachedAttr *catt = &entry->attrs[i];
 
 					tup->isnull[i] = false;
 					len = pq_getmsgint(s, 4); /* read length */
 
-					getTypeInputInfo(att->atttypid, &typinput, &typioparam);
+					if (!catt->input_valid)
+					{
+						Oid typinput;
+
+						getTypeInputInfo(att->atttypid, &typinput,
+										 &catt->typioparam);
+						fmgr_info_cxt(typinput, &catt->input_fn,
+									  MtmApplyCacheContext);
+						catt->input_valid = true;
+					}
+
 					/* and data */
 					data = (char *) pq_getmsgbytes(s, len);
-					tup->values[i] = OidInputFunctionCall(
-						typinput, (char *) data, typioparam, att->atttypmod);
+					tup->values[i] = InputFunctionCall(
+						&catt->input_fn, (char *) data, catt->typioparam,
+						att->atttypmod);
 				}
 				break;
 			default:
@@ -463,10 +1130,47 @@ read_rel(StringInfo s, LOCKMODE mode)
 	return heap_open(relid, NoLock);
 }
 
+/*
+ * Note on the visibility map: it has been proposed that apply should mark
+ * the pages it touched all-visible once the applied transaction's CSN is
+ * known to be globally durable, so that index-only scans on this node stop
+ * visiting the heap.  That is not sound.  All-visible is a property of every
+ * tuple on the page -- including dead versions left by applied updates and
+ * deletes, and tuples of other origin transactions still in flight -- not of
+ * the one transaction we just applied.  Deciding it requires the same
+ * OldestXmin page scan lazy vacuum performs (see heap_page_is_all_visible in
+ * vacuumlazy.c); a wrongly set bit makes index-only scans return deleted
+ * rows.  Keeping the VM fresh on apply nodes is therefore still vacuum's
+ * job; tune autovacuum on the receiving side rather than teaching apply to
+ * guess at page visibility.
+ */
 static void
 process_remote_commit(StringInfo s)
 {
+	csn_t csn = pq_getmsgint64(s);
+
+	if (MtmApplyGroupActive)
+	{
+		ReleaseCurrentSubTransaction();
+		MtmApplyGroupCount += 1;
+		if (csn != INVALID_CSN && csn > MtmApplyGroupMaxCsn) {
+			MtmApplyGroupMaxCsn = csn;
+		}
+		/*
+		 * Keep the group open for the next work item unless it is full or the
+		 * worker's queue has drained: an idle stream should not leave the
+		 * last transactions of a burst uncommitted.
+		 */
+		if (MtmApplyGroupCount >= MtmApplyGroupSize
+			|| !MtmMoreApplyWorkPending(MtmApplyWorkerId))
+		{
+			apply_group_finish();
+		}
+		return;
+	}
+	deferred_indexes_flush();
 	CommitTransactionCommand();
+	MtmUpdateAppliedCsn(MtmApplyLastOrigin, csn);
 }
 
 static void
@@ -542,6 +1246,9 @@ process_remote_insert(StringInfo s, Relation rel)
 		/* alert if there's more than one conflicting unique key */
 		if (found)
 		{
+			MtmLogConflict(RelationGetRelid(rel), MTM_CONFLICT_INSERT_EXISTS,
+				  format_identity_key(rel, relinfo->ri_IndexRelationDescs[i],
+									  &new_tuple));
 			/* TODO: Report tuple identity in log */
 			ereport(ERROR,
                     (errcode(ERRCODE_UNIQUE_VIOLATION),
@@ -678,6 +1385,9 @@ process_remote_update(StringInfo s, Relation rel)
 	}
 	else
 	{
+		MtmLogConflict(RelationGetRelid(rel), MTM_CONFLICT_UPDATE_MISSING,
+					   format_identity_key(rel, idxrel,
+										   pkey_sent ? &old_tuple : &new_tuple));
         ereport(ERROR,
                 (errcode(ERRCODE_NO_DATA_FOUND),
                  errmsg("Record with specified key can not be located at this node"),
@@ -755,6 +1465,8 @@ process_remote_delete(StringInfo s, Relation rel)
 	}
 	else
 	{
+		MtmLogConflict(RelationGetRelid(rel), MTM_CONFLICT_DELETE_MISSING,
+					   format_identity_key(rel, idxrel, &oldtup));
         ereport(ERROR,
                 (errcode(ERRCODE_NO_DATA_FOUND),
                  errmsg("Record with specified key can not be located at this node"),
@@ -778,6 +1490,7 @@ void MtmExecutor(int id, void* work, size_t size)
 {
     StringInfoData s;
     Relation rel = NULL;
+    MtmApplyWorkerId = id;
     initStringInfo(&s);
     s.data = work;
     s.len = size;
@@ -792,8 +1505,35 @@ void MtmExecutor(int id, void* work, size_t size)
     }
     MemoryContextSwitchTo(ApplyContext);
 
+    if (size > 1 && ((char*)work)[0] == 'F')
+    {
+        /*
+         * The receiver spilled this transaction to a file (see
+         * MtmExecuteSpilled): read it back and apply it as usual. Only this
+         * worker pays the memory for the large transaction, the receiver and
+         * the pool queue stayed bounded.
+         */
+        char const* path = (char*)work + 1;
+        struct stat st;
+        int fd = open(path, O_RDONLY|PG_BINARY, 0);
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            elog(LOG, "MtmExecutor: failed to open spill file \"%s\": %m", path);
+            if (fd >= 0) close(fd);
+            return;
+        }
+        s.data = palloc(st.st_size);
+        s.len = st.st_size;
+        if (read(fd, s.data, st.st_size) != st.st_size) {
+            elog(LOG, "MtmExecutor: failed to read spill file \"%s\": %m", path);
+            close(fd);
+            return;
+        }
+        close(fd);
+        unlink(path);
+    }
+
     PG_TRY();
-    {    
+    {
         while (true) { 
             char action = pq_getmsgbyte(&s);
             
@@ -831,10 +1571,31 @@ void MtmExecutor(int id, void* work, size_t size)
     {
         FlushErrorState();
 		MTM_TRACE("%d: REMOTE abort transaction %d\n", getpid(), GetCurrentTransactionId());
+        if (MtmApplyGroupActive)
+        {
+            /*
+             * Aborting the enclosing transaction also drops the already
+             * applied members of the group; none of them has voted yet, so
+             * for the coordinator they look like any other failed apply.
+             */
+            elog(WARNING, "Apply group of %d transactions from node %d is dropped because of apply error",
+                 MtmApplyGroupCount + 1, MtmApplyGroupOrigin);
+            MtmApplyGroupActive = false;
+            MtmApplyGroupCount = 0;
+        }
+        deferred_indexes_reset();
         AbortCurrentTransaction();
     }
     PG_END_TRY();
 
+    /*
+     * Stop tagging WAL once we are done applying on this node's behalf.  An
+     * active apply group keeps its local transaction (and hence the origin)
+     * across work items until apply_group_finish.
+     */
+    if (!MtmApplyGroupActive)
+        replorigin_session_origin = InvalidRepOriginId;
+
     MemoryContextResetAndDeleteChildren(ApplyContext);
 }
     
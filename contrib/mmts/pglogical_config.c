@@ -72,7 +72,12 @@ enum {
 	PARAM_PG_VERSION,
 	PARAM_FORWARD_CHANGESETS,
 	PARAM_HOOKS_SETUP_FUNCTION,
-	PARAM_NO_TXINFO
+	PARAM_NO_TXINFO,
+	PARAM_MTM_REPLICATION_STREAM,
+	PARAM_MTM_REPLICATION_STREAMS,
+	PARAM_MTM_CATCHUP_STREAM,
+	PARAM_MTM_CATCHUP_STREAMS,
+	PARAM_MTM_CATCHUP_UNTIL
 } OutputPluginParamKey;
 
 typedef struct {
@@ -100,6 +105,11 @@ static OutputPluginParam param_lookup[] = {
 	{"forward_changesets", PARAM_FORWARD_CHANGESETS},
 	{"hooks.setup_function", PARAM_HOOKS_SETUP_FUNCTION},
 	{"no_txinfo", PARAM_NO_TXINFO},
+	{"mtm.replication_stream", PARAM_MTM_REPLICATION_STREAM},
+	{"mtm.replication_streams", PARAM_MTM_REPLICATION_STREAMS},
+	{"mtm.catchup_stream", PARAM_MTM_CATCHUP_STREAM},
+	{"mtm.catchup_streams", PARAM_MTM_CATCHUP_STREAMS},
+	{"mtm.catchup_until", PARAM_MTM_CATCHUP_UNTIL},
 	{NULL, PARAM_UNRECOGNISED}
 };
 
@@ -251,6 +261,41 @@ process_parameters_v1(List *options, PGLogicalOutputData *data)
 				data->client_no_txinfo = DatumGetBool(val);
 				break;
 
+			case PARAM_MTM_REPLICATION_STREAM:
+				val = get_param_value(elem, false, OUTPUT_PARAM_TYPE_UINT32);
+				data->client_replication_stream = DatumGetUInt32(val);
+				break;
+
+			case PARAM_MTM_REPLICATION_STREAMS:
+				val = get_param_value(elem, false, OUTPUT_PARAM_TYPE_UINT32);
+				data->client_replication_streams = DatumGetUInt32(val);
+				break;
+
+			case PARAM_MTM_CATCHUP_STREAM:
+				val = get_param_value(elem, false, OUTPUT_PARAM_TYPE_UINT32);
+				data->client_catchup_stream = DatumGetUInt32(val);
+				break;
+
+			case PARAM_MTM_CATCHUP_STREAMS:
+				val = get_param_value(elem, false, OUTPUT_PARAM_TYPE_UINT32);
+				data->client_catchup_streams = DatumGetUInt32(val);
+				break;
+
+			case PARAM_MTM_CATCHUP_UNTIL:
+				{
+					/* LSN sent in the usual %X/%X form */
+					uint32 hi, lo;
+
+					val = get_param_value(elem, false, OUTPUT_PARAM_TYPE_STRING);
+					if (sscanf(DatumGetPointer(val), "%X/%X", &hi, &lo) != 2)
+						ereport(ERROR,
+								(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+								 errmsg("could not parse LSN in parameter \"%s\"",
+										elem->defname)));
+					data->client_catchup_until = ((uint64) hi << 32) | lo;
+				}
+				break;
+
 			case PARAM_UNRECOGNISED:
 				ereport(DEBUG1,
 						(errmsg("Unrecognised pglogical parameter %s ignored", elem->defname)));
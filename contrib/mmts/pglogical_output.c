@@ -17,6 +17,7 @@
 #include "pglogical_proto.h"
 #include "pglogical_hooks.h"
 
+#include "access/clog.h"
 #include "access/hash.h"
 #include "access/sysattr.h"
 #include "access/xact.h"
@@ -47,6 +48,8 @@
 #include "utils/syscache.h"
 #include "utils/typcache.h"
 
+#include "multimaster.h"
+
 extern void		_PG_output_plugin_init(OutputPluginCallbacks *cb);
 
 /* These must be available to pg_dlsym() */
@@ -63,6 +66,8 @@ static void pg_decode_change(LogicalDecodingContext *ctx,
 
 static bool pg_decode_origin_filter(LogicalDecodingContext *ctx,
 						RepOriginId origin_id);
+static bool pg_decode_relfilenode_filter(LogicalDecodingContext *ctx,
+						RelFileNode *relnode);
 
 static void send_startup_message(LogicalDecodingContext *ctx,
 		PGLogicalOutputData *data, bool last_message);
@@ -80,6 +85,7 @@ _PG_output_plugin_init(OutputPluginCallbacks *cb)
 	cb->change_cb = pg_decode_change;
 	cb->commit_cb = pg_decode_commit_txn;
 	cb->filter_by_origin_cb = pg_decode_origin_filter;
+	cb->filter_by_relfilenode_cb = pg_decode_relfilenode_filter;
 	cb->shutdown_cb = pg_decode_shutdown;
 }
 
@@ -489,12 +495,37 @@ pg_decode_origin_filter(LogicalDecodingContext *ctx,
 	if (!call_txn_filter_hook(data, origin_id))
 		return true;
 
+	/*
+	 * A donor feeding a recovering node forwards everything, including the
+	 * transactions it applied from other nodes, so nothing may be dropped
+	 * on origin grounds.  In normal operation the apply workers tag their
+	 * WAL with the peer's replication origin, and this test skips those
+	 * transactions before they ever enter the reorder buffer; the
+	 * csn-based check in pglogical_write_begin stays as a backstop.
+	 */
+	if (pglogical_replication_to_recovered_node(data))
+		return false;
+
 	if (!data->forward_changesets && origin_id != InvalidRepOriginId)
 		return true;
 
 	return false;
 }
 
+/*
+ * Decide if changes of a relation should be decoded at all, so changes of
+ * tables declared local with mtm.make_table_local() are dropped while
+ * reading WAL, before they are queued in the reorder buffer and spilled to
+ * disk. There is no snapshot at this point, so the decision is made on the
+ * physical relfilenode alone.
+ */
+static bool
+pg_decode_relfilenode_filter(LogicalDecodingContext *ctx,
+							 RelFileNode *relnode)
+{
+	return MtmIsLocalRelFileNode(relnode);
+}
+
 static void
 send_startup_message(LogicalDecodingContext *ctx,
 		PGLogicalOutputData *data, bool last_message)
@@ -86,6 +86,25 @@ typedef struct PGLogicalOutputData
 	bool	client_forward_changesets;
 	bool	client_no_txinfo;
 
+	/*
+	 * Parallel replication streams of one node pair: this consumer's stream
+	 * index and the total stream count. A count below 2 means the single
+	 * stream carries everything.
+	 */
+	uint32	client_replication_stream;
+	uint32	client_replication_streams;
+
+	/*
+	 * Temporary catch-up stream of one node pair: while decoding commits
+	 * below client_catchup_until, transactions are partitioned between the
+	 * regular stream (index 0) and client_catchup_streams extra streams;
+	 * beyond that LSN the regular stream again carries everything and the
+	 * extra streams go silent. A zero count or zero LSN disables the split.
+	 */
+	uint32	client_catchup_stream;
+	uint32	client_catchup_streams;
+	uint64	client_catchup_until;
+
 	/* hooks */
 	List *hooks_setup_funcname;
 	struct PGLogicalHooks hooks;
@@ -4,6 +4,7 @@
 
 #include "pglogical_output.h"
 
+#include "access/hash.h"
 #include "access/sysattr.h"
 #include "access/tuptoaster.h"
 #include "access/xact.h"
@@ -27,6 +28,8 @@
 #include "mb/pg_wchar.h"
 
 #include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
@@ -43,6 +46,21 @@ typedef struct PGLogicalProtoMM
     bool isLocal;
 } PGLogicalProtoMM;
 
+/*
+ * Cache of preformatted 'R' (relation description) messages keyed by relid.
+ * Resolving the namespace per change is a catalog lookup, and steady-state
+ * decoding keeps describing the same hot tables; the cache lives for the
+ * whole decoding session and entries are dropped on relcache invalidation.
+ */
+typedef struct RelMetaCacheEntry
+{
+    Oid   relid;
+    char* data; /* preformatted relation description message */
+    int   len;
+} RelMetaCacheEntry;
+
+static HTAB* RelMetaCache;
+
 static void pglogical_write_rel(StringInfo out, PGLogicalOutputData *data, Relation rel);
 
 static void pglogical_write_begin(StringInfo out, PGLogicalOutputData *data,
@@ -65,38 +83,112 @@ static char decide_datum_transfer(Form_pg_attribute att,
 								  bool allow_internal_basetypes,
 								  bool allow_binary_basetypes);
 
+static void
+relmeta_cache_callback(Datum arg, Oid relid)
+{
+    RelMetaCacheEntry* entry;
+
+    if (RelMetaCache == NULL)
+        return;
+
+    if (relid == InvalidOid)
+    {
+        HASH_SEQ_STATUS status;
+        hash_seq_init(&status, RelMetaCache);
+        while ((entry = (RelMetaCacheEntry*)hash_seq_search(&status)) != NULL)
+        {
+            pfree(entry->data);
+            hash_search(RelMetaCache, &entry->relid, HASH_REMOVE, NULL);
+        }
+    }
+    else
+    {
+        entry = (RelMetaCacheEntry*)hash_search(RelMetaCache, &relid, HASH_FIND, NULL);
+        if (entry != NULL)
+        {
+            pfree(entry->data);
+            hash_search(RelMetaCache, &relid, HASH_REMOVE, NULL);
+        }
+    }
+}
+
 /*
- * Write relation description to the output stream.
+ * Write relation description to the output stream, formatting it (and doing
+ * the catalog lookups it takes) only when the relation is not yet cached.
  */
 static void
 pglogical_write_rel(StringInfo out, PGLogicalOutputData *data, Relation rel)
 {
     PGLogicalProtoMM* mm = (PGLogicalProtoMM*)data->api;
-    if (!mm->isLocal) { 
-        const char *nspname;
-        uint8		nspnamelen;
-        const char *relname;
-        uint8		relnamelen;
-        
-        pq_sendbyte(out, 'R');		/* sending RELATION */
-        
-        nspname = get_namespace_name(rel->rd_rel->relnamespace);
-        if (nspname == NULL)
-            elog(ERROR, "cache lookup failed for namespace %u",
-                 rel->rd_rel->relnamespace);
-        nspnamelen = strlen(nspname) + 1;
-        
-        relname = NameStr(rel->rd_rel->relname);
-        relnamelen = strlen(relname) + 1;
-        
-        pq_sendbyte(out, nspnamelen);		/* schema name length */
-        pq_sendbytes(out, nspname, nspnamelen);
-        
-        pq_sendbyte(out, relnamelen);		/* table name length */
-        pq_sendbytes(out, relname, relnamelen);
+    if (!mm->isLocal) {
+        Oid relid = RelationGetRelid(rel);
+        RelMetaCacheEntry* entry;
+
+        if (RelMetaCache == NULL)
+        {
+            HASHCTL ctl;
+            MemSet(&ctl, 0, sizeof(ctl));
+            ctl.keysize = sizeof(Oid);
+            ctl.entrysize = sizeof(RelMetaCacheEntry);
+            ctl.hcxt = TopMemoryContext;
+            RelMetaCache = hash_create("pglogical relation metadata cache", 32,
+                                       &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+            CacheRegisterRelcacheCallback(relmeta_cache_callback, (Datum)0);
+        }
+
+        entry = (RelMetaCacheEntry*)hash_search(RelMetaCache, &relid, HASH_FIND, NULL);
+        if (entry == NULL)
+        {
+            const char *nspname;
+            uint8		nspnamelen;
+            const char *relname;
+            uint8		relnamelen;
+            char	   *msg;
+            char	   *p;
+            bool		found;
+
+            nspname = get_namespace_name(rel->rd_rel->relnamespace);
+            if (nspname == NULL)
+                elog(ERROR, "cache lookup failed for namespace %u",
+                     rel->rd_rel->relnamespace);
+            nspnamelen = strlen(nspname) + 1;
+
+            relname = NameStr(rel->rd_rel->relname);
+            relnamelen = strlen(relname) + 1;
+
+            msg = MemoryContextAlloc(TopMemoryContext, 3 + nspnamelen + relnamelen);
+            p = msg;
+            *p++ = 'R';			/* sending RELATION */
+            *p++ = nspnamelen;	/* schema name length */
+            memcpy(p, nspname, nspnamelen);
+            p += nspnamelen;
+            *p++ = relnamelen;	/* table name length */
+            memcpy(p, relname, relnamelen);
+            p += relnamelen;
+
+            entry = (RelMetaCacheEntry*)hash_search(RelMetaCache, &relid, HASH_ENTER, &found);
+            entry->data = msg;
+            entry->len = p - msg;
+        }
+
+        pq_sendbytes(out, entry->data, entry->len);
     }
 }
 
+/*
+ * Stream index a transaction is routed to while a catch-up window is open:
+ * commits below the window end are partitioned by xid hash between the
+ * regular stream (0) and the extra catch-up streams (1..N), commits beyond
+ * it all go to the regular stream again.
+ */
+static uint32
+pglogical_catchup_route(PGLogicalOutputData *data, ReorderBufferTXN *txn)
+{
+	if (txn->end_lsn >= (XLogRecPtr) data->client_catchup_until)
+		return 0;
+	return hash_uint32(txn->xid) % (data->client_catchup_streams + 1);
+}
+
 /*
  * Write BEGIN to the output stream.
  */
@@ -110,7 +202,23 @@ pglogical_write_begin(StringInfo out, PGLogicalOutputData *data,
 	MTM_TRACE("pglogical_write_begin %d CSN=%ld\n", txn->xid, csn);
     if (csn == INVALID_CSN && !isRecovery) {
         mm->isLocal = true;
-    } else { 
+    } else if (data->client_replication_streams > 1
+               && hash_uint32(txn->xid) % data->client_replication_streams
+                  != data->client_replication_stream) {
+        /*
+         * This transaction is routed through one of the sibling parallel
+         * streams of this node pair: suppress it here just like a local
+         * transaction. Partitioning by xid keeps a transaction whole on one
+         * stream.
+         */
+        mm->isLocal = true;
+    } else if (data->client_catchup_streams > 0
+               && pglogical_catchup_route(data, txn)
+                  != data->client_catchup_stream) {
+        /* Routed to another stream of the catch-up window, or the window is
+         * over and this is one of the temporary streams: suppress. */
+        mm->isLocal = true;
+    } else {
         mm->isLocal = false;        
         pq_sendbyte(out, 'B');		/* BEGIN */
 		pq_sendint(out, MtmNodeId, 4);
@@ -127,8 +235,9 @@ pglogical_write_commit(StringInfo out, PGLogicalOutputData *data,
 					   ReorderBufferTXN *txn, XLogRecPtr commit_lsn)
 {
     PGLogicalProtoMM* mm = (PGLogicalProtoMM*)data->api;
-    if (!mm->isLocal) { 
+    if (!mm->isLocal) {
         pq_sendbyte(out, 'C');		/* sending COMMIT */
+        pq_sendint64(out, MtmTransactionCsn(txn->xid)); /* origin commit CSN */
     }
 }
 
@@ -373,6 +482,18 @@ decide_datum_transfer(Form_pg_attribute att, Form_pg_type typclass,
 }
 
 
+/*
+ * Is this decoding session feeding a node that is being recovered?  A donor
+ * must forward the transactions it applied from other nodes, so no
+ * origin-based filtering may be done for it (see pg_decode_origin_filter).
+ */
+bool
+pglogical_replication_to_recovered_node(PGLogicalOutputData *data)
+{
+	PGLogicalProtoMM* mm = (PGLogicalProtoMM*)data->api;
+	return mm != NULL && MtmIsRecoveredNode(mm->nodeId);
+}
+
 PGLogicalProtoAPI *
 pglogical_init_api(PGLogicalProtoType typ)
 {
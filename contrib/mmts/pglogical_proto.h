@@ -53,5 +53,6 @@ typedef enum PGLogicalProtoType
 } PGLogicalProtoType;
 
 extern PGLogicalProtoAPI *pglogical_init_api(PGLogicalProtoType typ);
+extern bool pglogical_replication_to_recovered_node(PGLogicalOutputData *data);
 
 #endif /* PG_LOGICAL_PROTO_H */
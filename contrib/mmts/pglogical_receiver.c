@@ -22,6 +22,7 @@
 #include "access/xact.h"
 #include "access/clog.h"
 #include "access/transam.h"
+#include "common/pg_lzcompress.h"
 #include "lib/stringinfo.h"
 #include "pgstat.h"
 #include "postmaster/bgworker.h"
@@ -32,15 +33,19 @@
 #include "utils/snapmgr.h"
 #include "executor/spi.h"
 #include "replication/origin.h"
+#include "mb/pg_wchar.h"
 
 #include "multimaster.h"
 
 /* Allow load of this module in shared libs */
 
-typedef struct ReceiverArgs { 
+typedef struct ReceiverArgs {
 	int receiver_node;
+	int receiver_stream; /* which of the parallel streams of this node pair we consume */
+	bool receiver_catchup; /* temporary catch-up stream: carries its share of the
+							* backlog during a catch-up window, silent otherwise */
     char* receiver_conn_string;
-    char receiver_slot[16];
+    char receiver_slot[32];
 } ReceiverArgs;
 
 #define ERRCODE_DUPLICATE_OBJECT_STR  "42710"
@@ -210,6 +215,7 @@ pglogical_receiver_main(Datum main_arg)
 #endif
     ByteBuffer buf;
 	XLogRecPtr originStartPos;
+	XLogRecPtr catchupUntil = 0;
 
 	/* Register functions for SIGTERM/SIGHUP management */
 	pqsignal(SIGHUP, receiver_raw_sighup);
@@ -223,8 +229,9 @@ pglogical_receiver_main(Datum main_arg)
 	/* Connect to a database */
 	BackgroundWorkerInitializeConnection(MtmDatabaseName, NULL);
 
-	mode = MtmReceiverSlotMode(args->receiver_node);	
-    
+	mode = MtmReceiverSlotMode(args->receiver_node);
+	ds = MtmGetState();
+
 	/* Establish connection to remote server */
 	conn = PQconnectdb(args->receiver_conn_string);
 	if (PQstatus(conn) != CONNECTION_OK)
@@ -262,13 +269,127 @@ pglogical_receiver_main(Datum main_arg)
 	}
 	/* Start logical replication at specified position */
 	originStartPos = replorigin_session_get_progress(false);
-	appendPQExpBuffer(query, "START_REPLICATION SLOT \"%s\" LOGICAL %u/%u (\"startup_params_format\" '1', \"max_proto_version\" '%d',  \"min_proto_version\" '%d')",
+	appendPQExpBuffer(query, "START_REPLICATION SLOT \"%s\" LOGICAL %u/%u (\"startup_params_format\" '1', \"max_proto_version\" '%d',  \"min_proto_version\" '%d'",
 					  args->receiver_slot,
 					  (uint32) (originStartPos >> 32),
 					  (uint32) originStartPos,
 					  MULTIMASTER_MAX_PROTO_VERSION,
 					  MULTIMASTER_MIN_PROTO_VERSION
 		);
+	if (MtmReplicationStreams > 1)
+	{
+		/*
+		 * Ask the sender to route to us only the transactions whose xid
+		 * hashes to our stream; the sibling receivers of this node pair
+		 * cover the other streams.
+		 */
+		appendPQExpBuffer(query,
+						  ", \"mtm.replication_stream\" '%d'"
+						  ", \"mtm.replication_streams\" '%d'",
+						  args->receiver_stream,
+						  MtmReplicationStreams);
+	}
+	if (MtmCatchupStreams > 0 && MtmReplicationStreams == 1)
+	{
+		if (args->receiver_catchup)
+		{
+			/* Catch-up stream: adopt the window published by the regular receiver */
+			catchupUntil = (XLogRecPtr) pg_atomic_read_u64(&ds->catchupLsn[args->receiver_node-1]);
+		}
+		else
+		{
+			/*
+			 * Regular stream: measure how far we are behind the remote node
+			 * and, if the lag exceeds the threshold, open a catch-up window
+			 * ending at the current remote WAL position. The catch-up
+			 * receivers pick the window up from shared memory and restart
+			 * with it; their slots exist and keep advancing all the time, so
+			 * they can serve the backlog from where we stand.
+			 */
+			res = PQexec(conn, "IDENTIFY_SYSTEM");
+			if (PQresultStatus(res) == PGRES_TUPLES_OK && PQntuples(res) == 1)
+			{
+				uint32 hi, lo;
+				if (sscanf(PQgetvalue(res, 0, 2), "%X/%X", &hi, &lo) == 2)
+				{
+					XLogRecPtr remoteEnd = ((XLogRecPtr) hi << 32) | lo;
+					if (remoteEnd > originStartPos + MtmCatchupLag)
+						catchupUntil = remoteEnd;
+				}
+			}
+			PQclear(res);
+			pg_atomic_write_u64(&ds->catchupLsn[args->receiver_node-1], catchupUntil);
+			if (catchupUntil != 0)
+				ereport(LOG, (errmsg("%s: %ld bytes behind node %d, opening catch-up window until %X/%X",
+									 worker_proc, (long)(catchupUntil - originStartPos), args->receiver_node,
+									 (uint32) (catchupUntil >> 32), (uint32) catchupUntil)));
+		}
+		/*
+		 * The catch-up receivers always negotiate the split so the sender
+		 * keeps them silent outside a window; the regular receiver only does
+		 * so while a window is open.
+		 */
+		if (args->receiver_catchup || catchupUntil != 0)
+			appendPQExpBuffer(query,
+							  ", \"mtm.catchup_stream\" '%d'"
+							  ", \"mtm.catchup_streams\" '%d'"
+							  ", \"mtm.catchup_until\" '%X/%X'",
+							  args->receiver_stream,
+							  MtmCatchupStreams,
+							  (uint32) (catchupUntil >> 32),
+							  (uint32) catchupUntil);
+	}
+	if (MtmBinaryBasetypes)
+	{
+		/*
+		 * Ask the sender to transfer builtin base types in binary: either as
+		 * raw datum images ('b', requires identical architecture, verified by
+		 * the sender against the parameters below) or through send/recv
+		 * functions ('s', requires only matching major version). The sender
+		 * silently falls back to text transfer when the check fails, and
+		 * read_tuple_parts() handles all three formats, so this is always
+		 * safe to request.
+		 */
+		appendPQExpBuffer(query,
+						  ", \"binary.want_internal_basetypes\" '1'"
+						  ", \"binary.want_binary_basetypes\" '1'"
+						  ", \"binary.basetypes_major_version\" '%u'"
+						  ", \"binary.bigendian\" '%d'"
+						  ", \"binary.sizeof_datum\" '%u'"
+						  ", \"binary.sizeof_int\" '%u'"
+						  ", \"binary.sizeof_long\" '%u'"
+						  ", \"binary.float4_byval\" '%d'"
+						  ", \"binary.float8_byval\" '%d'"
+						  ", \"binary.integer_datetimes\" '%d'"
+						  ", \"expected_encoding\" '%s'",
+						  PG_VERSION_NUM / 100,
+#ifdef WORDS_BIGENDIAN
+						  1,
+#else
+						  0,
+#endif
+						  (unsigned) sizeof(Datum),
+						  (unsigned) sizeof(int),
+						  (unsigned) sizeof(long),
+#ifdef USE_FLOAT4_BYVAL
+						  1,
+#else
+						  0,
+#endif
+#ifdef USE_FLOAT8_BYVAL
+						  1,
+#else
+						  0,
+#endif
+#ifdef USE_INTEGER_DATETIMES
+						  1,
+#else
+						  0,
+#endif
+						  GetDatabaseEncodingName()
+		);
+	}
+	appendPQExpBuffer(query, ")");
 	res = PQexec(conn, query->data);
 	if (PQresultStatus(res) != PGRES_COPY_BOTH)
 	{
@@ -282,7 +403,16 @@ pglogical_receiver_main(Datum main_arg)
 
     MtmReceiverStarted(args->receiver_node);
     ByteBufferAlloc(&buf);
-	ds = MtmGetState();
+
+	/*
+	 * A catch-up stream replays a backlog; lower its origin's weight in the
+	 * apply pool so the backlog takes a reduced share of the queue and
+	 * timely transactions from the other nodes are not starved behind it.
+	 * A regular stream restores the default, since the previous incarnation
+	 * of this receiver may have been a catch-up one.
+	 */
+	BgwPoolSetOriginWeight(&ds->pool, args->receiver_node,
+						   args->receiver_catchup ? 1 : BGWPOOL_DEFAULT_ORIGIN_WEIGHT);
 
 	while (!got_sigterm)
 	{
@@ -314,6 +444,20 @@ pglogical_receiver_main(Datum main_arg)
 		if (rc & WL_POSTMASTER_DEATH)
 			proc_exit(1);
 
+		/*
+		 * If the regular receiver has published a window different from the
+		 * one we negotiated with the sender, restart to renegotiate the
+		 * split. After a window is drained no restart happens: the sender
+		 * simply stops routing anything to us.
+		 */
+		if (args->receiver_catchup
+			&& pg_atomic_read_u64(&ds->catchupLsn[args->receiver_node-1]) != catchupUntil)
+		{
+			ereport(LOG, (errmsg("%s: catch-up window changed, restarting",
+								 worker_proc)));
+			proc_exit(1);
+		}
+
 		/* Some cleanup */
 		if (copybuf != NULL)
 		{
@@ -327,7 +471,10 @@ pglogical_receiver_main(Datum main_arg)
 		while (true)
 		{
 			XLogRecPtr  walEnd;
+			int64       sendTime;
             char* stmt;
+			char* decompressed;
+			int stmt_len;
 
 			rc = PQgetCopyData(conn, &copybuf, 1);
 			if (rc <= 0) {
@@ -357,7 +504,8 @@ pglogical_receiver_main(Datum main_arg)
 				 */
 				walEnd = fe_recvint64(&copybuf[pos]);
 				pos += 8;	/* read walEnd */
-				pos += 8;	/* skip sendTime */
+				sendTime = fe_recvint64(&copybuf[pos]);
+				pos += 8;	/* read sendTime */
 				if (rc < pos + 1)
 				{
 					ereport(LOG, (errmsg("%s: streaming header too small: %d",
@@ -371,6 +519,9 @@ pglogical_receiver_main(Datum main_arg)
 				output_fsync_lsn = output_written_lsn;
 				output_applied_lsn = output_written_lsn;
 
+				MtmUpdateReceiverStats(args->receiver_node, output_written_lsn,
+									   sendTime, feGetCurrentTimestamp());
+
 				/*
 				 * If the server requested an immediate reply, send one.
 				 * If sync mode is sent reply in all cases to ensure that
@@ -386,7 +537,7 @@ pglogical_receiver_main(Datum main_arg)
 				}
 				continue;
 			}
-			else if (copybuf[0] != 'w')
+			else if (copybuf[0] != 'w' && copybuf[0] != 'z')
 			{
 				ereport(LOG, (errmsg("%s: Incorrect streaming header",
 									 worker_proc)));
@@ -394,26 +545,70 @@ pglogical_receiver_main(Datum main_arg)
 			}
 
 			/* Now fetch the data */
-			hdr_len = 1;		/* msgtype 'w' */
+			hdr_len = 1;		/* msgtype 'w' or 'z' */
 			fe_recvint64(&copybuf[hdr_len]);
 			hdr_len += 8;		/* dataStart */
 			walEnd = fe_recvint64(&copybuf[hdr_len]);
 			hdr_len += 8;		/* WALEnd */
+			sendTime = fe_recvint64(&copybuf[hdr_len]);
 			hdr_len += 8;		/* sendTime */
 
+			if (copybuf[0] == 'z')
+			{
+				/*
+				 * Compressed variant, sent when we set wal_sender_compression
+				 * on this connection: raw payload length, then the payload
+				 * compressed with pglz.
+				 */
+				int32 raw_len;
+
+				raw_len = ((int32) (unsigned char) copybuf[hdr_len] << 24) |
+					((int32) (unsigned char) copybuf[hdr_len + 1] << 16) |
+					((int32) (unsigned char) copybuf[hdr_len + 2] << 8) |
+					((int32) (unsigned char) copybuf[hdr_len + 3]);
+				hdr_len += 4;	/* rawLen */
+
+				if (raw_len <= 0 || rc <= hdr_len)
+				{
+					ereport(LOG, (errmsg("%s: Invalid compressed message",
+										 worker_proc)));
+					proc_exit(1);
+				}
+
+				decompressed = palloc(raw_len);
+				if (pglz_decompress(copybuf + hdr_len, rc - hdr_len,
+									decompressed, raw_len) != raw_len)
+				{
+					ereport(LOG, (errmsg("%s: Failed to decompress message",
+										 worker_proc)));
+					proc_exit(1);
+				}
+				stmt_len = raw_len;
+			}
+			else
+			{
+				decompressed = NULL;
+				stmt_len = rc - hdr_len;
+			}
+
 			/*ereport(LOG, (errmsg("%s: receive message %c length %d", worker_proc, copybuf[hdr_len], rc - hdr_len)));*/
 
             Assert(rc >= hdr_len);
 
-			if (rc > hdr_len)
+			if (stmt_len > 0)
 			{
-                stmt = copybuf + hdr_len;
+                stmt = decompressed ? decompressed : copybuf + hdr_len;
            
 #ifdef USE_PGLOGICAL_OUTPUT
-                ByteBufferAppend(&buf, stmt, rc - hdr_len);
+                ByteBufferAppend(&buf, stmt, stmt_len);
                 if (stmt[0] == 'C') /* commit */
-                { 
-                    MtmExecute(buf.data, buf.used);
+                {
+                    if (ByteBufferIsSpilled(&buf)) {
+                        /* large transaction spilled to disk: hand the file over */
+                        MtmExecuteSpilled(args->receiver_node, ByteBufferSpillFinish(&buf));
+                    } else {
+                        MtmExecute(buf.data, buf.used);
+                    }
                     ByteBufferReset(&buf);
                 }
 #else
@@ -433,14 +628,19 @@ pglogical_receiver_main(Datum main_arg)
                     insideTrans = false;
                 } else {
                     Assert(insideTrans);
-                    ByteBufferAppend(&buf, stmt, rc - hdr_len/*strlen(stmt)*/);
+                    ByteBufferAppend(&buf, stmt, stmt_len/*strlen(stmt)*/);
                 }
 #endif
             }
+			if (decompressed != NULL)
+				pfree(decompressed);
 			/* Update written position */
 			output_written_lsn = Max(walEnd, output_written_lsn);
 			output_fsync_lsn = output_written_lsn;
 			output_applied_lsn = output_written_lsn;
+
+			MtmUpdateReceiverStats(args->receiver_node, output_written_lsn,
+								   sendTime, feGetCurrentTimestamp());
 		}
 
 		/* No data, move to next loop */
@@ -550,7 +750,17 @@ int MtmStartReceivers(char* conns, int node_id)
             p = conn_str_end;
         }
         if (++i != node_id) {
-            ReceiverArgs* ctx = (ReceiverArgs*)malloc(sizeof(ReceiverArgs));
+            int stream;
+            int nStreams = MtmReplicationStreams;
+            /*
+             * With a single regular stream, also register the temporary
+             * catch-up receivers. They run permanently so that their slots
+             * exist and keep advancing, which is what allows them to serve
+             * the backlog when a catch-up window opens; outside a window
+             * the sender routes nothing to them.
+             */
+            if (MtmReplicationStreams == 1 && MtmCatchupStreams > 0)
+                nStreams += MtmCatchupStreams;
             if (MtmDatabaseName == NULL) {
                 char* dbname = strstr(conn_str, "dbname=");
                 char* eon;
@@ -563,15 +773,38 @@ int MtmStartReceivers(char* conns, int node_id)
                 memcpy(MtmDatabaseName, dbname, len);
                 MtmDatabaseName[len] = '\0';
             }
-            ctx->receiver_conn_string = psprintf("replication=database %.*s", (int)(p - conn_str), conn_str);
-            sprintf(ctx->receiver_slot, "mtm_slot_%d", node_id);
-            ctx->receiver_node = node_id;
-
-            /* Worker parameter and registration */
-            snprintf(worker.bgw_name, BGW_MAXLEN, "mtm_worker_%d_%d", node_id, i);
-            
-            worker.bgw_main_arg = (Datum)ctx;
-            RegisterBackgroundWorker(&worker);
+            /*
+             * One receiver (and so one walsender and one slot at the remote
+             * node) per parallel stream of this node pair. With a single
+             * stream the slot keeps its old name.
+             */
+            for (stream = 0; stream < nStreams; stream++) {
+                ReceiverArgs* ctx = (ReceiverArgs*)malloc(sizeof(ReceiverArgs));
+                /*
+                 * Setting wal_sender_compression on the connection tells the
+                 * remote walsender that we can decode compressed ('z') stream
+                 * messages, and asks it to send them.
+                 */
+                ctx->receiver_conn_string = psprintf("replication=database %s %.*s",
+                                                     MtmUseWalCompression
+                                                     ? "options='-c wal_sender_compression=on'"
+                                                     : "",
+                                                     (int)(p - conn_str), conn_str);
+                if (stream == 0) {
+                    sprintf(ctx->receiver_slot, "mtm_slot_%d", node_id);
+                } else {
+                    sprintf(ctx->receiver_slot, "mtm_slot_%d_%d", node_id, stream);
+                }
+                ctx->receiver_node = node_id;
+                ctx->receiver_stream = stream;
+                ctx->receiver_catchup = stream >= MtmReplicationStreams;
+
+                /* Worker parameter and registration */
+                snprintf(worker.bgw_name, BGW_MAXLEN, "mtm_worker_%d_%d_%d", node_id, i, stream);
+
+                worker.bgw_main_arg = (Datum)ctx;
+                RegisterBackgroundWorker(&worker);
+            }
         }
         conn_str = p + 1;
     }
@@ -0,0 +1,28 @@
+/* contrib/pg_buffercache/pg_buffercache--1.1--1.2.sql */
+
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION pg_buffercache UPDATE TO '1.2'" to load this file. \quit
+
+-- Low-overhead inspection functions.  Unlike pg_buffercache_pages() these
+-- take no locks at all, so individual rows can occasionally be torn, but
+-- they never stall the buffer manager.
+CREATE FUNCTION pg_buffercache_sample(IN sample_size integer,
+    OUT bufferid integer, OUT relfilenode oid, OUT reltablespace oid,
+    OUT reldatabase oid, OUT relforknumber int2, OUT relblocknumber int8,
+    OUT isdirty bool, OUT usagecount int2, OUT pinning_backends int4)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_buffercache_sample'
+LANGUAGE C;
+
+CREATE FUNCTION pg_buffercache_pages_range(IN first_buffer integer,
+    IN nbuffers integer,
+    OUT bufferid integer, OUT relfilenode oid, OUT reltablespace oid,
+    OUT reldatabase oid, OUT relforknumber int2, OUT relblocknumber int8,
+    OUT isdirty bool, OUT usagecount int2, OUT pinning_backends int4)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_buffercache_pages_range'
+LANGUAGE C;
+
+-- Don't want these to be available to public.
+REVOKE ALL ON FUNCTION pg_buffercache_sample(integer) FROM PUBLIC;
+REVOKE ALL ON FUNCTION pg_buffercache_pages_range(integer, integer) FROM PUBLIC;
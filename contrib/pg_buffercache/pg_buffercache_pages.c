@@ -148,11 +148,12 @@ pg_buffercache_pages(PG_FUNCTION_ARGS)
 		 */
 		for (i = 0; i < NBuffers; i++)
 		{
-			volatile BufferDesc *bufHdr;
+			BufferDesc *bufHdr;
+			uint32		buf_state;
 
 			bufHdr = GetBufferDescriptor(i);
 			/* Lock each buffer header before inspecting. */
-			LockBufHdr(bufHdr);
+			buf_state = LockBufHdr(bufHdr);
 
 			fctx->record[i].bufferid = BufferDescriptorGetBuffer(bufHdr);
 			fctx->record[i].relfilenode = bufHdr->tag.rnode.relNode;
@@ -160,21 +161,21 @@ pg_buffercache_pages(PG_FUNCTION_ARGS)
 			fctx->record[i].reldatabase = bufHdr->tag.rnode.dbNode;
 			fctx->record[i].forknum = bufHdr->tag.forkNum;
 			fctx->record[i].blocknum = bufHdr->tag.blockNum;
-			fctx->record[i].usagecount = bufHdr->usage_count;
-			fctx->record[i].pinning_backends = bufHdr->refcount;
+			fctx->record[i].usagecount = BUF_STATE_GET_USAGECOUNT(buf_state);
+			fctx->record[i].pinning_backends = BUF_STATE_GET_REFCOUNT(buf_state);
 
-			if (bufHdr->flags & BM_DIRTY)
+			if (buf_state & BM_DIRTY)
 				fctx->record[i].isdirty = true;
 			else
 				fctx->record[i].isdirty = false;
 
 			/* Note if the buffer is valid, and has storage created */
-			if ((bufHdr->flags & BM_VALID) && (bufHdr->flags & BM_TAG_VALID))
+			if ((buf_state & BM_VALID) && (buf_state & BM_TAG_VALID))
 				fctx->record[i].isvalid = true;
 			else
 				fctx->record[i].isvalid = false;
 
-			UnlockBufHdr(bufHdr);
+			UnlockBufHdr(bufHdr, buf_state);
 		}
 
 		/*
@@ -249,3 +250,217 @@ pg_buffercache_pages(PG_FUNCTION_ARGS)
 	else
 		SRF_RETURN_DONE(funcctx);
 }
+
+/*
+ * Read the fields of one buffer header without taking any locks.
+ *
+ * Because we take neither the buffer mapping locks nor the buffer header
+ * lock, a concurrently changing buffer can yield a torn result: the tag
+ * may be mid-update and disagree with the state word, or the usage count
+ * may be off by one.  For monitoring purposes a rare bogus row is harmless
+ * and vastly preferable to freezing the whole buffer manager, which is
+ * exactly what pg_buffercache_pages() does on large shared_buffers
+ * settings.
+ */
+static void
+pg_buffercache_snap_buffer(int i, BufferCachePagesRec *rec)
+{
+	BufferDesc *bufHdr = GetBufferDescriptor(i);
+	uint32		buf_state;
+
+	rec->bufferid = BufferDescriptorGetBuffer(bufHdr);
+	rec->relfilenode = bufHdr->tag.rnode.relNode;
+	rec->reltablespace = bufHdr->tag.rnode.spcNode;
+	rec->reldatabase = bufHdr->tag.rnode.dbNode;
+	rec->forknum = bufHdr->tag.forkNum;
+	rec->blocknum = bufHdr->tag.blockNum;
+
+	buf_state = pg_atomic_read_u32(&bufHdr->state);
+	rec->usagecount = BUF_STATE_GET_USAGECOUNT(buf_state);
+	rec->pinning_backends = BUF_STATE_GET_REFCOUNT(buf_state);
+	rec->isdirty = (buf_state & BM_DIRTY) != 0;
+	rec->isvalid = (buf_state & BM_VALID) != 0 &&
+		(buf_state & BM_TAG_VALID) != 0;
+}
+
+/*
+ * Set up the cross-call context for the sampling functions.  Unlike
+ * pg_buffercache_pages() we don't need to cope with pre-1.2 row types here,
+ * so the declared result type can be used as is.
+ */
+static BufferCachePagesContext *
+pg_buffercache_init_context(FunctionCallInfo fcinfo,
+							FuncCallContext *funcctx, int nrecords)
+{
+	BufferCachePagesContext *fctx;
+	TupleDesc	tupledesc;
+	MemoryContext oldcontext;
+
+	oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+	fctx = (BufferCachePagesContext *) palloc(sizeof(BufferCachePagesContext));
+
+	if (get_call_result_type(fcinfo, NULL, &tupledesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	fctx->tupdesc = BlessTupleDesc(tupledesc);
+	fctx->record = (BufferCachePagesRec *)
+		palloc(sizeof(BufferCachePagesRec) * Max(nrecords, 1));
+
+	funcctx->max_calls = nrecords;
+	funcctx->user_fctx = fctx;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	return fctx;
+}
+
+/*
+ * Form a result tuple from one saved record; shared by the sampling
+ * functions, which always deal in the full 1.2 row type.
+ */
+static HeapTuple
+pg_buffercache_form_record(BufferCachePagesContext *fctx, uint32 i)
+{
+	Datum		values[NUM_BUFFERCACHE_PAGES_ELEM];
+	bool		nulls[NUM_BUFFERCACHE_PAGES_ELEM];
+
+	values[0] = Int32GetDatum(fctx->record[i].bufferid);
+	nulls[0] = false;
+
+	/*
+	 * Set all fields except the bufferid to null if the buffer is unused or
+	 * not valid.
+	 */
+	if (fctx->record[i].blocknum == InvalidBlockNumber ||
+		fctx->record[i].isvalid == false)
+	{
+		int			j;
+
+		for (j = 1; j < NUM_BUFFERCACHE_PAGES_ELEM; j++)
+			nulls[j] = true;
+	}
+	else
+	{
+		values[1] = ObjectIdGetDatum(fctx->record[i].relfilenode);
+		nulls[1] = false;
+		values[2] = ObjectIdGetDatum(fctx->record[i].reltablespace);
+		nulls[2] = false;
+		values[3] = ObjectIdGetDatum(fctx->record[i].reldatabase);
+		nulls[3] = false;
+		values[4] = ObjectIdGetDatum(fctx->record[i].forknum);
+		nulls[4] = false;
+		values[5] = Int64GetDatum((int64) fctx->record[i].blocknum);
+		nulls[5] = false;
+		values[6] = BoolGetDatum(fctx->record[i].isdirty);
+		nulls[6] = false;
+		values[7] = Int16GetDatum(fctx->record[i].usagecount);
+		nulls[7] = false;
+		values[8] = Int32GetDatum(fctx->record[i].pinning_backends);
+		nulls[8] = false;
+	}
+
+	return heap_form_tuple(fctx->tupdesc, values, nulls);
+}
+
+/*
+ * Inspect an evenly spaced, randomly offset sample of the buffer cache
+ * without taking any locks.  Statistics derived from the sample (cache
+ * contents per relation, dirty fraction, usage count distribution) can be
+ * scaled up by NBuffers / sample_size.
+ */
+PG_FUNCTION_INFO_V1(pg_buffercache_sample);
+
+Datum
+pg_buffercache_sample(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	BufferCachePagesContext *fctx;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		int			sample_size = PG_GETARG_INT32(0);
+		int			stride;
+		int			start;
+		int			i;
+
+		if (sample_size <= 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("sample size must be positive")));
+		if (sample_size > NBuffers)
+			sample_size = NBuffers;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		fctx = pg_buffercache_init_context(fcinfo, funcctx, sample_size);
+
+		/*
+		 * Systematic sampling: a random offset plus a fixed stride gives
+		 * distinct buffers and even coverage of the cache, and successive
+		 * calls look at different subsets.
+		 */
+		stride = NBuffers / sample_size;
+		start = random() % stride;
+
+		for (i = 0; i < sample_size; i++)
+			pg_buffercache_snap_buffer(start + i * stride, &fctx->record[i]);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	fctx = funcctx->user_fctx;
+
+	if (funcctx->call_cntr < funcctx->max_calls)
+		SRF_RETURN_NEXT(funcctx,
+						HeapTupleGetDatum(pg_buffercache_form_record(fctx,
+													funcctx->call_cntr)));
+	else
+		SRF_RETURN_DONE(funcctx);
+}
+
+/*
+ * Inspect the buffers with ids in [first_buffer, first_buffer + nbuffers)
+ * without taking any locks.  Monitoring can walk the whole cache in small
+ * slices over many calls instead of freezing it in one big one.
+ */
+PG_FUNCTION_INFO_V1(pg_buffercache_pages_range);
+
+Datum
+pg_buffercache_pages_range(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	BufferCachePagesContext *fctx;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		int			first_buffer = PG_GETARG_INT32(0);
+		int			nbuffers = PG_GETARG_INT32(1);
+		int			i;
+
+		/* Buffer ids are 1-based */
+		if (first_buffer < 1 || nbuffers < 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("invalid buffer range")));
+		if (first_buffer > NBuffers)
+			nbuffers = 0;
+		else if (nbuffers > NBuffers - (first_buffer - 1))
+			nbuffers = NBuffers - (first_buffer - 1);
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		fctx = pg_buffercache_init_context(fcinfo, funcctx, nbuffers);
+
+		for (i = 0; i < nbuffers; i++)
+			pg_buffercache_snap_buffer(first_buffer - 1 + i,
+									   &fctx->record[i]);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	fctx = funcctx->user_fctx;
+
+	if (funcctx->call_cntr < funcctx->max_calls)
+		SRF_RETURN_NEXT(funcctx,
+						HeapTupleGetDatum(pg_buffercache_form_record(fctx,
+													funcctx->call_cntr)));
+	else
+		SRF_RETURN_DONE(funcctx);
+}
@@ -20,3 +20,18 @@ LANGUAGE C;
 CREATE FUNCTION dtm_get_current_snapshot_xcnt() RETURNS integer
 AS 'MODULE_PATHNAME','dtm_get_current_snapshot_xcnt'
 LANGUAGE C;
+
+-- Cluster-wide sequence: returns values unique across all nodes for a given
+-- name, without touching any local sequence relation. Values are leased from
+-- the arbiter in blocks of dtm.sequence_reserve and served from a
+-- backend-local cache, so they are increasing but have gaps where the blocks
+-- of different backends and nodes interleave, like cached local sequences.
+CREATE FUNCTION dtm_nextval(sequence_name text) RETURNS bigint
+AS 'MODULE_PATHNAME','dtm_nextval'
+LANGUAGE C;
+
+-- Writes this backend's recent arbiter round-trip timings to the server log,
+-- for correlation with the arbiter daemon's flight recorder (SIGUSR1).
+CREATE FUNCTION dtm_dump_trace() RETURNS void
+AS 'MODULE_PATHNAME','dtm_dump_trace'
+LANGUAGE C;
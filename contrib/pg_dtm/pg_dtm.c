@@ -8,6 +8,9 @@
 #include <unistd.h>
 #include <sys/time.h>
 #include <time.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "postgres.h"
 #include "fmgr.h"
@@ -29,6 +32,7 @@
 #include "storage/proc.h"
 #include "storage/procarray.h"
 #include "access/twophase.h"
+#include "access/hash.h"
 #include <utils/guc.h>
 #include "utils/hsearch.h"
 #include "utils/tqual.h"
@@ -45,6 +49,25 @@
 #include "sockhub.h"
 #include "arbiter.h"
 
+#define MAX_SNAPSHOT_BATCH 64
+#define DTM_BATCH_XIP_SIZE 1024
+
+typedef enum
+{
+	DTM_SLOT_FREE,     /* slot is not in use */
+	DTM_SLOT_PENDING,  /* backend is waiting for the next batch to be sent */
+	DTM_SLOT_INFLIGHT, /* request was included in the batch being executed */
+	DTM_SLOT_DONE      /* result is available in the shared buffer */
+} DtmSnapshotSlotState;
+
+typedef struct
+{
+	DtmSnapshotSlotState state;
+	TransactionId xid;
+	Latch* latch;   /* procLatch of the waiting backend */
+	bool failed;    /* backend should fall back to a direct request */
+} DtmSnapshotSlot;
+
 typedef struct
 {
 	LWLockId hashLock;
@@ -52,6 +75,18 @@ typedef struct
 	TransactionId minXid;  /* XID of oldest transaction visible by any active transaction (local or global) */
 	TransactionId nextXid; /* next XID for local transaction */
 	size_t nReservedXids;  /* number of XIDs reserved for local transactions */
+
+	/* State of snapshot request batching, protected by batchLock */
+	LWLockId batchLock;
+	bool batchInProgress;   /* a leader is currently talking to the arbiter */
+	int  nBatchReaders;     /* DONE slots which have not yet consumed the result */
+	Latch* batchLeaderLatch;/* latch of a leader waiting for readers to drain */
+	DtmSnapshotSlot batchSlots[MAX_SNAPSHOT_BATCH];
+	TransactionId batchGxmin;
+	TransactionId batchXmin;
+	TransactionId batchXmax;
+	int batchXcnt;
+	TransactionId batchXip[DTM_BATCH_XIP_SIZE];
 } DtmState;
 
 typedef struct
@@ -69,8 +104,10 @@ void _PG_init(void);
 void _PG_fini(void);
 
 static Snapshot DtmGetSnapshot(Snapshot snapshot);
+static void DtmGetGlobalSnapshot(TransactionId xid, Snapshot snapshot, TransactionId *gxmin);
 static void DtmMergeWithGlobalSnapshot(Snapshot snapshot);
 static XidStatus DtmGetTransactionStatus(TransactionId xid, XLogRecPtr *lsn);
+static void DtmGetTransactionStatusBulk(int nxids, TransactionId *xids, XidStatus *statuses, XLogRecPtr *lsns);
 static void DtmSetTransactionStatus(TransactionId xid, int nsubxids, TransactionId *subxids, XidStatus status, XLogRecPtr lsn);
 static void DtmUpdateRecentXmin(Snapshot snapshot);
 static void DtmInitialize(void);
@@ -107,6 +144,7 @@ static SnapshotData DtmSnapshot = { HeapTupleSatisfiesMVCC };
 static bool DtmHasGlobalSnapshot;
 static bool DtmGlobalXidAssigned;
 static int DtmLocalXidReserve;
+static int DtmSequenceReserve;
 static CommandId DtmCurcid;
 static Snapshot DtmLastSnapshot;
 static TransactionManager DtmTM = {
@@ -119,12 +157,14 @@ static TransactionManager DtmTM = {
 	DtmGetGlobalTransactionId,
 	PgXidInMVCCSnapshot,
     DtmDetectGlobalDeadLock,
-	DtmGetName
+	DtmGetName,
+	DtmGetTransactionStatusBulk
 };
 
 static char *Arbiters;
 static char *ArbitersCopy;
 static int DtmBufferSize;
+static int DtmSnapshotBatchSize;
 
 static BackgroundWorker DtmWorker = {
 	"DtmWorker",
@@ -165,11 +205,37 @@ static void DumpSnapshot(Snapshot s, char *name)
 	XTM_INFO("%s\n", buf);
 }
 
-/* In snapshots provided by DTMD xip array is sorted, so we can use bsearch */
+/* Snapshots smaller than this are scanned linearly (vectorized when possible) */
+#define DTM_LINEAR_SEARCH_LIMIT 128
+
+/* In snapshots provided by DTMD xip array is sorted, so we can use bsearch.
+ * But for the typical snapshot sizes a branchless linear scan comparing four
+ * xids at once is cheaper than the data-dependent branches of a binary
+ * search, so bsearch is reserved for huge snapshots.
+ */
 static bool TransactionIdIsInSnapshot(TransactionId xid, Snapshot snapshot)
 {
-	return xid >= snapshot->xmax
-		|| bsearch(&xid, snapshot->xip, snapshot->xcnt, sizeof(TransactionId), xidComparator) != NULL;
+	if (xid >= snapshot->xmax)
+		return true;
+#ifdef __SSE2__
+	if (snapshot->xcnt <= DTM_LINEAR_SEARCH_LIMIT)
+	{
+		__m128i needle = _mm_set1_epi32((int)xid);
+		int n = snapshot->xcnt & ~3;
+		int i;
+		for (i = 0; i < n; i += 4)
+		{
+			__m128i chunk = _mm_loadu_si128((__m128i const*)(snapshot->xip + i));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(needle, chunk)))
+				return true;
+		}
+		for (; i < snapshot->xcnt; i++)
+			if (snapshot->xip[i] == xid)
+				return true;
+		return false;
+	}
+#endif
+	return bsearch(&xid, snapshot->xip, snapshot->xcnt, sizeof(TransactionId), xidComparator) != NULL;
 }
 
 /* Transaction is considered as in-doubt if it is globally committed by DTMD but local commit is not yet completed.
@@ -601,6 +667,183 @@ DtmGetNewTransactionId(bool isSubXact)
 	return xid;
 }
 
+/*
+ * Mark the listed in-flight requests as completed and wake up their backends.
+ * If the batch failed, the waiters retry with a direct request instead of
+ * using the shared result buffer. If more requests arrived while the batch was
+ * in progress, elect one of them as the leader of the next batch.
+ * Caller must hold batchLock.
+ */
+static void DtmWakeupBatchWaiters(int* ids, int n, bool failed)
+{
+	int i;
+	for (i = 0; i < n; i++)
+	{
+		dtm->batchSlots[ids[i]].failed = failed;
+		dtm->batchSlots[ids[i]].state = DTM_SLOT_DONE;
+		SetLatch(dtm->batchSlots[ids[i]].latch);
+	}
+	dtm->nBatchReaders = n;
+	dtm->batchInProgress = false;
+	for (i = 0; i < MAX_SNAPSHOT_BATCH; i++)
+	{
+		if (dtm->batchSlots[i].state == DTM_SLOT_PENDING)
+		{
+			SetLatch(dtm->batchSlots[i].latch);
+			break;
+		}
+	}
+}
+
+/*
+ * Get a global snapshot for the given xid from the arbiter.
+ * When dtm.snapshot_batch_size is greater than one, concurrent requests from
+ * different backends of this node are coalesced into a single arbiter round
+ * trip: the first backend to arrive becomes the leader and sends the xids of
+ * all backends queued behind it in one CMD_SNAPSHOT_BATCH message, then
+ * distributes the returned snapshot to them through shared memory. While the
+ * leader is busy, newcomers queue up and form the next batch, so under load
+ * the number of round trips is determined by the arbiter latency rather than
+ * by the number of backends.
+ */
+static void DtmGetGlobalSnapshot(TransactionId xid, Snapshot snapshot, TransactionId *gxmin)
+{
+	TransactionId xids[MAX_SNAPSHOT_BATCH];
+	int ids[MAX_SNAPSHOT_BATCH];
+	TransactionId batchGxmin;
+	int mySlot = -1;
+	int n, i;
+	bool ok;
+
+	if (DtmSnapshotBatchSize <= 1)
+	{
+		ArbiterGetSnapshot(xid, snapshot, gxmin);
+		return;
+	}
+
+	LWLockAcquire(dtm->batchLock, LW_EXCLUSIVE);
+	while (dtm->batchInProgress)
+	{
+		if (mySlot < 0)
+		{
+			for (i = 0; i < MAX_SNAPSHOT_BATCH; i++)
+			{
+				if (dtm->batchSlots[i].state == DTM_SLOT_FREE)
+				{
+					mySlot = i;
+					break;
+				}
+			}
+			if (mySlot < 0)
+			{
+				/* All slots are busy: do not wait, just ask the arbiter directly */
+				LWLockRelease(dtm->batchLock);
+				ArbiterGetSnapshot(xid, snapshot, gxmin);
+				return;
+			}
+			dtm->batchSlots[mySlot].state = DTM_SLOT_PENDING;
+			dtm->batchSlots[mySlot].xid = xid;
+			dtm->batchSlots[mySlot].latch = MyLatch;
+			dtm->batchSlots[mySlot].failed = false;
+		}
+		LWLockRelease(dtm->batchLock);
+		WaitLatch(MyLatch, WL_LATCH_SET | WL_POSTMASTER_DEATH, 0);
+		ResetLatch(MyLatch);
+		LWLockAcquire(dtm->batchLock, LW_EXCLUSIVE);
+		if (mySlot >= 0 && dtm->batchSlots[mySlot].state == DTM_SLOT_DONE)
+		{
+			/* The leader has fetched a snapshot on our behalf */
+			bool failed = dtm->batchSlots[mySlot].failed;
+			if (!failed)
+			{
+				ArbiterInitSnapshot(snapshot);
+				snapshot->xmin = dtm->batchXmin;
+				snapshot->xmax = dtm->batchXmax;
+				snapshot->xcnt = dtm->batchXcnt;
+				memcpy(snapshot->xip, dtm->batchXip, dtm->batchXcnt*sizeof(TransactionId));
+				*gxmin = dtm->batchGxmin;
+			}
+			dtm->batchSlots[mySlot].state = DTM_SLOT_FREE;
+			if (--dtm->nBatchReaders == 0 && dtm->batchLeaderLatch)
+				SetLatch(dtm->batchLeaderLatch);
+			LWLockRelease(dtm->batchLock);
+			if (failed)
+				ArbiterGetSnapshot(xid, snapshot, gxmin);
+			return;
+		}
+	}
+
+	/* Become the leader of the next batch */
+	dtm->batchInProgress = true;
+	if (mySlot >= 0)
+	{
+		/* We were queued but got elected instead: our request goes with the batch anyway */
+		dtm->batchSlots[mySlot].state = DTM_SLOT_FREE;
+		mySlot = -1;
+	}
+
+	/* Wait until readers of the previous batch have consumed its result */
+	dtm->batchLeaderLatch = MyLatch;
+	while (dtm->nBatchReaders > 0)
+	{
+		LWLockRelease(dtm->batchLock);
+		WaitLatch(MyLatch, WL_LATCH_SET | WL_POSTMASTER_DEATH, 0);
+		ResetLatch(MyLatch);
+		LWLockAcquire(dtm->batchLock, LW_EXCLUSIVE);
+	}
+	dtm->batchLeaderLatch = NULL;
+
+	/* Collect the requests queued by other backends */
+	n = 0;
+	for (i = 0; i < MAX_SNAPSHOT_BATCH && n < DtmSnapshotBatchSize-1; i++)
+	{
+		if (dtm->batchSlots[i].state == DTM_SLOT_PENDING)
+		{
+			dtm->batchSlots[i].state = DTM_SLOT_INFLIGHT;
+			ids[n] = i;
+			xids[n++] = dtm->batchSlots[i].xid;
+		}
+	}
+	xids[n] = xid; /* the leader's own request goes last */
+	LWLockRelease(dtm->batchLock);
+
+	PG_TRY();
+	{
+		ok = ArbiterGetSnapshotBatch(xids, n+1, snapshot, &batchGxmin);
+	}
+	PG_CATCH();
+	{
+		/* Do not leave the waiters hanging on a half-done batch */
+		LWLockAcquire(dtm->batchLock, LW_EXCLUSIVE);
+		DtmWakeupBatchWaiters(ids, n, true);
+		LWLockRelease(dtm->batchLock);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	LWLockAcquire(dtm->batchLock, LW_EXCLUSIVE);
+	if (ok && snapshot->xcnt <= DTM_BATCH_XIP_SIZE)
+	{
+		dtm->batchGxmin = batchGxmin;
+		dtm->batchXmin = snapshot->xmin;
+		dtm->batchXmax = snapshot->xmax;
+		dtm->batchXcnt = snapshot->xcnt;
+		memcpy(dtm->batchXip, snapshot->xip, snapshot->xcnt*sizeof(TransactionId));
+		DtmWakeupBatchWaiters(ids, n, false);
+	}
+	else
+	{
+		/* Snapshot did not fit in the shared buffer or request failed: let the waiters refetch */
+		DtmWakeupBatchWaiters(ids, n, true);
+	}
+	LWLockRelease(dtm->batchLock);
+
+	if (ok)
+		*gxmin = batchGxmin;
+	else
+		ArbiterGetSnapshot(xid, snapshot, gxmin);
+}
+
 static Snapshot DtmGetSnapshot(Snapshot snapshot)
 {
 	if (DtmGlobalXidAssigned)
@@ -614,7 +857,7 @@ static Snapshot DtmGetSnapshot(Snapshot snapshot)
 	if (TransactionIdIsValid(DtmNextXid) && snapshot != &CatalogSnapshotData)
 	{		
 		if (!DtmHasGlobalSnapshot && (snapshot != DtmLastSnapshot || DtmCurcid != GetCurrentCommandId(false))) {
-			ArbiterGetSnapshot(DtmNextXid, &DtmSnapshot, &dtm->minXid);
+			DtmGetGlobalSnapshot(DtmNextXid, &DtmSnapshot, &dtm->minXid);
 		}
 		DtmLastSnapshot = snapshot;
 		DtmMergeWithGlobalSnapshot(snapshot);
@@ -649,6 +892,32 @@ static XidStatus DtmGetTransactionStatus(TransactionId xid, XLogRecPtr *lsn)
 	return status;
 }
 
+static void DtmGetTransactionStatusBulk(int nxids, TransactionId *xids, XidStatus *statuses, XLogRecPtr *lsns)
+{
+	int i = 0;
+	XTM_TRACE("XTM: DtmGetTransactionStatusBulk\n");
+	while (i < nxids)
+	{
+		if (xids[i] >= ShmemVariableCache->nextXid)
+		{
+			statuses[i] = TRANSACTION_STATUS_IN_PROGRESS;
+			lsns[i] = InvalidXLogRecPtr;
+			i += 1;
+		}
+		else
+		{
+			/* Let CLOG handle maximal runs of locally known xids in one call */
+			int run = i;
+			while (run < nxids && xids[run] < ShmemVariableCache->nextXid)
+			{
+				run += 1;
+			}
+			PgTransactionIdGetStatusBulk(run - i, xids + i, statuses + i, lsns + i);
+			i = run;
+		}
+	}
+}
+
 static void DtmSetTransactionStatus(TransactionId xid, int nsubxids, TransactionId *subxids, XidStatus status, XLogRecPtr lsn)
 {
 	XTM_INFO("%d: DtmSetTransactionStatus %u = %u\n", getpid(), xid, status);
@@ -659,8 +928,10 @@ static void DtmSetTransactionStatus(TransactionId xid, int nsubxids, Transaction
 			CurrentTransactionSnapshot = NULL;
 			if (status == TRANSACTION_STATUS_ABORTED)
 			{
+				/* overlap the arbiter round trip with the local clog update */
+				bool sent = ArbiterSetTransStatusBegin(xid, status, false);
 				PgTransactionIdSetTreeStatus(xid, nsubxids, subxids, status, lsn);
-				if (ArbiterSetTransStatus(xid, status, false) == -1)
+				if (!sent || ArbiterSetTransStatusEnd() == -1)
 				{
 					elog(WARNING, "failed to set 'aborted' transaction status on arbiter");
 					return;
@@ -721,10 +992,18 @@ static void DtmInitialize()
 	dtm = ShmemInitStruct("dtm", sizeof(DtmState), &found);
 	if (!found)
 	{
-		dtm->hashLock = LWLockAssign();
-		dtm->xidLock = LWLockAssign();
+		int i;
+		LWLockPadded *locks = GetNamedLWLockTranche("pg_dtm");
+		dtm->hashLock = &locks[0].lock;
+		dtm->xidLock = &locks[1].lock;
+		dtm->batchLock = &locks[2].lock;
 		dtm->nReservedXids = 0;
 		dtm->minXid = InvalidTransactionId;
+		dtm->batchInProgress = false;
+		dtm->nBatchReaders = 0;
+		dtm->batchLeaderLatch = NULL;
+		for (i = 0; i < MAX_SNAPSHOT_BATCH; i++)
+			dtm->batchSlots[i].state = DTM_SLOT_FREE;
 		RegisterXactCallback(DtmXactCallback, NULL);
 		RegisterSubXactCallback(DtmSubXactCallback, NULL);
 	}
@@ -821,7 +1100,7 @@ _PG_init(void)
 	 * resources in imcs_shmem_startup().
 	 */
 	RequestAddinShmemSpace(DTM_SHMEM_SIZE);
-	RequestAddinLWLocks(2);
+	RequestNamedLWLockTranche("pg_dtm", 3);
 
 	DefineCustomIntVariable(
 		"dtm.local_xid_reserve",
@@ -838,6 +1117,38 @@ _PG_init(void)
 		NULL
 	);
 
+	DefineCustomIntVariable(
+		"dtm.snapshot_batch_size",
+		"Maximum number of concurrent snapshot requests coalesced into one arbiter round trip",
+		"Value 1 disables batching: each backend asks the arbiter directly",
+		&DtmSnapshotBatchSize,
+		1,
+		1,
+		MAX_SNAPSHOT_BATCH,
+		PGC_BACKEND,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	DefineCustomIntVariable(
+		"dtm.sequence_reserve",
+		"Number of sequence values leased from the arbiter in one request",
+		"Larger blocks mean fewer arbiter round trips per dtm_nextval() call, "
+		"but also larger gaps in the observed values when a backend exits "
+		"with part of its block unused",
+		&DtmSequenceReserve,
+		4096,
+		1,
+		INT_MAX,
+		PGC_BACKEND,
+		0,
+		NULL,
+		NULL,
+		NULL
+	);
+
 	DefineCustomIntVariable(
 		"dtm.buffer_size",
 		"Size of sockhub buffer for connection to arbiters, if 0, then direct connection will be used",
@@ -910,6 +1221,8 @@ PG_FUNCTION_INFO_V1(dtm_join_transaction);
 PG_FUNCTION_INFO_V1(dtm_get_current_snapshot_xmax);
 PG_FUNCTION_INFO_V1(dtm_get_current_snapshot_xmin);
 PG_FUNCTION_INFO_V1(dtm_get_current_snapshot_xcnt);
+PG_FUNCTION_INFO_V1(dtm_nextval);
+PG_FUNCTION_INFO_V1(dtm_dump_trace);
 
 Datum
 dtm_get_current_snapshot_xmin(PG_FUNCTION_ARGS)
@@ -929,6 +1242,13 @@ dtm_get_current_snapshot_xcnt(PG_FUNCTION_ARGS)
 	PG_RETURN_INT32(CurrentTransactionSnapshot->xcnt);
 }
 
+Datum
+dtm_dump_trace(PG_FUNCTION_ARGS)
+{
+	ArbiterTraceDump();
+	PG_RETURN_VOID();
+}
+
 Datum
 dtm_begin_transaction(PG_FUNCTION_ARGS)
 {
@@ -948,6 +1268,57 @@ dtm_begin_transaction(PG_FUNCTION_ARGS)
 	PG_RETURN_INT32(DtmNextXid);
 }
 
+/*
+ * Backend-local cache of sequence ranges leased from the arbiter, keyed by
+ * the hash of the sequence name. Drawing values from the cache touches no
+ * shared state at all, so concurrent backends (and nodes) do not contend the
+ * way they do on a local sequence relation's buffer lock; the price is one
+ * arbiter round trip per dtm.sequence_reserve values and gaps where leased
+ * ranges interleave or are abandoned, the same caveats as cached local
+ * sequences have. Two names hashing to the same key share one counter, which
+ * costs uniqueness nothing, only density.
+ */
+typedef struct
+{
+	uint32 key;  /* hash of the sequence name */
+	int64 next;  /* next value to return */
+	int64 last;  /* last value of the leased range */
+} DtmSequenceCache;
+
+static HTAB* sequence_cache;
+
+Datum dtm_nextval(PG_FUNCTION_ARGS)
+{
+	text* seqname = PG_GETARG_TEXT_PP(0);
+	uint32 key = DatumGetUInt32(hash_any((unsigned char*)VARDATA_ANY(seqname),
+										 VARSIZE_ANY_EXHDR(seqname)));
+	DtmSequenceCache* cache;
+	bool found;
+
+	if (sequence_cache == NULL)
+	{
+		HASHCTL info;
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(uint32);
+		info.entrysize = sizeof(DtmSequenceCache);
+		sequence_cache = hash_create("dtm_sequence_cache", 16, &info,
+									 HASH_ELEM | HASH_BLOBS);
+	}
+	cache = (DtmSequenceCache*)hash_search(sequence_cache, &key, HASH_ENTER, &found);
+	if (!found || cache->next > cache->last)
+	{
+		long long first;
+		long long last;
+
+		if (!ArbiterReserveSequence(key, DtmSequenceReserve, &first, &last))
+			elog(ERROR, "failed to lease a range of sequence \"%s\" on arbiter",
+				 text_to_cstring(seqname));
+		cache->next = first;
+		cache->last = last;
+	}
+	PG_RETURN_INT64(cache->next++);
+}
+
 Datum dtm_join_transaction(PG_FUNCTION_ARGS)
 {
 	if (TransactionIdIsValid(DtmNextXid))
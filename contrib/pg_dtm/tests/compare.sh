@@ -0,0 +1,114 @@
+#!/bin/bash
+#
+# Run the same dtmbench workload against every transaction manager that can
+# be plugged in through the XTM interface, each on its own freshly deployed
+# set of local instances, and print a comparison table at the end.
+#
+# Requires initdb/pg_ctl/psql built with the contribs in PATH (the usual
+# ~/postgres_cluster/dist/bin) and dtmbench built in this directory (make).
+#
+# Usage:
+#     ./compare.sh [dtmbench options...]
+# e.g. ./compare.sh -n 10000 -a 10000 -w 10 -r 1 -m transfer
+# Extra options are passed to every dtmbench invocation, so all backends
+# see an identical workload.  Environment knobs:
+#     N_NODES   number of local instances per backend (default 3)
+#     BACKENDS  which backends to measure (default "vanilla tsdtm dtm mmts")
+#     BASE_PORT first instance listens here, the rest on consecutive ports
+
+n_nodes=${N_NODES:-3}
+backends=${BACKENDS:-"vanilla tsdtm dtm mmts"}
+base_port=${BASE_PORT:-5432}
+arbiter_port=$((base_port - 1))
+arbiter_bin=../../arbiter/bin/arbiter
+workdir=compare_data
+csv=$workdir/compare.csv
+
+stop_all() {
+    for ((i=1;i<=n_nodes;i++))
+    do
+        pg_ctl -D $workdir/node$i stop -m immediate > /dev/null 2>&1
+    done
+    pkill -9 arbiter 2> /dev/null
+}
+
+trap stop_all EXIT
+
+rm -fr $workdir
+mkdir $workdir
+
+for backend in $backends
+do
+    echo "=== $backend: deploying $n_nodes local instances ==="
+    rm -fr $workdir/node? $workdir/arbiter
+    conns=""
+    mm_conn_str=""
+    sep=""
+    for ((i=1;i<=n_nodes;i++))
+    do
+        port=$((base_port + i - 1))
+        mm_conn_str="$mm_conn_str${sep}dbname=postgres host=127.0.0.1 port=$port sslmode=disable"
+        sep=","
+    done
+    for ((i=1;i<=n_nodes;i++))
+    do
+        port=$((base_port + i - 1))
+        initdb $workdir/node$i > $workdir/initdb-$backend-$i.log 2>&1
+        {
+            echo "port = $port"
+            echo "fsync = off"
+            echo "max_connections = 200"
+            echo "max_prepared_transactions = 200"
+        } >> $workdir/node$i/postgresql.conf
+        case $backend in
+            dtm)
+                echo "shared_preload_libraries = 'pg_dtm'" >> $workdir/node$i/postgresql.conf
+                echo "dtm.arbiters = '127.0.0.1:$arbiter_port'" >> $workdir/node$i/postgresql.conf
+                ;;
+            tsdtm)
+                echo "shared_preload_libraries = 'pg_tsdtm'" >> $workdir/node$i/postgresql.conf
+                ;;
+            mmts)
+                {
+                    echo "shared_preload_libraries = 'multimaster'"
+                    echo "wal_level = logical"
+                    echo "max_worker_processes = 100"
+                    echo "max_wal_senders = 10"
+                    echo "max_replication_slots = 10"
+                    echo "multimaster.conn_strings = '$mm_conn_str'"
+                    echo "multimaster.node_id = $i"
+                    echo "multimaster.workers = 8"
+                } >> $workdir/node$i/postgresql.conf
+                ;;
+        esac
+        conns="$conns -c \"dbname=postgres host=127.0.0.1 port=$port sslmode=disable\""
+    done
+
+    if [ "$backend" = dtm ]; then
+        mkdir $workdir/arbiter
+        $arbiter_bin -i 0 -r 127.0.0.1:$arbiter_port -d $workdir/arbiter \
+            -l $workdir/arbiter.log
+        sleep 1
+    fi
+
+    for ((i=1;i<=n_nodes;i++))
+    do
+        pg_ctl -D $workdir/node$i -l $workdir/node$i-$backend.log start > /dev/null
+    done
+    for ((i=1;i<=n_nodes;i++))
+    do
+        port=$((base_port + i - 1))
+        until pg_isready -q -h 127.0.0.1 -p $port; do sleep 1; done
+    done
+    # multimaster needs all nodes connected to each other before it
+    # accepts transactions
+    if [ "$backend" = mmts ]; then sleep 5; fi
+
+    eval ./dtmbench $conns -t $backend -i -L $backend -o $csv "$@"
+
+    stop_all
+done
+
+echo
+echo "=== comparison report ==="
+column -t -s, $csv
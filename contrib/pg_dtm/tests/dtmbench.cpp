@@ -1,7 +1,9 @@
 #include <time.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <inttypes.h>
 #include <sys/time.h>
 #include <pthread.h>
@@ -21,7 +23,7 @@ template<class T>
 class unique_ptr
 {
     T* ptr;
-    
+
   public:
     unique_ptr(T* p = NULL) : ptr(p) {}
     ~unique_ptr() { delete ptr; }
@@ -31,27 +33,74 @@ class unique_ptr
     void operator=(unique_ptr& other) {
         ptr = other.ptr;
         other.ptr = NULL;
-    }        
+    }
 };
 
 typedef void* (*thread_proc_t)(void*);
 typedef uint32_t xid_t;
+typedef int64_t csn_t;
+
+/*
+ * Which commit protocol the benchmark should drive.  "dtm" and "tsdtm"
+ * coordinate a global transaction across every connection; "mmts" (and
+ * "vanilla", for baselining) talk to a single node per transaction and
+ * leave replication to the server.
+ */
+enum backend_t
+{
+    BACKEND_DTM,
+    BACKEND_TSDTM,
+    BACKEND_MMTS,
+    BACKEND_VANILLA
+};
+
+enum workload_t
+{
+    WORKLOAD_TRANSFER,
+    WORKLOAD_READONLY,
+    WORKLOAD_WRITESKEW
+};
+
+/*
+ * Power-of-two latency histogram: bucket B counts transactions that took
+ * less than 2^B microseconds.  32 buckets cover more than an hour.
+ */
+#define LATENCY_BUCKETS 32
 
 struct thread
 {
     pthread_t t;
     size_t proceeded;
+    size_t reads;
     size_t aborts;
     int id;
+    size_t latencyHist[LATENCY_BUCKETS];
+    time_t maxLatency;
 
-    void start(int tid, thread_proc_t proc) { 
+    void start(int tid, thread_proc_t proc) {
         id = tid;
         proceeded = 0;
+        reads = 0;
         aborts = 0;
+        maxLatency = 0;
+        memset(latencyHist, 0, sizeof(latencyHist));
         pthread_create(&t, NULL, proc, this);
     }
 
-    void wait() { 
+    void recordLatency(time_t usec) {
+        int bucket = 0;
+        time_t us = usec;
+        while (us > 0 && bucket < LATENCY_BUCKETS-1) {
+            us >>= 1;
+            bucket += 1;
+        }
+        latencyHist[bucket] += 1;
+        if (usec > maxLatency) {
+            maxLatency = usec;
+        }
+    }
+
+    void wait() {
         pthread_join(t, NULL);
     }
 };
@@ -62,15 +111,29 @@ struct config
     int nWriters;
     int nIterations;
     int nAccounts;
+    int globalPercent;
+    backend_t backend;
+    workload_t workload;
     char const* isolationLevel;
+    char const* label;
+    char const* csvFile;
+    char const* jsonFile;
+    time_t startAt;
     vector<string> connections;
 
     config() {
         nReaders = 1;
         nWriters = 10;
         nIterations = 1000;
-        nAccounts = 1000;      
+        nAccounts = 1000;
+        globalPercent = 100;
+        backend = BACKEND_DTM;
+        workload = WORKLOAD_TRANSFER;
         isolationLevel = "repeatable read";//"read committed";
+        label = "dtmbench";
+        csvFile = NULL;
+        jsonFile = NULL;
+        startAt = 0;
     }
 };
 
@@ -97,7 +160,7 @@ void exec(transaction_base& txn, char const* sql, ...)
     txn.exec(buf);
 }
 
-xid_t execQuery( transaction_base& txn, char const* sql, ...)
+int64_t execQuery( transaction_base& txn, char const* sql, ...)
 {
     va_list args;
     va_start(args, sql);
@@ -105,8 +168,99 @@ xid_t execQuery( transaction_base& txn, char const* sql, ...)
     vsprintf(buf, sql, args);
     va_end(args);
     result r = txn.exec(buf);
-    return r[0][0].as(xid_t());
-}  
+    return r[0][0].as(int64_t());
+}
+
+static char const* backendName(backend_t b)
+{
+    switch (b) {
+    case BACKEND_DTM:     return "dtm";
+    case BACKEND_TSDTM:   return "tsdtm";
+    case BACKEND_MMTS:    return "mmts";
+    default:              return "vanilla";
+    }
+}
+
+static char const* workloadName(workload_t w)
+{
+    switch (w) {
+    case WORKLOAD_TRANSFER:  return "transfer";
+    case WORKLOAD_READONLY:  return "readonly";
+    default:                 return "writeskew";
+    }
+}
+
+/*
+ * Begin a global transaction spanning the two given connections, using the
+ * backend's coordination protocol.  For mmts/vanilla only srcTx is used and
+ * the caller must route both updates through it.
+ */
+static void beginGlobal(thread& t, int iteration,
+                        nontransaction& srcTx, nontransaction& dstTx,
+                        char* gtid)
+{
+    switch (cfg.backend) {
+    case BACKEND_DTM:
+    {
+        xid_t xid = execQuery(srcTx, "select dtm_begin_transaction()");
+        exec(dstTx, "select dtm_join_transaction(%u)", xid);
+        exec(srcTx, "begin transaction isolation level %s", cfg.isolationLevel);
+        exec(dstTx, "begin transaction isolation level %s", cfg.isolationLevel);
+        break;
+    }
+    case BACKEND_TSDTM:
+    {
+        csn_t snapshot;
+        sprintf(gtid, "%d.%d.%d", getpid(), t.id, iteration);
+        exec(srcTx, "begin transaction");
+        exec(dstTx, "begin transaction");
+        snapshot = execQuery(srcTx, "select dtm_extend('%s')", gtid);
+        execQuery(dstTx, "select dtm_access(%ld, '%s')", snapshot, gtid);
+        break;
+    }
+    default:
+        exec(srcTx, "begin transaction isolation level %s", cfg.isolationLevel);
+        break;
+    }
+}
+
+/*
+ * Commit the global transaction started by beginGlobal.  Throws on abort.
+ */
+static void commitGlobal(nontransaction& srcTx, nontransaction& dstTx,
+                         char const* gtid)
+{
+    switch (cfg.backend) {
+    case BACKEND_DTM:
+    {
+        pipeline srcPipe(srcTx);
+        pipeline dstPipe(dstTx);
+        pipeline::query_id q1 = srcPipe.insert("commit transaction");
+        pipeline::query_id q2 = dstPipe.insert("commit transaction");
+        srcPipe.retrieve(q1);
+        dstPipe.retrieve(q2);
+        break;
+    }
+    case BACKEND_TSDTM:
+    {
+        csn_t csn;
+        exec(srcTx, "prepare transaction '%s'", gtid);
+        exec(dstTx, "prepare transaction '%s'", gtid);
+        exec(srcTx, "select dtm_begin_prepare('%s')", gtid);
+        exec(dstTx, "select dtm_begin_prepare('%s')", gtid);
+        csn = execQuery(srcTx, "select dtm_prepare('%s', 0)", gtid);
+        csn = execQuery(dstTx, "select dtm_prepare('%s', %ld)", gtid, csn);
+        exec(srcTx, "select dtm_end_prepare('%s', %ld)", gtid, csn);
+        exec(dstTx, "select dtm_end_prepare('%s', %ld)", gtid, csn);
+        exec(srcTx, "commit prepared '%s'", gtid);
+        exec(dstTx, "commit prepared '%s'", gtid);
+        break;
+    }
+    default:
+        exec(srcTx, "commit transaction");
+        break;
+    }
+}
 
 void* reader(void* arg)
 {
@@ -119,43 +273,68 @@ void* reader(void* arg)
 
     while (running && (cfg.nWriters != 0 || t.proceeded < (size_t)cfg.nIterations)) {
         try {
+            time_t start = getCurrentTime();
             xid_t xid = 0;
-            for (size_t i = 0; i < conns.size(); i++) {        
-                work txn(*conns[i]);
-                if (i == 0) {
-                    xid = execQuery(txn, "select dtm_begin_transaction()");
-                } else {
-                    exec(txn, "select dtm_join_transaction(%u)", xid);
+            if (cfg.backend == BACKEND_DTM) {
+                for (size_t i = 0; i < conns.size(); i++) {
+                    work txn(*conns[i]);
+                    if (i == 0) {
+                        xid = execQuery(txn, "select dtm_begin_transaction()");
+                    } else {
+                        exec(txn, "select dtm_join_transaction(%u)", xid);
+                    }
+                    txn.commit();
                 }
-                txn.commit();
-            }
-            vector< unique_ptr<nontransaction> > txns(conns.size());
-            vector< unique_ptr<pipeline> > pipes(conns.size());
-            vector<pipeline::query_id> results(conns.size());
-            for (size_t i = 0; i < conns.size(); i++) {        
-                txns[i] = new nontransaction(*conns[i]);
-                pipes[i] = new pipeline(*txns[i]);
-                results[i] = pipes[i]->insert("select sum(v) from t");
             }
             int64_t sum = 0;
-            for (size_t i = 0; i < conns.size(); i++) {        
-                pipes[i]->complete();
-                result r = pipes[i]->retrieve(results[i]);
-                sum += r[0][0].as(int64_t());
+            if (cfg.backend == BACKEND_MMTS || cfg.backend == BACKEND_VANILLA) {
+                /* the server replicates: any one node has the whole table */
+                work txn(*conns[t.id % conns.size()]);
+                sum = execQuery(txn, "select sum(v) from t");
+                txn.commit();
+            } else {
+                vector< unique_ptr<nontransaction> > txns(conns.size());
+                vector< unique_ptr<pipeline> > pipes(conns.size());
+                vector<pipeline::query_id> results(conns.size());
+                if (cfg.backend == BACKEND_TSDTM) {
+                    csn_t snapshot = 0;
+                    for (size_t i = 0; i < conns.size(); i++) {
+                        txns[i] = new nontransaction(*conns[i]);
+                        snapshot = max(snapshot, execQuery(*txns[i], "select dtm_extend()"));
+                    }
+                    for (size_t i = 0; i < conns.size(); i++) {
+                        execQuery(*txns[i], "select dtm_access(%ld)", snapshot);
+                    }
+                } else {
+                    for (size_t i = 0; i < conns.size(); i++) {
+                        txns[i] = new nontransaction(*conns[i]);
+                    }
+                }
+                for (size_t i = 0; i < conns.size(); i++) {
+                    pipes[i] = new pipeline(*txns[i]);
+                    results[i] = pipes[i]->insert("select sum(v) from t");
+                }
+                for (size_t i = 0; i < conns.size(); i++) {
+                    pipes[i]->complete();
+                    result r = pipes[i]->retrieve(results[i]);
+                    sum += r[0][0].as(int64_t());
+                }
             }
-            if (sum != prevSum) {
+            if (sum != prevSum && cfg.backend == BACKEND_DTM) {
                 printf("Total=%ld xid=%u\n", sum, xid);
                 prevSum = sum;
             }
             t.proceeded += 1;
-        } catch (pqxx_exception const& x) { 
+            t.reads += 1;
+            t.recordLatency(getCurrentTime() - start);
+        } catch (pqxx_exception const& x) {
             printf("reader exception\n");
             continue;
         }
     }
     return NULL;
 }
- 
+
 void* writer(void* arg)
 {
     thread& t = *(thread*)arg;
@@ -164,93 +343,170 @@ void* writer(void* arg)
         conns[i] = new connection(cfg.connections[i]);
     }
     for (int i = 0; i < cfg.nIterations; i++)
-    { 
+    {
         int srcCon, dstCon;
-        //int srcAcc = (random() % ((cfg.nAccounts-cfg.nWriters)/cfg.nWriters))*cfg.nWriters + t.id;
-        //int dstAcc = (random() % ((cfg.nAccounts-cfg.nWriters)/cfg.nWriters))*cfg.nWriters + t.id;
+        char gtid[64];
         int srcAcc = random() % cfg.nAccounts;
         int dstAcc = random() % cfg.nAccounts;
+        bool global = cfg.connections.size() > 1
+            && (int)(random() % 100) < cfg.globalPercent
+            && cfg.backend != BACKEND_MMTS
+            && cfg.backend != BACKEND_VANILLA;
+
+        if (global) {
+            do {
+                srcCon = random() % cfg.connections.size();
+                dstCon = random() % cfg.connections.size();
+            } while (srcCon == dstCon);
+        } else {
+            srcCon = dstCon = t.id % cfg.connections.size();
+        }
 
-        do { 
-            srcCon = random() % cfg.connections.size();
-            dstCon = random() % cfg.connections.size();
-        } while (srcCon == dstCon);
-        
         nontransaction srcTx(*conns[srcCon]);
         nontransaction dstTx(*conns[dstCon]);
-        
+        nontransaction& dstRef = global ? dstTx : srcTx;
+
+        time_t start = getCurrentTime();
+
         try {
-            xid_t xid = execQuery(srcTx, "select dtm_begin_transaction()");
-            exec(dstTx, "select dtm_join_transaction(%u)", xid);
+            if (global) {
+                beginGlobal(t, i, srcTx, dstTx, gtid);
+            } else {
+                exec(srcTx, "begin transaction isolation level %s",
+                     cfg.isolationLevel);
+            }
         } catch (pqxx_exception const& x) {
             i -= 1;
             continue;
         }
 
-        exec(srcTx, "begin transaction isolation level %s", cfg.isolationLevel);
-        exec(dstTx, "begin transaction isolation level %s", cfg.isolationLevel);
-
-        try { 
-            exec(srcTx, "update t set v = v - 1 where u=%d", srcAcc);
-            exec(dstTx, "update t set v = v + 1 where u=%d", dstAcc);
-        } catch (pqxx_exception const& x) { 
+        try {
+            if (cfg.workload == WORKLOAD_WRITESKEW) {
+                /*
+                 * Classic write-skew shape: each transaction reads both
+                 * accounts, checks an invariant over their sum, and then
+                 * writes only one of them.  Serializable systems must abort
+                 * some of these; weaker ones silently break the invariant,
+                 * which the final sum check will expose.
+                 */
+                int64_t v1 = execQuery(srcTx, "select v from t where u=%d", srcAcc);
+                int64_t v2 = execQuery(dstRef, "select v from t where u=%d", dstAcc);
+                t.reads += 2;
+                if (v1 + v2 >= 0) {
+                    exec(srcTx, "update t set v = v - 1 where u=%d", srcAcc);
+                } else {
+                    exec(dstRef, "update t set v = v + 1 where u=%d", dstAcc);
+                }
+            } else {
+                exec(srcTx, "update t set v = v - 1 where u=%d", srcAcc);
+                exec(dstRef, "update t set v = v + 1 where u=%d", dstAcc);
+            }
+        } catch (pqxx_exception const& x) {
             exec(srcTx, "rollback");
-            exec(dstTx, "rollback");
+            if (global) {
+                exec(dstTx, "rollback");
+            }
             t.aborts += 1;
             i -= 1;
             continue;
         }
-        try { 
-            pipeline srcPipe(srcTx);
-            pipeline dstPipe(dstTx);
-            pipeline::query_id q1 = srcPipe.insert("commit transaction");
-            pipeline::query_id q2 = dstPipe.insert("commit transaction");
-            //srcPipe.complete();
-            //dstPipe.complete();
-            srcPipe.retrieve(q1);
-            dstPipe.retrieve(q2);
-        } catch (pqxx_exception const& x) { 
+        try {
+            if (global) {
+                commitGlobal(srcTx, dstTx, gtid);
+            } else {
+                exec(srcTx, "commit transaction");
+            }
+        } catch (pqxx_exception const& x) {
             t.aborts += 1;
             i -= 1;
             continue;
         }
-       
+
         t.proceeded += 1;
+        t.recordLatency(getCurrentTime() - start);
     }
     return NULL;
 }
-      
+
 void initializeDatabase()
 {
-    for (size_t i = 0; i < cfg.connections.size(); i++) { 
+    for (size_t i = 0; i < cfg.connections.size(); i++) {
         try {
             connection conn(cfg.connections[i]);
             work txn(conn);
-            exec(txn, "drop extension if exists pg_dtm");
-            exec(txn, "create extension pg_dtm");
+            if (cfg.backend == BACKEND_DTM) {
+                exec(txn, "drop extension if exists pg_dtm");
+                exec(txn, "create extension pg_dtm");
+            } else if (cfg.backend == BACKEND_TSDTM) {
+                exec(txn, "drop extension if exists pg_tsdtm");
+                exec(txn, "create extension pg_tsdtm");
+            }
             exec(txn, "drop table if exists t");
             exec(txn, "create table t(u int primary key, v int)");
             exec(txn, "insert into t (select generate_series(0,%d), %d)", cfg.nAccounts-1, 0);
             txn.commit();
+            if (cfg.backend == BACKEND_MMTS || cfg.backend == BACKEND_VANILLA) {
+                /* the server replicates: initializing one node is enough */
+                break;
+            }
         } catch (pqxx_exception const& x) {
             i -= 1;
             continue;
         }
-    }        
+    }
+}
+
+/*
+ * Merge the per-thread histograms and return the latency below which
+ * 'percent' of the transactions completed, rounded up to the bucket's
+ * upper bound (2^bucket usec).
+ */
+static time_t percentile(vector<thread>& readers, vector<thread>& writers,
+                         double percent)
+{
+    size_t hist[LATENCY_BUCKETS];
+    size_t total = 0;
+    size_t seen = 0;
+    int b;
+
+    memset(hist, 0, sizeof(hist));
+    for (int i = 0; i < cfg.nReaders; i++) {
+        for (b = 0; b < LATENCY_BUCKETS; b++) {
+            hist[b] += readers[i].latencyHist[b];
+        }
+    }
+    for (int i = 0; i < cfg.nWriters; i++) {
+        for (b = 0; b < LATENCY_BUCKETS; b++) {
+            hist[b] += writers[i].latencyHist[b];
+        }
+    }
+    for (b = 0; b < LATENCY_BUCKETS; b++) {
+        total += hist[b];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    for (b = 0; b < LATENCY_BUCKETS; b++) {
+        seen += hist[b];
+        if ((double)seen * 100.0 >= (double)total * percent) {
+            break;
+        }
+    }
+    return (time_t)1 << b;
 }
 
 int main (int argc, char* argv[])
 {
     bool initialize = false;
-    for (int i = 1; i < argc; i++) { 
-        if (argv[i][0] == '-') { 
-            switch (argv[i][1]) { 
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            switch (argv[i][1]) {
             case 'r':
                 cfg.nReaders = atoi(argv[++i]);
                 continue;
             case 'w':
                 cfg.nWriters = atoi(argv[++i]);
-                continue;                
+                continue;
             case 'a':
                 cfg.nAccounts = atoi(argv[++i]);
                 continue;
@@ -263,6 +519,53 @@ int main (int argc, char* argv[])
             case 'l':
                 cfg.isolationLevel = argv[++i];
                 continue;
+            case 't':
+            {
+                char const* t = argv[++i];
+                if (strcmp(t, "dtm") == 0) {
+                    cfg.backend = BACKEND_DTM;
+                } else if (strcmp(t, "tsdtm") == 0) {
+                    cfg.backend = BACKEND_TSDTM;
+                } else if (strcmp(t, "mmts") == 0) {
+                    cfg.backend = BACKEND_MMTS;
+                } else if (strcmp(t, "vanilla") == 0) {
+                    cfg.backend = BACKEND_VANILLA;
+                } else {
+                    printf("Unknown backend %s\n", t);
+                    return 1;
+                }
+                continue;
+            }
+            case 'm':
+            {
+                char const* m = argv[++i];
+                if (strcmp(m, "transfer") == 0) {
+                    cfg.workload = WORKLOAD_TRANSFER;
+                } else if (strcmp(m, "readonly") == 0) {
+                    cfg.workload = WORKLOAD_READONLY;
+                } else if (strcmp(m, "writeskew") == 0) {
+                    cfg.workload = WORKLOAD_WRITESKEW;
+                } else {
+                    printf("Unknown workload %s\n", m);
+                    return 1;
+                }
+                continue;
+            }
+            case 'g':
+                cfg.globalPercent = atoi(argv[++i]);
+                continue;
+            case 'L':
+                cfg.label = argv[++i];
+                continue;
+            case 'o':
+                cfg.csvFile = argv[++i];
+                continue;
+            case 'J':
+                cfg.jsonFile = argv[++i];
+                continue;
+            case 'S':
+                cfg.startAt = (time_t)atoll(argv[++i]) * USEC;
+                continue;
             case 'i':
                 initialize = true;
                 continue;
@@ -273,18 +576,48 @@ int main (int argc, char* argv[])
                "\t-w N\tnumber of writers (10)\n"
                "\t-a N\tnumber of accounts (1000)\n"
                "\t-n N\tnumber of iterations (1000)\n"
-               "\t-l STR\tisolation level (read committed)\n"
+               "\t-l STR\tisolation level (repeatable read)\n"
                "\t-c STR\tdatabase connection string\n"
-               "\t-i\tinitialize datanase\n");
+               "\t-t STR\tbackend: dtm, tsdtm, mmts or vanilla (dtm)\n"
+               "\t-m STR\tworkload: transfer, readonly or writeskew (transfer)\n"
+               "\t-g N\tpercent of multi-node transactions (100)\n"
+               "\t-L STR\tscenario label for CSV/JSON output\n"
+               "\t-o FILE\tappend a CSV result line to FILE\n"
+               "\t-J FILE\twrite a JSON result object to FILE\n"
+               "\t-S EPOCH\tdelay start until this Unix time (for\n"
+               "\t\tcoordinating clients on several hosts)\n"
+               "\t-i\tinitialize database\n");
+        return 1;
+    }
+    if (cfg.connections.size() < 1) {
+        printf("At least one connection has to be specified\n");
         return 1;
     }
-    if (cfg.connections.size() < 2) { 
+    if ((cfg.backend == BACKEND_DTM || cfg.backend == BACKEND_TSDTM)
+        && cfg.connections.size() < 2)
+    {
         printf("At least two connections has to be specified\n");
         return 1;
     }
-    if (initialize) { 
+    if (initialize) {
         initializeDatabase();
     }
+    if (cfg.workload == WORKLOAD_READONLY) {
+        /* drive everything through the reader threads */
+        if (cfg.nWriters != 0) {
+            cfg.nReaders += cfg.nWriters;
+            cfg.nWriters = 0;
+        }
+    }
+
+    /*
+     * When several client hosts run the same scenario, the controller picks
+     * a start time slightly in the future and passes it with -S, so that
+     * all of them hit the servers together.
+     */
+    while (cfg.startAt != 0 && getCurrentTime() < cfg.startAt) {
+        usleep(1000);
+    }
 
     time_t start = getCurrentTime();
     running = true;
@@ -294,15 +627,15 @@ int main (int argc, char* argv[])
     size_t nReads = 0;
     size_t nWrites = 0;
     size_t nAborts = 0;
-    
-    for (int i = 0; i < cfg.nReaders; i++) { 
+
+    for (int i = 0; i < cfg.nReaders; i++) {
         readers[i].start(i, reader);
     }
-    for (int i = 0; i < cfg.nWriters; i++) { 
+    for (int i = 0; i < cfg.nWriters; i++) {
         writers[i].start(i, writer);
     }
-    
-    for (int i = 0; i < cfg.nWriters; i++) { 
+
+    for (int i = 0; i < cfg.nWriters; i++) {
         writers[i].wait();
         nWrites += writers[i].proceeded;
         nAborts += writers[i].aborts;
@@ -312,16 +645,74 @@ int main (int argc, char* argv[])
         running = false;
     }
 
-    for (int i = 0; i < cfg.nReaders; i++) { 
+    for (int i = 0; i < cfg.nReaders; i++) {
         readers[i].wait();
         nReads += readers[i].proceeded;
     }
- 
+
     time_t elapsed = getCurrentTime() - start;
-    if (elapsed == 0) { 
+    if (elapsed == 0) {
         printf("Test is completed too fast\n");
-    } else { 
-        printf("TPS(updates)=%f, TPS(selects)=%f, aborts=%ld\n", (double)(nWrites*USEC)/elapsed, (double)(nReads*USEC)/elapsed, nAborts);
+        return 0;
+    }
+
+    double updateTps = (double)(nWrites*USEC)/elapsed;
+    double selectTps = (double)(nReads*USEC)/elapsed;
+    time_t p50 = percentile(readers, writers, 50);
+    time_t p90 = percentile(readers, writers, 90);
+    time_t p99 = percentile(readers, writers, 99);
+    time_t p999 = percentile(readers, writers, 99.9);
+    time_t maxLatency = 0;
+    for (int i = 0; i < cfg.nReaders; i++) {
+        maxLatency = max(maxLatency, readers[i].maxLatency);
+    }
+    for (int i = 0; i < cfg.nWriters; i++) {
+        maxLatency = max(maxLatency, writers[i].maxLatency);
+    }
+
+    printf("TPS(updates)=%f, TPS(selects)=%f, aborts=%ld\n", updateTps, selectTps, nAborts);
+    printf("Latency (usec, bucket upper bounds): p50=%ld p90=%ld p99=%ld p99.9=%ld max=%ld\n",
+           p50, p90, p99, p999, maxLatency);
+
+    if (cfg.csvFile != NULL) {
+        FILE* f = fopen(cfg.csvFile, "a");
+        if (f == NULL) {
+            printf("Failed to open %s\n", cfg.csvFile);
+            return 1;
+        }
+        if (ftell(f) == 0) {
+            fprintf(f, "label,backend,workload,nodes,writers,readers,accounts,"
+                    "global_percent,update_tps,select_tps,aborts,"
+                    "p50_usec,p90_usec,p99_usec,p999_usec,max_usec\n");
+        }
+        fprintf(f, "%s,%s,%s,%d,%d,%d,%d,%d,%f,%f,%ld,%ld,%ld,%ld,%ld,%ld\n",
+                cfg.label, backendName(cfg.backend), workloadName(cfg.workload),
+                (int)cfg.connections.size(), cfg.nWriters, cfg.nReaders,
+                cfg.nAccounts, cfg.globalPercent,
+                updateTps, selectTps, nAborts,
+                p50, p90, p99, p999, maxLatency);
+        fclose(f);
+    }
+
+    if (cfg.jsonFile != NULL) {
+        FILE* f = fopen(cfg.jsonFile, "w");
+        if (f == NULL) {
+            printf("Failed to open %s\n", cfg.jsonFile);
+            return 1;
+        }
+        fprintf(f,
+                "{\"label\":\"%s\", \"backend\":\"%s\", \"workload\":\"%s\","
+                " \"nodes\":%d, \"writers\":%d, \"readers\":%d,"
+                " \"accounts\":%d, \"global_percent\":%d,"
+                " \"update_tps\":%f, \"select_tps\":%f, \"aborts\":%ld,"
+                " \"latency_usec\":{\"p50\":%ld, \"p90\":%ld, \"p99\":%ld,"
+                " \"p999\":%ld, \"max\":%ld}}\n",
+                cfg.label, backendName(cfg.backend), workloadName(cfg.workload),
+                (int)cfg.connections.size(), cfg.nWriters, cfg.nReaders,
+                cfg.nAccounts, cfg.globalPercent,
+                updateTps, selectTps, nAborts,
+                p50, p90, p99, p999, maxLatency);
+        fclose(f);
     }
     return 0;
 }
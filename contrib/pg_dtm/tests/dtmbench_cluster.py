@@ -0,0 +1,155 @@
+#!/usr/bin/env python
+#
+# Controller for running dtmbench from several client hosts at once and
+# comparing pg_dtm, pg_tsdtm and multimaster on the same scenario.
+#
+# Each client host must have the dtmbench binary built (see makefile) and be
+# reachable over ssh without a password prompt.  The controller picks a start
+# time a few seconds in the future and passes it to every client with -S, so
+# all of them hit the servers together; afterwards it fetches the per-host
+# CSV lines, merges them (TPS and aborts are summed, latency percentiles are
+# taken as the worst across hosts) and prints a comparison table.
+#
+# Example:
+#   ./dtmbench_cluster.py \
+#       --client host1 --client host2 \
+#       --connstr "dbname=postgres host=node1 port=5432" \
+#       --connstr "dbname=postgres host=node2 port=5432" \
+#       --backend dtm --backend tsdtm \
+#       --workload transfer --workload readonly \
+#       -w 10 -n 1000 -o results.csv
+
+import argparse
+import csv
+import json
+import os
+import subprocess
+import sys
+import time
+
+DTMBENCH = "./dtmbench"
+START_DELAY = 5  # seconds for all clients to get the command and connect
+
+
+def run_scenario(args, backend, workload):
+    start_at = int(time.time()) + START_DELAY
+    procs = []
+    for i, client in enumerate(args.client):
+        remote_csv = "/tmp/dtmbench.%d.%s.%s.csv" % (os.getpid(), backend, workload)
+        cmd = [DTMBENCH,
+               "-t", backend,
+               "-m", workload,
+               "-w", str(args.writers),
+               "-r", str(args.readers),
+               "-a", str(args.accounts),
+               "-n", str(args.iterations),
+               "-g", str(args.global_percent),
+               "-L", args.label,
+               "-S", str(start_at),
+               "-o", remote_csv]
+        for c in args.connstr:
+            cmd += ["-c", c]
+        if i == 0 and not args.no_init:
+            cmd += ["-i"]
+        ssh = ["ssh", client, "cd %s && rm -f %s && %s" %
+               (args.bench_dir, remote_csv, " ".join("'%s'" % a for a in cmd))]
+        procs.append((client, remote_csv, subprocess.Popen(ssh)))
+
+    results = []
+    for client, remote_csv, proc in procs:
+        if proc.wait() != 0:
+            print("%s: dtmbench failed" % client)
+            continue
+        out = subprocess.check_output(["ssh", client, "cat %s" % remote_csv])
+        for row in csv.DictReader(out.splitlines()):
+            row["client"] = client
+            results.append(row)
+    return results
+
+
+def merge(rows):
+    if not rows:
+        return None
+    merged = dict(rows[0])
+    merged["update_tps"] = sum(float(r["update_tps"]) for r in rows)
+    merged["select_tps"] = sum(float(r["select_tps"]) for r in rows)
+    merged["aborts"] = sum(int(r["aborts"]) for r in rows)
+    for p in ("p50_usec", "p90_usec", "p99_usec", "p999_usec", "max_usec"):
+        merged[p] = max(int(r[p]) for r in rows)
+    merged["clients"] = len(rows)
+    return merged
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--client", action="append", required=True,
+                        help="ssh host to run dtmbench on (repeatable)")
+    parser.add_argument("--connstr", action="append", required=True,
+                        help="connection string of one cluster node (repeatable)")
+    parser.add_argument("--backend", action="append",
+                        help="dtm, tsdtm, mmts or vanilla (repeatable)")
+    parser.add_argument("--workload", action="append",
+                        help="transfer, readonly or writeskew (repeatable)")
+    parser.add_argument("--bench-dir", default=".",
+                        help="directory with the dtmbench binary on the clients")
+    parser.add_argument("-w", "--writers", type=int, default=10)
+    parser.add_argument("-r", "--readers", type=int, default=1)
+    parser.add_argument("-a", "--accounts", type=int, default=1000)
+    parser.add_argument("-n", "--iterations", type=int, default=1000)
+    parser.add_argument("-g", "--global-percent", type=int, default=100)
+    parser.add_argument("-L", "--label", default="cluster")
+    parser.add_argument("-o", "--output", help="merged CSV output file")
+    parser.add_argument("-J", "--json", help="merged JSON output file")
+    parser.add_argument("--no-init", action="store_true",
+                        help="do not reinitialize the database")
+    args = parser.parse_args()
+
+    backends = args.backend or ["dtm"]
+    workloads = args.workload or ["transfer"]
+
+    merged_rows = []
+    for backend in backends:
+        for workload in workloads:
+            print("=== %s / %s ===" % (backend, workload))
+            rows = run_scenario(args, backend, workload)
+            m = merge(rows)
+            if m is None:
+                print("no results")
+                continue
+            merged_rows.append(m)
+            print(("clients=%(clients)s update_tps=%(update_tps).1f "
+                   "select_tps=%(select_tps).1f aborts=%(aborts)s "
+                   "p99=%(p99_usec)sus max=%(max_usec)sus") % m)
+
+    if not merged_rows:
+        sys.exit(1)
+
+    fields = ["label", "backend", "workload", "nodes", "clients",
+              "writers", "readers", "accounts", "global_percent",
+              "update_tps", "select_tps", "aborts",
+              "p50_usec", "p90_usec", "p99_usec", "p999_usec", "max_usec"]
+
+    if args.output:
+        with open(args.output, "w") as f:
+            w = csv.DictWriter(f, fields, extrasaction="ignore")
+            w.writeheader()
+            for m in merged_rows:
+                w.writerow(m)
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump([{k: m.get(k) for k in fields} for m in merged_rows],
+                      f, indent=2)
+            f.write("\n")
+
+    print("")
+    print("%-8s %-10s %12s %12s %8s %10s" % (
+        "backend", "workload", "update_tps", "select_tps", "aborts", "p99_usec"))
+    for m in merged_rows:
+        print("%-8s %-10s %12.1f %12.1f %8s %10s" % (
+            m["backend"], m["workload"], m["update_tps"], m["select_tps"],
+            m["aborts"], m["p99_usec"]))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,612 @@
+/*-------------------------------------------------------------------------
+ *
+ * autoprewarm.c
+ *		Periodically dump the list of blocks resident in shared buffers,
+ *		and reload them in parallel after a restart.
+ *
+ * When pg_prewarm is listed in shared_preload_libraries and
+ * pg_prewarm.autoprewarm is enabled, a background worker is started that
+ * writes the identities of all buffered blocks to a file in the data
+ * directory at a configurable interval (and once at shutdown). After the
+ * next startup, the same worker reads the file back and restores the
+ * blocks through pg_prewarm.reload_workers parallel I/O workers per
+ * database, so the cache reaches its working set long before ordinary
+ * traffic would warm it.
+ *
+ * Copyright (c) 2010-2016, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *		contrib/pg_prewarm/autoprewarm.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <unistd.h>
+
+#include "access/heapam.h"
+#include "access/xact.h"
+#include "common/relpath.h"
+#include "miscadmin.h"
+#include "postmaster/bgworker.h"
+#include "storage/buf_internals.h"
+#include "storage/bufmgr.h"
+#include "storage/fd.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lwlock.h"
+#include "storage/proc.h"
+#include "storage/shmem.h"
+#include "storage/smgr.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/relfilenodemap.h"
+
+#define AUTOPREWARM_DUMP_FILE		"autoprewarm.blocks"
+#define AUTOPREWARM_TEMP_FILE		"autoprewarm.blocks.tmp"
+
+/* a reload worker is only worth launching for this many blocks (64MB) */
+#define MIN_BLOCKS_PER_WORKER		8192
+
+/* identity of one buffered block, as written to the dump file */
+typedef struct BlockInfoRecord
+{
+	Oid			database;		/* database, or 0 for shared relations */
+	Oid			tablespace;
+	Oid			filenode;
+	int32		forknum;
+	BlockNumber blocknum;
+} BlockInfoRecord;
+
+/*
+ * State passed from the autoprewarm master to its reload workers. The
+ * master fully populates this before launching the workers of one database
+ * group and does not modify it until they have exited.
+ */
+typedef struct AutoPrewarmSharedState
+{
+	Oid			database;		/* database the workers connect to */
+	bool		includeShared;	/* also load blocks of shared relations */
+	int			nworkers;		/* workers launched for this database */
+} AutoPrewarmSharedState;
+
+void		_PG_init(void);
+void		autoprewarm_main(Datum main_arg);
+void		autoprewarm_database_main(Datum main_arg);
+
+static void apw_sigterm_handler(SIGNAL_ARGS);
+static void apw_shmem_startup(void);
+static void apw_attach_shmem(void);
+static void apw_load_buffers(void);
+static void apw_start_database_workers(Oid database, bool includeShared,
+						   int blockCount);
+static void apw_dump_now(void);
+static BlockInfoRecord *apw_read_dump(int *countPtr);
+static int	apw_compare_blockinfo(const void *p, const void *q);
+
+/* GUCs */
+static bool autoprewarm = true;
+static int	autoprewarm_interval = 300;
+static int	reload_workers = 4;
+
+static AutoPrewarmSharedState *apw_state = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+static volatile sig_atomic_t got_sigterm = false;
+
+
+/*
+ * Module load callback. The autoprewarm machinery is only available when
+ * the library is preloaded, since it needs shared memory and a permanent
+ * background worker; the pg_prewarm() SQL function works either way.
+ */
+void
+_PG_init(void)
+{
+	BackgroundWorker worker;
+
+	DefineCustomBoolVariable("pg_prewarm.autoprewarm",
+							 "Starts the autoprewarm worker.", NULL,
+							 &autoprewarm, true, PGC_POSTMASTER, 0,
+							 NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pg_prewarm.autoprewarm_interval",
+							"Sets the interval between dumps of shared buffers",
+							"If set to zero, time-based dumping is disabled.",
+							&autoprewarm_interval, 300, 0, INT_MAX / 1000,
+							PGC_SIGHUP, GUC_UNIT_S, NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pg_prewarm.reload_workers",
+							"Number of parallel workers used to reload "
+							"buffers at startup", NULL,
+							&reload_workers, 4, 1, 64,
+							PGC_SIGHUP, 0, NULL, NULL, NULL);
+
+	EmitWarningsOnPlaceholders("pg_prewarm");
+
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+	RequestAddinShmemSpace(MAXALIGN(sizeof(AutoPrewarmSharedState)));
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = apw_shmem_startup;
+
+	if (!autoprewarm)
+		return;
+
+	MemSet(&worker, 0, sizeof(worker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+	worker.bgw_start_time = BgWorkerStart_ConsistentState;
+	worker.bgw_restart_time = BGW_DEFAULT_RESTART_INTERVAL;
+	worker.bgw_main = NULL;
+	snprintf(worker.bgw_library_name, BGW_MAXLEN, "pg_prewarm");
+	snprintf(worker.bgw_function_name, BGW_MAXLEN, "autoprewarm_main");
+	snprintf(worker.bgw_name, BGW_MAXLEN, "autoprewarm");
+	worker.bgw_main_arg = (Datum) 0;
+	worker.bgw_notify_pid = 0;
+
+	RegisterBackgroundWorker(&worker);
+}
+
+/*
+ * Allocate or attach to the shared state.
+ */
+static void
+apw_shmem_startup(void)
+{
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	apw_attach_shmem();
+}
+
+static void
+apw_attach_shmem(void)
+{
+	bool		found;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	apw_state = ShmemInitStruct("pg_prewarm",
+								sizeof(AutoPrewarmSharedState), &found);
+	if (!found)
+		memset(apw_state, 0, sizeof(AutoPrewarmSharedState));
+	LWLockRelease(AddinShmemInitLock);
+}
+
+/*
+ * SIGTERM: time to exit, after one final dump.
+ */
+static void
+apw_sigterm_handler(SIGNAL_ARGS)
+{
+	int			save_errno = errno;
+
+	got_sigterm = true;
+	if (MyLatch)
+		SetLatch(MyLatch);
+
+	errno = save_errno;
+}
+
+/*
+ * Main entry point of the autoprewarm master worker. First restores the
+ * blocks recorded by the previous run, then periodically dumps the buffer
+ * pool contents until shutdown.
+ */
+void
+autoprewarm_main(Datum main_arg)
+{
+	pqsignal(SIGTERM, apw_sigterm_handler);
+	BackgroundWorkerUnblockSignals();
+
+	apw_attach_shmem();
+
+	apw_load_buffers();
+
+	while (!got_sigterm)
+	{
+		int			rc;
+
+		if (autoprewarm_interval > 0)
+			rc = WaitLatch(MyLatch,
+						   WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+						   autoprewarm_interval * 1000L);
+		else
+			rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_POSTMASTER_DEATH, 0);
+
+		ResetLatch(MyLatch);
+
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+
+		if (got_sigterm)
+			break;
+
+		if (rc & WL_TIMEOUT)
+			apw_dump_now();
+	}
+
+	/* capture the final state so the next startup restores it */
+	apw_dump_now();
+
+	proc_exit(0);
+}
+
+/*
+ * Restore the blocks recorded in the dump file. The file is sorted by
+ * database, so each database forms one contiguous group; for each group the
+ * configured number of reload workers is launched and waited for. Blocks of
+ * shared relations are recorded under database 0 and are loaded by the
+ * workers of the first real database group, since any connection can read
+ * them.
+ */
+static void
+apw_load_buffers(void)
+{
+	int			num_elements = 0;
+	BlockInfoRecord *blkinfo = apw_read_dump(&num_elements);
+	int			i = 0;
+	int			sharedCount = 0;
+
+	if (blkinfo == NULL || num_elements == 0)
+		return;
+
+	ereport(LOG,
+			(errmsg("restoring %d blocks recorded in \"%s\"",
+					num_elements, AUTOPREWARM_DUMP_FILE)));
+
+	/* database 0 sorts first; defer it to the first real group */
+	while (i < num_elements && blkinfo[i].database == InvalidOid)
+		i++;
+	sharedCount = i;
+
+	while (i < num_elements && !got_sigterm)
+	{
+		Oid			database = blkinfo[i].database;
+		int			groupStart = i;
+
+		while (i < num_elements && blkinfo[i].database == database)
+			i++;
+
+		apw_start_database_workers(database, sharedCount > 0,
+								   (i - groupStart) + sharedCount);
+		sharedCount = 0;
+	}
+
+	pfree(blkinfo);
+}
+
+/*
+ * Launch the reload workers for one database group and wait until all of
+ * them have exited. Worker n loads every nworkers-th eligible block, so the
+ * blocks of a large relation are spread across all workers and their reads
+ * overlap in the I/O scheduler.
+ */
+static void
+apw_start_database_workers(Oid database, bool includeShared, int blockCount)
+{
+	BackgroundWorker worker;
+	BackgroundWorkerHandle **handles;
+	int			nworkers;
+	int			i;
+
+	nworkers = (blockCount + MIN_BLOCKS_PER_WORKER - 1) / MIN_BLOCKS_PER_WORKER;
+	nworkers = Min(nworkers, reload_workers);
+	if (nworkers < 1)
+		nworkers = 1;
+
+	apw_state->database = database;
+	apw_state->includeShared = includeShared;
+	apw_state->nworkers = nworkers;
+
+	handles = (BackgroundWorkerHandle **)
+		palloc0(nworkers * sizeof(BackgroundWorkerHandle *));
+
+	MemSet(&worker, 0, sizeof(worker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS |
+		BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_ConsistentState;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	worker.bgw_main = NULL;
+	snprintf(worker.bgw_library_name, BGW_MAXLEN, "pg_prewarm");
+	snprintf(worker.bgw_function_name, BGW_MAXLEN, "autoprewarm_database_main");
+	snprintf(worker.bgw_name, BGW_MAXLEN, "autoprewarm reload worker");
+	worker.bgw_notify_pid = MyProcPid;
+
+	for (i = 0; i < nworkers; i++)
+	{
+		worker.bgw_main_arg = Int32GetDatum(i);
+
+		if (!RegisterDynamicBackgroundWorker(&worker, &handles[i]))
+		{
+			/* out of worker slots: that stripe of blocks stays cold */
+			ereport(WARNING,
+					(errmsg("could not register autoprewarm reload worker"),
+					 errhint("Consider increasing max_worker_processes.")));
+			handles[i] = NULL;
+		}
+	}
+
+	for (i = 0; i < nworkers; i++)
+	{
+		if (handles[i] != NULL)
+		{
+			WaitForBackgroundWorkerShutdown(handles[i]);
+			pfree(handles[i]);
+		}
+	}
+
+	pfree(handles);
+}
+
+/*
+ * Main entry point of a reload worker. Connects to the database published
+ * in shared state and reads every nworkers-th eligible block of the dump
+ * into shared buffers. Relations or blocks that have disappeared since the
+ * dump was taken are silently skipped.
+ */
+void
+autoprewarm_database_main(Datum main_arg)
+{
+	int			index = DatumGetInt32(main_arg);
+	Oid			database;
+	bool		includeShared;
+	int			nworkers;
+	BlockInfoRecord *blkinfo;
+	int			num_elements = 0;
+	int			i;
+	int64		ordinal = 0;
+	Oid			curTablespace = InvalidOid;
+	Oid			curFilenode = InvalidOid;
+	int32		curForknum = InvalidForkNumber;
+	BlockNumber curNblocks = 0;
+	Relation	rel = NULL;
+
+	pqsignal(SIGTERM, apw_sigterm_handler);
+	BackgroundWorkerUnblockSignals();
+
+	apw_attach_shmem();
+	database = apw_state->database;
+	includeShared = apw_state->includeShared;
+	nworkers = apw_state->nworkers;
+
+	BackgroundWorkerInitializeConnectionByOid(database, InvalidOid);
+
+	blkinfo = apw_read_dump(&num_elements);
+	if (blkinfo == NULL)
+		proc_exit(0);
+
+	for (i = 0; i < num_elements && !got_sigterm; i++)
+	{
+		BlockInfoRecord *blk = &blkinfo[i];
+
+		if (blk->database != database &&
+			!(includeShared && blk->database == InvalidOid))
+			continue;
+
+		/* every worker walks the same records, so the stripes are disjoint */
+		if (ordinal++ % nworkers != index)
+			continue;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (rel == NULL ||
+			blk->tablespace != curTablespace ||
+			blk->filenode != curFilenode)
+		{
+			Oid			relid;
+
+			if (rel != NULL)
+			{
+				relation_close(rel, AccessShareLock);
+				rel = NULL;
+				CommitTransactionCommand();
+			}
+
+			curTablespace = blk->tablespace;
+			curFilenode = blk->filenode;
+			curForknum = InvalidForkNumber;
+
+			StartTransactionCommand();
+			relid = RelidByRelfilenode(blk->tablespace, blk->filenode);
+			if (OidIsValid(relid))
+				rel = try_relation_open(relid, AccessShareLock);
+			if (rel == NULL)
+				CommitTransactionCommand();
+		}
+		if (rel == NULL)
+			continue;
+
+		if (blk->forknum != curForknum)
+		{
+			curForknum = blk->forknum;
+
+			RelationOpenSmgr(rel);
+			if (blk->forknum >= 0 && blk->forknum <= MAX_FORKNUM &&
+				smgrexists(rel->rd_smgr, blk->forknum))
+				curNblocks = RelationGetNumberOfBlocksInFork(rel, blk->forknum);
+			else
+				curNblocks = 0;
+		}
+
+		if (blk->blocknum < curNblocks)
+		{
+			Buffer		buf;
+
+			buf = ReadBufferExtended(rel, blk->forknum, blk->blocknum,
+									 RBM_NORMAL, NULL);
+			ReleaseBuffer(buf);
+		}
+	}
+
+	if (rel != NULL)
+	{
+		relation_close(rel, AccessShareLock);
+		CommitTransactionCommand();
+	}
+
+	pfree(blkinfo);
+	proc_exit(0);
+}
+
+/*
+ * Write the identities of all valid buffered blocks to the dump file. The
+ * scan takes only the buffer header locks, so it sees a slightly fuzzy
+ * picture of a busy pool; that is fine for a warm-set hint. The file is
+ * written to a temporary name first and renamed into place, so a crash
+ * during the dump cannot destroy the previous dump.
+ */
+static void
+apw_dump_now(void)
+{
+	int			i;
+	int			num_blocks = 0;
+	BlockInfoRecord *blkinfo;
+	FILE	   *file;
+
+	blkinfo = (BlockInfoRecord *)
+		palloc(sizeof(BlockInfoRecord) * NBuffers);
+
+	for (i = 0; i < NBuffers; i++)
+	{
+		BufferDesc *bufHdr = GetBufferDescriptor(i);
+		uint32		buf_state;
+
+		buf_state = LockBufHdr(bufHdr);
+
+		if ((buf_state & BM_TAG_VALID) && (buf_state & BM_VALID))
+		{
+			blkinfo[num_blocks].database = bufHdr->tag.rnode.dbNode;
+			blkinfo[num_blocks].tablespace = bufHdr->tag.rnode.spcNode;
+			blkinfo[num_blocks].filenode = bufHdr->tag.rnode.relNode;
+			blkinfo[num_blocks].forknum = bufHdr->tag.forkNum;
+			blkinfo[num_blocks].blocknum = bufHdr->tag.blockNum;
+			num_blocks++;
+		}
+
+		UnlockBufHdr(bufHdr, buf_state);
+	}
+
+	/* sorting groups the records by database for the reload phase */
+	qsort(blkinfo, num_blocks, sizeof(BlockInfoRecord), apw_compare_blockinfo);
+
+	file = AllocateFile(AUTOPREWARM_TEMP_FILE, "w");
+	if (file == NULL)
+	{
+		ereport(LOG,
+				(errcode_for_file_access(),
+				 errmsg("could not open file \"%s\": %m",
+						AUTOPREWARM_TEMP_FILE)));
+		pfree(blkinfo);
+		return;
+	}
+
+	fprintf(file, "%d\n", num_blocks);
+	for (i = 0; i < num_blocks; i++)
+		fprintf(file, "%u,%u,%u,%d,%u\n",
+				blkinfo[i].database,
+				blkinfo[i].tablespace,
+				blkinfo[i].filenode,
+				blkinfo[i].forknum,
+				blkinfo[i].blocknum);
+
+	if (FreeFile(file) != 0 ||
+		rename(AUTOPREWARM_TEMP_FILE, AUTOPREWARM_DUMP_FILE) != 0)
+	{
+		ereport(LOG,
+				(errcode_for_file_access(),
+				 errmsg("could not write file \"%s\": %m",
+						AUTOPREWARM_DUMP_FILE)));
+		unlink(AUTOPREWARM_TEMP_FILE);
+	}
+
+	pfree(blkinfo);
+}
+
+/*
+ * Read the dump file back into a palloc'd array, returning NULL if the file
+ * does not exist or cannot be parsed. Both the master and the reload
+ * workers use this; the workers filter the array rather than receiving
+ * their slice from the master, which keeps the shared state tiny.
+ */
+static BlockInfoRecord *
+apw_read_dump(int *countPtr)
+{
+	FILE	   *file;
+	BlockInfoRecord *blkinfo;
+	int			num_elements;
+	int			i;
+
+	file = AllocateFile(AUTOPREWARM_DUMP_FILE, "r");
+	if (file == NULL)
+	{
+		if (errno != ENOENT)
+			ereport(LOG,
+					(errcode_for_file_access(),
+					 errmsg("could not open file \"%s\": %m",
+							AUTOPREWARM_DUMP_FILE)));
+		return NULL;
+	}
+
+	if (fscanf(file, "%d\n", &num_elements) != 1 || num_elements < 0)
+	{
+		ereport(LOG,
+				(errmsg("invalid format of file \"%s\"",
+						AUTOPREWARM_DUMP_FILE)));
+		FreeFile(file);
+		return NULL;
+	}
+
+	blkinfo = (BlockInfoRecord *)
+		palloc(sizeof(BlockInfoRecord) * Max(num_elements, 1));
+
+	for (i = 0; i < num_elements; i++)
+	{
+		if (fscanf(file, "%u,%u,%u,%d,%u\n",
+				   &blkinfo[i].database,
+				   &blkinfo[i].tablespace,
+				   &blkinfo[i].filenode,
+				   &blkinfo[i].forknum,
+				   &blkinfo[i].blocknum) != 5)
+		{
+			ereport(LOG,
+					(errmsg("invalid format of file \"%s\"",
+							AUTOPREWARM_DUMP_FILE)));
+			FreeFile(file);
+			pfree(blkinfo);
+			return NULL;
+		}
+	}
+
+	FreeFile(file);
+
+	*countPtr = num_elements;
+	return blkinfo;
+}
+
+/*
+ * Ordering of dump records: by database first, so reload can process one
+ * database group at a time, then in physical order within each relation so
+ * the reload reads are as sequential as the striping allows.
+ */
+static int
+apw_compare_blockinfo(const void *p, const void *q)
+{
+	const BlockInfoRecord *a = (const BlockInfoRecord *) p;
+	const BlockInfoRecord *b = (const BlockInfoRecord *) q;
+
+	if (a->database != b->database)
+		return (a->database < b->database) ? -1 : 1;
+	if (a->tablespace != b->tablespace)
+		return (a->tablespace < b->tablespace) ? -1 : 1;
+	if (a->filenode != b->filenode)
+		return (a->filenode < b->filenode) ? -1 : 1;
+	if (a->forknum != b->forknum)
+		return (a->forknum < b->forknum) ? -1 : 1;
+	if (a->blocknum != b->blocknum)
+		return (a->blocknum < b->blocknum) ? -1 : 1;
+
+	return 0;
+}
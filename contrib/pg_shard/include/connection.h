@@ -16,6 +16,9 @@
 #include "c.h"
 #include "libpq-fe.h"
 
+#include "datatype/timestamp.h"
+#include "nodes/pg_list.h"
+
 
 /* maximum duration to wait for connection */
 #define CLIENT_CONNECT_TIMEOUT_SECONDS "5"
@@ -27,9 +30,16 @@
 /* times to attempt connection (or reconnection) */
 #define MAX_CONNECT_ATTEMPTS 2
 
+/* reconnect backoff bounds; the delay doubles with each consecutive failure */
+#define RECONNECT_BACKOFF_BASE_MS 100
+#define RECONNECT_BACKOFF_MAX_MS 5000
+
 /* SQL statement for testing */
 #define TEST_SQL "DO $$ BEGIN RAISE EXCEPTION 'Raised remotely!'; END $$"
 
+/* per-connection limit on cached remote prepared statements */
+#define MAX_PREPARED_STATEMENTS 64
+
 
 /*
  * NodeConnectionKey acts as the key to index into the (process-local) hash
@@ -45,13 +55,28 @@ typedef struct NodeConnectionKey
 /* NodeConnectionEntry keeps track of connections themselves. */
 typedef struct NodeConnectionEntry
 {
-	NodeConnectionKey cacheKey; /* hash entry key */
-	PGconn *connection;         /* connection to remote server, if any */
+	NodeConnectionKey cacheKey;    /* hash entry key */
+	PGconn *connection;            /* connection to remote server, if any */
+	TimestampTz lastUseTime;       /* when the connection was last handed out */
+	TimestampTz lastHealthCheckTime; /* when the connection last proved alive */
+	TimestampTz lastFailTime;      /* when connecting to this node last failed */
+	int failCount;                 /* consecutive connect failures to this node */
+	List *preparedStatementList;   /* statements prepared on this connection */
+	int preparedStatementCount;    /* statement names issued on this connection */
 } NodeConnectionEntry;
 
 
+/* configuration of the connection pool */
+extern int MaxCachedConnections;
+extern int KeepaliveInterval;
+extern bool PrewarmConnections;
+
+
 /* function declarations for obtaining and using a connection */
 extern PGconn * GetConnection(char *nodeName, int32 nodePort, bool openNew);
+extern char * PrepareRemoteStatement(char *nodeName, int32 nodePort,
+									 PGconn *connection, const char *queryText,
+									 int parameterCount, const Oid *parameterTypes);
 extern void PurgeConnection(PGconn *connection);
 extern void ReportRemoteError(PGconn *connection, PGresult *result);
 
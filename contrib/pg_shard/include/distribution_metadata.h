@@ -43,6 +43,10 @@
 							  "FROM pgs_distribution_metadata.shard_placement " \
 							  "WHERE shard_id = $1"
 
+/* query to find every distinct worker node with at least one placement */
+#define WORKER_NODE_QUERY "SELECT DISTINCT node_name, node_port " \
+						  "FROM pgs_distribution_metadata.shard_placement"
+
 /* human-readable names for addressing columns of shard placement queries */
 #define TLIST_NUM_SHARD_PLACEMENT_ID 1
 #define TLIST_NUM_SHARD_PLACEMENT_SHARD_ID 2
@@ -126,16 +130,24 @@ typedef enum
 	SHARD_LOCK_METADATA = 4
 } ShardLockType;
 
+/* controls use of the shared-memory metadata cache */
+extern bool UseSharedMetadataCache;
+
+
 /* function declarations to access and manipulate the metadata */
 extern List * LookupShardIntervalList(Oid distributedTableId);
 extern List * LoadShardIntervalList(Oid distributedTableId);
 extern ShardInterval * LoadShardInterval(int64 shardId);
 extern List * LoadFinalizedShardPlacementList(int64 shardId);
 extern List * LoadShardPlacementList(int64 shardId);
+extern List * WorkerNodeList(void);
 extern Var * PartitionColumn(Oid distributedTableId);
 extern char PartitionType(Oid distributedTableId);
 extern bool IsDistributedTable(Oid tableId);
 extern bool DistributedTablesExist(void);
+extern bool TablesColocated(Oid leftRelationId, Oid rightRelationId);
+extern ShardInterval * ColocatedShardInterval(ShardInterval *shardInterval,
+											  List *shardIntervalList);
 extern Var * ColumnNameToColumn(Oid relationId, char *columnName);
 extern void InsertPartitionRow(Oid distributedTableId, char partitionType,
 							   text *partitionKeyText);
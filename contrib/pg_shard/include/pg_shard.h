@@ -74,6 +74,12 @@ typedef struct DistributedPlan
 
 	bool selectFromMultipleShards; /* does the select run across multiple shards? */
 	CreateStmt *createTemporaryTableStmt; /* valid for multiple shard selects */
+
+	int totalShardCount; /* shard count of the table before pruning, so the
+						  * matched-to-total ratio is visible to EXPLAIN and
+						  * executor heuristics */
+
+	bool multiRowInsert; /* multi-row INSERT: one batched task per shard */
 } DistributedPlan;
 
 
@@ -89,6 +95,18 @@ typedef struct Task
 	StringInfo queryString;     /* SQL string suitable for immediate remote execution */
 	List *taskPlacementList;    /* ShardPlacements on which the task can be executed */
 	int64 shardId;              /* Denormalized shardId of tasks for convenience */
+
+	/*
+	 * Parameterized form of the query, with constants extracted as $n
+	 * placeholders, or NULL when the query could not be parameterized. The
+	 * literal queryString above is kept regardless: EXPLAIN, statement
+	 * logging and the execution fallback paths need parameter-free SQL. The
+	 * type and value arrays are shared between the tasks of one plan.
+	 */
+	StringInfo parameterizedQueryString; /* query with constants as $n, or NULL */
+	int parameterCount;         /* number of extracted constants */
+	Oid *parameterTypes;        /* parameter type OIDs */
+	char **parameterValues;     /* parameter values in text format */
 } Task;
 
 
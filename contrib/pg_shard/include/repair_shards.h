@@ -23,6 +23,13 @@
 #define COPY_SHARD_PLACEMENT_COMMAND "SELECT worker_copy_shard_placement(%s, %s, %d)"
 #define SELECT_ALL_QUERY "SELECT * FROM %s"
 
+/* longest nap taken while enforcing the copy throttle, in microseconds */
+#define THROTTLE_SLEEP_INTERVAL_USECS 100000L
+
+
+/* configuration of shard copy behavior */
+extern int CopyThrottle;
+
 
 /* function declarations for shard repair functionality */
 extern Datum master_copy_shard_placement(PG_FUNCTION_ARGS);
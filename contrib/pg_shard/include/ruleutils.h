@@ -21,8 +21,23 @@
 #include "nodes/parsenodes.h"
 
 
+/*
+ * RelationShard maps a relation to the shard that should stand in for it when
+ * deparsing a query. A list of these is used instead of a single shard ID for
+ * queries which join several distributed tables, since each table's colocated
+ * shard carries a different shard ID suffix.
+ */
+typedef struct RelationShard
+{
+	Oid relationId;		/* distributed table referenced by the query */
+	int64 shardId;		/* shard whose name should replace the table's */
+} RelationShard;
+
+
 /* function declarations for extending and deparsing a query */
 extern void deparse_shard_query(Query *query, int64 shardid, StringInfo buffer);
+extern void deparse_shard_query_map(Query *query, List *relationShardList,
+									StringInfo buffer);
 
 
 #endif /* PG_SHARD_RULEUTILS_H */
@@ -19,7 +19,10 @@
 #include <stddef.h>
 #include <string.h>
 
+#include "access/xact.h"
 #include "commands/dbcommands.h"
+#include "create_shards.h"
+#include "distribution_metadata.h"
 #include "lib/stringinfo.h"
 #include "mb/pg_wchar.h"
 #include "utils/builtins.h"
@@ -28,6 +31,17 @@
 #include "utils/hsearch.h"
 #include "utils/memutils.h"
 #include "utils/palloc.h"
+#include "utils/timestamp.h"
+
+
+/* per-backend limit on pooled worker connections; zero means no limit */
+int MaxCachedConnections = 64;
+
+/* seconds of idleness after which a pooled connection is probed before reuse */
+int KeepaliveInterval = 30;
+
+/* open connections to all worker nodes on first use */
+bool PrewarmConnections = false;
 
 
 /*
@@ -36,9 +50,28 @@
  */
 static HTAB *NodeConnectionHash = NULL;
 
+/* number of live connections currently kept in the hash */
+static int CachedConnectionCount = 0;
+
+/* set once the pool has been prewarmed for this backend */
+static bool ConnectionsPrewarmed = false;
+
+
+/* a statement prepared on a pooled connection, found again by its query text */
+typedef struct PreparedStatement
+{
+	char *queryText;                 /* parameterized query the statement runs */
+	char statementName[NAMEDATALEN]; /* name of the statement on the remote side */
+} PreparedStatement;
+
 
 /* local function forward declarations */
 static HTAB * CreateNodeConnectionHash(void);
+static void PrewarmNodeConnections(void);
+static bool ConnectionAlive(NodeConnectionEntry *nodeConnectionEntry);
+static int ReconnectBackoffMs(int failCount);
+static void EvictIdleConnection(void);
+static void ResetPreparedStatements(NodeConnectionEntry *nodeConnectionEntry);
 static PGconn * ConnectToNode(char *nodeName, char *nodePort);
 static char * ConnectionGetOptionValue(PGconn *connection, char *optionKeyword);
 
@@ -78,6 +111,13 @@ GetConnection(char *nodeName, int32 nodePort, bool openNew)
 		NodeConnectionHash = CreateNodeConnectionHash();
 	}
 
+	if (PrewarmConnections && !ConnectionsPrewarmed)
+	{
+		/* set the flag first: prewarming itself calls GetConnection */
+		ConnectionsPrewarmed = true;
+		PrewarmNodeConnections();
+	}
+
 	memset(&nodeConnectionKey, 0, sizeof(nodeConnectionKey));
 	strncpy(nodeConnectionKey.nodeName, nodeName, MAX_NODE_LENGTH);
 	nodeConnectionKey.nodePort = nodePort;
@@ -87,13 +127,30 @@ GetConnection(char *nodeName, int32 nodePort, bool openNew)
 	if (entryFound)
 	{
 		connection = nodeConnectionEntry->connection;
-		if (PQstatus(connection) == CONNECTION_OK)
+		if (connection == NULL)
+		{
+			/*
+			 * Back off after consecutive failures instead of retrying at
+			 * once: after a node goes down, every statement re-dialing the
+			 * dead node turns failover into a connection establishment storm.
+			 */
+			if (nodeConnectionEntry->failCount > 0 &&
+				!TimestampDifferenceExceeds(nodeConnectionEntry->lastFailTime,
+											GetCurrentTimestamp(),
+											ReconnectBackoffMs(nodeConnectionEntry->failCount)))
+			{
+				return NULL;
+			}
+		}
+		else if (PQstatus(connection) == CONNECTION_OK &&
+				 ConnectionAlive(nodeConnectionEntry))
 		{
 			needNewConnection = false;
 		}
 		else
 		{
 			PurgeConnection(connection);
+			connection = NULL;
 		}
 	}
 
@@ -103,18 +160,293 @@ GetConnection(char *nodeName, int32 nodePort, bool openNew)
 		appendStringInfo(nodePortString, "%d", nodePort);
 
 		connection = ConnectToNode(nodeName, nodePortString->data);
+
+		nodeConnectionEntry = hash_search(NodeConnectionHash, &nodeConnectionKey,
+										  HASH_ENTER, &entryFound);
+		if (!entryFound)
+		{
+			nodeConnectionEntry->connection = NULL;
+			nodeConnectionEntry->lastUseTime = 0;
+			nodeConnectionEntry->lastHealthCheckTime = 0;
+			nodeConnectionEntry->lastFailTime = 0;
+			nodeConnectionEntry->failCount = 0;
+			nodeConnectionEntry->preparedStatementList = NIL;
+			nodeConnectionEntry->preparedStatementCount = 0;
+		}
+
 		if (connection != NULL)
 		{
-			nodeConnectionEntry = hash_search(NodeConnectionHash, &nodeConnectionKey,
-											  HASH_ENTER, &entryFound);
+			if (MaxCachedConnections > 0 &&
+				CachedConnectionCount >= MaxCachedConnections)
+			{
+				EvictIdleConnection();
+			}
+
+			/* statements prepared on an earlier connection died with it */
+			ResetPreparedStatements(nodeConnectionEntry);
+
 			nodeConnectionEntry->connection = connection;
+			nodeConnectionEntry->lastHealthCheckTime = GetCurrentTimestamp();
+			nodeConnectionEntry->failCount = 0;
+			CachedConnectionCount++;
+		}
+		else
+		{
+			nodeConnectionEntry->lastFailTime = GetCurrentTimestamp();
+			nodeConnectionEntry->failCount++;
 		}
 	}
 
+	if (connection != NULL)
+	{
+		nodeConnectionEntry->lastUseTime = GetCurrentTimestamp();
+	}
+
 	return connection;
 }
 
 
+/*
+ * PrewarmNodeConnections opens a connection to every worker node which hosts
+ * at least one shard placement, so that the first distributed query of this
+ * backend does not pay the connection establishment latency for each node.
+ */
+static void
+PrewarmNodeConnections(void)
+{
+	List *workerNodeList = NIL;
+	ListCell *workerNodeCell = NULL;
+
+	/* reading the placement metadata requires a transaction */
+	if (!IsTransactionState())
+	{
+		return;
+	}
+
+	workerNodeList = WorkerNodeList();
+
+	foreach(workerNodeCell, workerNodeList)
+	{
+		WorkerNode *workerNode = (WorkerNode *) lfirst(workerNodeCell);
+
+		GetConnection(workerNode->nodeName, workerNode->nodePort, true);
+	}
+}
+
+
+/*
+ * ConnectionAlive checks whether a pooled connection which has been idle for
+ * longer than the keepalive interval still responds, using an empty query as
+ * the probe. Connections inside a transaction or with a query in flight are
+ * considered alive without probing.
+ */
+static bool
+ConnectionAlive(NodeConnectionEntry *nodeConnectionEntry)
+{
+	PGconn *connection = nodeConnectionEntry->connection;
+	PGresult *result = NULL;
+	bool connectionAlive = true;
+
+	if (KeepaliveInterval <= 0)
+	{
+		return true;
+	}
+
+	if (!TimestampDifferenceExceeds(nodeConnectionEntry->lastHealthCheckTime,
+									GetCurrentTimestamp(),
+									KeepaliveInterval * 1000))
+	{
+		return true;
+	}
+
+	if (PQtransactionStatus(connection) != PQTRANS_IDLE)
+	{
+		return true;
+	}
+
+	result = PQexec(connection, "");
+	connectionAlive = (PQresultStatus(result) == PGRES_EMPTY_QUERY);
+	PQclear(result);
+
+	if (connectionAlive)
+	{
+		nodeConnectionEntry->lastHealthCheckTime = GetCurrentTimestamp();
+	}
+
+	return connectionAlive;
+}
+
+
+/*
+ * ReconnectBackoffMs computes the delay before the next connect attempt to a
+ * node: the base delay doubled for each consecutive failure, bounded by the
+ * backoff maximum.
+ */
+static int
+ReconnectBackoffMs(int failCount)
+{
+	int backoffMs = RECONNECT_BACKOFF_BASE_MS;
+
+	while (--failCount > 0 && backoffMs < RECONNECT_BACKOFF_MAX_MS)
+	{
+		backoffMs *= 2;
+	}
+
+	return Min(backoffMs, RECONNECT_BACKOFF_MAX_MS);
+}
+
+
+/*
+ * EvictIdleConnection closes the least recently used pooled connection which
+ * is neither inside a transaction nor has a query in flight. If every pooled
+ * connection is busy the pool temporarily exceeds its configured size.
+ */
+static void
+EvictIdleConnection(void)
+{
+	HASH_SEQ_STATUS hashStatus;
+	NodeConnectionEntry *nodeConnectionEntry = NULL;
+	NodeConnectionEntry *victimEntry = NULL;
+
+	hash_seq_init(&hashStatus, NodeConnectionHash);
+	while ((nodeConnectionEntry = hash_seq_search(&hashStatus)) != NULL)
+	{
+		if (nodeConnectionEntry->connection == NULL ||
+			PQtransactionStatus(nodeConnectionEntry->connection) != PQTRANS_IDLE)
+		{
+			continue;
+		}
+
+		if (victimEntry == NULL ||
+			nodeConnectionEntry->lastUseTime < victimEntry->lastUseTime)
+		{
+			victimEntry = nodeConnectionEntry;
+		}
+	}
+
+	if (victimEntry != NULL)
+	{
+		PQfinish(victimEntry->connection);
+		victimEntry->connection = NULL;
+		ResetPreparedStatements(victimEntry);
+		CachedConnectionCount--;
+	}
+}
+
+
+/*
+ * ResetPreparedStatements discards the prepared statement cache of a pool
+ * entry. This must happen whenever the entry's connection is closed or
+ * replaced: the statements live in the remote session and die with it.
+ */
+static void
+ResetPreparedStatements(NodeConnectionEntry *nodeConnectionEntry)
+{
+	ListCell *preparedStatementCell = NULL;
+
+	foreach(preparedStatementCell, nodeConnectionEntry->preparedStatementList)
+	{
+		PreparedStatement *preparedStatement =
+			(PreparedStatement *) lfirst(preparedStatementCell);
+
+		pfree(preparedStatement->queryText);
+		pfree(preparedStatement);
+	}
+
+	list_free(nodeConnectionEntry->preparedStatementList);
+	nodeConnectionEntry->preparedStatementList = NIL;
+	nodeConnectionEntry->preparedStatementCount = 0;
+}
+
+
+/*
+ * PrepareRemoteStatement returns the name of a remote prepared statement for
+ * the given query text on the given pooled connection, preparing it first if
+ * this connection has not seen the text before. Later executions of the same
+ * statement shape then ship only the statement name and parameter values,
+ * skipping the remote parser and planner.
+ *
+ * The function returns NULL when the statement cannot be prepared: the
+ * connection is not the pooled one for the node (so its lifetime is not
+ * tracked), the per-connection cache is full, or the remote PREPARE failed.
+ * Callers are expected to fall back to sending the full query text.
+ */
+char *
+PrepareRemoteStatement(char *nodeName, int32 nodePort, PGconn *connection,
+					   const char *queryText, int parameterCount,
+					   const Oid *parameterTypes)
+{
+	NodeConnectionKey nodeConnectionKey;
+	NodeConnectionEntry *nodeConnectionEntry = NULL;
+	bool entryFound = false;
+	ListCell *preparedStatementCell = NULL;
+	PreparedStatement *preparedStatement = NULL;
+	PGresult *result = NULL;
+	MemoryContext oldContext = NULL;
+
+	if (NodeConnectionHash == NULL)
+	{
+		return NULL;
+	}
+
+	memset(&nodeConnectionKey, 0, sizeof(nodeConnectionKey));
+	strncpy(nodeConnectionKey.nodeName, nodeName, MAX_NODE_LENGTH);
+	nodeConnectionKey.nodePort = nodePort;
+
+	nodeConnectionEntry = hash_search(NodeConnectionHash, &nodeConnectionKey,
+									  HASH_FIND, &entryFound);
+	if (!entryFound || nodeConnectionEntry->connection != connection)
+	{
+		return NULL;
+	}
+
+	foreach(preparedStatementCell, nodeConnectionEntry->preparedStatementList)
+	{
+		preparedStatement = (PreparedStatement *) lfirst(preparedStatementCell);
+
+		if (strcmp(preparedStatement->queryText, queryText) == 0)
+		{
+			return preparedStatement->statementName;
+		}
+	}
+
+	if (list_length(nodeConnectionEntry->preparedStatementList) >=
+		MAX_PREPARED_STATEMENTS)
+	{
+		return NULL;
+	}
+
+	preparedStatement = MemoryContextAllocZero(CacheMemoryContext,
+											   sizeof(PreparedStatement));
+	snprintf(preparedStatement->statementName, NAMEDATALEN, "pg_shard_%d",
+			 nodeConnectionEntry->preparedStatementCount);
+
+	result = PQprepare(connection, preparedStatement->statementName, queryText,
+					   parameterCount, parameterTypes);
+	if (PQresultStatus(result) != PGRES_COMMAND_OK)
+	{
+		ReportRemoteError(connection, result);
+		PQclear(result);
+		pfree(preparedStatement);
+
+		return NULL;
+	}
+	PQclear(result);
+
+	preparedStatement->queryText = MemoryContextStrdup(CacheMemoryContext,
+													   queryText);
+
+	oldContext = MemoryContextSwitchTo(CacheMemoryContext);
+	nodeConnectionEntry->preparedStatementList =
+		lappend(nodeConnectionEntry->preparedStatementList, preparedStatement);
+	MemoryContextSwitchTo(oldContext);
+
+	nodeConnectionEntry->preparedStatementCount++;
+
+	return preparedStatement->statementName;
+}
+
+
 /*
  * PurgeConnection removes the given connection from the connection hash and
  * closes it using PQfinish. If our hash does not contain the given connection,
@@ -151,16 +483,17 @@ PurgeConnection(PGconn *connection)
 	pfree(nodePortString);
 
 	nodeConnectionEntry = hash_search(NodeConnectionHash, &nodeConnectionKey,
-									  HASH_REMOVE, &entryFound);
+									  HASH_FIND, &entryFound);
 	if (entryFound)
 	{
 		/*
 		 * It's possible the provided connection matches the host and port for
 		 * an entry in the hash without being precisely the same connection. In
-		 * that case, we will want to close the hash's connection (because the
-		 * entry has already been removed) in addition to the provided one.
+		 * that case, we will want to close the hash's connection in addition
+		 * to the provided one.
 		 */
-		if (nodeConnectionEntry->connection != connection)
+		if (nodeConnectionEntry->connection != NULL &&
+			nodeConnectionEntry->connection != connection)
 		{
 			ereport(WARNING, (errmsg("hash entry for \"%s:%d\" contained different "
 									 "connection than that provided by caller",
@@ -168,6 +501,19 @@ PurgeConnection(PGconn *connection)
 									 nodeConnectionKey.nodePort)));
 			PQfinish(nodeConnectionEntry->connection);
 		}
+
+		/*
+		 * The entry itself is kept so that the node's failure history
+		 * survives the purge and drives the reconnect backoff.
+		 */
+		if (nodeConnectionEntry->connection != NULL)
+		{
+			nodeConnectionEntry->connection = NULL;
+			CachedConnectionCount--;
+		}
+		ResetPreparedStatements(nodeConnectionEntry);
+		nodeConnectionEntry->lastFailTime = GetCurrentTimestamp();
+		nodeConnectionEntry->failCount++;
 	}
 	else
 	{
@@ -299,6 +645,12 @@ ConnectToNode(char *nodeName, char *nodePort)
 
 			PQfinish(connection);
 			connection = NULL;
+
+			/* wait a little before dialing the node again */
+			if (attemptIndex < MAX_CONNECT_ATTEMPTS - 1)
+			{
+				pg_usleep((RECONNECT_BACKOFF_BASE_MS << attemptIndex) * 1000L);
+			}
 		}
 	}
 
@@ -15,6 +15,7 @@
 #include "fmgr.h"
 #include "miscadmin.h"
 
+#include "create_shards.h"
 #include "distribution_metadata.h"
 
 #include <stddef.h>
@@ -23,6 +24,7 @@
 #include "access/attnum.h"
 #include "access/htup.h"
 #include "access/tupdesc.h"
+#include "access/xact.h"
 #include "executor/spi.h"
 #include "catalog/catalog.h"
 #include "catalog/namespace.h"
@@ -31,9 +33,15 @@
 #include "nodes/memnodes.h" /* IWYU pragma: keep */
 #include "nodes/pg_list.h"
 #include "nodes/primnodes.h"
+#include "prune_shard_list.h"
+#include "storage/dsm.h"
 #include "storage/lock.h"
 #include "storage/lmgr.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
 #include "utils/builtins.h"
+#include "utils/datum.h"
 #include "utils/elog.h"
 #include "utils/errcodes.h"
 #include "utils/lsyscache.h"
@@ -47,8 +55,105 @@
  */
 static List *ShardIntervalListCache = NIL;
 
+/*
+ * The distribution metadata is identical in every backend, yet each one used
+ * to rebuild it by running SQL queries through SPI, costing tens of
+ * milliseconds per cold backend and duplicating the load on the metadata
+ * tables.  Since the metadata rarely changes, backends instead publish a
+ * read-only snapshot of it (shard intervals and placements for the whole
+ * database) in a dynamic shared memory segment, and serve lookups from that
+ * snapshot until the shared version counter moves.
+ *
+ * The version counter is bumped when a transaction that modified the
+ * metadata commits, so snapshot readers never see uncommitted changes.  A
+ * backend that has itself modified the metadata bypasses the snapshot until
+ * its transaction ends, preserving read-your-writes behavior.  The shared
+ * control block tracks a single snapshot; if several databases on one
+ * cluster use pg_shard, they take turns publishing, which is correct but
+ * only benefits the database that published last.
+ */
+typedef struct SharedMetadataControl
+{
+	slock_t mutex;              /* protects all fields below */
+	uint32 version;             /* bumped by committed metadata changes */
+	bool snapshotValid;         /* do the snapshot fields point anywhere? */
+	Oid snapshotDatabaseId;     /* database the snapshot was built in */
+	uint32 snapshotVersion;     /* version the snapshot was built from */
+	dsm_handle snapshotHandle;  /* segment containing the snapshot */
+} SharedMetadataControl;
+
+/* per-table directory entry within a metadata snapshot */
+typedef struct SharedTableEntry
+{
+	Oid relationId;     /* distributed table; entries sorted by this key */
+	int firstInterval;  /* index of the table's first shard interval */
+	int intervalCount;  /* number of shard intervals for the table */
+} SharedTableEntry;
+
+/* flattened ShardInterval; by-reference datums become segment offsets */
+typedef struct SharedShardInterval
+{
+	int64 id;
+	Oid relationId;
+	Oid valueTypeId;
+	int16 valueTypeLength;
+	bool valueByVal;
+	Datum minValue;     /* value if by-value, else offset into segment */
+	Datum maxValue;     /* likewise */
+} SharedShardInterval;
+
+/* flattened ShardPlacement; entries are sorted by shardId */
+typedef struct SharedShardPlacement
+{
+	int64 id;
+	int64 shardId;
+	int32 shardState;
+	int32 nodePort;
+	Size nodeNameOffset;    /* offset of NUL-terminated hostname */
+} SharedShardPlacement;
+
+/* header of a metadata snapshot segment; all offsets are from the header */
+typedef struct SharedMetadataSnapshot
+{
+	uint32 version;         /* metadata version this snapshot reflects */
+	Oid databaseId;         /* database this snapshot was built in */
+	int tableCount;
+	int intervalCount;
+	int placementCount;
+	Size tableOffset;       /* SharedTableEntry[tableCount] */
+	Size intervalOffset;    /* SharedShardInterval[intervalCount] */
+	Size placementOffset;   /* SharedShardPlacement[placementCount] */
+} SharedMetadataSnapshot;
+
+/* advisory lock field used to serialize snapshot builds (see ShardLockType) */
+#define SHARD_LOCK_CACHE_BUILD 5
+
+/* controls use of the shared metadata cache; see pg_shard.c for the GUC */
+bool UseSharedMetadataCache = true;
+
+static SharedMetadataControl *MetadataCacheControl = NULL;
+static dsm_segment *MetadataCacheSegment = NULL;
+static uint32 MetadataCacheSegmentVersion = 0;
+static uint32 LastSeenMetadataVersion = 0;
+static bool MetadataModifiedInXact = false;
+static bool MetadataXactCallbackRegistered = false;
+
 
 /* local function forward declarations */
+static SharedMetadataControl * MetadataCacheGetControl(void);
+static uint32 MetadataCacheVersion(void);
+static void MetadataXactCallback(XactEvent event, void *arg);
+static void RecordMetadataWrite(void);
+static void ResetLocalMetadataCaches(void);
+static SharedMetadataSnapshot * MetadataCacheSnapshot(void);
+static dsm_segment * MetadataSnapshotBuild(uint32 version);
+static List * DistributedTableIdList(void);
+static List * AllShardPlacementList(void);
+static List * SharedMetadataShardIntervalList(Oid distributedTableId,
+											  bool *foundInCache);
+static List * SharedMetadataShardPlacementList(int64 shardId, bool *foundInCache);
+static bool ShardIntervalRangesEqual(ShardInterval *leftInterval,
+									 ShardInterval *rightInterval);
 static ShardInterval * TupleToShardInterval(HeapTuple heapTuple,
 											TupleDesc tupleDescriptor);
 static ShardPlacement * TupleToShardPlacement(HeapTuple heapTuple,
@@ -57,6 +162,765 @@ static void AcquireShardLock(int64 shardId, ShardLockType shardLockType,
 							 LOCKMODE lockMode);
 
 
+/*
+ * MetadataCacheGetControl attaches to (initializing if necessary) the small
+ * shared control block used by the metadata cache. pg_shard does not require
+ * preloading, so the block is carved from shared memory slop on first use.
+ */
+static SharedMetadataControl *
+MetadataCacheGetControl(void)
+{
+	if (MetadataCacheControl == NULL)
+	{
+		bool alreadyInitialized = false;
+
+		LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+		MetadataCacheControl =
+			ShmemInitStruct("pg_shard metadata cache",
+							sizeof(SharedMetadataControl), &alreadyInitialized);
+		if (!alreadyInitialized)
+		{
+			SpinLockInit(&MetadataCacheControl->mutex);
+			MetadataCacheControl->version = 1;
+			MetadataCacheControl->snapshotValid = false;
+			MetadataCacheControl->snapshotDatabaseId = InvalidOid;
+			MetadataCacheControl->snapshotVersion = 0;
+			MetadataCacheControl->snapshotHandle = 0;
+		}
+
+		LWLockRelease(AddinShmemInitLock);
+	}
+
+	return MetadataCacheControl;
+}
+
+
+/*
+ * MetadataCacheVersion returns the current shared metadata version, or zero
+ * when the shared cache is disabled or unavailable.
+ */
+static uint32
+MetadataCacheVersion(void)
+{
+	SharedMetadataControl *control = NULL;
+	uint32 version = 0;
+
+	if (!UseSharedMetadataCache || !IsUnderPostmaster)
+	{
+		return 0;
+	}
+
+	control = MetadataCacheGetControl();
+
+	SpinLockAcquire(&control->mutex);
+	version = control->version;
+	SpinLockRelease(&control->mutex);
+
+	return version;
+}
+
+
+/*
+ * MetadataXactCallback publishes this backend's metadata modifications by
+ * bumping the shared version counter once they actually commit. On abort the
+ * modification flag is simply discarded.
+ */
+static void
+MetadataXactCallback(XactEvent event, void *arg)
+{
+	switch (event)
+	{
+		case XACT_EVENT_COMMIT:
+		case XACT_EVENT_PREPARE:
+		{
+			if (MetadataModifiedInXact && IsUnderPostmaster)
+			{
+				SharedMetadataControl *control = MetadataCacheGetControl();
+
+				SpinLockAcquire(&control->mutex);
+				control->version++;
+				SpinLockRelease(&control->mutex);
+			}
+			MetadataModifiedInXact = false;
+			break;
+		}
+
+		case XACT_EVENT_ABORT:
+		{
+			MetadataModifiedInXact = false;
+			break;
+		}
+
+		default:
+		{
+			break;
+		}
+	}
+}
+
+
+/*
+ * RecordMetadataWrite notes that the current transaction has modified the
+ * distribution metadata. Until the transaction ends, shared snapshot reads
+ * are bypassed so the backend sees its own uncommitted changes; at commit,
+ * the shared version is bumped so that all backends refresh.
+ */
+static void
+RecordMetadataWrite(void)
+{
+	if (!MetadataXactCallbackRegistered)
+	{
+		RegisterXactCallback(MetadataXactCallback, NULL);
+		MetadataXactCallbackRegistered = true;
+	}
+
+	/* make sure the control block exists before the commit callback runs */
+	if (UseSharedMetadataCache && IsUnderPostmaster)
+	{
+		(void) MetadataCacheGetControl();
+	}
+
+	MetadataModifiedInXact = true;
+}
+
+
+/*
+ * ResetLocalMetadataCaches drops every per-backend cache derived from the
+ * distribution metadata; used when the shared version counter reveals that
+ * another backend has changed the metadata.
+ */
+static void
+ResetLocalMetadataCaches(void)
+{
+	ListCell *cacheEntryCell = NULL;
+
+	foreach(cacheEntryCell, ShardIntervalListCache)
+	{
+		ShardIntervalListCacheEntry *cacheEntry = lfirst(cacheEntryCell);
+
+		InvalidateShardPruningCache(cacheEntry->distributedTableId);
+	}
+
+	ShardIntervalListCache = NIL;
+}
+
+
+/*
+ * MetadataCacheSnapshot returns the current metadata snapshot for this
+ * database, attaching to a published segment or building a fresh one as
+ * required. It returns NULL when the shared cache cannot be used, in which
+ * case callers fall back to loading metadata through SPI.
+ */
+static SharedMetadataSnapshot *
+MetadataCacheSnapshot(void)
+{
+	SharedMetadataControl *control = NULL;
+	dsm_segment *segment = NULL;
+	uint32 version = 0;
+	dsm_handle snapshotHandle = 0;
+	bool snapshotUsable = false;
+	LOCKTAG lockTag;
+
+	if (!UseSharedMetadataCache || !IsUnderPostmaster)
+	{
+		return NULL;
+	}
+
+	control = MetadataCacheGetControl();
+
+	SpinLockAcquire(&control->mutex);
+	version = control->version;
+	if (control->snapshotValid &&
+		control->snapshotDatabaseId == MyDatabaseId &&
+		control->snapshotVersion == version)
+	{
+		snapshotHandle = control->snapshotHandle;
+		snapshotUsable = true;
+	}
+	SpinLockRelease(&control->mutex);
+
+	/* fast path: the segment we are already attached to is still current */
+	if (MetadataCacheSegment != NULL)
+	{
+		if (MetadataCacheSegmentVersion == version)
+		{
+			return (SharedMetadataSnapshot *)
+				dsm_segment_address(MetadataCacheSegment);
+		}
+
+		dsm_detach(MetadataCacheSegment);
+		MetadataCacheSegment = NULL;
+		MetadataCacheSegmentVersion = 0;
+	}
+
+	/* try to attach a snapshot another backend has already published */
+	if (snapshotUsable)
+	{
+		segment = dsm_attach(snapshotHandle);
+		if (segment != NULL)
+		{
+			SharedMetadataSnapshot *snapshot = dsm_segment_address(segment);
+
+			if (snapshot->version == version &&
+				snapshot->databaseId == MyDatabaseId)
+			{
+				dsm_pin_mapping(segment);
+				MetadataCacheSegment = segment;
+				MetadataCacheSegmentVersion = version;
+				return snapshot;
+			}
+
+			dsm_detach(segment);
+			segment = NULL;
+		}
+	}
+
+	/*
+	 * No usable snapshot is published, so build one. An advisory lock keeps a
+	 * thundering herd of cold backends from all building at once; whoever
+	 * gets the lock first builds, and the rest attach to the result.
+	 */
+	memset(&lockTag, 0, sizeof(LOCKTAG));
+	SET_LOCKTAG_ADVISORY(lockTag, MyDatabaseId, 0, 0, SHARD_LOCK_CACHE_BUILD);
+	(void) LockAcquire(&lockTag, ExclusiveLock, false, false);
+
+	/* somebody may have published a snapshot while we waited */
+	SpinLockAcquire(&control->mutex);
+	version = control->version;
+	snapshotUsable = (control->snapshotValid &&
+					  control->snapshotDatabaseId == MyDatabaseId &&
+					  control->snapshotVersion == version);
+	snapshotHandle = control->snapshotHandle;
+	SpinLockRelease(&control->mutex);
+
+	if (snapshotUsable)
+	{
+		segment = dsm_attach(snapshotHandle);
+	}
+
+	if (segment == NULL)
+	{
+		segment = MetadataSnapshotBuild(version);
+
+		SpinLockAcquire(&control->mutex);
+		control->snapshotValid = true;
+		control->snapshotDatabaseId = MyDatabaseId;
+		control->snapshotVersion = version;
+		control->snapshotHandle = dsm_segment_handle(segment);
+		SpinLockRelease(&control->mutex);
+	}
+
+	(void) LockRelease(&lockTag, ExclusiveLock, false);
+
+	dsm_pin_mapping(segment);
+	MetadataCacheSegment = segment;
+	MetadataCacheSegmentVersion = version;
+
+	return (SharedMetadataSnapshot *) dsm_segment_address(segment);
+}
+
+
+/*
+ * MetadataSnapshotBuild loads the complete distribution metadata for the
+ * current database through SPI and serializes it into a new dynamic shared
+ * memory segment stamped with the given version. By-reference datums and
+ * hostnames are flattened into the segment so readers need no further
+ * catalog or metadata table access.
+ */
+static dsm_segment *
+MetadataSnapshotBuild(uint32 version)
+{
+	dsm_segment *segment = NULL;
+	SharedMetadataSnapshot *snapshot = NULL;
+	char *segmentBase = NULL;
+	SharedTableEntry *tableEntries = NULL;
+	SharedShardInterval *sharedIntervals = NULL;
+	SharedShardPlacement *sharedPlacements = NULL;
+	List *tableIdList = NIL;
+	List *intervalListList = NIL;
+	List *placementList = NIL;
+	ListCell *tableIdCell = NULL;
+	ListCell *intervalListCell = NULL;
+	ListCell *placementCell = NULL;
+	int tableCount = 0;
+	int intervalCount = 0;
+	int placementCount = 0;
+	int tableIndex = 0;
+	int intervalIndex = 0;
+	int placementIndex = 0;
+	Size valueSize = 0;
+	Size segmentSize = 0;
+	Size valueOffset = 0;
+	MemoryContext buildContext = NULL;
+	MemoryContext oldContext = NULL;
+
+	/* collect everything in a private context we can drop afterwards */
+	buildContext = AllocSetContextCreate(CurrentMemoryContext,
+										 "MetadataSnapshotBuild",
+										 ALLOCSET_DEFAULT_MINSIZE,
+										 ALLOCSET_DEFAULT_INITSIZE,
+										 ALLOCSET_DEFAULT_MAXSIZE);
+	oldContext = MemoryContextSwitchTo(buildContext);
+
+	tableIdList = DistributedTableIdList();
+	foreach(tableIdCell, tableIdList)
+	{
+		Oid tableId = lfirst_oid(tableIdCell);
+		List *intervalList = LoadShardIntervalList(tableId);
+		ListCell *intervalCell = NULL;
+
+		intervalListList = lappend(intervalListList, intervalList);
+		intervalCount += list_length(intervalList);
+
+		foreach(intervalCell, intervalList)
+		{
+			ShardInterval *interval = (ShardInterval *) lfirst(intervalCell);
+			int16 typeLength = 0;
+			bool typeByValue = false;
+
+			get_typlenbyval(interval->valueTypeId, &typeLength, &typeByValue);
+			if (!typeByValue)
+			{
+				valueSize += MAXALIGN(datumGetSize(interval->minValue,
+												   typeByValue, typeLength));
+				valueSize += MAXALIGN(datumGetSize(interval->maxValue,
+												   typeByValue, typeLength));
+			}
+		}
+	}
+
+	placementList = AllShardPlacementList();
+	foreach(placementCell, placementList)
+	{
+		ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
+
+		valueSize += MAXALIGN(strlen(placement->nodeName) + 1);
+	}
+
+	tableCount = list_length(tableIdList);
+	placementCount = list_length(placementList);
+
+	segmentSize = MAXALIGN(sizeof(SharedMetadataSnapshot));
+	segmentSize += MAXALIGN(tableCount * sizeof(SharedTableEntry));
+	segmentSize += MAXALIGN(intervalCount * sizeof(SharedShardInterval));
+	segmentSize += MAXALIGN(placementCount * sizeof(SharedShardPlacement));
+	segmentSize += valueSize;
+
+	segment = dsm_create(segmentSize, 0);
+	segmentBase = dsm_segment_address(segment);
+
+	snapshot = (SharedMetadataSnapshot *) segmentBase;
+	snapshot->version = version;
+	snapshot->databaseId = MyDatabaseId;
+	snapshot->tableCount = tableCount;
+	snapshot->intervalCount = intervalCount;
+	snapshot->placementCount = placementCount;
+	snapshot->tableOffset = MAXALIGN(sizeof(SharedMetadataSnapshot));
+	snapshot->intervalOffset = snapshot->tableOffset +
+							   MAXALIGN(tableCount * sizeof(SharedTableEntry));
+	snapshot->placementOffset = snapshot->intervalOffset +
+								MAXALIGN(intervalCount *
+										 sizeof(SharedShardInterval));
+	valueOffset = snapshot->placementOffset +
+				  MAXALIGN(placementCount * sizeof(SharedShardPlacement));
+
+	tableEntries = (SharedTableEntry *) (segmentBase + snapshot->tableOffset);
+	sharedIntervals = (SharedShardInterval *)
+		(segmentBase + snapshot->intervalOffset);
+	sharedPlacements = (SharedShardPlacement *)
+		(segmentBase + snapshot->placementOffset);
+
+	forboth(tableIdCell, tableIdList, intervalListCell, intervalListList)
+	{
+		List *intervalList = (List *) lfirst(intervalListCell);
+		ListCell *intervalCell = NULL;
+		SharedTableEntry *tableEntry = &tableEntries[tableIndex];
+
+		tableEntry->relationId = lfirst_oid(tableIdCell);
+		tableEntry->firstInterval = intervalIndex;
+		tableEntry->intervalCount = list_length(intervalList);
+		tableIndex++;
+
+		foreach(intervalCell, intervalList)
+		{
+			ShardInterval *interval = (ShardInterval *) lfirst(intervalCell);
+			SharedShardInterval *sharedInterval = &sharedIntervals[intervalIndex];
+			int16 typeLength = 0;
+			bool typeByValue = false;
+
+			get_typlenbyval(interval->valueTypeId, &typeLength, &typeByValue);
+
+			sharedInterval->id = interval->id;
+			sharedInterval->relationId = interval->relationId;
+			sharedInterval->valueTypeId = interval->valueTypeId;
+			sharedInterval->valueTypeLength = typeLength;
+			sharedInterval->valueByVal = typeByValue;
+
+			if (typeByValue)
+			{
+				sharedInterval->minValue = interval->minValue;
+				sharedInterval->maxValue = interval->maxValue;
+			}
+			else
+			{
+				Size minValueSize = datumGetSize(interval->minValue,
+												 typeByValue, typeLength);
+				Size maxValueSize = datumGetSize(interval->maxValue,
+												 typeByValue, typeLength);
+
+				memcpy(segmentBase + valueOffset,
+					   DatumGetPointer(interval->minValue), minValueSize);
+				sharedInterval->minValue = (Datum) valueOffset;
+				valueOffset += MAXALIGN(minValueSize);
+
+				memcpy(segmentBase + valueOffset,
+					   DatumGetPointer(interval->maxValue), maxValueSize);
+				sharedInterval->maxValue = (Datum) valueOffset;
+				valueOffset += MAXALIGN(maxValueSize);
+			}
+
+			intervalIndex++;
+		}
+	}
+
+	foreach(placementCell, placementList)
+	{
+		ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
+		SharedShardPlacement *sharedPlacement = &sharedPlacements[placementIndex];
+		Size nodeNameSize = strlen(placement->nodeName) + 1;
+
+		sharedPlacement->id = placement->id;
+		sharedPlacement->shardId = placement->shardId;
+		sharedPlacement->shardState = (int32) placement->shardState;
+		sharedPlacement->nodePort = placement->nodePort;
+
+		memcpy(segmentBase + valueOffset, placement->nodeName, nodeNameSize);
+		sharedPlacement->nodeNameOffset = valueOffset;
+		valueOffset += MAXALIGN(nodeNameSize);
+
+		placementIndex++;
+	}
+
+	Assert(valueOffset <= segmentSize);
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(buildContext);
+
+	return segment;
+}
+
+
+/*
+ * DistributedTableIdList returns the identifiers of every distributed table
+ * in the current database, ordered by identifier.
+ */
+static List *
+DistributedTableIdList(void)
+{
+	List *tableIdList = NIL;
+	int spiStatus PG_USED_FOR_ASSERTS_ONLY = 0;
+	static SPIPlanPtr spiPlan = NULL;
+
+	/*
+	 * SPI_connect switches to an SPI-specific MemoryContext. See the comment
+	 * in LoadShardIntervalList for a more extensive explanation.
+	 */
+	MemoryContext upperContext = CurrentMemoryContext, oldContext = NULL;
+	SPI_connect();
+
+	if (spiPlan == NULL)
+	{
+		spiPlan = SPI_prepare("SELECT relation_id "
+							  "FROM pgs_distribution_metadata.partition "
+							  "ORDER BY relation_id", 0, NULL);
+
+		spiStatus = SPI_keepplan(spiPlan);
+		Assert(spiStatus == 0);
+	}
+
+	spiStatus = SPI_execute_plan(spiPlan, NULL, NULL, false, 0);
+	Assert(spiStatus == SPI_OK_SELECT);
+
+	oldContext = MemoryContextSwitchTo(upperContext);
+
+	for (uint32 rowNumber = 0; rowNumber < SPI_processed; rowNumber++)
+	{
+		bool isNull = false;
+		Datum relationIdDatum = SPI_getbinval(SPI_tuptable->vals[rowNumber],
+											  SPI_tuptable->tupdesc, 1, &isNull);
+
+		tableIdList = lappend_oid(tableIdList, DatumGetObjectId(relationIdDatum));
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	SPI_finish();
+
+	return tableIdList;
+}
+
+
+/*
+ * AllShardPlacementList returns every shard placement in the current
+ * database, ordered by shard identifier so that the serialized form can be
+ * searched with a binary search.
+ */
+static List *
+AllShardPlacementList(void)
+{
+	List *shardPlacementList = NIL;
+	int spiStatus PG_USED_FOR_ASSERTS_ONLY = 0;
+	static SPIPlanPtr spiPlan = NULL;
+
+	/*
+	 * SPI_connect switches to an SPI-specific MemoryContext. See the comment
+	 * in LoadShardIntervalList for a more extensive explanation.
+	 */
+	MemoryContext upperContext = CurrentMemoryContext, oldContext = NULL;
+	SPI_connect();
+
+	if (spiPlan == NULL)
+	{
+		spiPlan = SPI_prepare("SELECT id, shard_id, shard_state, "
+							  "node_name, node_port "
+							  "FROM pgs_distribution_metadata.shard_placement "
+							  "ORDER BY shard_id", 0, NULL);
+
+		spiStatus = SPI_keepplan(spiPlan);
+		Assert(spiStatus == 0);
+	}
+
+	spiStatus = SPI_execute_plan(spiPlan, NULL, NULL, false, 0);
+	Assert(spiStatus == SPI_OK_SELECT);
+
+	oldContext = MemoryContextSwitchTo(upperContext);
+
+	for (uint32 rowNumber = 0; rowNumber < SPI_processed; rowNumber++)
+	{
+		HeapTuple heapTuple = SPI_tuptable->vals[rowNumber];
+		ShardPlacement *shardPlacement = TupleToShardPlacement(heapTuple,
+															   SPI_tuptable->tupdesc);
+		shardPlacementList = lappend(shardPlacementList, shardPlacement);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	SPI_finish();
+
+	return shardPlacementList;
+}
+
+
+/*
+ * SharedMetadataShardIntervalList serves a shard interval list from the
+ * shared snapshot. On success it sets foundInCache and returns a list of
+ * backend-local ShardIntervals (the snapshot is authoritative for the whole
+ * database, so an unknown or shardless table yields an empty list). When the
+ * shared cache cannot be consulted, foundInCache remains false and the
+ * caller must fall back to SPI.
+ */
+static List *
+SharedMetadataShardIntervalList(Oid distributedTableId, bool *foundInCache)
+{
+	List *shardIntervalList = NIL;
+	SharedMetadataSnapshot *snapshot = NULL;
+	SharedTableEntry *tableEntries = NULL;
+	SharedTableEntry *tableEntry = NULL;
+	char *segmentBase = NULL;
+	int lowIndex = 0;
+	int highIndex = 0;
+	int intervalIndex = 0;
+
+	*foundInCache = false;
+
+	/* a backend with uncommitted metadata changes must see its own writes */
+	if (MetadataModifiedInXact)
+	{
+		return NIL;
+	}
+
+	snapshot = MetadataCacheSnapshot();
+	if (snapshot == NULL)
+	{
+		return NIL;
+	}
+
+	*foundInCache = true;
+
+	segmentBase = (char *) snapshot;
+	tableEntries = (SharedTableEntry *) (segmentBase + snapshot->tableOffset);
+
+	/* binary search the per-table directory */
+	highIndex = snapshot->tableCount - 1;
+	while (lowIndex <= highIndex)
+	{
+		int middleIndex = (lowIndex + highIndex) / 2;
+
+		if (tableEntries[middleIndex].relationId < distributedTableId)
+		{
+			lowIndex = middleIndex + 1;
+		}
+		else if (tableEntries[middleIndex].relationId > distributedTableId)
+		{
+			highIndex = middleIndex - 1;
+		}
+		else
+		{
+			tableEntry = &tableEntries[middleIndex];
+			break;
+		}
+	}
+
+	if (tableEntry == NULL)
+	{
+		return NIL;
+	}
+
+	for (intervalIndex = tableEntry->firstInterval;
+		 intervalIndex < tableEntry->firstInterval + tableEntry->intervalCount;
+		 intervalIndex++)
+	{
+		SharedShardInterval *sharedInterval =
+			&((SharedShardInterval *) (segmentBase +
+									   snapshot->intervalOffset))[intervalIndex];
+		ShardInterval *shardInterval = palloc0(sizeof(ShardInterval));
+
+		shardInterval->id = sharedInterval->id;
+		shardInterval->relationId = sharedInterval->relationId;
+		shardInterval->valueTypeId = sharedInterval->valueTypeId;
+
+		/*
+		 * By-reference values are copied out of the segment so the cached
+		 * list stays valid after the snapshot is replaced and detached.
+		 */
+		if (sharedInterval->valueByVal)
+		{
+			shardInterval->minValue = sharedInterval->minValue;
+			shardInterval->maxValue = sharedInterval->maxValue;
+		}
+		else
+		{
+			Datum minValuePointer =
+				PointerGetDatum(segmentBase + sharedInterval->minValue);
+			Datum maxValuePointer =
+				PointerGetDatum(segmentBase + sharedInterval->maxValue);
+
+			shardInterval->minValue = datumCopy(minValuePointer, false,
+												sharedInterval->valueTypeLength);
+			shardInterval->maxValue = datumCopy(maxValuePointer, false,
+												sharedInterval->valueTypeLength);
+		}
+
+		shardIntervalList = lappend(shardIntervalList, shardInterval);
+	}
+
+	return shardIntervalList;
+}
+
+
+/*
+ * SharedMetadataShardPlacementList serves a shard's placement list from the
+ * shared snapshot, mirroring SharedMetadataShardIntervalList. The returned
+ * placements are allocated in the caller's memory context, just like those
+ * built by LoadShardPlacementList.
+ */
+static List *
+SharedMetadataShardPlacementList(int64 shardId, bool *foundInCache)
+{
+	List *shardPlacementList = NIL;
+	SharedMetadataSnapshot *snapshot = NULL;
+	SharedShardPlacement *sharedPlacements = NULL;
+	char *segmentBase = NULL;
+	int lowIndex = 0;
+	int highIndex = 0;
+	int firstMatch = -1;
+	int placementIndex = 0;
+
+	*foundInCache = false;
+
+	/* a backend with uncommitted metadata changes must see its own writes */
+	if (MetadataModifiedInXact)
+	{
+		return NIL;
+	}
+
+	snapshot = MetadataCacheSnapshot();
+	if (snapshot == NULL)
+	{
+		return NIL;
+	}
+
+	*foundInCache = true;
+
+	segmentBase = (char *) snapshot;
+	sharedPlacements = (SharedShardPlacement *)
+		(segmentBase + snapshot->placementOffset);
+
+	/* binary search for the leftmost placement of this shard */
+	highIndex = snapshot->placementCount;
+	while (lowIndex < highIndex)
+	{
+		int middleIndex = (lowIndex + highIndex) / 2;
+
+		if (sharedPlacements[middleIndex].shardId < shardId)
+		{
+			lowIndex = middleIndex + 1;
+		}
+		else
+		{
+			highIndex = middleIndex;
+		}
+	}
+	firstMatch = lowIndex;
+
+	for (placementIndex = firstMatch;
+		 placementIndex < snapshot->placementCount &&
+		 sharedPlacements[placementIndex].shardId == shardId;
+		 placementIndex++)
+	{
+		SharedShardPlacement *sharedPlacement = &sharedPlacements[placementIndex];
+		ShardPlacement *shardPlacement = palloc0(sizeof(ShardPlacement));
+
+		shardPlacement->id = sharedPlacement->id;
+		shardPlacement->shardId = sharedPlacement->shardId;
+		shardPlacement->shardState = (ShardState) sharedPlacement->shardState;
+		shardPlacement->nodeName =
+			pstrdup(segmentBase + sharedPlacement->nodeNameOffset);
+		shardPlacement->nodePort = sharedPlacement->nodePort;
+
+		shardPlacementList = lappend(shardPlacementList, shardPlacement);
+	}
+
+	return shardPlacementList;
+}
+
+
+/*
+ * InvalidateShardIntervalListCache drops this backend's cached shard interval
+ * list for the given table, together with the pruning caches built on top of
+ * it, so that later plans see the modified shard layout.
+ */
+static void
+InvalidateShardIntervalListCache(Oid distributedTableId)
+{
+	ListCell *cacheEntryCell = NULL;
+
+	foreach(cacheEntryCell, ShardIntervalListCache)
+	{
+		ShardIntervalListCacheEntry *cacheEntry = lfirst(cacheEntryCell);
+		if (cacheEntry->distributedTableId == distributedTableId)
+		{
+			ShardIntervalListCache = list_delete_ptr(ShardIntervalListCache,
+													 cacheEntry);
+			break;
+		}
+	}
+
+	InvalidateShardPruningCache(distributedTableId);
+}
+
+
 /*
  * LookupShardIntervalList is wrapper around LoadShardIntervalList that uses a
  * cache to avoid multiple lookups of a distributed table's shards within a
@@ -67,6 +931,14 @@ LookupShardIntervalList(Oid distributedTableId)
 {
 	ShardIntervalListCacheEntry *matchingCacheEntry = NULL;
 	ListCell *cacheEntryCell = NULL;
+	uint32 sharedVersion = MetadataCacheVersion();
+
+	/* drop all local caches when another backend changed the metadata */
+	if (sharedVersion != LastSeenMetadataVersion)
+	{
+		ResetLocalMetadataCaches();
+		LastSeenMetadataVersion = sharedVersion;
+	}
 
 	/* search the cache */
 	foreach(cacheEntryCell, ShardIntervalListCache)
@@ -83,8 +955,16 @@ LookupShardIntervalList(Oid distributedTableId)
 	if (matchingCacheEntry == NULL)
 	{
 		MemoryContext oldContext = MemoryContextSwitchTo(CacheMemoryContext);
+		bool foundInCache = false;
+
+		/* prefer the shared snapshot; fall back to loading through SPI */
+		List *loadedIntervalList =
+			SharedMetadataShardIntervalList(distributedTableId, &foundInCache);
+		if (!foundInCache)
+		{
+			loadedIntervalList = LoadShardIntervalList(distributedTableId);
+		}
 
-		List *loadedIntervalList = LoadShardIntervalList(distributedTableId);
 		if (loadedIntervalList != NIL)
 		{
 			matchingCacheEntry = palloc0(sizeof(ShardIntervalListCacheEntry));
@@ -252,9 +1132,72 @@ List *
 LoadShardPlacementList(int64 shardId)
 {
 	List *shardPlacementList = NIL;
-	Oid argTypes[] = { INT8OID };
-	Datum argValues[] = { Int64GetDatum(shardId) };
-	const int argCount = sizeof(argValues) / sizeof(argValues[0]);
+	bool foundInCache = false;
+
+	/* prefer the shared snapshot; fall back to loading through SPI */
+	shardPlacementList = SharedMetadataShardPlacementList(shardId, &foundInCache);
+	if (!foundInCache)
+	{
+		Oid argTypes[] = { INT8OID };
+		Datum argValues[] = { Int64GetDatum(shardId) };
+		const int argCount = sizeof(argValues) / sizeof(argValues[0]);
+		int spiStatus PG_USED_FOR_ASSERTS_ONLY = 0;
+		static SPIPlanPtr spiPlan = NULL;
+
+		/*
+		 * SPI_connect switches to an SPI-specific MemoryContext. See the
+		 * comment in LoadShardIntervalList for a more extensive explanation.
+		 */
+		MemoryContext upperContext = CurrentMemoryContext, oldContext = NULL;
+		SPI_connect();
+
+		if (spiPlan == NULL)
+		{
+			spiPlan = SPI_prepare(SHARD_PLACEMENT_QUERY, argCount, argTypes);
+
+			spiStatus = SPI_keepplan(spiPlan);
+			Assert(spiStatus == 0);
+		}
+
+		spiStatus = SPI_execute_plan(spiPlan, argValues, NULL, false, 0);
+		Assert(spiStatus == SPI_OK_SELECT);
+
+		oldContext = MemoryContextSwitchTo(upperContext);
+
+		for (uint32 rowNumber = 0; rowNumber < SPI_processed; rowNumber++)
+		{
+			HeapTuple heapTuple = SPI_tuptable->vals[rowNumber];
+			ShardPlacement *shardPlacement = TupleToShardPlacement(heapTuple,
+																   SPI_tuptable->tupdesc);
+			shardPlacementList = lappend(shardPlacementList, shardPlacement);
+		}
+
+		MemoryContextSwitchTo(oldContext);
+
+		SPI_finish();
+	}
+
+	/* if no shard placements are found, error out */
+	if (shardPlacementList == NIL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_NO_DATA),
+						errmsg("no placements exist for shard with ID "
+							   INT64_FORMAT, shardId)));
+	}
+
+	return shardPlacementList;
+}
+
+
+/*
+ * WorkerNodeList returns a list of WorkerNodes for every distinct node which
+ * hosts at least one shard placement. Unlike the shard placement loaders, the
+ * function simply returns NIL when no placements exist yet.
+ */
+List *
+WorkerNodeList(void)
+{
+	List *workerNodeList = NIL;
 	int spiStatus PG_USED_FOR_ASSERTS_ONLY = 0;
 	static SPIPlanPtr spiPlan = NULL;
 
@@ -267,13 +1210,13 @@ LoadShardPlacementList(int64 shardId)
 
 	if (spiPlan == NULL)
 	{
-		spiPlan = SPI_prepare(SHARD_PLACEMENT_QUERY, argCount, argTypes);
+		spiPlan = SPI_prepare(WORKER_NODE_QUERY, 0, NULL);
 
 		spiStatus = SPI_keepplan(spiPlan);
 		Assert(spiStatus == 0);
 	}
 
-	spiStatus = SPI_execute_plan(spiPlan, argValues, NULL, false, 0);
+	spiStatus = SPI_execute_plan(spiPlan, NULL, NULL, false, 0);
 	Assert(spiStatus == SPI_OK_SELECT);
 
 	oldContext = MemoryContextSwitchTo(upperContext);
@@ -281,24 +1224,24 @@ LoadShardPlacementList(int64 shardId)
 	for (uint32 rowNumber = 0; rowNumber < SPI_processed; rowNumber++)
 	{
 		HeapTuple heapTuple = SPI_tuptable->vals[rowNumber];
-		ShardPlacement *shardPlacement = TupleToShardPlacement(heapTuple,
-															   SPI_tuptable->tupdesc);
-		shardPlacementList = lappend(shardPlacementList, shardPlacement);
+		TupleDesc tupleDescriptor = SPI_tuptable->tupdesc;
+		bool isNull = false;
+
+		Datum nodeNameDatum = SPI_getbinval(heapTuple, tupleDescriptor, 1, &isNull);
+		Datum nodePortDatum = SPI_getbinval(heapTuple, tupleDescriptor, 2, &isNull);
+
+		WorkerNode *workerNode = palloc0(sizeof(WorkerNode));
+		workerNode->nodeName = TextDatumGetCString(nodeNameDatum);
+		workerNode->nodePort = DatumGetInt32(nodePortDatum);
+
+		workerNodeList = lappend(workerNodeList, workerNode);
 	}
 
 	MemoryContextSwitchTo(oldContext);
 
 	SPI_finish();
 
-	/* if no shard placements are found, error out */
-	if (shardPlacementList == NIL)
-	{
-		ereport(ERROR, (errcode(ERRCODE_NO_DATA),
-						errmsg("no placements exist for shard with ID "
-							   INT64_FORMAT, shardId)));
-	}
-
-	return shardPlacementList;
+	return workerNodeList;
 }
 
 
@@ -505,6 +1448,118 @@ DistributedTablesExist(void)
 }
 
 
+/*
+ * TablesColocated determines whether two distributed tables are colocated,
+ * i.e. whether they are partitioned the same way: same partition type, same
+ * partition column type, and shard intervals covering exactly the same value
+ * ranges. Queries joining colocated tables on their partition columns can be
+ * answered by pairing up the range-equal shards of the tables.
+ */
+bool
+TablesColocated(Oid leftRelationId, Oid rightRelationId)
+{
+	Var *leftColumn = NULL;
+	Var *rightColumn = NULL;
+	List *leftShardIntervalList = NIL;
+	List *rightShardIntervalList = NIL;
+	ListCell *leftShardIntervalCell = NULL;
+
+	if (leftRelationId == rightRelationId)
+	{
+		return true;
+	}
+
+	if (PartitionType(leftRelationId) != PartitionType(rightRelationId))
+	{
+		return false;
+	}
+
+	leftColumn = PartitionColumn(leftRelationId);
+	rightColumn = PartitionColumn(rightRelationId);
+	if (leftColumn->vartype != rightColumn->vartype)
+	{
+		return false;
+	}
+
+	leftShardIntervalList = LookupShardIntervalList(leftRelationId);
+	rightShardIntervalList = LookupShardIntervalList(rightRelationId);
+	if (list_length(leftShardIntervalList) != list_length(rightShardIntervalList))
+	{
+		return false;
+	}
+
+	/*
+	 * The lists have equal length, so requiring a range-equal partner for
+	 * every left interval establishes a one-to-one pairing unless intervals
+	 * within one table share identical ranges; such duplicates make shard
+	 * pairing ambiguous, so treating them as not colocated is the safe
+	 * outcome anyway.
+	 */
+	foreach(leftShardIntervalCell, leftShardIntervalList)
+	{
+		ShardInterval *leftInterval = (ShardInterval *) lfirst(leftShardIntervalCell);
+		ShardInterval *rightInterval = ColocatedShardInterval(leftInterval,
+															  rightShardIntervalList);
+
+		if (rightInterval == NULL)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * ColocatedShardInterval scans the provided shard interval list for an
+ * interval covering exactly the same value range as the given interval, and
+ * returns it. The function returns NULL if no such interval exists.
+ */
+ShardInterval *
+ColocatedShardInterval(ShardInterval *shardInterval, List *shardIntervalList)
+{
+	ListCell *shardIntervalCell = NULL;
+
+	foreach(shardIntervalCell, shardIntervalList)
+	{
+		ShardInterval *candidateInterval =
+			(ShardInterval *) lfirst(shardIntervalCell);
+
+		if (ShardIntervalRangesEqual(shardInterval, candidateInterval))
+		{
+			return candidateInterval;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * ShardIntervalRangesEqual checks whether two shard intervals cover exactly
+ * the same value range.
+ */
+static bool
+ShardIntervalRangesEqual(ShardInterval *leftInterval, ShardInterval *rightInterval)
+{
+	int16 typeLength = 0;
+	bool typeByValue = false;
+
+	if (leftInterval->valueTypeId != rightInterval->valueTypeId)
+	{
+		return false;
+	}
+
+	get_typlenbyval(leftInterval->valueTypeId, &typeLength, &typeByValue);
+
+	return datumIsEqual(leftInterval->minValue, rightInterval->minValue,
+						typeByValue, typeLength) &&
+		   datumIsEqual(leftInterval->maxValue, rightInterval->maxValue,
+						typeByValue, typeLength);
+}
+
+
 /*
  * ColumnNameToColumn accepts a relation identifier and column name and returns
  * a Var that represents that column in that relation. This function throws an
@@ -709,6 +1764,9 @@ InsertPartitionRow(Oid distributedTableId, char partitionType, text *partitionKe
 	Assert(spiStatus == SPI_OK_INSERT);
 
 	SPI_finish();
+
+	InvalidateShardIntervalListCache(distributedTableId);
+	RecordMetadataWrite();
 }
 
 
@@ -756,6 +1814,9 @@ CreateShardRow(Oid distributedTableId, char shardStorage, text *shardMinValue,
 
 	SPI_finish();
 
+	InvalidateShardIntervalListCache(distributedTableId);
+	RecordMetadataWrite();
+
 	return newShardId;
 }
 
@@ -804,6 +1865,8 @@ CreateShardPlacementRow(int64 shardId, ShardState shardState, char *nodeName,
 
 	SPI_finish();
 
+	RecordMetadataWrite();
+
 	return newShardPlacementId;
 }
 
@@ -843,6 +1906,8 @@ DeleteShardPlacementRow(int64 shardPlacementId)
 	}
 
 	SPI_finish();
+
+	RecordMetadataWrite();
 }
 
 
@@ -885,6 +1950,8 @@ UpdateShardPlacementRowState(int64 shardPlacementId, ShardState newState)
 	}
 
 	SPI_finish();
+
+	RecordMetadataWrite();
 }
 
 
@@ -21,13 +21,18 @@
 #include "pg_shard.h"
 #include "connection.h"
 #include "create_shards.h"
+#include "ddl_commands.h"
 #include "distribution_metadata.h"
 #include "prune_shard_list.h"
+#include "repair_shards.h"
 #include "ruleutils.h"
 
 #include <stddef.h>
 #include <string.h>
 #include <inttypes.h>
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
 
 #include "access/heapam.h"
 #include "access/htup_details.h"
@@ -41,8 +46,11 @@
 #include "access/tupdesc.h"
 #include "access/xact.h"
 #include "catalog/namespace.h"
+#include "catalog/pg_am.h"
 #include "catalog/pg_class.h"
 #include "catalog/pg_type.h"
+#include "commands/copy.h"
+#include "commands/explain.h"
 #include "commands/extension.h"
 #include "executor/execdesc.h"
 #include "executor/executor.h"
@@ -67,11 +75,14 @@
 #include "parser/parse_node.h"
 #include "parser/parsetree.h"
 #include "parser/parse_type.h"
+#include "portability/instr_time.h"
 #include "storage/lock.h"
 #include "tcop/dest.h"
 #include "tcop/tcopprot.h"
 #include "tcop/utility.h"
+#include "utils/acl.h"
 #include "utils/builtins.h"
+#include "utils/datum.h"
 #include "utils/elog.h"
 #include "utils/errcodes.h"
 #include "utils/guc.h"
@@ -80,11 +91,38 @@
 #include "utils/rel.h"
 #include "utils/relcache.h"
 #include "utils/snapmgr.h"
+#include "utils/syscache.h"
+#include "utils/timestamp.h"
 #include "utils/tuplestore.h"
+#include "utils/typcache.h"
 #include "utils/memutils.h"
 
 typedef long long csn_t;
 
+/*
+ * Queries with more extracted constants than this are executed with their
+ * literal text; past this point the deparsed statements rarely repeat, so
+ * preparing them remotely only fills the statement cache.
+ */
+#define MAX_TASK_PARAMETERS 32
+
+/* collects the constants extracted while parameterizing a task query */
+typedef struct ConstParamContext
+{
+	List *constList; /* Consts replaced so far, in parameter number order */
+	bool failed;     /* set when the query cannot be fully parameterized */
+} ConstParamContext;
+
+/* per-task state used by the parallel multi-shard SELECT fan-out */
+typedef struct TaskExecution
+{
+	Task *task;
+	ListCell *placementCell;	/* next placement to try after a failure */
+	PGconn *connection;			/* connection with a query in flight, or NULL */
+	Tuplestorestate *tupleStore;
+	bool done;
+} TaskExecution;
+
 /* controls use of locks to enforce safe commutativity */
 bool AllModificationsCommutative = false;
 
@@ -94,12 +132,18 @@ bool UseCitusDBSelectLogic = false;
 /* informs pg_shard to use the distributed transaction manager */
 bool UseDtmTransactions = false;
 
+/* transfer task results in binary format when all column types support it */
+bool BinaryTransfer = true;
+
 /* Use two phase commit for update transactions */
 bool DtmTwoPhaseCommit = false;
 
 /* logs each statement used in a distributed plan */
 bool LogDistributedStatements = false;
 
+/* executes tasks through shard-side prepared statements when possible */
+bool UsePreparedStatements = true;
+
 
 /* planner functions forward declarations */
 static PlannedStmt * PgShardPlanner(Query *parse, int cursorOptions,
@@ -108,7 +152,7 @@ static PlannerType DeterminePlannerType(Query *query);
 static void ErrorIfQueryNotSupported(Query *queryTree);
 static Oid ExtractFirstDistributedTableId(Query *query);
 static bool ExtractRangeTableEntryWalker(Node *node, List **rangeTableList);
-static List * DistributedQueryShardList(Query *query);
+static List * DistributedQueryShardList(Query *query, int *totalShardCount);
 static bool SelectFromMultipleShards(Query *query, List *queryShardList);
 static void ClassifyRestrictions(List *queryRestrictList, List **remoteRestrictList,
 								 List **localRestrictList);
@@ -124,23 +168,70 @@ static List * QueryFromList(List *rangeTableList);
 static List * TargetEntryList(List *expressionList);
 static CreateStmt * CreateTemporaryTableLikeStmt(Oid sourceRelationId);
 static DistributedPlan * BuildDistributedPlan(Query *query, List *shardIntervalList);
+static List * QueryRelationIdList(Query *query);
+static DistributedPlan * BuildColocatedJoinPlan(Query *query);
+static bool ExtractJoinQualifiersWalker(Node *node, List **qualifierList);
+static bool PartitionColumnEquijoin(Node *qualifier, Query *query,
+									Oid *leftRelationId, Oid *rightRelationId);
+static bool QualifierReferencesOnlyRelation(Node *qualifier, Query *query,
+											Oid relationId);
+static Node * MapQualifierVarno(Node *qualifier);
+static bool MakeJoinTreeQualsExplicitWalker(Node *node, void *context);
+static int CompareShardIntervalsById(const void *leftElement,
+									 const void *rightElement);
+static Query * ParameterizeTaskQuery(Query *query, List **parameterConstList);
+static Node * ConstToParamMutator(Node *node, ConstParamContext *context);
+static RangeTblEntry * MultiRowInsertValuesRTE(Query *query);
+static DistributedPlan * BuildMultiRowInsertPlan(Query *query,
+												 RangeTblEntry *valuesRTE);
+static bool ExternParamWalker(Node *node, void *context);
+static Query * BindQueryParameters(Query *query, ParamListInfo boundParams);
+static Node * ParamToConstMutator(Node *node, ParamListInfo boundParams);
+static bool DeferredRoutingEligible(Query *query);
+static CustomScan * BuildDeferredRoutingScan(Query *query, Plan *originalPlan);
+static Node * DeferredRoutingScanStateError(CustomScan *customScan);
 
 /* executor functions forward declarations */
 static void PgShardExecutorStart(QueryDesc *queryDesc, int eflags);
 static bool IsPgShardPlan(PlannedStmt *plannedStmt);
+static bool IsPgShardDeferredPlan(PlannedStmt *plannedStmt);
+static PlannedStmt * ResolveDeferredPlannedStmt(PlannedStmt *plannedStatement,
+												ParamListInfo boundParams);
 static void NextExecutorStartHook(QueryDesc *queryDesc, int eflags);
 static LOCKMODE CommutativityRuleToLockMode(CmdType commandType);
 static void AcquireExecutorShardLocks(List *taskList, LOCKMODE lockMode);
 static int CompareTasksByShardId(const void *leftElement, const void *rightElement);
 static void ExecuteMultipleShardSelect(DistributedPlan *distributedPlan,
 									   RangeVar *intermediateTable);
-static bool SendQueryInSingleRowMode(PGconn *connection, StringInfo query);
+static void StartTaskExecution(TaskExecution *taskExecution,
+							   TaskExecution *taskExecutions, int taskCount,
+							   bool binaryResults);
+static bool ConnectionBusy(PGconn *connection, TaskExecution *taskExecutions,
+						   int taskCount);
+static bool DrainTaskResults(TaskExecution *taskExecution,
+							 AttInMetadata *attributeInputMetadata,
+							 FmgrInfo *receiveFunctions, Oid *typeIoParams,
+							 char **columnArray, MemoryContext ioContext);
+static bool SendQueryInSingleRowMode(Task *task, char *nodeName, int32 nodePort,
+									 PGconn *connection, bool binaryResults);
+static bool TypeBinaryReceiveDefined(Oid typeId);
+static bool BuildBinaryReceiveFunctions(TupleDesc tupleDescriptor,
+										FmgrInfo **receiveFunctions,
+										Oid **typeIoParams);
 static bool StoreQueryResult(PGconn *connection, TupleDesc tupleDescriptor,
+							 FmgrInfo *receiveFunctions, Oid *typeIoParams,
 							 Tuplestorestate *tupleStore);
+static void StoreResultTuples(PGresult *result, AttInMetadata *attributeInputMetadata,
+							  FmgrInfo *receiveFunctions, Oid *typeIoParams,
+							  char **columnArray, MemoryContext ioContext,
+							  Tuplestorestate *tupleStore);
 static void TupleStoreToTable(RangeVar *tableRangeVar, List *remoteTargetList,
 							  TupleDesc storeTupleDescriptor, Tuplestorestate *store);
 static void PgShardExecutorRun(QueryDesc *queryDesc, ScanDirection direction, long count);
 static int32 ExecuteDistributedModify(DistributedPlan *distributedPlan);
+static int32 ExecuteModifyTask(Task *task);
+static PGresult * ExecuteTaskOnConnection(Task *task, char *nodeName, int32 nodePort,
+										  PGconn *connection);
 static void PrepareDtmTransaction(Task *task);
 static csn_t SendDtmBeginTransaction(PGconn *connection);
 static bool SendDtmJoinTransaction(PGconn *connection, csn_t TransactionId);
@@ -155,6 +246,18 @@ static void PgShardProcessUtility(Node *parsetree, const char *queryString,
 								  ProcessUtilityContext context, ParamListInfo params,
 								  DestReceiver *dest, char *completionTag);
 static void ErrorOnDropIfDistributedTablesExist(DropStmt *dropStatement);
+static void PgShardCopyFrom(CopyStmt *copyStatement, char *completionTag);
+static void OpenCopyToShard(int64 shardId, Oid relationId,
+							const char *columnNameString,
+							List **connectionListPointer);
+static void AppendCopyAttributeValue(StringInfo rowBuffer, const char *value);
+
+/* distributed EXPLAIN forward declarations */
+static void PgShardExplainOneQuery(Query *query, IntoClause *into, ExplainState *es,
+								   const char *queryString, ParamListInfo params);
+static void ExplainDistributedPlan(DistributedPlan *distributedPlan,
+								   ExplainState *es);
+static void ExplainRemoteTask(Task *task, ExplainState *es);
 
 /* PL/pgSQL plugin declarations */
 static void SetupPLErrorTransformation(PLpgSQL_execstate *estate, PLpgSQL_function *func);
@@ -166,6 +269,21 @@ static PLpgSQL_plugin PluginFuncs = {
 	.func_end = TeardownPLErrorTransformation
 };
 
+/*
+ * Plans whose shard routing is deferred until execution carry their routing
+ * query inside a CustomScan node. Unlike DistributedPlan, CustomScan survives
+ * the copyObject the plan cache applies to generic plans, which is what allows
+ * prepared statements to be planned once. The methods table only identifies
+ * such plans: execution never reaches the standard executor, as the routing is
+ * resolved in pg_shard's executor start hook.
+ */
+static CustomScanMethods DeferredRoutingScanMethods = {
+	.CustomName = "PgShardDeferredRouting",
+	.LibraryName = "pg_shard",
+	.SymbolName = "DeferredRoutingScanMethods",
+	.CreateCustomScanState = DeferredRoutingScanStateError
+};
+
 /* declarations for dynamic loading */
 PG_MODULE_MAGIC;
 
@@ -177,6 +295,7 @@ static ExecutorRun_hook_type PreviousExecutorRunHook = NULL;
 static ExecutorFinish_hook_type PreviousExecutorFinishHook = NULL;
 static ExecutorEnd_hook_type PreviousExecutorEndHook = NULL;
 static ProcessUtility_hook_type PreviousProcessUtilityHook = NULL;
+static ExplainOneQuery_hook_type PreviousExplainOneQueryHook = NULL;
 
 /* XTM stuff */
 static List *connectionsWithDtmTransactions = NIL;
@@ -217,6 +336,9 @@ _PG_init(void)
 	PreviousProcessUtilityHook = ProcessUtility_hook;
 	ProcessUtility_hook = PgShardProcessUtility;
 
+	PreviousExplainOneQueryHook = ExplainOneQuery_hook;
+	ExplainOneQuery_hook = PgShardExplainOneQuery;
+
 	DefineCustomBoolVariable("pg_shard.all_modifications_commutative",
 							 "Bypasses commutativity checks when enabled", NULL,
 							 &AllModificationsCommutative, false, PGC_USERSET, 0, NULL,
@@ -227,6 +349,11 @@ _PG_init(void)
 							 &UseCitusDBSelectLogic, BUILT_AGAINST_CITUSDB, PGC_USERSET,
 							 0, NULL, NULL, NULL);
 
+	DefineCustomBoolVariable("pg_shard.shared_metadata_cache",
+							 "Caches distribution metadata in shared memory", NULL,
+							 &UseSharedMetadataCache, true, PGC_USERSET, 0, NULL,
+							 NULL, NULL);
+
 	DefineCustomBoolVariable("pg_shard.use_dtm_transactions",
 							 "Informs pg_shard to use distributed transaction manager", NULL,
 							 &UseDtmTransactions, false, PGC_USERSET, 0, NULL,
@@ -237,6 +364,39 @@ _PG_init(void)
 							 &LogDistributedStatements, false, PGC_USERSET, 0, NULL,
 							 NULL, NULL);
 
+	DefineCustomBoolVariable("pg_shard.prepared_statements",
+							 "Executes tasks through shard-side prepared statements",
+							 NULL, &UsePreparedStatements, true, PGC_USERSET, 0, NULL,
+							 NULL, NULL);
+
+	DefineCustomIntVariable("pg_shard.max_cached_connections",
+							"Per-backend limit on pooled worker connections",
+							"Zero disables the limit", &MaxCachedConnections,
+							64, 0, INT_MAX, PGC_USERSET, 0, NULL, NULL, NULL);
+
+	DefineCustomIntVariable("pg_shard.keepalive_interval",
+							"Seconds of idleness after which a pooled connection "
+							"is health checked before reuse",
+							"Zero disables the health checks", &KeepaliveInterval,
+							30, 0, INT_MAX, PGC_USERSET, GUC_UNIT_S, NULL, NULL, NULL);
+
+	DefineCustomBoolVariable("pg_shard.binary_transfer",
+							 "Transfers task results in binary format when all "
+							 "result column types support it", NULL,
+							 &BinaryTransfer, true, PGC_USERSET, 0, NULL,
+							 NULL, NULL);
+
+	DefineCustomBoolVariable("pg_shard.prewarm_connections",
+							 "Opens connections to all worker nodes on first use", NULL,
+							 &PrewarmConnections, false, PGC_USERSET, 0, NULL,
+							 NULL, NULL);
+
+	DefineCustomIntVariable("pg_shard.copy_throttle",
+							"Bandwidth cap for shard placement copies, in KB "
+							"per second", "Zero disables the cap", &CopyThrottle,
+							0, 0, INT_MAX, PGC_USERSET, GUC_UNIT_KB, NULL, NULL,
+							NULL);
+
 	EmitWarningsOnPlaceholders("pg_shard");
 
 	/* install error transformation handler for PL/pgSQL invocations */
@@ -321,6 +481,7 @@ PgShardErrorTransform(void *arg)
 void
 _PG_fini(void)
 {
+	ExplainOneQuery_hook = PreviousExplainOneQueryHook;
 	ProcessUtility_hook = PreviousProcessUtilityHook;
 	ExecutorRun_hook = PreviousExecutorRunHook;
 	ExecutorStart_hook = PreviousExecutorStartHook;
@@ -348,20 +509,78 @@ PgShardPlanner(Query *query, int cursorOptions, ParamListInfo boundParams)
 		DistributedPlan *distributedPlan = NULL;
 		Query *distributedQuery = copyObject(query);
 		List *queryShardList = NIL;
+		int totalShardCount = 0;
 		bool selectFromMultipleShards = false;
 		CreateStmt *createTemporaryTableStmt = NULL;
+		RangeTblEntry *valuesRTE = NULL;
 
 		/* call standard planner first to have Query transformations performed */
 		plannedStatement = standard_planner(distributedQuery, cursorOptions,
 											boundParams);
 
+		/*
+		 * Prepared statements reach the planner with PARAM_EXTERN references
+		 * in place of their constants. When the parameter values are at hand
+		 * (custom plans), substitute them so the unmodified routing logic
+		 * below applies. When they are not (generic plans), emit a plan which
+		 * defers shard routing until execution, so that the statement is
+		 * planned once and each execution merely resolves its target shard
+		 * from the supplied parameter values.
+		 */
+		if (ExternParamWalker((Node *) distributedQuery, NULL))
+		{
+			if (boundParams != NULL)
+			{
+				distributedQuery = BindQueryParameters(distributedQuery,
+													   boundParams);
+			}
+			else if (DeferredRoutingEligible(distributedQuery))
+			{
+				ErrorIfQueryNotSupported(distributedQuery);
+
+				plannedStatement->planTree =
+					(Plan *) BuildDeferredRoutingScan(distributedQuery,
+													  plannedStatement->planTree);
+
+				return plannedStatement;
+			}
+		}
+
 		ErrorIfQueryNotSupported(distributedQuery);
 
+		/* multi-row INSERTs group their rows into one batched task per shard */
+		valuesRTE = MultiRowInsertValuesRTE(distributedQuery);
+		if (valuesRTE != NULL)
+		{
+			distributedPlan = BuildMultiRowInsertPlan(distributedQuery, valuesRTE);
+			distributedPlan->originalPlan = plannedStatement->planTree;
+
+			plannedStatement->planTree = (Plan *) distributedPlan;
+
+			return plannedStatement;
+		}
+
+		/*
+		 * SELECTs joining several distributed tables ship in their entirety
+		 * to a worker node holding a complete group of colocated shards.
+		 */
+		if (distributedQuery->commandType == CMD_SELECT &&
+			list_length(QueryRelationIdList(distributedQuery)) > 1)
+		{
+			distributedPlan = BuildColocatedJoinPlan(distributedQuery);
+			distributedPlan->originalPlan = plannedStatement->planTree;
+
+			plannedStatement->planTree = (Plan *) distributedPlan;
+
+			return plannedStatement;
+		}
+
 		/*
 		 * Compute the list of shards this query needs to access.
 		 * Error out if there are no existing shards for the table.
 		 */
-		queryShardList = DistributedQueryShardList(distributedQuery);
+		queryShardList = DistributedQueryShardList(distributedQuery,
+												   &totalShardCount);
 
 		/*
 		 * If a select query touches multiple shards, we don't push down the
@@ -408,6 +627,7 @@ PgShardPlanner(Query *query, int cursorOptions, ParamListInfo boundParams)
 		distributedPlan->originalPlan = plannedStatement->planTree;
 		distributedPlan->selectFromMultipleShards = selectFromMultipleShards;
 		distributedPlan->createTemporaryTableStmt = createTemporaryTableStmt;
+		distributedPlan->totalShardCount = totalShardCount;
 
 		plannedStatement->planTree = (Plan *) distributedPlan;
 	}
@@ -573,6 +793,17 @@ ErrorIfQueryNotSupported(Query *queryTree)
 			 * are rejected above with queryTree->cteList check.
 			 */
 			char *rangeTableEntryErrorDetail = NULL;
+
+			/*
+			 * SELECTs may join distributed tables; whether the join can
+			 * actually be pushed down is checked when the colocated join
+			 * plan is built.
+			 */
+			if (rangeTableEntry->rtekind == RTE_JOIN && commandType == CMD_SELECT)
+			{
+				continue;
+			}
+
 			if (rangeTableEntry->rtekind == RTE_SUBQUERY)
 			{
 				rangeTableEntryErrorDetail = "Subqueries are not supported in"
@@ -600,8 +831,8 @@ ErrorIfQueryNotSupported(Query *queryTree)
 		}
 	}
 
-	/* reject queries which involve joins */
-	if (queryTableCount != 1)
+	/* reject queries which involve joins, except SELECTs on colocated tables */
+	if (queryTableCount != 1 && commandType != CMD_SELECT)
 	{
 		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
 						errmsg("cannot perform distributed planning for the given"
@@ -609,14 +840,14 @@ ErrorIfQueryNotSupported(Query *queryTree)
 						errdetail("Joins are not supported in distributed queries.")));
 	}
 
-	/* reject queries which involve multi-row inserts */
-	if (hasValuesScan)
+	/* multi-row inserts are planned separately; reject other VALUES scans */
+	if (hasValuesScan && commandType != CMD_INSERT)
 	{
 		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
 						errmsg("cannot perform distributed planning for the given"
 							   " query"),
-						errdetail("Multi-row INSERTs to distributed tables are not "
-								  "supported.")));
+						errdetail("VALUES scans are only supported in distributed "
+								  "INSERT statements.")));
 	}
 
 	/* reject queries with a returning list */
@@ -763,7 +994,7 @@ ExtractRangeTableEntryWalker(Node *node, List **rangeTableList)
  * being queried has no shards created whatsoever, this function errors out.
  */
 static List *
-DistributedQueryShardList(Query *query)
+DistributedQueryShardList(Query *query, int *totalShardCount)
 {
 	List *restrictClauseList = NIL;
 	List *prunedShardList = NIL;
@@ -789,6 +1020,11 @@ DistributedQueryShardList(Query *query)
 	prunedShardList = PruneShardList(distributedTableId, restrictClauseList,
 									 shardIntervalList);
 
+	if (totalShardCount != NULL)
+	{
+		*totalShardCount = list_length(shardIntervalList);
+	}
+
 	return prunedShardList;
 }
 
@@ -1184,18 +1420,75 @@ BuildDistributedPlan(Query *query, List *shardIntervalList)
 {
 	ListCell *shardIntervalCell = NULL;
 	List *taskList = NIL;
+	FromExpr *joinTree = NULL;
+	Query *parameterizedQuery = NULL;
+	List *parameterConstList = NIL;
+	int parameterCount = 0;
+	Oid *parameterTypes = NULL;
+	char **parameterValues = NULL;
 	DistributedPlan *distributedPlan = palloc0(sizeof(DistributedPlan));
 	distributedPlan->plan.type = (NodeTag) T_DistributedPlan;
 	distributedPlan->targetList = query->targetList;
 
+	/*
+	 * Convert the qualifiers to an explicitly and'd clause, which is needed
+	 * before we deparse the query. This applies to SELECT, UPDATE and
+	 * DELETE statements.
+	 */
+	joinTree = query->jointree;
+	if ((joinTree != NULL) && (joinTree->quals != NULL))
+	{
+		Node *whereClause = joinTree->quals;
+		if (IsA(whereClause, List))
+		{
+			joinTree->quals = (Node *) make_ands_explicit((List *) whereClause);
+		}
+	}
+
+	/*
+	 * Extract the constants from the query so the same statement shape can be
+	 * prepared once per worker connection and re-executed with values only.
+	 * The types and textual values are shared between the tasks: pruning ran
+	 * before this point, so every shard sees the same constants.
+	 */
+	if (UsePreparedStatements)
+	{
+		parameterizedQuery = ParameterizeTaskQuery(query, &parameterConstList);
+	}
+
+	if (parameterizedQuery != NULL)
+	{
+		ListCell *parameterConstCell = NULL;
+		int parameterIndex = 0;
+
+		parameterCount = list_length(parameterConstList);
+		parameterTypes = (Oid *) palloc0(parameterCount * sizeof(Oid));
+		parameterValues = (char **) palloc0(parameterCount * sizeof(char *));
+
+		foreach(parameterConstCell, parameterConstList)
+		{
+			Const *parameterConst = (Const *) lfirst(parameterConstCell);
+			Oid outputFunctionId = InvalidOid;
+			bool variableLengthType = false;
+
+			getTypeOutputInfo(parameterConst->consttype, &outputFunctionId,
+							  &variableLengthType);
+
+			parameterTypes[parameterIndex] = parameterConst->consttype;
+			parameterValues[parameterIndex] =
+				OidOutputFunctionCall(outputFunctionId, parameterConst->constvalue);
+			parameterIndex++;
+		}
+	}
+
 	foreach(shardIntervalCell, shardIntervalList)
 	{
 		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
 		int64 shardId = shardInterval->id;
 		List *finalizedPlacementList = NIL;
-		FromExpr *joinTree = NULL;
 		Task *task = NULL;
 		StringInfo queryString = makeStringInfo();
+		StringInfo parameterizedQueryString = NULL;
 
 		/* grab shared metadata lock to stop concurrent placement additions */
 		LockShardDistributionMetadata(shardId, ShareLock);
@@ -1203,23 +1496,15 @@ BuildDistributedPlan(Query *query, List *shardIntervalList)
 		/* now safe to populate placement list */
 		finalizedPlacementList = LoadFinalizedShardPlacementList(shardId);
 
-		/*
-		 * Convert the qualifiers to an explicitly and'd clause, which is needed
-		 * before we deparse the query. This applies to SELECT, UPDATE and
-		 * DELETE statements.
-		 */
-		joinTree = query->jointree;
-		if ((joinTree != NULL) && (joinTree->quals != NULL))
+		deparse_shard_query(query, shardId, queryString);
+
+		if (parameterizedQuery != NULL)
 		{
-			Node *whereClause = joinTree->quals;
-			if (IsA(whereClause, List))
-			{
-				joinTree->quals = (Node *) make_ands_explicit((List *) whereClause);
-			}
+			parameterizedQueryString = makeStringInfo();
+			deparse_shard_query(parameterizedQuery, shardId,
+								parameterizedQueryString);
 		}
 
-		deparse_shard_query(query, shardId, queryString);
-
 		if (LogDistributedStatements)
 		{
 			ereport(LOG, (errmsg("distributed statement: %s", queryString->data)));
@@ -1227,6 +1512,10 @@ BuildDistributedPlan(Query *query, List *shardIntervalList)
 
 		task = (Task *) palloc0(sizeof(Task));
 		task->queryString = queryString;
+		task->parameterizedQueryString = parameterizedQueryString;
+		task->parameterCount = parameterCount;
+		task->parameterTypes = parameterTypes;
+		task->parameterValues = parameterValues;
 		task->taskPlacementList = finalizedPlacementList;
 		task->shardId = shardId;
 
@@ -1240,1153 +1529,3548 @@ BuildDistributedPlan(Query *query, List *shardIntervalList)
 
 
 /*
- * PgShardExecutorStart sets up the executor state and queryDesc for pgShard
- * executed statements. The function also handles multi-shard selects
- * differently by fetching the remote data and modifying the existing plan to
- * scan that data.
+ * QueryRelationIdList returns the relation identifiers of all plain relation
+ * range table entries in the query, one per entry: a table joined with itself
+ * appears once per reference.
  */
-static void
-PgShardExecutorStart(QueryDesc *queryDesc, int eflags)
+static List *
+QueryRelationIdList(Query *query)
 {
-	PlannedStmt *plannedStatement = queryDesc->plannedstmt;
-	bool pgShardExecution = IsPgShardPlan(plannedStatement);
+	List *rangeTableList = NIL;
+	List *relationIdList = NIL;
+	ListCell *rangeTableCell = NULL;
 
-	if (pgShardExecution)
+	ExtractRangeTableEntryWalker((Node *) query, &rangeTableList);
+
+	foreach(rangeTableCell, rangeTableList)
 	{
-		DistributedPlan *distributedPlan = (DistributedPlan *) plannedStatement->planTree;
-		bool selectFromMultipleShards = distributedPlan->selectFromMultipleShards;
-		bool zeroShardQuery = (list_length(distributedPlan->taskList) == 0);
+		RangeTblEntry *rangeTableEntry = (RangeTblEntry *) lfirst(rangeTableCell);
 
-		if (zeroShardQuery)
+		if (rangeTableEntry->rtekind == RTE_RELATION)
 		{
-			/* if zero shards are involved, let non-INSERTs hit local table */
-			Plan *originalPlan = distributedPlan->originalPlan;
-			plannedStatement->planTree = originalPlan;
+			relationIdList = lappend_oid(relationIdList, rangeTableEntry->relid);
+		}
+	}
 
-			if (plannedStatement->commandType == CMD_INSERT)
-			{
-				ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
-								errmsg("could not find destination shard for new row"),
-								errdetail("Target relation does not contain any shards "
-										  "capable of storing the new row.")));
-			}
+	return relationIdList;
+}
 
-			NextExecutorStartHook(queryDesc, eflags);
-		}
-		else if (!selectFromMultipleShards)
-		{
-			/* bool topLevel = true; */
-			LOCKMODE lockMode = NoLock;
-			EState *executorState = NULL;
 
-			/*
-			 * Also enable transactions to have ability to run the same test 
-			 * with and without DTM.
-			 */
-			/*
-			 * if (!UseDtmTransactions)
-			 * {
-			 *	PreventTransactionChain(topLevel, "distributed commands");
-			 *	eflags |= EXEC_FLAG_SKIP_TRIGGERS;
-			 * }
-			 *
-			 */
+/*
+ * BuildColocatedJoinPlan builds the distributed plan for a SELECT which joins
+ * several distributed tables. Such a join produces correct results remotely
+ * when the joined tables are colocated, every join is an inner join equating
+ * the tables' partition columns, and the query's restrictions resolve to a
+ * single group of range-equal shards: the whole query -- including any
+ * aggregates, grouping, ordering and limits -- then ships to a worker node
+ * holding every shard of that group, and the rows it returns are final. The
+ * function errors out when the query does not meet these conditions.
+ */
+static DistributedPlan *
+BuildColocatedJoinPlan(Query *query)
+{
+	List *referencedIdList = QueryRelationIdList(query);
+	List *relationIdList = NIL;
+	ListCell *referencedIdCell = NULL;
+	int tableCount = 0;
+	Oid firstRelationId = InvalidOid;
+	List *qualifierList = NIL;
+	List **shardIntervalLists = NULL;
+	List **prunedShardLists = NULL;
+	int *componentIds = NULL;
+	List *matchedShardGroup = NIL;
+	int matchedGroupCount = 0;
+	List *sortedShardGroup = NIL;
+	List *taskPlacementList = NIL;
+	List *relationShardList = NIL;
+	ListCell *relationIdCell = NULL;
+	ListCell *qualifierCell = NULL;
+	ListCell *shardIntervalCell = NULL;
+	int relationIndex = 0;
+	int tableIndex = 0;
+	Task *task = NULL;
+	StringInfo queryString = NULL;
 
-			/* build empty executor state to obtain per-query memory context */
-			executorState = CreateExecutorState();
-			executorState->es_top_eflags = eflags;
-			executorState->es_instrument = queryDesc->instrument_options;
+	DistributedPlan *distributedPlan = palloc0(sizeof(DistributedPlan));
+	distributedPlan->plan.type = (NodeTag) T_DistributedPlan;
+	distributedPlan->targetList = query->targetList;
 
-			queryDesc->estate = executorState;
+	/*
+	 * The shard substitution below is keyed by relation, so a table joined
+	 * with itself would have both references routed to the same shard even
+	 * when the join condition calls for pairing every shard with every other;
+	 * reject self-joins rather than risk wrong results.
+	 */
+	foreach(referencedIdCell, referencedIdList)
+	{
+		Oid referencedId = lfirst_oid(referencedIdCell);
 
-			lockMode = CommutativityRuleToLockMode(plannedStatement->commandType);
-			if (lockMode != NoLock)
-			{
-				AcquireExecutorShardLocks(distributedPlan->taskList, lockMode);
-			}
+		if (list_member_oid(relationIdList, referencedId))
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("cannot perform distributed planning for the given"
+								   " query"),
+							errdetail("Self-joins are not supported in distributed "
+									  "queries.")));
 		}
-		else
+
+		relationIdList = lappend_oid(relationIdList, referencedId);
+	}
+
+	tableCount = list_length(relationIdList);
+	firstRelationId = linitial_oid(relationIdList);
+
+	/* every joined table must be distributed and colocated with the rest */
+	foreach(relationIdCell, relationIdList)
+	{
+		Oid relationId = lfirst_oid(relationIdCell);
+
+		if (!IsDistributedTable(relationId))
 		{
-			/*
-			 * If its a SELECT query over multiple shards, we fetch the relevant
-			 * data from the remote nodes and insert it into a temp table. We then
-			 * point the existing plan to scan this temp table instead of the
-			 * original one.
-			 */
-			Plan *originalPlan = NULL;
-			RangeTblEntry *sequentialScanRangeTable = NULL;
-			Oid intermediateResultTableId = InvalidOid;
-			bool missingOK = false;
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("cannot perform distributed planning for the given"
+								   " query"),
+							errdetail("Joins between distributed and local tables are "
+									  "not supported.")));
+		}
 
-			/* execute the previously created statement to create a temp table */
-			CreateStmt *createStmt = distributedPlan->createTemporaryTableStmt;
-			const char *queryDescription = "create temp table like";
-			RangeVar *intermediateResultTable = createStmt->relation;
+		if (!TablesColocated(firstRelationId, relationId))
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("cannot perform distributed planning for the given"
+								   " query"),
+							errdetail("Only colocated tables, partitioned identically "
+									  "on columns of the same type, can be joined in "
+									  "distributed queries.")));
+		}
+	}
 
-			ProcessUtility((Node *) createStmt, queryDescription,
-						   PROCESS_UTILITY_TOPLEVEL, NULL, None_Receiver, NULL);
+	/* collect WHERE and JOIN ... ON qualifiers; errors out on outer joins */
+	ExtractJoinQualifiersWalker((Node *) query->jointree, &qualifierList);
 
-			/* execute select queries and fetch results into the temp table */
-			ExecuteMultipleShardSelect(distributedPlan, intermediateResultTable);
+	/*
+	 * Shards only pair up correctly when the join conditions equate the
+	 * tables' partition columns. Treat the partition column equijoins as
+	 * edges of a graph over the joined tables and require the graph to be
+	 * connected.
+	 */
+	componentIds = (int *) palloc(tableCount * sizeof(int));
+	for (tableIndex = 0; tableIndex < tableCount; tableIndex++)
+	{
+		componentIds[tableIndex] = tableIndex;
+	}
 
-			/* update the query descriptor snapshot so results are visible */
-			UnregisterSnapshot(queryDesc->snapshot);
-			UpdateActiveSnapshotCommandId();
-			queryDesc->snapshot = RegisterSnapshot(GetActiveSnapshot());
+	foreach(qualifierCell, qualifierList)
+	{
+		Node *qualifier = (Node *) lfirst(qualifierCell);
+		Oid leftRelationId = InvalidOid;
+		Oid rightRelationId = InvalidOid;
 
-			/* update sequential scan's table entry to point to intermediate table */
-			intermediateResultTableId = RangeVarGetRelid(intermediateResultTable,
-														 NoLock, missingOK);
+		if (PartitionColumnEquijoin(qualifier, query, &leftRelationId,
+									&rightRelationId))
+		{
+			int leftComponentId = 0;
+			int rightComponentId = 0;
+			int leftIndex = -1;
+			int rightIndex = -1;
 
-			Assert(list_length(plannedStatement->rtable) == 1);
-			sequentialScanRangeTable = linitial(plannedStatement->rtable);
-			Assert(sequentialScanRangeTable->rtekind == RTE_RELATION);
-			sequentialScanRangeTable->relid = intermediateResultTableId;
+			tableIndex = 0;
+			foreach(relationIdCell, relationIdList)
+			{
+				Oid relationId = lfirst_oid(relationIdCell);
 
-			/* swap in modified (local) plan for compatibility with standard start hook */
-			originalPlan = distributedPlan->originalPlan;
-			plannedStatement->planTree = originalPlan;
+				if (relationId == leftRelationId)
+				{
+					leftIndex = tableIndex;
+				}
+				if (relationId == rightRelationId)
+				{
+					rightIndex = tableIndex;
+				}
+				tableIndex++;
+			}
+			Assert(leftIndex >= 0 && rightIndex >= 0);
 
-			NextExecutorStartHook(queryDesc, eflags);
+			leftComponentId = componentIds[leftIndex];
+			rightComponentId = componentIds[rightIndex];
+			for (tableIndex = 0; tableIndex < tableCount; tableIndex++)
+			{
+				if (componentIds[tableIndex] == rightComponentId)
+				{
+					componentIds[tableIndex] = leftComponentId;
+				}
+			}
 		}
 	}
-	else
+
+	for (tableIndex = 0; tableIndex < tableCount; tableIndex++)
 	{
-		NextExecutorStartHook(queryDesc, eflags);
+		if (componentIds[tableIndex] != componentIds[0])
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("cannot perform distributed planning for the given"
+								   " query"),
+							errdetail("Joined tables must be equated on their "
+									  "partition columns.")));
+		}
 	}
-}
 
+	/*
+	 * Prune each table's shards using the qualifiers which reference only
+	 * that table. A qualifier pinning one table's partition column pins the
+	 * other tables through the colocated shard pairing below, so constants
+	 * need not be repeated for every table.
+	 */
+	shardIntervalLists = (List **) palloc0(tableCount * sizeof(List *));
+	prunedShardLists = (List **) palloc0(tableCount * sizeof(List *));
 
-/*
- * IsPgShardPlan determines whether the provided plannedStmt contains a plan
- * suitable for execution by PgShard.
- */
-static bool
-IsPgShardPlan(PlannedStmt *plannedStmt)
-{
-	Plan *plan = plannedStmt->planTree;
-	NodeTag nodeTag = nodeTag(plan);
-	bool isPgShardPlan = ((DistributedNodeTag) nodeTag == T_DistributedPlan);
+	relationIndex = 0;
+	foreach(relationIdCell, relationIdList)
+	{
+		Oid relationId = lfirst_oid(relationIdCell);
+		List *restrictList = NIL;
 
-	return isPgShardPlan;
-}
+		foreach(qualifierCell, qualifierList)
+		{
+			Node *qualifier = (Node *) lfirst(qualifierCell);
 
+			if (QualifierReferencesOnlyRelation(qualifier, query, relationId))
+			{
+				restrictList = lappend(restrictList, MapQualifierVarno(qualifier));
+			}
+		}
 
-/*
- * NextExecutorStartHook simply encapsulates the common logic of calling the
- * next executor start hook in the chain or the standard executor start hook
- * if no other hooks are present.
- */
-static void
-NextExecutorStartHook(QueryDesc *queryDesc, int eflags)
-{
-	/* call into the standard executor start, or hook if set */
-	if (PreviousExecutorStartHook != NULL)
-	{
-		PreviousExecutorStartHook(queryDesc, eflags);
+		shardIntervalLists[relationIndex] = LookupShardIntervalList(relationId);
+		if (shardIntervalLists[relationIndex] == NIL)
+		{
+			char *relationName = get_rel_name(relationId);
+
+			ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+							errmsg("could not find any shards for query"),
+							errdetail("No shards exist for distributed table \"%s\".",
+									  relationName),
+							errhint("Run master_create_worker_shards to create shards "
+									"and try again.")));
+		}
+
+		prunedShardLists[relationIndex] = PruneShardList(relationId, restrictList,
+														 shardIntervalLists[relationIndex]);
+		relationIndex++;
 	}
-	else
+
+	/*
+	 * Pair up the surviving shards: keep those shards of the first table
+	 * whose range-equal partner in every other table also survived pruning.
+	 * Each kept shard describes one group of colocated shards the join would
+	 * have to visit.
+	 */
+	foreach(shardIntervalCell, prunedShardLists[0])
 	{
-		standard_ExecutorStart(queryDesc, eflags);
-	}
-}
+		ShardInterval *firstInterval = (ShardInterval *) lfirst(shardIntervalCell);
+		List *shardGroup = list_make1(firstInterval);
+		bool groupPruned = false;
 
+		for (relationIndex = 1; relationIndex < tableCount; relationIndex++)
+		{
+			ShardInterval *partnerInterval =
+				ColocatedShardInterval(firstInterval,
+									   shardIntervalLists[relationIndex]);
+			ListCell *prunedIntervalCell = NULL;
+			bool partnerSurvived = false;
 
-/*
- * CommutativityRuleToLockMode determines the commutativity rule for the given
- * command and returns the appropriate lock mode to enforce that rule. The
- * function assumes a SELECT doesn't modify state and therefore is commutative
- * with all other commands. The function also assumes that an INSERT commutes
- * with another INSERT, but not with an UPDATE/DELETE; and an UPDATE/DELETE
- * doesn't commute with an INSERT, UPDATE, or DELETE.
- *
- * The above mapping is overridden entirely when all_modifications_commutative
- * is set to true. In that case, all commands just claim a shared lock. This
- * allows the shard repair logic to lock out modifications while permitting all
- * commands to otherwise commute.
- */
-static LOCKMODE
-CommutativityRuleToLockMode(CmdType commandType)
-{
-	LOCKMODE lockMode = NoLock;
+			/* the tables are colocated, so a partner always exists */
+			Assert(partnerInterval != NULL);
 
-	/* bypass commutativity checks when flag enabled */
-	if (AllModificationsCommutative)
-	{
-		return ShareLock;
+			foreach(prunedIntervalCell, prunedShardLists[relationIndex])
+			{
+				ShardInterval *prunedInterval =
+					(ShardInterval *) lfirst(prunedIntervalCell);
+
+				if (prunedInterval->id == partnerInterval->id)
+				{
+					partnerSurvived = true;
+					break;
+				}
+			}
+
+			if (!partnerSurvived)
+			{
+				groupPruned = true;
+				break;
+			}
+
+			shardGroup = lappend(shardGroup, partnerInterval);
+		}
+
+		if (!groupPruned)
+		{
+			matchedShardGroup = shardGroup;
+			matchedGroupCount++;
+		}
 	}
 
-	if (commandType == CMD_SELECT)
+	distributedPlan->totalShardCount = list_length(shardIntervalLists[0]);
+
+	/* all shard groups were pruned away: the query cannot return any rows */
+	if (matchedGroupCount == 0)
 	{
-		lockMode = NoLock;
+		distributedPlan->taskList = NIL;
+
+		return distributedPlan;
 	}
-	else if (commandType == CMD_INSERT)
+
+	if (matchedGroupCount > 1)
 	{
-		lockMode = ShareLock;
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot perform distributed planning for the given"
+							   " query"),
+						errdetail("Distributed joins may touch only a single group of "
+								  "colocated shards."),
+						errhint("Add an equality filter on the joined tables' "
+								"partition columns.")));
 	}
-	else if (commandType == CMD_UPDATE || commandType == CMD_DELETE)
+
+	/* grab shared metadata locks in shardId order to stop placement changes */
+	sortedShardGroup = SortList(list_copy(matchedShardGroup),
+								CompareShardIntervalsById);
+	foreach(shardIntervalCell, sortedShardGroup)
 	{
-		lockMode = ExclusiveLock;
+		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+
+		LockShardDistributionMetadata(shardInterval->id, ShareLock);
 	}
-	else
+
+	/*
+	 * The task must run on a worker node holding a finalized placement of
+	 * every shard in the group, so intersect the placement lists by node.
+	 * pg_shard assigns placements round-robin, which does not guarantee such
+	 * a node exists even for colocated tables.
+	 */
+	relationIndex = 0;
+	foreach(shardIntervalCell, matchedShardGroup)
 	{
-		ereport(ERROR, (errmsg("unrecognized operation code: %d", (int) commandType)));
-	}
+		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+		List *placementList = LoadFinalizedShardPlacementList(shardInterval->id);
 
-	return lockMode;
-}
+		if (relationIndex == 0)
+		{
+			taskPlacementList = placementList;
+		}
+		else
+		{
+			List *commonPlacementList = NIL;
+			ListCell *taskPlacementCell = NULL;
 
+			foreach(taskPlacementCell, taskPlacementList)
+			{
+				ShardPlacement *taskPlacement =
+					(ShardPlacement *) lfirst(taskPlacementCell);
+				ListCell *placementCell = NULL;
 
-/*
- * AcquireExecutorShardLocks: acquire shard locks needed for execution of tasks
- * within a distributed plan.
- */
-static void
-AcquireExecutorShardLocks(List *taskList, LOCKMODE lockMode)
-{
-	List *shardIdSortedTaskList = SortList(taskList, CompareTasksByShardId);
-	ListCell *taskCell = NULL;
+				foreach(placementCell, placementList)
+				{
+					ShardPlacement *placement =
+						(ShardPlacement *) lfirst(placementCell);
+
+					if (placement->nodePort == taskPlacement->nodePort &&
+						strncmp(placement->nodeName, taskPlacement->nodeName,
+								MAX_NODE_LENGTH) == 0)
+					{
+						commonPlacementList = lappend(commonPlacementList,
+													  taskPlacement);
+						break;
+					}
+				}
+			}
 
-	foreach(taskCell, shardIdSortedTaskList)
-	{
-		Task *task = (Task *) lfirst(taskCell);
-		int64 shardId = task->shardId;
+			taskPlacementList = commonPlacementList;
+		}
 
-		LockShardData(shardId, lockMode);
+		relationIndex++;
 	}
-}
-
-
-/* Helper function to compare two tasks using their shardIds. */
-static int
-CompareTasksByShardId(const void *leftElement, const void *rightElement)
-{
-	const Task *leftTask = *((const Task **) leftElement);
-	const Task *rightTask = *((const Task **) rightElement);
-	int64 leftShardId = leftTask->shardId;
-	int64 rightShardId = rightTask->shardId;
 
-	/* we compare 64-bit integers, instead of casting their difference to int */
-	if (leftShardId > rightShardId)
-	{
-		return 1;
-	}
-	else if (leftShardId < rightShardId)
-	{
-		return -1;
-	}
-	else
+	if (taskPlacementList == NIL)
 	{
-		return 0;
+		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+						errmsg("could not find a worker node holding placements for "
+							   "all colocated shards in the query"),
+						errhint("Consider using master_copy_shard_placement to "
+								"colocate the shard placements.")));
 	}
-}
 
+	/* record which shard stands in for each relation while deparsing */
+	forboth(relationIdCell, relationIdList, shardIntervalCell, matchedShardGroup)
+	{
+		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+		RelationShard *relationShard = palloc0(sizeof(RelationShard));
 
-/*
- * ExecuteMultipleShardSelect executes the SELECT queries in the distributed
- * plan and inserts the returned rows into the given tableId.
- */
-static void
-ExecuteMultipleShardSelect(DistributedPlan *distributedPlan,
-						   RangeVar *intermediateTable)
-{
-	List *taskList = distributedPlan->taskList;
-	List *targetList = distributedPlan->targetList;
+		relationShard->relationId = lfirst_oid(relationIdCell);
+		relationShard->shardId = shardInterval->id;
 
-	/* ExecType instead of ExecCleanType so we don't ignore junk columns */
-	TupleDesc tupleStoreDescriptor = ExecTypeFromTL(targetList, false);
+		relationShardList = lappend(relationShardList, relationShard);
+	}
 
-	ListCell *taskCell = NULL;
+	/* qualifiers must be explicitly and'd before the query can be deparsed */
+	MakeJoinTreeQualsExplicitWalker((Node *) query->jointree, NULL);
 
-	DtmTwoPhaseCommit = IsTransactionBlock();
+	queryString = makeStringInfo();
+	deparse_shard_query_map(query, relationShardList, queryString);
 
-	foreach(taskCell, taskList)
+	if (LogDistributedStatements)
 	{
-		Task *task = (Task *) lfirst(taskCell);
-		Tuplestorestate *tupleStore = tuplestore_begin_heap(false, false, work_mem);
-		bool resultsOK = false;
-
-		if (UseDtmTransactions)
-		{
-			PrepareDtmTransaction(task);
-		}
+		ereport(LOG, (errmsg("distributed statement: %s", queryString->data)));
+	}
 
-		resultsOK = ExecuteTaskAndStoreResults(task, tupleStoreDescriptor, tupleStore);
-		if (!resultsOK)
-		{
-			ereport(ERROR, (errmsg("could not receive query results")));
-		}
+	task = (Task *) palloc0(sizeof(Task));
+	task->queryString = queryString;
+	task->taskPlacementList = taskPlacementList;
+	task->shardId = ((ShardInterval *) linitial(matchedShardGroup))->id;
 
-		/*
-		 * We successfully fetched data into local tuplestore. Now move results from
-		 * the tupleStore into the table.
-		 */
-		Assert(tupleStore != NULL);
-		TupleStoreToTable(intermediateTable, targetList, tupleStoreDescriptor,
-						  tupleStore);
+	distributedPlan->taskList = list_make1(task);
 
-		tuplestore_end(tupleStore);
-	}
-	
+	return distributedPlan;
 }
 
 
 /*
- * ExecuteTaskAndStoreResults executes the task on the remote node, retrieves
- * the results and stores them in the given tuple store. If the task fails on
- * one of the placements, the function retries it on other placements.
+ * ExtractJoinQualifiersWalker walks over the query's join tree and collects
+ * the qualifiers of FROM and JOIN ... ON clauses alike, unlike
+ * ExtractFromExpressionWalker which only examines the former. Outer joins
+ * cause an error: their qualifiers do not filter rows, so the pruning logic
+ * must not treat them as restrictions.
  */
-bool
-ExecuteTaskAndStoreResults(Task *task, TupleDesc tupleDescriptor,
-						   Tuplestorestate *tupleStore)
+static bool
+ExtractJoinQualifiersWalker(Node *node, List **qualifierList)
 {
-	bool resultsOK = false;
-	List *taskPlacementList = task->taskPlacementList;
-	ListCell *taskPlacementCell = NULL;
+	bool walkIsComplete = false;
+	Node *qualifiers = NULL;
 
-	/*
-	 * Try to run the query to completion on one placement. If the query fails
-	 * attempt the query on the next placement.
-	 */
-	foreach(taskPlacementCell, taskPlacementList)
+	if (node == NULL)
 	{
-		ShardPlacement *taskPlacement = (ShardPlacement *) lfirst(taskPlacementCell);
-		char *nodeName = taskPlacement->nodeName;
-		int32 nodePort = taskPlacement->nodePort;
-		bool queryOK = false;
-		bool storedOK = false;
+		return false;
+	}
 
-		PGconn *connection = GetConnection(nodeName, nodePort, !UseDtmTransactions);
-		if (connection == NULL)
-		{
-			continue;
-		}
+	if (IsA(node, FromExpr))
+	{
+		qualifiers = ((FromExpr *) node)->quals;
+	}
+	else if (IsA(node, JoinExpr))
+	{
+		JoinExpr *joinExpression = (JoinExpr *) node;
 
-		queryOK = SendQueryInSingleRowMode(connection, task->queryString);
-		if (!queryOK)
+		if (joinExpression->jointype != JOIN_INNER)
 		{
-			PurgeConnection(connection);
-			continue;
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("cannot perform distributed planning for the given"
+								   " query"),
+							errdetail("Outer joins are not supported in distributed "
+									  "queries.")));
 		}
 
-		storedOK = StoreQueryResult(connection, tupleDescriptor, tupleStore);
-		if (storedOK)
+		qualifiers = joinExpression->quals;
+	}
+
+	if (qualifiers != NULL)
+	{
+		if (IsA(qualifiers, List))
 		{
-			resultsOK = true;
-			break;
+			*qualifierList = list_concat(*qualifierList,
+										 list_copy((List *) qualifiers));
 		}
 		else
 		{
-			tuplestore_clear(tupleStore);
-			PurgeConnection(connection);
+			*qualifierList = lappend(*qualifierList, qualifiers);
 		}
 	}
 
-	return resultsOK;
+	walkIsComplete = expression_tree_walker(node, ExtractJoinQualifiersWalker,
+											(void *) qualifierList);
+
+	return walkIsComplete;
 }
 
 
 /*
- * SendQueryInSingleRowMode sends the given query on the connection in an
- * asynchronous way. The function also sets the single-row mode on the
- * connection so that we receive results a row at a time.
+ * PartitionColumnEquijoin checks whether the qualifier equates the partition
+ * columns of two distinct distributed tables, and returns the identifiers of
+ * those tables through the output parameters if so.
  */
 static bool
-SendQueryInSingleRowMode(PGconn *connection, StringInfo query)
+PartitionColumnEquijoin(Node *qualifier, Query *query, Oid *leftRelationId,
+						Oid *rightRelationId)
 {
-	int querySent = 0;
-	int singleRowMode = 0;
+	OpExpr *operatorExpression = NULL;
+	Node *leftArgument = NULL;
+	Node *rightArgument = NULL;
+	Var *leftVar = NULL;
+	Var *rightVar = NULL;
+	RangeTblEntry *leftRte = NULL;
+	RangeTblEntry *rightRte = NULL;
+	Var *leftColumn = NULL;
+	Var *rightColumn = NULL;
+	Oid equalityOperatorId = InvalidOid;
+
+	if (!IsA(qualifier, OpExpr) || list_length(((OpExpr *) qualifier)->args) != 2)
+	{
+		return false;
+	}
 
-	querySent = PQsendQuery(connection, query->data);
-	if (querySent == 0)
+	operatorExpression = (OpExpr *) qualifier;
+	leftArgument = strip_implicit_coercions(get_leftop((Expr *) operatorExpression));
+	rightArgument = strip_implicit_coercions(get_rightop((Expr *) operatorExpression));
+
+	if (!IsA(leftArgument, Var) || !IsA(rightArgument, Var))
 	{
-		ReportRemoteError(connection, NULL);
 		return false;
 	}
 
-	singleRowMode = PQsetSingleRowMode(connection);
-	if (singleRowMode == 0)
+	leftVar = (Var *) leftArgument;
+	rightVar = (Var *) rightArgument;
+	if (leftVar->varlevelsup != 0 || rightVar->varlevelsup != 0)
+	{
+		return false;
+	}
+
+	leftRte = rt_fetch(leftVar->varno, query->rtable);
+	rightRte = rt_fetch(rightVar->varno, query->rtable);
+	if (leftRte->rtekind != RTE_RELATION || rightRte->rtekind != RTE_RELATION ||
+		leftRte->relid == rightRte->relid)
+	{
+		return false;
+	}
+
+	leftColumn = PartitionColumn(leftRte->relid);
+	rightColumn = PartitionColumn(rightRte->relid);
+	if (leftVar->varattno != leftColumn->varattno ||
+		rightVar->varattno != rightColumn->varattno)
+	{
+		return false;
+	}
+
+	equalityOperatorId = GetOperatorByType(leftColumn->vartype, BTREE_AM_OID,
+										   BTEqualStrategyNumber);
+	if (operatorExpression->opno != equalityOperatorId)
 	{
-		ReportRemoteError(connection, NULL);
 		return false;
 	}
 
+	*leftRelationId = leftRte->relid;
+	*rightRelationId = rightRte->relid;
+
 	return true;
 }
 
 
 /*
- * StoreQueryResult gets the query results from the given connection, builds
- * tuples from the results and stores them in the given tuple-store. If the
- * function can't receive query results, it returns false. Note that this
- * function assumes the query has already been sent on the connection and the
- * tuplestore has earlier been initialized.
+ * QualifierReferencesOnlyRelation determines whether every variable in the
+ * qualifier belongs to the given relation. Qualifiers without any variable
+ * return false: they cannot contribute to shard pruning.
  */
 static bool
-StoreQueryResult(PGconn *connection, TupleDesc tupleDescriptor,
-				 Tuplestorestate *tupleStore)
+QualifierReferencesOnlyRelation(Node *qualifier, Query *query, Oid relationId)
 {
-	AttInMetadata *attributeInputMetadata = TupleDescGetAttInMetadata(tupleDescriptor);
-	uint32 expectedColumnCount = tupleDescriptor->natts;
-	char **columnArray = (char **) palloc0(expectedColumnCount * sizeof(char *));
-	MemoryContext ioContext = AllocSetContextCreate(CurrentMemoryContext,
-													"StoreQueryResult",
-													ALLOCSET_DEFAULT_MINSIZE,
-													ALLOCSET_DEFAULT_INITSIZE,
-													ALLOCSET_DEFAULT_MAXSIZE);
-
-	Assert(tupleStore != NULL);
+	List *varList = pull_var_clause(qualifier, PVC_RECURSE_AGGREGATES,
+									PVC_REJECT_PLACEHOLDERS);
+	ListCell *varCell = NULL;
 
-	for (;;)
+	if (varList == NIL)
 	{
-		uint32 rowIndex = 0;
-		uint32 columnIndex = 0;
-		uint32 rowCount = 0;
-		uint32 columnCount = 0;
-		ExecStatusType resultStatus = 0;
+		return false;
+	}
 
-		PGresult *result = PQgetResult(connection);
-		if (result == NULL)
-		{
-			break;
-		}
+	foreach(varCell, varList)
+	{
+		Var *var = (Var *) lfirst(varCell);
+		RangeTblEntry *rangeTableEntry = NULL;
 
-		resultStatus = PQresultStatus(result);
-		if ((resultStatus != PGRES_SINGLE_TUPLE) && (resultStatus != PGRES_TUPLES_OK))
+		if (var->varlevelsup != 0)
 		{
-			ReportRemoteError(connection, result);
-			PQclear(result);
-
 			return false;
 		}
 
-		rowCount = PQntuples(result);
-		columnCount = PQnfields(result);
-		Assert(columnCount == expectedColumnCount);
-
-		for (rowIndex = 0; rowIndex < rowCount; rowIndex++)
+		rangeTableEntry = rt_fetch(var->varno, query->rtable);
+		if (rangeTableEntry->rtekind != RTE_RELATION ||
+			rangeTableEntry->relid != relationId)
 		{
-			HeapTuple heapTuple = NULL;
-			MemoryContext oldContext = NULL;
-			memset(columnArray, 0, columnCount * sizeof(char *));
-
-			for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
-			{
-				if (PQgetisnull(result, rowIndex, columnIndex))
-				{
-					columnArray[columnIndex] = NULL;
-				}
-				else
-				{
-					columnArray[columnIndex] = PQgetvalue(result, rowIndex, columnIndex);
-				}
-			}
-
-			/*
-			 * Switch to a temporary memory context that we reset after each tuple. This
-			 * protects us from any memory leaks that might be present in I/O functions
-			 * called by BuildTupleFromCStrings.
-			 */
-			oldContext = MemoryContextSwitchTo(ioContext);
-
-			heapTuple = BuildTupleFromCStrings(attributeInputMetadata, columnArray);
-
-			MemoryContextSwitchTo(oldContext);
-
-			tuplestore_puttuple(tupleStore, heapTuple);
-			MemoryContextReset(ioContext);
+			return false;
 		}
-
-		PQclear(result);
 	}
 
-	pfree(columnArray);
-
 	return true;
 }
 
 
 /*
- * TupleStoreToTable inserts the tuples from the given tupleStore into the given
- * table. Before doing so, the function extracts the values from the tuple and
- * sets the right attributes for the given table based on the column attribute
- * numbers.
+ * MapQualifierVarno returns a copy of the given qualifier in which every
+ * variable's range table index has been replaced with 1, the index the
+ * metadata functions use when building partition column references. The
+ * qualifier must reference exactly one range table entry.
  */
-static void
-TupleStoreToTable(RangeVar *tableRangeVar, List *storeToTableColumnList,
-				  TupleDesc storeTupleDescriptor, Tuplestorestate *store)
+static Node *
+MapQualifierVarno(Node *qualifier)
 {
-	Relation table = heap_openrv(tableRangeVar, RowExclusiveLock);
-	TupleDesc tableTupleDescriptor = RelationGetDescr(table);
+	Node *qualifierCopy = (Node *) copyObject(qualifier);
+	List *varList = pull_var_clause(qualifierCopy, PVC_RECURSE_AGGREGATES,
+									PVC_REJECT_PLACEHOLDERS);
+	ListCell *varCell = NULL;
 
-	int tableColumnCount = tableTupleDescriptor->natts;
-	Datum *tableTupleValues = palloc0(tableColumnCount * sizeof(Datum));
-	bool *tableTupleNulls = palloc0(tableColumnCount * sizeof(bool));
+	foreach(varCell, varList)
+	{
+		Var *var = (Var *) lfirst(varCell);
+		var->varno = 1;
+	}
 
-	int storeColumnCount = storeTupleDescriptor->natts;
-	Datum *storeTupleValues = palloc0(storeColumnCount * sizeof(Datum));
-	bool *storeTupleNulls = palloc0(storeColumnCount * sizeof(bool));
-	TupleTableSlot *storeTableSlot = MakeSingleTupleTableSlot(storeTupleDescriptor);
+	return qualifierCopy;
+}
 
-	for (;;)
+
+/*
+ * MakeJoinTreeQualsExplicitWalker converts the implicitly and'd qualifier
+ * lists of every FROM and JOIN ... ON clause in the join tree into explicit
+ * AND expressions, which the deparsing logic requires. BuildDistributedPlan
+ * performs the same conversion for the top-level qualifiers only.
+ */
+static bool
+MakeJoinTreeQualsExplicitWalker(Node *node, void *context)
+{
+	if (node == NULL)
 	{
-		HeapTuple storeTuple = NULL;
-		HeapTuple tableTuple = NULL;
-		int storeColumnIndex = 0;
+		return false;
+	}
 
-		bool nextTuple = tuplestore_gettupleslot(store, true, false, storeTableSlot);
-		if (!nextTuple)
+	if (IsA(node, FromExpr))
+	{
+		FromExpr *fromExpression = (FromExpr *) node;
+
+		if (fromExpression->quals != NULL && IsA(fromExpression->quals, List))
 		{
-			break;
+			fromExpression->quals =
+				(Node *) make_ands_explicit((List *) fromExpression->quals);
 		}
+	}
+	else if (IsA(node, JoinExpr))
+	{
+		JoinExpr *joinExpression = (JoinExpr *) node;
 
-		storeTuple = ExecFetchSlotTuple(storeTableSlot);
-		heap_deform_tuple(storeTuple, storeTupleDescriptor,
-						  storeTupleValues, storeTupleNulls);
+		if (joinExpression->quals != NULL && IsA(joinExpression->quals, List))
+		{
+			joinExpression->quals =
+				(Node *) make_ands_explicit((List *) joinExpression->quals);
+		}
+	}
 
-		/* set all values to null for the table tuple */
-		memset(tableTupleNulls, true, tableColumnCount * sizeof(bool));
+	return expression_tree_walker(node, MakeJoinTreeQualsExplicitWalker, context);
+}
 
-		/*
-		 * Extract values from the returned tuple and set them in the right
-		 * attribute location for the new table. We determine this attribute
-		 * location based on the attribute number in the column from the remote
-		 * query's target list.
-		 */
-		for (storeColumnIndex = 0; storeColumnIndex < storeColumnCount;
-			 storeColumnIndex++)
-		{
-			TargetEntry *tableEntry = (TargetEntry *) list_nth(storeToTableColumnList,
-															   storeColumnIndex);
-			Expr *tableExpression = tableEntry->expr;
-			Var *tableColumn = NULL;
-			int tableColumnId = 0;
 
-			/* special case for count(*) as we expect a NULL const */
-			if (IsA(tableExpression, Const))
-			{
-				Const *constValue PG_USED_FOR_ASSERTS_ONLY = (Const *) tableExpression;
-				Assert(constValue->consttype == UNKNOWNOID);
+/*
+ * CompareShardIntervalsById is a comparison function for sorting shard
+ * intervals by their identifiers.
+ */
+static int
+CompareShardIntervalsById(const void *leftElement, const void *rightElement)
+{
+	const ShardInterval *leftInterval = *((const ShardInterval **) leftElement);
+	const ShardInterval *rightInterval = *((const ShardInterval **) rightElement);
+	int64 leftShardId = leftInterval->id;
+	int64 rightShardId = rightInterval->id;
 
-				/* skip over the null consts */
-				continue;
-			}
+	/* we compare 64-bit integers, instead of casting their difference to int */
+	if (leftShardId > rightShardId)
+	{
+		return 1;
+	}
+	else if (leftShardId < rightShardId)
+	{
+		return -1;
+	}
+	else
+	{
+		return 0;
+	}
+}
 
-			Assert(IsA(tableExpression, Var));
-			tableColumn = (Var *) tableExpression;
-			tableColumnId = tableColumn->varattno;
 
-			tableTupleValues[tableColumnId - 1] = storeTupleValues[storeColumnIndex];
-			tableTupleNulls[tableColumnId - 1] = storeTupleNulls[storeColumnIndex];
-		}
+/*
+ * ParameterizeTaskQuery produces a copy of the given query in which the
+ * eligible constants have been replaced with external parameter references
+ * ($1, $2, ...), and returns the replaced Const nodes in parameter number
+ * order through parameterConstList. The function returns NULL when the query
+ * contains no eligible constant or has too many of them, in which case the
+ * caller should execute the literal query text.
+ */
+static Query *
+ParameterizeTaskQuery(Query *query, List **parameterConstList)
+{
+	ConstParamContext context;
+	Query *parameterizedQuery = NULL;
 
-		tableTuple = heap_form_tuple(tableTupleDescriptor,
-									 tableTupleValues, tableTupleNulls);
+	context.constList = NIL;
+	context.failed = false;
 
-		simple_heap_insert(table, tableTuple);
-		CommandCounterIncrement();
+	parameterizedQuery = (Query *) ConstToParamMutator((Node *) query, &context);
 
-		ExecClearTuple(storeTableSlot);
-		heap_freetuple(tableTuple);
+	if (context.failed || context.constList == NIL)
+	{
+		return NULL;
 	}
 
-	ExecDropSingleTupleTableSlot(storeTableSlot);
-	heap_close(table, RowExclusiveLock);
+	*parameterConstList = context.constList;
+
+	return parameterizedQuery;
 }
 
 
 /*
- * PgShardExecutorRun actually runs a distributed plan, if any.
+ * ConstToParamMutator walks an expression tree and replaces Const nodes with
+ * equivalent PARAM_EXTERN Param nodes, collecting the replaced constants in
+ * the context. NULL constants and literals of unresolved type keep their
+ * inline form: their deparsed representation carries type information that a
+ * bare parameter reference would lose.
  */
-static void
-PgShardExecutorRun(QueryDesc *queryDesc, ScanDirection direction, long count)
+static Node *
+ConstToParamMutator(Node *node, ConstParamContext *context)
 {
-	PlannedStmt *plannedStatement = queryDesc->plannedstmt;
-	bool pgShardExecution = IsPgShardPlan(plannedStatement);
-
-	if (pgShardExecution)
+	if (node == NULL)
 	{
-		EState *estate = queryDesc->estate;
-		CmdType operation = queryDesc->operation;
-		DistributedPlan *plan = (DistributedPlan *) plannedStatement->planTree;
-		MemoryContext oldcontext = NULL;
-
-		Assert(estate != NULL);
-		Assert(!(estate->es_top_eflags & EXEC_FLAG_EXPLAIN_ONLY));
+		return NULL;
+	}
 
-		/* we only support default scan direction and row fetch count */
-		if (!ScanDirectionIsForward(direction))
-		{
-			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-							errmsg("scan directions other than forward scans "
-								   "are unsupported")));
-		}
-		if (count != 0)
-		{
-			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-							errmsg("fetching rows from a query using a cursor "
-								   "is unsupported")));
-		}
+	if (IsA(node, Query))
+	{
+		return (Node *) query_tree_mutator((Query *) node, ConstToParamMutator,
+										   (void *) context, 0);
+	}
 
-		oldcontext = MemoryContextSwitchTo(estate->es_query_cxt);
+	if (IsA(node, Const))
+	{
+		Const *constant = (Const *) node;
+		Param *parameter = NULL;
 
-		if (queryDesc->totaltime != NULL)
+		if (constant->constisnull || constant->consttype == UNKNOWNOID)
 		{
-			InstrStartNode(queryDesc->totaltime);
+			return (Node *) copyObject(constant);
 		}
 
-		if (operation == CMD_INSERT || operation == CMD_UPDATE ||
-			operation == CMD_DELETE)
+		if (list_length(context->constList) >= MAX_TASK_PARAMETERS)
 		{
-			int32 affectedRowCount = ExecuteDistributedModify(plan);
-			estate->es_processed = affectedRowCount;
+			context->failed = true;
+			return (Node *) copyObject(constant);
 		}
-		else if (operation == CMD_SELECT)
-		{
-			DestReceiver *destination = queryDesc->dest;
-			List *targetList = plan->targetList;
-			TupleDesc tupleDescriptor = ExecCleanTypeFromTL(targetList, false);
 
-			ExecuteSingleShardSelect(plan, estate, tupleDescriptor, destination);
-		}
-		else
-		{
-			ereport(ERROR, (errmsg("unrecognized operation code: %d",
-								   (int) operation)));
-		}
+		context->constList = lappend(context->constList, constant);
 
-		if (queryDesc->totaltime != NULL)
-		{
-			InstrStopNode(queryDesc->totaltime, estate->es_processed);
-		}
+		parameter = makeNode(Param);
+		parameter->paramkind = PARAM_EXTERN;
+		parameter->paramid = list_length(context->constList);
+		parameter->paramtype = constant->consttype;
+		parameter->paramtypmod = constant->consttypmod;
+		parameter->paramcollid = constant->constcollid;
+		parameter->location = constant->location;
 
-		MemoryContextSwitchTo(oldcontext);
-	}
-	else
-	{
-		/* this isn't a query pg_shard handles: use previous hook or standard */
-		if (PreviousExecutorRunHook != NULL)
-		{
-			PreviousExecutorRunHook(queryDesc, direction, count);
-		}
-		else
-		{
-			standard_ExecutorRun(queryDesc, direction, count);
-		}
+		return (Node *) parameter;
 	}
+
+	return expression_tree_mutator(node, ConstToParamMutator, (void *) context);
 }
 
 
 /*
- * ExecuteDistributedModify is the main entry point for modifying distributed
- * tables. A distributed modification is successful if any placement of the
- * distributed table is successful. ExecuteDistributedModify returns the number
- * of modified rows in that case and errors in all others. This function will
- * also generate warnings for individual placement failures.
+ * MultiRowInsertValuesRTE returns the VALUES range table entry of a multi-row
+ * INSERT statement, or NULL when the query is not such an insert. Single-row
+ * inserts place their values directly in the target list and have no VALUES
+ * range table entry.
  */
-static int32
-ExecuteDistributedModify(DistributedPlan *plan)
+static RangeTblEntry *
+MultiRowInsertValuesRTE(Query *query)
 {
-	int32 affectedTupleCount = -1;
-	Task *task = (Task *) linitial(plan->taskList);
-	ListCell *taskPlacementCell = NULL;
-	List *failedPlacementList = NIL;
-	ListCell *failedPlacementCell = NULL;
+	ListCell *rangeTableCell = NULL;
 
-	/* we only support a single modification to a single shard */
-	if (list_length(plan->taskList) != 1)
+	if (query->commandType != CMD_INSERT)
 	{
-		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-						errmsg("cannot modify multiple shards during a single query")));
+		return NULL;
 	}
 
-	if (UseDtmTransactions)
+	foreach(rangeTableCell, query->rtable)
 	{
-		DtmTwoPhaseCommit = true;
-		PrepareDtmTransaction(task);
+		RangeTblEntry *rangeTableEntry = (RangeTblEntry *) lfirst(rangeTableCell);
+		if (rangeTableEntry->rtekind == RTE_VALUES)
+		{
+			return rangeTableEntry;
+		}
 	}
 
-	foreach(taskPlacementCell, task->taskPlacementList)
-	{
-		ShardPlacement *taskPlacement = (ShardPlacement *) lfirst(taskPlacementCell);
-		char *nodeName = taskPlacement->nodeName;
-		int32 nodePort = taskPlacement->nodePort;
+	return NULL;
+}
 
-		PGconn *connection = NULL;
-		PGresult *result = NULL;
-		char *currentAffectedTupleString = NULL;
-		int32 currentAffectedTupleCount = -1;
 
-		Assert(taskPlacement->shardState == STATE_FINALIZED);
+/* groups the rows of a multi-row INSERT which target the same shard */
+typedef struct ShardInsertGroup
+{
+	ShardInterval *shardInterval;
+	List *rowList; /* VALUES rows routed to this shard */
+} ShardInsertGroup;
 
-		connection = GetConnection(nodeName, nodePort, !UseDtmTransactions);
-		if (connection == NULL)
-		{
-			failedPlacementList = lappend(failedPlacementList, taskPlacement);
+
+/*
+ * BuildMultiRowInsertPlan creates the DistributedPlan for a multi-row INSERT.
+ * The rows of the VALUES list are grouped by the shard their partition column
+ * value falls into, and one multi-row INSERT statement is deparsed per shard,
+ * so loading many rows costs one round trip per shard instead of one per row.
+ */
+static DistributedPlan *
+BuildMultiRowInsertPlan(Query *query, RangeTblEntry *valuesRTE)
+{
+	DistributedPlan *distributedPlan = NULL;
+	Oid distributedTableId = ExtractFirstDistributedTableId(query);
+	Var *partitionColumn = PartitionColumn(distributedTableId);
+	TargetEntry *partitionTargetEntry = get_tle_by_resno(query->targetList,
+														 partitionColumn->varattno);
+	List *shardIntervalList = LookupShardIntervalList(distributedTableId);
+	List *originalValuesLists = valuesRTE->values_lists;
+	List *insertGroupList = NIL;
+	List *taskList = NIL;
+	int valuesColumnIndex = 0;
+	int valuesRangeTableIndex = 1;
+	ListCell *rangeTableCell = NULL;
+	ListCell *valuesCell = NULL;
+	ListCell *groupCell = NULL;
+
+	/* error out if no shards exist for the table */
+	if (shardIntervalList == NIL)
+	{
+		char *relationName = get_rel_name(distributedTableId);
+
+		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+						errmsg("could not find any shards for query"),
+						errdetail("No shards exist for distributed table \"%s\".",
+								  relationName),
+						errhint("Run master_create_worker_shards to create shards "
+								"and try again.")));
+	}
+
+	if (partitionTargetEntry == NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+						errmsg("cannot plan INSERT using row with NULL value "
+							   "in partition column")));
+	}
+
+	/* locate the partition column within the VALUES rows */
+	foreach(rangeTableCell, query->rtable)
+	{
+		if (lfirst(rangeTableCell) == valuesRTE)
+		{
+			break;
+		}
+		valuesRangeTableIndex++;
+	}
+
+	if (IsA(partitionTargetEntry->expr, Var) &&
+		((Var *) partitionTargetEntry->expr)->varno == (Index) valuesRangeTableIndex)
+	{
+		valuesColumnIndex = ((Var *) partitionTargetEntry->expr)->varattno;
+	}
+	else if (!IsA(partitionTargetEntry->expr, Const))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot plan sharded INSERT using a non-constant "
+							   "partition column value")));
+	}
+
+	/* group the rows by the shard their partition column value falls into */
+	foreach(valuesCell, originalValuesLists)
+	{
+		List *rowValues = (List *) lfirst(valuesCell);
+		Const *partitionValue = NULL;
+		OpExpr *equalityExpr = NULL;
+		Const *rightConst = NULL;
+		List *prunedShardList = NIL;
+		ShardInterval *shardInterval = NULL;
+		ShardInsertGroup *insertGroup = NULL;
+
+		if (valuesColumnIndex > 0)
+		{
+			Node *partitionExpr = (Node *) list_nth(rowValues,
+													valuesColumnIndex - 1);
+			if (!IsA(partitionExpr, Const))
+			{
+				ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+								errmsg("cannot plan sharded INSERT using a "
+									   "non-constant partition column value")));
+			}
+			partitionValue = (Const *) partitionExpr;
+		}
+		else
+		{
+			partitionValue = (Const *) partitionTargetEntry->expr;
+		}
+
+		if (partitionValue->constisnull)
+		{
+			ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+							errmsg("cannot plan INSERT using row with NULL value "
+								   "in partition column")));
+		}
+
+		/* build an equality clause and prune to the row's target shard */
+		equalityExpr = MakeOpExpression(partitionColumn, BTEqualStrategyNumber);
+		rightConst = (Const *) get_rightop((Expr *) equalityExpr);
+		Assert(IsA(rightConst, Const));
+
+		rightConst->constvalue = partitionValue->constvalue;
+		rightConst->constisnull = partitionValue->constisnull;
+		rightConst->constbyval = partitionValue->constbyval;
+
+		prunedShardList = PruneShardList(distributedTableId,
+										 list_make1(equalityExpr),
+										 shardIntervalList);
+		if (list_length(prunedShardList) != 1)
+		{
+			ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+							errmsg("distributed INSERT rows must each map to "
+								   "exactly one shard")));
+		}
+		shardInterval = (ShardInterval *) linitial(prunedShardList);
+
+		foreach(groupCell, insertGroupList)
+		{
+			ShardInsertGroup *candidateGroup = lfirst(groupCell);
+			if (candidateGroup->shardInterval->id == shardInterval->id)
+			{
+				insertGroup = candidateGroup;
+				break;
+			}
+		}
+
+		if (insertGroup == NULL)
+		{
+			insertGroup = (ShardInsertGroup *) palloc0(sizeof(ShardInsertGroup));
+			insertGroup->shardInterval = shardInterval;
+
+			insertGroupList = lappend(insertGroupList, insertGroup);
+		}
+
+		insertGroup->rowList = lappend(insertGroup->rowList, rowValues);
+	}
+
+	/* deparse one multi-row INSERT per target shard */
+	foreach(groupCell, insertGroupList)
+	{
+		ShardInsertGroup *insertGroup = (ShardInsertGroup *) lfirst(groupCell);
+		int64 shardId = insertGroup->shardInterval->id;
+		List *finalizedPlacementList = NIL;
+		Task *task = NULL;
+		StringInfo queryString = makeStringInfo();
+
+		/* grab shared metadata lock to stop concurrent placement additions */
+		LockShardDistributionMetadata(shardId, ShareLock);
+
+		/* now safe to populate placement list */
+		finalizedPlacementList = LoadFinalizedShardPlacementList(shardId);
+
+		valuesRTE->values_lists = insertGroup->rowList;
+		deparse_shard_query(query, shardId, queryString);
+
+		if (LogDistributedStatements)
+		{
+			ereport(LOG, (errmsg("distributed statement: %s", queryString->data)));
+		}
+
+		task = (Task *) palloc0(sizeof(Task));
+		task->queryString = queryString;
+		task->taskPlacementList = finalizedPlacementList;
+		task->shardId = shardId;
+
+		taskList = lappend(taskList, task);
+	}
+
+	valuesRTE->values_lists = originalValuesLists;
+
+	distributedPlan = palloc0(sizeof(DistributedPlan));
+	distributedPlan->plan.type = (NodeTag) T_DistributedPlan;
+	distributedPlan->targetList = query->targetList;
+	distributedPlan->taskList = taskList;
+	distributedPlan->multiRowInsert = true;
+
+	return distributedPlan;
+}
+
+
+/*
+ * ExternParamWalker walks a query tree and returns true if it contains any
+ * external parameter reference, i.e. a placeholder of a prepared statement
+ * whose value only becomes known at execution time.
+ */
+static bool
+ExternParamWalker(Node *node, void *context)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, Param) && ((Param *) node)->paramkind == PARAM_EXTERN)
+	{
+		return true;
+	}
+
+	if (IsA(node, Query))
+	{
+		return query_tree_walker((Query *) node, ExternParamWalker, context, 0);
+	}
+
+	return expression_tree_walker(node, ExternParamWalker, context);
+}
+
+
+/*
+ * BindQueryParameters returns a version of the given query in which every
+ * external parameter reference has been replaced by a Const carrying the
+ * parameter's bound value. The function errors out if some referenced
+ * parameter has no value.
+ */
+static Query *
+BindQueryParameters(Query *query, ParamListInfo boundParams)
+{
+	return (Query *) ParamToConstMutator((Node *) query, boundParams);
+}
+
+
+/*
+ * ParamToConstMutator replaces PARAM_EXTERN Param nodes with Const nodes
+ * built from the corresponding bound parameter values. It is the inverse of
+ * ConstToParamMutator above.
+ */
+static Node *
+ParamToConstMutator(Node *node, ParamListInfo boundParams)
+{
+	if (node == NULL)
+	{
+		return NULL;
+	}
+
+	if (IsA(node, Query))
+	{
+		return (Node *) query_tree_mutator((Query *) node, ParamToConstMutator,
+										   (void *) boundParams, 0);
+	}
+
+	if (IsA(node, Param))
+	{
+		Param *parameter = (Param *) node;
+		ParamExternData *parameterData = NULL;
+		int16 typeLength = 0;
+		bool typeByValue = false;
+		Datum constantValue = 0;
+
+		if (parameter->paramkind != PARAM_EXTERN)
+		{
+			return (Node *) copyObject(parameter);
+		}
+
+		if (boundParams == NULL || parameter->paramid < 1 ||
+			parameter->paramid > boundParams->numParams)
+		{
+			ereport(ERROR, (errcode(ERRCODE_UNDEFINED_OBJECT),
+							errmsg("no value found for parameter %d",
+								   parameter->paramid)));
+		}
+
+		parameterData = &boundParams->params[parameter->paramid - 1];
+
+		/* give the parameter's owner a chance to supply the value on demand */
+		if (!OidIsValid(parameterData->ptype) && boundParams->paramFetch != NULL)
+		{
+			(*boundParams->paramFetch)(boundParams, parameter->paramid);
+		}
+
+		if (!OidIsValid(parameterData->ptype))
+		{
+			ereport(ERROR, (errcode(ERRCODE_UNDEFINED_OBJECT),
+							errmsg("no value found for parameter %d",
+								   parameter->paramid)));
+		}
+
+		if (parameterData->ptype != parameter->paramtype)
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+							errmsg("type of parameter %d (%s) does not match "
+								   "that when preparing the plan (%s)",
+								   parameter->paramid,
+								   format_type_be(parameterData->ptype),
+								   format_type_be(parameter->paramtype))));
+		}
+
+		get_typlenbyval(parameter->paramtype, &typeLength, &typeByValue);
+		if (!parameterData->isnull)
+		{
+			constantValue = datumCopy(parameterData->value, typeByValue,
+									  typeLength);
+		}
+
+		return (Node *) makeConst(parameter->paramtype, parameter->paramtypmod,
+								  parameter->paramcollid, (int) typeLength,
+								  constantValue, parameterData->isnull,
+								  typeByValue);
+	}
+
+	return expression_tree_mutator(node, ParamToConstMutator,
+								   (void *) boundParams);
+}
+
+
+/*
+ * DeferredRoutingEligible decides whether shard routing for the given
+ * parameterized query can be postponed until execution time. INSERTs always
+ * qualify: their target shard follows from the partition column value of the
+ * inserted row. Other commands qualify when their restrictions compare the
+ * partition column against a constant or an external parameter, since
+ * binding the parameter values then lets the regular pruning logic pick the
+ * target shard. Queries which do not qualify keep the existing behavior.
+ */
+static bool
+DeferredRoutingEligible(Query *query)
+{
+	Oid distributedTableId = ExtractFirstDistributedTableId(query);
+	Var *partitionColumn = NULL;
+	List *restrictList = NIL;
+	ListCell *restrictCell = NULL;
+
+	if (query->commandType == CMD_INSERT)
+	{
+		return true;
+	}
+
+	/* joins route through the colocated join planner, never deferred */
+	if (list_length(QueryRelationIdList(query)) > 1)
+	{
+		return false;
+	}
+
+	partitionColumn = PartitionColumn(distributedTableId);
+	restrictList = QueryRestrictList(query);
+
+	foreach(restrictCell, restrictList)
+	{
+		OpExpr *operatorExpression = NULL;
+		Node *leftArgument = NULL;
+		Node *rightArgument = NULL;
+		Node *valueArgument = NULL;
+		Node *restriction = (Node *) lfirst(restrictCell);
+
+		if (!IsA(restriction, OpExpr) ||
+			list_length(((OpExpr *) restriction)->args) != 2)
+		{
+			continue;
+		}
+
+		operatorExpression = (OpExpr *) restriction;
+		leftArgument =
+			strip_implicit_coercions(get_leftop((Expr *) operatorExpression));
+		rightArgument =
+			strip_implicit_coercions(get_rightop((Expr *) operatorExpression));
+
+		if (IsA(leftArgument, Var) &&
+			((Var *) leftArgument)->varattno == partitionColumn->varattno)
+		{
+			valueArgument = rightArgument;
+		}
+		else if (IsA(rightArgument, Var) &&
+				 ((Var *) rightArgument)->varattno == partitionColumn->varattno)
+		{
+			valueArgument = leftArgument;
+		}
+		else
+		{
+			continue;
+		}
+
+		if (IsA(valueArgument, Const) ||
+			(IsA(valueArgument, Param) &&
+			 ((Param *) valueArgument)->paramkind == PARAM_EXTERN))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * BuildDeferredRoutingScan wraps the routing query and the standard planner's
+ * plan in a CustomScan node. The cost fields are left at zero on purpose: the
+ * plan cache compares the costs of generic and custom plans, and a resolved
+ * DistributedPlan reports zero cost as well, so anything higher would make the
+ * plan cache replan the statement on every execution.
+ */
+static CustomScan *
+BuildDeferredRoutingScan(Query *query, Plan *originalPlan)
+{
+	CustomScan *routingScan = makeNode(CustomScan);
+
+	routingScan->scan.plan.targetlist = originalPlan->targetlist;
+	routingScan->custom_private = list_make2(query, originalPlan);
+	routingScan->methods = &DeferredRoutingScanMethods;
+
+	return routingScan;
+}
+
+
+/*
+ * DeferredRoutingScanStateError reports that a deferred routing plan has
+ * reached the standard executor, which can only happen when pg_shard's
+ * executor hooks are not installed.
+ */
+static Node *
+DeferredRoutingScanStateError(CustomScan *customScan)
+{
+	ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR),
+					errmsg("cannot execute deferred shard routing plan "
+						   "without the pg_shard executor hooks")));
+
+	return NULL; /* keep compiler happy */
+}
+
+
+/*
+ * PgShardExecutorStart sets up the executor state and queryDesc for pgShard
+ * executed statements. The function also handles multi-shard selects
+ * differently by fetching the remote data and modifying the existing plan to
+ * scan that data.
+ */
+static void
+PgShardExecutorStart(QueryDesc *queryDesc, int eflags)
+{
+	PlannedStmt *plannedStatement = queryDesc->plannedstmt;
+	bool pgShardExecution = false;
+
+	/*
+	 * Plans which deferred their shard routing are resolved here, now that
+	 * the parameter values are known. Resolution works on a private copy of
+	 * the planned statement: the original may live in the plan cache and be
+	 * re-executed with different parameter values later.
+	 */
+	if (IsPgShardDeferredPlan(plannedStatement))
+	{
+		plannedStatement = ResolveDeferredPlannedStmt(plannedStatement,
+													  queryDesc->params);
+		queryDesc->plannedstmt = plannedStatement;
+	}
+
+	pgShardExecution = IsPgShardPlan(plannedStatement);
+
+	if (pgShardExecution)
+	{
+		DistributedPlan *distributedPlan = (DistributedPlan *) plannedStatement->planTree;
+		bool selectFromMultipleShards = distributedPlan->selectFromMultipleShards;
+		bool zeroShardQuery = (list_length(distributedPlan->taskList) == 0);
+
+		if (zeroShardQuery)
+		{
+			/* if zero shards are involved, let non-INSERTs hit local table */
+			Plan *originalPlan = distributedPlan->originalPlan;
+			plannedStatement->planTree = originalPlan;
+
+			if (plannedStatement->commandType == CMD_INSERT)
+			{
+				ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+								errmsg("could not find destination shard for new row"),
+								errdetail("Target relation does not contain any shards "
+										  "capable of storing the new row.")));
+			}
+
+			NextExecutorStartHook(queryDesc, eflags);
+		}
+		else if (!selectFromMultipleShards)
+		{
+			/* bool topLevel = true; */
+			LOCKMODE lockMode = NoLock;
+			EState *executorState = NULL;
+
+			/*
+			 * Also enable transactions to have ability to run the same test 
+			 * with and without DTM.
+			 */
+			/*
+			 * if (!UseDtmTransactions)
+			 * {
+			 *	PreventTransactionChain(topLevel, "distributed commands");
+			 *	eflags |= EXEC_FLAG_SKIP_TRIGGERS;
+			 * }
+			 *
+			 */
+
+			/* build empty executor state to obtain per-query memory context */
+			executorState = CreateExecutorState();
+			executorState->es_top_eflags = eflags;
+			executorState->es_instrument = queryDesc->instrument_options;
+
+			queryDesc->estate = executorState;
+
+			lockMode = CommutativityRuleToLockMode(plannedStatement->commandType);
+			if (lockMode != NoLock)
+			{
+				AcquireExecutorShardLocks(distributedPlan->taskList, lockMode);
+			}
+		}
+		else
+		{
+			/*
+			 * If its a SELECT query over multiple shards, we fetch the relevant
+			 * data from the remote nodes and insert it into a temp table. We then
+			 * point the existing plan to scan this temp table instead of the
+			 * original one.
+			 */
+			Plan *originalPlan = NULL;
+			RangeTblEntry *sequentialScanRangeTable = NULL;
+			Oid intermediateResultTableId = InvalidOid;
+			bool missingOK = false;
+
+			/* execute the previously created statement to create a temp table */
+			CreateStmt *createStmt = distributedPlan->createTemporaryTableStmt;
+			const char *queryDescription = "create temp table like";
+			RangeVar *intermediateResultTable = createStmt->relation;
+
+			ProcessUtility((Node *) createStmt, queryDescription,
+						   PROCESS_UTILITY_TOPLEVEL, NULL, None_Receiver, NULL);
+
+			/* execute select queries and fetch results into the temp table */
+			ExecuteMultipleShardSelect(distributedPlan, intermediateResultTable);
+
+			/* update the query descriptor snapshot so results are visible */
+			UnregisterSnapshot(queryDesc->snapshot);
+			UpdateActiveSnapshotCommandId();
+			queryDesc->snapshot = RegisterSnapshot(GetActiveSnapshot());
+
+			/* update sequential scan's table entry to point to intermediate table */
+			intermediateResultTableId = RangeVarGetRelid(intermediateResultTable,
+														 NoLock, missingOK);
+
+			Assert(list_length(plannedStatement->rtable) == 1);
+			sequentialScanRangeTable = linitial(plannedStatement->rtable);
+			Assert(sequentialScanRangeTable->rtekind == RTE_RELATION);
+			sequentialScanRangeTable->relid = intermediateResultTableId;
+
+			/* swap in modified (local) plan for compatibility with standard start hook */
+			originalPlan = distributedPlan->originalPlan;
+			plannedStatement->planTree = originalPlan;
+
+			NextExecutorStartHook(queryDesc, eflags);
+		}
+	}
+	else
+	{
+		NextExecutorStartHook(queryDesc, eflags);
+	}
+}
+
+
+/*
+ * IsPgShardPlan determines whether the provided plannedStmt contains a plan
+ * suitable for execution by PgShard.
+ */
+static bool
+IsPgShardPlan(PlannedStmt *plannedStmt)
+{
+	Plan *plan = plannedStmt->planTree;
+	NodeTag nodeTag = nodeTag(plan);
+	bool isPgShardPlan = ((DistributedNodeTag) nodeTag == T_DistributedPlan);
+
+	return isPgShardPlan;
+}
+
+
+/*
+ * IsPgShardDeferredPlan determines whether the provided plannedStmt carries a
+ * deferred shard routing plan, recognized by its custom scan methods table.
+ */
+static bool
+IsPgShardDeferredPlan(PlannedStmt *plannedStmt)
+{
+	Plan *plan = plannedStmt->planTree;
+
+	return (IsA(plan, CustomScan) &&
+			((CustomScan *) plan)->methods == &DeferredRoutingScanMethods);
+}
+
+
+/*
+ * ResolveDeferredPlannedStmt turns a deferred routing plan into a regular
+ * distributed plan by binding the supplied parameter values into the routing
+ * query and running the usual shard pruning and task construction on the
+ * result. The function operates on a copy of the planned statement, leaving
+ * the (possibly cached) original untouched, and returns that copy with a
+ * DistributedPlan installed as its plan tree.
+ */
+static PlannedStmt *
+ResolveDeferredPlannedStmt(PlannedStmt *plannedStatement, ParamListInfo boundParams)
+{
+	PlannedStmt *resolvedStatement = copyObject(plannedStatement);
+	CustomScan *routingScan = (CustomScan *) resolvedStatement->planTree;
+	Query *routingQuery = (Query *) linitial(routingScan->custom_private);
+	Plan *originalPlan = (Plan *) lsecond(routingScan->custom_private);
+	DistributedPlan *distributedPlan = NULL;
+	RangeTblEntry *valuesRTE = NULL;
+
+	routingQuery = BindQueryParameters(routingQuery, boundParams);
+
+	valuesRTE = MultiRowInsertValuesRTE(routingQuery);
+	if (valuesRTE != NULL)
+	{
+		distributedPlan = BuildMultiRowInsertPlan(routingQuery, valuesRTE);
+	}
+	else
+	{
+		int totalShardCount = 0;
+		List *queryShardList = DistributedQueryShardList(routingQuery,
+														 &totalShardCount);
+
+		/*
+		 * The multiple shard SELECT path rebuilds the local plan around a
+		 * temporary table at planning time, which is no longer possible here.
+		 * Eligibility checking makes this case unlikely: it requires a
+		 * partition column restriction which nonetheless prunes to more than
+		 * one shard, e.g. an inequality comparison.
+		 */
+		if (routingQuery->commandType == CMD_SELECT &&
+			list_length(queryShardList) > 1)
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("parameter values do not route the prepared "
+								   "SELECT to a single shard"),
+							errhint("Execute the statement with literal values "
+									"instead.")));
+		}
+
+		distributedPlan = BuildDistributedPlan(routingQuery, queryShardList);
+		distributedPlan->totalShardCount = totalShardCount;
+	}
+
+	distributedPlan->originalPlan = originalPlan;
+	resolvedStatement->planTree = (Plan *) distributedPlan;
+
+	return resolvedStatement;
+}
+
+
+/*
+ * NextExecutorStartHook simply encapsulates the common logic of calling the
+ * next executor start hook in the chain or the standard executor start hook
+ * if no other hooks are present.
+ */
+static void
+NextExecutorStartHook(QueryDesc *queryDesc, int eflags)
+{
+	/* call into the standard executor start, or hook if set */
+	if (PreviousExecutorStartHook != NULL)
+	{
+		PreviousExecutorStartHook(queryDesc, eflags);
+	}
+	else
+	{
+		standard_ExecutorStart(queryDesc, eflags);
+	}
+}
+
+
+/*
+ * CommutativityRuleToLockMode determines the commutativity rule for the given
+ * command and returns the appropriate lock mode to enforce that rule. The
+ * function assumes a SELECT doesn't modify state and therefore is commutative
+ * with all other commands. The function also assumes that an INSERT commutes
+ * with another INSERT, but not with an UPDATE/DELETE; and an UPDATE/DELETE
+ * doesn't commute with an INSERT, UPDATE, or DELETE.
+ *
+ * The above mapping is overridden entirely when all_modifications_commutative
+ * is set to true. In that case, all commands just claim a shared lock. This
+ * allows the shard repair logic to lock out modifications while permitting all
+ * commands to otherwise commute.
+ */
+static LOCKMODE
+CommutativityRuleToLockMode(CmdType commandType)
+{
+	LOCKMODE lockMode = NoLock;
+
+	/* bypass commutativity checks when flag enabled */
+	if (AllModificationsCommutative)
+	{
+		return ShareLock;
+	}
+
+	if (commandType == CMD_SELECT)
+	{
+		lockMode = NoLock;
+	}
+	else if (commandType == CMD_INSERT)
+	{
+		lockMode = ShareLock;
+	}
+	else if (commandType == CMD_UPDATE || commandType == CMD_DELETE)
+	{
+		lockMode = ExclusiveLock;
+	}
+	else
+	{
+		ereport(ERROR, (errmsg("unrecognized operation code: %d", (int) commandType)));
+	}
+
+	return lockMode;
+}
+
+
+/*
+ * AcquireExecutorShardLocks: acquire shard locks needed for execution of tasks
+ * within a distributed plan.
+ */
+static void
+AcquireExecutorShardLocks(List *taskList, LOCKMODE lockMode)
+{
+	List *shardIdSortedTaskList = SortList(taskList, CompareTasksByShardId);
+	ListCell *taskCell = NULL;
+
+	foreach(taskCell, shardIdSortedTaskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		int64 shardId = task->shardId;
+
+		LockShardData(shardId, lockMode);
+	}
+}
+
+
+/* Helper function to compare two tasks using their shardIds. */
+static int
+CompareTasksByShardId(const void *leftElement, const void *rightElement)
+{
+	const Task *leftTask = *((const Task **) leftElement);
+	const Task *rightTask = *((const Task **) rightElement);
+	int64 leftShardId = leftTask->shardId;
+	int64 rightShardId = rightTask->shardId;
+
+	/* we compare 64-bit integers, instead of casting their difference to int */
+	if (leftShardId > rightShardId)
+	{
+		return 1;
+	}
+	else if (leftShardId < rightShardId)
+	{
+		return -1;
+	}
+	else
+	{
+		return 0;
+	}
+}
+
+
+/*
+ * ExecuteMultipleShardSelect executes the SELECT queries in the distributed
+ * plan and inserts the returned rows into the given tableId. The queries are
+ * issued on all shard connections up front and their results are consumed as
+ * they arrive, so the total latency is bounded by the slowest shard rather
+ * than by the sum over all shards.
+ */
+static void
+ExecuteMultipleShardSelect(DistributedPlan *distributedPlan,
+						   RangeVar *intermediateTable)
+{
+	List *taskList = distributedPlan->taskList;
+	List *targetList = distributedPlan->targetList;
+
+	/* ExecType instead of ExecCleanType so we don't ignore junk columns */
+	TupleDesc tupleStoreDescriptor = ExecTypeFromTL(targetList, false);
+
+	int taskCount = list_length(taskList);
+	TaskExecution *taskExecutions = (TaskExecution *)
+		palloc0(taskCount * sizeof(TaskExecution));
+	AttInMetadata *attributeInputMetadata =
+		TupleDescGetAttInMetadata(tupleStoreDescriptor);
+	char **columnArray = (char **)
+		palloc0(tupleStoreDescriptor->natts * sizeof(char *));
+	MemoryContext ioContext = AllocSetContextCreate(CurrentMemoryContext,
+													"MultiShardSelect",
+													ALLOCSET_DEFAULT_MINSIZE,
+													ALLOCSET_DEFAULT_INITSIZE,
+													ALLOCSET_DEFAULT_MAXSIZE);
+	FmgrInfo *receiveFunctions = NULL;
+	Oid *typeIoParams = NULL;
+	bool binaryResults = false;
+	int completedCount = 0;
+	int taskIndex = 0;
+	ListCell *taskCell = NULL;
+
+	if (BinaryTransfer)
+	{
+		binaryResults = BuildBinaryReceiveFunctions(tupleStoreDescriptor,
+													&receiveFunctions,
+													&typeIoParams);
+	}
+
+	DtmTwoPhaseCommit = IsTransactionBlock();
+
+	foreach(taskCell, taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		TaskExecution *taskExecution = &taskExecutions[taskIndex++];
+
+		taskExecution->task = task;
+		taskExecution->placementCell = list_head(task->taskPlacementList);
+		taskExecution->tupleStore = tuplestore_begin_heap(false, false, work_mem);
+
+		if (UseDtmTransactions)
+		{
+			PrepareDtmTransaction(task);
+		}
+	}
+
+	while (completedCount < taskCount)
+	{
+		fd_set readFileDescriptorSet;
+		int maxFileDescriptor = -1;
+		int selectResult = 0;
+
+		/* (re)start every task which has no query in flight */
+		for (taskIndex = 0; taskIndex < taskCount; taskIndex++)
+		{
+			TaskExecution *taskExecution = &taskExecutions[taskIndex];
+			if (!taskExecution->done && taskExecution->connection == NULL)
+			{
+				StartTaskExecution(taskExecution, taskExecutions, taskCount,
+								   binaryResults);
+			}
+		}
+
+		FD_ZERO(&readFileDescriptorSet);
+		for (taskIndex = 0; taskIndex < taskCount; taskIndex++)
+		{
+			TaskExecution *taskExecution = &taskExecutions[taskIndex];
+			if (!taskExecution->done && taskExecution->connection != NULL)
+			{
+				int fileDescriptor = PQsocket(taskExecution->connection);
+				FD_SET(fileDescriptor, &readFileDescriptorSet);
+				if (fileDescriptor > maxFileDescriptor)
+				{
+					maxFileDescriptor = fileDescriptor;
+				}
+			}
+		}
+		Assert(maxFileDescriptor >= 0);
+
+		selectResult = select(maxFileDescriptor + 1, &readFileDescriptorSet,
+							  NULL, NULL, NULL);
+		if (selectResult < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			ereport(ERROR, (errcode_for_socket_access(),
+							errmsg("select() failed: %m")));
+		}
+
+		for (taskIndex = 0; taskIndex < taskCount; taskIndex++)
+		{
+			TaskExecution *taskExecution = &taskExecutions[taskIndex];
+			if (taskExecution->done || taskExecution->connection == NULL ||
+				!FD_ISSET(PQsocket(taskExecution->connection),
+						  &readFileDescriptorSet))
+			{
+				continue;
+			}
+
+			if (!DrainTaskResults(taskExecution, attributeInputMetadata,
+								  receiveFunctions, typeIoParams,
+								  columnArray, ioContext))
+			{
+				/* this placement failed: retry the task on the next one */
+				tuplestore_clear(taskExecution->tupleStore);
+				PurgeConnection(taskExecution->connection);
+				taskExecution->connection = NULL;
+			}
+			else if (taskExecution->done)
+			{
+				/*
+				 * We successfully fetched data into local tuplestore. Now move
+				 * results from the tupleStore into the table.
+				 */
+				TupleStoreToTable(intermediateTable, targetList,
+								  tupleStoreDescriptor,
+								  taskExecution->tupleStore);
+
+				tuplestore_end(taskExecution->tupleStore);
+				taskExecution->connection = NULL;
+				completedCount++;
+			}
+		}
+	}
+
+	MemoryContextDelete(ioContext);
+	pfree(columnArray);
+	pfree(taskExecutions);
+}
+
+
+/*
+ * StartTaskExecution sends the task's query on the first usable placement,
+ * starting from the placement the task previously failed over to. If the
+ * candidate placement's connection already carries another task's query, the
+ * task is left pending and retried once that connection drains. Running out
+ * of placements is an error, matching the sequential executor.
+ */
+static void
+StartTaskExecution(TaskExecution *taskExecution, TaskExecution *taskExecutions,
+				   int taskCount, bool binaryResults)
+{
+	while (taskExecution->placementCell != NULL)
+	{
+		ShardPlacement *taskPlacement =
+			(ShardPlacement *) lfirst(taskExecution->placementCell);
+		char *nodeName = taskPlacement->nodeName;
+		int32 nodePort = taskPlacement->nodePort;
+		bool queryOK = false;
+
+		PGconn *connection = GetConnection(nodeName, nodePort, !UseDtmTransactions);
+		if (connection == NULL)
+		{
+			taskExecution->placementCell = lnext(taskExecution->placementCell);
+			continue;
+		}
+
+		if (ConnectionBusy(connection, taskExecutions, taskCount))
+		{
+			return;
+		}
+
+		queryOK = SendQueryInSingleRowMode(taskExecution->task, nodeName, nodePort,
+										   connection, binaryResults);
+		if (!queryOK)
+		{
+			PurgeConnection(connection);
+			taskExecution->placementCell = lnext(taskExecution->placementCell);
+			continue;
+		}
+
+		taskExecution->placementCell = lnext(taskExecution->placementCell);
+		taskExecution->connection = connection;
+		return;
+	}
+
+	ereport(ERROR, (errmsg("could not receive query results")));
+}
+
+
+/*
+ * ConnectionBusy returns true if some task's query is currently in flight on
+ * the given connection. Connections are cached per node, so two shards placed
+ * on the same node share one connection and must take turns on it.
+ */
+static bool
+ConnectionBusy(PGconn *connection, TaskExecution *taskExecutions, int taskCount)
+{
+	int taskIndex = 0;
+	for (taskIndex = 0; taskIndex < taskCount; taskIndex++)
+	{
+		if (taskExecutions[taskIndex].connection == connection)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/*
+ * DrainTaskResults consumes whatever input has arrived on the task's
+ * connection and stores the completed rows into the task's tuple store,
+ * without ever blocking on the socket. The function sets the task's done flag
+ * once the query's last result has been processed, and returns false if the
+ * connection failed or the remote node reported an error.
+ */
+static bool
+DrainTaskResults(TaskExecution *taskExecution, AttInMetadata *attributeInputMetadata,
+				 FmgrInfo *receiveFunctions, Oid *typeIoParams,
+				 char **columnArray, MemoryContext ioContext)
+{
+	PGconn *connection = taskExecution->connection;
+
+	if (PQconsumeInput(connection) == 0)
+	{
+		ReportRemoteError(connection, NULL);
+		return false;
+	}
+
+	while (!PQisBusy(connection))
+	{
+		ExecStatusType resultStatus = 0;
+
+		PGresult *result = PQgetResult(connection);
+		if (result == NULL)
+		{
+			taskExecution->done = true;
+			return true;
+		}
+
+		resultStatus = PQresultStatus(result);
+		if ((resultStatus != PGRES_SINGLE_TUPLE) && (resultStatus != PGRES_TUPLES_OK))
+		{
+			ReportRemoteError(connection, result);
+			PQclear(result);
+
+			return false;
+		}
+
+		StoreResultTuples(result, attributeInputMetadata, receiveFunctions,
+						  typeIoParams, columnArray, ioContext,
+						  taskExecution->tupleStore);
+		PQclear(result);
+	}
+
+	return true;
+}
+
+
+/*
+ * ExecuteTaskAndStoreResults executes the task on the remote node, retrieves
+ * the results and stores them in the given tuple store. If the task fails on
+ * one of the placements, the function retries it on other placements.
+ */
+bool
+ExecuteTaskAndStoreResults(Task *task, TupleDesc tupleDescriptor,
+						   Tuplestorestate *tupleStore)
+{
+	bool resultsOK = false;
+	List *taskPlacementList = task->taskPlacementList;
+	ListCell *taskPlacementCell = NULL;
+	FmgrInfo *receiveFunctions = NULL;
+	Oid *typeIoParams = NULL;
+	bool binaryResults = false;
+
+	if (BinaryTransfer)
+	{
+		binaryResults = BuildBinaryReceiveFunctions(tupleDescriptor,
+													&receiveFunctions,
+													&typeIoParams);
+	}
+
+	/*
+	 * Try to run the query to completion on one placement. If the query fails
+	 * attempt the query on the next placement.
+	 */
+	foreach(taskPlacementCell, taskPlacementList)
+	{
+		ShardPlacement *taskPlacement = (ShardPlacement *) lfirst(taskPlacementCell);
+		char *nodeName = taskPlacement->nodeName;
+		int32 nodePort = taskPlacement->nodePort;
+		bool queryOK = false;
+		bool storedOK = false;
+
+		PGconn *connection = GetConnection(nodeName, nodePort, !UseDtmTransactions);
+		if (connection == NULL)
+		{
+			continue;
+		}
+
+		queryOK = SendQueryInSingleRowMode(task, nodeName, nodePort, connection,
+										   binaryResults);
+		if (!queryOK)
+		{
+			PurgeConnection(connection);
+			continue;
+		}
+
+		storedOK = StoreQueryResult(connection, tupleDescriptor, receiveFunctions,
+									typeIoParams, tupleStore);
+		if (storedOK)
+		{
+			resultsOK = true;
+			break;
+		}
+		else
+		{
+			tuplestore_clear(tupleStore);
+			PurgeConnection(connection);
+		}
+	}
+
+	return resultsOK;
+}
+
+
+/*
+ * SendQueryInSingleRowMode sends the task's query on the connection in an
+ * asynchronous way. The function also sets the single-row mode on the
+ * connection so that we receive results a row at a time. When binaryResults
+ * is set the query is sent through the extended protocol requesting results
+ * in binary format. Parameterized tasks execute through a statement prepared
+ * on the placement, falling back to the full query text when preparation is
+ * not possible.
+ */
+static bool
+SendQueryInSingleRowMode(Task *task, char *nodeName, int32 nodePort,
+						 PGconn *connection, bool binaryResults)
+{
+	int querySent = 0;
+	int singleRowMode = 0;
+	int resultFormat = binaryResults ? 1 : 0;
+
+	if (UsePreparedStatements && task->parameterizedQueryString != NULL)
+	{
+		char *statementName =
+			PrepareRemoteStatement(nodeName, nodePort, connection,
+								   task->parameterizedQueryString->data,
+								   task->parameterCount, task->parameterTypes);
+		if (statementName != NULL)
+		{
+			querySent = PQsendQueryPrepared(connection, statementName,
+											task->parameterCount,
+											(const char *const *) task->parameterValues,
+											NULL, NULL, resultFormat);
+		}
+		else
+		{
+			querySent = PQsendQueryParams(connection,
+										  task->parameterizedQueryString->data,
+										  task->parameterCount, task->parameterTypes,
+										  (const char *const *) task->parameterValues,
+										  NULL, NULL, resultFormat);
+		}
+	}
+	else if (binaryResults)
+	{
+		querySent = PQsendQueryParams(connection, task->queryString->data, 0, NULL,
+									  NULL, NULL, NULL, 1);
+	}
+	else
+	{
+		querySent = PQsendQuery(connection, task->queryString->data);
+	}
+	if (querySent == 0)
+	{
+		ReportRemoteError(connection, NULL);
+		return false;
+	}
+
+	singleRowMode = PQsetSingleRowMode(connection);
+	if (singleRowMode == 0)
+	{
+		ReportRemoteError(connection, NULL);
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * StoreQueryResult gets the query results from the given connection, builds
+ * tuples from the results and stores them in the given tuple-store. If the
+ * function can't receive query results, it returns false. Note that this
+ * function assumes the query has already been sent on the connection and the
+ * tuplestore has earlier been initialized.
+ */
+static bool
+StoreQueryResult(PGconn *connection, TupleDesc tupleDescriptor,
+				 FmgrInfo *receiveFunctions, Oid *typeIoParams,
+				 Tuplestorestate *tupleStore)
+{
+	AttInMetadata *attributeInputMetadata = TupleDescGetAttInMetadata(tupleDescriptor);
+	uint32 expectedColumnCount = tupleDescriptor->natts;
+	char **columnArray = (char **) palloc0(expectedColumnCount * sizeof(char *));
+	MemoryContext ioContext = AllocSetContextCreate(CurrentMemoryContext,
+													"StoreQueryResult",
+													ALLOCSET_DEFAULT_MINSIZE,
+													ALLOCSET_DEFAULT_INITSIZE,
+													ALLOCSET_DEFAULT_MAXSIZE);
+
+	Assert(tupleStore != NULL);
+
+	for (;;)
+	{
+		ExecStatusType resultStatus = 0;
+
+		PGresult *result = PQgetResult(connection);
+		if (result == NULL)
+		{
+			break;
+		}
+
+		resultStatus = PQresultStatus(result);
+		if ((resultStatus != PGRES_SINGLE_TUPLE) && (resultStatus != PGRES_TUPLES_OK))
+		{
+			ReportRemoteError(connection, result);
+			PQclear(result);
+
+			return false;
+		}
+
+		Assert((uint32) PQnfields(result) == expectedColumnCount);
+
+		StoreResultTuples(result, attributeInputMetadata, receiveFunctions,
+						  typeIoParams, columnArray, ioContext, tupleStore);
+		PQclear(result);
+	}
+
+	pfree(columnArray);
+
+	return true;
+}
+
+
+/*
+ * TypeBinaryReceiveDefined returns true if the given type has a binary
+ * receive function.
+ */
+static bool
+TypeBinaryReceiveDefined(Oid typeId)
+{
+	HeapTuple typeTuple = SearchSysCache1(TYPEOID, ObjectIdGetDatum(typeId));
+	Form_pg_type typeForm = NULL;
+	bool receiveDefined = false;
+
+	if (!HeapTupleIsValid(typeTuple))
+	{
+		return false;
+	}
+
+	typeForm = (Form_pg_type) GETSTRUCT(typeTuple);
+	receiveDefined = OidIsValid(typeForm->typreceive);
+	ReleaseSysCache(typeTuple);
+
+	return receiveDefined;
+}
+
+
+/*
+ * BuildBinaryReceiveFunctions looks up the binary receive function for every
+ * column of the given tuple descriptor. The function returns false without
+ * producing the arrays when some column type lacks a binary receive function,
+ * in which case the caller must fall back to text transfer.
+ */
+static bool
+BuildBinaryReceiveFunctions(TupleDesc tupleDescriptor, FmgrInfo **receiveFunctions,
+							Oid **typeIoParams)
+{
+	int columnCount = tupleDescriptor->natts;
+	FmgrInfo *functionArray = (FmgrInfo *) palloc0(columnCount * sizeof(FmgrInfo));
+	Oid *ioParamArray = (Oid *) palloc0(columnCount * sizeof(Oid));
+	int columnIndex = 0;
+
+	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = tupleDescriptor->attrs[columnIndex];
+		Oid receiveFunctionId = InvalidOid;
+
+		if (attribute->attisdropped ||
+			!TypeBinaryReceiveDefined(attribute->atttypid))
+		{
+			pfree(functionArray);
+			pfree(ioParamArray);
+			return false;
+		}
+
+		getTypeBinaryInputInfo(attribute->atttypid, &receiveFunctionId,
+							   &ioParamArray[columnIndex]);
+		fmgr_info(receiveFunctionId, &functionArray[columnIndex]);
+	}
+
+	*receiveFunctions = functionArray;
+	*typeIoParams = ioParamArray;
+
+	return true;
+}
+
+
+/*
+ * StoreResultTuples builds tuples from all rows of the given result and puts
+ * them into the given tuple-store. Binary format results are decoded with the
+ * provided receive functions; text results go through the types' input
+ * functions as before.
+ */
+static void
+StoreResultTuples(PGresult *result, AttInMetadata *attributeInputMetadata,
+				  FmgrInfo *receiveFunctions, Oid *typeIoParams,
+				  char **columnArray, MemoryContext ioContext,
+				  Tuplestorestate *tupleStore)
+{
+	uint32 rowIndex = 0;
+	uint32 columnIndex = 0;
+	uint32 rowCount = PQntuples(result);
+	uint32 columnCount = PQnfields(result);
+
+	if (columnCount > 0 && PQfformat(result, 0) == 1)
+	{
+		TupleDesc tupleDescriptor = attributeInputMetadata->tupdesc;
+		Datum *valueArray = (Datum *) palloc0(columnCount * sizeof(Datum));
+		bool *nullArray = (bool *) palloc0(columnCount * sizeof(bool));
+
+		Assert(receiveFunctions != NULL);
+
+		for (rowIndex = 0; rowIndex < rowCount; rowIndex++)
+		{
+			HeapTuple heapTuple = NULL;
+			MemoryContext oldContext = MemoryContextSwitchTo(ioContext);
+
+			for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+			{
+				if (PQgetisnull(result, rowIndex, columnIndex))
+				{
+					valueArray[columnIndex] = (Datum) 0;
+					nullArray[columnIndex] = true;
+				}
+				else
+				{
+					StringInfoData columnData;
+
+					columnData.data = PQgetvalue(result, rowIndex, columnIndex);
+					columnData.len = PQgetlength(result, rowIndex, columnIndex);
+					columnData.maxlen = columnData.len;
+					columnData.cursor = 0;
+
+					valueArray[columnIndex] = ReceiveFunctionCall(
+						&receiveFunctions[columnIndex], &columnData,
+						typeIoParams[columnIndex],
+						tupleDescriptor->attrs[columnIndex]->atttypmod);
+					nullArray[columnIndex] = false;
+				}
+			}
+
+			heapTuple = heap_form_tuple(tupleDescriptor, valueArray, nullArray);
+
+			MemoryContextSwitchTo(oldContext);
+
+			tuplestore_puttuple(tupleStore, heapTuple);
+			MemoryContextReset(ioContext);
+		}
+
+		pfree(valueArray);
+		pfree(nullArray);
+
+		return;
+	}
+
+	for (rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		HeapTuple heapTuple = NULL;
+		MemoryContext oldContext = NULL;
+		memset(columnArray, 0, columnCount * sizeof(char *));
+
+		for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+		{
+			if (PQgetisnull(result, rowIndex, columnIndex))
+			{
+				columnArray[columnIndex] = NULL;
+			}
+			else
+			{
+				columnArray[columnIndex] = PQgetvalue(result, rowIndex, columnIndex);
+			}
+		}
+
+		/*
+		 * Switch to a temporary memory context that we reset after each tuple. This
+		 * protects us from any memory leaks that might be present in I/O functions
+		 * called by BuildTupleFromCStrings.
+		 */
+		oldContext = MemoryContextSwitchTo(ioContext);
+
+		heapTuple = BuildTupleFromCStrings(attributeInputMetadata, columnArray);
+
+		MemoryContextSwitchTo(oldContext);
+
+		tuplestore_puttuple(tupleStore, heapTuple);
+		MemoryContextReset(ioContext);
+	}
+}
+
+
+/*
+ * TupleStoreToTable inserts the tuples from the given tupleStore into the given
+ * table. Before doing so, the function extracts the values from the tuple and
+ * sets the right attributes for the given table based on the column attribute
+ * numbers.
+ */
+static void
+TupleStoreToTable(RangeVar *tableRangeVar, List *storeToTableColumnList,
+				  TupleDesc storeTupleDescriptor, Tuplestorestate *store)
+{
+	Relation table = heap_openrv(tableRangeVar, RowExclusiveLock);
+	TupleDesc tableTupleDescriptor = RelationGetDescr(table);
+
+	int tableColumnCount = tableTupleDescriptor->natts;
+	Datum *tableTupleValues = palloc0(tableColumnCount * sizeof(Datum));
+	bool *tableTupleNulls = palloc0(tableColumnCount * sizeof(bool));
+
+	int storeColumnCount = storeTupleDescriptor->natts;
+	Datum *storeTupleValues = palloc0(storeColumnCount * sizeof(Datum));
+	bool *storeTupleNulls = palloc0(storeColumnCount * sizeof(bool));
+	TupleTableSlot *storeTableSlot = MakeSingleTupleTableSlot(storeTupleDescriptor);
+
+	for (;;)
+	{
+		HeapTuple storeTuple = NULL;
+		HeapTuple tableTuple = NULL;
+		int storeColumnIndex = 0;
+
+		bool nextTuple = tuplestore_gettupleslot(store, true, false, storeTableSlot);
+		if (!nextTuple)
+		{
+			break;
+		}
+
+		storeTuple = ExecFetchSlotTuple(storeTableSlot);
+		heap_deform_tuple(storeTuple, storeTupleDescriptor,
+						  storeTupleValues, storeTupleNulls);
+
+		/* set all values to null for the table tuple */
+		memset(tableTupleNulls, true, tableColumnCount * sizeof(bool));
+
+		/*
+		 * Extract values from the returned tuple and set them in the right
+		 * attribute location for the new table. We determine this attribute
+		 * location based on the attribute number in the column from the remote
+		 * query's target list.
+		 */
+		for (storeColumnIndex = 0; storeColumnIndex < storeColumnCount;
+			 storeColumnIndex++)
+		{
+			TargetEntry *tableEntry = (TargetEntry *) list_nth(storeToTableColumnList,
+															   storeColumnIndex);
+			Expr *tableExpression = tableEntry->expr;
+			Var *tableColumn = NULL;
+			int tableColumnId = 0;
+
+			/* special case for count(*) as we expect a NULL const */
+			if (IsA(tableExpression, Const))
+			{
+				Const *constValue PG_USED_FOR_ASSERTS_ONLY = (Const *) tableExpression;
+				Assert(constValue->consttype == UNKNOWNOID);
+
+				/* skip over the null consts */
+				continue;
+			}
+
+			Assert(IsA(tableExpression, Var));
+			tableColumn = (Var *) tableExpression;
+			tableColumnId = tableColumn->varattno;
+
+			tableTupleValues[tableColumnId - 1] = storeTupleValues[storeColumnIndex];
+			tableTupleNulls[tableColumnId - 1] = storeTupleNulls[storeColumnIndex];
+		}
+
+		tableTuple = heap_form_tuple(tableTupleDescriptor,
+									 tableTupleValues, tableTupleNulls);
+
+		simple_heap_insert(table, tableTuple);
+		CommandCounterIncrement();
+
+		ExecClearTuple(storeTableSlot);
+		heap_freetuple(tableTuple);
+	}
+
+	ExecDropSingleTupleTableSlot(storeTableSlot);
+	heap_close(table, RowExclusiveLock);
+}
+
+
+/*
+ * PgShardExecutorRun actually runs a distributed plan, if any.
+ */
+static void
+PgShardExecutorRun(QueryDesc *queryDesc, ScanDirection direction, long count)
+{
+	PlannedStmt *plannedStatement = queryDesc->plannedstmt;
+	bool pgShardExecution = IsPgShardPlan(plannedStatement);
+
+	if (pgShardExecution)
+	{
+		EState *estate = queryDesc->estate;
+		CmdType operation = queryDesc->operation;
+		DistributedPlan *plan = (DistributedPlan *) plannedStatement->planTree;
+		MemoryContext oldcontext = NULL;
+
+		Assert(estate != NULL);
+		Assert(!(estate->es_top_eflags & EXEC_FLAG_EXPLAIN_ONLY));
+
+		/* we only support default scan direction and row fetch count */
+		if (!ScanDirectionIsForward(direction))
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("scan directions other than forward scans "
+								   "are unsupported")));
+		}
+		if (count != 0)
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("fetching rows from a query using a cursor "
+								   "is unsupported")));
+		}
+
+		oldcontext = MemoryContextSwitchTo(estate->es_query_cxt);
+
+		if (queryDesc->totaltime != NULL)
+		{
+			InstrStartNode(queryDesc->totaltime);
+		}
+
+		if (operation == CMD_INSERT || operation == CMD_UPDATE ||
+			operation == CMD_DELETE)
+		{
+			int32 affectedRowCount = ExecuteDistributedModify(plan);
+			estate->es_processed = affectedRowCount;
+		}
+		else if (operation == CMD_SELECT)
+		{
+			DestReceiver *destination = queryDesc->dest;
+			List *targetList = plan->targetList;
+			TupleDesc tupleDescriptor = ExecCleanTypeFromTL(targetList, false);
+
+			ExecuteSingleShardSelect(plan, estate, tupleDescriptor, destination);
+		}
+		else
+		{
+			ereport(ERROR, (errmsg("unrecognized operation code: %d",
+								   (int) operation)));
+		}
+
+		if (queryDesc->totaltime != NULL)
+		{
+			InstrStopNode(queryDesc->totaltime, estate->es_processed);
+		}
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+	else
+	{
+		/* this isn't a query pg_shard handles: use previous hook or standard */
+		if (PreviousExecutorRunHook != NULL)
+		{
+			PreviousExecutorRunHook(queryDesc, direction, count);
+		}
+		else
+		{
+			standard_ExecutorRun(queryDesc, direction, count);
+		}
+	}
+}
+
+
+/*
+ * ExecuteDistributedModify is the main entry point for modifying distributed
+ * tables. A distributed modification is successful if any placement of the
+ * distributed table is successful. ExecuteDistributedModify returns the number
+ * of modified rows in that case and errors in all others. This function will
+ * also generate warnings for individual placement failures.
+ */
+static int32
+ExecuteDistributedModify(DistributedPlan *plan)
+{
+	int32 affectedTupleCount = 0;
+	ListCell *taskCell = NULL;
+
+	/* only batched multi-row INSERTs may touch more than one shard */
+	if (list_length(plan->taskList) != 1 && !plan->multiRowInsert)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot modify multiple shards during a single query")));
+	}
+
+	foreach(taskCell, plan->taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+
+		affectedTupleCount += ExecuteModifyTask(task);
+	}
+
+	return affectedTupleCount;
+}
+
+
+/*
+ * ExecuteModifyTask executes a modification task on all placements of its
+ * shard, marking placements which fail as inactive, and returns the number of
+ * affected tuples.
+ */
+static int32
+ExecuteModifyTask(Task *task)
+{
+	int32 affectedTupleCount = -1;
+	ListCell *taskPlacementCell = NULL;
+	List *failedPlacementList = NIL;
+	ListCell *failedPlacementCell = NULL;
+
+	if (UseDtmTransactions)
+	{
+		DtmTwoPhaseCommit = true;
+		PrepareDtmTransaction(task);
+	}
+
+	foreach(taskPlacementCell, task->taskPlacementList)
+	{
+		ShardPlacement *taskPlacement = (ShardPlacement *) lfirst(taskPlacementCell);
+		char *nodeName = taskPlacement->nodeName;
+		int32 nodePort = taskPlacement->nodePort;
+
+		PGconn *connection = NULL;
+		PGresult *result = NULL;
+		char *currentAffectedTupleString = NULL;
+		int32 currentAffectedTupleCount = -1;
+
+		Assert(taskPlacement->shardState == STATE_FINALIZED);
+
+		connection = GetConnection(nodeName, nodePort, !UseDtmTransactions);
+		if (connection == NULL)
+		{
+			failedPlacementList = lappend(failedPlacementList, taskPlacement);
+			continue;
+		}
+
+		result = ExecuteTaskOnConnection(task, nodeName, nodePort, connection);
+		if (PQresultStatus(result) != PGRES_COMMAND_OK)
+		{
+			ReportRemoteError(connection, result);
+			PQclear(result);
+
+			failedPlacementList = lappend(failedPlacementList, taskPlacement);
+			continue;
+		}
+		TRACE("shard_xtm: conn#%p: \"%s\" to %s:%u\n",
+				connection, task->queryString->data, nodeName, nodePort);
+
+		currentAffectedTupleString = PQcmdTuples(result);
+		currentAffectedTupleCount = pg_atoi(currentAffectedTupleString, sizeof(int32), 0);
+
+		if ((affectedTupleCount == -1) ||
+			(affectedTupleCount == currentAffectedTupleCount))
+		{
+			affectedTupleCount = currentAffectedTupleCount;
+		}
+		else
+		{
+			ereport(WARNING, (errmsg("modified %d tuples, but expected to modify %d",
+									 currentAffectedTupleCount, affectedTupleCount),
+							  errdetail("modified placement on %s:%d",
+										nodeName, nodePort)));
+		}
+
+		PQclear(result);
+	}
+
+	/* if all placements failed, error out */
+	if (list_length(failedPlacementList) == list_length(task->taskPlacementList))
+	{
+		ereport(ERROR, (errmsg("could not modify any active placements")));
+	}
+
+	/* otherwise, mark failed placements as inactive: they're stale */
+	foreach(failedPlacementCell, failedPlacementList)
+	{
+		ShardPlacement *failedPlacement = (ShardPlacement *) lfirst(failedPlacementCell);
+
+		UpdateShardPlacementRowState(failedPlacement->id, STATE_INACTIVE);
+	}
+
+	return affectedTupleCount;
+}
+
+
+/*
+ * ExecuteTaskOnConnection runs the task's query on the given connection and
+ * returns the result. When the task carries a parameterized query string, the
+ * statement is prepared on the placement once and then executed by name with
+ * the parameter values only, so repeated executions of the same statement
+ * shape skip the remote parser and planner. The literal query text is used
+ * when preparation is unavailable or fails.
+ */
+static PGresult *
+ExecuteTaskOnConnection(Task *task, char *nodeName, int32 nodePort,
+						PGconn *connection)
+{
+	PGresult *result = NULL;
+
+	if (UsePreparedStatements && task->parameterizedQueryString != NULL)
+	{
+		char *statementName =
+			PrepareRemoteStatement(nodeName, nodePort, connection,
+								   task->parameterizedQueryString->data,
+								   task->parameterCount, task->parameterTypes);
+		if (statementName != NULL)
+		{
+			result = PQexecPrepared(connection, statementName, task->parameterCount,
+									(const char *const *) task->parameterValues,
+									NULL, NULL, 0);
+		}
+		else
+		{
+			result = PQexecParams(connection, task->parameterizedQueryString->data,
+								  task->parameterCount, task->parameterTypes,
+								  (const char *const *) task->parameterValues,
+								  NULL, NULL, 0);
+		}
+	}
+	else
+	{
+		result = PQexec(connection, task->queryString->data);
+	}
+
+	return result;
+}
+
+
+/*
+ * PrepareDtmTransaction sends the necessary commands to the nodes to perform
+ * a global transaction.
+ */
+static void
+PrepareDtmTransaction(Task *task)
+{
+	MemoryContext oldContext = NULL;
+	ListCell *taskPlacementCell = NULL;
+	bool abortTransaction = false;
+	List *newTransactions = NIL;
+
+	oldContext = MemoryContextSwitchTo(TopTransactionContext);
+
+	foreach(taskPlacementCell, task->taskPlacementList)
+	{
+		ShardPlacement *taskPlacement = (ShardPlacement *) lfirst(taskPlacementCell);
+		char *nodeName = taskPlacement->nodeName;
+		int32 nodePort = taskPlacement->nodePort;
+		PGconn *connection = NULL;
+
+		connection = GetConnection(nodeName, nodePort, true);
+		if (connection == NULL)
+		{
+			ereport(WARNING, (errmsg("failed to connect to %s:%d",
+									 nodeName, nodePort)));
+			abortTransaction = true;
+			continue;
+		}
+
+		if (list_member_ptr(connectionsWithDtmTransactions, connection))
+		{
+			/* already started a transaction */
+			continue;
+		}
+		if (!SendCommand(connection, "BEGIN"))
+		{
+			PurgeConnection(connection);
+			abortTransaction = true;
+			continue;
+		}
+		if (!currentGlobalTransactionId)
+		{
+			/* Send dtm_begin_transaction to the first node */
+			currentGlobalTransactionId = SendDtmBeginTransaction(connection);
+			if (!currentGlobalTransactionId)
+			{
+				ereport(WARNING, (errmsg("failed to parse remoteTransactionId result on %s:%d",
+										 nodeName, nodePort)));
+				abortTransaction = true;
+				continue;
+			}
+			TRACE("shard_xtm: conn#%p: Sent dtm_begin() to %s:%u -> %llu\n",
+					 connection, nodeName, nodePort, currentGlobalTransactionId);
+		}
+		else
+		{
+			/* Send dtm_join_transaction to the rest of the nodes */
+			if (!SendDtmJoinTransaction(connection, currentGlobalTransactionId))
+			{
+				abortTransaction = true;
+				continue;
+			}
+			TRACE("shard_xtm: conn#%p: Sent dtm_access(%llu) to %s:%u\n",
+					 connection, currentGlobalTransactionId, nodeName, nodePort);
+		}
+
+		newTransactions = lappend(newTransactions, connection);
+	}
+
+	if (abortTransaction)
+	{
+		MemoryContextSwitchTo(oldContext);
+
+		/* make sure we abort all pending transactions */
+		connectionsWithDtmTransactions = newTransactions;
+		
+		/*
+		 * Since pg_shard reuses connections across transactions on the master,
+		 * we need to abort pending transactions on the workers.
+		 */
+		FinishDtmTransaction(XACT_EVENT_ABORT, NULL);
+		ereport(ERROR, (errmsg("aborting distributed transaction due to failures")));
+	}
+
+	connectionsWithDtmTransactions = list_union(connectionsWithDtmTransactions,
+												newTransactions);
+
+	MemoryContextSwitchTo(oldContext);
+
+	if (abortTransaction)
+	{
+		/*
+		 * Since pg_shard reuses connections across transactions on the master,
+		 * we need to abort pending transactions on the workers.
+		 */
+		FinishDtmTransaction(XACT_EVENT_ABORT, NULL);
+		ereport(ERROR, (errmsg("aborting distributed transaction due to failures")));
+	}
+
+	if (!commitCallbackSet)
+	{
+		RegisterXactCallback(FinishDtmTransaction, NULL);
+		commitCallbackSet = true;
+	}
+}
+
+
+static csn_t
+SendDtmBeginTransaction(PGconn *connection)
+{
+	PGresult *result = NULL;
+	char *resp = NULL;
+	csn_t remoteTransactionId;
+
+	
+	result = DtmTwoPhaseCommit
+		? PQexec(connection, psprintf("SELECT dtm_extend('%d.%d')", MyProcPid, ++currentLocalTransactionId))
+		: PQexec(connection, "SELECT dtm_extend()");
+	if (PQresultStatus(result) != PGRES_TUPLES_OK)
+	{
+		ReportRemoteError(connection, result);
+		PQclear(result);
+		return 0;
+	}
+
+	resp = PQgetvalue(result, 0, 0);
+	if (resp == NULL || (*resp) == '\0' || sscanf(resp, "%lld", &remoteTransactionId) != 1)
+	{
+		ReportRemoteError(connection, result);
+		PQclear(result);
+		return 0;
+	}
+
+	PQclear(result);
+	return remoteTransactionId;
+}
+
+
+static bool
+SendDtmJoinTransaction(PGconn *connection, csn_t TransactionId)
+{
+	PGresult *result = NULL;
+	bool resultOK = true;
+
+	result = PQexec(connection, DtmTwoPhaseCommit
+					? psprintf("SELECT dtm_access(%llu, '%d.%d')", TransactionId, MyProcPid, currentLocalTransactionId)
+					: psprintf("SELECT dtm_access(%llu)", TransactionId));
+	if (PQresultStatus(result) != PGRES_TUPLES_OK)
+	{
+		ReportRemoteError(connection, result);
+		resultOK = false;
+	}
+
+	PQclear(result);
+
+	return resultOK;
+}
+
+
+static bool
+SendCommand(PGconn *connection, char *command)
+{
+	PGresult *result = NULL;
+	bool resultOK = true;
+
+	result = PQexec(connection, command);
+	if (PQresultStatus(result) != PGRES_COMMAND_OK)
+	{
+		ReportRemoteError(connection, result);
+		resultOK = false;
+	}
+
+	PQclear(result);
+
+	return resultOK;
+}
+
+typedef bool (*DtmCommandResultHandler)(PGresult *result, void* arg);
+
+static bool RunDtmStatement(char const* sql, unsigned expectedStatus, DtmCommandResultHandler handler, void* arg)
+{
+	int querySent = 0;
+	PGresult *result = NULL;
+	PGconn *connection = NULL;
+	bool allOk = true;
+	ListCell *connectionCell = NULL;
+	ListCell *nextCell = list_head(connectionsWithDtmTransactions);
+	ListCell *prevCell = NULL;
+
+	while ((connectionCell = nextCell) != NULL)
+	{
+		nextCell = lnext(connectionCell);
+		connection = (PGconn *) lfirst(connectionCell);
+		querySent = PQsendQuery(connection, sql);
+		if (!querySent)
+		{
+			ReportRemoteError(connection, NULL);
+			list_delete_cell(connectionsWithDtmTransactions, connectionCell, prevCell);
+			PurgeConnection(connection);
+			allOk = false;
 			continue;
 		}
+		prevCell = connectionCell;
+		TRACE("shard_xtm: conn#%p: Sent %s to %s:%s\n", connection, sql, PQhost(connection), PQport(connection));
+	}
+	foreach(connectionCell, connectionsWithDtmTransactions)
+	{
+		connection = (PGconn *) lfirst(connectionCell);
+		result = PQgetResult(connection);
+		if (PQresultStatus(result) != expectedStatus || (handler && !handler(result, arg)))
+		{
+			ReportRemoteError(connection, result);
+			allOk = false;
+		}
+		PQclear(result);
+		PQgetResult(connection); /* consume NULL result */
+	}	
+	return allOk;
+}
+
+static bool RunDtmCommand(char const* sql)
+{
+	return RunDtmStatement(sql, PGRES_COMMAND_OK, NULL, NULL);
+}
+
+static bool RunDtmFunction(char const* sql)
+{
+	return RunDtmStatement(sql, PGRES_TUPLES_OK, NULL, NULL);
+}
+
+
+static bool DtmMaxCSN(PGresult *result, void* arg)
+{
+	char* resp = PQgetvalue(result, 0, 0);
+	csn_t* maxCSN = (csn_t*)arg;
+	csn_t csn = 0;
+	if (resp == NULL || (*resp) == '\0' || sscanf(resp, "%lld", &csn) != 1)
+	{
+		return false;
+	} else {
+		if (*maxCSN < csn)
+		{
+			*maxCSN = csn;
+		}
+		return true;
+	}
+}
+
+
+static void
+FinishDtmTransaction(XactEvent event, void * arg)
+{
+	if ((event == XACT_EVENT_COMMIT || event == XACT_EVENT_ABORT) && connectionsWithDtmTransactions)
+	{
+		if (DtmTwoPhaseCommit) 
+		{ 
+			if (event == XACT_EVENT_COMMIT)
+			{
+				csn_t maxCSN = 0;
+				
+				if (!RunDtmCommand(psprintf("PREPARE TRANSACTION '%d.%d'", 
+											MyProcPid, currentLocalTransactionId)) ||
+					!RunDtmFunction(psprintf("SELECT dtm_begin_prepare('%d.%d')", 
+											 MyProcPid, currentLocalTransactionId)) ||
+					!RunDtmStatement(psprintf("SELECT dtm_prepare('%d.%d',0)", 
+											  MyProcPid, currentLocalTransactionId), PGRES_TUPLES_OK, DtmMaxCSN, &maxCSN) ||
+					!RunDtmFunction(psprintf("SELECT dtm_end_prepare('%d.%d',%lld)", 
+											 MyProcPid, currentLocalTransactionId, maxCSN)) ||
+					!RunDtmCommand(psprintf("COMMIT PREPARED '%d.%d'", 
+											MyProcPid, currentLocalTransactionId)))
+				{
+					RunDtmCommand(psprintf("ROLLBACK PREPARED '%d.%d'", 
+										   MyProcPid, currentLocalTransactionId));
+				}
+			} else { 
+				RunDtmCommand("ROLLBACK");
+			}
+		} else { 
+			RunDtmCommand("COMMIT");
+		}
+		/*
+		 * Calling unregister inside callback itself leads to segfault when
+		 * there are several callbacks on the same event.
+		 */
+		/*
+		 * UnregisterXactCallback(FinishDtmTransaction, NULL);
+		 */
+		connectionsWithDtmTransactions = NIL;
+		currentGlobalTransactionId = 0;
+	}
+}
+
+
+/*
+ * ExecuteSingleShardSelect executes the remote select query and sends the
+ * resultant tuples to the given destination receiver. If the query fails on a
+ * given placement, the function attempts it on its replica.
+ */
+static void
+ExecuteSingleShardSelect(DistributedPlan *distributedPlan, EState *executorState,
+						 TupleDesc tupleDescriptor, DestReceiver *destination)
+{
+	Task *task = NULL;
+	Tuplestorestate *tupleStore = NULL;
+	bool resultsOK = false;
+	TupleTableSlot *tupleTableSlot = NULL;
+
+	List *taskList = distributedPlan->taskList;
+	Assert(list_length(taskList) == 1);
+
+	task = (Task *) linitial(taskList);
+	tupleStore = tuplestore_begin_heap(false, false, work_mem);
+
+	resultsOK = ExecuteTaskAndStoreResults(task, tupleDescriptor, tupleStore);
+	if (!resultsOK)
+	{
+		ereport(ERROR, (errmsg("could not receive query results")));
+	}
+
+	tupleTableSlot = MakeSingleTupleTableSlot(tupleDescriptor);
+
+	/* startup the tuple receiver */
+	(*destination->rStartup)(destination, CMD_SELECT, tupleDescriptor);
+
+	/* iterate over tuples in tuple store, and send them to destination */
+	for (;;)
+	{
+		bool nextTuple = tuplestore_gettupleslot(tupleStore, true, false, tupleTableSlot);
+		if (!nextTuple)
+		{
+			break;
+		}
+
+		(*destination->receiveSlot)(tupleTableSlot, destination);
+		executorState->es_processed++;
+
+		ExecClearTuple(tupleTableSlot);
+	}
+
+	/* shutdown the tuple receiver */
+	(*destination->rShutdown)(destination);
+
+	ExecDropSingleTupleTableSlot(tupleTableSlot);
+
+	tuplestore_end(tupleStore);
+}
+
+
+/*
+ * PgShardExecutorFinish cleans up after a distributed execution, if any, has
+ * executed.
+ */
+static void
+PgShardExecutorFinish(QueryDesc *queryDesc)
+{
+	PlannedStmt *plannedStatement = queryDesc->plannedstmt;
+	bool pgShardExecution = IsPgShardPlan(plannedStatement);
+
+	if (pgShardExecution)
+	{
+		EState *estate = queryDesc->estate;
+		Assert(estate != NULL);
+
+		estate->es_finished = true;
+	}
+	else
+	{
+		/* this isn't a query pg_shard handles: use previous hook or standard */
+		if (PreviousExecutorFinishHook != NULL)
+		{
+			PreviousExecutorFinishHook(queryDesc);
+		}
+		else
+		{
+			standard_ExecutorFinish(queryDesc);
+		}
+	}
+}
+
+
+/*
+ * PgShardExecutorEnd cleans up the executor state after a distributed
+ * execution, if any, has executed.
+ */
+static void
+PgShardExecutorEnd(QueryDesc *queryDesc)
+{
+	PlannedStmt *plannedStatement = queryDesc->plannedstmt;
+	bool pgShardExecution = IsPgShardPlan(plannedStatement);
+
+	if (pgShardExecution)
+	{
+		EState *estate = queryDesc->estate;
 
-		result = PQexec(connection, task->queryString->data);
-		if (PQresultStatus(result) != PGRES_COMMAND_OK)
-		{
-			ReportRemoteError(connection, result);
-			PQclear(result);
+		Assert(estate != NULL);
+		Assert(estate->es_finished);
 
-			failedPlacementList = lappend(failedPlacementList, taskPlacement);
-			continue;
+		FreeExecutorState(estate);
+		queryDesc->estate = NULL;
+		queryDesc->totaltime = NULL;
+	}
+	else
+	{
+		/* this isn't a query pg_shard handles: use previous hook or standard */
+		if (PreviousExecutorEndHook != NULL)
+		{
+			PreviousExecutorEndHook(queryDesc);
 		}
-		TRACE("shard_xtm: conn#%p: \"%s\" to %s:%u\n",
-				connection, task->queryString->data, nodeName, nodePort);
+		else
+		{
+			standard_ExecutorEnd(queryDesc);
+		}
+	}
+}
 
-		currentAffectedTupleString = PQcmdTuples(result);
-		currentAffectedTupleCount = pg_atoi(currentAffectedTupleString, sizeof(int32), 0);
 
-		if ((affectedTupleCount == -1) ||
-			(affectedTupleCount == currentAffectedTupleCount))
+/*
+ * PgShardExplainOneQuery is registered as the ExplainOneQuery hook and renders
+ * EXPLAIN output for queries planned by pg_shard. Queries which do not involve
+ * a distributed table are planned and explained exactly as the standard
+ * ExplainOneQuery would handle them, deferring to any previously installed
+ * hook first.
+ */
+static void
+PgShardExplainOneQuery(Query *query, IntoClause *into, ExplainState *es,
+					   const char *queryString, ParamListInfo params)
+{
+	PlannedStmt *plannedStatement = NULL;
+	PlannerType plannerType = DeterminePlannerType(query);
+
+	if (plannerType != PLANNER_TYPE_PG_SHARD || into != NULL)
+	{
+		if (PreviousExplainOneQueryHook != NULL)
 		{
-			affectedTupleCount = currentAffectedTupleCount;
+			PreviousExplainOneQueryHook(query, into, es, queryString, params);
 		}
 		else
 		{
-			ereport(WARNING, (errmsg("modified %d tuples, but expected to modify %d",
-									 currentAffectedTupleCount, affectedTupleCount),
-							  errdetail("modified placement on %s:%d",
-										nodeName, nodePort)));
+			/* core's ExplainOneQuery is not reachable once a hook is set */
+			instr_time planStart;
+			instr_time planDuration;
+
+			INSTR_TIME_SET_CURRENT(planStart);
+
+			plannedStatement = pg_plan_query(query,
+											 into ? 0 : CURSOR_OPT_PARALLEL_OK,
+											 params);
+
+			INSTR_TIME_SET_CURRENT(planDuration);
+			INSTR_TIME_SUBTRACT(planDuration, planStart);
+
+			ExplainOnePlan(plannedStatement, into, es, queryString, params,
+						   &planDuration);
 		}
 
-		PQclear(result);
+		return;
 	}
 
-	/* if all placements failed, error out */
-	if (list_length(failedPlacementList) == list_length(task->taskPlacementList))
+	if (es->format != EXPLAIN_FORMAT_TEXT)
 	{
-		ereport(ERROR, (errmsg("could not modify any active placements")));
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("EXPLAIN commands on distributed tables only "
+							   "support the TEXT format")));
 	}
 
-	/* otherwise, mark failed placements as inactive: they're stale */
-	foreach(failedPlacementCell, failedPlacementList)
+	if (es->analyze && query->commandType != CMD_SELECT)
 	{
-		ShardPlacement *failedPlacement = (ShardPlacement *) lfirst(failedPlacementCell);
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("EXPLAIN ANALYZE is unsupported for distributed "
+							   "modifications"),
+						errdetail("Executing the modification while explaining "
+								  "it would apply it to a single placement "
+								  "only.")));
+	}
 
-		UpdateShardPlacementRowState(failedPlacement->id, STATE_INACTIVE);
+	/* plan through the planner hook to obtain the distributed plan */
+	plannedStatement = pg_plan_query(query, 0, params);
+
+	/* resolve deferred shard routing; errors out if values are missing */
+	if (IsPgShardDeferredPlan(plannedStatement))
+	{
+		plannedStatement = ResolveDeferredPlannedStmt(plannedStatement, params);
 	}
+	Assert(IsPgShardPlan(plannedStatement));
 
-	return affectedTupleCount;
+	ExplainDistributedPlan((DistributedPlan *) plannedStatement->planTree, es);
 }
 
 
 /*
- * PrepareDtmTransaction sends the necessary commands to the nodes to perform
- * a global transaction.
+ * ExplainDistributedPlan renders a distributed plan as a tree of its tasks.
+ * Every task is explained on one of its placements, so the output shows the
+ * remote plan chosen for each shard along with the time spent obtaining it,
+ * making straggler shards visible from a single EXPLAIN invocation.
  */
 static void
-PrepareDtmTransaction(Task *task)
+ExplainDistributedPlan(DistributedPlan *distributedPlan, ExplainState *es)
 {
-	MemoryContext oldContext = NULL;
-	ListCell *taskPlacementCell = NULL;
-	bool abortTransaction = false;
-	List *newTransactions = NIL;
+	List *taskList = distributedPlan->taskList;
+	ListCell *taskCell = NULL;
 
-	oldContext = MemoryContextSwitchTo(TopTransactionContext);
+	appendStringInfoSpaces(es->str, es->indent * 2);
+	appendStringInfo(es->str, "Distributed Query");
+	if (distributedPlan->selectFromMultipleShards)
+	{
+		appendStringInfo(es->str, " (results collected in temporary table)");
+	}
+	appendStringInfo(es->str, "\n");
 
-	foreach(taskPlacementCell, task->taskPlacementList)
+	es->indent++;
+	ExplainPropertyInteger("Task Count", list_length(taskList), es);
+	if (distributedPlan->totalShardCount > 0)
 	{
-		ShardPlacement *taskPlacement = (ShardPlacement *) lfirst(taskPlacementCell);
-		char *nodeName = taskPlacement->nodeName;
-		int32 nodePort = taskPlacement->nodePort;
-		PGconn *connection = NULL;
+		ExplainPropertyInteger("Shard Count", distributedPlan->totalShardCount, es);
+	}
+
+	foreach(taskCell, taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+
+		ExplainRemoteTask(task, es);
+	}
+	es->indent--;
+}
+
+
+/*
+ * ExplainRemoteTask runs EXPLAIN for a single task on the first responsive
+ * placement and appends the returned plan to the output. The round trip time
+ * of the remote EXPLAIN is reported when timing is shown; under ANALYZE the
+ * difference between it and the remote execution time approximates the network
+ * and queueing overhead for that shard.
+ */
+static void
+ExplainRemoteTask(Task *task, ExplainState *es)
+{
+	StringInfo explainQuery = makeStringInfo();
+	ListCell *placementCell = NULL;
+	bool explainDone = false;
+
+	appendStringInfo(explainQuery, "EXPLAIN (ANALYZE %s, VERBOSE %s, COSTS %s, "
+								   "BUFFERS %s, TIMING %s, FORMAT TEXT) %s",
+					 es->analyze ? "true" : "false", es->verbose ? "true" : "false",
+					 es->costs ? "true" : "false", es->buffers ? "true" : "false",
+					 es->timing ? "true" : "false", task->queryString->data);
+
+	foreach(placementCell, task->taskPlacementList)
+	{
+		ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
+		PGconn *connection = GetConnection(placement->nodeName, placement->nodePort,
+										   true);
+		PGresult *result = NULL;
+		TimestampTz startTime = 0;
+		long durationSeconds = 0;
+		int durationMicroseconds = 0;
+		int rowCount = 0;
+		int rowIndex = 0;
 
-		connection = GetConnection(nodeName, nodePort, true);
 		if (connection == NULL)
 		{
-			ereport(WARNING, (errmsg("failed to connect to %s:%d",
-									 nodeName, nodePort)));
-			abortTransaction = true;
 			continue;
 		}
 
-		if (list_member_ptr(connectionsWithDtmTransactions, connection))
-		{
-			/* already started a transaction */
-			continue;
-		}
-		if (!SendCommand(connection, "BEGIN"))
+		startTime = GetCurrentTimestamp();
+
+		result = PQexec(connection, explainQuery->data);
+		if (PQresultStatus(result) != PGRES_TUPLES_OK)
 		{
+			ReportRemoteError(connection, result);
+			PQclear(result);
 			PurgeConnection(connection);
-			abortTransaction = true;
+
 			continue;
 		}
-		if (!currentGlobalTransactionId)
-		{
-			/* Send dtm_begin_transaction to the first node */
-			currentGlobalTransactionId = SendDtmBeginTransaction(connection);
-			if (!currentGlobalTransactionId)
-			{
-				ereport(WARNING, (errmsg("failed to parse remoteTransactionId result on %s:%d",
-										 nodeName, nodePort)));
-				abortTransaction = true;
-				continue;
-			}
-			TRACE("shard_xtm: conn#%p: Sent dtm_begin() to %s:%u -> %llu\n",
-					 connection, nodeName, nodePort, currentGlobalTransactionId);
-		}
-		else
-		{
-			/* Send dtm_join_transaction to the rest of the nodes */
-			if (!SendDtmJoinTransaction(connection, currentGlobalTransactionId))
-			{
-				abortTransaction = true;
-				continue;
-			}
-			TRACE("shard_xtm: conn#%p: Sent dtm_access(%llu) to %s:%u\n",
-					 connection, currentGlobalTransactionId, nodeName, nodePort);
-		}
 
-		newTransactions = lappend(newTransactions, connection);
-	}
+		TimestampDifference(startTime, GetCurrentTimestamp(), &durationSeconds,
+							&durationMicroseconds);
 
-	if (abortTransaction)
-	{
-		MemoryContextSwitchTo(oldContext);
+		appendStringInfoSpaces(es->str, es->indent * 2);
+		appendStringInfo(es->str, "->  Shard " INT64_FORMAT " on %s:%d\n",
+						 task->shardId, placement->nodeName, placement->nodePort);
 
-		/* make sure we abort all pending transactions */
-		connectionsWithDtmTransactions = newTransactions;
-		
-		/*
-		 * Since pg_shard reuses connections across transactions on the master,
-		 * we need to abort pending transactions on the workers.
-		 */
-		FinishDtmTransaction(XACT_EVENT_ABORT, NULL);
-		ereport(ERROR, (errmsg("aborting distributed transaction due to failures")));
-	}
+		rowCount = PQntuples(result);
+		for (rowIndex = 0; rowIndex < rowCount; rowIndex++)
+		{
+			appendStringInfoSpaces(es->str, (es->indent + 3) * 2);
+			appendStringInfo(es->str, "%s\n", PQgetvalue(result, rowIndex, 0));
+		}
 
-	connectionsWithDtmTransactions = list_union(connectionsWithDtmTransactions,
-												newTransactions);
+		if (es->timing)
+		{
+			double durationMilliseconds = (durationSeconds * 1000.0) +
+										  (durationMicroseconds / 1000.0);
 
-	MemoryContextSwitchTo(oldContext);
+			appendStringInfoSpaces(es->str, (es->indent + 3) * 2);
+			appendStringInfo(es->str, "Remote Round Trip Time: %.3f ms\n",
+							 durationMilliseconds);
+		}
 
-	if (abortTransaction)
-	{
-		/*
-		 * Since pg_shard reuses connections across transactions on the master,
-		 * we need to abort pending transactions on the workers.
-		 */
-		FinishDtmTransaction(XACT_EVENT_ABORT, NULL);
-		ereport(ERROR, (errmsg("aborting distributed transaction due to failures")));
+		PQclear(result);
+		explainDone = true;
+		break;
 	}
 
-	if (!commitCallbackSet)
+	if (!explainDone)
 	{
-		RegisterXactCallback(FinishDtmTransaction, NULL);
-		commitCallbackSet = true;
+		ereport(ERROR, (errmsg("could not run EXPLAIN on any placement of shard "
+							   INT64_FORMAT, task->shardId)));
 	}
 }
 
 
-static csn_t
-SendDtmBeginTransaction(PGconn *connection)
+/*
+ * PgShardCopyFrom implements COPY FROM for hash partitioned distributed
+ * tables. Rows are parsed on the gateway with the regular COPY input
+ * machinery, routed by the hash of their partition column value, and streamed
+ * to one open COPY per shard placement, so loading n rows costs one COPY
+ * round trip per placement instead of one INSERT per row. The remote COPY
+ * statements all run inside explicit remote transactions which are committed
+ * only after every placement has acknowledged its data, so a failure before
+ * that point loads nothing anywhere.
+ */
+static void
+PgShardCopyFrom(CopyStmt *copyStatement, char *completionTag)
 {
-	PGresult *result = NULL;
-	char *resp = NULL;
-	csn_t remoteTransactionId;
+	Relation relation = heap_openrv(copyStatement->relation, RowExclusiveLock);
+	Oid tableId = RelationGetRelid(relation);
+	char partitionMethod = PartitionType(tableId);
+	Var *partitionColumn = PartitionColumn(tableId);
+	List *shardIntervalList = LookupShardIntervalList(tableId);
+	int shardCount = list_length(shardIntervalList);
+	uint32 hashTokenIncrement = 0;
+	ShardInterval **shardIntervalArray = NULL;
+	List **shardConnectionListArray = NULL;
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+	int columnCount = tupleDescriptor->natts;
+	Datum *columnValues = NULL;
+	bool *columnNulls = NULL;
+	FmgrInfo *outputFunctions = NULL;
+	TypeCacheEntry *typeEntry = NULL;
+	FmgrInfo *hashFunction = NULL;
+	StringInfo columnNames = makeStringInfo();
+	StringInfo rowBuffer = makeStringInfo();
+	CopyState copyState = NULL;
+	EState *executorState = NULL;
+	ExprContext *exprContext = NULL;
+	MemoryContext tupleContext = NULL;
+	MemoryContext oldContext = NULL;
+	uint64 processedRowCount = 0;
+	AclResult aclResult = ACLCHECK_OK;
+	ListCell *shardIntervalCell = NULL;
+	int columnIndex = 0;
+	int shardIndex = 0;
 
-	
-	result = DtmTwoPhaseCommit
-		? PQexec(connection, psprintf("SELECT dtm_extend('%d.%d')", MyProcPid, ++currentLocalTransactionId))
-		: PQexec(connection, "SELECT dtm_extend()");
-	if (PQresultStatus(result) != PGRES_TUPLES_OK)
+	aclResult = pg_class_aclcheck(tableId, GetUserId(), ACL_INSERT);
+	if (aclResult != ACLCHECK_OK)
 	{
-		ReportRemoteError(connection, result);
-		PQclear(result);
-		return 0;
+		aclcheck_error(aclResult, ACL_KIND_CLASS,
+					   RelationGetRelationName(relation));
 	}
 
-	resp = PQgetvalue(result, 0, 0);
-	if (resp == NULL || (*resp) == '\0' || sscanf(resp, "%lld", &remoteTransactionId) != 1)
+	if (partitionMethod != HASH_PARTITION_TYPE)
 	{
-		ReportRemoteError(connection, result);
-		PQclear(result);
-		return 0;
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("COPY is only supported for hash partitioned "
+							   "distributed tables")));
 	}
 
-	PQclear(result);
-	return remoteTransactionId;
-}
-
-
-static bool
-SendDtmJoinTransaction(PGconn *connection, csn_t TransactionId)
-{
-	PGresult *result = NULL;
-	bool resultOK = true;
-
-	result = PQexec(connection, DtmTwoPhaseCommit
-					? psprintf("SELECT dtm_access(%llu, '%d.%d')", TransactionId, MyProcPid, currentLocalTransactionId)
-					: psprintf("SELECT dtm_access(%llu)", TransactionId));
-	if (PQresultStatus(result) != PGRES_TUPLES_OK)
+	if (shardIntervalList == NIL)
 	{
-		ReportRemoteError(connection, result);
-		resultOK = false;
+		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+						errmsg("could not find any shards for COPY target"),
+						errhint("Run master_create_worker_shards to create "
+								"shards and try again.")));
 	}
 
-	PQclear(result);
-
-	return resultOK;
-}
-
-
-static bool
-SendCommand(PGconn *connection, char *command)
-{
-	PGresult *result = NULL;
-	bool resultOK = true;
+	/*
+	 * Build an array routing hash tokens to shard intervals. The layout
+	 * created by master_create_worker_shards divides the hash token space
+	 * evenly, which the executor's placement cache already relies on, so we
+	 * verify it here and route rows with one division instead of a lookup.
+	 */
+	hashTokenIncrement = (uint32) (HASH_TOKEN_COUNT / shardCount);
+	shardIntervalArray = (ShardInterval **)
+		palloc0(shardCount * sizeof(ShardInterval *));
+	shardConnectionListArray = (List **) palloc0(shardCount * sizeof(List *));
 
-	result = PQexec(connection, command);
-	if (PQresultStatus(result) != PGRES_COMMAND_OK)
+	foreach(shardIntervalCell, shardIntervalList)
 	{
-		ReportRemoteError(connection, result);
-		resultOK = false;
-	}
-
-	PQclear(result);
-
-	return resultOK;
-}
-
-typedef bool (*DtmCommandResultHandler)(PGresult *result, void* arg);
+		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+		int32 shardMinHashToken = DatumGetInt32(shardInterval->minValue);
+
+		shardIndex = (int) ((uint32) (shardMinHashToken - INT32_MIN) /
+							hashTokenIncrement);
+		if (shardIndex < 0 || shardIndex >= shardCount ||
+			shardIntervalArray[shardIndex] != NULL ||
+			shardMinHashToken != (int32) (INT32_MIN +
+										  (int64) shardIndex * hashTokenIncrement))
+		{
+			ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+							errmsg("shard layout of \"%s\" does not divide the "
+								   "hash token space evenly",
+								   RelationGetRelationName(relation))));
+		}
 
-static bool RunDtmStatement(char const* sql, unsigned expectedStatus, DtmCommandResultHandler handler, void* arg)
-{
-	int querySent = 0;
-	PGresult *result = NULL;
-	PGconn *connection = NULL;
-	bool allOk = true;
-	ListCell *connectionCell = NULL;
-	ListCell *nextCell = list_head(connectionsWithDtmTransactions);
-	ListCell *prevCell = NULL;
+		shardIntervalArray[shardIndex] = shardInterval;
+	}
 
-	while ((connectionCell = nextCell) != NULL)
+	/* resolve the hash function for partition column values */
+	typeEntry = lookup_type_cache(partitionColumn->vartype,
+								  TYPECACHE_HASH_PROC_FINFO);
+	hashFunction = &(typeEntry->hash_proc_finfo);
+	if (!OidIsValid(hashFunction->fn_oid))
 	{
-		nextCell = lnext(connectionCell);
-		connection = (PGconn *) lfirst(connectionCell);
-		querySent = PQsendQuery(connection, sql);
-		if (!querySent)
+		ereport(ERROR, (errcode(ERRCODE_UNDEFINED_FUNCTION),
+						errmsg("could not identify a hash function for type %s",
+							   format_type_be(partitionColumn->vartype))));
+	}
+
+	/* resolve output functions and the remote column list once */
+	outputFunctions = (FmgrInfo *) palloc0(columnCount * sizeof(FmgrInfo));
+	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = tupleDescriptor->attrs[columnIndex];
+		Oid outputFunctionId = InvalidOid;
+		bool typeVariableLength = false;
+
+		if (attribute->attisdropped)
 		{
-			ReportRemoteError(connection, NULL);
-			list_delete_cell(connectionsWithDtmTransactions, connectionCell, prevCell);
-			PurgeConnection(connection);
-			allOk = false;
 			continue;
 		}
-		prevCell = connectionCell;
-		TRACE("shard_xtm: conn#%p: Sent %s to %s:%s\n", connection, sql, PQhost(connection), PQport(connection));
-	}
-	foreach(connectionCell, connectionsWithDtmTransactions)
-	{
-		connection = (PGconn *) lfirst(connectionCell);
-		result = PQgetResult(connection);
-		if (PQresultStatus(result) != expectedStatus || (handler && !handler(result, arg)))
+
+		getTypeOutputInfo(attribute->atttypid, &outputFunctionId,
+						  &typeVariableLength);
+		fmgr_info(outputFunctionId, &outputFunctions[columnIndex]);
+
+		if (columnNames->len > 0)
 		{
-			ReportRemoteError(connection, result);
-			allOk = false;
+			appendStringInfoString(columnNames, ", ");
 		}
-		PQclear(result);
-		PQgetResult(connection); /* consume NULL result */
-	}	
-	return allOk;
-}
+		appendStringInfoString(columnNames,
+							   quote_identifier(NameStr(attribute->attname)));
+	}
 
-static bool RunDtmCommand(char const* sql)
-{
-	return RunDtmStatement(sql, PGRES_COMMAND_OK, NULL, NULL);
-}
+	columnValues = (Datum *) palloc0(columnCount * sizeof(Datum));
+	columnNulls = (bool *) palloc0(columnCount * sizeof(bool));
 
-static bool RunDtmFunction(char const* sql)
-{
-	return RunDtmStatement(sql, PGRES_TUPLES_OK, NULL, NULL);
-}
+	executorState = CreateExecutorState();
+	exprContext = GetPerTupleExprContext(executorState);
+	tupleContext = GetPerTupleMemoryContext(executorState);
 
+	copyState = BeginCopyFrom(relation, copyStatement->filename,
+							  copyStatement->is_program,
+							  copyStatement->attlist, copyStatement->options);
 
-static bool DtmMaxCSN(PGresult *result, void* arg)
-{
-	char* resp = PQgetvalue(result, 0, 0);
-	csn_t* maxCSN = (csn_t*)arg;
-	csn_t csn = 0;
-	if (resp == NULL || (*resp) == '\0' || sscanf(resp, "%lld", &csn) != 1)
+	PG_TRY();
 	{
-		return false;
-	} else {
-		if (*maxCSN < csn)
+		for (;;)
 		{
-			*maxCSN = csn;
-		}
-		return true;
-	}
-}
+			bool nextRowFound = false;
+			Datum partitionValue = 0;
+			int hashedValue = 0;
+			bool firstColumn = true;
+			ListCell *connectionCell = NULL;
+			List *connectionList = NIL;
+
+			ResetPerTupleExprContext(executorState);
+
+			oldContext = MemoryContextSwitchTo(tupleContext);
+			nextRowFound = NextCopyFrom(copyState, exprContext,
+										columnValues, columnNulls, NULL);
+			if (!nextRowFound)
+			{
+				MemoryContextSwitchTo(oldContext);
+				break;
+			}
 
+			if (columnNulls[partitionColumn->varattno - 1])
+			{
+				ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+								errmsg("cannot copy row with NULL value in "
+									   "partition column")));
+			}
 
-static void
-FinishDtmTransaction(XactEvent event, void * arg)
-{
-	if ((event == XACT_EVENT_COMMIT || event == XACT_EVENT_ABORT) && connectionsWithDtmTransactions)
-	{
-		if (DtmTwoPhaseCommit) 
-		{ 
-			if (event == XACT_EVENT_COMMIT)
+			/* route the row by the hash of its partition column value */
+			partitionValue = columnValues[partitionColumn->varattno - 1];
+			hashedValue = DatumGetInt32(FunctionCall1(hashFunction,
+													  partitionValue));
+			shardIndex = (int) ((uint32) (hashedValue - INT32_MIN) /
+								hashTokenIncrement);
+			if (shardIndex >= shardCount)
 			{
-				csn_t maxCSN = 0;
-				
-				if (!RunDtmCommand(psprintf("PREPARE TRANSACTION '%d.%d'", 
-											MyProcPid, currentLocalTransactionId)) ||
-					!RunDtmFunction(psprintf("SELECT dtm_begin_prepare('%d.%d')", 
-											 MyProcPid, currentLocalTransactionId)) ||
-					!RunDtmStatement(psprintf("SELECT dtm_prepare('%d.%d',0)", 
-											  MyProcPid, currentLocalTransactionId), PGRES_TUPLES_OK, DtmMaxCSN, &maxCSN) ||
-					!RunDtmFunction(psprintf("SELECT dtm_end_prepare('%d.%d',%lld)", 
-											 MyProcPid, currentLocalTransactionId, maxCSN)) ||
-					!RunDtmCommand(psprintf("COMMIT PREPARED '%d.%d'", 
-											MyProcPid, currentLocalTransactionId)))
+				/* remainder tokens of the division belong to the last shard */
+				shardIndex = shardCount - 1;
+			}
+
+			if (shardConnectionListArray[shardIndex] == NIL)
+			{
+				OpenCopyToShard(shardIntervalArray[shardIndex]->id, tableId,
+								columnNames->data,
+								&shardConnectionListArray[shardIndex]);
+			}
+			connectionList = shardConnectionListArray[shardIndex];
+
+			/* serialize the row in COPY text format */
+			resetStringInfo(rowBuffer);
+			for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+			{
+				Form_pg_attribute attribute = tupleDescriptor->attrs[columnIndex];
+				char *columnText = NULL;
+
+				if (attribute->attisdropped)
 				{
-					RunDtmCommand(psprintf("ROLLBACK PREPARED '%d.%d'", 
-										   MyProcPid, currentLocalTransactionId));
+					continue;
 				}
-			} else { 
-				RunDtmCommand("ROLLBACK");
+
+				if (!firstColumn)
+				{
+					appendStringInfoChar(rowBuffer, '\t');
+				}
+				firstColumn = false;
+
+				if (columnNulls[columnIndex])
+				{
+					appendStringInfoString(rowBuffer, "\\N");
+					continue;
+				}
+
+				columnText = OutputFunctionCall(&outputFunctions[columnIndex],
+												columnValues[columnIndex]);
+				AppendCopyAttributeValue(rowBuffer, columnText);
 			}
-		} else { 
-			RunDtmCommand("COMMIT");
+			appendStringInfoChar(rowBuffer, '\n');
+
+			foreach(connectionCell, connectionList)
+			{
+				PGconn *connection = (PGconn *) lfirst(connectionCell);
+
+				if (PQputCopyData(connection, rowBuffer->data,
+								  rowBuffer->len) != 1)
+				{
+					ReportRemoteError(connection, NULL);
+					ereport(ERROR, (errmsg("could not send row to shard "
+										   "placement")));
+				}
+			}
+
+			MemoryContextSwitchTo(oldContext);
+			processedRowCount++;
 		}
-		/*
-		 * Calling unregister inside callback itself leads to segfault when
-		 * there are several callbacks on the same event.
-		 */
-		/*
-		 * UnregisterXactCallback(FinishDtmTransaction, NULL);
-		 */
-		connectionsWithDtmTransactions = NIL;
-		currentGlobalTransactionId = 0;
-	}
-}
 
+		/* finish every in-progress remote COPY before committing any of them */
+		for (shardIndex = 0; shardIndex < shardCount; shardIndex++)
+		{
+			ListCell *connectionCell = NULL;
 
-/*
- * ExecuteSingleShardSelect executes the remote select query and sends the
- * resultant tuples to the given destination receiver. If the query fails on a
- * given placement, the function attempts it on its replica.
- */
-static void
-ExecuteSingleShardSelect(DistributedPlan *distributedPlan, EState *executorState,
-						 TupleDesc tupleDescriptor, DestReceiver *destination)
-{
-	Task *task = NULL;
-	Tuplestorestate *tupleStore = NULL;
-	bool resultsOK = false;
-	TupleTableSlot *tupleTableSlot = NULL;
+			foreach(connectionCell, shardConnectionListArray[shardIndex])
+			{
+				PGconn *connection = (PGconn *) lfirst(connectionCell);
+				PGresult *result = NULL;
 
-	List *taskList = distributedPlan->taskList;
-	Assert(list_length(taskList) == 1);
+				if (PQputCopyEnd(connection, NULL) != 1)
+				{
+					ReportRemoteError(connection, NULL);
+					ereport(ERROR, (errmsg("could not end COPY on shard "
+										   "placement")));
+				}
 
-	task = (Task *) linitial(taskList);
-	tupleStore = tuplestore_begin_heap(false, false, work_mem);
+				result = PQgetResult(connection);
+				if (PQresultStatus(result) != PGRES_COMMAND_OK)
+				{
+					ReportRemoteError(connection, result);
+					PQclear(result);
+					ereport(ERROR, (errmsg("COPY to shard placement failed")));
+				}
+				PQclear(result);
 
-	resultsOK = ExecuteTaskAndStoreResults(task, tupleDescriptor, tupleStore);
-	if (!resultsOK)
-	{
-		ereport(ERROR, (errmsg("could not receive query results")));
-	}
+				while ((result = PQgetResult(connection)) != NULL)
+				{
+					PQclear(result);
+				}
+			}
+		}
 
-	tupleTableSlot = MakeSingleTupleTableSlot(tupleDescriptor);
+		for (shardIndex = 0; shardIndex < shardCount; shardIndex++)
+		{
+			ListCell *connectionCell = NULL;
 
-	/* startup the tuple receiver */
-	(*destination->rStartup)(destination, CMD_SELECT, tupleDescriptor);
+			foreach(connectionCell, shardConnectionListArray[shardIndex])
+			{
+				PGconn *connection = (PGconn *) lfirst(connectionCell);
+				PGresult *result = PQexec(connection, "COMMIT");
 
-	/* iterate over tuples in tuple store, and send them to destination */
-	for (;;)
+				if (PQresultStatus(result) != PGRES_COMMAND_OK)
+				{
+					ReportRemoteError(connection, result);
+					PQclear(result);
+					ereport(ERROR, (errmsg("could not commit COPY on shard "
+										   "placement")));
+				}
+				PQclear(result);
+			}
+		}
+	}
+	PG_CATCH();
 	{
-		bool nextTuple = tuplestore_gettupleslot(tupleStore, true, false, tupleTableSlot);
-		if (!nextTuple)
+		/*
+		 * Drop every connection with a COPY or remote transaction still in
+		 * progress: closing the socket aborts the remote transaction, and a
+		 * purged connection cannot poison the connection cache.
+		 */
+		for (shardIndex = 0; shardIndex < shardCount; shardIndex++)
 		{
-			break;
-		}
+			ListCell *connectionCell = NULL;
 
-		(*destination->receiveSlot)(tupleTableSlot, destination);
-		executorState->es_processed++;
+			foreach(connectionCell, shardConnectionListArray[shardIndex])
+			{
+				PurgeConnection((PGconn *) lfirst(connectionCell));
+			}
+		}
 
-		ExecClearTuple(tupleTableSlot);
+		PG_RE_THROW();
 	}
+	PG_END_TRY();
 
-	/* shutdown the tuple receiver */
-	(*destination->rShutdown)(destination);
-
-	ExecDropSingleTupleTableSlot(tupleTableSlot);
+	EndCopyFrom(copyState);
+	FreeExecutorState(executorState);
+	heap_close(relation, NoLock);
 
-	tuplestore_end(tupleStore);
+	if (completionTag != NULL)
+	{
+		snprintf(completionTag, COMPLETION_TAG_BUFSIZE, "COPY " UINT64_FORMAT,
+				 processedRowCount);
+	}
 }
 
 
 /*
- * PgShardExecutorFinish cleans up after a distributed execution, if any, has
- * executed.
+ * OpenCopyToShard starts a COPY into the given shard on every finalized
+ * placement, appending each connection to the caller's list as soon as it is
+ * obtained so that the caller's error cleanup covers partially opened shards.
+ * The remote COPY runs in an explicit transaction so that the caller can
+ * commit all placements together once the whole load has been transferred.
  */
 static void
-PgShardExecutorFinish(QueryDesc *queryDesc)
+OpenCopyToShard(int64 shardId, Oid relationId, const char *columnNameString,
+				List **connectionListPointer)
 {
-	PlannedStmt *plannedStatement = queryDesc->plannedstmt;
-	bool pgShardExecution = IsPgShardPlan(plannedStatement);
+	List *placementList = NIL;
+	ListCell *placementCell = NULL;
+	StringInfo copyCommand = makeStringInfo();
+	char *relationName = get_rel_name(relationId);
 
-	if (pgShardExecution)
-	{
-		EState *estate = queryDesc->estate;
-		Assert(estate != NULL);
+	/* prevent concurrent placement changes and uncommutative modifications */
+	LockShardDistributionMetadata(shardId, ShareLock);
+	LockShardData(shardId, ShareLock);
 
-		estate->es_finished = true;
+	placementList = LoadFinalizedShardPlacementList(shardId);
+	if (placementList == NIL)
+	{
+		ereport(ERROR, (errmsg("could not find any healthy placement for "
+							   "shard " INT64_FORMAT, shardId)));
 	}
-	else
+
+	AppendShardIdToName(&relationName, shardId);
+	appendStringInfo(copyCommand, "COPY %s (%s) FROM STDIN",
+					 quote_identifier(relationName), columnNameString);
+
+	foreach(placementCell, placementList)
 	{
-		/* this isn't a query pg_shard handles: use previous hook or standard */
-		if (PreviousExecutorFinishHook != NULL)
+		ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
+		PGconn *connection = GetConnection(placement->nodeName,
+										   placement->nodePort, true);
+		PGresult *result = NULL;
+
+		if (connection == NULL)
 		{
-			PreviousExecutorFinishHook(queryDesc);
+			ereport(ERROR, (errmsg("could not connect to shard placement "
+								   "\"%s:%d\"", placement->nodeName,
+								   placement->nodePort)));
 		}
-		else
+
+		*connectionListPointer = lappend(*connectionListPointer, connection);
+
+		result = PQexec(connection, "BEGIN");
+		if (PQresultStatus(result) != PGRES_COMMAND_OK)
 		{
-			standard_ExecutorFinish(queryDesc);
+			ReportRemoteError(connection, result);
+			PQclear(result);
+			ereport(ERROR, (errmsg("could not begin transaction on shard "
+								   "placement")));
+		}
+		PQclear(result);
+
+		result = PQexec(connection, copyCommand->data);
+		if (PQresultStatus(result) != PGRES_COPY_IN)
+		{
+			ReportRemoteError(connection, result);
+			PQclear(result);
+			ereport(ERROR, (errmsg("could not start COPY on shard placement")));
 		}
+		PQclear(result);
 	}
 }
 
 
 /*
- * PgShardExecutorEnd cleans up the executor state after a distributed
- * execution, if any, has executed.
+ * AppendCopyAttributeValue appends an attribute value to the row buffer,
+ * escaping the characters that are special in COPY text format.
  */
 static void
-PgShardExecutorEnd(QueryDesc *queryDesc)
+AppendCopyAttributeValue(StringInfo rowBuffer, const char *value)
 {
-	PlannedStmt *plannedStatement = queryDesc->plannedstmt;
-	bool pgShardExecution = IsPgShardPlan(plannedStatement);
+	const char *position = value;
 
-	if (pgShardExecution)
+	for (; *position != '\0'; position++)
 	{
-		EState *estate = queryDesc->estate;
-
-		Assert(estate != NULL);
-		Assert(estate->es_finished);
+		char character = *position;
 
-		FreeExecutorState(estate);
-		queryDesc->estate = NULL;
-		queryDesc->totaltime = NULL;
-	}
-	else
-	{
-		/* this isn't a query pg_shard handles: use previous hook or standard */
-		if (PreviousExecutorEndHook != NULL)
+		switch (character)
 		{
-			PreviousExecutorEndHook(queryDesc);
-		}
-		else
-		{
-			standard_ExecutorEnd(queryDesc);
+			case '\\':
+				appendStringInfoString(rowBuffer, "\\\\");
+				break;
+
+			case '\t':
+				appendStringInfoString(rowBuffer, "\\t");
+				break;
+
+			case '\n':
+				appendStringInfoString(rowBuffer, "\\n");
+				break;
+
+			case '\r':
+				appendStringInfoString(rowBuffer, "\\r");
+				break;
+
+			case '\b':
+				appendStringInfoString(rowBuffer, "\\b");
+				break;
+
+			case '\f':
+				appendStringInfoString(rowBuffer, "\\f");
+				break;
+
+			case '\v':
+				appendStringInfoString(rowBuffer, "\\v");
+				break;
+
+			default:
+				appendStringInfoChar(rowBuffer, character);
+				break;
 		}
 	}
 }
@@ -2402,23 +5086,7 @@ PgShardProcessUtility(Node *parsetree, const char *queryString,
 					  DestReceiver *dest, char *completionTag)
 {
 	NodeTag statementType = nodeTag(parsetree);
-	if (statementType == T_ExplainStmt)
-	{
-		/* extract the query from the explain statement */
-		Query *query = UtilityContainsQuery(parsetree);
-
-		if (query != NULL)
-		{
-			PlannerType plannerType = DeterminePlannerType(query);
-			if (plannerType == PLANNER_TYPE_PG_SHARD)
-			{
-				ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-								errmsg("EXPLAIN commands on distributed tables "
-									   "are unsupported")));
-			}
-		}
-	}
-	else if (statementType == T_PrepareStmt)
+	if (statementType == T_PrepareStmt)
 	{
 		PrepareStmt *prepareStatement = (PrepareStmt *) parsetree;
 		Query *parsedQuery = NULL;
@@ -2479,9 +5147,18 @@ PgShardProcessUtility(Node *parsetree, const char *queryString,
 			isDistributedTable = IsDistributedTable(tableId);
 			if (isDistributedTable)
 			{
+				if (copyStatement->is_from)
+				{
+					PgShardCopyFrom(copyStatement, completionTag);
+					return;
+				}
+
 				ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-								errmsg("COPY commands on distributed tables "
-									   "are unsupported")));
+								errmsg("COPY TO on distributed tables is "
+									   "unsupported"),
+								errhint("Use COPY (SELECT ...) TO to fetch "
+										"the data through the distributed "
+										"planner.")));
 			}
 		}
 		else if (rawQuery != NULL)
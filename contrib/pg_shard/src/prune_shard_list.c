@@ -28,6 +28,7 @@
 #include "access/skey.h"
 #endif
 #include "catalog/pg_am.h"
+#include "catalog/pg_collation.h"
 #include "catalog/pg_type.h"
 #include "commands/defrem.h"
 #include "nodes/makefuncs.h"
@@ -57,6 +58,24 @@
 static List *OperatorIdCache = NIL;
 
 
+/*
+ * SortedShardIntervalCache keeps, per distributed table, the shard intervals
+ * sorted by their minimum value, so that point lookups on range partitioned
+ * tables can binary search for the matching shard instead of testing every
+ * shard interval against the query predicate.
+ */
+typedef struct SortedShardIntervalCacheEntry
+{
+	Oid relationId;                  /* cache key */
+	int shardCount;
+	ShardInterval **sortedIntervals; /* sorted by minimum value */
+	FmgrInfo compareFunction;        /* btree comparison proc for the type */
+	bool overlapping;                /* intervals overlap: search unusable */
+} SortedShardIntervalCacheEntry;
+
+static HTAB *SortedShardIntervalCache = NULL;
+
+
 /* local function forward declarations */
 static Oid LookupOperatorByType(Oid typeId, Oid accessMethodId, int16 strategyNumber);
 static bool SimpleOpExpression(Expr *clause);
@@ -69,6 +88,20 @@ static OpExpr * MakeOpExpressionWithZeroConst(void);
 static List * BuildRestrictInfoList(List *qualList);
 static Node * BuildBaseConstraint(Var *column);
 static void UpdateConstraint(Node *baseConstraint, ShardInterval *shardInterval);
+static Const * PointLookupConstant(List *whereClauseList, Var *partitionColumn);
+static SortedShardIntervalCacheEntry * LookupSortedShardIntervals(Oid relationId,
+																  List *shardIntervalList);
+static List * SearchShardIntervals(SortedShardIntervalCacheEntry *cacheEntry,
+								   Datum partitionValue);
+static void RangeBoundsFromClauses(List *whereClauseList, Var *partitionColumn,
+								   FmgrInfo *compareFunction,
+								   Datum *lowerBound, bool *hasLowerBound,
+								   Datum *upperBound, bool *hasUpperBound);
+static List * SearchShardIntervalRange(SortedShardIntervalCacheEntry *cacheEntry,
+									   bool hasLowerBound, Datum lowerBound,
+									   bool hasUpperBound, Datum upperBound);
+static int CompareShardIntervalsByMinValue(const void *leftElement,
+										   const void *rightElement, void *context);
 
 static HTAB* shardPlacementCache;
 
@@ -138,6 +171,45 @@ PruneShardList(Oid relationId, List *whereClauseList, List *shardIntervalList)
 		case APPEND_PARTITION_TYPE:
 		case RANGE_PARTITION_TYPE:
 		{
+			/* binary search the sorted shard intervals for point lookups */
+			Const *pointConstant = PointLookupConstant(whereClauseList,
+													   partitionColumn);
+			SortedShardIntervalCacheEntry *cacheEntry =
+				LookupSortedShardIntervals(relationId, shardIntervalList);
+			if (pointConstant != NULL && cacheEntry != NULL &&
+				!cacheEntry->overlapping)
+			{
+				return SearchShardIntervals(cacheEntry,
+											pointConstant->constvalue);
+			}
+
+			/*
+			 * For range predicates on the partition column, binary search the
+			 * sorted intervals for the contiguous slice of shards intersecting
+			 * the requested range. Clauses the bound extraction does not
+			 * understand only widen the slice, which is safe for pruning, so
+			 * the per-shard predicate_refuted_by scan below remains as the
+			 * fallback for tables with overlapping intervals only.
+			 */
+			if (cacheEntry != NULL && !cacheEntry->overlapping)
+			{
+				Datum lowerBound = 0;
+				Datum upperBound = 0;
+				bool hasLowerBound = false;
+				bool hasUpperBound = false;
+
+				RangeBoundsFromClauses(whereClauseList, partitionColumn,
+									   &cacheEntry->compareFunction,
+									   &lowerBound, &hasLowerBound,
+									   &upperBound, &hasUpperBound);
+				if (hasLowerBound || hasUpperBound)
+				{
+					return SearchShardIntervalRange(cacheEntry,
+													hasLowerBound, lowerBound,
+													hasUpperBound, upperBound);
+				}
+			}
+
 			restrictInfoList = BuildRestrictInfoList(whereClauseList);
 			break;
 		}
@@ -247,6 +319,459 @@ PruneShardList(Oid relationId, List *whereClauseList, List *shardIntervalList)
 }
 
 
+/*
+ * PointLookupConstant returns the constant compared for equality against the
+ * partition column if the where clause list contains such a comparison, or
+ * NULL when the query is not a point lookup.
+ */
+static Const *
+PointLookupConstant(List *whereClauseList, Var *partitionColumn)
+{
+	ListCell *clauseCell = NULL;
+
+	foreach(clauseCell, whereClauseList)
+	{
+		Expr *clause = (Expr *) lfirst(clauseCell);
+		OpExpr *operatorExpression = NULL;
+		Oid equalityOperatorId = InvalidOid;
+		Node *rightOperand = NULL;
+
+		if (!IsA(clause, OpExpr) || !SimpleOpExpression(clause))
+		{
+			continue;
+		}
+
+		operatorExpression = (OpExpr *) clause;
+		if (!OpExpressionContainsColumn(operatorExpression, partitionColumn))
+		{
+			continue;
+		}
+
+		equalityOperatorId = LookupOperatorByType(partitionColumn->vartype,
+												  BTREE_AM_OID,
+												  BTEqualStrategyNumber);
+		if (operatorExpression->opno != equalityOperatorId)
+		{
+			continue;
+		}
+
+		rightOperand = get_rightop(clause);
+		if (IsA(rightOperand, Const))
+		{
+			return (Const *) rightOperand;
+		}
+		return (Const *) get_leftop(clause);
+	}
+
+	return NULL;
+}
+
+
+/*
+ * LookupSortedShardIntervals returns the sorted shard interval array for the
+ * given table, building and caching it on first use. The function returns
+ * NULL when the interval type has no btree comparison function. A change in
+ * the shard count invalidates the cached array, as do the explicit cache
+ * invalidations issued by the metadata modification functions.
+ */
+static SortedShardIntervalCacheEntry *
+LookupSortedShardIntervals(Oid relationId, List *shardIntervalList)
+{
+	SortedShardIntervalCacheEntry *cacheEntry = NULL;
+	bool entryFound = false;
+	int shardCount = list_length(shardIntervalList);
+	int shardIndex = 0;
+	ListCell *shardIntervalCell = NULL;
+	ShardInterval *firstInterval = NULL;
+	TypeCacheEntry *typeEntry = NULL;
+	MemoryContext oldContext = NULL;
+
+	if (SortedShardIntervalCache == NULL)
+	{
+		HASHCTL info;
+		int hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(Oid);
+		info.entrysize = sizeof(SortedShardIntervalCacheEntry);
+		info.hcxt = CacheMemoryContext;
+
+		SortedShardIntervalCache = hash_create("pg_shard sorted intervals",
+											   MAX_DISTRIBUTED_TABLES, &info,
+											   hashFlags);
+	}
+
+	cacheEntry = hash_search(SortedShardIntervalCache, &relationId, HASH_FIND,
+							 &entryFound);
+	if (entryFound && cacheEntry->shardCount == shardCount)
+	{
+		return cacheEntry;
+	}
+
+	firstInterval = (ShardInterval *) linitial(shardIntervalList);
+	typeEntry = lookup_type_cache(firstInterval->valueTypeId,
+								  TYPECACHE_CMP_PROC_FINFO);
+	if (!OidIsValid(typeEntry->cmp_proc_finfo.fn_oid))
+	{
+		return NULL;
+	}
+
+	cacheEntry = hash_search(SortedShardIntervalCache, &relationId, HASH_ENTER,
+							 &entryFound);
+	if (entryFound && cacheEntry->sortedIntervals != NULL)
+	{
+		pfree(cacheEntry->sortedIntervals);
+	}
+
+	oldContext = MemoryContextSwitchTo(CacheMemoryContext);
+
+	cacheEntry->sortedIntervals = palloc0(shardCount * sizeof(ShardInterval *));
+	foreach(shardIntervalCell, shardIntervalList)
+	{
+		cacheEntry->sortedIntervals[shardIndex++] =
+			(ShardInterval *) lfirst(shardIntervalCell);
+	}
+
+	fmgr_info_copy(&cacheEntry->compareFunction, &typeEntry->cmp_proc_finfo,
+				   CacheMemoryContext);
+
+	qsort_arg(cacheEntry->sortedIntervals, shardCount, sizeof(ShardInterval *),
+			  CompareShardIntervalsByMinValue, &cacheEntry->compareFunction);
+
+	/* binary search requires the sorted intervals not to overlap */
+	cacheEntry->overlapping = false;
+	for (shardIndex = 1; shardIndex < shardCount; shardIndex++)
+	{
+		ShardInterval *previousInterval = cacheEntry->sortedIntervals[shardIndex - 1];
+		ShardInterval *currentInterval = cacheEntry->sortedIntervals[shardIndex];
+
+		int comparisonResult = DatumGetInt32(
+			FunctionCall2Coll(&cacheEntry->compareFunction, DEFAULT_COLLATION_OID,
+							  currentInterval->minValue,
+							  previousInterval->maxValue));
+		if (comparisonResult <= 0)
+		{
+			cacheEntry->overlapping = true;
+			break;
+		}
+	}
+
+	cacheEntry->shardCount = shardCount;
+
+	MemoryContextSwitchTo(oldContext);
+
+	return cacheEntry;
+}
+
+
+/*
+ * SearchShardIntervals binary searches the sorted shard intervals for the
+ * single interval containing the given partition column value and returns it
+ * as a one element list, or an empty list when the value falls outside every
+ * shard interval.
+ */
+static List *
+SearchShardIntervals(SortedShardIntervalCacheEntry *cacheEntry,
+					 Datum partitionValue)
+{
+	List *matchingShardList = NIL;
+	FmgrInfo *compareFunction = &cacheEntry->compareFunction;
+	ShardInterval *candidateInterval = NULL;
+	int lowIndex = 0;
+	int highIndex = cacheEntry->shardCount - 1;
+	int comparisonResult = 0;
+
+	/* find the last interval whose minimum value does not exceed the value */
+	while (lowIndex < highIndex)
+	{
+		int middleIndex = (lowIndex + highIndex + 1) / 2;
+		ShardInterval *middleInterval = cacheEntry->sortedIntervals[middleIndex];
+
+		comparisonResult = DatumGetInt32(
+			FunctionCall2Coll(compareFunction, DEFAULT_COLLATION_OID,
+							  middleInterval->minValue, partitionValue));
+		if (comparisonResult <= 0)
+		{
+			lowIndex = middleIndex;
+		}
+		else
+		{
+			highIndex = middleIndex - 1;
+		}
+	}
+
+	candidateInterval = cacheEntry->sortedIntervals[lowIndex];
+
+	comparisonResult = DatumGetInt32(
+		FunctionCall2Coll(compareFunction, DEFAULT_COLLATION_OID,
+						  candidateInterval->minValue, partitionValue));
+	if (comparisonResult <= 0)
+	{
+		comparisonResult = DatumGetInt32(
+			FunctionCall2Coll(compareFunction, DEFAULT_COLLATION_OID,
+							  partitionValue, candidateInterval->maxValue));
+		if (comparisonResult <= 0)
+		{
+			matchingShardList = lappend(matchingShardList,
+										&(candidateInterval->id));
+		}
+	}
+
+	return matchingShardList;
+}
+
+
+/*
+ * RangeBoundsFromClauses extracts the tightest lower and upper bounds the
+ * where clause list places on the partition column. Only simple btree
+ * comparisons of the column against a constant of the column's own type are
+ * recognized; strict comparisons are treated as inclusive ones, which may
+ * keep one boundary shard too many but never prunes a needed shard. Clauses
+ * this function does not understand are simply ignored for the same reason.
+ */
+static void
+RangeBoundsFromClauses(List *whereClauseList, Var *partitionColumn,
+					   FmgrInfo *compareFunction,
+					   Datum *lowerBound, bool *hasLowerBound,
+					   Datum *upperBound, bool *hasUpperBound)
+{
+	ListCell *clauseCell = NULL;
+
+	*hasLowerBound = false;
+	*hasUpperBound = false;
+
+	foreach(clauseCell, whereClauseList)
+	{
+		Expr *clause = (Expr *) lfirst(clauseCell);
+		OpExpr *operatorExpression = NULL;
+		Const *constant = NULL;
+		Oid operatorId = InvalidOid;
+		int16 strategyNumber = InvalidStrategy;
+		int16 strategyIndex = 0;
+		bool boundsLower = false;
+		bool boundsUpper = false;
+
+		if (!IsA(clause, OpExpr) || !SimpleOpExpression(clause))
+		{
+			continue;
+		}
+
+		operatorExpression = (OpExpr *) clause;
+		if (!OpExpressionContainsColumn(operatorExpression, partitionColumn))
+		{
+			continue;
+		}
+
+		/*
+		 * Constant-on-the-left comparisons would need the commuted strategy;
+		 * the planner normally places the column on the left, so we just
+		 * skip the rare remaining cases.
+		 */
+		if (!IsA(get_leftop(clause), Var))
+		{
+			continue;
+		}
+		constant = (Const *) get_rightop(clause);
+
+		/* identify the btree strategy implemented by the clause's operator */
+		for (strategyIndex = BTLessStrategyNumber;
+			 strategyIndex <= BTGreaterStrategyNumber; strategyIndex++)
+		{
+			operatorId = LookupOperatorByType(partitionColumn->vartype,
+											  BTREE_AM_OID, strategyIndex);
+			if (operatorId == operatorExpression->opno)
+			{
+				strategyNumber = strategyIndex;
+				break;
+			}
+		}
+
+		switch (strategyNumber)
+		{
+			case BTLessStrategyNumber:
+			case BTLessEqualStrategyNumber:
+				boundsUpper = true;
+				break;
+
+			case BTGreaterStrategyNumber:
+			case BTGreaterEqualStrategyNumber:
+				boundsLower = true;
+				break;
+
+			case BTEqualStrategyNumber:
+				boundsLower = true;
+				boundsUpper = true;
+				break;
+
+			default:
+				continue; /* not a btree comparison on the column's type */
+		}
+
+		if (boundsLower)
+		{
+			if (!(*hasLowerBound) ||
+				DatumGetInt32(FunctionCall2Coll(compareFunction,
+												DEFAULT_COLLATION_OID,
+												constant->constvalue,
+												*lowerBound)) > 0)
+			{
+				*lowerBound = constant->constvalue;
+				*hasLowerBound = true;
+			}
+		}
+
+		if (boundsUpper)
+		{
+			if (!(*hasUpperBound) ||
+				DatumGetInt32(FunctionCall2Coll(compareFunction,
+												DEFAULT_COLLATION_OID,
+												constant->constvalue,
+												*upperBound)) < 0)
+			{
+				*upperBound = constant->constvalue;
+				*hasUpperBound = true;
+			}
+		}
+	}
+}
+
+
+/*
+ * SearchShardIntervalRange binary searches the sorted shard intervals for the
+ * contiguous slice of intervals intersecting the given range and returns the
+ * shard identifiers of the slice. Because the intervals are sorted by their
+ * minimum value and do not overlap, their maximum values are sorted as well,
+ * so both slice boundaries can be located by binary search.
+ */
+static List *
+SearchShardIntervalRange(SortedShardIntervalCacheEntry *cacheEntry,
+						 bool hasLowerBound, Datum lowerBound,
+						 bool hasUpperBound, Datum upperBound)
+{
+	List *matchingShardList = NIL;
+	FmgrInfo *compareFunction = &cacheEntry->compareFunction;
+	int firstIndex = 0;
+	int lastIndex = cacheEntry->shardCount - 1;
+	int shardIndex = 0;
+	int comparisonResult = 0;
+
+	/* find the first interval whose maximum value reaches the lower bound */
+	if (hasLowerBound)
+	{
+		int lowIndex = 0;
+		int highIndex = cacheEntry->shardCount;
+
+		while (lowIndex < highIndex)
+		{
+			int middleIndex = (lowIndex + highIndex) / 2;
+			ShardInterval *middleInterval = cacheEntry->sortedIntervals[middleIndex];
+
+			comparisonResult = DatumGetInt32(
+				FunctionCall2Coll(compareFunction, DEFAULT_COLLATION_OID,
+								  middleInterval->maxValue, lowerBound));
+			if (comparisonResult < 0)
+			{
+				lowIndex = middleIndex + 1;
+			}
+			else
+			{
+				highIndex = middleIndex;
+			}
+		}
+		firstIndex = lowIndex;
+	}
+
+	/* find the last interval whose minimum value does not exceed the upper bound */
+	if (hasUpperBound)
+	{
+		int lowIndex = 0;
+		int highIndex = cacheEntry->shardCount - 1;
+
+		while (lowIndex < highIndex)
+		{
+			int middleIndex = (lowIndex + highIndex + 1) / 2;
+			ShardInterval *middleInterval = cacheEntry->sortedIntervals[middleIndex];
+
+			comparisonResult = DatumGetInt32(
+				FunctionCall2Coll(compareFunction, DEFAULT_COLLATION_OID,
+								  middleInterval->minValue, upperBound));
+			if (comparisonResult <= 0)
+			{
+				lowIndex = middleIndex;
+			}
+			else
+			{
+				highIndex = middleIndex - 1;
+			}
+		}
+
+		comparisonResult = DatumGetInt32(
+			FunctionCall2Coll(compareFunction, DEFAULT_COLLATION_OID,
+							  cacheEntry->sortedIntervals[lowIndex]->minValue,
+							  upperBound));
+		lastIndex = (comparisonResult <= 0) ? lowIndex : -1;
+	}
+
+	for (shardIndex = firstIndex; shardIndex <= lastIndex; shardIndex++)
+	{
+		ShardInterval *shardInterval = cacheEntry->sortedIntervals[shardIndex];
+
+		matchingShardList = lappend(matchingShardList, &(shardInterval->id));
+	}
+
+	return matchingShardList;
+}
+
+
+/*
+ * CompareShardIntervalsByMinValue is the qsort_arg comparator ordering shard
+ * intervals by their minimum value; the comparison context is the btree
+ * comparison function of the interval type.
+ */
+static int
+CompareShardIntervalsByMinValue(const void *leftElement, const void *rightElement,
+								void *context)
+{
+	ShardInterval *leftInterval = *((ShardInterval **) leftElement);
+	ShardInterval *rightInterval = *((ShardInterval **) rightElement);
+	FmgrInfo *compareFunction = (FmgrInfo *) context;
+
+	Datum comparisonResult = FunctionCall2Coll(compareFunction,
+											   DEFAULT_COLLATION_OID,
+											   leftInterval->minValue,
+											   rightInterval->minValue);
+
+	return DatumGetInt32(comparisonResult);
+}
+
+
+/*
+ * InvalidateShardPruningCache drops this backend's pruning caches for the
+ * given table. The metadata modification functions call this so that later
+ * plans see the new shard layout.
+ */
+void
+InvalidateShardPruningCache(Oid relationId)
+{
+	if (SortedShardIntervalCache != NULL)
+	{
+		hash_search(SortedShardIntervalCache, &relationId, HASH_REMOVE, NULL);
+	}
+
+	if (shardPlacementCache != NULL)
+	{
+		bool entryFound = false;
+		ShardPlacementCacheEntry *placementEntry =
+			hash_search(shardPlacementCache, &relationId, HASH_FIND, &entryFound);
+		if (entryFound)
+		{
+			pfree(placementEntry->placements);
+			hash_search(shardPlacementCache, &relationId, HASH_REMOVE, NULL);
+		}
+	}
+}
+
+
 /*
  * BuildRestrictInfoList builds restrict info list using the selection criteria,
  * and then return this list. Note that this function assumes there is only one
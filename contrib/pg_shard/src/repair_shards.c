@@ -13,6 +13,8 @@
 #include "postgres.h"
 #include "c.h"
 #include "fmgr.h"
+#include "funcapi.h"
+#include "libpq-fe.h"
 #include "miscadmin.h"
 
 #include "connection.h"
@@ -29,7 +31,6 @@
 #include "access/tupdesc.h"
 #include "access/xact.h"
 #include "catalog/pg_class.h"
-#include "executor/tuptable.h"
 #include "lib/stringinfo.h"
 #include "nodes/pg_list.h"
 #include "storage/lock.h"
@@ -37,10 +38,15 @@
 #include "utils/elog.h"
 #include "utils/errcodes.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/palloc.h"
 #include "utils/rel.h"
 #include "utils/relcache.h"
-#include "utils/tuplestore.h"
+#include "utils/timestamp.h"
+
+
+/* bandwidth cap applied while copying shard data, in KB per second */
+int CopyThrottle = 0;
 
 
 /* local function forward declarations */
@@ -50,8 +56,9 @@ static List * RecreateTableDDLCommandList(Oid relationId, int64 shardId);
 static bool CopyDataFromFinalizedPlacement(Oid distributedTableId, int64 shardId,
 										   ShardPlacement *healthyPlacement,
 										   ShardPlacement *placementToRepair);
-static void CopyDataFromTupleStoreToRelation(Tuplestorestate *tupleStore,
-											 Relation relation);
+static void StreamDataFromPlacement(char *nodeName, int32 nodePort,
+									StringInfo query, Relation relation);
+static void ThrottleCopyRate(uint64 copiedByteCount, TimestampTz copyStartTime);
 
 
 /* declarations for dynamic loading */
@@ -152,8 +159,10 @@ master_copy_shard_placement(PG_FUNCTION_ARGS)
 
 /*
  * worker_copy_shard_placement implements a internal UDF to copy a table's data from
- * a healthy placement into a receiving table on an unhealthy placement. This
- * function returns a boolean reflecting success or failure.
+ * a healthy placement into a receiving table on an unhealthy placement. Rows are
+ * streamed from the healthy placement and inserted as they arrive rather than
+ * being materialized in full, so memory use stays constant and the transfer can
+ * be throttled via pg_shard.copy_throttle.
  */
 Datum
 worker_copy_shard_placement(PG_FUNCTION_ARGS)
@@ -163,40 +172,15 @@ worker_copy_shard_placement(PG_FUNCTION_ARGS)
 	int32 nodePort = PG_GETARG_INT32(2);
 	char *shardRelationName = text_to_cstring(shardRelationNameText);
 	char *nodeName = text_to_cstring(nodeNameText);
-	bool fetchSuccessful = false;
 
 	Oid shardRelationId = ResolveRelationId(shardRelationNameText);
 	Relation shardTable = heap_open(shardRelationId, RowExclusiveLock);
-	TupleDesc tupleDescriptor = RelationGetDescr(shardTable);
-	Tuplestorestate *tupleStore = tuplestore_begin_heap(false, false, work_mem);
-
-	StringInfo selectAllQuery = NULL;
-	ShardPlacement *placement = NULL;
-	Task *task = NULL;
 
-	selectAllQuery = makeStringInfo();
+	StringInfo selectAllQuery = makeStringInfo();
 	appendStringInfo(selectAllQuery, SELECT_ALL_QUERY,
 					 quote_identifier(shardRelationName));
 
-	placement = (ShardPlacement *) palloc0(sizeof(ShardPlacement));
-	placement->nodeName = nodeName;
-	placement->nodePort = nodePort;
-
-	task = (Task *) palloc0(sizeof(Task));
-	task->queryString = selectAllQuery;
-	task->taskPlacementList = list_make1(placement);
-
-	fetchSuccessful = ExecuteTaskAndStoreResults(task, tupleDescriptor, tupleStore);
-	if (!fetchSuccessful)
-	{
-		ereport(ERROR, (errmsg("could not store shard rows from healthy placement"),
-						errhint("Consult recent messages in the server logs for "
-								"details.")));
-	}
-
-	CopyDataFromTupleStoreToRelation(tupleStore, shardTable);
-
-	tuplestore_end(tupleStore);
+	StreamDataFromPlacement(nodeName, nodePort, selectAllQuery, shardTable);
 
 	heap_close(shardTable, RowExclusiveLock);
 
@@ -332,33 +316,153 @@ CopyDataFromFinalizedPlacement(Oid distributedTableId, int64 shardId,
 
 
 /*
- * CopyDataFromTupleStoreToRelation loads a specified relation with all tuples
- * stored in the provided tuplestore. This function assumes the relation's
- * layout (TupleDesc) exactly matches that of the provided tuplestore. This
- * function raises an error if the copy cannot be completed.
+ * StreamDataFromPlacement runs the provided query against a healthy placement
+ * and inserts every row it returns into the given relation. Results are fetched
+ * in single-row mode, so inserts overlap the transfer and memory use does not
+ * grow with the shard. When pg_shard.copy_throttle is set, the transfer rate is
+ * capped to that many kilobytes per second. This function assumes the
+ * relation's layout (TupleDesc) exactly matches that of the query results, and
+ * raises an error if the copy cannot be completed.
  */
 static void
-CopyDataFromTupleStoreToRelation(Tuplestorestate *tupleStore, Relation relation)
+StreamDataFromPlacement(char *nodeName, int32 nodePort, StringInfo query,
+						Relation relation)
 {
 	TupleDesc tupleDescriptor = RelationGetDescr(relation);
-	TupleTableSlot *tupleTableSlot = MakeSingleTupleTableSlot(tupleDescriptor);
+	AttInMetadata *attributeInMetadata = TupleDescGetAttInMetadata(tupleDescriptor);
+	int columnCount = tupleDescriptor->natts;
+	char **columnValueArray = (char **) palloc0(columnCount * sizeof(char *));
+	MemoryContext ioContext = AllocSetContextCreate(CurrentMemoryContext,
+													"StreamDataIoContext",
+													ALLOCSET_DEFAULT_MINSIZE,
+													ALLOCSET_DEFAULT_INITSIZE,
+													ALLOCSET_DEFAULT_MAXSIZE);
+	TimestampTz copyStartTime = GetCurrentTimestamp();
+	uint64 copiedByteCount = 0;
+	PGconn *connection = NULL;
+	int querySent = 0;
+	int singleRowMode = 0;
+	bool copyDone = false;
+
+	connection = GetConnection(nodeName, nodePort, true);
+	if (connection == NULL)
+	{
+		ereport(ERROR, (errmsg("could not connect to healthy placement \"%s:%d\"",
+							   nodeName, nodePort)));
+	}
 
-	for (;;)
+	querySent = PQsendQuery(connection, query->data);
+	if (querySent == 0)
+	{
+		ReportRemoteError(connection, NULL);
+		PurgeConnection(connection);
+
+		ereport(ERROR, (errmsg("could not send query to healthy placement")));
+	}
+
+	singleRowMode = PQsetSingleRowMode(connection);
+	if (singleRowMode == 0)
+	{
+		PurgeConnection(connection);
+
+		ereport(ERROR, (errmsg("could not enter single-row mode")));
+	}
+
+	while (!copyDone)
 	{
-		HeapTuple tupleToInsert = NULL;
-		bool nextTuple = tuplestore_gettupleslot(tupleStore, true, false, tupleTableSlot);
-		if (!nextTuple)
+		PGresult *result = PQgetResult(connection);
+		ExecStatusType resultStatus = PGRES_COMMAND_OK;
+		if (result == NULL)
 		{
+			copyDone = true;
 			break;
 		}
 
-		tupleToInsert = ExecMaterializeSlot(tupleTableSlot);
+		resultStatus = PQresultStatus(result);
+		if (resultStatus == PGRES_SINGLE_TUPLE)
+		{
+			MemoryContext oldContext = MemoryContextSwitchTo(ioContext);
+			HeapTuple tupleToInsert = NULL;
+			int columnIndex = 0;
+
+			for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+			{
+				if (PQgetisnull(result, 0, columnIndex))
+				{
+					columnValueArray[columnIndex] = NULL;
+				}
+				else
+				{
+					columnValueArray[columnIndex] = PQgetvalue(result, 0,
+															   columnIndex);
+					copiedByteCount += (uint64) PQgetlength(result, 0,
+															columnIndex);
+				}
+			}
+
+			tupleToInsert = BuildTupleFromCStrings(attributeInMetadata,
+												   columnValueArray);
+
+			simple_heap_insert(relation, tupleToInsert);
+			CommandCounterIncrement();
+
+			MemoryContextSwitchTo(oldContext);
+			MemoryContextReset(ioContext);
+
+			if (CopyThrottle > 0)
+			{
+				ThrottleCopyRate(copiedByteCount, copyStartTime);
+			}
+		}
+		else if (resultStatus != PGRES_TUPLES_OK)
+		{
+			ReportRemoteError(connection, result);
+			PQclear(result);
+			PurgeConnection(connection);
 
-		simple_heap_insert(relation, tupleToInsert);
-		CommandCounterIncrement();
+			ereport(ERROR, (errmsg("could not receive shard rows from healthy "
+								   "placement")));
+		}
 
-		ExecClearTuple(tupleTableSlot);
+		PQclear(result);
 	}
 
-	ExecDropSingleTupleTableSlot(tupleTableSlot);
+	MemoryContextDelete(ioContext);
+}
+
+
+/*
+ * ThrottleCopyRate pauses the calling copy until its average transfer rate
+ * falls back under pg_shard.copy_throttle. Sleeps are taken in short slices so
+ * that query cancellation stays responsive during a heavily throttled copy.
+ */
+static void
+ThrottleCopyRate(uint64 copiedByteCount, TimestampTz copyStartTime)
+{
+	uint64 expectedMicroseconds = (copiedByteCount * USECS_PER_SEC) /
+								  ((uint64) CopyThrottle * 1024);
+
+	for (;;)
+	{
+		TimestampTz currentTime = GetCurrentTimestamp();
+		long elapsedSeconds = 0;
+		int elapsedMicrosecondPart = 0;
+		uint64 elapsedMicroseconds = 0;
+		uint64 sleepMicroseconds = 0;
+
+		TimestampDifference(copyStartTime, currentTime, &elapsedSeconds,
+							&elapsedMicrosecondPart);
+		elapsedMicroseconds = ((uint64) elapsedSeconds * USECS_PER_SEC) +
+							  (uint64) elapsedMicrosecondPart;
+		if (elapsedMicroseconds >= expectedMicroseconds)
+		{
+			break;
+		}
+
+		sleepMicroseconds = Min(expectedMicroseconds - elapsedMicroseconds,
+								(uint64) THROTTLE_SLEEP_INTERVAL_USECS);
+		pg_usleep((long) sleepMicroseconds);
+
+		CHECK_FOR_INTERRUPTS();
+	}
 }
@@ -125,6 +125,9 @@ typedef struct
 	int			indentLevel;	/* current indent level for prettyprint */
 	bool		varprefix;		/* TRUE to print prefixes on Vars */
 	int64		shardid;		/* a distributed table's shardid, if positive */
+	List	   *relshards;		/* RelationShard list mapping relations to
+								 * shardids, for queries naming more than one
+								 * distributed table; NIL to use shardid */
 	ParseExprKind special_exprkind;		/* set only for exprkinds needing
 										 * special handling */
 } deparse_context;
@@ -333,7 +336,8 @@ static void get_query_def(Query *query, StringInfo buf, List *parentnamespace,
 			  TupleDesc resultDesc,
 			  int prettyFlags, int wrapColumn, int startIndent);
 static void get_shard_query_def(Query *query, StringInfo buf,
-					List *parentnamespace, int64 shardid, TupleDesc resultDesc,
+					List *parentnamespace, int64 shardid, List *relshards,
+					TupleDesc resultDesc,
 					int prettyFlags, int wrapColumn, int startIndent);
 static void get_values_def(List *values_lists, deparse_context *context);
 static void get_with_clause(Query *query, deparse_context *context);
@@ -406,6 +410,7 @@ static Node *processIndirection(Node *node, deparse_context *context,
 static void printSubscripts(ArrayRef *aref, deparse_context *context);
 static char *get_relation_name(Oid relid);
 static char *generate_shard_name(Oid relid, int64 shardid);
+static int64 deparse_context_shardid(deparse_context *context, Oid relid);
 static char *generate_function_name(Oid funcid, int nargs,
 					   List *argnames, Oid *argtypes,
 					   bool has_variadic, bool *use_variadic_p,
@@ -1726,7 +1731,24 @@ pop_ancestor_plan(deparse_namespace *dpns, deparse_namespace *save_dpns)
 void
 deparse_shard_query(Query *query, int64 shardid, StringInfo buffer)
 {
-	get_shard_query_def(query, buffer, NIL, shardid, NULL, 0, WRAP_COLUMN_DEFAULT, 0);
+	get_shard_query_def(query, buffer, NIL, shardid, NIL, NULL, 0,
+						WRAP_COLUMN_DEFAULT, 0);
+}
+
+
+/* ----------
+ * deparse_shard_query_map	- Parse back a query joining several shards
+ *
+ * Like deparse_shard_query, but for queries referencing more than one
+ * distributed table: each relation is renamed to the shard named for it in
+ * relationShardList, a list of RelationShard structs.
+ * ----------
+ */
+void
+deparse_shard_query_map(Query *query, List *relationShardList, StringInfo buffer)
+{
+	get_shard_query_def(query, buffer, NIL, 0, relationShardList, NULL, 0,
+						WRAP_COLUMN_DEFAULT, 0);
 }
 
 
@@ -1742,8 +1764,8 @@ get_query_def(Query *query, StringInfo buf, List *parentnamespace,
 			  TupleDesc resultDesc,
 			  int prettyFlags, int wrapColumn, int startIndent)
 {
-	get_shard_query_def(query, buf, parentnamespace, 0, resultDesc, prettyFlags,
-						wrapColumn, startIndent);
+	get_shard_query_def(query, buf, parentnamespace, 0, NIL, resultDesc,
+						prettyFlags, wrapColumn, startIndent);
 }
 
 
@@ -1751,12 +1773,14 @@ get_query_def(Query *query, StringInfo buf, List *parentnamespace,
  * get_shard_query_def		- Parse back one query parsetree for a given shard
  *
  * If shardid is positive, it is appended to the query's "main" relation name so
- * that the query may be executed on a placement for the given shard.
+ * that the query may be executed on a placement for the given shard. When the
+ * query references several distributed tables, relshards supplies a per-table
+ * shardid instead.
  * ----------
  */
 static void
 get_shard_query_def(Query *query, StringInfo buf, List *parentnamespace,
-					int64 shardid, TupleDesc resultDesc,
+					int64 shardid, List *relshards, TupleDesc resultDesc,
 					int prettyFlags, int wrapColumn, int startIndent)
 {
 	deparse_context context;
@@ -1787,6 +1811,7 @@ get_shard_query_def(Query *query, StringInfo buf, List *parentnamespace,
 	context.wrapColumn = wrapColumn;
 	context.indentLevel = startIndent;
 	context.shardid = shardid;
+	context.relshards = relshards;
 	context.special_exprkind = EXPR_KIND_NONE;
 
 	set_deparse_for_query(&dpns, query, parentnamespace);
@@ -2863,7 +2888,7 @@ get_insert_query_def(Query *query, deparse_context *context)
 		appendStringInfoChar(buf, ' ');
 	}
 	appendStringInfo(buf, "INSERT INTO %s ",
-					 generate_shard_name(rte->relid, context->shardid));
+					 generate_shard_name(rte->relid, deparse_context_shardid(context, rte->relid)));
 	/* INSERT requires AS keyword for target alias */
 	if (rte->alias != NULL)
 		appendStringInfo(buf, "AS %s ",
@@ -3036,7 +3061,7 @@ get_update_query_def(Query *query, deparse_context *context)
 	}
 	appendStringInfo(buf, "UPDATE %s%s",
 					 only_marker(rte),
-					 generate_shard_name(rte->relid, context->shardid));
+					 generate_shard_name(rte->relid, deparse_context_shardid(context, rte->relid)));
 	if (rte->alias != NULL)
 		appendStringInfo(buf, " %s",
 						 quote_identifier(rte->alias->aliasname));
@@ -3231,7 +3256,7 @@ get_delete_query_def(Query *query, deparse_context *context)
 	}
 	appendStringInfo(buf, "DELETE FROM %s%s",
 					 only_marker(rte),
-					 generate_shard_name(rte->relid, context->shardid));
+					 generate_shard_name(rte->relid, deparse_context_shardid(context, rte->relid)));
 	if (rte->alias != NULL)
 		appendStringInfo(buf, " %s",
 						 quote_identifier(rte->alias->aliasname));
@@ -6247,7 +6272,7 @@ get_from_clause_item(Node *jtnode, Query *query, deparse_context *context)
 				/* Normal relation RTE */
 				appendStringInfo(buf, "%s%s",
 								 only_marker(rte),
-								 generate_shard_name(rte->relid, context->shardid));
+								 generate_shard_name(rte->relid, deparse_context_shardid(context, rte->relid)));
 				break;
 			case RTE_SUBQUERY:
 				/* Subquery RTE */
@@ -6841,6 +6866,33 @@ generate_shard_name(Oid relid, int64 shardid)
 	return relname;
 }
 
+/*
+ * deparse_context_shardid
+ *		Determine which shardid to substitute for a given relation
+ *
+ * If the context carries a RelationShard list, the relation's entry in that
+ * list decides; relations without an entry keep their unsuffixed name.
+ * Otherwise the context's single shardid applies to every relation.
+ */
+static int64
+deparse_context_shardid(deparse_context *context, Oid relid)
+{
+	ListCell   *relshard_cell;
+
+	if (context->relshards == NIL)
+		return context->shardid;
+
+	foreach(relshard_cell, context->relshards)
+	{
+		RelationShard *relshard = (RelationShard *) lfirst(relshard_cell);
+
+		if (relshard->relationId == relid)
+			return relshard->shardId;
+	}
+
+	return 0;
+}
+
 /*
  * generate_function_name
  *		Compute the name to display for a function specified by OID,
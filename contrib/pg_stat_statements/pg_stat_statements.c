@@ -39,6 +39,14 @@
  * one must hold the lock shared.  To read or update the counters within
  * an entry, one must hold the lock shared or exclusive (so the entry doesn't
  * disappear!) and also take the entry's mutex spinlock.
+ *
+ * When pg_stat_statements.batch_size is more than one, statement completions
+ * are first accumulated in backend-local memory and only folded into the
+ * shared hashtable once that many statements have completed, so a busy
+ * backend takes each entry's spinlock once per batch rather than once per
+ * statement.  The price is that the view can lag the truth by up to
+ * batch_size statements per backend; a backend flushes its pending counts
+ * when its batch fills, when it reads the view itself, and at backend exit.
  * The shared state variable pgss->extent (the next free spot in the external
  * query-text file) should be accessed only while holding either the
  * pgss->mutex spinlock, or exclusive lock on pgss->lock.  We use the mutex to
@@ -93,7 +101,7 @@ PG_MODULE_MAGIC;
 #define PGSS_TEXT_FILE	PG_STAT_TMP_DIR "/pgss_query_texts.stat"
 
 /* Magic number identifying the stats file format */
-static const uint32 PGSS_FILE_HEADER = 0x20140125;
+static const uint32 PGSS_FILE_HEADER = 0x20160801;
 
 /* PostgreSQL major version number, changes in which invalidate all entries */
 static const uint32 PGSS_PG_MAJOR_VERSION = PG_VERSION_NUM / 100;
@@ -117,7 +125,8 @@ typedef enum pgssVersion
 	PGSS_V1_0 = 0,
 	PGSS_V1_1,
 	PGSS_V1_2,
-	PGSS_V1_3
+	PGSS_V1_3,
+	PGSS_V1_4
 } pgssVersion;
 
 /*
@@ -156,6 +165,8 @@ typedef struct Counters
 	double		blk_read_time;	/* time spent reading, in msec */
 	double		blk_write_time; /* time spent writing, in msec */
 	double		usage;			/* usage factor */
+	int64		plan_id;		/* hash of most recent plan tree, or 0 */
+	int64		plan_changes;	/* # of times plan_id has changed */
 } Counters;
 
 /*
@@ -175,6 +186,20 @@ typedef struct pgssEntry
 	slock_t		mutex;			/* protects the counters only */
 } pgssEntry;
 
+/*
+ * Backend-local statistics entry, used to accumulate counts between flushes
+ * to the shared hashtable when pg_stat_statements.batch_size > 1.  We must
+ * keep a copy of the query text, in case the shared entry has to be created
+ * at flush time.
+ */
+typedef struct pgssLocalEntry
+{
+	pgssHashKey key;			/* hash key of entry - MUST BE FIRST */
+	Counters	counters;		/* pending statistics for this query */
+	char	   *query;			/* copy of query text */
+	int			encoding;		/* query text encoding */
+} pgssLocalEntry;
+
 /*
  * Global shared state
  */
@@ -238,6 +263,12 @@ static ProcessUtility_hook_type prev_ProcessUtility = NULL;
 static pgssSharedState *pgss = NULL;
 static HTAB *pgss_hash = NULL;
 
+/* Backend-local accumulation state (used when batch_size > 1) */
+static HTAB *pgss_local_hash = NULL;
+static MemoryContext pgss_local_cxt = NULL;
+static int	pending_count = 0;	/* statements accumulated but not flushed */
+static bool exit_callback_registered = false;
+
 /*---- GUC variables ----*/
 
 typedef enum
@@ -258,7 +289,9 @@ static const struct config_enum_entry track_options[] =
 static int	pgss_max;			/* max # statements to track */
 static int	pgss_track;			/* tracking level */
 static bool pgss_track_utility; /* whether to track utility commands */
+static bool pgss_track_plans;	/* whether to track plan identifiers */
 static bool pgss_save;			/* whether to save stats across shutdown */
+static int	pgss_batch_size;	/* # statements to accumulate locally */
 
 
 #define pgss_enabled() \
@@ -281,6 +314,7 @@ void		_PG_fini(void);
 PG_FUNCTION_INFO_V1(pg_stat_statements_reset);
 PG_FUNCTION_INFO_V1(pg_stat_statements_1_2);
 PG_FUNCTION_INFO_V1(pg_stat_statements_1_3);
+PG_FUNCTION_INFO_V1(pg_stat_statements_1_4);
 PG_FUNCTION_INFO_V1(pg_stat_statements);
 
 static void pgss_shmem_startup(void);
@@ -298,10 +332,19 @@ static void pgss_ProcessUtility(Node *parsetree, const char *queryString,
 static uint32 pgss_hash_fn(const void *key, Size keysize);
 static int	pgss_match_fn(const void *key1, const void *key2, Size keysize);
 static uint32 pgss_hash_string(const char *str);
-static void pgss_store(const char *query, uint32 queryId,
+static uint32 pgss_hash_plan(PlannedStmt *pstmt);
+static void pgss_store(const char *query, uint32 queryId, uint32 planId,
 		   double total_time, uint64 rows,
 		   const BufferUsage *bufusage,
 		   pgssJumbleState *jstate);
+static void counters_merge(Counters *dst, const Counters *add);
+static void entry_update(pgssHashKey *key, const char *query, int query_len,
+			 int encoding, const Counters *delta);
+static void local_accum(pgssHashKey *key, const char *query, int encoding,
+			const Counters *delta);
+static void local_flush(void);
+static void local_flush_on_exit(int code, Datum arg);
+static void local_discard(void);
 static void pg_stat_statements_internal(FunctionCallInfo fcinfo,
 							pgssVersion api_version,
 							bool showtext);
@@ -323,6 +366,7 @@ static void JumbleQuery(pgssJumbleState *jstate, Query *query);
 static void JumbleRangeTable(pgssJumbleState *jstate, List *rtable);
 static void JumbleExpr(pgssJumbleState *jstate, Node *node);
 static void RecordConstLocation(pgssJumbleState *jstate, int location);
+static void JumblePlanTree(pgssJumbleState *jstate, Plan *plan);
 static char *generate_normalized_query(pgssJumbleState *jstate, const char *query,
 						  int *query_len_p, int encoding);
 static void fill_in_constant_lengths(pgssJumbleState *jstate, const char *query);
@@ -385,6 +429,30 @@ _PG_init(void)
 							 NULL,
 							 NULL);
 
+	DefineCustomBoolVariable("pg_stat_statements.track_plans",
+		"Selects whether plan identifiers are tracked by pg_stat_statements.",
+							 NULL,
+							 &pgss_track_plans,
+							 false,
+							 PGC_SUSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomIntVariable("pg_stat_statements.batch_size",
+							"Sets the number of statement completions accumulated locally before the shared counters are updated.",
+							NULL,
+							&pgss_batch_size,
+							1,
+							1,
+							100000,
+							PGC_SUSET,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
 	DefineCustomBoolVariable("pg_stat_statements.save",
 			   "Save pg_stat_statements statistics across server shutdowns.",
 							 NULL,
@@ -828,6 +896,7 @@ pgss_post_parse_analyze(ParseState *pstate, Query *query)
 				   query->queryId,
 				   0,
 				   0,
+				   0,
 				   NULL,
 				   &jstate);
 }
@@ -922,14 +991,21 @@ pgss_ExecutorEnd(QueryDesc *queryDesc)
 
 	if (queryId != 0 && queryDesc->totaltime && pgss_enabled())
 	{
+		uint32		planId = 0;
+
 		/*
 		 * Make sure stats accumulation is done.  (Note: it's okay if several
 		 * levels of hook all do this.)
 		 */
 		InstrEndLoop(queryDesc->totaltime);
 
+		/* Identify the plan, if plan tracking is enabled */
+		if (pgss_track_plans)
+			planId = pgss_hash_plan(queryDesc->plannedstmt);
+
 		pgss_store(queryDesc->sourceText,
 				   queryId,
+				   planId,
 				   queryDesc->totaltime->total * 1000.0,		/* convert to msec */
 				   queryDesc->estate->es_processed,
 				   &queryDesc->totaltime->bufusage,
@@ -1046,6 +1122,7 @@ pgss_ProcessUtility(Node *parsetree, const char *queryString,
 
 		pgss_store(queryString,
 				   queryId,
+				   0,
 				   INSTR_TIME_GET_MILLISEC(duration),
 				   rows,
 				   &bufusage,
@@ -1110,17 +1187,16 @@ pgss_hash_string(const char *str)
  *
  * If jstate is not NULL then we're trying to create an entry for which
  * we have no statistics as yet; we just want to record the normalized
- * query string.  total_time, rows, bufusage are ignored in this case.
+ * query string.  planId, total_time, rows, bufusage are ignored in this
+ * case.
  */
 static void
-pgss_store(const char *query, uint32 queryId,
+pgss_store(const char *query, uint32 queryId, uint32 planId,
 		   double total_time, uint64 rows,
 		   const BufferUsage *bufusage,
 		   pgssJumbleState *jstate)
 {
 	pgssHashKey key;
-	pgssEntry  *entry;
-	char	   *norm_query = NULL;
 	int			encoding = GetDatabaseEncoding();
 	int			query_len;
 
@@ -1137,10 +1213,217 @@ pgss_store(const char *query, uint32 queryId,
 	key.dbid = MyDatabaseId;
 	key.queryid = queryId;
 
+	if (jstate)
+	{
+		/*
+		 * We're just recording the normalized query text, so that it will be
+		 * available when execution statistics start arriving.
+		 */
+		pgssEntry  *entry;
+		char	   *norm_query = NULL;
+
+		/* Lookup the hash table entry with shared lock. */
+		LWLockAcquire(pgss->lock, LW_SHARED);
+
+		entry = (pgssEntry *) hash_search(pgss_hash, &key, HASH_FIND, NULL);
+
+		/* Create new sticky entry, if not present */
+		if (!entry)
+		{
+			Size		query_offset;
+			int			gc_count;
+			bool		stored;
+			bool		do_gc;
+
+			/*
+			 * Create a new, normalized query string.  We don't need to hold
+			 * the lock while doing this work.  (Note: in any case, it's
+			 * possible that someone else creates a duplicate hashtable entry
+			 * in the interval where we don't hold the lock below.  That case
+			 * is handled by entry_alloc.)
+			 */
+			LWLockRelease(pgss->lock);
+			norm_query = generate_normalized_query(jstate, query,
+												   &query_len,
+												   encoding);
+			LWLockAcquire(pgss->lock, LW_SHARED);
+
+			/* Append new query text to file with only shared lock held */
+			stored = qtext_store(norm_query, query_len,
+								 &query_offset, &gc_count);
+
+			/*
+			 * Determine whether we need to garbage collect external query
+			 * texts while the shared lock is still held.  This
+			 * micro-optimization avoids taking the time to decide this while
+			 * holding exclusive lock.
+			 */
+			do_gc = need_gc_qtexts();
+
+			/* Need exclusive lock to make a new hashtable entry - promote */
+			LWLockRelease(pgss->lock);
+			LWLockAcquire(pgss->lock, LW_EXCLUSIVE);
+
+			/*
+			 * A garbage collection may have occurred while we weren't
+			 * holding the lock.  In the unlikely event that this happens,
+			 * the query text we stored above will have been garbage
+			 * collected, so write it again.  This should be infrequent
+			 * enough that doing it while holding exclusive lock isn't a
+			 * performance problem.
+			 */
+			if (!stored || pgss->gc_count != gc_count)
+				stored = qtext_store(norm_query, query_len,
+									 &query_offset, NULL);
+
+			/* Create the entry only if we stored its text successfully */
+			if (stored)
+			{
+				entry = entry_alloc(&key, query_offset, query_len, encoding,
+									true);
+
+				/* If needed, garbage collect while exclusive lock held */
+				if (do_gc)
+					gc_qtexts();
+			}
+		}
+
+		LWLockRelease(pgss->lock);
+
+		/* We postpone this clean-up until we're out of the lock */
+		if (norm_query)
+			pfree(norm_query);
+	}
+	else
+	{
+		/*
+		 * Assemble this execution's counts into a Counters delta, then
+		 * either fold it into the shared entry directly, or accumulate it in
+		 * backend-local memory when batching is enabled.
+		 */
+		Counters	delta;
+
+		memset(&delta, 0, sizeof(Counters));
+		delta.calls = 1;
+		delta.total_time = total_time;
+		delta.min_time = total_time;
+		delta.max_time = total_time;
+		delta.mean_time = total_time;
+		delta.rows = rows;
+		delta.shared_blks_hit = bufusage->shared_blks_hit;
+		delta.shared_blks_read = bufusage->shared_blks_read;
+		delta.shared_blks_dirtied = bufusage->shared_blks_dirtied;
+		delta.shared_blks_written = bufusage->shared_blks_written;
+		delta.local_blks_hit = bufusage->local_blks_hit;
+		delta.local_blks_read = bufusage->local_blks_read;
+		delta.local_blks_dirtied = bufusage->local_blks_dirtied;
+		delta.local_blks_written = bufusage->local_blks_written;
+		delta.temp_blks_read = bufusage->temp_blks_read;
+		delta.temp_blks_written = bufusage->temp_blks_written;
+		delta.blk_read_time = INSTR_TIME_GET_MILLISEC(bufusage->blk_read_time);
+		delta.blk_write_time = INSTR_TIME_GET_MILLISEC(bufusage->blk_write_time);
+		delta.usage = USAGE_EXEC(total_time);
+		delta.plan_id = (int64) planId;
+
+		if (pgss_batch_size > 1)
+			local_accum(&key, query, encoding, &delta);
+		else
+		{
+			/* Batching just disabled?  Push out anything still pending. */
+			if (pending_count > 0)
+				local_flush();
+			entry_update(&key, query, query_len, encoding, &delta);
+		}
+	}
+}
+
+/*
+ * Merge a set of counter deltas into *dst.
+ *
+ * The mean and sum-of-variances members are combined with the parallel
+ * variant of Welford's method (see the comment in entry_update), so that
+ * folding a batch of executions in at once yields the same mean_time and
+ * stddev_time as updating once per execution would have.
+ *
+ * For the shared hashtable this must be called with the entry's spinlock
+ * held; it is also used to accumulate into backend-local entries, which
+ * need no locking.
+ */
+static void
+counters_merge(Counters *dst, const Counters *add)
+{
+	if (dst->calls == 0)
+	{
+		dst->min_time = add->min_time;
+		dst->max_time = add->max_time;
+		dst->mean_time = add->mean_time;
+		dst->sum_var_time = add->sum_var_time;
+	}
+	else
+	{
+		double		d = add->mean_time - dst->mean_time;
+		int64		n = dst->calls + add->calls;
+
+		dst->sum_var_time += add->sum_var_time +
+			d * d * ((double) dst->calls * add->calls / n);
+		dst->mean_time += d * add->calls / n;
+		if (dst->min_time > add->min_time)
+			dst->min_time = add->min_time;
+		if (dst->max_time < add->max_time)
+			dst->max_time = add->max_time;
+	}
+	dst->calls += add->calls;
+	dst->total_time += add->total_time;
+	dst->rows += add->rows;
+	dst->shared_blks_hit += add->shared_blks_hit;
+	dst->shared_blks_read += add->shared_blks_read;
+	dst->shared_blks_dirtied += add->shared_blks_dirtied;
+	dst->shared_blks_written += add->shared_blks_written;
+	dst->local_blks_hit += add->local_blks_hit;
+	dst->local_blks_read += add->local_blks_read;
+	dst->local_blks_dirtied += add->local_blks_dirtied;
+	dst->local_blks_written += add->local_blks_written;
+	dst->temp_blks_read += add->temp_blks_read;
+	dst->temp_blks_written += add->temp_blks_written;
+	dst->blk_read_time += add->blk_read_time;
+	dst->blk_write_time += add->blk_write_time;
+	dst->usage += add->usage;
+
+	/*
+	 * Plan tracking: add->plan_id is the most recent plan seen by the
+	 * source, add->plan_changes the number of flips it observed itself.
+	 * Count one more flip if the plan differs across the merge boundary.
+	 * (When batching, a plan that flips away and back within one batch is
+	 * counted from the batch's own observations only.)
+	 */
+	if (add->plan_id != 0)
+	{
+		if (dst->plan_id != 0 && dst->plan_id != add->plan_id)
+			dst->plan_changes += add->plan_changes + 1;
+		else
+			dst->plan_changes += add->plan_changes;
+		dst->plan_id = add->plan_id;
+	}
+}
+
+/*
+ * Fold a counter delta into the shared hashtable entry for "key",
+ * creating the entry if it doesn't exist yet.
+ *
+ * This is the tail end of the old pgss_store: find the entry with shared
+ * lock, escalate to exclusive only if it has to be created, then update
+ * the counters under the entry's spinlock.
+ */
+static void
+entry_update(pgssHashKey *key, const char *query, int query_len,
+			 int encoding, const Counters *delta)
+{
+	pgssEntry  *entry;
+
 	/* Lookup the hash table entry with shared lock. */
 	LWLockAcquire(pgss->lock, LW_SHARED);
 
-	entry = (pgssEntry *) hash_search(pgss_hash, &key, HASH_FIND, NULL);
+	entry = (pgssEntry *) hash_search(pgss_hash, key, HASH_FIND, NULL);
 
 	/* Create new entry, if not present */
 	if (!entry)
@@ -1150,25 +1433,8 @@ pgss_store(const char *query, uint32 queryId,
 		bool		stored;
 		bool		do_gc;
 
-		/*
-		 * Create a new, normalized query string if caller asked.  We don't
-		 * need to hold the lock while doing this work.  (Note: in any case,
-		 * it's possible that someone else creates a duplicate hashtable entry
-		 * in the interval where we don't hold the lock below.  That case is
-		 * handled by entry_alloc.)
-		 */
-		if (jstate)
-		{
-			LWLockRelease(pgss->lock);
-			norm_query = generate_normalized_query(jstate, query,
-												   &query_len,
-												   encoding);
-			LWLockAcquire(pgss->lock, LW_SHARED);
-		}
-
 		/* Append new query text to file with only shared lock held */
-		stored = qtext_store(norm_query ? norm_query : query, query_len,
-							 &query_offset, &gc_count);
+		stored = qtext_store(query, query_len, &query_offset, &gc_count);
 
 		/*
 		 * Determine whether we need to garbage collect external query texts
@@ -1189,29 +1455,28 @@ pgss_store(const char *query, uint32 queryId,
 		 * exclusive lock isn't a performance problem.
 		 */
 		if (!stored || pgss->gc_count != gc_count)
-			stored = qtext_store(norm_query ? norm_query : query, query_len,
-								 &query_offset, NULL);
+			stored = qtext_store(query, query_len, &query_offset, NULL);
 
 		/* If we failed to write to the text file, give up */
 		if (!stored)
-			goto done;
+		{
+			LWLockRelease(pgss->lock);
+			return;
+		}
 
 		/* OK to create a new hashtable entry */
-		entry = entry_alloc(&key, query_offset, query_len, encoding,
-							jstate != NULL);
+		entry = entry_alloc(key, query_offset, query_len, encoding, false);
 
 		/* If needed, perform garbage collection while exclusive lock held */
 		if (do_gc)
 			gc_qtexts();
 	}
 
-	/* Increment the counts, except when jstate is not NULL */
-	if (!jstate)
+	/*
+	 * Grab the spinlock while updating the counters (see comment about
+	 * locking rules at the head of the file)
+	 */
 	{
-		/*
-		 * Grab the spinlock while updating the counters (see comment about
-		 * locking rules at the head of the file)
-		 */
 		volatile pgssEntry *e = (volatile pgssEntry *) entry;
 
 		SpinLockAcquire(&e->mutex);
@@ -1220,57 +1485,113 @@ pgss_store(const char *query, uint32 queryId,
 		if (e->counters.calls == 0)
 			e->counters.usage = USAGE_INIT;
 
-		e->counters.calls += 1;
-		e->counters.total_time += total_time;
-		if (e->counters.calls == 1)
-		{
-			e->counters.min_time = total_time;
-			e->counters.max_time = total_time;
-			e->counters.mean_time = total_time;
-		}
-		else
-		{
-			/*
-			 * Welford's method for accurately computing variance. See
-			 * <http://www.johndcook.com/blog/standard_deviation/>
-			 */
-			double		old_mean = e->counters.mean_time;
-
-			e->counters.mean_time +=
-				(total_time - old_mean) / e->counters.calls;
-			e->counters.sum_var_time +=
-				(total_time - old_mean) * (total_time - e->counters.mean_time);
-
-			/* calculate min and max time */
-			if (e->counters.min_time > total_time)
-				e->counters.min_time = total_time;
-			if (e->counters.max_time < total_time)
-				e->counters.max_time = total_time;
-		}
-		e->counters.rows += rows;
-		e->counters.shared_blks_hit += bufusage->shared_blks_hit;
-		e->counters.shared_blks_read += bufusage->shared_blks_read;
-		e->counters.shared_blks_dirtied += bufusage->shared_blks_dirtied;
-		e->counters.shared_blks_written += bufusage->shared_blks_written;
-		e->counters.local_blks_hit += bufusage->local_blks_hit;
-		e->counters.local_blks_read += bufusage->local_blks_read;
-		e->counters.local_blks_dirtied += bufusage->local_blks_dirtied;
-		e->counters.local_blks_written += bufusage->local_blks_written;
-		e->counters.temp_blks_read += bufusage->temp_blks_read;
-		e->counters.temp_blks_written += bufusage->temp_blks_written;
-		e->counters.blk_read_time += INSTR_TIME_GET_MILLISEC(bufusage->blk_read_time);
-		e->counters.blk_write_time += INSTR_TIME_GET_MILLISEC(bufusage->blk_write_time);
-		e->counters.usage += USAGE_EXEC(total_time);
+		counters_merge((Counters *) &e->counters, delta);
 
 		SpinLockRelease(&e->mutex);
 	}
 
-done:
 	LWLockRelease(pgss->lock);
+}
+
+/*
+ * Accumulate a counter delta in backend-local memory, flushing all pending
+ * entries to shared memory once batch_size statements have been collected.
+ */
+static void
+local_accum(pgssHashKey *key, const char *query, int encoding,
+			const Counters *delta)
+{
+	pgssLocalEntry *entry;
+	bool		found;
+
+	if (pgss_local_hash == NULL)
+	{
+		HASHCTL		info;
+
+		if (pgss_local_cxt == NULL)
+			pgss_local_cxt = AllocSetContextCreate(TopMemoryContext,
+										"pg_stat_statements local counters",
+												   ALLOCSET_DEFAULT_MINSIZE,
+												   ALLOCSET_DEFAULT_INITSIZE,
+												   ALLOCSET_DEFAULT_MAXSIZE);
+
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(pgssHashKey);
+		info.entrysize = sizeof(pgssLocalEntry);
+		info.hash = pgss_hash_fn;
+		info.match = pgss_match_fn;
+		info.hcxt = pgss_local_cxt;
+		pgss_local_hash = hash_create("pg_stat_statements local hash",
+									  pgss_batch_size,
+									  &info,
+						HASH_ELEM | HASH_FUNCTION | HASH_COMPARE | HASH_CONTEXT);
+
+		/* Make sure pending counts reach shared memory at backend exit */
+		if (!exit_callback_registered)
+		{
+			before_shmem_exit(local_flush_on_exit, (Datum) 0);
+			exit_callback_registered = true;
+		}
+	}
+
+	entry = (pgssLocalEntry *) hash_search(pgss_local_hash, key,
+										   HASH_ENTER, &found);
+	if (!found)
+	{
+		memset(&entry->counters, 0, sizeof(Counters));
+		entry->query = MemoryContextStrdup(pgss_local_cxt, query);
+		entry->encoding = encoding;
+	}
+
+	counters_merge(&entry->counters, delta);
 
-	/* We postpone this clean-up until we're out of the lock */
-	if (norm_query)
-		pfree(norm_query);
+	if (++pending_count >= pgss_batch_size)
+		local_flush();
+}
+
+/*
+ * Flush all pending backend-local counts into the shared hashtable.
+ */
+static void
+local_flush(void)
+{
+	HASH_SEQ_STATUS hash_seq;
+	pgssLocalEntry *entry;
+
+	if (pgss_local_hash == NULL)
+		return;
+
+	hash_seq_init(&hash_seq, pgss_local_hash);
+	while ((entry = hash_seq_search(&hash_seq)) != NULL)
+		entry_update(&entry->key, entry->query, strlen(entry->query),
+					 entry->encoding, &entry->counters);
+
+	local_discard();
+}
+
+/*
+ * before_shmem_exit callback to push out whatever this backend still has
+ * pending, so that short-lived sessions aren't underrepresented.
+ */
+static void
+local_flush_on_exit(int code, Datum arg)
+{
+	if (pgss && pgss_hash)
+		local_flush();
+}
+
+/*
+ * Throw away all pending backend-local counts, including the query text
+ * copies.  (Resetting the context destroys the local hash table too, since
+ * its storage lives in a child context.)
+ */
+static void
+local_discard(void)
+{
+	if (pgss_local_cxt)
+		MemoryContextReset(pgss_local_cxt);
+	pgss_local_hash = NULL;
+	pending_count = 0;
 }
 
 /*
@@ -1283,6 +1604,8 @@ pg_stat_statements_reset(PG_FUNCTION_ARGS)
 		ereport(ERROR,
 				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
 				 errmsg("pg_stat_statements must be loaded via shared_preload_libraries")));
+	/* Also discard our own pending counts, else they'd resurface later */
+	local_discard();
 	entry_reset();
 	PG_RETURN_VOID();
 }
@@ -1292,7 +1615,8 @@ pg_stat_statements_reset(PG_FUNCTION_ARGS)
 #define PG_STAT_STATEMENTS_COLS_V1_1	18
 #define PG_STAT_STATEMENTS_COLS_V1_2	19
 #define PG_STAT_STATEMENTS_COLS_V1_3	23
-#define PG_STAT_STATEMENTS_COLS			23		/* maximum of above */
+#define PG_STAT_STATEMENTS_COLS_V1_4	25
+#define PG_STAT_STATEMENTS_COLS			25		/* maximum of above */
 
 /*
  * Retrieve statement statistics.
@@ -1304,6 +1628,16 @@ pg_stat_statements_reset(PG_FUNCTION_ARGS)
  * expected API version is identified by embedding it in the C name of the
  * function.  Unfortunately we weren't bright enough to do that for 1.1.
  */
+Datum
+pg_stat_statements_1_4(PG_FUNCTION_ARGS)
+{
+	bool		showtext = PG_GETARG_BOOL(0);
+
+	pg_stat_statements_internal(fcinfo, PGSS_V1_4, showtext);
+
+	return (Datum) 0;
+}
+
 Datum
 pg_stat_statements_1_3(PG_FUNCTION_ARGS)
 {
@@ -1363,6 +1697,13 @@ pg_stat_statements_internal(FunctionCallInfo fcinfo,
 				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
 				 errmsg("pg_stat_statements must be loaded via shared_preload_libraries")));
 
+	/*
+	 * Push out our own pending counts first, so at least this backend's
+	 * activity is fully represented.  (Other backends' batches may still be
+	 * in flight; that staleness is the documented price of batching.)
+	 */
+	local_flush();
+
 	/* check to see if caller supports us returning a tuplestore */
 	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
 		ereport(ERROR,
@@ -1407,6 +1748,10 @@ pg_stat_statements_internal(FunctionCallInfo fcinfo,
 			if (api_version != PGSS_V1_3)
 				elog(ERROR, "incorrect number of output arguments");
 			break;
+		case PG_STAT_STATEMENTS_COLS_V1_4:
+			if (api_version != PGSS_V1_4)
+				elog(ERROR, "incorrect number of output arguments");
+			break;
 		default:
 			elog(ERROR, "incorrect number of output arguments");
 	}
@@ -1603,11 +1948,26 @@ pg_stat_statements_internal(FunctionCallInfo fcinfo,
 			values[i++] = Float8GetDatumFast(tmp.blk_read_time);
 			values[i++] = Float8GetDatumFast(tmp.blk_write_time);
 		}
+		if (api_version >= PGSS_V1_4)
+		{
+			/* Hide plan identifiers along with the query text */
+			if (is_superuser || entry->key.userid == userid)
+			{
+				values[i++] = Int64GetDatumFast(tmp.plan_id);
+				values[i++] = Int64GetDatumFast(tmp.plan_changes);
+			}
+			else
+			{
+				nulls[i++] = true;
+				nulls[i++] = true;
+			}
+		}
 
 		Assert(i == (api_version == PGSS_V1_0 ? PG_STAT_STATEMENTS_COLS_V1_0 :
 					 api_version == PGSS_V1_1 ? PG_STAT_STATEMENTS_COLS_V1_1 :
 					 api_version == PGSS_V1_2 ? PG_STAT_STATEMENTS_COLS_V1_2 :
 					 api_version == PGSS_V1_3 ? PG_STAT_STATEMENTS_COLS_V1_3 :
+					 api_version == PGSS_V1_4 ? PG_STAT_STATEMENTS_COLS_V1_4 :
 					 -1 /* fail if you forget to update this assert */ ));
 
 		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
@@ -2868,6 +3228,131 @@ RecordConstLocation(pgssJumbleState *jstate, int location)
 	}
 }
 
+/*
+ * JumblePlanTree: Serialize the shape of a plan tree, so that two executions
+ * of the same query hash alike exactly when the planner made the same
+ * choices for them.
+ *
+ * We include the node tags, the recursion structure, and the few fields that
+ * say which object a node operates on or which strategy it uses.  Costs and
+ * row estimates are deliberately ignored: a mere refresh of statistics
+ * should not be reported as a new plan.
+ */
+static void
+JumblePlanTree(pgssJumbleState *jstate, Plan *plan)
+{
+	ListCell   *lc;
+
+	if (plan == NULL)
+		return;
+
+	APP_JUMB(plan->type);
+
+	switch (nodeTag(plan))
+	{
+		case T_IndexScan:
+			APP_JUMB(((IndexScan *) plan)->indexid);
+			break;
+		case T_IndexOnlyScan:
+			APP_JUMB(((IndexOnlyScan *) plan)->indexid);
+			break;
+		case T_BitmapIndexScan:
+			APP_JUMB(((BitmapIndexScan *) plan)->indexid);
+			break;
+		case T_NestLoop:
+		case T_MergeJoin:
+		case T_HashJoin:
+			APP_JUMB(((Join *) plan)->jointype);
+			break;
+		case T_Agg:
+			APP_JUMB(((Agg *) plan)->aggstrategy);
+			break;
+		case T_SubqueryScan:
+			JumblePlanTree(jstate, ((SubqueryScan *) plan)->subplan);
+			break;
+		case T_Append:
+			foreach(lc, ((Append *) plan)->appendplans)
+				JumblePlanTree(jstate, (Plan *) lfirst(lc));
+			break;
+		case T_MergeAppend:
+			foreach(lc, ((MergeAppend *) plan)->mergeplans)
+				JumblePlanTree(jstate, (Plan *) lfirst(lc));
+			break;
+		case T_ModifyTable:
+			foreach(lc, ((ModifyTable *) plan)->plans)
+				JumblePlanTree(jstate, (Plan *) lfirst(lc));
+			break;
+		case T_BitmapAnd:
+			foreach(lc, ((BitmapAnd *) plan)->bitmapplans)
+				JumblePlanTree(jstate, (Plan *) lfirst(lc));
+			break;
+		case T_BitmapOr:
+			foreach(lc, ((BitmapOr *) plan)->bitmapplans)
+				JumblePlanTree(jstate, (Plan *) lfirst(lc));
+			break;
+		default:
+			break;
+	}
+
+	/* All scan descendants identify the range table entry they read */
+	switch (nodeTag(plan))
+	{
+		case T_SeqScan:
+		case T_SampleScan:
+		case T_IndexScan:
+		case T_IndexOnlyScan:
+		case T_BitmapHeapScan:
+		case T_TidScan:
+		case T_SubqueryScan:
+		case T_FunctionScan:
+		case T_ValuesScan:
+		case T_CteScan:
+		case T_WorkTableScan:
+		case T_ForeignScan:
+		case T_CustomScan:
+			APP_JUMB(((Scan *) plan)->scanrelid);
+			break;
+		default:
+			break;
+	}
+
+	JumblePlanTree(jstate, plan->lefttree);
+	JumblePlanTree(jstate, plan->righttree);
+}
+
+/*
+ * Compute a hash identifying the shape of a finished plan, for plan-flip
+ * tracking.  Zero is reserved to mean "no plan identified".
+ */
+static uint32
+pgss_hash_plan(PlannedStmt *pstmt)
+{
+	pgssJumbleState jstate;
+	ListCell   *lc;
+	uint32		planId;
+
+	/* Set up workspace; constant locations are not of interest here */
+	jstate.jumble = (unsigned char *) palloc(JUMBLE_SIZE);
+	jstate.jumble_len = 0;
+	jstate.clocations = NULL;
+	jstate.clocations_buf_size = 0;
+	jstate.clocations_count = 0;
+
+	JumblePlanTree(&jstate, pstmt->planTree);
+	foreach(lc, pstmt->subplans)
+		JumblePlanTree(&jstate, (Plan *) lfirst(lc));
+
+	planId = hash_any(jstate.jumble, jstate.jumble_len);
+
+	pfree(jstate.jumble);
+
+	/* As with queryId, avoid the reserved value */
+	if (planId == 0)
+		planId = 1;
+
+	return planId;
+}
+
 /*
  * Generate a normalized version of the query string that will be used to
  * represent all similar queries.
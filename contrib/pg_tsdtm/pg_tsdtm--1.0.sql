@@ -24,3 +24,17 @@ LANGUAGE C;
 CREATE FUNCTION dtm_get_csn(xid integer) RETURNS bigint
 AS 'MODULE_PATHNAME','dtm_get_csn'
 LANGUAGE C;
+
+CREATE FUNCTION dtm_get_skew(
+    OUT node_id integer,
+    OUT skew_usec bigint,
+    OUT max_skew_usec bigint,
+    OUT samples bigint,
+    OUT last_seen_usec bigint
+) RETURNS SETOF record
+AS 'MODULE_PATHNAME','dtm_get_skew'
+LANGUAGE C;
+
+-- Estimated clock skew per peer node, derived from the CSNs received from it
+CREATE VIEW dtm_skew AS
+    SELECT * FROM dtm_get_skew();
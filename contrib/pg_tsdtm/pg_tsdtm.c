@@ -11,6 +11,7 @@
 
 #include "postgres.h"
 #include "fmgr.h"
+#include "funcapi.h"
 #include "miscadmin.h"
 #include "storage/s_lock.h"
 #include "storage/spin.h"
@@ -45,6 +46,28 @@
 
 typedef uint64 timestamp_t;
 
+#define DTM_MAX_PEERS 64		/* max nodes we track clock skew for */
+#define DTM_SKEW_AVG_WINDOW 16	/* EWMA weight of a single skew sample is
+								 * 1/DTM_SKEW_AVG_WINDOW */
+
+/*
+ * Clock skew estimate for one peer node. Every CSN received from a peer is a
+ * reading of its clock taken at most a network round trip ago, so the
+ * difference between it and our clock at the moment of receipt is a lower
+ * bound on how far the peer's clock runs ahead of ours. On a well synchronized
+ * cluster the estimate is negative (dominated by the network delay); it only
+ * becomes positive when the peer's clock is ahead by more than that delay,
+ * which is exactly the case when waiting out clock uncertainty matters.
+ */
+typedef struct DtmPeerSkew
+{
+	nodeid_t	node_id;
+	int64		skew;			/* EWMA of (peer CSN - local time), usec */
+	int64		max_skew;		/* maximum observed difference, usec */
+	uint64		nSamples;		/* number of observations */
+	timestamp_t last_seen;		/* local time of the last observation */
+}	DtmPeerSkew;
+
 /* Distributed transaction state kept in shared memory */
 typedef struct DtmTransStatus
 {
@@ -70,6 +93,8 @@ typedef struct
 										 * This list is used to perform
 										 * cleanup of too old transactions */
 	DtmTransStatus **trans_list_tail;
+	int			nPeers;			/* number of used entries in peers[] */
+	DtmPeerSkew peers[DTM_MAX_PEERS];	/* per-peer clock skew estimates */
 }	DtmNodeState;
 
 /* Structure used to map global transaction identifier to XID */
@@ -85,6 +110,26 @@ typedef struct
 #define DTM_TRACE(x)
 /* #define DTM_TRACE(x) fprintf x */
 
+#define DTM_CSN_CACHE_SIZE 1024 /* per-backend entries, must be power of two */
+
+/*
+ * Per-backend cache of resolved xid->CSN mappings. The status and CSN of a
+ * finished transaction never change, so once they are fetched from the shared
+ * xid2status hash there is no need to take the shared lock again for the same
+ * xid - the common case when scanning a freshly updated table. Entries are
+ * tagged with the snapshot they were cached under and so are implicitly
+ * invalidated when the backend switches to another snapshot.
+ */
+typedef struct
+{
+	TransactionId xid;
+	XidStatus	status;
+	cid_t		cid;
+	cid_t		snapshot;		/* dtm_tx.snapshot this entry was cached under */
+}	DtmCsnCacheEntry;
+
+static DtmCsnCacheEntry csn_cache[DTM_CSN_CACHE_SIZE];
+
 static shmem_startup_hook_type prev_shmem_startup_hook;
 static HTAB *xid2status;
 static HTAB *gtid2xid;
@@ -93,6 +138,7 @@ static DtmCurrentTrans dtm_tx;
 static uint64 totalSleepInterrupts;
 static int	DtmVacuumDelay;
 static bool DtmRecordCommits;
+static int	DtmMinWaitTimeout;
 
 static Snapshot DtmGetSnapshot(Snapshot snapshot);
 static TransactionId DtmGetOldestXmin(Relation rel, bool ignoreVacuum);
@@ -113,7 +159,8 @@ static TransactionManager DtmTM = {
 	PgGetGlobalTransactionId,
 	DtmXidInMVCCSnapshot,
 	DtmDetectGlobalDeadLock,
-	DtmGetName
+	DtmGetName,
+	PgTransactionIdGetStatusBulk
 };
 
 void		_PG_init(void);
@@ -127,6 +174,9 @@ static timestamp_t dtm_get_current_time();
 static void dtm_sleep(timestamp_t interval);
 static cid_t dtm_get_cid();
 static cid_t dtm_sync(cid_t cid);
+static nodeid_t dtm_gtid_node(GlobalTransactionId gtid);
+static void dtm_observe_skew(nodeid_t node, cid_t remote_ts);
+static timestamp_t dtm_get_uncertainty(void);
 
 /*
  *	Time manipulation functions
@@ -194,6 +244,109 @@ dtm_sync(cid_t global_cid)
 	return local_cid;
 }
 
+/*
+ * Extract the node identifier from a global transaction identifier.
+ * By convention gtids are generated by the coordinator as "NODE.BACKEND.SEQ",
+ * so the leading number identifies the node the timestamp came from.
+ * Returns -1 if the gtid does not follow this convention.
+ */
+static nodeid_t
+dtm_gtid_node(GlobalTransactionId gtid)
+{
+	nodeid_t	node = 0;
+
+	if (gtid == NULL || *gtid < '0' || *gtid > '9')
+	{
+		return -1;
+	}
+	while (*gtid >= '0' && *gtid <= '9')
+	{
+		node = node * 10 + (*gtid++ - '0');
+	}
+	return node;
+}
+
+/*
+ * Record one observation of a peer's clock: 'remote_ts' is a CSN just
+ * received from node 'node'. This function is called inside critical section.
+ */
+static void
+dtm_observe_skew(nodeid_t node, cid_t remote_ts)
+{
+	timestamp_t now = dtm_get_current_time();
+	int64		delta = (int64) remote_ts - (int64) now;
+	DtmPeerSkew *peer = NULL;
+	int			i;
+
+	if (node < 0)
+	{
+		return;
+	}
+	for (i = 0; i < local->nPeers; i++)
+	{
+		if (local->peers[i].node_id == node)
+		{
+			peer = &local->peers[i];
+			break;
+		}
+	}
+	if (peer == NULL)
+	{
+		if (local->nPeers == DTM_MAX_PEERS)
+		{
+			return;
+		}
+		peer = &local->peers[local->nPeers++];
+		peer->node_id = node;
+		peer->skew = delta;
+		peer->max_skew = delta;
+		peer->nSamples = 0;
+	}
+	peer->skew += (delta - peer->skew) / DTM_SKEW_AVG_WINDOW;
+	if (delta > peer->max_skew)
+	{
+		peer->max_skew = delta;
+	}
+	peer->nSamples += 1;
+	peer->last_seen = now;
+}
+
+/*
+ * Size of the current clock uncertainty window: how far the clock of the most
+ * skewed peer is estimated to run ahead of ours, clamped to a sane range.
+ * Used as the initial quantum when waiting for in-doubt transactions, so that
+ * a well synchronized cluster waits microseconds instead of the worst-case
+ * timeout. Until we have seen any peer the old pessimistic default is used.
+ * This function is called inside critical section.
+ */
+static timestamp_t
+dtm_get_uncertainty(void)
+{
+	int64		uncertainty = 0;
+	int			i;
+
+	if (local->nPeers == 0)
+	{
+		return MIN_WAIT_TIMEOUT;
+	}
+	for (i = 0; i < local->nPeers; i++)
+	{
+		if (local->peers[i].skew > uncertainty)
+		{
+			uncertainty = local->peers[i].skew;
+		}
+	}
+	if (uncertainty < DtmMinWaitTimeout)
+	{
+		uncertainty = DtmMinWaitTimeout;
+	}
+	else if (uncertainty > MAX_WAIT_TIMEOUT)
+	{
+		uncertainty = MAX_WAIT_TIMEOUT;
+	}
+	return (timestamp_t) uncertainty;
+}
+
 void
 _PG_init(void)
 {
@@ -227,6 +380,21 @@ _PG_init(void)
 							NULL
 		);
 
+	DefineCustomIntVariable(
+							"dtm.min_wait_timeout",
+							"Minimal wait quantum for in-doubt transactions (microseconds)",
+							"Lower bound of the adaptive clock uncertainty window; raise it if the skew estimates are too optimistic for your time synchronization",
+							&DtmMinWaitTimeout,
+							10,
+							1,
+							MAX_WAIT_TIMEOUT,
+							PGC_BACKEND,
+							0,
+							NULL,
+							NULL,
+							NULL
+		);
+
 	DefineCustomBoolVariable(
 							 "dtm.record_commits",
 							 "Store information about committed global transactions in pg_committed_xacts table",
@@ -345,6 +513,7 @@ PG_FUNCTION_INFO_V1(dtm_begin_prepare);
 PG_FUNCTION_INFO_V1(dtm_prepare);
 PG_FUNCTION_INFO_V1(dtm_end_prepare);
 PG_FUNCTION_INFO_V1(dtm_get_csn);
+PG_FUNCTION_INFO_V1(dtm_get_skew);
 
 Datum
 dtm_extend(PG_FUNCTION_ARGS)
@@ -408,6 +577,71 @@ dtm_get_csn(PG_FUNCTION_ARGS)
 	PG_RETURN_INT64(csn);
 }
 
+#define DTM_SKEW_COLS	5
+
+/*
+ * Report the current clock skew estimates, one row per peer node.
+ */
+Datum
+dtm_get_skew(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	DtmPeerSkew peers[DTM_MAX_PEERS];
+	int			nPeers;
+	int			i;
+
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	/* copy out the estimates: no allocations under the spinlock */
+	SpinLockAcquire(&local->lock);
+	nPeers = local->nPeers;
+	memcpy(peers, local->peers, nPeers * sizeof(DtmPeerSkew));
+	SpinLockRelease(&local->lock);
+
+	for (i = 0; i < nPeers; i++)
+	{
+		Datum		values[DTM_SKEW_COLS];
+		bool		nulls[DTM_SKEW_COLS] = {false, false, false, false, false};
+
+		values[0] = Int32GetDatum(peers[i].node_id);
+		values[1] = Int64GetDatum(peers[i].skew);
+		values[2] = Int64GetDatum(peers[i].max_skew);
+		values[3] = Int64GetDatum((int64) peers[i].nSamples);
+		values[4] = Int64GetDatum((int64) peers[i].last_seen);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
 /*
  *	***************************************************************************
  */
@@ -541,12 +775,22 @@ DtmGetOldestXmin(Relation rel, bool ignoreVacuum)
 bool
 DtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
 {
-	timestamp_t delay = MIN_WAIT_TIMEOUT;
+	timestamp_t delay;
+	DtmCsnCacheEntry *cached = &csn_cache[xid & (DTM_CSN_CACHE_SIZE - 1)];
 
 	Assert(xid != InvalidTransactionId);
 
+	if (cached->xid == xid && cached->snapshot == dtm_tx.snapshot)
+	{
+		if (cached->cid > dtm_tx.snapshot)
+			return true;
+		return cached->status == TRANSACTION_STATUS_ABORTED;
+	}
+
 	SpinLockAcquire(&local->lock);
 
+	delay = dtm_get_uncertainty();
+
 	while (true)
 	{
 		DtmTransStatus *ts = (DtmTransStatus *) hash_search(xid2status, &xid, HASH_FIND, NULL);
@@ -557,6 +801,14 @@ DtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
 			{
 				DTM_TRACE((stderr, "%d: tuple with xid=%d(csn=%lld) is invisibile in snapshot %lld\n",
 						   getpid(), xid, ts->cid, dtm_tx.snapshot));
+				if (ts->status != TRANSACTION_STATUS_IN_PROGRESS)
+				{
+					/* only finished transactions may be cached: their CSN is final */
+					cached->xid = xid;
+					cached->status = ts->status;
+					cached->cid = ts->cid;
+					cached->snapshot = dtm_tx.snapshot;
+				}
 				SpinLockRelease(&local->lock);
 				return true;
 			}
@@ -577,6 +829,10 @@ DtmXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
 
 				DTM_TRACE((stderr, "%d: tuple with xid=%d(csn= %lld) is %s in snapshot %lld\n",
 						   getpid(), xid, ts->cid, invisible ? "rollbacked" : "committed", dtm_tx.snapshot));
+				cached->xid = xid;
+				cached->status = ts->status;
+				cached->cid = ts->cid;
+				cached->snapshot = dtm_tx.snapshot;
 				SpinLockRelease(&local->lock);
 				return invisible;
 			}
@@ -627,6 +883,7 @@ DtmInitialize()
 		local->cid = dtm_get_current_time();
 		local->trans_list_head = NULL;
 		local->trans_list_tail = &local->trans_list_head;
+		local->nPeers = 0;
 		SpinLockInit(&local->lock);
 		RegisterXactCallback(dtm_xact_callback, NULL);
 	}
@@ -696,6 +953,8 @@ DtmLocalAccess(DtmCurrentTrans * x, GlobalTransactionId gtid, cid_t global_cid)
 			id->nSubxids = 0;
 			id->subxids = 0;
 		}
+		/* the snapshot is a reading of the coordinator's clock */
+		dtm_observe_skew(dtm_gtid_node(gtid), global_cid);
 		local_cid = dtm_sync(global_cid);
 		x->snapshot = global_cid;
 		x->is_global = true;
@@ -775,6 +1034,14 @@ DtmLocalEndPrepare(GlobalTransactionId gtid, cid_t cid)
 			ts = ts->next;
 			ts->cid = cid;
 		}
+
+		/*
+		 * The CSN is the maximum over all participants, so attributing it to
+		 * the coordinator may overestimate that node's skew, but never the
+		 * cluster-wide maximum, which is what sizes the uncertainty window.
+		 * Observe it before dtm_sync() shifts our clock up to it.
+		 */
+		dtm_observe_skew(dtm_gtid_node(gtid), cid);
 		dtm_sync(cid);
 
 		DTM_TRACE((stderr, "Prepare transaction %u(%s) with CSN %lu\n", id->xid, gtid, cid));
@@ -46,6 +46,7 @@ Mean:		   500 cycles =    51.2 mbits/sec
 
 #include "px.h"
 #include "rijndael.h"
+#include "x86-ni.h"
 
 #define PRE_CALC_TABLES
 #define LARGE_TABLES
@@ -505,6 +506,13 @@ aes_set_key(rijndael_ctx *ctx, const uint8 *key, unsigned keybits, int enc)
 {
 	uint32	   *k;
 
+	if (pg_aesni_available())
+	{
+		pg_aesni_set_key(ctx, key, keybits, enc);
+		return;
+	}
+	ctx->ni_rounds = 0;
+
 	k = (uint32 *) key;
 	rijndael_set_key(ctx, k, keybits, enc);
 }
@@ -515,6 +523,12 @@ aes_ecb_encrypt(rijndael_ctx *ctx, uint8 *data, unsigned len)
 	unsigned	bs = 16;
 	uint32	   *d;
 
+	if (ctx->ni_rounds)
+	{
+		pg_aesni_ecb_encrypt(ctx, data, len);
+		return;
+	}
+
 	while (len >= bs)
 	{
 		d = (uint32 *) data;
@@ -531,6 +545,12 @@ aes_ecb_decrypt(rijndael_ctx *ctx, uint8 *data, unsigned len)
 	unsigned	bs = 16;
 	uint32	   *d;
 
+	if (ctx->ni_rounds)
+	{
+		pg_aesni_ecb_decrypt(ctx, data, len);
+		return;
+	}
+
 	while (len >= bs)
 	{
 		d = (uint32 *) data;
@@ -548,6 +568,12 @@ aes_cbc_encrypt(rijndael_ctx *ctx, uint8 *iva, uint8 *data, unsigned len)
 	uint32	   *d = (uint32 *) data;
 	unsigned	bs = 16;
 
+	if (ctx->ni_rounds)
+	{
+		pg_aesni_cbc_encrypt(ctx, iva, data, len);
+		return;
+	}
+
 	while (len >= bs)
 	{
 		d[0] ^= iv[0];
@@ -571,6 +597,12 @@ aes_cbc_decrypt(rijndael_ctx *ctx, uint8 *iva, uint8 *data, unsigned len)
 	uint32		buf[4],
 				iv[4];
 
+	if (ctx->ni_rounds)
+	{
+		pg_aesni_cbc_decrypt(ctx, iva, data, len);
+		return;
+	}
+
 	memcpy(iv, iva, bs);
 	while (len >= bs)
 	{
@@ -36,6 +36,15 @@ typedef struct _rijndael_ctx
 	int			decrypt;
 	u4byte		e_key[64];
 	u4byte		d_key[64];
+
+	/*
+	 * AES-NI state (x86-ni.c).  ni_rounds is zero when the key was set up
+	 * for the portable code above; otherwise the ni_* key schedules are
+	 * valid and the bulk routines take the hardware path.
+	 */
+	unsigned	ni_rounds;
+	uint8		ni_ekey[16 * 15];
+	uint8		ni_dkey[16 * 15];
 } rijndael_ctx;
 
 
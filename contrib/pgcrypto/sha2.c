@@ -42,6 +42,7 @@
 
 #include "px.h"
 #include "sha2.h"
+#include "x86-ni.h"
 
 /*
  * UNROLLED TRANSFORM LOOP NOTE:
@@ -303,6 +304,13 @@ SHA256_Transform(SHA256_CTX *context, const uint8 *data)
 			   *W256;
 	int			j;
 
+	/* Use the SHA extensions for the whole block when available */
+	if (pg_shani_available())
+	{
+		pg_shani_sha256_transform(context->state, data);
+		return;
+	}
+
 	W256 = (uint32 *) context->buffer;
 
 	/* Initialize registers with the prev. intermediate value */
@@ -375,6 +383,13 @@ SHA256_Transform(SHA256_CTX *context, const uint8 *data)
 			   *W256;
 	int			j;
 
+	/* Use the SHA extensions for the whole block when available */
+	if (pg_shani_available())
+	{
+		pg_shani_sha256_transform(context->state, data);
+		return;
+	}
+
 	W256 = (uint32 *) context->buffer;
 
 	/* Initialize registers with the prev. intermediate value */
@@ -0,0 +1,33 @@
+/*
+ * x86-ni.h
+ *		Runtime-dispatched x86 AES-NI / SHA-NI helpers.
+ *
+ * These are only used by the built-in (non-OpenSSL) cipher and digest
+ * implementations.  On non-x86 builds the probe functions report false and
+ * the worker functions are never called.
+ *
+ * contrib/pgcrypto/x86-ni.h
+ */
+#ifndef _X86_NI_H_
+#define _X86_NI_H_
+
+struct _rijndael_ctx;
+
+/* AES-NI */
+int			pg_aesni_available(void);
+void		pg_aesni_set_key(struct _rijndael_ctx *ctx, const uint8 *key,
+							 unsigned keybits, int enc);
+void		pg_aesni_ecb_encrypt(struct _rijndael_ctx *ctx, uint8 *data,
+								 unsigned len);
+void		pg_aesni_ecb_decrypt(struct _rijndael_ctx *ctx, uint8 *data,
+								 unsigned len);
+void		pg_aesni_cbc_encrypt(struct _rijndael_ctx *ctx, uint8 *iva,
+								 uint8 *data, unsigned len);
+void		pg_aesni_cbc_decrypt(struct _rijndael_ctx *ctx, uint8 *iva,
+								 uint8 *data, unsigned len);
+
+/* SHA-NI */
+int			pg_shani_available(void);
+void		pg_shani_sha256_transform(uint32 *state, const uint8 *data);
+
+#endif   /* _X86_NI_H_ */
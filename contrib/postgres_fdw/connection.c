@@ -171,6 +171,13 @@ GetConnection(UserMapping *user, bool will_prep_stmt)
 			 entry->conn, server->servername, user->umid, user->userid);
 	}
 
+	/*
+	 * If a scan has an asynchronously-started FETCH in flight on this
+	 * connection, collect its result first: anything else sent on the
+	 * connection would discard it.
+	 */
+	pgfdw_complete_pending_fetch(entry->conn);
+
 	/*
 	 * Start a new transaction or subtransaction if needed.
 	 */
@@ -671,6 +678,13 @@ pgfdw_xact_callback(XactEvent event, void *arg)
 	if (!xact_got_connection)
 		return;
 
+	/*
+	 * The executor has shut down every foreign scan by now, so any FETCH
+	 * still recorded as in flight belongs to no live scan; forget it, and
+	 * let the transaction commands below discard any stray result.
+	 */
+	pgfdw_forget_all_pending_fetches();
+
 	if (currentGlobalTransactionId != 0)
 	{
 		switch (event)
@@ -885,6 +899,18 @@ pgfdw_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
 			elog(ERROR, "missed cleaning up remote subtransaction at level %d",
 				 entry->xact_depth);
 
+		/*
+		 * A scan on this connection may still have a FETCH in flight.  On
+		 * subtransaction commit the scan can survive into the parent, so
+		 * buffer the rows it is owed before issuing transaction commands;
+		 * on abort the scan is being torn down anyway and the PQexec below
+		 * will discard the stray result.
+		 */
+		if (event == SUBXACT_EVENT_PRE_COMMIT_SUB)
+			pgfdw_complete_pending_fetch(entry->conn);
+		else
+			pgfdw_forget_pending_fetch(entry->conn);
+
 		if (event == SUBXACT_EVENT_PRE_COMMIT_SUB)
 		{
 			/* Commit all remote subtransactions during pre-commit */
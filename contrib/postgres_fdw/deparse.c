@@ -24,6 +24,14 @@
  * with collations that match the remote table's columns, which we can
  * consider to be user error.
  *
+ * Only WHERE clauses and ORDER BY pathkeys are considered for remote
+ * execution at present.  Aggregates and GROUP BY cannot be pushed down:
+ * the core planner constructs the grouping plan on top of the cheapest
+ * scan/join paths without giving FDWs an opportunity to offer a path for
+ * the grouped relation, so there is no place to substitute a remotely
+ * aggregated query.  If the planner grows such a hook, this module is
+ * where the grouped query text should be generated.
+ *
  * Portions Copyright (c) 2012-2016, PostgreSQL Global Development Group
  *
  * IDENTIFICATION
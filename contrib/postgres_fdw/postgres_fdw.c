@@ -34,6 +34,7 @@
 #include "parser/parsetree.h"
 #include "utils/builtins.h"
 #include "utils/guc.h"
+#include "utils/hsearch.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
@@ -118,6 +119,12 @@ typedef struct PgFdwScanState
 	/* batch-level state, for optimizing rewinds and avoiding useless fetch */
 	int			fetch_ct_2;		/* Min(# of fetches done, 2) */
 	bool		eof_reached;	/* true if last fetch reached EOF */
+	bool		async_pending;	/* sent a FETCH whose result is not yet in */
+
+	/* for binary-mode transfer (binary_transfer option) */
+	bool		binary_transfer;	/* use a binary cursor for this scan */
+	FmgrInfo   *recv_flinfo;	/* per-column binary receive functions */
+	Oid		   *recv_typioparams;	/* their typioparam values */
 
 	/* working memory contexts */
 	MemoryContext batch_cxt;	/* context holding current batch of tuples */
@@ -285,6 +292,10 @@ static bool ec_member_matches_foreign(PlannerInfo *root, RelOptInfo *rel,
 						  void *arg);
 static void create_cursor(ForeignScanState *node);
 static void fetch_more_data(ForeignScanState *node);
+static PgFdwScanState *pending_fetch_scan(PGconn *conn);
+static void register_pending_fetch(PgFdwScanState *fsstate);
+static void issue_async_fetch(PgFdwScanState *fsstate);
+static void fetch_received_data(PgFdwScanState *fsstate);
 static void close_cursor(PGconn *conn, unsigned int cursor_number);
 static void prepare_foreign_modify(PgFdwModifyState *fmstate);
 static const char **convert_prep_stmt_params(PgFdwModifyState *fmstate,
@@ -303,6 +314,7 @@ static HeapTuple make_tuple_from_result_row(PGresult *res,
 						   Relation rel,
 						   AttInMetadata *attinmeta,
 						   List *retrieved_attrs,
+						   PgFdwScanState *fsstate,
 						   MemoryContext temp_context);
 static void conversion_error_callback(void *arg);
 
@@ -1112,6 +1124,55 @@ postgresBeginForeignScan(ForeignScanState *node, int eflags)
 	/* Get info we'll need for input data conversion. */
 	fsstate->attinmeta = TupleDescGetAttInMetadata(RelationGetDescr(fsstate->rel));
 
+	/*
+	 * Check for the binary_transfer option; a per-table setting overrides a
+	 * per-server one.  When set, the cursor is declared BINARY and values
+	 * are converted with the types' receive functions, which is considerably
+	 * cheaper than text output/input for wide or numeric-heavy rows.
+	 */
+	fsstate->binary_transfer = false;
+	foreach(lc, GetForeignServer(table->serverid)->options)
+	{
+		DefElem    *def = (DefElem *) lfirst(lc);
+
+		if (strcmp(def->defname, "binary_transfer") == 0)
+			fsstate->binary_transfer = defGetBoolean(def);
+	}
+	foreach(lc, table->options)
+	{
+		DefElem    *def = (DefElem *) lfirst(lc);
+
+		if (strcmp(def->defname, "binary_transfer") == 0)
+			fsstate->binary_transfer = defGetBoolean(def);
+	}
+
+	/*
+	 * In binary mode, look up the receive function for each retrieved
+	 * column.  Types lacking a binary receive function are reported here,
+	 * when the scan starts, rather than failing row by row.
+	 */
+	if (fsstate->binary_transfer)
+	{
+		TupleDesc	tupdesc = RelationGetDescr(fsstate->rel);
+
+		fsstate->recv_flinfo = (FmgrInfo *)
+			palloc0(tupdesc->natts * sizeof(FmgrInfo));
+		fsstate->recv_typioparams = (Oid *)
+			palloc0(tupdesc->natts * sizeof(Oid));
+		foreach(lc, fsstate->retrieved_attrs)
+		{
+			int			attnum = lfirst_int(lc);
+			Oid			recvfuncid;
+
+			if (attnum <= 0)
+				continue;		/* ctid is handled specially */
+			getTypeBinaryInputInfo(tupdesc->attrs[attnum - 1]->atttypid,
+								   &recvfuncid,
+								   &fsstate->recv_typioparams[attnum - 1]);
+			fmgr_info(recvfuncid, &fsstate->recv_flinfo[attnum - 1]);
+		}
+	}
+
 	/* Prepare for output conversion of parameters used in remote query. */
 	numParams = list_length(fsplan->fdw_exprs);
 	fsstate->numParams = numParams;
@@ -1148,6 +1209,21 @@ postgresBeginForeignScan(ForeignScanState *node, int eflags)
 		fsstate->param_values = (const char **) palloc0(numParams * sizeof(char *));
 	else
 		fsstate->param_values = NULL;
+
+	/*
+	 * If the scan needs no run-time parameters, open the cursor and start
+	 * the first fetch right away.  All the scans under an Append are
+	 * initialized before any of them is asked for rows, so this lets every
+	 * remote server work on its first batch concurrently instead of
+	 * serializing the startup latencies.  If another scan already has a
+	 * fetch in flight on this connection, just fall back to starting the
+	 * cursor at the first Iterate call, as before.
+	 */
+	if (numParams == 0 && pending_fetch_scan(fsstate->conn) == NULL)
+	{
+		create_cursor(node);
+		issue_async_fetch(fsstate);
+	}
 }
 
 /*
@@ -1231,6 +1307,9 @@ postgresReScanForeignScan(ForeignScanState *node)
 		return;
 	}
 
+	/* Collect any FETCH in flight on the connection (ours or another's) */
+	pgfdw_complete_pending_fetch(fsstate->conn);
+
 	/*
 	 * We don't use a PG_TRY block here, so be careful not to throw error
 	 * without releasing the PGresult.
@@ -1575,6 +1654,7 @@ postgresExecForeignInsert(EState *estate,
 	 * We don't use a PG_TRY block here, so be careful not to throw error
 	 * without releasing the PGresult.
 	 */
+	pgfdw_complete_pending_fetch(fmstate->conn);
 	res = PQexecPrepared(fmstate->conn,
 						 fmstate->p_name,
 						 fmstate->p_nums,
@@ -1645,6 +1725,7 @@ postgresExecForeignUpdate(EState *estate,
 	 * We don't use a PG_TRY block here, so be careful not to throw error
 	 * without releasing the PGresult.
 	 */
+	pgfdw_complete_pending_fetch(fmstate->conn);
 	res = PQexecPrepared(fmstate->conn,
 						 fmstate->p_name,
 						 fmstate->p_nums,
@@ -1715,6 +1796,7 @@ postgresExecForeignDelete(EState *estate,
 	 * We don't use a PG_TRY block here, so be careful not to throw error
 	 * without releasing the PGresult.
 	 */
+	pgfdw_complete_pending_fetch(fmstate->conn);
 	res = PQexecPrepared(fmstate->conn,
 						 fmstate->p_name,
 						 fmstate->p_nums,
@@ -1771,6 +1853,7 @@ postgresEndForeignModify(EState *estate,
 		 * We don't use a PG_TRY block here, so be careful not to throw error
 		 * without releasing the PGresult.
 		 */
+		pgfdw_complete_pending_fetch(fmstate->conn);
 		res = PQexec(fmstate->conn, sql);
 		if (PQresultStatus(res) != PGRES_COMMAND_OK)
 			pgfdw_report_error(ERROR, res, fmstate->conn, true, sql);
@@ -2168,8 +2251,10 @@ create_cursor(ForeignScanState *node)
 
 	/* Construct the DECLARE CURSOR command */
 	initStringInfo(&buf);
-	appendStringInfo(&buf, "DECLARE c%u CURSOR FOR\n%s",
-					 fsstate->cursor_number, fsstate->query);
+	appendStringInfo(&buf, "DECLARE c%u %sCURSOR FOR\n%s",
+					 fsstate->cursor_number,
+					 fsstate->binary_transfer ? "BINARY " : "",
+					 fsstate->query);
 
 	/*
 	 * Notice that we pass NULL for paramTypes, thus forcing the remote server
@@ -2181,6 +2266,7 @@ create_cursor(ForeignScanState *node)
 	 * We don't use a PG_TRY block here, so be careful not to throw error
 	 * without releasing the PGresult.
 	 */
+	pgfdw_complete_pending_fetch(conn);
 	res = PQexecParams(conn, buf.data, numParams, NULL, values,
 					   NULL, NULL, 0);
 	if (PQresultStatus(res) != PGRES_COMMAND_OK)
@@ -2200,54 +2286,182 @@ create_cursor(ForeignScanState *node)
 }
 
 /*
- * Fetch some more rows from the node's cursor.
+ * Registry of asynchronously-started FETCHes.
+ *
+ * Only one query can be in flight on a connection at a time, so we track,
+ * per connection, the scan (if any) whose FETCH has been sent but whose
+ * result has not yet been collected.  Any other use of the connection must
+ * first complete that fetch with pgfdw_complete_pending_fetch(); otherwise
+ * libpq would silently discard the result.
+ */
+typedef struct PgFdwPendingFetch
+{
+	PGconn	   *conn;			/* hash key -- must be first */
+	PgFdwScanState *scan;		/* scan whose FETCH is in flight */
+} PgFdwPendingFetch;
+
+static HTAB *PendingFetchHash = NULL;
+
+/*
+ * Return the scan with a FETCH in flight on the given connection, if any.
+ */
+static PgFdwScanState *
+pending_fetch_scan(PGconn *conn)
+{
+	PgFdwPendingFetch *pf;
+
+	if (PendingFetchHash == NULL)
+		return NULL;
+	pf = (PgFdwPendingFetch *) hash_search(PendingFetchHash, &conn,
+										   HASH_FIND, NULL);
+	return pf ? pf->scan : NULL;
+}
+
+/*
+ * Record that the given scan has a FETCH in flight on its connection.
  */
 static void
-fetch_more_data(ForeignScanState *node)
+register_pending_fetch(PgFdwScanState *fsstate)
+{
+	PgFdwPendingFetch *pf;
+	bool		found;
+
+	if (PendingFetchHash == NULL)
+	{
+		HASHCTL		ctl;
+
+		MemSet(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(PGconn *);
+		ctl.entrysize = sizeof(PgFdwPendingFetch);
+		ctl.hcxt = CacheMemoryContext;
+		PendingFetchHash = hash_create("postgres_fdw pending fetches", 8,
+									   &ctl,
+									   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	pf = (PgFdwPendingFetch *) hash_search(PendingFetchHash, &fsstate->conn,
+										   HASH_ENTER, &found);
+	Assert(!found);
+	pf->scan = fsstate;
+}
+
+/*
+ * Forget any in-flight FETCH on the given connection without touching the
+ * owning scan.  For use by transaction cleanup, when the scan is being
+ * torn down anyway and the next PQexec will discard the stray result.
+ */
+void
+pgfdw_forget_pending_fetch(PGconn *conn)
+{
+	if (PendingFetchHash)
+		hash_search(PendingFetchHash, &conn, HASH_REMOVE, NULL);
+}
+
+/*
+ * Forget all in-flight FETCHes.  For use at top-level transaction end,
+ * when the executor has long since shut down every scan.
+ */
+void
+pgfdw_forget_all_pending_fetches(void)
+{
+	HASH_SEQ_STATUS scan;
+	PgFdwPendingFetch *pf;
+
+	if (PendingFetchHash == NULL)
+		return;
+	hash_seq_init(&scan, PendingFetchHash);
+	while ((pf = (PgFdwPendingFetch *) hash_seq_search(&scan)) != NULL)
+		hash_search(PendingFetchHash, &pf->conn, HASH_REMOVE, NULL);
+}
+
+/*
+ * Complete the in-flight FETCH on the given connection, if any, buffering
+ * the received rows in the owning scan.  This must be called before
+ * issuing any other query on a connection that may be running an
+ * asynchronously-started FETCH.
+ */
+void
+pgfdw_complete_pending_fetch(PGconn *conn)
+{
+	PgFdwScanState *fsstate = pending_fetch_scan(conn);
+
+	if (fsstate == NULL)
+		return;
+	fetch_received_data(fsstate);
+}
+
+/*
+ * Start the next FETCH on the scan's cursor without waiting for the
+ * result, so that the remote server produces and ships rows while we do
+ * other work.  The caller must ensure that no other query is in flight on
+ * the connection.
+ */
+static void
+issue_async_fetch(PgFdwScanState *fsstate)
+{
+	char		sql[64];
+
+	Assert(!fsstate->async_pending);
+	Assert(pending_fetch_scan(fsstate->conn) == NULL);
+
+	snprintf(sql, sizeof(sql), "FETCH %d FROM c%u",
+			 fsstate->fetch_size, fsstate->cursor_number);
+
+	if (!PQsendQuery(fsstate->conn, sql))
+		pgfdw_report_error(ERROR, NULL, fsstate->conn, false, fsstate->query);
+
+	register_pending_fetch(fsstate);
+	fsstate->async_pending = true;
+}
+
+/*
+ * Collect the result of the FETCH previously sent on the scan's
+ * connection, appending the rows to the scan's buffer.
+ */
+static void
+fetch_received_data(PgFdwScanState *fsstate)
 {
-	PgFdwScanState *fsstate = (PgFdwScanState *) node->fdw_state;
 	PGresult   *volatile res = NULL;
 	MemoryContext oldcontext;
 
-	/*
-	 * We'll store the tuples in the batch_cxt.  First, flush the previous
-	 * batch.
-	 */
-	fsstate->tuples = NULL;
-	MemoryContextReset(fsstate->batch_cxt);
+	Assert(fsstate->async_pending);
+
 	oldcontext = MemoryContextSwitchTo(fsstate->batch_cxt);
 
 	/* PGresult must be released before leaving this function. */
 	PG_TRY();
 	{
 		PGconn	   *conn = fsstate->conn;
-		char		sql[64];
+		PGresult   *next;
 		int			numrows;
 		int			i;
 
-		snprintf(sql, sizeof(sql), "FETCH %d FROM c%u",
-				 fsstate->fetch_size, fsstate->cursor_number);
-
-		res = PQexec(conn, sql);
+		res = PQgetResult(conn);
 		/* On error, report the original query, not the FETCH. */
 		if (PQresultStatus(res) != PGRES_TUPLES_OK)
 			pgfdw_report_error(ERROR, res, conn, false, fsstate->query);
 
-		/* Convert the data into HeapTuples */
+		/* Convert the data into HeapTuples, appending to the buffer */
 		numrows = PQntuples(res);
-		fsstate->tuples = (HeapTuple *) palloc0(numrows * sizeof(HeapTuple));
-		fsstate->num_tuples = numrows;
-		fsstate->next_tuple = 0;
+		if (fsstate->tuples == NULL)
+			fsstate->tuples = (HeapTuple *)
+				palloc0(numrows * sizeof(HeapTuple));
+		else
+			fsstate->tuples = (HeapTuple *)
+				repalloc(fsstate->tuples,
+						 (fsstate->num_tuples + numrows) * sizeof(HeapTuple));
 
 		for (i = 0; i < numrows; i++)
 		{
-			fsstate->tuples[i] =
+			fsstate->tuples[fsstate->num_tuples + i] =
 				make_tuple_from_result_row(res, i,
 										   fsstate->rel,
 										   fsstate->attinmeta,
 										   fsstate->retrieved_attrs,
+										   fsstate,
 										   fsstate->temp_cxt);
 		}
+		fsstate->num_tuples += numrows;
 
 		/* Update fetch_ct_2 */
 		if (fsstate->fetch_ct_2 < 2)
@@ -2258,6 +2472,10 @@ fetch_more_data(ForeignScanState *node)
 
 		PQclear(res);
 		res = NULL;
+
+		/* Nothing else should be pending on the connection */
+		while ((next = PQgetResult(conn)) != NULL)
+			PQclear(next);
 	}
 	PG_CATCH();
 	{
@@ -2267,9 +2485,52 @@ fetch_more_data(ForeignScanState *node)
 	}
 	PG_END_TRY();
 
+	fsstate->async_pending = false;
+	pgfdw_forget_pending_fetch(fsstate->conn);
+
 	MemoryContextSwitchTo(oldcontext);
 }
 
+/*
+ * Fetch some more rows from the node's cursor.
+ */
+static void
+fetch_more_data(ForeignScanState *node)
+{
+	PgFdwScanState *fsstate = (PgFdwScanState *) node->fdw_state;
+
+	/*
+	 * We'll store the tuples in the batch_cxt.  First, flush the previous
+	 * batch.
+	 */
+	fsstate->tuples = NULL;
+	fsstate->num_tuples = 0;
+	fsstate->next_tuple = 0;
+	MemoryContextReset(fsstate->batch_cxt);
+
+	if (fsstate->async_pending)
+	{
+		/* The FETCH for this batch is already in flight. */
+		if (pending_fetch_scan(fsstate->conn) != fsstate)
+			elog(ERROR, "in-flight postgres_fdw FETCH result was lost");
+	}
+	else
+	{
+		/* Some other scan may have a FETCH in flight on our connection. */
+		pgfdw_complete_pending_fetch(fsstate->conn);
+		issue_async_fetch(fsstate);
+	}
+
+	fetch_received_data(fsstate);
+
+	/*
+	 * Eagerly request the next batch: the remote server can produce and
+	 * ship it while we process this one.
+	 */
+	if (!fsstate->eof_reached)
+		issue_async_fetch(fsstate);
+}
+
 /*
  * Force assorted GUC parameters to settings that ensure that we'll output
  * data values in a form that is unambiguous to the remote server.
@@ -2331,6 +2592,9 @@ close_cursor(PGconn *conn, unsigned int cursor_number)
 
 	snprintf(sql, sizeof(sql), "CLOSE c%u", cursor_number);
 
+	/* First collect any FETCH still in flight on the connection */
+	pgfdw_complete_pending_fetch(conn);
+
 	/*
 	 * We don't use a PG_TRY block here, so be careful not to throw error
 	 * without releasing the PGresult.
@@ -2367,6 +2631,7 @@ prepare_foreign_modify(PgFdwModifyState *fmstate)
 	 * We don't use a PG_TRY block here, so be careful not to throw error
 	 * without releasing the PGresult.
 	 */
+	pgfdw_complete_pending_fetch(fmstate->conn);
 	res = PQprepare(fmstate->conn,
 					p_name,
 					fmstate->query,
@@ -2464,6 +2729,7 @@ store_returning_result(PgFdwModifyState *fmstate,
 											fmstate->rel,
 											fmstate->attinmeta,
 											fmstate->retrieved_attrs,
+											NULL,
 											fmstate->temp_cxt);
 		/* tuple will be deleted when it is cleared from the slot */
 		ExecStoreTuple(newtup, slot, InvalidBuffer, true);
@@ -2774,6 +3040,7 @@ analyze_row_processor(PGresult *res, int row, PgFdwAnalyzeState *astate)
 													   astate->rel,
 													   astate->attinmeta,
 													 astate->retrieved_attrs,
+													   NULL,
 													   astate->temp_cxt);
 
 		MemoryContextSwitchTo(oldcontext);
@@ -3062,8 +3329,10 @@ make_tuple_from_result_row(PGresult *res,
 						   Relation rel,
 						   AttInMetadata *attinmeta,
 						   List *retrieved_attrs,
+						   PgFdwScanState *fsstate,
 						   MemoryContext temp_context)
 {
+	bool		binary = (fsstate && fsstate->binary_transfer);
 	HeapTuple	tuple;
 	TupleDesc	tupdesc = RelationGetDescr(rel);
 	Datum	   *values;
@@ -3107,12 +3376,27 @@ make_tuple_from_result_row(PGresult *res,
 	{
 		int			i = lfirst_int(lc);
 		char	   *valstr;
+		StringInfoData valbuf;
 
-		/* fetch next column's textual value */
+		/* fetch next column's value (text, or wire format if binary) */
 		if (PQgetisnull(res, row, j))
 			valstr = NULL;
 		else
+		{
 			valstr = PQgetvalue(res, row, j);
+			if (binary)
+			{
+				/*
+				 * Wrap the wire datum in a StringInfo for the receive
+				 * function.  Receive functions only read from the buffer,
+				 * so pointing it straight at libpq's storage is safe.
+				 */
+				valbuf.data = valstr;
+				valbuf.len = PQgetlength(res, row, j);
+				valbuf.maxlen = valbuf.len;
+				valbuf.cursor = 0;
+			}
+		}
 
 		/* convert value to internal representation */
 		if (i > 0)
@@ -3120,10 +3404,16 @@ make_tuple_from_result_row(PGresult *res,
 			/* ordinary column */
 			Assert(i <= tupdesc->natts);
 			nulls[i - 1] = (valstr == NULL);
-			/* Apply the input function even to nulls, to support domains */
+			/* Apply the conversion function even to nulls, for domains */
 			errpos.cur_attno = i;
-			values[i - 1] = InputFunctionCall(&attinmeta->attinfuncs[i - 1],
-											  valstr,
+			if (binary)
+				values[i - 1] = ReceiveFunctionCall(&fsstate->recv_flinfo[i - 1],
+													valstr ? &valbuf : NULL,
+										fsstate->recv_typioparams[i - 1],
+											  attinmeta->atttypmods[i - 1]);
+			else
+				values[i - 1] = InputFunctionCall(&attinmeta->attinfuncs[i - 1],
+												  valstr,
 											  attinmeta->attioparams[i - 1],
 											  attinmeta->atttypmods[i - 1]);
 			errpos.cur_attno = 0;
@@ -3135,7 +3425,12 @@ make_tuple_from_result_row(PGresult *res,
 			{
 				Datum		datum;
 
-				datum = DirectFunctionCall1(tidin, CStringGetDatum(valstr));
+				if (binary)
+					datum = DirectFunctionCall1(tidrecv,
+												PointerGetDatum(&valbuf));
+				else
+					datum = DirectFunctionCall1(tidin,
+												CStringGetDatum(valstr));
 				ctid = (ItemPointer) DatumGetPointer(datum);
 			}
 		}
@@ -3228,7 +3523,7 @@ postgres_fdw_exec(PG_FUNCTION_ARGS)
 	ForeignTable *table = GetForeignTable(relid);
 	ForeignServer *server = GetForeignServer(table->serverid);
 	UserMapping *user = GetUserMapping(userid, server->serverid);
-	PGconn	   *conn = GetConnection(server, user, false);
+	PGconn	   *conn = GetConnection(user, false);
 	PGresult   *res = PQexec(conn, sql);
 
 	PQclear(res);
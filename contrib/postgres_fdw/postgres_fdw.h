@@ -58,8 +58,12 @@ typedef struct PgFdwRelationInfo
 } PgFdwRelationInfo;
 
 /* in postgres_fdw.c */
+extern bool UseTsDtmTransactions;
 extern int	set_transmission_modes(void);
 extern void reset_transmission_modes(int nestlevel);
+extern void pgfdw_complete_pending_fetch(PGconn *conn);
+extern void pgfdw_forget_pending_fetch(PGconn *conn);
+extern void pgfdw_forget_all_pending_fetches(void);
 
 /* in connection.c */
 extern PGconn *GetConnection(UserMapping *user, bool will_prep_stmt);
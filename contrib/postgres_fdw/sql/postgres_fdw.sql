@@ -973,3 +973,17 @@ WHERE ftrelid = 'table30000'::regclass
 AND ftoptions @> array['fetch_size=60000'];
 
 ROLLBACK;
+
+-- ===================================================================
+-- test binary-mode transfer
+-- ===================================================================
+ALTER FOREIGN TABLE ft2 OPTIONS (ADD binary_transfer 'true');
+
+SELECT c1, c2, c3 FROM ft2 WHERE c1 = 1;
+
+SELECT c1, c2, c3 FROM ft2 WHERE c1 < 5 ORDER BY c1;
+
+-- binary_transfer accepts only boolean values
+ALTER FOREIGN TABLE ft2 OPTIONS (SET binary_transfer 'surely');  -- ERROR
+
+ALTER FOREIGN TABLE ft2 OPTIONS (DROP binary_transfer);
@@ -0,0 +1,329 @@
+/*
+ * brin_bloom.c
+ *		Implementation of bloom-filter opclasses for BRIN
+ *
+ * This module provides BRIN support functions for the "bloom" operator
+ * classes.  Instead of summarizing a block range by the boundaries of the
+ * values it contains, these opclasses summarize it by a bloom filter of the
+ * values.  That keeps equality queries effective on columns whose values are
+ * not physically correlated with heap order, where a single outlier row per
+ * range makes a min/max summary span nearly the whole domain.
+ *
+ * The filter size is fixed.  Each range can absorb on the order of a
+ * thousand distinct values before the false positive rate starts to climb;
+ * for columns with more distinct values per range, a smaller
+ * pages_per_range is advisable.
+ *
+ * The opclasses hash values with the type's hash opclass support function,
+ * looked up through the type cache, so the support procedures here are
+ * shared by the bloom opclasses of all indexable types.  Only the equality
+ * operator can be indexed.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/access/brin/brin_bloom.c
+ */
+#include "postgres.h"
+
+#include "access/brin_internal.h"
+#include "access/brin_tuple.h"
+#include "access/skey.h"
+#include "catalog/pg_type.h"
+#include "utils/builtins.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/typcache.h"
+
+
+/*
+ * Filter geometry.  8192 bits with seven probes keeps the false positive
+ * rate around 1% for up to ~800 distinct values per block range.
+ */
+#define BLOOM_FILTER_BYTES		1024
+#define BLOOM_FILTER_BITS		(BLOOM_FILTER_BYTES * BITS_PER_BYTE)
+#define BLOOM_NUM_HASHES		7
+
+/* Strategy numbers (there is only one) */
+#define BloomEqualStrategyNumber	1
+
+typedef struct BloomOpaque
+{
+	/* the indexed type's hash function, set up on first use */
+	FmgrInfo	hash_proc;
+	bool		hash_proc_set;
+} BloomOpaque;
+
+Datum		brin_bloom_opcinfo(PG_FUNCTION_ARGS);
+Datum		brin_bloom_add_value(PG_FUNCTION_ARGS);
+Datum		brin_bloom_consistent(PG_FUNCTION_ARGS);
+Datum		brin_bloom_union(PG_FUNCTION_ARGS);
+
+static uint32 bloom_hash_value(BrinDesc *bdesc, uint16 attno, Oid colloid,
+				 Datum value);
+static bytea *bloom_get_filter(BrinValues *column);
+
+
+/*
+ * BRIN bloom OpcInfo function
+ */
+Datum
+brin_bloom_opcinfo(PG_FUNCTION_ARGS)
+{
+	BrinOpcInfo *result;
+
+	/*
+	 * The stored value is always a bytea containing the filter, regardless
+	 * of the indexed type.
+	 */
+	result = palloc0(MAXALIGN(SizeofBrinOpcInfo(1)) + sizeof(BloomOpaque));
+	result->oi_nstored = 1;
+	result->oi_opaque = (BloomOpaque *)
+		MAXALIGN((char *) result + SizeofBrinOpcInfo(1));
+	result->oi_typcache[0] = lookup_type_cache(BYTEAOID, 0);
+
+	PG_RETURN_POINTER(result);
+}
+
+/*
+ * BRIN bloom add value function
+ *
+ * Set the filter bits for the given heap value, and return whether that
+ * changed the stored summary.
+ */
+Datum
+brin_bloom_add_value(PG_FUNCTION_ARGS)
+{
+	BrinDesc   *bdesc = (BrinDesc *) PG_GETARG_POINTER(0);
+	BrinValues *column = (BrinValues *) PG_GETARG_POINTER(1);
+	Datum		newval = PG_GETARG_DATUM(2);
+	bool		isnull = PG_GETARG_BOOL(3);
+	Oid			colloid = PG_GET_COLLATION();
+	AttrNumber	attno = column->bv_attno;
+	bytea	   *filter;
+	uint8	   *bits;
+	uint32		hash;
+	uint32		probe;
+	bool		updated = false;
+	int			i;
+
+	/*
+	 * If the new value is null, we record that we saw it if it's the first
+	 * one; otherwise, there's nothing to do.
+	 */
+	if (isnull)
+	{
+		if (column->bv_hasnulls)
+			PG_RETURN_BOOL(false);
+
+		column->bv_hasnulls = true;
+		PG_RETURN_BOOL(true);
+	}
+
+	/*
+	 * If the range had no values so far, start with an empty filter.
+	 */
+	if (column->bv_allnulls)
+	{
+		filter = (bytea *) palloc0(VARHDRSZ + BLOOM_FILTER_BYTES);
+		SET_VARSIZE(filter, VARHDRSZ + BLOOM_FILTER_BYTES);
+		column->bv_values[0] = PointerGetDatum(filter);
+		column->bv_allnulls = false;
+		updated = true;
+	}
+	else
+		filter = bloom_get_filter(column);
+
+	bits = (uint8 *) VARDATA(filter);
+	hash = bloom_hash_value(bdesc, attno, colloid, newval);
+
+	/*
+	 * Derive the probe positions by double hashing: the value's hash plus
+	 * multiples of a second, odd hash obtained by scrambling the first.
+	 */
+	for (i = 0; i < BLOOM_NUM_HASHES; i++)
+	{
+		probe = (hash + i * ((hash * 0x9E3779B1) | 1)) % BLOOM_FILTER_BITS;
+		if (!(bits[probe / BITS_PER_BYTE] & (1 << (probe % BITS_PER_BYTE))))
+		{
+			bits[probe / BITS_PER_BYTE] |= 1 << (probe % BITS_PER_BYTE);
+			updated = true;
+		}
+	}
+
+	PG_RETURN_BOOL(updated);
+}
+
+/*
+ * BRIN bloom consistent function
+ *
+ * Only the equality strategy is supported; the range may contain the query
+ * value only if all of its probe bits are set in the filter.
+ */
+Datum
+brin_bloom_consistent(PG_FUNCTION_ARGS)
+{
+	BrinDesc   *bdesc = (BrinDesc *) PG_GETARG_POINTER(0);
+	BrinValues *column = (BrinValues *) PG_GETARG_POINTER(1);
+	ScanKey		key = (ScanKey) PG_GETARG_POINTER(2);
+	Oid			colloid = PG_GET_COLLATION();
+	bytea	   *filter;
+	uint8	   *bits;
+	uint32		hash;
+	uint32		probe;
+	int			i;
+
+	Assert(key->sk_attno == column->bv_attno);
+
+	/* Handle IS NULL/IS NOT NULL tests. */
+	if (key->sk_flags & SK_ISNULL)
+	{
+		if (key->sk_flags & SK_SEARCHNULL)
+		{
+			if (column->bv_allnulls || column->bv_hasnulls)
+				PG_RETURN_BOOL(true);
+			PG_RETURN_BOOL(false);
+		}
+
+		/*
+		 * For IS NOT NULL, we can only skip ranges that are known to have
+		 * only nulls.
+		 */
+		if (key->sk_flags & SK_SEARCHNOTNULL)
+			PG_RETURN_BOOL(!column->bv_allnulls);
+
+		/*
+		 * Neither IS NULL nor IS NOT NULL was used; assume all indexable
+		 * operators are strict and return false.
+		 */
+		PG_RETURN_BOOL(false);
+	}
+
+	/* If it is all nulls, it cannot possibly be consistent. */
+	if (column->bv_allnulls)
+		PG_RETURN_BOOL(false);
+
+	if (key->sk_strategy != BloomEqualStrategyNumber)
+		elog(ERROR, "invalid strategy number %d", key->sk_strategy);
+
+	filter = bloom_get_filter(column);
+	bits = (uint8 *) VARDATA(filter);
+	hash = bloom_hash_value(bdesc, column->bv_attno, colloid,
+							key->sk_argument);
+
+	for (i = 0; i < BLOOM_NUM_HASHES; i++)
+	{
+		probe = (hash + i * ((hash * 0x9E3779B1) | 1)) % BLOOM_FILTER_BITS;
+		if (!(bits[probe / BITS_PER_BYTE] & (1 << (probe % BITS_PER_BYTE))))
+			PG_RETURN_BOOL(false);
+	}
+
+	PG_RETURN_BOOL(true);
+}
+
+/*
+ * BRIN bloom union function
+ *
+ * Given two BrinValues, update the first of them as a union of the summary
+ * values contained in both.  The second one is untouched.
+ */
+Datum
+brin_bloom_union(PG_FUNCTION_ARGS)
+{
+	BrinValues *col_a = (BrinValues *) PG_GETARG_POINTER(1);
+	BrinValues *col_b = (BrinValues *) PG_GETARG_POINTER(2);
+	bytea	   *filter_a;
+	bytea	   *filter_b;
+	uint8	   *bits_a;
+	uint8	   *bits_b;
+	int			i;
+
+	Assert(col_a->bv_attno == col_b->bv_attno);
+
+	/* Adjust "hasnulls". */
+	if (!col_a->bv_hasnulls && col_b->bv_hasnulls)
+		col_a->bv_hasnulls = true;
+
+	/* If there are no values in B, there's nothing left to do. */
+	if (col_b->bv_allnulls)
+		PG_RETURN_VOID();
+
+	filter_b = bloom_get_filter(col_b);
+
+	/*
+	 * If A doesn't have values, copy B's filter into A.  We cannot use the
+	 * existing value in this case, because it might contain garbage.
+	 */
+	if (col_a->bv_allnulls)
+	{
+		col_a->bv_allnulls = false;
+		col_a->bv_values[0] = datumCopy(PointerGetDatum(filter_b),
+										false, -1);
+		PG_RETURN_VOID();
+	}
+
+	filter_a = bloom_get_filter(col_a);
+	bits_a = (uint8 *) VARDATA(filter_a);
+	bits_b = (uint8 *) VARDATA(filter_b);
+
+	for (i = 0; i < BLOOM_FILTER_BYTES; i++)
+		bits_a[i] |= bits_b[i];
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * Hash a value of the indexed type, using the type's default hash opclass
+ * support function.  The function is looked up on first use and cached in
+ * the opaque struct.
+ */
+static uint32
+bloom_hash_value(BrinDesc *bdesc, uint16 attno, Oid colloid, Datum value)
+{
+	BloomOpaque *opaque;
+
+	opaque = (BloomOpaque *) bdesc->bd_info[attno - 1]->oi_opaque;
+
+	if (!opaque->hash_proc_set)
+	{
+		Form_pg_attribute attr = bdesc->bd_tupdesc->attrs[attno - 1];
+		TypeCacheEntry *typentry;
+
+		typentry = lookup_type_cache(attr->atttypid,
+									 TYPECACHE_HASH_PROC_FINFO);
+		if (!OidIsValid(typentry->hash_proc_finfo.fn_oid))
+			ereport(ERROR,
+					(errcode(ERRCODE_UNDEFINED_FUNCTION),
+					 errmsg("could not identify a hash function for type %s",
+							format_type_be(attr->atttypid))));
+
+		fmgr_info_copy(&opaque->hash_proc, &typentry->hash_proc_finfo,
+					   bdesc->bd_context);
+		opaque->hash_proc_set = true;
+	}
+
+	return DatumGetUInt32(FunctionCall1Coll(&opaque->hash_proc, colloid,
+											value));
+}
+
+/*
+ * Return the stored filter of a column, detoasted.  If detoasting made a
+ * copy, install the copy so that updates are not lost.
+ */
+static bytea *
+bloom_get_filter(BrinValues *column)
+{
+	bytea	   *filter;
+
+	filter = (bytea *) PG_DETOAST_DATUM(column->bv_values[0]);
+	if ((Pointer) filter != DatumGetPointer(column->bv_values[0]))
+		column->bv_values[0] = PointerGetDatum(filter);
+
+	if (VARSIZE(filter) != VARHDRSZ + BLOOM_FILTER_BYTES)
+		elog(ERROR, "invalid bloom filter size: %zu",
+			 (Size) (VARSIZE(filter) - VARHDRSZ));
+
+	return filter;
+}
@@ -1000,6 +1000,28 @@ slot_deform_tuple(TupleTableSlot *slot, int natts)
 
 	tp = (char *) tup + tup->t_hoff;
 
+	/*
+	 * Fast path for the leading run of fixed-width NOT NULL attributes: their
+	 * offsets are tuple-independent, so we can fetch them at precomputed
+	 * attcacheoff positions without testing the null bitmap or redoing the
+	 * alignment arithmetic.  NOT NULL guarantees their bitmap bits are set
+	 * even when later attributes make the tuple HEAP_HASNULL.
+	 */
+	if (attnum < TupleDescFixedPrefix(tupleDesc))
+	{
+		int			nfixed = Min(TupleDescFixedPrefix(tupleDesc), natts);
+
+		for (; attnum < nfixed; attnum++)
+		{
+			Form_pg_attribute thisatt = att[attnum];
+
+			values[attnum] = fetchatt(thisatt, tp + thisatt->attcacheoff);
+			isnull[attnum] = false;
+			off = thisatt->attcacheoff + thisatt->attlen;
+		}
+		slow = false;
+	}
+
 	for (; attnum < natts; attnum++)
 	{
 		Form_pg_attribute thisatt = att[attnum];
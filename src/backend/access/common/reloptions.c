@@ -237,6 +237,15 @@ static relopt_int intRelOpts[] =
 		},
 		-1, -1, INT_MAX
 	},
+	{
+		{
+			"prealloc_blocks",
+			"Number of blocks of file space to reserve ahead when the table grows",
+			RELOPT_KIND_HEAP | RELOPT_KIND_TOAST,
+			ShareUpdateExclusiveLock
+		},
+		0, 0, RELSEG_SIZE
+	},
 	{
 		{
 			"pages_per_range",
@@ -1291,7 +1300,9 @@ default_reloptions(Datum reloptions, bool validate, relopt_kind kind)
 		{"autovacuum_analyze_scale_factor", RELOPT_TYPE_REAL,
 		offsetof(StdRdOptions, autovacuum) +offsetof(AutoVacOpts, analyze_scale_factor)},
 		{"user_catalog_table", RELOPT_TYPE_BOOL,
-		offsetof(StdRdOptions, user_catalog_table)}
+		offsetof(StdRdOptions, user_catalog_table)},
+		{"prealloc_blocks", RELOPT_TYPE_INT,
+		offsetof(StdRdOptions, prealloc_blocks)}
 	};
 
 	options = parseRelOptions(reloptions, validate, kind, &numoptions);
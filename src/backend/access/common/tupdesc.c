@@ -92,6 +92,7 @@ CreateTemplateTupleDesc(int natts, bool hasoid)
 	desc->tdtypmod = -1;
 	desc->tdhasoid = hasoid;
 	desc->tdrefcount = -1;		/* assume not reference-counted */
+	desc->tdnfixed = -1;		/* not computed yet */
 
 	return desc;
 }
@@ -125,6 +126,7 @@ CreateTupleDesc(int natts, bool hasoid, Form_pg_attribute *attrs)
 	desc->tdtypmod = -1;
 	desc->tdhasoid = hasoid;
 	desc->tdrefcount = -1;		/* assume not reference-counted */
+	desc->tdnfixed = -1;		/* not computed yet */
 
 	return desc;
 }
@@ -473,6 +475,48 @@ equalTupleDescs(TupleDesc tupdesc1, TupleDesc tupdesc2)
 	return true;
 }
 
+/*
+ * TupleDescFixedPrefix
+ *		Return the number of leading attributes that can be deformed at
+ *		precomputed fixed offsets, without consulting the null bitmap or
+ *		applying the alignment rules per tuple.
+ *
+ * An attribute qualifies if it and all attributes before it are fixed-width,
+ * not dropped and declared NOT NULL: then its offset within the tuple data is
+ * the same in every tuple and nothing before it can set the slow flag.  As a
+ * side effect we fill in attcacheoff for the whole prefix, exactly as the
+ * generic deforming loop would on its first tuple.
+ *
+ * The result is computed once and cached in the descriptor, so for relation
+ * descriptors it persists in the relcache alongside them.  Transient
+ * descriptors built by the executor carry no NOT NULL knowledge and get a
+ * prefix of zero, which simply means the generic path is always used.
+ */
+int
+TupleDescFixedPrefix(TupleDesc tupdesc)
+{
+	int			nfixed;
+	int32		off = 0;
+
+	if (tupdesc->tdnfixed >= 0)
+		return tupdesc->tdnfixed;
+
+	for (nfixed = 0; nfixed < tupdesc->natts; nfixed++)
+	{
+		Form_pg_attribute thisatt = tupdesc->attrs[nfixed];
+
+		if (thisatt->attisdropped || !thisatt->attnotnull ||
+			thisatt->attlen <= 0)
+			break;
+		off = att_align_nominal(off, thisatt->attalign);
+		thisatt->attcacheoff = off;
+		off += thisatt->attlen;
+	}
+	tupdesc->tdnfixed = nfixed;
+
+	return nfixed;
+}
+
 /*
  * TupleDescInitEntry
  *		This function initializes a single attribute structure in
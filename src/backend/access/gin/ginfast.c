@@ -24,6 +24,7 @@
 #include "commands/vacuum.h"
 #include "catalog/pg_am.h"
 #include "miscadmin.h"
+#include "postmaster/autovacuum.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/acl.h"
@@ -227,6 +228,7 @@ ginHeapTupleFastInsert(GinState *ginstate, GinTupleCollector *collector)
 	bool		separateList = false;
 	bool		needCleanup = false;
 	int			cleanupSize;
+	BlockNumber pendingPages = 0;
 	bool		needWal;
 
 	if (collector->ntuples == 0)
@@ -430,14 +432,34 @@ ginHeapTupleFastInsert(GinState *ginstate, GinTupleCollector *collector)
 	 */
 	cleanupSize = GinGetPendingListCleanupSize(index);
 	if (metadata->nPendingPages * GIN_PAGE_FREESIZE > cleanupSize * 1024L)
+	{
 		needCleanup = true;
+		pendingPages = metadata->nPendingPages;
+	}
 
 	UnlockReleaseBuffer(metabuffer);
 
 	END_CRIT_SECTION();
 
+	/*
+	 * Prefer to hand the cleanup off to an autovacuum worker rather than
+	 * performing it here: it can take a long time, and doing it in the
+	 * inserting backend turns an occasional background chore into a latency
+	 * spike for whichever insert happens to trip the threshold.  Autovacuum
+	 * work items can be delayed or lost, though, so if the pending list has
+	 * already grown well past the limit, or the request cannot be recorded,
+	 * clean it up ourselves so the list cannot grow without bound.  Indexes
+	 * in backend-local buffers are invisible to autovacuum workers and are
+	 * always cleaned up here.
+	 */
 	if (needCleanup)
-		ginInsertCleanup(ginstate, true, NULL);
+	{
+		if (RelationUsesLocalBuffers(index) ||
+			pendingPages * GIN_PAGE_FREESIZE > 2 * cleanupSize * 1024L ||
+			!AutoVacuumRequestWork(AVW_GinCleanPendingList,
+								   RelationGetRelid(index)))
+			ginInsertCleanup(ginstate, true, NULL);
+	}
 }
 
 /*
@@ -571,6 +571,59 @@ startScan(IndexScanDesc scan)
 		startScanKey(ginstate, so, so->keys + i);
 }
 
+/*
+ * Find, in the sorted array items[offset .. nitems - 1], the index of the
+ * first item > advancePast; returns nitems if there is none.
+ *
+ * When one entry stream is much denser than the others (a frequent lexeme
+ * ANDed with a rare one, say), the merge loops in this file may have to skip
+ * over long runs of non-matching items.  Rather than stepping one item at a
+ * time, we gallop: probe at doubling distances until we overshoot, then
+ * binary-search the bracketed range.  The cost is logarithmic in the
+ * distance skipped, while a skip to the immediately next item is still just
+ * one comparison.
+ */
+static int
+entryIndexPast(ItemPointerData *items, int offset, int nitems,
+			   ItemPointer advancePast)
+{
+	int			lo,
+				hi,
+				step;
+
+	/* the common case: the very next item is already past advancePast */
+	if (offset >= nitems ||
+		ginCompareItemPointers(&items[offset], advancePast) > 0)
+		return offset;
+
+	/* gallop forward; invariant: items[lo] <= advancePast */
+	lo = offset;
+	step = 1;
+	hi = offset + step;
+	while (hi < nitems &&
+		   ginCompareItemPointers(&items[hi], advancePast) <= 0)
+	{
+		lo = hi;
+		step *= 2;
+		hi = offset + step;
+	}
+	if (hi > nitems)
+		hi = nitems;
+
+	/* binary search; items[lo] <= advancePast < items[hi] (if hi in range) */
+	while (lo + 1 < hi)
+	{
+		int			mid = lo + (hi - lo) / 2;
+
+		if (ginCompareItemPointers(&items[mid], advancePast) <= 0)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return hi;
+}
+
 /*
  * Load the next batch of item pointers from a posting tree.
  *
@@ -694,22 +747,20 @@ entryLoadMoreItems(GinState *ginstate, GinScanEntry entry, ItemPointerData advan
 
 		entry->list = GinDataLeafPageGetItems(page, &entry->nlist, advancePast);
 
-		for (i = 0; i < entry->nlist; i++)
+		i = entryIndexPast(entry->list, 0, entry->nlist, &advancePast);
+		if (i < entry->nlist)
 		{
-			if (ginCompareItemPointers(&advancePast, &entry->list[i]) < 0)
-			{
-				entry->offset = i;
+			entry->offset = i;
 
-				if (GinPageRightMost(page))
-				{
-					/* after processing the copied items, we're done. */
-					UnlockReleaseBuffer(entry->buffer);
-					entry->buffer = InvalidBuffer;
-				}
-				else
-					LockBuffer(entry->buffer, GIN_UNLOCK);
-				return;
+			if (GinPageRightMost(page))
+			{
+				/* after processing the copied items, we're done. */
+				UnlockReleaseBuffer(entry->buffer);
+				entry->buffer = InvalidBuffer;
 			}
+			else
+				LockBuffer(entry->buffer, GIN_UNLOCK);
+			return;
 		}
 	}
 }
@@ -834,17 +885,15 @@ entryGetItem(GinState *ginstate, GinScanEntry entry,
 		 * A posting list from an entry tuple, or the last page of a posting
 		 * tree.
 		 */
-		do
+		entry->offset = entryIndexPast(entry->list, entry->offset,
+									   entry->nlist, &advancePast);
+		if (entry->offset >= entry->nlist)
 		{
-			if (entry->offset >= entry->nlist)
-			{
-				ItemPointerSetInvalid(&entry->curItem);
-				entry->isFinished = TRUE;
-				break;
-			}
-
+			ItemPointerSetInvalid(&entry->curItem);
+			entry->isFinished = TRUE;
+		}
+		else
 			entry->curItem = entry->list[entry->offset++];
-		} while (ginCompareItemPointers(&entry->curItem, &advancePast) <= 0);
 		/* XXX: shouldn't we apply the fuzzy search limit here? */
 	}
 	else
@@ -852,9 +901,19 @@ entryGetItem(GinState *ginstate, GinScanEntry entry,
 		/* A posting tree */
 		do
 		{
-			/* If we've processed the current batch, load more items */
-			while (entry->offset >= entry->nlist)
+			/*
+			 * Skip to the first item > advancePast, loading more batches as
+			 * needed.  After a successful entryLoadMoreItems, entry->offset
+			 * already points at such an item, so the skip finds it with a
+			 * single comparison.
+			 */
+			for (;;)
 			{
+				entry->offset = entryIndexPast(entry->list, entry->offset,
+											   entry->nlist, &advancePast);
+				if (entry->offset < entry->nlist)
+					break;
+
 				entryLoadMoreItems(ginstate, entry, advancePast);
 
 				if (entry->isFinished)
@@ -866,8 +925,7 @@ entryGetItem(GinState *ginstate, GinScanEntry entry,
 
 			entry->curItem = entry->list[entry->offset++];
 
-		} while (ginCompareItemPointers(&entry->curItem, &advancePast) <= 0 ||
-				 (entry->reduceResult == TRUE && dropItem(entry)));
+		} while (entry->reduceResult == TRUE && dropItem(entry));
 	}
 }
 
@@ -77,6 +77,15 @@
 /* GUC variable */
 bool		synchronize_seqscans = true;
 
+/*
+ * When set, heap_update places the new tuple version through the normal
+ * FSM/extension path even when it would fit on the old tuple's page, so
+ * the update relocates the row instead of doing a same-page (possibly HOT)
+ * update.  Incremental clustering sets this around its updates to migrate
+ * tuples toward index order; see pg_incremental_cluster() in cluster.c.
+ */
+bool		heap_relocate_update = false;
+
 
 static HeapScanDesc heap_beginscan_internal(Relation relation,
 						Snapshot snapshot,
@@ -299,6 +308,8 @@ initscan(HeapScanDesc scan, ScanKey key, bool keep_startblock)
 	ItemPointerSetInvalid(&scan->rs_ctup.t_self);
 	scan->rs_cbuf = InvalidBuffer;
 	scan->rs_cblock = InvalidBlockNumber;
+	scan->rs_prefetch_block = InvalidBlockNumber;
+	scan->rs_prefetch_target = 0;
 
 	/* page-at-a-time fields are always invalid when not rs_inited */
 
@@ -336,6 +347,46 @@ heap_setscanlimits(HeapScanDesc scan, BlockNumber startBlk, BlockNumber numBlks)
 	scan->rs_numblocks = numBlks;
 }
 
+#ifdef USE_PREFETCH
+/*
+ * heapgetpage_readahead - issue prefetch advice ahead of a forward seqscan
+ *
+ * OS readahead alone doesn't keep modern storage busy, so ask the kernel for
+ * upcoming blocks explicitly.  As in nodeBitmapHeapscan.c, the readahead
+ * distance ramps up gradually to target_prefetch_pages so that scans which
+ * stop after a few pages don't pay for advice they never use; a scan that
+ * keeps consuming pages quickly reaches the full distance.
+ *
+ * Must be called before rs_cblock is advanced to the new page.  Backward
+ * scans, rewinds and syncscan wraparounds just re-arm the window: advice is
+ * only issued once the scan has proven to be moving forward contiguously.
+ */
+static void
+heapgetpage_readahead(HeapScanDesc scan, BlockNumber page)
+{
+	if (scan->rs_cblock == InvalidBlockNumber ||
+		page != scan->rs_cblock + 1)
+	{
+		scan->rs_prefetch_block = page + 1;
+		scan->rs_prefetch_target = 0;
+		return;
+	}
+
+	if (scan->rs_prefetch_target == 0)
+		scan->rs_prefetch_target = 1;
+	else if (scan->rs_prefetch_target < target_prefetch_pages)
+		scan->rs_prefetch_target = Min(target_prefetch_pages,
+									   scan->rs_prefetch_target * 2);
+
+	while (scan->rs_prefetch_block < scan->rs_nblocks &&
+		   scan->rs_prefetch_block - page <= scan->rs_prefetch_target)
+	{
+		PrefetchBuffer(scan->rs_rd, MAIN_FORKNUM, scan->rs_prefetch_block);
+		scan->rs_prefetch_block++;
+	}
+}
+#endif   /* USE_PREFETCH */
+
 /*
  * heapgetpage - subroutine for heapgettup()
  *
@@ -371,6 +422,17 @@ heapgetpage(HeapScanDesc scan, BlockNumber page)
 	 */
 	CHECK_FOR_INTERRUPTS();
 
+#ifdef USE_PREFETCH
+
+	/*
+	 * Issue readahead advice for the blocks beyond this one before we block
+	 * on reading it.  Parallel scans hand out blocks to workers one at a
+	 * time, so there a worker doesn't know which blocks it will get next.
+	 */
+	if (target_prefetch_pages > 0 && scan->rs_parallel == NULL)
+		heapgetpage_readahead(scan, page);
+#endif   /* USE_PREFETCH */
+
 	/* read page using selected strategy */
 	scan->rs_cbuf = ReadBufferExtended(scan->rs_rd, MAIN_FORKNUM, page,
 									   RBM_NORMAL, scan->rs_strategy);
@@ -420,6 +482,38 @@ heapgetpage(HeapScanDesc scan, BlockNumber page)
 	 */
 	all_visible = PageIsAllVisible(dp) && !snapshot->takenDuringRecovery;
 
+	/*
+	 * When we do have to test every tuple, collect the unhinted xids the
+	 * visibility checks will probe and resolve their statuses with one bulk
+	 * clog call, rather than paying a separate clog lookup per tuple.
+	 */
+	if (!all_visible)
+	{
+		TransactionId prefetch[MaxHeapTuplesPerPage * 2];
+		int			nprefetch = 0;
+
+		for (lineoff = FirstOffsetNumber, lpp = PageGetItemId(dp, lineoff);
+			 lineoff <= lines;
+			 lineoff++, lpp++)
+		{
+			HeapTupleHeader htup;
+
+			if (!ItemIdIsNormal(lpp))
+				continue;
+			htup = (HeapTupleHeader) PageGetItem((Page) dp, lpp);
+
+			if (!HeapTupleHeaderXminCommitted(htup) &&
+				!HeapTupleHeaderXminInvalid(htup))
+				prefetch[nprefetch++] = HeapTupleHeaderGetXmin(htup);
+
+			if (!(htup->t_infomask & (HEAP_XMAX_INVALID | HEAP_XMAX_COMMITTED |
+									  HEAP_XMAX_IS_MULTI)))
+				prefetch[nprefetch++] = HeapTupleHeaderGetRawXmax(htup);
+		}
+		if (nprefetch > 0)
+			TransactionIdPrefetchStatus(nprefetch, prefetch);
+	}
+
 	for (lineoff = FirstOffsetNumber, lpp = PageGetItemId(dp, lineoff);
 		 lineoff <= lines;
 		 lineoff++, lpp++)
@@ -3921,7 +4015,7 @@ l2:
 
 	newtupsize = MAXALIGN(newtup->t_len);
 
-	if (need_toast || newtupsize > pagefree)
+	if (need_toast || newtupsize > pagefree || heap_relocate_update)
 	{
 		/* Clear obsolete visibility flags ... */
 		oldtup.t_data->t_infomask &= ~(HEAP_XMAX_BITS | HEAP_MOVED);
@@ -3971,7 +4065,7 @@ l2:
 		 * while not holding the lock on the old page, and we must rely on it
 		 * to get the locks on both pages in the correct order.
 		 */
-		if (newtupsize > pagefree)
+		if (newtupsize > pagefree || heap_relocate_update)
 		{
 			/* Assume there's no chance to put heaptup on same page. */
 			newbuf = RelationGetBufferForTuple(relation, heaptup->t_len,
@@ -18,6 +18,7 @@
 #include "access/heapam_xlog.h"
 #include "access/transam.h"
 #include "access/htup_details.h"
+#include "access/xact.h"
 #include "access/xlog.h"
 #include "catalog/catalog.h"
 #include "miscadmin.h"
@@ -25,8 +26,20 @@
 #include "storage/bufmgr.h"
 #include "utils/snapmgr.h"
 #include "utils/rel.h"
+#include "utils/timestamp.h"
 #include "utils/tqual.h"
 
+/*
+ * Maximum number of heap pages one statement may opportunistically prune,
+ * or zero for no limit.  Pages left unpruned keep their prune hint, so a
+ * later statement or vacuum picks them up.
+ */
+int			opportunistic_prune_limit = 0;
+
+/* pages pruned so far by the statement identified by the timestamp */
+static int	pruned_page_count = 0;
+static TimestampTz prune_budget_stmt_start = 0;
+
 /* Working data for heap_page_prune and subroutines */
 typedef struct
 {
@@ -128,6 +141,27 @@ heap_page_prune_opt(Relation relation, Buffer buffer)
 
 	if (PageIsFull(page) || PageGetHeapFreeSpace(page) < minfree)
 	{
+		/*
+		 * Enforce the per-statement prune budget, if one is configured.  A
+		 * scan crossing a run of heavily-updated pages otherwise spends its
+		 * time pruning on behalf of everybody else, which shows up as
+		 * latency spikes on plain reads.  Skipping is safe: the page keeps
+		 * its prune hint, so a later statement or vacuum will deal with it.
+		 */
+		if (opportunistic_prune_limit > 0)
+		{
+			TimestampTz stmt_start = GetCurrentStatementStartTimestamp();
+
+			if (stmt_start != prune_budget_stmt_start)
+			{
+				prune_budget_stmt_start = stmt_start;
+				pruned_page_count = 0;
+			}
+
+			if (pruned_page_count >= opportunistic_prune_limit)
+				return;
+		}
+
 		/* OK, try to get exclusive buffer lock */
 		if (!ConditionalLockBufferForCleanup(buffer))
 			return;
@@ -145,6 +179,8 @@ heap_page_prune_opt(Relation relation, Buffer buffer)
 
 			/* OK to prune */
 			(void) heap_page_prune(relation, buffer, OldestXmin, true, &ignore);
+
+			pruned_page_count++;
 		}
 
 		/* And release buffer lock */
@@ -178,6 +214,8 @@ heap_page_prune(Relation relation, Buffer buffer, TransactionId OldestXmin,
 	OffsetNumber offnum,
 				maxoff;
 	PruneState	prstate;
+	TransactionId prefetch[MaxHeapTuplesPerPage * 2];
+	int			nprefetch = 0;
 
 	/*
 	 * Our strategy is to scan the page and make lists of items to change,
@@ -195,8 +233,37 @@ heap_page_prune(Relation relation, Buffer buffer, TransactionId OldestXmin,
 	prstate.nredirected = prstate.ndead = prstate.nunused = 0;
 	memset(prstate.marked, 0, sizeof(prstate.marked));
 
-	/* Scan the page */
+	/*
+	 * Collect the xids the visibility checks below are likely to probe, and
+	 * resolve their statuses with one bulk clog call.  A single page can
+	 * yield dozens of distinct unhinted xids, and looking them up one at a
+	 * time pays the full clog lookup cost (or, with a nondefault transaction
+	 * manager, possibly a network round trip) per xid.
+	 */
 	maxoff = PageGetMaxOffsetNumber(page);
+	for (offnum = FirstOffsetNumber;
+		 offnum <= maxoff;
+		 offnum = OffsetNumberNext(offnum))
+	{
+		ItemId		itemid = PageGetItemId(page, offnum);
+		HeapTupleHeader htup;
+
+		if (!ItemIdIsNormal(itemid))
+			continue;
+		htup = (HeapTupleHeader) PageGetItem(page, itemid);
+
+		if (!HeapTupleHeaderXminCommitted(htup) &&
+			!HeapTupleHeaderXminInvalid(htup))
+			prefetch[nprefetch++] = HeapTupleHeaderGetXmin(htup);
+
+		if (!(htup->t_infomask & (HEAP_XMAX_INVALID | HEAP_XMAX_COMMITTED |
+								  HEAP_XMAX_IS_MULTI)))
+			prefetch[nprefetch++] = HeapTupleHeaderGetRawXmax(htup);
+	}
+	if (nprefetch > 0)
+		TransactionIdPrefetchStatus(nprefetch, prefetch);
+
+	/* Scan the page */
 	for (offnum = FirstOffsetNumber;
 		 offnum <= maxoff;
 		 offnum = OffsetNumberNext(offnum))
@@ -37,8 +37,10 @@
 #include "catalog/catalog.h"
 #include "common/pg_lzcompress.h"
 #include "miscadmin.h"
+#include "storage/proc.h"
 #include "utils/expandeddatum.h"
 #include "utils/fmgroids.h"
+#include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/typcache.h"
 #include "utils/tqual.h"
@@ -245,6 +247,230 @@ heap_tuple_untoast_attr(struct varlena * attr)
 }
 
 
+/*
+ * Small cache of recently untoasted external values, for
+ * heap_tuple_untoast_attr_cached().  A toast value is immutable and is
+ * uniquely identified by its toast relation and value OID; entries are
+ * additionally stamped with the local transaction id, so a value OID
+ * reused after vacuum in some later transaction can never match a stale
+ * entry.  Kept in rough LRU order; slot 0 is the most recently used.
+ */
+typedef struct UntoastCacheEntry
+{
+	Oid			toastrelid;
+	Oid			valueid;
+	LocalTransactionId lxid;
+	struct varlena *value;		/* allocated in UntoastCacheContext */
+} UntoastCacheEntry;
+
+#define UNTOAST_CACHE_ENTRIES	8
+#define UNTOAST_CACHE_MAX_SIZE	(1024 * 1024)
+
+static UntoastCacheEntry untoast_cache[UNTOAST_CACHE_ENTRIES];
+static MemoryContext UntoastCacheContext = NULL;
+
+/*
+ * Ring of toast pointers we have detoasted once but not cached yet.  The
+ * generic path (heap_tuple_untoast_attr_memo) copies a value into the cache
+ * only when it comes around for the second time, so that single-pass scans
+ * over wide columns don't pay for copying values that will never be
+ * requested again.
+ */
+typedef struct UntoastSeenEntry
+{
+	Oid			toastrelid;
+	Oid			valueid;
+	LocalTransactionId lxid;
+} UntoastSeenEntry;
+
+#define UNTOAST_SEEN_ENTRIES	16
+
+static UntoastSeenEntry untoast_seen[UNTOAST_SEEN_ENTRIES];
+static int	untoast_seen_next = 0;
+
+/*
+ * Look up a toast pointer in the cache.  On a hit, move the entry to the
+ * front and return its (cache-owned) value; else return NULL.
+ */
+static struct varlena *
+untoast_cache_lookup(struct varatt_external * toast_pointer,
+					 LocalTransactionId lxid)
+{
+	UntoastCacheEntry tmp;
+	int			i;
+
+	for (i = 0; i < UNTOAST_CACHE_ENTRIES; i++)
+	{
+		if (untoast_cache[i].value != NULL &&
+			untoast_cache[i].valueid == toast_pointer->va_valueid &&
+			untoast_cache[i].toastrelid == toast_pointer->va_toastrelid &&
+			untoast_cache[i].lxid == lxid)
+		{
+			/* found it; move to front */
+			tmp = untoast_cache[i];
+			memmove(&untoast_cache[1], &untoast_cache[0],
+					i * sizeof(UntoastCacheEntry));
+			untoast_cache[0] = tmp;
+			return tmp.value;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Insert a copy of the given detoasted value at the front of the cache,
+ * evicting the least recently used entry.  The caller has checked the
+ * value against UNTOAST_CACHE_MAX_SIZE.
+ */
+static void
+untoast_cache_insert(struct varatt_external * toast_pointer,
+					 LocalTransactionId lxid,
+					 struct varlena * value)
+{
+	int			i;
+
+	if (UntoastCacheContext == NULL)
+		UntoastCacheContext = AllocSetContextCreate(CacheMemoryContext,
+													"untoasted value cache",
+													ALLOCSET_DEFAULT_MINSIZE,
+													ALLOCSET_DEFAULT_INITSIZE,
+													ALLOCSET_DEFAULT_MAXSIZE);
+
+	i = UNTOAST_CACHE_ENTRIES - 1;
+	if (untoast_cache[i].value != NULL)
+		pfree(untoast_cache[i].value);
+	memmove(&untoast_cache[1], &untoast_cache[0],
+			i * sizeof(UntoastCacheEntry));
+	untoast_cache[0].toastrelid = toast_pointer->va_toastrelid;
+	untoast_cache[0].valueid = toast_pointer->va_valueid;
+	untoast_cache[0].lxid = lxid;
+	untoast_cache[0].value = (struct varlena *)
+		MemoryContextAlloc(UntoastCacheContext, VARSIZE(value));
+	memcpy(untoast_cache[0].value, value, VARSIZE(value));
+}
+
+/*
+ * Record that we detoasted the given toast pointer without caching it, or
+ * report that a previous call already recorded it.  Used to defer caching
+ * until a value is provably requested more than once.
+ */
+static bool
+untoast_seen_recently(struct varatt_external * toast_pointer,
+					  LocalTransactionId lxid)
+{
+	int			i;
+
+	for (i = 0; i < UNTOAST_SEEN_ENTRIES; i++)
+	{
+		if (untoast_seen[i].valueid == toast_pointer->va_valueid &&
+			untoast_seen[i].toastrelid == toast_pointer->va_toastrelid &&
+			untoast_seen[i].lxid == lxid)
+			return true;
+	}
+
+	untoast_seen[untoast_seen_next].toastrelid = toast_pointer->va_toastrelid;
+	untoast_seen[untoast_seen_next].valueid = toast_pointer->va_valueid;
+	untoast_seen[untoast_seen_next].lxid = lxid;
+	untoast_seen_next = (untoast_seen_next + 1) % UNTOAST_SEEN_ENTRIES;
+
+	return false;
+}
+
+/* ----------
+ * heap_tuple_untoast_attr_cached -
+ *
+ *	Like heap_tuple_untoast_attr, but remembers the last few externally
+ *	stored values it has detoasted and serves repeated requests for the
+ *	same value from memory.  This is meant for functions like the hstore
+ *	and jsonb field getters: extracting several keys from one wide column
+ *	evaluates one getter expression per key, each of which would otherwise
+ *	fetch and decompress the same toast value again.
+ *
+ *	On a cache hit the returned pointer is owned by the cache: the caller
+ *	must treat it as read-only, must not pfree it, and must not use it
+ *	after the next call of this function.  Values that are not stored
+ *	external on disk, exceed UNTOAST_CACHE_MAX_SIZE, or are detoasted
+ *	outside any transaction are simply passed to heap_tuple_untoast_attr.
+ * ----------
+ */
+struct varlena *
+heap_tuple_untoast_attr_cached(struct varlena * attr)
+{
+	struct varatt_external toast_pointer;
+	LocalTransactionId lxid;
+	struct varlena *cached;
+	struct varlena *result;
+
+	if (!VARATT_IS_EXTERNAL_ONDISK(attr) ||
+		MyProc == NULL ||
+		MyProc->lxid == InvalidLocalTransactionId)
+		return heap_tuple_untoast_attr(attr);
+
+	lxid = MyProc->lxid;
+	VARATT_EXTERNAL_GET_POINTER(toast_pointer, attr);
+
+	cached = untoast_cache_lookup(&toast_pointer, lxid);
+	if (cached != NULL)
+		return cached;
+
+	result = heap_tuple_untoast_attr(attr);
+
+	if (VARSIZE(result) <= UNTOAST_CACHE_MAX_SIZE)
+		untoast_cache_insert(&toast_pointer, lxid, result);
+
+	return result;
+}
+
+/* ----------
+ * heap_tuple_untoast_attr_memo -
+ *
+ *	Caching detoast for callers with ordinary palloc'd-result semantics.
+ *	On a cache hit the value is copied into the current memory context, so
+ *	the result is always the caller's to modify and pfree, exactly as with
+ *	heap_tuple_untoast_attr; the fetch and decompression are still saved.
+ *
+ *	Unlike heap_tuple_untoast_attr_cached, whose call sites know they are
+ *	on a repeated-access pattern, this is reached from the generic detoast
+ *	path, where most values are detoasted exactly once.  To keep that case
+ *	free of copying overhead, a value is added to the cache only the second
+ *	time it is detoasted (tracked via the untoast_seen ring).
+ * ----------
+ */
+struct varlena *
+heap_tuple_untoast_attr_memo(struct varlena * attr)
+{
+	struct varatt_external toast_pointer;
+	LocalTransactionId lxid;
+	struct varlena *cached;
+	struct varlena *result;
+
+	if (!VARATT_IS_EXTERNAL_ONDISK(attr) ||
+		MyProc == NULL ||
+		MyProc->lxid == InvalidLocalTransactionId)
+		return heap_tuple_untoast_attr(attr);
+
+	lxid = MyProc->lxid;
+	VARATT_EXTERNAL_GET_POINTER(toast_pointer, attr);
+
+	cached = untoast_cache_lookup(&toast_pointer, lxid);
+	if (cached != NULL)
+	{
+		result = (struct varlena *) palloc(VARSIZE(cached));
+		memcpy(result, cached, VARSIZE(cached));
+		return result;
+	}
+
+	result = heap_tuple_untoast_attr(attr);
+
+	if (VARSIZE(result) <= UNTOAST_CACHE_MAX_SIZE &&
+		untoast_seen_recently(&toast_pointer, lxid))
+		untoast_cache_insert(&toast_pointer, lxid, result);
+
+	return result;
+}
+
+
 /* ----------
  * heap_tuple_untoast_attr_slice -
  *
@@ -68,9 +68,11 @@
 #include "access/amapi.h"
 #include "access/relscan.h"
 #include "access/transam.h"
+#include "access/visibilitymap.h"
 #include "access/xlog.h"
 #include "catalog/catalog.h"
 #include "catalog/index.h"
+#include "miscadmin.h"
 #include "pgstat.h"
 #include "storage/bufmgr.h"
 #include "storage/lmgr.h"
@@ -570,6 +572,87 @@ index_getnext(IndexScanDesc scan, ScanDirection direction)
 	return NULL;				/* failure exit */
 }
 
+/* ----------------
+ *		index_count - count all remaining visible entries of an index scan
+ *
+ * Equivalent to fetching every remaining entry of the scan and resolving
+ * its visibility the way an index-only scan does (skipping the heap when
+ * the page is all-visible), but without materializing any tuples.  This
+ * lets COUNT()-style aggregation over an index-only range skip all
+ * per-tuple executor overhead.  As with index-only scans, only MVCC
+ * snapshots are supported.
+ *
+ * Returns the number of visible entries, or -1 if the index reported a
+ * lossy match (xs_recheck set), in which case only the executor can verify
+ * the quals; the scan position is then indeterminate and the caller must
+ * rescan before using the scan any further.
+ * ----------------
+ */
+int64
+index_count(IndexScanDesc scan)
+{
+	int64		ntuples = 0;
+	ItemPointer tid;
+	Buffer		vmbuffer = InvalidBuffer;
+
+	while ((tid = index_getnext_tid(scan, ForwardScanDirection)) != NULL)
+	{
+		bool		heap_checked = false;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (scan->xs_recheck)
+		{
+			if (BufferIsValid(vmbuffer))
+				ReleaseBuffer(vmbuffer);
+			return -1;
+		}
+
+		/*
+		 * We can skip the heap fetch when the TID references a heap page on
+		 * which all tuples are known visible to everybody.  See
+		 * IndexOnlyNext for why reading the visibility map without locking
+		 * its buffer is safe here.
+		 */
+		if (!visibilitymap_test(scan->heapRelation,
+								ItemPointerGetBlockNumber(tid),
+								&vmbuffer))
+		{
+			if (index_fetch_heap(scan) == NULL)
+				continue;		/* no visible tuple, try next index entry */
+
+			/*
+			 * Only MVCC snapshots are supported here, so there should be no
+			 * need to keep following the HOT chain once a visible entry has
+			 * been found.
+			 */
+			if (scan->xs_continue_hot)
+				elog(ERROR, "non-MVCC snapshots are not supported in index-only scans");
+			heap_checked = true;
+		}
+
+		/*
+		 * Predicate locks must be acquired at page level when the heap is
+		 * not accessed, since tuple-level predicate locks need the tuple's
+		 * xmin value.  If we visited the tuple, we already have the
+		 * tuple-level lock.
+		 */
+		if (!heap_checked)
+			PredicateLockPage(scan->heapRelation,
+							  ItemPointerGetBlockNumber(tid),
+							  scan->xs_snapshot);
+
+		ntuples++;
+	}
+
+	if (BufferIsValid(vmbuffer))
+		ReleaseBuffer(vmbuffer);
+
+	pgstat_count_index_tuples(scan->indexRelation, ntuples);
+
+	return ntuples;
+}
+
 /* ----------------
  *		index_getbitmap - get all tuples at once from an index scan
  *
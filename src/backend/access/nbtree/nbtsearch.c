@@ -967,13 +967,56 @@ _bt_first(IndexScanDesc scan, ScanDirection dir)
 	}
 
 	/*
-	 * Use the manufactured insertion scan key to descend the tree and
-	 * position ourselves on the target leaf page.
+	 * If a previous call in this scan descended to a leaf page, check
+	 * whether that page still covers the new scan key before paying for a
+	 * fresh descent from the root.  Nestloop inner indexscans commonly probe
+	 * the same or neighboring keys over and over, re-reading the same upper
+	 * tree pages on every probe; this shortcut skips the descent entirely
+	 * whenever the remembered leaf demonstrably contains the start position.
+	 *
+	 * The validity test mirrors the _bt_moveright/_bt_binsrch invariants:
+	 * the scan key must sort strictly after the page's first data item (so
+	 * the start position cannot lie on an earlier page, even with duplicates
+	 * spanning page boundaries) and before its high key (so it cannot lie on
+	 * a later page).  If the page has been deleted, split into non-leaf, or
+	 * simply no longer covers the key, we fall through to a normal descent.
 	 */
-	stack = _bt_search(rel, keysCount, scankeys, nextkey, &buf, BT_READ);
+	buf = InvalidBuffer;
+	if (BlockNumberIsValid(so->lastStartBlkno))
+	{
+		Buffer		hintbuf;
+		Page		hintpage;
+		BTPageOpaque hintopaque;
+		int			cmpval = nextkey ? 0 : 1;
+
+		hintbuf = _bt_getbuf(rel, so->lastStartBlkno, BT_READ);
+		hintpage = BufferGetPage(hintbuf);
+		hintopaque = (BTPageOpaque) PageGetSpecialPointer(hintpage);
+
+		if (P_ISLEAF(hintopaque) &&
+			!P_IGNORE(hintopaque) &&
+			PageGetMaxOffsetNumber(hintpage) >= P_FIRSTDATAKEY(hintopaque) &&
+			_bt_compare(rel, keysCount, scankeys, hintpage,
+						P_FIRSTDATAKEY(hintopaque)) >= cmpval &&
+			(P_RIGHTMOST(hintopaque) ||
+			 _bt_compare(rel, keysCount, scankeys, hintpage,
+						 P_HIKEY) < cmpval))
+			buf = hintbuf;		/* hint page is the right start page */
+		else
+			_bt_relbuf(rel, hintbuf);
+	}
 
-	/* don't need to keep the stack around... */
-	_bt_freestack(stack);
+	if (!BufferIsValid(buf))
+	{
+		/*
+		 * Use the manufactured insertion scan key to descend the tree and
+		 * position ourselves on the target leaf page.
+		 */
+		stack = _bt_search(rel, keysCount, scankeys, nextkey, &buf, BT_READ);
+
+		/* don't need to keep the stack around... */
+		_bt_freestack(stack);
+	}
 
 	if (!BufferIsValid(buf))
 	{
@@ -988,6 +1031,9 @@ _bt_first(IndexScanDesc scan, ScanDirection dir)
 		PredicateLockPage(rel, BufferGetBlockNumber(buf),
 						  scan->xs_snapshot);
 
+	/* remember the start leaf as a descent shortcut for the next probe */
+	so->lastStartBlkno = BufferGetBlockNumber(buf);
+
 	/* initialize moreLeft/moreRight appropriately for scan direction */
 	if (ScanDirectionIsForward(dir))
 	{
@@ -55,6 +55,16 @@
  * This code isn't concerned about the FSM at all. The caller is responsible
  * for initializing that.
  *
+ * The build is deliberately single-process.  Farming the heap scan and sort
+ * out to background workers, with the leader merging the workers' sorted
+ * partitions in the load phase, would need infrastructure we don't have:
+ * workers' sort temp files are deleted when the worker exits, so the runs
+ * would have to live in a shared temp-file set the leader can adopt, and
+ * tuplesort.c would have to expose its merge step over tapes it didn't
+ * write.  Until then, the sort is bounded by one core (plus
+ * maintenance_work_mem); anyone revisiting this should start with the
+ * temp-file ownership problem, not with the sort itself.
+ *
  * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
  *
@@ -3,15 +3,16 @@
  * slru.c
  *		Simple LRU buffering for transaction status logfiles
  *
- * We use a simple least-recently-used scheme to manage a pool of page
- * buffers.  Under ordinary circumstances we expect that write
- * traffic will occur mostly to the latest page (and to the just-prior
- * page, soon after a page transition).  Read traffic will probably touch
- * a larger span of pages, but in any case a fairly small number of page
+ * We manage a pool of page buffers.  Under ordinary circumstances we expect
+ * that write traffic will occur mostly to the latest page (and to the
+ * just-prior page, soon after a page transition).  Read traffic will probably
+ * touch a larger span of pages, but in any case a fairly small number of page
  * buffers should be sufficient.  So, we just search the buffers using plain
  * linear search; there's no need for a hashtable or anything fancy.
- * The management algorithm is straight LRU except that we will never swap
- * out the latest page (since we know it's going to be hit again eventually).
+ * Page replacement approximates LRU with a clock sweep over per-slot
+ * recently-used flags, so choosing a victim does not require examining every
+ * slot; we will never swap out the latest page (since we know it's going to
+ * be hit again eventually).
  *
  * We use a control LWLock to protect the shared data structures, plus
  * per-buffer LWLocks that synchronize I/O for each buffer.  The control lock
@@ -81,32 +82,27 @@ typedef struct SlruFlushData
 typedef struct SlruFlushData *SlruFlush;
 
 /*
- * Macro to mark a buffer slot "most recently used".  Note multiple evaluation
- * of arguments!
- *
- * The reason for the if-test is that there are often many consecutive
- * accesses to the same page (particularly the latest page).  By suppressing
- * useless increments of cur_lru_count, we reduce the probability that old
- * pages' counts will "wrap around" and make them appear recently used.
+ * Macro to mark a buffer slot "recently used", protecting it from the next
+ * pass of the clock sweep in SlruSelectVictimPage().
  *
  * We allow this code to be executed concurrently by multiple processes within
- * SimpleLruReadPage_ReadOnly().  As long as int reads and writes are atomic,
- * this should not cause any completely-bogus values to enter the computation.
- * However, it is possible for either cur_lru_count or individual
- * page_lru_count entries to be "reset" to lower values than they should have,
- * in case a process is delayed while it executes this macro.  With care in
- * SlruSelectLRUPage(), this does little harm, and in any case the absolute
- * worst possible consequence is a nonoptimal choice of page to evict.  The
- * gain from allowing concurrent reads of SLRU pages seems worth it.
+ * SimpleLruReadPage_ReadOnly(), holding only shared control lock.  Setting a
+ * bool is atomic for our purposes, and the sweep itself runs only with the
+ * control lock held exclusively, so no flag update can be lost while a victim
+ * is being chosen.
  */
 #define SlruRecentlyUsed(shared, slotno)	\
-	do { \
-		int		new_lru_count = (shared)->cur_lru_count; \
-		if (new_lru_count != (shared)->page_lru_count[slotno]) { \
-			(shared)->cur_lru_count = ++new_lru_count; \
-			(shared)->page_lru_count[slotno] = new_lru_count; \
-		} \
-	} while (0)
+	((shared)->page_recently_used[slotno] = true)
+
+/*
+ * All SLRUs created in this cluster, for reporting their usage counters.
+ * The array is filled during shared memory initialization and is inherited
+ * (or, with EXEC_BACKEND, rebuilt) by every backend.
+ */
+#define MAX_SLRU_STATS	16
+
+static SlruShared SlruStatsEntries[MAX_SLRU_STATS];
+static int	SlruStatsNumEntries = 0;
 
 /* Saved info for SlruReportIOError */
 typedef enum
@@ -130,7 +126,7 @@ static bool SlruPhysicalReadPage(SlruCtl ctl, int pageno, int slotno);
 static bool SlruPhysicalWritePage(SlruCtl ctl, int pageno, int slotno,
 					  SlruFlush fdata);
 static void SlruReportIOError(SlruCtl ctl, int pageno, TransactionId xid);
-static int	SlruSelectLRUPage(SlruCtl ctl, int pageno);
+static int	SlruSelectVictimPage(SlruCtl ctl, int pageno);
 
 static bool SlruScanDirCbDeleteCutoff(SlruCtl ctl, char *filename,
 						  int segpage, void *data);
@@ -151,7 +147,7 @@ SimpleLruShmemSize(int nslots, int nlsns)
 	sz += MAXALIGN(nslots * sizeof(SlruPageStatus));	/* page_status[] */
 	sz += MAXALIGN(nslots * sizeof(bool));		/* page_dirty[] */
 	sz += MAXALIGN(nslots * sizeof(int));		/* page_number[] */
-	sz += MAXALIGN(nslots * sizeof(int));		/* page_lru_count[] */
+	sz += MAXALIGN(nslots * sizeof(bool));		/* page_recently_used[] */
 	sz += MAXALIGN(nslots * sizeof(LWLockPadded)); /* buffer_locks[] */
 
 	if (nlsns > 0)
@@ -187,7 +183,9 @@ SimpleLruInit(SlruCtl ctl, const char *name, int nslots, int nlsns,
 		shared->num_slots = nslots;
 		shared->lsn_groups_per_page = nlsns;
 
-		shared->cur_lru_count = 0;
+		shared->next_victim_slot = 0;
+
+		/* usage counters were zeroed by the memset above */
 
 		/* shared->latest_page_number will be set later */
 
@@ -201,8 +199,8 @@ SimpleLruInit(SlruCtl ctl, const char *name, int nslots, int nlsns,
 		offset += MAXALIGN(nslots * sizeof(bool));
 		shared->page_number = (int *) (ptr + offset);
 		offset += MAXALIGN(nslots * sizeof(int));
-		shared->page_lru_count = (int *) (ptr + offset);
-		offset += MAXALIGN(nslots * sizeof(int));
+		shared->page_recently_used = (bool *) (ptr + offset);
+		offset += MAXALIGN(nslots * sizeof(bool));
 
 		if (nlsns > 0)
 		{
@@ -229,7 +227,7 @@ SimpleLruInit(SlruCtl ctl, const char *name, int nslots, int nlsns,
 			shared->page_buffer[slotno] = ptr;
 			shared->page_status[slotno] = SLRU_PAGE_EMPTY;
 			shared->page_dirty[slotno] = false;
-			shared->page_lru_count[slotno] = 0;
+			shared->page_recently_used[slotno] = false;
 			ptr += BLCKSZ;
 		}
 	}
@@ -246,6 +244,39 @@ SimpleLruInit(SlruCtl ctl, const char *name, int nslots, int nlsns,
 	ctl->shared = shared;
 	ctl->do_fsync = true;		/* default behavior */
 	StrNCpy(ctl->Dir, subdir, sizeof(ctl->Dir));
+
+	/* Remember this SLRU so its usage counters can be reported */
+	if (SlruStatsNumEntries < MAX_SLRU_STATS)
+		SlruStatsEntries[SlruStatsNumEntries++] = shared;
+}
+
+/*
+ * Report how many SLRUs exist in this cluster.
+ */
+int
+SimpleLruStatsCount(void)
+{
+	return SlruStatsNumEntries;
+}
+
+/*
+ * Fetch the name and usage counters of the index'th SLRU.  The counters are
+ * read without taking the control lock; they are only statistics, and torn
+ * 64-bit reads are at worst momentarily off by a bit on narrow platforms.
+ */
+void
+SimpleLruGetStats(int index, const char **name,
+				  uint64 *blks_hit, uint64 *blks_read, uint64 *blks_written)
+{
+	SlruShared	shared;
+
+	Assert(index >= 0 && index < SlruStatsNumEntries);
+	shared = SlruStatsEntries[index];
+
+	*name = shared->lwlock_tranche_name;
+	*blks_hit = shared->blks_hit;
+	*blks_read = shared->blks_read;
+	*blks_written = shared->blks_written;
 }
 
 /*
@@ -263,7 +294,7 @@ SimpleLruZeroPage(SlruCtl ctl, int pageno)
 	int			slotno;
 
 	/* Find a suitable buffer slot for the page */
-	slotno = SlruSelectLRUPage(ctl, pageno);
+	slotno = SlruSelectVictimPage(ctl, pageno);
 	Assert(shared->page_status[slotno] == SLRU_PAGE_EMPTY ||
 		   (shared->page_status[slotno] == SLRU_PAGE_VALID &&
 			!shared->page_dirty[slotno]) ||
@@ -381,7 +412,7 @@ SimpleLruReadPage(SlruCtl ctl, int pageno, bool write_ok,
 		bool		ok;
 
 		/* See if page already is in memory; if not, pick victim slot */
-		slotno = SlruSelectLRUPage(ctl, pageno);
+		slotno = SlruSelectVictimPage(ctl, pageno);
 
 		/* Did we find the page in memory? */
 		if (shared->page_number[slotno] == pageno &&
@@ -401,6 +432,7 @@ SimpleLruReadPage(SlruCtl ctl, int pageno, bool write_ok,
 			}
 			/* Otherwise, it's ready to use */
 			SlruRecentlyUsed(shared, slotno);
+			shared->blks_hit++;
 			return slotno;
 		}
 
@@ -434,6 +466,7 @@ SimpleLruReadPage(SlruCtl ctl, int pageno, bool write_ok,
 			   !shared->page_dirty[slotno]);
 
 		shared->page_status[slotno] = ok ? SLRU_PAGE_VALID : SLRU_PAGE_EMPTY;
+		shared->blks_read++;
 
 		LWLockRelease(&shared->buffer_locks[slotno].lock);
 
@@ -478,6 +511,7 @@ SimpleLruReadPage_ReadOnly(SlruCtl ctl, int pageno, TransactionId xid)
 		{
 			/* See comments for SlruRecentlyUsed macro */
 			SlruRecentlyUsed(shared, slotno);
+			shared->blks_hit++;
 			return slotno;
 		}
 	}
@@ -557,6 +591,8 @@ SlruInternalWritePage(SlruCtl ctl, int slotno, SlruFlush fdata)
 	/* If we failed to write, mark the page dirty again */
 	if (!ok)
 		shared->page_dirty[slotno] = true;
+	else
+		shared->blks_written++;
 
 	shared->page_status[slotno] = SLRU_PAGE_VALID;
 
@@ -952,7 +988,7 @@ SlruReportIOError(SlruCtl ctl, int pageno, TransactionId xid)
  * Control lock must be held at entry, and will be held at exit.
  */
 static int
-SlruSelectLRUPage(SlruCtl ctl, int pageno)
+SlruSelectVictimPage(SlruCtl ctl, int pageno)
 {
 	SlruShared	shared = ctl->shared;
 
@@ -960,13 +996,9 @@ SlruSelectLRUPage(SlruCtl ctl, int pageno)
 	for (;;)
 	{
 		int			slotno;
-		int			cur_count;
-		int			bestvalidslot = 0;	/* keep compiler quiet */
-		int			best_valid_delta = -1;
-		int			best_valid_page_number = 0; /* keep compiler quiet */
-		int			bestinvalidslot = 0;		/* keep compiler quiet */
-		int			best_invalid_delta = -1;
-		int			best_invalid_page_number = 0;		/* keep compiler quiet */
+		int			spins;
+		int			dirtyslot = -1;
+		int			ioslot = -1;
 
 		/* See if page already has a buffer assigned */
 		for (slotno = 0; slotno < shared->num_slots; slotno++)
@@ -977,111 +1009,73 @@ SlruSelectLRUPage(SlruCtl ctl, int pageno)
 		}
 
 		/*
-		 * If we find any EMPTY slot, just select that one. Else choose a
-		 * victim page to replace.  We normally take the least recently used
-		 * valid page, but we will never take the slot containing
-		 * latest_page_number, even if it appears least recently used.  We
-		 * will select a slot that is already I/O busy only if there is no
-		 * other choice: a read-busy slot will not be least recently used once
-		 * the read finishes, and waiting for an I/O on a write-busy slot is
-		 * inferior to just picking some other slot.  Testing shows the slot
-		 * we pick instead will often be clean, allowing us to begin a read at
-		 * once.
-		 *
-		 * Normally the page_lru_count values will all be different and so
-		 * there will be a well-defined LRU page.  But since we allow
-		 * concurrent execution of SlruRecentlyUsed() within
-		 * SimpleLruReadPage_ReadOnly(), it is possible that multiple pages
-		 * acquire the same lru_count values.  In that case we break ties by
-		 * choosing the furthest-back page.
-		 *
-		 * Notice that this next line forcibly advances cur_lru_count to a
-		 * value that is certainly beyond any value that will be in the
-		 * page_lru_count array after the loop finishes.  This ensures that
-		 * the next execution of SlruRecentlyUsed will mark the page newly
-		 * used, even if it's for a page that has the current counter value.
-		 * That gets us back on the path to having good data when there are
-		 * multiple pages with the same lru_count.
+		 * Run the clock sweep.  Any EMPTY slot the hand passes is selected
+		 * immediately.  A slot whose recently-used flag is set gets a second
+		 * chance: we clear the flag and move on.  A valid, clean,
+		 * not-recently-used slot ends the sweep, which is the expected quick
+		 * exit.  We will never take the slot containing latest_page_number,
+		 * even if its flag is clear.  Dirty or I/O-busy slots are only
+		 * fallbacks: we remember the first of each that the hand passes,
+		 * since the hand position makes it the approximately least recently
+		 * used one.  Because the sweep runs with the control lock held
+		 * exclusively, nobody can re-set a flag behind the hand, so two full
+		 * revolutions are certain to visit every slot with its flag clear.
 		 */
-		cur_count = (shared->cur_lru_count)++;
-		for (slotno = 0; slotno < shared->num_slots; slotno++)
+		for (spins = 0; spins < shared->num_slots * 2; spins++)
 		{
-			int			this_delta;
-			int			this_page_number;
+			slotno = shared->next_victim_slot;
+			if (++shared->next_victim_slot >= shared->num_slots)
+				shared->next_victim_slot = 0;
 
 			if (shared->page_status[slotno] == SLRU_PAGE_EMPTY)
 				return slotno;
-			this_delta = cur_count - shared->page_lru_count[slotno];
-			if (this_delta < 0)
-			{
-				/*
-				 * Clean up in case shared updates have caused cur_count
-				 * increments to get "lost".  We back off the page counts,
-				 * rather than trying to increase cur_count, to avoid any
-				 * question of infinite loops or failure in the presence of
-				 * wrapped-around counts.
-				 */
-				shared->page_lru_count[slotno] = cur_count;
-				this_delta = 0;
-			}
-			this_page_number = shared->page_number[slotno];
-			if (this_page_number == shared->latest_page_number)
+			if (shared->page_number[slotno] == shared->latest_page_number)
 				continue;
-			if (shared->page_status[slotno] == SLRU_PAGE_VALID)
+			if (shared->page_recently_used[slotno])
 			{
-				if (this_delta > best_valid_delta ||
-					(this_delta == best_valid_delta &&
-					 ctl->PagePrecedes(this_page_number,
-									   best_valid_page_number)))
-				{
-					bestvalidslot = slotno;
-					best_valid_delta = this_delta;
-					best_valid_page_number = this_page_number;
-				}
+				shared->page_recently_used[slotno] = false;
+				continue;
 			}
-			else
+			if (shared->page_status[slotno] == SLRU_PAGE_VALID)
 			{
-				if (this_delta > best_invalid_delta ||
-					(this_delta == best_invalid_delta &&
-					 ctl->PagePrecedes(this_page_number,
-									   best_invalid_page_number)))
-				{
-					bestinvalidslot = slotno;
-					best_invalid_delta = this_delta;
-					best_invalid_page_number = this_page_number;
-				}
+				if (!shared->page_dirty[slotno])
+					return slotno;
+				if (dirtyslot < 0)
+					dirtyslot = slotno;
 			}
+			else if (ioslot < 0)
+				ioslot = slotno;
 		}
 
 		/*
-		 * If all pages (except possibly the latest one) are I/O busy, we'll
-		 * have to wait for an I/O to complete and then retry.  In that
-		 * unhappy case, we choose to wait for the I/O on the least recently
-		 * used slot, on the assumption that it was likely initiated first of
-		 * all the I/Os in progress and may therefore finish first.
+		 * No clean victim.  If there was a dirty slot, write it out and then
+		 * retry from the top.
 		 */
-		if (best_valid_delta < 0)
+		if (dirtyslot >= 0)
 		{
-			SimpleLruWaitIO(ctl, bestinvalidslot);
+			SlruInternalWritePage(ctl, dirtyslot, NULL);
 			continue;
 		}
 
 		/*
-		 * If the selected page is clean, we're set.
-		 */
-		if (!shared->page_dirty[bestvalidslot])
-			return bestvalidslot;
-
-		/*
-		 * Write the page.
+		 * If all pages (except possibly the latest one) are I/O busy, we'll
+		 * have to wait for an I/O to complete and then retry.  We choose to
+		 * wait for the I/O on the slot nearest the hand, on the assumption
+		 * that it was likely initiated first of all the I/Os in progress and
+		 * may therefore finish first.
 		 */
-		SlruInternalWritePage(ctl, bestvalidslot, NULL);
+		if (ioslot >= 0)
+		{
+			SimpleLruWaitIO(ctl, ioslot);
+			continue;
+		}
 
 		/*
-		 * Now loop back and try again.  This is the easiest way of dealing
-		 * with corner cases such as the victim page being re-dirtied while we
-		 * wrote it.
+		 * Can't happen with more than one buffer slot: only the slot holding
+		 * the latest page is exempt from the sweep.
 		 */
+		elog(ERROR, "could not find a victim page to evict in SLRU \"%s\"",
+			 shared->lwlock_tranche_name);
 	}
 }
 
@@ -1207,7 +1201,7 @@ restart:;
 		/*
 		 * Hmm, we have (or may have) I/O operations acting on the page, so
 		 * we've got to wait for them to finish and then start again. This is
-		 * the same logic as in SlruSelectLRUPage.  (XXX if page is dirty,
+		 * the same logic as in SlruSelectVictimPage.  (XXX if page is dirty,
 		 * wouldn't it be OK to just discard it without writing it?  For now,
 		 * keep the logic the same as it was.)
 		 */
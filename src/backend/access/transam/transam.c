@@ -22,6 +22,7 @@
 #include "access/clog.h"
 #include "access/subtrans.h"
 #include "access/transam.h"
+#include "utils/builtins.h"
 #include "utils/snapmgr.h"
 
 /*
@@ -34,6 +35,18 @@ static TransactionId cachedFetchXid = InvalidTransactionId;
 static XidStatus cachedFetchXidStatus;
 static XLogRecPtr cachedCommitLSN;
 
+/*
+ * Small direct-mapped cache filled by TransactionIdPrefetchStatus.  Callers
+ * that are about to look up many xids (such as heap page pruning) can fetch
+ * all their statuses with one TransactionIdGetStatusBulk call, and the
+ * subsequent TransactionLogFetch calls are then satisfied from here.  Only
+ * statuses that can no longer change are stored, so a hit is always valid.
+ */
+#define PREFETCH_STATUS_CACHE_SIZE	64		/* must be a power of two */
+static TransactionId prefetchedXid[PREFETCH_STATUS_CACHE_SIZE];
+static XidStatus prefetchedXidStatus[PREFETCH_STATUS_CACHE_SIZE];
+static XLogRecPtr prefetchedCommitLSN[PREFETCH_STATUS_CACHE_SIZE];
+
 /* Local functions */
 static XidStatus TransactionLogFetch(TransactionId transactionId);
 
@@ -53,6 +66,7 @@ TransactionLogFetch(TransactionId transactionId)
 {
 	XidStatus	xidstatus;
 	XLogRecPtr	xidlsn;
+	int			slot;
 
 	/*
 	 * Before going to the commit log manager, check our single item cache to
@@ -73,6 +87,18 @@ TransactionLogFetch(TransactionId transactionId)
 		return TRANSACTION_STATUS_ABORTED;
 	}
 
+	/*
+	 * Check the prefetch cache; see TransactionIdPrefetchStatus.
+	 */
+	slot = transactionId & (PREFETCH_STATUS_CACHE_SIZE - 1);
+	if (TransactionIdEquals(prefetchedXid[slot], transactionId))
+	{
+		cachedFetchXid = transactionId;
+		cachedFetchXidStatus = prefetchedXidStatus[slot];
+		cachedCommitLSN = prefetchedCommitLSN[slot];
+		return cachedFetchXidStatus;
+	}
+
 	/*
 	 * Get the transaction status.
 	 */
@@ -93,6 +119,56 @@ TransactionLogFetch(TransactionId transactionId)
 	return xidstatus;
 }
 
+/*
+ * TransactionIdPrefetchStatus
+ *		Fetch the commit status of many xids with one bulk clog call and
+ *		remember the results for subsequent TransactionLogFetch calls.
+ *
+ * This is purely a performance hint for callers that are about to probe many
+ * xids, such as heap page pruning: invalid and permanent xids are skipped,
+ * duplicates are harmless, and statuses that may still change (in-progress,
+ * sub-committed) are not remembered, so a later cache hit is always valid.
+ */
+void
+TransactionIdPrefetchStatus(int nxids, TransactionId *xids)
+{
+	TransactionId batch[PREFETCH_STATUS_CACHE_SIZE];
+	XidStatus	statuses[PREFETCH_STATUS_CACHE_SIZE];
+	XLogRecPtr	lsns[PREFETCH_STATUS_CACHE_SIZE];
+	int			n = 0;
+	int			i;
+
+	for (i = 0; i < nxids; i++)
+	{
+		if (TransactionIdIsNormal(xids[i]))
+			batch[n++] = xids[i];
+
+		if (n > 0 && (n == PREFETCH_STATUS_CACHE_SIZE || i == nxids - 1))
+		{
+			int			j;
+
+			/* Sorting lets the bulk lookup serve each clog page once */
+			qsort(batch, n, sizeof(TransactionId), xidComparator);
+			TransactionIdGetStatusBulk(n, batch, statuses, lsns);
+
+			for (j = 0; j < n; j++)
+			{
+				int			slot;
+
+				if (statuses[j] == TRANSACTION_STATUS_IN_PROGRESS ||
+					statuses[j] == TRANSACTION_STATUS_SUB_COMMITTED)
+					continue;
+
+				slot = batch[j] & (PREFETCH_STATUS_CACHE_SIZE - 1);
+				prefetchedXid[slot] = batch[j];
+				prefetchedXidStatus[slot] = statuses[j];
+				prefetchedCommitLSN[slot] = lsns[j];
+			}
+			n = 0;
+		}
+	}
+}
+
 /* ----------------------------------------------------------------
  *						Interface functions
  *
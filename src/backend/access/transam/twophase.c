@@ -83,9 +83,11 @@
 #include "storage/predicate.h"
 #include "storage/proc.h"
 #include "storage/procarray.h"
+#include "storage/shmem.h"
 #include "storage/sinvaladt.h"
 #include "storage/smgr.h"
 #include "utils/builtins.h"
+#include "utils/hsearch.h"
 #include "utils/memutils.h"
 #include "utils/timestamp.h"
 
@@ -171,6 +173,21 @@ typedef struct TwoPhaseStateData
 
 static TwoPhaseStateData *TwoPhaseState;
 
+/*
+ * By-GID index over the active prepXacts entries, so that LockGXact and the
+ * duplicate-GID check in MarkAsPreparing need not scan the whole array.
+ * Distributed commit protocols create and resolve prepared transactions at a
+ * high enough rate that the linear scans show up in profiles.  Entries are
+ * added and removed together with the array entries, under TwoPhaseStateLock.
+ */
+typedef struct TwoPhaseGidEntry
+{
+	char		gid[GIDSIZE];	/* hash key: the GID (NUL-terminated) */
+	GlobalTransaction gxact;	/* associated active entry */
+} TwoPhaseGidEntry;
+
+static HTAB *TwoPhaseGidHash;
+
 /*
  * Global transaction entry currently locked by us, if any.
  */
@@ -212,6 +229,8 @@ TwoPhaseShmemSize(void)
 	size = MAXALIGN(size);
 	size = add_size(size, mul_size(max_prepared_xacts,
 								   sizeof(GlobalTransactionData)));
+	size = add_size(size, hash_estimate_size(Max(max_prepared_xacts, 1),
+											 sizeof(TwoPhaseGidEntry)));
 
 	return size;
 }
@@ -220,10 +239,20 @@ void
 TwoPhaseShmemInit(void)
 {
 	bool		found;
+	HASHCTL		info;
 
 	TwoPhaseState = ShmemInitStruct("Prepared Transaction Table",
 									TwoPhaseShmemSize(),
 									&found);
+
+	MemSet(&info, 0, sizeof(info));
+	info.keysize = GIDSIZE;
+	info.entrysize = sizeof(TwoPhaseGidEntry);
+
+	TwoPhaseGidHash = ShmemInitHash("Prepared Transaction GID hash",
+									Max(max_prepared_xacts, 1),
+									Max(max_prepared_xacts, 1),
+									&info, HASH_ELEM);
 	if (!IsUnderPostmaster)
 	{
 		GlobalTransaction gxacts;
@@ -350,8 +379,10 @@ MarkAsPreparing(TransactionId xid, const char *gid,
 				TimestampTz prepared_at, Oid owner, Oid databaseid)
 {
 	GlobalTransaction gxact;
+	TwoPhaseGidEntry *entry;
 	PGPROC	   *proc;
 	PGXACT	   *pgxact;
+	bool		found;
 	int			i;
 
 	if (strlen(gid) >= GIDSIZE)
@@ -377,17 +408,11 @@ MarkAsPreparing(TransactionId xid, const char *gid,
 	LWLockAcquire(TwoPhaseStateLock, LW_EXCLUSIVE);
 
 	/* Check for conflicting GID */
-	for (i = 0; i < TwoPhaseState->numPrepXacts; i++)
-	{
-		gxact = TwoPhaseState->prepXacts[i];
-		if (strcmp(gxact->gid, gid) == 0)
-		{
-			ereport(ERROR,
-					(errcode(ERRCODE_DUPLICATE_OBJECT),
-					 errmsg("transaction identifier \"%s\" is already in use",
-							gid)));
-		}
-	}
+	if (hash_search(TwoPhaseGidHash, gid, HASH_FIND, NULL) != NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_DUPLICATE_OBJECT),
+				 errmsg("transaction identifier \"%s\" is already in use",
+						gid)));
 
 	/* Get a free gxact from the freelist */
 	if (TwoPhaseState->freeGXacts == NULL)
@@ -437,9 +462,13 @@ MarkAsPreparing(TransactionId xid, const char *gid,
 	gxact->ondisk = false;
 	strcpy(gxact->gid, gid);
 
-	/* And insert it into the active array */
+	/* And insert it into the active array and the by-GID hash */
 	Assert(TwoPhaseState->numPrepXacts < max_prepared_xacts);
 	TwoPhaseState->prepXacts[TwoPhaseState->numPrepXacts++] = gxact;
+	entry = (TwoPhaseGidEntry *) hash_search(TwoPhaseGidHash, gid,
+											 HASH_ENTER, &found);
+	Assert(!found);
+	entry->gxact = gxact;
 
 	/*
 	 * Remember that we have this GlobalTransaction entry locked for us. If we
@@ -507,7 +536,7 @@ MarkAsPrepared(GlobalTransaction gxact)
 static GlobalTransaction
 LockGXact(const char *gid, Oid user)
 {
-	int			i;
+	TwoPhaseGidEntry *entry;
 
 	/* on first call, register the exit hook */
 	if (!twophaseExitRegistered)
@@ -518,17 +547,15 @@ LockGXact(const char *gid, Oid user)
 
 	LWLockAcquire(TwoPhaseStateLock, LW_EXCLUSIVE);
 
-	for (i = 0; i < TwoPhaseState->numPrepXacts; i++)
+	entry = (TwoPhaseGidEntry *) hash_search(TwoPhaseGidHash, gid,
+											 HASH_FIND, NULL);
+
+	/* Ignore not-yet-valid GIDs */
+	if (entry != NULL && entry->gxact->valid)
 	{
-		GlobalTransaction gxact = TwoPhaseState->prepXacts[i];
+		GlobalTransaction gxact = entry->gxact;
 		PGPROC	   *proc = &ProcGlobal->allProcs[gxact->pgprocno];
 
-		/* Ignore not-yet-valid GIDs */
-		if (!gxact->valid)
-			continue;
-		if (strcmp(gxact->gid, gid) != 0)
-			continue;
-
 		/* Found it, but has someone else got it locked? */
 		if (gxact->locking_backend != InvalidBackendId)
 			ereport(ERROR,
@@ -595,6 +622,9 @@ RemoveGXact(GlobalTransaction gxact)
 			TwoPhaseState->numPrepXacts--;
 			TwoPhaseState->prepXacts[i] = TwoPhaseState->prepXacts[TwoPhaseState->numPrepXacts];
 
+			/* remove from the by-GID hash */
+			hash_search(TwoPhaseGidHash, gxact->gid, HASH_REMOVE, NULL);
+
 			/* and put it back in the freelist */
 			gxact->next = TwoPhaseState->freeGXacts;
 			TwoPhaseState->freeGXacts = gxact;
@@ -37,6 +37,8 @@ VariableCache ShmemVariableCache = NULL;
 TransactionId
 GetNewTransactionId(bool isSubXact)
 {
+	if (TransactionManagerIsDefault())
+		return PgGetNewTransactionId(isSubXact);
 	return TM->GetNewTransactionId(isSubXact);
 }
 
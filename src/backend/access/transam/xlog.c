@@ -85,6 +85,7 @@ extern uint32 bootstrap_data_checksum_version;
 int			max_wal_size = 64;	/* 1 GB */
 int			min_wal_size = 5;	/* 80 MB */
 int			wal_keep_segments = 0;
+int			wal_prealloc_segments = 1;
 int			XLOGbuffers = -1;
 int			XLogArchiveTimeout = 0;
 int			XLogArchiveMode = ARCHIVE_MODE_OFF;
@@ -92,13 +93,14 @@ char	   *XLogArchiveCommand = NULL;
 bool		EnableHotStandby = false;
 bool		fullPageWrites = true;
 bool		wal_log_hints = false;
-bool		wal_compression = false;
+int			wal_compression = WAL_COMPRESSION_NONE;
 bool		log_checkpoints = false;
 int			sync_method = DEFAULT_SYNC_METHOD;
 int			wal_level = WAL_LEVEL_MINIMAL;
 int			CommitDelay = 0;	/* precommit delay in microseconds */
 int			CommitSiblings = 5; /* # concurrent xacts needed to sleep */
 int			wal_retrieve_retry_interval = 5000;
+int			recovery_prefetch = 32;
 
 #ifdef WAL_DEBUG
 bool		XLOG_DEBUG = false;
@@ -109,7 +111,7 @@ bool		XLOG_DEBUG = false;
  * to happen concurrently, but adds some CPU overhead to flushing the WAL,
  * which needs to iterate all the locks.
  */
-#define NUM_XLOGINSERT_LOCKS  8
+int			wal_insert_locks = 8;
 
 /*
  * Max distance from last checkpoint, before triggering a new xlog-based
@@ -743,6 +745,43 @@ typedef struct XLogPageReadPrivate
 	bool		randAccess;
 } XLogPageReadPrivate;
 
+/*
+ * State for prefetching data blocks ahead of WAL replay.  A second xlog
+ * reader decodes records up to recovery_prefetch blocks ahead of the main
+ * replay loop and issues smgrprefetch() hints for the blocks they touch.
+ * If the prefetcher hits WAL that can't be read or decoded yet (typically
+ * because it hasn't been streamed or restored), prefetchFailPtr records
+ * where, so that we don't uselessly retry until replay has caught up that
+ * far.
+ */
+static XLogReaderState *prefetchReader = NULL;
+static XLogRecPtr prefetchPtr = InvalidXLogRecPtr;
+static XLogRecPtr prefetchFailPtr = InvalidXLogRecPtr;
+static int	prefetchBlocksAhead = 0;
+
+/* file state of the prefetcher's page-read callback */
+static int	prefetchFile = -1;
+static XLogSegNo prefetchSegNo = 0;
+static TimeLineID prefetchTLI = 0;
+
+/*
+ * Hash table of recently hinted blocks, used to suppress duplicate
+ * prefetch hints.  Hot pages are referenced by long runs of consecutive
+ * records, and after the first reference the page is about to be read
+ * into shared buffers by replay anyway, so repeating the fadvise call
+ * buys nothing.  Collisions simply overwrite the slot; a stale entry at
+ * worst suppresses one useful hint.
+ */
+typedef struct PrefetchedBlock
+{
+	RelFileNode rnode;
+	ForkNumber	forknum;
+	BlockNumber blkno;
+} PrefetchedBlock;
+
+#define PREFETCH_DEDUP_SLOTS	1024	/* must be a power of two */
+static PrefetchedBlock prefetchDedupTable[PREFETCH_DEDUP_SLOTS];
+
 /*
  * These variables track when we last obtained some WAL data to process,
  * and where we got it from.  (XLogReceiptSource is initially the same as
@@ -813,11 +852,16 @@ static int	XLogFileReadAnyTLI(XLogSegNo segno, int emode, int source);
 static int XLogPageRead(XLogReaderState *xlogreader, XLogRecPtr targetPagePtr,
 			 int reqLen, XLogRecPtr targetRecPtr, char *readBuf,
 			 TimeLineID *readTLI);
+static int XLogPrefetchPageRead(XLogReaderState *xlogreader,
+					 XLogRecPtr targetPagePtr, int reqLen,
+					 XLogRecPtr targetRecPtr, char *readBuf,
+					 TimeLineID *readTLI);
+static void XLogPrefetch(XLogReaderState *replayReader);
+static void XLogPrefetchShutdown(void);
 static bool WaitForWALToBecomeAvailable(XLogRecPtr RecPtr, bool randAccess,
 							bool fetching_ckpt, XLogRecPtr tliRecPtr);
 static int	emode_for_corrupt_record(int emode, XLogRecPtr RecPtr);
 static void XLogFileClose(void);
-static void PreallocXlogFiles(XLogRecPtr endptr);
 static void RemoveOldXlogFiles(XLogSegNo segno, XLogRecPtr PriorRedoPtr, XLogRecPtr endptr);
 static void RemoveXlogFile(const char *segname, XLogRecPtr PriorRedoPtr, XLogRecPtr endptr);
 static void UpdateLastRemovedPtr(char *filename);
@@ -925,7 +969,7 @@ XLogInsertRecord(XLogRecData *rdata, XLogRecPtr fpw_lsn)
 	 * inserter acquires an insertion lock. In addition to just indicating that
 	 * an insertion is in progress, the lock tells others how far the inserter
 	 * has progressed. There is a small fixed number of insertion locks,
-	 * determined by NUM_XLOGINSERT_LOCKS. When an inserter crosses a page
+	 * determined by wal_insert_locks. When an inserter crosses a page
 	 * boundary, it updates the value stored in the lock to the how far it has
 	 * inserted, to allow the previous buffer to be flushed.
 	 *
@@ -1399,7 +1443,7 @@ WALInsertLockAcquire(void)
 	static int	lockToTry = -1;
 
 	if (lockToTry == -1)
-		lockToTry = MyProc->pgprocno % NUM_XLOGINSERT_LOCKS;
+		lockToTry = MyProc->pgprocno % wal_insert_locks;
 	MyLockNo = lockToTry;
 
 	/*
@@ -1417,7 +1461,7 @@ WALInsertLockAcquire(void)
 		 * than locks, it still helps to distribute the inserters evenly
 		 * across the locks.
 		 */
-		lockToTry = (lockToTry + 1) % NUM_XLOGINSERT_LOCKS;
+		lockToTry = (lockToTry + 1) % wal_insert_locks;
 	}
 }
 
@@ -1435,7 +1479,7 @@ WALInsertLockAcquireExclusive(void)
 	 * indicator is set to 0xFFFFFFFFFFFFFFFF, which is higher than any real
 	 * XLogRecPtr value, to make sure that no-one blocks waiting on those.
 	 */
-	for (i = 0; i < NUM_XLOGINSERT_LOCKS - 1; i++)
+	for (i = 0; i < wal_insert_locks - 1; i++)
 	{
 		LWLockAcquire(&WALInsertLocks[i].l.lock, LW_EXCLUSIVE);
 		LWLockUpdateVar(&WALInsertLocks[i].l.lock,
@@ -1461,7 +1505,7 @@ WALInsertLockRelease(void)
 	{
 		int			i;
 
-		for (i = 0; i < NUM_XLOGINSERT_LOCKS; i++)
+		for (i = 0; i < wal_insert_locks; i++)
 			LWLockReleaseClearVar(&WALInsertLocks[i].l.lock,
 								  &WALInsertLocks[i].l.insertingAt,
 								  0);
@@ -1489,8 +1533,8 @@ WALInsertLockUpdateInsertingAt(XLogRecPtr insertingAt)
 		 * We use the last lock to mark our actual position, see comments in
 		 * WALInsertLockAcquireExclusive.
 		 */
-		LWLockUpdateVar(&WALInsertLocks[NUM_XLOGINSERT_LOCKS - 1].l.lock,
-					 &WALInsertLocks[NUM_XLOGINSERT_LOCKS - 1].l.insertingAt,
+		LWLockUpdateVar(&WALInsertLocks[wal_insert_locks - 1].l.lock,
+					 &WALInsertLocks[wal_insert_locks - 1].l.insertingAt,
 						insertingAt);
 	}
 	else
@@ -1557,7 +1601,7 @@ WaitXLogInsertionsToFinish(XLogRecPtr upto)
 	 * out for any insertion that's still in progress.
 	 */
 	finishedUpto = reservedUpto;
-	for (i = 0; i < NUM_XLOGINSERT_LOCKS; i++)
+	for (i = 0; i < wal_insert_locks; i++)
 	{
 		XLogRecPtr	insertingat = InvalidXLogRecPtr;
 
@@ -2978,7 +3022,22 @@ XLogFileInit(XLogSegNo logsegno, bool *use_existent, bool use_lock)
 	 */
 	zbuffer = (char *) MAXALIGN(zbuffer_raw);
 	memset(zbuffer, 0, XLOG_BLCKSZ);
-	for (nbytes = 0; nbytes < XLogSegSize; nbytes += XLOG_BLCKSZ)
+	nbytes = 0;
+
+#ifdef HAVE_POSIX_FALLOCATE
+	/*
+	 * If the kernel can allocate the whole segment in one call, use that in
+	 * preference to writing XLogSegSize bytes of zeroes: it is much cheaper,
+	 * and it provides the same guarantee that all the file space is really
+	 * allocated.  Not every filesystem supports it, so if the call fails for
+	 * any reason just fall through to the write loop; that will report hard
+	 * errors such as ENOSPC in the usual way.
+	 */
+	if (posix_fallocate(fd, 0, (off_t) XLogSegSize) == 0)
+		nbytes = XLogSegSize;
+#endif
+
+	for (; nbytes < XLogSegSize; nbytes += XLOG_BLCKSZ)
 	{
 		errno = 0;
 		if ((int) write(fd, zbuffer, XLOG_BLCKSZ) != (int) XLOG_BLCKSZ)
@@ -3499,23 +3558,33 @@ XLogFileClose(void)
 /*
  * Preallocate log files beyond the specified log endpoint.
  *
- * XXX this is currently extremely conservative, since it forces only one
- * future log segment to exist, and even that only if we are 75% done with
- * the current one.  This is only appropriate for very low-WAL-volume systems.
- * High-volume systems will be OK once they've built up a sufficient set of
- * recycled log segments, but the startup transient is likely to include
- * a lot of segment creations by foreground processes, which is not so good.
+ * Up to wal_prealloc_segments future log segments are forced to exist, so
+ * that foreground processes switching to a new segment can normally just
+ * open a ready-made file.  Besides the checkpointer, the WAL writer calls
+ * this on every cycle to keep the pool topped up between checkpoints; once
+ * the pool is full, each call costs only one open()/close() per segment.
  */
-static void
+void
 PreallocXlogFiles(XLogRecPtr endptr)
 {
 	XLogSegNo	_logSegNo;
 	int			lf;
 	bool		use_existent;
+	int			nsegs;
 
 	XLByteToPrevSeg(endptr, _logSegNo);
-	if ((endptr - 1) % XLogSegSize >= (uint32) (0.75 * XLogSegSize))
+	for (nsegs = 1; nsegs <= wal_prealloc_segments; nsegs++)
 	{
+		/*
+		 * With the default pool of one ready segment, retain the historical
+		 * behavior of pre-creating it only once the current segment is
+		 * mostly filled.  Larger pools are kept topped up unconditionally,
+		 * since their whole point is to stay ahead of write bursts.
+		 */
+		if (nsegs == 1 && wal_prealloc_segments == 1 &&
+			(endptr - 1) % XLogSegSize < (uint32) (0.75 * XLogSegSize))
+			break;
+
 		_logSegNo++;
 		use_existent = true;
 		lf = XLogFileInit(_logSegNo, &use_existent, true);
@@ -4596,7 +4665,7 @@ XLOGShmemSize(void)
 	size = sizeof(XLogCtlData);
 
 	/* WAL insertion locks, plus alignment */
-	size = add_size(size, mul_size(sizeof(WALInsertLockPadded), NUM_XLOGINSERT_LOCKS + 1));
+	size = add_size(size, mul_size(sizeof(WALInsertLockPadded), wal_insert_locks + 1));
 	/* xlblocks array */
 	size = add_size(size, mul_size(sizeof(XLogRecPtr), XLOGbuffers));
 	/* extra alignment padding for XLOG I/O buffers */
@@ -4673,14 +4742,14 @@ XLOGShmemInit(void)
 		((uintptr_t) allocptr) %sizeof(WALInsertLockPadded);
 	WALInsertLocks = XLogCtl->Insert.WALInsertLocks =
 		(WALInsertLockPadded *) allocptr;
-	allocptr += sizeof(WALInsertLockPadded) * NUM_XLOGINSERT_LOCKS;
+	allocptr += sizeof(WALInsertLockPadded) * wal_insert_locks;
 
 	XLogCtl->Insert.WALInsertLockTranche.name = "WALInsertLocks";
 	XLogCtl->Insert.WALInsertLockTranche.array_base = WALInsertLocks;
 	XLogCtl->Insert.WALInsertLockTranche.array_stride = sizeof(WALInsertLockPadded);
 
 	LWLockRegisterTranche(LWTRANCHE_WAL_INSERT, &XLogCtl->Insert.WALInsertLockTranche);
-	for (i = 0; i < NUM_XLOGINSERT_LOCKS; i++)
+	for (i = 0; i < wal_insert_locks; i++)
 	{
 		LWLockInitialize(&WALInsertLocks[i].l.lock, LWTRANCHE_WAL_INSERT);
 		WALInsertLocks[i].l.insertingAt = InvalidXLogRecPtr;
@@ -6842,6 +6911,9 @@ StartupXLOG(void)
 					TransactionIdIsValid(record->xl_xid))
 					RecordKnownAssignedTransactionIds(record->xl_xid);
 
+				/* Hint the kernel about data blocks needed soon */
+				XLogPrefetch(xlogreader);
+
 				/* Now apply the WAL record itself */
 				RmgrTable[record->xl_rmid].rm_redo(xlogreader);
 
@@ -7367,6 +7439,7 @@ StartupXLOG(void)
 		readFile = -1;
 	}
 	XLogReaderFree(xlogreader);
+	XLogPrefetchShutdown();
 
 	/*
 	 * If any of the critical GUCs have changed, log them before we allow
@@ -11062,6 +11135,185 @@ next_record_is_invalid:
 		return -1;
 }
 
+/*
+ * Page-read callback for the prefetch xlog reader.
+ *
+ * Unlike XLogPageRead, this never waits for WAL to arrive and never
+ * consults the archive or the walreceiver: it only reads pages that are
+ * already present in pg_xlog, and fails silently otherwise.  Garbage read
+ * from a recycled or partially written segment is caught by the reader's
+ * page and record validation; a failure here merely suspends prefetching
+ * until replay catches up with the failure point.
+ */
+static int
+XLogPrefetchPageRead(XLogReaderState *xlogreader, XLogRecPtr targetPagePtr,
+					 int reqLen, XLogRecPtr targetRecPtr, char *readBuf,
+					 TimeLineID *readTLI)
+{
+	XLogSegNo	targetSegNo;
+	uint32		targetPageOff;
+
+	XLByteToSeg(targetPagePtr, targetSegNo);
+	targetPageOff = targetPagePtr % XLogSegSize;
+
+	/*
+	 * Read from the timeline the main reader is currently on.  If a
+	 * timeline switch makes this wrong, record validation fails and the
+	 * prefetcher is repositioned once replay passes the switch point.
+	 */
+	if (prefetchFile < 0 || targetSegNo != prefetchSegNo ||
+		prefetchTLI != curFileTLI)
+	{
+		char		path[MAXPGPATH];
+
+		if (prefetchFile >= 0)
+			close(prefetchFile);
+
+		XLogFilePath(path, curFileTLI, targetSegNo);
+		prefetchFile = BasicOpenFile(path, O_RDONLY | PG_BINARY, 0);
+		if (prefetchFile < 0)
+			return -1;
+		prefetchSegNo = targetSegNo;
+		prefetchTLI = curFileTLI;
+	}
+
+	if (lseek(prefetchFile, (off_t) targetPageOff, SEEK_SET) < 0 ||
+		read(prefetchFile, readBuf, XLOG_BLCKSZ) != XLOG_BLCKSZ)
+	{
+		close(prefetchFile);
+		prefetchFile = -1;
+		return -1;
+	}
+
+	*readTLI = prefetchTLI;
+	return XLOG_BLCKSZ;
+}
+
+/*
+ * Decode WAL ahead of the main redo loop and hint the kernel to start
+ * reading the data blocks it will shortly need.  Called once per record
+ * from the redo loop; replayReader is the main xlog reader, positioned at
+ * the record about to be applied.
+ *
+ * The prefetcher keeps a budget of recovery_prefetch blocks between the
+ * replay position and its own position.  Each replayed record returns its
+ * blocks to the budget, plus one so that runs of block-less records still
+ * let the prefetcher advance.  Blocks carrying a full-page image are not
+ * prefetched, since redo overwrites those pages without reading them.
+ */
+static void
+XLogPrefetch(XLogReaderState *replayReader)
+{
+	char	   *errormsg;
+
+	if (recovery_prefetch <= 0)
+		return;
+
+	if (prefetchReader == NULL)
+	{
+		prefetchReader = XLogReaderAllocate(&XLogPrefetchPageRead, NULL);
+		if (prefetchReader == NULL)
+		{
+			/* not worth interrupting recovery for; just disable the feature */
+			recovery_prefetch = 0;
+			return;
+		}
+		prefetchReader->system_identifier = ControlFile->system_identifier;
+	}
+
+	/* the record about to be replayed no longer counts against the budget */
+	prefetchBlocksAhead -= replayReader->max_block_id + 2;
+	if (prefetchBlocksAhead < 0)
+		prefetchBlocksAhead = 0;
+
+	/*
+	 * After a read or decode failure, don't retry until replay has gotten
+	 * past the failure point; the WAL beyond it quite possibly hadn't been
+	 * streamed or restored yet.
+	 */
+	if (!XLogRecPtrIsInvalid(prefetchFailPtr))
+	{
+		if (replayReader->EndRecPtr <= prefetchFailPtr)
+			return;
+		prefetchFailPtr = InvalidXLogRecPtr;
+		prefetchPtr = InvalidXLogRecPtr;
+	}
+
+	/*
+	 * (Re)position the prefetcher just past the record being replayed if it
+	 * has fallen behind, as at startup and after failures.  Copying the
+	 * replay reader's position lets XLogReadRecord continue from there with
+	 * the usual xl_prev cross-check.
+	 */
+	if (XLogRecPtrIsInvalid(prefetchPtr) ||
+		prefetchPtr < replayReader->EndRecPtr)
+	{
+		prefetchReader->ReadRecPtr = replayReader->ReadRecPtr;
+		prefetchReader->EndRecPtr = replayReader->EndRecPtr;
+		prefetchPtr = replayReader->EndRecPtr;
+		prefetchBlocksAhead = 0;
+	}
+
+	while (prefetchBlocksAhead < recovery_prefetch)
+	{
+		int			block_id;
+
+		if (XLogReadRecord(prefetchReader, InvalidXLogRecPtr, &errormsg) == NULL)
+		{
+			/* typically end of the locally available WAL */
+			prefetchFailPtr = prefetchPtr;
+			return;
+		}
+		prefetchPtr = prefetchReader->EndRecPtr;
+
+		for (block_id = 0; block_id <= prefetchReader->max_block_id; block_id++)
+		{
+			RelFileNode rnode;
+			ForkNumber	forknum;
+			BlockNumber blkno;
+			PrefetchedBlock *slot;
+
+			if (XLogRecHasBlockImage(prefetchReader, block_id))
+				continue;
+			if (!XLogRecGetBlockTag(prefetchReader, block_id,
+									&rnode, &forknum, &blkno))
+				continue;
+
+			/* skip blocks we have hinted about recently */
+			slot = &prefetchDedupTable[(rnode.relNode ^
+				(blkno * 2654435761U)) % PREFETCH_DEDUP_SLOTS];
+			if (RelFileNodeEquals(slot->rnode, rnode) &&
+				slot->forknum == forknum && slot->blkno == blkno)
+				continue;
+			slot->rnode = rnode;
+			slot->forknum = forknum;
+			slot->blkno = blkno;
+
+			smgrprefetch(smgropen(rnode, InvalidBackendId), forknum, blkno);
+		}
+
+		prefetchBlocksAhead += prefetchReader->max_block_id + 2;
+	}
+}
+
+/*
+ * Release prefetcher resources at the end of recovery.
+ */
+static void
+XLogPrefetchShutdown(void)
+{
+	if (prefetchFile >= 0)
+	{
+		close(prefetchFile);
+		prefetchFile = -1;
+	}
+	if (prefetchReader != NULL)
+	{
+		XLogReaderFree(prefetchReader);
+		prefetchReader = NULL;
+	}
+}
+
 /*
  * Open the WAL segment containing WAL position 'RecPtr'.
  *
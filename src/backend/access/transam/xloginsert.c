@@ -593,9 +593,12 @@ XLogRecordAssemble(RmgrId rmid, uint8 info,
 			}
 
 			/*
-			 * Try to compress a block image if wal_compression is enabled
+			 * Try to compress a block image if wal_compression is enabled.
+			 * pglz is the only algorithm so far; additional values of the
+			 * WalCompression enum will need their own BKPIMAGE flag, since
+			 * redo must be able to tell how an image was compressed.
 			 */
-			if (wal_compression)
+			if (wal_compression != WAL_COMPRESSION_NONE)
 			{
 				is_compressed =
 					XLogCompressBackupBlock(page, bimg.hole_offset,
@@ -46,7 +46,8 @@ TransactionManager PgTM = {
 	PgGetGlobalTransactionId,
 	PgXidInMVCCSnapshot,
 	PgDetectGlobalDeadLock,
-	PgGetTransactionManagerName
+	PgGetTransactionManagerName,
+	PgTransactionIdGetStatusBulk
 };
 
 TransactionManager *TM = &PgTM;
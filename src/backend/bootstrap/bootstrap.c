@@ -349,8 +349,13 @@ AuxiliaryProcessMain(int argc, char *argv[])
 
 	/* Initialize MaxBackends (if under postmaster, was done already) */
 	if (!IsUnderPostmaster)
+	{
 		InitializeMaxBackends();
 
+		/* Same for the number of fast-path lock groups. */
+		InitializeFastPathLocks();
+	}
+
 	BaseInit();
 
 	/*
@@ -775,6 +775,32 @@ CREATE VIEW pg_stat_archiver AS
         s.stats_reset
     FROM pg_stat_get_archiver() s;
 
+CREATE VIEW pg_stat_lwlock_waits AS
+    SELECT
+        s.tranche,
+        s.wait_us_lt,
+        s.count
+    FROM pg_stat_get_lwlock_wait_histogram() s;
+
+CREATE VIEW pg_stat_buffer_pressure AS
+    SELECT
+        s.backend_writes,
+        s.alloc_rate,
+        s.backend_write_rate,
+        s.pressure
+    FROM pg_stat_get_buffer_pressure() s;
+
+CREATE VIEW pg_stat_buffer_rings AS
+    SELECT
+        s.strategy,
+        s.allocs,
+        s.ring_hits,
+        CASE WHEN s.allocs > 0
+             THEN round(s.ring_hits::numeric / s.allocs, 4)
+             ELSE 0 END AS hit_ratio,
+        s.evict_writes
+    FROM pg_stat_get_buffer_rings() s;
+
 CREATE VIEW pg_stat_bgwriter AS
     SELECT
         pg_stat_get_bgwriter_timed_checkpoints() AS checkpoints_timed,
@@ -267,6 +267,16 @@ static SlruCtlData AsyncCtlData;
 #define QUEUE_PAGESIZE				BLCKSZ
 #define QUEUE_FULL_WARN_INTERVAL	5000		/* warn at most once every 5s */
 
+/*
+ * To reduce the cost of advancing the global tail pointer (which requires
+ * an exclusive scan of all backends' queue positions), we only do so once
+ * every QUEUE_CLEANUP_DELAY pages of queue traffic.  Listeners in other
+ * databases likewise get signaled only once they have fallen at least this
+ * far behind the queue head; they can't consume our notifications anyway,
+ * and only need an occasional nudge so they don't hold back truncation.
+ */
+#define QUEUE_CLEANUP_DELAY 4
+
 /*
  * slru.c currently assumes that all filenames are four characters of hex
  * digits. That means that we can use segments 0000 through FFFF.
@@ -364,6 +374,9 @@ static bool amRegisteredListener = false;
 /* has this backend sent notifications in the current transaction? */
 static bool backendHasSentNotifications = false;
 
+/* have we advanced the queue head far enough to merit a tail advance? */
+static bool tryAdvanceTail = false;
+
 /* GUC parameter */
 bool		Trace_notify = false;
 
@@ -397,10 +410,11 @@ static bool AsyncExistsPendingNotify(const char *channel, const char *payload);
 static void ClearPendingActionsAndNotifies(void);
 
 /*
- * We will work on the page range of 0..QUEUE_MAX_PAGE.
+ * Compute the difference between two queue page numbers (i.e., p - q),
+ * accounting for wraparound.
  */
-static bool
-asyncQueuePagePrecedes(int p, int q)
+static int
+asyncQueuePageDiff(int p, int q)
 {
 	int			diff;
 
@@ -416,7 +430,18 @@ asyncQueuePagePrecedes(int p, int q)
 		diff -= QUEUE_MAX_PAGE + 1;
 	else if (diff < -((QUEUE_MAX_PAGE + 1) / 2))
 		diff += QUEUE_MAX_PAGE + 1;
-	return diff < 0;
+	return diff;
+}
+
+/*
+ * Is p < q, accounting for wraparound?
+ *
+ * We will work on the page range of 0..QUEUE_MAX_PAGE.
+ */
+static bool
+asyncQueuePagePrecedes(int p, int q)
+{
+	return asyncQueuePageDiff(p, q) < 0;
 }
 
 /*
@@ -908,6 +933,13 @@ AtCommit_Notify(void)
 	if (amRegisteredListener && listenChannels == NIL)
 		asyncQueueUnregister();
 
+	/* Might have to advance the global tail pointer */
+	if (tryAdvanceTail)
+	{
+		tryAdvanceTail = false;
+		asyncQueueAdvanceTail();
+	}
+
 	/* And clean up */
 	ClearPendingActionsAndNotifies();
 }
@@ -1393,6 +1425,15 @@ asyncQueueAddEntries(ListCell *nextNotify)
 			 * page without overrunning the queue.
 			 */
 			slotno = SimpleLruZeroPage(AsyncCtl, QUEUE_POS_PAGE(queue_head));
+
+			/*
+			 * If the new page address is a multiple of QUEUE_CLEANUP_DELAY,
+			 * set flag to remember that we should try to advance the tail
+			 * pointer (we don't want to actually do that right here).
+			 */
+			if (QUEUE_POS_PAGE(queue_head) % QUEUE_CLEANUP_DELAY == 0)
+				tryAdvanceTail = true;
+
 			/* And exit the loop */
 			break;
 		}
@@ -1499,7 +1540,12 @@ asyncQueueFillWarning(void)
 }
 
 /*
- * Send signals to all listening backends (except our own).
+ * Send signals to listening backends (except our own).
+ *
+ * Normally we signal only backends in our own database, since only those
+ * backends could be interested in notifies we send.  However, if there's a
+ * backend in some other database that's way behind, signal it anyway, so
+ * that it will advance its queue position and not prevent queue truncation.
  *
  * Returns true if we sent at least one signal.
  *
@@ -1542,12 +1588,29 @@ SignalBackends(void)
 		{
 			QueuePosition pos = QUEUE_BACKEND_POS(i);
 
-			if (!QUEUE_POS_EQUAL(pos, QUEUE_HEAD))
+			if (QUEUE_BACKEND_DBOID(i) == MyDatabaseId)
 			{
-				pids[count] = pid;
-				ids[count] = i;
-				count++;
+				/*
+				 * Always signal listeners in our own database, unless
+				 * they're already caught up (unlikely, but possible).
+				 */
+				if (QUEUE_POS_EQUAL(pos, QUEUE_HEAD))
+					continue;
 			}
+			else
+			{
+				/*
+				 * Listeners in other databases should be signaled only if
+				 * they're far behind.
+				 */
+				if (asyncQueuePageDiff(QUEUE_POS_PAGE(QUEUE_HEAD),
+									 QUEUE_POS_PAGE(pos)) < QUEUE_CLEANUP_DELAY)
+					continue;
+			}
+			/* OK, need to signal this one */
+			pids[count] = pid;
+			ids[count] = i;
+			count++;
 		}
 	}
 	LWLockRelease(AsyncQueueLock);
@@ -1745,9 +1808,7 @@ static void
 asyncQueueReadAllNotifications(void)
 {
 	volatile QueuePosition pos;
-	QueuePosition oldpos;
 	QueuePosition head;
-	bool		advanceTail;
 
 	/* page_buffer must be adequately aligned, so use a union */
 	union
@@ -1760,7 +1821,7 @@ asyncQueueReadAllNotifications(void)
 	LWLockAcquire(AsyncQueueLock, LW_SHARED);
 	/* Assert checks that we have a valid state entry */
 	Assert(MyProcPid == QUEUE_BACKEND_PID(MyBackendId));
-	pos = oldpos = QUEUE_BACKEND_POS(MyBackendId);
+	pos = QUEUE_BACKEND_POS(MyBackendId);
 	head = QUEUE_HEAD;
 	LWLockRelease(AsyncQueueLock);
 
@@ -1865,13 +1926,8 @@ asyncQueueReadAllNotifications(void)
 		/* Update shared state */
 		LWLockAcquire(AsyncQueueLock, LW_SHARED);
 		QUEUE_BACKEND_POS(MyBackendId) = pos;
-		advanceTail = QUEUE_POS_EQUAL(oldpos, QUEUE_TAIL);
 		LWLockRelease(AsyncQueueLock);
 
-		/* If we were the laziest backend, try to advance the tail pointer */
-		if (advanceTail)
-			asyncQueueAdvanceTail();
-
 		PG_RE_THROW();
 	}
 	PG_END_TRY();
@@ -1879,12 +1935,7 @@ asyncQueueReadAllNotifications(void)
 	/* Update shared state */
 	LWLockAcquire(AsyncQueueLock, LW_SHARED);
 	QUEUE_BACKEND_POS(MyBackendId) = pos;
-	advanceTail = QUEUE_POS_EQUAL(oldpos, QUEUE_TAIL);
 	LWLockRelease(AsyncQueueLock);
-
-	/* If we were the laziest backend, try to advance the tail pointer */
-	if (advanceTail)
-		asyncQueueAdvanceTail();
 }
 
 /*
@@ -18,6 +18,8 @@
 #include "postgres.h"
 
 #include "access/amapi.h"
+#include "access/genam.h"
+#include "access/heapam.h"
 #include "access/multixact.h"
 #include "access/relscan.h"
 #include "access/rewriteheap.h"
@@ -36,6 +38,7 @@
 #include "commands/cluster.h"
 #include "commands/tablecmds.h"
 #include "commands/vacuum.h"
+#include "executor/executor.h"
 #include "miscadmin.h"
 #include "optimizer/planner.h"
 #include "storage/bufmgr.h"
@@ -43,6 +46,7 @@
 #include "storage/predicate.h"
 #include "storage/smgr.h"
 #include "utils/acl.h"
+#include "utils/builtins.h"
 #include "utils/fmgroids.h"
 #include "utils/inval.h"
 #include "utils/lsyscache.h"
@@ -1737,3 +1741,204 @@ reform_and_rewrite_tuple(HeapTuple tuple,
 
 	heap_freetuple(copiedTuple);
 }
+
+/*
+ * pg_incremental_cluster(regclass, int4) returns int8
+ *
+ * Migrate up to max_moves tuples of the given table toward the order of
+ * its clustered index, without taking more than RowExclusiveLock.  This
+ * is the batch primitive for online clustering: unlike CLUSTER it never
+ * rewrites the table or blocks concurrent DML, so it can be run
+ * repeatedly (from cron or a maintenance daemon) to restore the heap
+ * correlation that range scans depend on.
+ *
+ * We walk the clustered index in order and compare each tuple's block
+ * number against the block a perfectly correlated heap would place it on
+ * (scaled by reltuples, so the estimate is only as fresh as the last
+ * VACUUM/ANALYZE).  Tuples lying well outside that window are re-inserted
+ * through a regular MVCC heap_update with identical contents, with
+ * heap_relocate_update set so the new version always goes through the
+ * FSM/extension path rather than staying on its old page.  Because the
+ * batch is processed in index order and consecutive relocations tend to
+ * fill the same target pages, the moved tuples come out clustered even
+ * though we do not choose their destination explicitly; the abandoned
+ * versions are reclaimed by ordinary vacuuming.
+ *
+ * Tuples that are concurrently updated or deleted while we work are
+ * simply skipped.  The return value is the number of tuples moved.
+ */
+Datum
+pg_incremental_cluster(PG_FUNCTION_ARGS)
+{
+	Oid			tableOid = PG_GETARG_OID(0);
+	int32		max_moves = PG_GETARG_INT32(1);
+	Relation	OldHeap;
+	Relation	indexRel;
+	Oid			indexOid = InvalidOid;
+	IndexScanDesc scan;
+	HeapTuple	tuple;
+	EState	   *estate;
+	ResultRelInfo *resultRelInfo;
+	TupleTableSlot *slot;
+	BlockNumber nblocks;
+	BlockNumber slack;
+	double		reltuples;
+	double		scanned = 0;
+	int64		moved = 0;
+	CommandId	cid;
+	ListCell   *index;
+
+	if (max_moves <= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("batch size must be positive")));
+
+	OldHeap = heap_open(tableOid, RowExclusiveLock);
+
+	if (!pg_class_ownercheck(tableOid, GetUserId()))
+		aclcheck_error(ACLCHECK_NOT_OWNER, ACL_KIND_CLASS,
+					   RelationGetRelationName(OldHeap));
+
+	if (OldHeap->rd_rel->relkind != RELKIND_RELATION)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not a table",
+						RelationGetRelationName(OldHeap))));
+
+	if (RELATION_IS_OTHER_TEMP(OldHeap))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			   errmsg("cannot cluster temporary tables of other sessions")));
+
+	/* We need to find the index that has indisclustered set. */
+	foreach(index, RelationGetIndexList(OldHeap))
+	{
+		HeapTuple	idxtuple;
+		Form_pg_index indexForm;
+
+		indexOid = lfirst_oid(index);
+		idxtuple = SearchSysCache1(INDEXRELID,
+								   ObjectIdGetDatum(indexOid));
+		if (!HeapTupleIsValid(idxtuple))
+			elog(ERROR, "cache lookup failed for index %u", indexOid);
+		indexForm = (Form_pg_index) GETSTRUCT(idxtuple);
+		if (indexForm->indisclustered)
+		{
+			ReleaseSysCache(idxtuple);
+			break;
+		}
+		ReleaseSysCache(idxtuple);
+		indexOid = InvalidOid;
+	}
+
+	if (!OidIsValid(indexOid))
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_OBJECT),
+				 errmsg("there is no previously clustered index for table \"%s\"",
+						RelationGetRelationName(OldHeap))));
+
+	check_index_is_clusterable(OldHeap, indexOid, true, RowExclusiveLock);
+
+	indexRel = index_open(indexOid, RowExclusiveLock);
+
+	nblocks = RelationGetNumberOfBlocks(OldHeap);
+	reltuples = OldHeap->rd_rel->reltuples;
+	if (reltuples < 1)
+		reltuples = 1;
+
+	/*
+	 * How far a tuple may sit from its ideal block before we consider it
+	 * misplaced.  Too tight a window would move tuples forever; 5% of the
+	 * table (at least 16 blocks) leaves well-correlated tables alone.
+	 */
+	slack = Max(nblocks / 20, 16);
+
+	/* executor machinery for inserting index entries for moved tuples */
+	estate = CreateExecutorState();
+	resultRelInfo = makeNode(ResultRelInfo);
+	InitResultRelInfo(resultRelInfo,
+					  OldHeap,
+					  1,		/* dummy rangetable index */
+					  0);
+	ExecOpenIndices(resultRelInfo, false);
+	estate->es_result_relations = resultRelInfo;
+	estate->es_num_result_relations = 1;
+	estate->es_result_relation_info = resultRelInfo;
+	slot = MakeSingleTupleTableSlot(RelationGetDescr(OldHeap));
+
+	cid = GetCurrentCommandId(true);
+
+	/*
+	 * Walk the index in order.  New tuple versions we create are invisible
+	 * to the scan's snapshot (their cmin equals the snapshot's curcid), so
+	 * we cannot revisit a tuple we have already moved.
+	 */
+	scan = index_beginscan(OldHeap, indexRel, GetActiveSnapshot(), 0, 0);
+	index_rescan(scan, NULL, 0, NULL, 0);
+
+	while ((tuple = index_getnext(scan, ForwardScanDirection)) != NULL)
+	{
+		BlockNumber blkno = ItemPointerGetBlockNumber(&tuple->t_self);
+		BlockNumber ideal;
+		HeapTuple	newtup;
+		HTSU_Result result;
+		HeapUpdateFailureData hufd;
+		LockTupleMode lockmode;
+
+		CHECK_FOR_INTERRUPTS();
+
+		ideal = (BlockNumber) (scanned / reltuples * nblocks);
+		scanned += 1;
+
+		if (blkno + slack >= ideal && blkno <= ideal + slack)
+			continue;			/* close enough to its ideal position */
+
+		/* re-insert the tuple, forcing the new version off its page */
+		newtup = heap_copytuple(tuple);
+
+		heap_relocate_update = true;
+		PG_TRY();
+		{
+			result = heap_update(OldHeap, &tuple->t_self, newtup,
+								 cid, InvalidSnapshot, true,
+								 &hufd, &lockmode);
+		}
+		PG_CATCH();
+		{
+			heap_relocate_update = false;
+			PG_RE_THROW();
+		}
+		PG_END_TRY();
+		heap_relocate_update = false;
+
+		if (result == HeapTupleMayBeUpdated)
+		{
+			/* moved; index the new version unless it ended up HOT anyway */
+			if (!HeapTupleIsHeapOnly(newtup))
+			{
+				ExecStoreTuple(newtup, slot, InvalidBuffer, false);
+				ExecInsertIndexTuples(slot, &newtup->t_self, estate,
+									  false, NULL, NIL);
+			}
+			moved++;
+		}
+		heap_freetuple(newtup);
+
+		/* concurrently updated or deleted tuples are somebody else's now */
+
+		if (moved >= max_moves)
+			break;
+	}
+
+	index_endscan(scan);
+
+	ExecDropSingleTupleTableSlot(slot);
+	ExecCloseIndices(resultRelInfo);
+	FreeExecutorState(estate);
+
+	/* close relations, keep locks till commit */
+	index_close(indexRel, NoLock);
+	heap_close(OldHeap, NoLock);
+
+	PG_RETURN_INT64(moved);
+}
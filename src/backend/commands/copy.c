@@ -22,6 +22,7 @@
 
 #include "access/heapam.h"
 #include "access/htup_details.h"
+#include "access/parallel.h"
 #include "access/sysattr.h"
 #include "access/xact.h"
 #include "access/xlog.h"
@@ -39,6 +40,8 @@
 #include "nodes/makefuncs.h"
 #include "rewrite/rewriteHandler.h"
 #include "storage/fd.h"
+#include "storage/shm_mq.h"
+#include "storage/shm_toc.h"
 #include "tcop/tcopprot.h"
 #include "utils/builtins.h"
 #include "utils/lsyscache.h"
@@ -60,9 +63,13 @@ typedef enum CopyDest
 {
 	COPY_FILE,					/* to/from file (or a piped program) */
 	COPY_OLD_FE,				/* to/from frontend (2.0 protocol) */
-	COPY_NEW_FE					/* to/from frontend (3.0 protocol) */
+	COPY_NEW_FE,				/* to/from frontend (3.0 protocol) */
+	COPY_CALLBACK				/* to callback function (parallel workers) */
 } CopyDest;
 
+/* Callback used with COPY_CALLBACK to deliver each formatted row */
+typedef void (*copy_data_dest_cb) (void *arg, const char *data, int len);
+
 /*
  *	Represents the end-of-line terminator type of the input
  */
@@ -98,6 +105,9 @@ typedef struct CopyStateData
 	StringInfo	fe_msgbuf;		/* used for all dests during COPY TO, only for
 								 * dest == COPY_NEW_FE in COPY FROM */
 	bool		fe_eof;			/* true if detected end of copy data */
+	copy_data_dest_cb data_dest_cb;		/* used if copy_dest == COPY_CALLBACK */
+	void	   *data_dest_cb_arg;
+	bool		data_dest_crlf; /* callback rows end in \r\n, not \n */
 	EolType		eol_type;		/* EOL type of input */
 	int			file_encoding;	/* file or remote side's character encoding */
 	bool		need_transcoding;		/* file encoding diff from server? */
@@ -112,6 +122,8 @@ typedef struct CopyStateData
 	bool		binary;			/* binary format? */
 	bool		oids;			/* include OIDs? */
 	bool		freeze;			/* freeze rows on loading? */
+	int			nworkers;		/* PARALLEL option for COPY TO */
+	List	   *options;		/* raw options list, for parallel workers */
 	bool		csv_mode;		/* Comma Separated Value format? */
 	bool		header_line;	/* CSV header line? */
 	char	   *null_print;		/* NULL marker string (server encoding!) */
@@ -290,6 +302,12 @@ static CopyState BeginCopyTo(Relation rel, Node *query, const char *queryString,
 static void EndCopyTo(CopyState cstate);
 static uint64 DoCopyTo(CopyState cstate);
 static uint64 CopyTo(CopyState cstate);
+static void CopyToPrepareOutput(CopyState cstate, TupleDesc tupDesc);
+static uint64 CopyToScanLoop(CopyState cstate, TupleDesc tupDesc,
+			   HeapScanDesc scandesc);
+static bool CopyToParallel(CopyState cstate, uint64 *processed);
+static void ParallelCopyToMain(dsm_segment *seg, shm_toc *toc);
+static void ParallelCopyToSendRow(void *arg, const char *data, int len);
 static void CopyOneRowTo(CopyState cstate, Oid tupleOid,
 			 Datum *values, bool *nulls);
 static uint64 CopyFrom(CopyState cstate);
@@ -322,6 +340,7 @@ static void CopySendData(CopyState cstate, const void *databuf, int datasize);
 static void CopySendString(CopyState cstate, const char *str);
 static void CopySendChar(CopyState cstate, char c);
 static void CopySendEndOfRow(CopyState cstate);
+static void CopySendBuffer(CopyState cstate);
 static int CopyGetData(CopyState cstate, void *databuf,
 			int minread, int maxread);
 static void CopySendInt32(CopyState cstate, int32 val);
@@ -477,21 +496,50 @@ CopySendChar(CopyState cstate, char c)
 static void
 CopySendEndOfRow(CopyState cstate)
 {
-	StringInfo	fe_msgbuf = cstate->fe_msgbuf;
-
-	switch (cstate->copy_dest)
+	if (!cstate->binary)
 	{
-		case COPY_FILE:
-			if (!cstate->binary)
-			{
+		switch (cstate->copy_dest)
+		{
+			case COPY_FILE:
 				/* Default line termination depends on platform */
 #ifndef WIN32
 				CopySendChar(cstate, '\n');
 #else
 				CopySendString(cstate, "\r\n");
 #endif
-			}
+				break;
+			case COPY_OLD_FE:
+			case COPY_NEW_FE:
+				/* The FE/BE protocol uses \n as newline for all platforms */
+				CopySendChar(cstate, '\n');
+				break;
+			case COPY_CALLBACK:
+				/* Emit the newline the leader's destination expects */
+				if (cstate->data_dest_crlf)
+					CopySendString(cstate, "\r\n");
+				else
+					CopySendChar(cstate, '\n');
+				break;
+		}
+	}
 
+	CopySendBuffer(cstate);
+}
+
+/*
+ * CopySendBuffer pushes the contents of fe_msgbuf to the destination and
+ * resets the buffer.  Split out of CopySendEndOfRow so that rows arriving
+ * preformatted from parallel COPY TO workers (newline included) can be
+ * forwarded without appending another line terminator.
+ */
+static void
+CopySendBuffer(CopyState cstate)
+{
+	StringInfo	fe_msgbuf = cstate->fe_msgbuf;
+
+	switch (cstate->copy_dest)
+	{
+		case COPY_FILE:
 			if (fwrite(fe_msgbuf->data, fe_msgbuf->len, 1,
 					   cstate->copy_file) != 1 ||
 				ferror(cstate->copy_file))
@@ -526,10 +574,6 @@ CopySendEndOfRow(CopyState cstate)
 			}
 			break;
 		case COPY_OLD_FE:
-			/* The FE/BE protocol uses \n as newline for all platforms */
-			if (!cstate->binary)
-				CopySendChar(cstate, '\n');
-
 			if (pq_putbytes(fe_msgbuf->data, fe_msgbuf->len))
 			{
 				/* no hope of recovering connection sync, so FATAL */
@@ -539,13 +583,13 @@ CopySendEndOfRow(CopyState cstate)
 			}
 			break;
 		case COPY_NEW_FE:
-			/* The FE/BE protocol uses \n as newline for all platforms */
-			if (!cstate->binary)
-				CopySendChar(cstate, '\n');
-
 			/* Dump the accumulated row as one CopyData message */
 			(void) pq_putmessage('d', fe_msgbuf->data, fe_msgbuf->len);
 			break;
+		case COPY_CALLBACK:
+			cstate->data_dest_cb(cstate->data_dest_cb_arg,
+								 fe_msgbuf->data, fe_msgbuf->len);
+			break;
 	}
 
 	resetStringInfo(fe_msgbuf);
@@ -596,6 +640,9 @@ CopyGetData(CopyState cstate, void *databuf, int minread, int maxread)
 			}
 			bytesread = minread;
 			break;
+		case COPY_CALLBACK:
+			elog(ERROR, "COPY_CALLBACK cannot be used as a COPY source");
+			break;
 		case COPY_NEW_FE:
 			while (maxread > 0 && bytesread < minread && !cstate->fe_eof)
 			{
@@ -1138,6 +1185,19 @@ ProcessCopyOptions(CopyState cstate,
 						 errmsg("argument to option \"%s\" must be a list of column names",
 								defel->defname)));
 		}
+		else if (strcmp(defel->defname, "parallel") == 0)
+		{
+			if (cstate->nworkers > 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("conflicting or redundant options")));
+			cstate->nworkers = defGetInt32(defel);
+			if (cstate->nworkers <= 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("argument to option \"%s\" must be a positive integer",
+								defel->defname)));
+		}
 		else if (strcmp(defel->defname, "encoding") == 0)
 		{
 			if (cstate->file_encoding >= 0)
@@ -1230,6 +1290,12 @@ ProcessCopyOptions(CopyState cstate,
 				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
 				 errmsg("COPY HEADER available only in CSV mode")));
 
+	/* Check parallel: loading rows in parallel workers is not possible */
+	if (cstate->nworkers > 0 && is_from)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("COPY PARALLEL is only supported for COPY TO")));
+
 	/* Check quote */
 	if (!cstate->csv_mode && cstate->quote != NULL)
 		ereport(ERROR,
@@ -1349,6 +1415,9 @@ BeginCopy(bool is_from,
 	/* Extract options from the statement node tree */
 	ProcessCopyOptions(cstate, is_from, options);
 
+	/* Keep the raw list too; parallel COPY TO workers rebuild from it */
+	cstate->options = copyObject(options);
+
 	/* Process the source/target relation or query */
 	if (rel)
 	{
@@ -1846,25 +1915,30 @@ EndCopyTo(CopyState cstate)
 }
 
 /*
- * Copy from relation or query TO file.
+ * Set up the per-row output state for COPY TO: the row buffer, the output
+ * functions for the columns being dumped, and a per-row memory context.
+ * This is shared between the normal CopyTo() path and parallel COPY TO
+ * workers, which perform the same per-row formatting on their own slice of
+ * the table.
  */
-static uint64
-CopyTo(CopyState cstate)
+static void
+CopyToPrepareOutput(CopyState cstate, TupleDesc tupDesc)
 {
-	TupleDesc	tupDesc;
-	int			num_phys_attrs;
-	Form_pg_attribute *attr;
+	Form_pg_attribute *attr = tupDesc->attrs;
+	int			num_phys_attrs = tupDesc->natts;
 	ListCell   *cur;
-	uint64		processed;
 
-	if (cstate->rel)
-		tupDesc = RelationGetDescr(cstate->rel);
-	else
-		tupDesc = cstate->queryDesc->tupDesc;
-	attr = tupDesc->attrs;
-	num_phys_attrs = tupDesc->natts;
 	cstate->null_print_client = cstate->null_print;		/* default */
 
+	/*
+	 * For non-binary copy, we need to convert null_print to file encoding,
+	 * because it will be sent directly with CopySendString.
+	 */
+	if (!cstate->binary && cstate->need_transcoding)
+		cstate->null_print_client = pg_server_to_any(cstate->null_print,
+													 cstate->null_print_len,
+													 cstate->file_encoding);
+
 	/* We use fe_msgbuf as a per-row buffer regardless of copy_dest */
 	cstate->fe_msgbuf = makeStringInfo();
 
@@ -1898,6 +1972,60 @@ CopyTo(CopyState cstate)
 											   ALLOCSET_DEFAULT_MINSIZE,
 											   ALLOCSET_DEFAULT_INITSIZE,
 											   ALLOCSET_DEFAULT_MAXSIZE);
+}
+
+/*
+ * Dump every tuple returned by the given (possibly parallel) heap scan.
+ * Returns the number of rows emitted.
+ */
+static uint64
+CopyToScanLoop(CopyState cstate, TupleDesc tupDesc, HeapScanDesc scandesc)
+{
+	int			num_phys_attrs = tupDesc->natts;
+	Datum	   *values;
+	bool	   *nulls;
+	HeapTuple	tuple;
+	uint64		processed = 0;
+
+	values = (Datum *) palloc(num_phys_attrs * sizeof(Datum));
+	nulls = (bool *) palloc(num_phys_attrs * sizeof(bool));
+
+	while ((tuple = heap_getnext(scandesc, ForwardScanDirection)) != NULL)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		/* Deconstruct the tuple ... faster than repeated heap_getattr */
+		heap_deform_tuple(tuple, tupDesc, values, nulls);
+
+		/* Format and send the data */
+		CopyOneRowTo(cstate, HeapTupleGetOid(tuple), values, nulls);
+		processed++;
+	}
+
+	pfree(values);
+	pfree(nulls);
+
+	return processed;
+}
+
+/*
+ * Copy from relation or query TO file.
+ */
+static uint64
+CopyTo(CopyState cstate)
+{
+	TupleDesc	tupDesc;
+	Form_pg_attribute *attr;
+	ListCell   *cur;
+	uint64		processed;
+
+	if (cstate->rel)
+		tupDesc = RelationGetDescr(cstate->rel);
+	else
+		tupDesc = cstate->queryDesc->tupDesc;
+	attr = tupDesc->attrs;
+
+	CopyToPrepareOutput(cstate, tupDesc);
 
 	if (cstate->binary)
 	{
@@ -1917,15 +2045,6 @@ CopyTo(CopyState cstate)
 	}
 	else
 	{
-		/*
-		 * For non-binary copy, we need to convert null_print to file
-		 * encoding, because it will be sent directly with CopySendString.
-		 */
-		if (cstate->need_transcoding)
-			cstate->null_print_client = pg_server_to_any(cstate->null_print,
-													  cstate->null_print_len,
-													  cstate->file_encoding);
-
 		/* if a header has been requested send the line */
 		if (cstate->header_line)
 		{
@@ -1952,33 +2071,15 @@ CopyTo(CopyState cstate)
 
 	if (cstate->rel)
 	{
-		Datum	   *values;
-		bool	   *nulls;
-		HeapScanDesc scandesc;
-		HeapTuple	tuple;
-
-		values = (Datum *) palloc(num_phys_attrs * sizeof(Datum));
-		nulls = (bool *) palloc(num_phys_attrs * sizeof(bool));
-
-		scandesc = heap_beginscan(cstate->rel, GetActiveSnapshot(), 0, NULL);
-
-		processed = 0;
-		while ((tuple = heap_getnext(scandesc, ForwardScanDirection)) != NULL)
+		if (cstate->nworkers <= 0 || !CopyToParallel(cstate, &processed))
 		{
-			CHECK_FOR_INTERRUPTS();
+			HeapScanDesc scandesc;
 
-			/* Deconstruct the tuple ... faster than repeated heap_getattr */
-			heap_deform_tuple(tuple, tupDesc, values, nulls);
-
-			/* Format and send the data */
-			CopyOneRowTo(cstate, HeapTupleGetOid(tuple), values, nulls);
-			processed++;
+			scandesc = heap_beginscan(cstate->rel, GetActiveSnapshot(),
+									  0, NULL);
+			processed = CopyToScanLoop(cstate, tupDesc, scandesc);
+			heap_endscan(scandesc);
 		}
-
-		heap_endscan(scandesc);
-
-		pfree(values);
-		pfree(nulls);
 	}
 	else
 	{
@@ -2000,6 +2101,255 @@ CopyTo(CopyState cstate)
 	return processed;
 }
 
+/*
+ * Parallel COPY TO.
+ *
+ * When COPY (... PARALLEL n) dumps a plain table, the leader launches n
+ * parallel workers that share a parallel heap scan of the relation.  Each
+ * worker formats its tuples with the normal COPY TO output machinery and
+ * ships the finished rows (text, CSV, or binary row images) to the leader
+ * through a private shared memory queue.  The leader drains the queues and
+ * forwards the rows to the real destination, so all file/protocol I/O still
+ * happens in one process and the overall output remains a valid COPY stream.
+ * Rows arrive grouped by worker rather than in physical order, but COPY TO
+ * has never promised any particular row order.
+ */
+
+/* Magic numbers for parallel COPY TO's shared memory TOC */
+#define PARALLEL_COPY_KEY_FIXED			UINT64CONST(0xFACADE0000000001)
+#define PARALLEL_COPY_KEY_OPTIONS		UINT64CONST(0xFACADE0000000002)
+#define PARALLEL_COPY_KEY_ATTNUMLIST	UINT64CONST(0xFACADE0000000003)
+#define PARALLEL_COPY_KEY_SCAN			UINT64CONST(0xFACADE0000000004)
+#define PARALLEL_COPY_KEY_QUEUES		UINT64CONST(0xFACADE0000000005)
+
+/* Size of each worker-to-leader row queue */
+#define PARALLEL_COPY_QUEUE_SIZE		65536
+
+/* Fixed-size state shared with parallel COPY TO workers */
+typedef struct ParallelCopyToFixed
+{
+	Oid			relid;			/* table being dumped */
+	bool		crlf;			/* use CRLF line endings? (leader's choice) */
+} ParallelCopyToFixed;
+
+/*
+ * Run a parallel COPY TO scan of cstate->rel, setting *processed to the
+ * number of rows emitted.  Returns false without doing anything if parallel
+ * execution is not possible; the caller then falls back to a serial scan.
+ */
+static bool
+CopyToParallel(CopyState cstate, uint64 *processed)
+{
+	ParallelContext *pcxt;
+	ParallelCopyToFixed *fixed;
+	char	   *optstr;
+	char	   *attstr;
+	char	   *optspace;
+	char	   *attspace;
+	ParallelHeapScanDesc pscan;
+	char	   *queuespace;
+	shm_mq_handle **mqh;
+	Size		pscan_len;
+	uint64		nrows = 0;
+	int			i;
+
+	/*
+	 * Parallel workers are unavailable in standalone backends, inside
+	 * another parallel operation, and for relations using local buffers
+	 * (temp tables), whose contents other backends cannot see.
+	 */
+	if (!IsUnderPostmaster ||
+		IsInParallelMode() ||
+		RelationUsesLocalBuffers(cstate->rel))
+		return false;
+
+	EnterParallelMode();
+
+	pcxt = CreateParallelContext(ParallelCopyToMain, cstate->nworkers);
+
+	optstr = nodeToString(cstate->options);
+	attstr = nodeToString(cstate->attnumlist);
+	pscan_len = heap_parallelscan_estimate(GetActiveSnapshot());
+
+	/* Estimate space for the five TOC entries, then create the DSM */
+	shm_toc_estimate_chunk(&pcxt->estimator, sizeof(ParallelCopyToFixed));
+	shm_toc_estimate_chunk(&pcxt->estimator, strlen(optstr) + 1);
+	shm_toc_estimate_chunk(&pcxt->estimator, strlen(attstr) + 1);
+	shm_toc_estimate_chunk(&pcxt->estimator, pscan_len);
+	shm_toc_estimate_chunk(&pcxt->estimator,
+					   mul_size(PARALLEL_COPY_QUEUE_SIZE, pcxt->nworkers));
+	shm_toc_estimate_keys(&pcxt->estimator, 5);
+	InitializeParallelDSM(pcxt);
+
+	fixed = shm_toc_allocate(pcxt->toc, sizeof(ParallelCopyToFixed));
+	fixed->relid = RelationGetRelid(cstate->rel);
+#ifdef WIN32
+	fixed->crlf = (cstate->copy_dest == COPY_FILE);
+#else
+	fixed->crlf = false;
+#endif
+	shm_toc_insert(pcxt->toc, PARALLEL_COPY_KEY_FIXED, fixed);
+
+	optspace = shm_toc_allocate(pcxt->toc, strlen(optstr) + 1);
+	strcpy(optspace, optstr);
+	shm_toc_insert(pcxt->toc, PARALLEL_COPY_KEY_OPTIONS, optspace);
+
+	attspace = shm_toc_allocate(pcxt->toc, strlen(attstr) + 1);
+	strcpy(attspace, attstr);
+	shm_toc_insert(pcxt->toc, PARALLEL_COPY_KEY_ATTNUMLIST, attspace);
+
+	pscan = shm_toc_allocate(pcxt->toc, pscan_len);
+	heap_parallelscan_initialize(pscan, cstate->rel, GetActiveSnapshot());
+	shm_toc_insert(pcxt->toc, PARALLEL_COPY_KEY_SCAN, pscan);
+
+	queuespace = shm_toc_allocate(pcxt->toc,
+					   mul_size(PARALLEL_COPY_QUEUE_SIZE, pcxt->nworkers));
+	shm_toc_insert(pcxt->toc, PARALLEL_COPY_KEY_QUEUES, queuespace);
+
+	mqh = palloc(pcxt->nworkers * sizeof(shm_mq_handle *));
+	for (i = 0; i < pcxt->nworkers; i++)
+	{
+		shm_mq	   *mq;
+
+		mq = shm_mq_create(queuespace + i * PARALLEL_COPY_QUEUE_SIZE,
+						   PARALLEL_COPY_QUEUE_SIZE);
+		shm_mq_set_receiver(mq, MyProc);
+		mqh[i] = shm_mq_attach(mq, pcxt->seg, NULL);
+	}
+
+	LaunchParallelWorkers(pcxt);
+
+	if (pcxt->nworkers_launched == 0)
+	{
+		/* No workers available; let the caller do a plain serial scan. */
+		DestroyParallelContext(pcxt);
+		ExitParallelMode();
+		pfree(mqh);
+		return false;
+	}
+
+	for (i = 0; i < pcxt->nworkers_launched; i++)
+		shm_mq_set_handle(mqh[i], pcxt->worker[i].bgwhandle);
+
+	/*
+	 * Drain the queues one worker at a time.  Queues are independent, so
+	 * this cannot deadlock: a worker whose queue fills up simply blocks in
+	 * shm_mq_send until we get to it, while the workers we are not reading
+	 * from keep scanning until their own queues fill.
+	 */
+	for (i = 0; i < pcxt->nworkers_launched; i++)
+	{
+		for (;;)
+		{
+			shm_mq_result res;
+			Size		nbytes;
+			void	   *data;
+
+			res = shm_mq_receive(mqh[i], &nbytes, &data, false);
+			if (res == SHM_MQ_DETACHED)
+				break;
+			Assert(res == SHM_MQ_SUCCESS);
+
+			/* Each message is one fully formatted row; pass it through. */
+			appendBinaryStringInfo(cstate->fe_msgbuf, data, nbytes);
+			CopySendBuffer(cstate);
+			nrows++;
+		}
+	}
+
+	WaitForParallelWorkersToFinish(pcxt);
+	DestroyParallelContext(pcxt);
+	ExitParallelMode();
+	pfree(mqh);
+
+	*processed = nrows;
+	return true;
+}
+
+/*
+ * Entrypoint for parallel COPY TO workers.
+ *
+ * Rebuild enough CopyState to format rows, claim a slice of the shared heap
+ * scan, and stream each formatted row to the leader over our queue.
+ */
+static void
+ParallelCopyToMain(dsm_segment *seg, shm_toc *toc)
+{
+	ParallelCopyToFixed *fixed;
+	char	   *optstr;
+	char	   *attstr;
+	ParallelHeapScanDesc pscan;
+	char	   *queuespace;
+	shm_mq	   *mq;
+	shm_mq_handle *mqh;
+	Relation	rel;
+	CopyState	cstate;
+	HeapScanDesc scandesc;
+
+	fixed = shm_toc_lookup(toc, PARALLEL_COPY_KEY_FIXED);
+	optstr = shm_toc_lookup(toc, PARALLEL_COPY_KEY_OPTIONS);
+	attstr = shm_toc_lookup(toc, PARALLEL_COPY_KEY_ATTNUMLIST);
+	pscan = shm_toc_lookup(toc, PARALLEL_COPY_KEY_SCAN);
+	queuespace = shm_toc_lookup(toc, PARALLEL_COPY_KEY_QUEUES);
+
+	mq = (shm_mq *) (queuespace +
+					 ParallelWorkerNumber * PARALLEL_COPY_QUEUE_SIZE);
+	shm_mq_set_sender(mq, MyProc);
+	mqh = shm_mq_attach(mq, seg, NULL);
+
+	/* The leader already holds a conflicting-enough lock on the table. */
+	rel = heap_open(fixed->relid, AccessShareLock);
+
+	cstate = BeginCopy(false, rel, NULL, NULL, InvalidOid, NIL,
+					   (List *) stringToNode(optstr));
+
+	/*
+	 * Use the leader's resolved attribute list rather than re-deriving it;
+	 * the options list carries column names only for the force_* options.
+	 */
+	cstate->attnumlist = (List *) stringToNode(attstr);
+
+	cstate->copy_dest = COPY_CALLBACK;
+	cstate->data_dest_cb = ParallelCopyToSendRow;
+	cstate->data_dest_cb_arg = mqh;
+	cstate->data_dest_crlf = fixed->crlf;
+
+	CopyToPrepareOutput(cstate, RelationGetDescr(rel));
+
+	scandesc = heap_beginscan_parallel(rel, pscan);
+	(void) CopyToScanLoop(cstate, RelationGetDescr(rel), scandesc);
+	heap_endscan(scandesc);
+
+	MemoryContextDelete(cstate->rowcontext);
+
+	/* Tell the leader we are done; this wakes it if it is waiting on us. */
+	if (shm_mq_flush(mqh) != SHM_MQ_SUCCESS)
+		ereport(ERROR,
+				(errcode(ERRCODE_CONNECTION_FAILURE),
+				 errmsg("lost connection to parallel COPY leader")));
+	shm_mq_detach(mq);
+
+	EndCopy(cstate);
+	heap_close(rel, AccessShareLock);
+}
+
+/*
+ * COPY_CALLBACK destination for parallel COPY TO workers: forward one
+ * formatted row to the leader.
+ */
+static void
+ParallelCopyToSendRow(void *arg, const char *data, int len)
+{
+	shm_mq_handle *mqh = (shm_mq_handle *) arg;
+	shm_mq_result res;
+
+	res = shm_mq_send(mqh, len, data, false, false);
+	if (res != SHM_MQ_SUCCESS)
+		ereport(ERROR,
+				(errcode(ERRCODE_CONNECTION_FAILURE),
+				 errmsg("lost connection to parallel COPY leader")));
+}
+
 /*
  * Emit one row during CopyTo().
  */
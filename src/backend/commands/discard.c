@@ -22,8 +22,6 @@
 #include "utils/guc.h"
 #include "utils/portal.h"
 
-static void DiscardAll(bool isTopLevel);
-
 /*
  * DISCARD { ALL | SEQUENCES | TEMP | PLANS }
  */
@@ -53,7 +51,11 @@ DiscardCommand(DiscardStmt *stmt, bool isTopLevel)
 	}
 }
 
-static void
+/*
+ * Exported so the backend pool can give a recycled session the same
+ * scrubbing DISCARD ALL provides.
+ */
+void
 DiscardAll(bool isTopLevel)
 {
 	/*
@@ -42,8 +42,10 @@
 #include "access/heapam_xlog.h"
 #include "access/htup_details.h"
 #include "access/multixact.h"
+#include "access/parallel.h"
 #include "access/transam.h"
 #include "access/visibilitymap.h"
+#include "access/xact.h"
 #include "access/xlog.h"
 #include "catalog/catalog.h"
 #include "catalog/storage.h"
@@ -56,6 +58,7 @@
 #include "storage/bufmgr.h"
 #include "storage/freespace.h"
 #include "storage/lmgr.h"
+#include "storage/shmem.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/pg_rusage.h"
@@ -97,6 +100,15 @@
  */
 #define SKIP_PAGES_THRESHOLD	((BlockNumber) 32)
 
+/*
+ * DSM keys for parallel index vacuuming.  Values are arbitrary, but must be
+ * unique within this table of contents.
+ */
+#define PARALLEL_VACUUM_KEY_SHARED		UINT64CONST(0xD000000000000001)
+#define PARALLEL_VACUUM_KEY_DEAD_TUPLES UINT64CONST(0xD000000000000002)
+#define PARALLEL_VACUUM_KEY_INDEX_OIDS	UINT64CONST(0xD000000000000003)
+#define PARALLEL_VACUUM_KEY_INDEX_STATS UINT64CONST(0xD000000000000004)
+
 typedef struct LVRelStats
 {
 	/* hasindex = true means two-pass strategy; false means one-pass */
@@ -123,6 +135,33 @@ typedef struct LVRelStats
 	bool		lock_waiter_detected;
 } LVRelStats;
 
+/*
+ * Shared state for parallel index vacuuming, stored in the parallel DSM
+ * segment.  Each participant (the leader included) repeatedly claims the
+ * next unprocessed index via the nextindex counter and bulk-deletes it.
+ */
+typedef struct LVParallelShared
+{
+	int			nindexes;		/* number of entries in the OID/stats arrays */
+	int			elevel;			/* message level for progress reports */
+	double		num_heap_tuples;	/* last known live-tuple estimate */
+	int			num_dead_tuples;	/* entries in the shared TID array */
+	pg_atomic_uint32 nextindex; /* next unclaimed index array slot */
+} LVParallelShared;
+
+/*
+ * Per-index slot for passing bulk-delete statistics between vacuuming
+ * rounds and back to the leader.  IndexBulkDeleteResult is a flat struct,
+ * so it can simply be copied through shared memory.
+ */
+typedef struct LVParallelIndStats
+{
+	bool		updated;		/* stats field holds valid data */
+	IndexBulkDeleteResult stats;
+} LVParallelIndStats;
+
+/* GUC variable */
+int			max_parallel_vacuum_workers = 0;
 
 /* A few variables that don't seem worth passing around as parameters */
 static int	elevel = -1;
@@ -139,6 +178,16 @@ static void lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 			   Relation *Irel, int nindexes, bool scan_all);
 static void lazy_vacuum_heap(Relation onerel, LVRelStats *vacrelstats);
 static bool lazy_check_needs_freeze(Buffer buf, bool *hastup);
+static void lazy_vacuum_all_indexes(Relation onerel, Relation *Irel,
+						int nindexes, IndexBulkDeleteResult **indstats,
+						LVRelStats *vacrelstats);
+static void lazy_parallel_vacuum_indexes(Relation *Irel, int nindexes,
+							 IndexBulkDeleteResult **indstats,
+							 LVRelStats *vacrelstats, int nworkers);
+static void lazy_parallel_vacuum_scan(LVParallelShared *shared, Oid *indoids,
+						  LVParallelIndStats *pindstats,
+						  ItemPointer dead_tuples);
+static void lazy_parallel_vacuum_main(dsm_segment *seg, shm_toc *toc);
 static void lazy_vacuum_index(Relation indrel,
 				  IndexBulkDeleteResult **stats,
 				  LVRelStats *vacrelstats);
@@ -447,6 +496,7 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 	PGRUsage	ru0;
 	Buffer		vmbuffer = InvalidBuffer;
 	BlockNumber next_not_all_visible_block;
+	BlockNumber prefetch_next = 0;
 	bool		skipping_all_visible_blocks;
 	xl_heap_freeze_tuple *frozen;
 	StringInfoData buf;
@@ -581,6 +631,26 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 
 		vacuum_delay_point();
 
+		/*
+		 * When we aren't skipping all-visible pages, every following block
+		 * will be read, so ask the kernel to start fetching the next few
+		 * ahead of us.  Sequential OS readahead mostly covers this, but it
+		 * gives up when our reads are spaced out by cost-based vacuum
+		 * delays; explicit advice keeps the I/O pipeline full anyway.
+		 */
+		if (target_prefetch_pages > 0 &&
+			(scan_all || !skipping_all_visible_blocks))
+		{
+			BlockNumber prefetch_end = blkno + 1 + target_prefetch_pages;
+
+			if (prefetch_end > nblocks)
+				prefetch_end = nblocks;
+			if (prefetch_next <= blkno)
+				prefetch_next = blkno + 1;
+			for (; prefetch_next < prefetch_end; prefetch_next++)
+				PrefetchBuffer(onerel, MAIN_FORKNUM, prefetch_next);
+		}
+
 		/*
 		 * If we are close to overrunning the available space for dead-tuple
 		 * TIDs, pause and do a cycle of vacuuming before we tackle this page.
@@ -604,10 +674,8 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 			vacuum_log_cleanup_info(onerel, vacrelstats);
 
 			/* Remove index entries */
-			for (i = 0; i < nindexes; i++)
-				lazy_vacuum_index(Irel[i],
-								  &indstats[i],
-								  vacrelstats);
+			lazy_vacuum_all_indexes(onerel, Irel, nindexes, indstats,
+									vacrelstats);
 			/* Remove tuples from heap */
 			lazy_vacuum_heap(onerel, vacrelstats);
 
@@ -1121,10 +1189,8 @@ lazy_scan_heap(Relation onerel, LVRelStats *vacrelstats,
 		vacuum_log_cleanup_info(onerel, vacrelstats);
 
 		/* Remove index entries */
-		for (i = 0; i < nindexes; i++)
-			lazy_vacuum_index(Irel[i],
-							  &indstats[i],
-							  vacrelstats);
+		lazy_vacuum_all_indexes(onerel, Irel, nindexes, indstats,
+								vacrelstats);
 		/* Remove tuples from heap */
 		lazy_vacuum_heap(onerel, vacrelstats);
 		vacrelstats->num_index_scans++;
@@ -1188,12 +1254,23 @@ lazy_vacuum_heap(Relation onerel, LVRelStats *vacrelstats)
 {
 	int			tupindex;
 	int			npages;
+	int			prefetchindex;
+	int			nprefetched;
+	int			nvisited;
+	BlockNumber last_prefetch;
+	BlockNumber last_visited;
 	PGRUsage	ru0;
 	Buffer		vmbuffer = InvalidBuffer;
 
 	pg_rusage_init(&ru0);
 	npages = 0;
 
+	prefetchindex = 0;
+	nprefetched = 0;
+	nvisited = 0;
+	last_prefetch = InvalidBlockNumber;
+	last_visited = InvalidBlockNumber;
+
 	tupindex = 0;
 	while (tupindex < vacrelstats->num_dead_tuples)
 	{
@@ -1205,6 +1282,35 @@ lazy_vacuum_heap(Relation onerel, LVRelStats *vacrelstats)
 		vacuum_delay_point();
 
 		tblk = ItemPointerGetBlockNumber(&vacrelstats->dead_tuples[tupindex]);
+
+		/*
+		 * The pages we will visit are exactly the distinct blocks in the
+		 * (sorted) dead-tuple TID array, and they are typically far apart,
+		 * so OS readahead doesn't help at all here.  Keep prefetch advice
+		 * issued for up to target_prefetch_pages distinct blocks ahead of
+		 * the one we are about to process.
+		 */
+		if (tblk != last_visited)
+		{
+			last_visited = tblk;
+			nvisited++;
+		}
+		while (target_prefetch_pages > 0 &&
+			   prefetchindex < vacrelstats->num_dead_tuples &&
+			   nprefetched < nvisited + target_prefetch_pages)
+		{
+			BlockNumber pblk;
+
+			pblk = ItemPointerGetBlockNumber(&vacrelstats->dead_tuples[prefetchindex]);
+			if (pblk != last_prefetch)
+			{
+				PrefetchBuffer(onerel, MAIN_FORKNUM, pblk);
+				last_prefetch = pblk;
+				nprefetched++;
+			}
+			prefetchindex++;
+		}
+
 		buf = ReadBufferExtended(onerel, MAIN_FORKNUM, tblk, RBM_NORMAL,
 								 vac_strategy);
 		if (!ConditionalLockBufferForCleanup(buf))
@@ -1379,6 +1485,224 @@ lazy_check_needs_freeze(Buffer buf, bool *hastup)
 }
 
 
+/*
+ *	lazy_vacuum_all_indexes() -- run the index-vacuum phase over all indexes.
+ *
+ *		When enough parallel workers are allowed, distribute the indexes
+ *		across background workers, one index per worker at a time; otherwise
+ *		just vacuum them one after another as before.
+ */
+static void
+lazy_vacuum_all_indexes(Relation onerel, Relation *Irel, int nindexes,
+						IndexBulkDeleteResult **indstats,
+						LVRelStats *vacrelstats)
+{
+	int			nworkers = 0;
+	int			i;
+
+	/*
+	 * Parallel vacuuming requires a working parallel infrastructure and
+	 * relations that workers can access: no temp tables, and no use from
+	 * within another parallel operation.  Autovacuum workers stay serial,
+	 * since their cost-based throttling is accounted per process.  The
+	 * leader participates too, so there's no point in more than
+	 * nindexes - 1 extra workers.
+	 */
+	if (max_parallel_vacuum_workers > 0 && nindexes > 1 &&
+		IsUnderPostmaster && !IsParallelWorker() &&
+		!IsAutoVacuumWorkerProcess() &&
+		!RelationUsesLocalBuffers(onerel))
+		nworkers = Min(max_parallel_vacuum_workers, nindexes - 1);
+
+	if (nworkers > 0)
+		lazy_parallel_vacuum_indexes(Irel, nindexes, indstats,
+									 vacrelstats, nworkers);
+	else
+	{
+		for (i = 0; i < nindexes; i++)
+			lazy_vacuum_index(Irel[i], &indstats[i], vacrelstats);
+	}
+}
+
+/*
+ * Claim and bulk-delete indexes until none are left.  Runs in the leader as
+ * well as in every parallel worker; the shared nextindex counter hands each
+ * participant the next unprocessed index.
+ */
+static void
+lazy_parallel_vacuum_scan(LVParallelShared *shared, Oid *indoids,
+						  LVParallelIndStats *pindstats,
+						  ItemPointer dead_tuples)
+{
+	LVRelStats	rstats;
+
+	/* Fake up the fields that lazy_tid_reaped looks at */
+	MemSet(&rstats, 0, sizeof(rstats));
+	rstats.num_dead_tuples = shared->num_dead_tuples;
+	rstats.dead_tuples = dead_tuples;
+
+	for (;;)
+	{
+		int			idx;
+		Relation	indrel;
+		IndexVacuumInfo ivinfo;
+		IndexBulkDeleteResult *istat;
+		PGRUsage	ru0;
+
+		idx = (int) pg_atomic_fetch_add_u32(&shared->nextindex, 1);
+		if (idx >= shared->nindexes)
+			break;
+
+		pg_rusage_init(&ru0);
+
+		indrel = index_open(indoids[idx], RowExclusiveLock);
+
+		ivinfo.index = indrel;
+		ivinfo.analyze_only = false;
+		ivinfo.estimated_count = true;
+		ivinfo.message_level = shared->elevel;
+		ivinfo.num_heap_tuples = shared->num_heap_tuples;
+		ivinfo.strategy = vac_strategy;
+
+		istat = pindstats[idx].updated ? &pindstats[idx].stats : NULL;
+		istat = index_bulk_delete(&ivinfo, istat,
+								  lazy_tid_reaped, (void *) &rstats);
+		if (istat != NULL)
+		{
+			if (istat != &pindstats[idx].stats)
+			{
+				pindstats[idx].stats = *istat;
+				pfree(istat);
+			}
+			pindstats[idx].updated = true;
+		}
+
+		ereport(shared->elevel,
+				(errmsg("scanned index \"%s\" to remove %d row versions",
+						RelationGetRelationName(indrel),
+						shared->num_dead_tuples),
+				 errdetail("%s.", pg_rusage_show(&ru0))));
+
+		index_close(indrel, RowExclusiveLock);
+	}
+}
+
+/*
+ * Per-worker entry point for parallel index vacuuming.
+ */
+static void
+lazy_parallel_vacuum_main(dsm_segment *seg, shm_toc *toc)
+{
+	LVParallelShared *shared;
+	Oid		   *indoids;
+	LVParallelIndStats *pindstats;
+	ItemPointer dead_tuples;
+
+	shared = (LVParallelShared *) shm_toc_lookup(toc, PARALLEL_VACUUM_KEY_SHARED);
+	dead_tuples = (ItemPointer) shm_toc_lookup(toc, PARALLEL_VACUUM_KEY_DEAD_TUPLES);
+	indoids = (Oid *) shm_toc_lookup(toc, PARALLEL_VACUUM_KEY_INDEX_OIDS);
+	pindstats = (LVParallelIndStats *) shm_toc_lookup(toc, PARALLEL_VACUUM_KEY_INDEX_STATS);
+
+	vac_strategy = GetAccessStrategy(BAS_VACUUM);
+
+	lazy_parallel_vacuum_scan(shared, indoids, pindstats, dead_tuples);
+}
+
+/*
+ * Set up a parallel context, farm the indexes out to the workers (with the
+ * leader taking its share), and collect the per-index statistics back into
+ * indstats[] for the next vacuuming round and the final cleanup phase.
+ */
+static void
+lazy_parallel_vacuum_indexes(Relation *Irel, int nindexes,
+							 IndexBulkDeleteResult **indstats,
+							 LVRelStats *vacrelstats, int nworkers)
+{
+	ParallelContext *pcxt;
+	LVParallelShared *shared;
+	ItemPointer dead_tuples;
+	Oid		   *indoids;
+	LVParallelIndStats *pindstats;
+	int			i;
+
+	EnterParallelMode();
+	pcxt = CreateParallelContext(lazy_parallel_vacuum_main, nworkers);
+
+	shm_toc_estimate_chunk(&pcxt->estimator, sizeof(LVParallelShared));
+	shm_toc_estimate_chunk(&pcxt->estimator,
+						   mul_size(vacrelstats->num_dead_tuples,
+									sizeof(ItemPointerData)));
+	shm_toc_estimate_chunk(&pcxt->estimator, mul_size(nindexes, sizeof(Oid)));
+	shm_toc_estimate_chunk(&pcxt->estimator,
+						   mul_size(nindexes, sizeof(LVParallelIndStats)));
+	shm_toc_estimate_keys(&pcxt->estimator, 4);
+
+	InitializeParallelDSM(pcxt);
+
+	shared = (LVParallelShared *)
+		shm_toc_allocate(pcxt->toc, sizeof(LVParallelShared));
+	shared->nindexes = nindexes;
+	shared->elevel = elevel;
+	shared->num_heap_tuples = vacrelstats->old_rel_tuples;
+	shared->num_dead_tuples = vacrelstats->num_dead_tuples;
+	pg_atomic_init_u32(&shared->nextindex, 0);
+	shm_toc_insert(pcxt->toc, PARALLEL_VACUUM_KEY_SHARED, shared);
+
+	dead_tuples = (ItemPointer)
+		shm_toc_allocate(pcxt->toc,
+						 mul_size(vacrelstats->num_dead_tuples,
+								  sizeof(ItemPointerData)));
+	memcpy(dead_tuples, vacrelstats->dead_tuples,
+		   vacrelstats->num_dead_tuples * sizeof(ItemPointerData));
+	shm_toc_insert(pcxt->toc, PARALLEL_VACUUM_KEY_DEAD_TUPLES, dead_tuples);
+
+	indoids = (Oid *) shm_toc_allocate(pcxt->toc,
+									   mul_size(nindexes, sizeof(Oid)));
+	for (i = 0; i < nindexes; i++)
+		indoids[i] = RelationGetRelid(Irel[i]);
+	shm_toc_insert(pcxt->toc, PARALLEL_VACUUM_KEY_INDEX_OIDS, indoids);
+
+	pindstats = (LVParallelIndStats *)
+		shm_toc_allocate(pcxt->toc,
+						 mul_size(nindexes, sizeof(LVParallelIndStats)));
+	MemSet(pindstats, 0, nindexes * sizeof(LVParallelIndStats));
+	for (i = 0; i < nindexes; i++)
+	{
+		/* Seed with the stats of the previous vacuuming round, if any */
+		if (indstats[i] != NULL)
+		{
+			pindstats[i].updated = true;
+			pindstats[i].stats = *indstats[i];
+		}
+	}
+	shm_toc_insert(pcxt->toc, PARALLEL_VACUUM_KEY_INDEX_STATS, pindstats);
+
+	LaunchParallelWorkers(pcxt);
+
+	/*
+	 * The leader claims indexes like any worker.  If no workers could
+	 * actually be launched, this simply processes all of them.
+	 */
+	lazy_parallel_vacuum_scan(shared, indoids, pindstats, dead_tuples);
+
+	WaitForParallelWorkersToFinish(pcxt);
+
+	/* Bring the accumulated statistics back into backend-local memory */
+	for (i = 0; i < nindexes; i++)
+	{
+		if (pindstats[i].updated)
+		{
+			if (indstats[i] == NULL)
+				indstats[i] = (IndexBulkDeleteResult *)
+					palloc0(sizeof(IndexBulkDeleteResult));
+			*indstats[i] = pindstats[i].stats;
+		}
+	}
+
+	DestroyParallelContext(pcxt);
+	ExitParallelMode();
+}
+
 /*
  *	lazy_vacuum_index() -- vacuum one index relation.
  *
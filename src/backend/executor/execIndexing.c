@@ -450,6 +450,148 @@ ExecInsertIndexTuples(TupleTableSlot *slot,
 	return result;
 }
 
+/* ----------------------------------------------------------------
+ *		ExecInsertIndexTuplesBatch
+ *
+ *		Insert index entries for a batch of heap tuples that were just
+ *		stored via heap_multi_insert.  'slot' is a scratch slot with
+ *		the right tuple descriptor; each tuple is stored into it in
+ *		turn so index expressions and predicates can be evaluated.
+ *
+ *		Unlike a loop of ExecInsertIndexTuples calls, this runs with
+ *		the indexes in the outer loop, so each index's upper pages
+ *		stay hot in cache while the whole batch goes into it, and the
+ *		per-index setup is done once per batch rather than once per
+ *		row.
+ *
+ *		No recheck list is returned, so the caller must not use this
+ *		when deferred uniqueness or exclusion rechecks could arise:
+ *		deferrable constraints carry internal AFTER ROW triggers, and
+ *		callers with AFTER ROW triggers must use the per-row function
+ *		to obtain each tuple's recheck list.  Speculative insertion is
+ *		likewise not supported here.
+ * ----------------------------------------------------------------
+ */
+void
+ExecInsertIndexTuplesBatch(TupleTableSlot *slot, HeapTuple *tuples,
+						   int ntuples, EState *estate)
+{
+	ResultRelInfo *resultRelInfo;
+	int			i;
+	int			numIndices;
+	RelationPtr relationDescs;
+	Relation	heapRelation;
+	IndexInfo **indexInfoArray;
+	ExprContext *econtext;
+	Datum		values[INDEX_MAX_KEYS];
+	bool		isnull[INDEX_MAX_KEYS];
+
+	/*
+	 * Get information from the result relation info structure.
+	 */
+	resultRelInfo = estate->es_result_relation_info;
+	numIndices = resultRelInfo->ri_NumIndices;
+	relationDescs = resultRelInfo->ri_IndexRelationDescs;
+	indexInfoArray = resultRelInfo->ri_IndexRelationInfo;
+	heapRelation = resultRelInfo->ri_RelationDesc;
+
+	/*
+	 * We will use the EState's per-tuple context for evaluating predicates
+	 * and index expressions (creating it if it's not already there).
+	 */
+	econtext = GetPerTupleExprContext(estate);
+
+	/* Arrange for econtext's scan tuple to be the tuple under test */
+	econtext->ecxt_scantuple = slot;
+
+	/*
+	 * for each index, form and insert the index tuples of the whole batch
+	 */
+	for (i = 0; i < numIndices; i++)
+	{
+		Relation	indexRelation = relationDescs[i];
+		IndexInfo  *indexInfo;
+		IndexUniqueCheck checkUnique;
+		List	   *predicate = NIL;
+		int			t;
+
+		if (indexRelation == NULL)
+			continue;
+
+		indexInfo = indexInfoArray[i];
+
+		/* If the index is marked as read-only, ignore it */
+		if (!indexInfo->ii_ReadyForInserts)
+			continue;
+
+		/*
+		 * Deferrable unique indexes never reach this function (see header
+		 * comment), so any unique index is checked immediately.
+		 */
+		Assert(!indexRelation->rd_index->indisunique ||
+			   indexRelation->rd_index->indimmediate);
+		checkUnique = indexRelation->rd_index->indisunique ?
+			UNIQUE_CHECK_YES : UNIQUE_CHECK_NO;
+
+		/* For a partial index, set up the predicate once per batch */
+		if (indexInfo->ii_Predicate != NIL)
+		{
+			/*
+			 * If predicate state not set up yet, create it (in the estate's
+			 * per-query context)
+			 */
+			predicate = indexInfo->ii_PredicateState;
+			if (predicate == NIL)
+			{
+				predicate = (List *)
+					ExecPrepareExpr((Expr *) indexInfo->ii_Predicate,
+									estate);
+				indexInfo->ii_PredicateState = predicate;
+			}
+		}
+
+		for (t = 0; t < ntuples; t++)
+		{
+			ExecStoreTuple(tuples[t], slot, InvalidBuffer, false);
+
+			/* Skip this tuple if the predicate isn't satisfied */
+			if (predicate != NIL && !ExecQual(predicate, econtext, false))
+				continue;
+
+			/*
+			 * FormIndexDatum fills in its values and isnull parameters with
+			 * the appropriate values for the column(s) of the index.
+			 */
+			FormIndexDatum(indexInfo,
+						   slot,
+						   estate,
+						   values,
+						   isnull);
+
+			index_insert(indexRelation,
+						 values,
+						 isnull,
+						 &(tuples[t]->t_self),
+						 heapRelation,
+						 checkUnique);
+
+			/*
+			 * If the index has an associated exclusion constraint, check it.
+			 * Only non-deferrable exclusion constraints can appear here (the
+			 * deferrable kind carry internal AFTER ROW triggers), so a
+			 * violation is always an immediate error.
+			 */
+			if (indexInfo->ii_ExclusionOps != NULL)
+				check_exclusion_or_unique_constraint(heapRelation,
+													 indexRelation, indexInfo,
+													 &(tuples[t]->t_self),
+													 values, isnull,
+													 estate, false,
+													 CEOUC_WAIT, false, NULL);
+		}
+	}
+}
+
 /* ----------------------------------------------------------------
  *		ExecCheckIndexConstraints
  *
@@ -53,6 +53,7 @@
 #include "pgstat.h"
 #include "utils/acl.h"
 #include "utils/builtins.h"
+#include "utils/fmgroids.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/typcache.h"
@@ -109,6 +110,14 @@ static Datum ExecMakeFunctionResult(FuncExprState *fcache,
 static Datum ExecMakeFunctionResultNoSets(FuncExprState *fcache,
 							 ExprContext *econtext,
 							 bool *isNull, ExprDoneCond *isDone);
+static bool ExecOpQualifiesForSimplePath(FuncExprState *fcache);
+static Datum ExecMakeFunctionResultSimpleOp(FuncExprState *fcache,
+							   ExprContext *econtext,
+							   bool *isNull, ExprDoneCond *isDone);
+static int	ExecFusedOpcodeFor(Oid opfuncid);
+static Datum ExecMakeFunctionResultFusedOp(FuncExprState *fcache,
+							  ExprContext *econtext,
+							  bool *isNull, ExprDoneCond *isDone);
 static Datum ExecEvalFunc(FuncExprState *fcache, ExprContext *econtext,
 			 bool *isNull, ExprDoneCond *isDone);
 static Datum ExecEvalOper(FuncExprState *fcache, ExprContext *econtext,
@@ -2046,6 +2055,311 @@ ExecMakeFunctionResultNoSets(FuncExprState *fcache,
 	return result;
 }
 
+/*
+ *		ExecOpQualifiesForSimplePath
+ *
+ * Decide whether an operator may use ExecMakeFunctionResultSimpleOp: it
+ * must have exactly two arguments, each a plain user-column Var or a
+ * Const.  Whole-row and system-column references stay on the general
+ * path, as do nested expressions.
+ */
+static bool
+ExecOpQualifiesForSimplePath(FuncExprState *fcache)
+{
+	ListCell   *arg;
+
+	if (list_length(fcache->args) != 2)
+		return false;
+
+	foreach(arg, fcache->args)
+	{
+		ExprState  *argstate = (ExprState *) lfirst(arg);
+
+		if (IsA(argstate->expr, Var))
+		{
+			if (((Var *) argstate->expr)->varattno <= 0)
+				return false;
+		}
+		else if (!IsA(argstate->expr, Const))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ *		ExecMakeFunctionResultSimpleOp
+ *
+ * Even more simplified version of ExecMakeFunctionResultNoSets, for the
+ * very common qual shapes "var op const" and "var op var".  Since the
+ * arguments are known to be plain Vars or Consts, we can fetch them
+ * directly instead of recursing through ExecEvalExpr, which saves a
+ * noticeable fraction of expression overhead in qual-heavy scans.
+ *
+ * The first evaluation of an eligible operator still runs through
+ * ExecMakeFunctionResultNoSets, so that the one-time sanity checks in
+ * ExecEvalScalarVar have been applied to the Var arguments before we
+ * start taking shortcuts with them.
+ */
+static Datum
+ExecMakeFunctionResultSimpleOp(FuncExprState *fcache,
+							   ExprContext *econtext,
+							   bool *isNull,
+							   ExprDoneCond *isDone)
+{
+	Datum		result;
+	FunctionCallInfo fcinfo;
+	PgStat_FunctionCallUsage fcusage;
+	ListCell   *arg;
+	int			i;
+
+	if (isDone)
+		*isDone = ExprSingleResult;
+
+	fcinfo = &fcache->fcinfo_data;
+	i = 0;
+	foreach(arg, fcache->args)
+	{
+		ExprState  *argstate = (ExprState *) lfirst(arg);
+
+		if (IsA(argstate->expr, Var))
+		{
+			Var		   *variable = (Var *) argstate->expr;
+			TupleTableSlot *slot;
+
+			/* Get the input slot we want, as in ExecEvalScalarVar */
+			switch (variable->varno)
+			{
+				case INNER_VAR: /* get the tuple from the inner node */
+					slot = econtext->ecxt_innertuple;
+					break;
+
+				case OUTER_VAR: /* get the tuple from the outer node */
+					slot = econtext->ecxt_outertuple;
+					break;
+
+					/* INDEX_VAR is handled by default case */
+
+				default:		/* get the tuple from the relation being
+								 * scanned */
+					slot = econtext->ecxt_scantuple;
+					break;
+			}
+
+			fcinfo->arg[i] = slot_getattr(slot, variable->varattno,
+										  &fcinfo->argnull[i]);
+		}
+		else
+		{
+			Const	   *con = (Const *) argstate->expr;
+
+			fcinfo->arg[i] = con->constvalue;
+			fcinfo->argnull[i] = con->constisnull;
+		}
+		i++;
+	}
+
+	/*
+	 * If function is strict, and there are any NULL arguments, skip calling
+	 * the function and return NULL.
+	 */
+	if (fcache->func.fn_strict &&
+		(fcinfo->argnull[0] || fcinfo->argnull[1]))
+	{
+		*isNull = true;
+		return (Datum) 0;
+	}
+
+	pgstat_init_function_usage(fcinfo, &fcusage);
+
+	fcinfo->isnull = false;
+	result = FunctionCallInvoke(fcinfo);
+	*isNull = fcinfo->isnull;
+
+	pgstat_end_function_usage(&fcusage, true);
+
+	return result;
+}
+
+/*
+ * Fused opcodes: inline implementations of a few hot builtin comparison
+ * functions, selected by ExecFusedOpcodeFor.  Zero means "not fused"; a
+ * freshly made FuncExprState reads as FUSED_OP_NONE without further ado.
+ */
+#define FUSED_OP_NONE			0
+#define FUSED_OP_INT4EQ			1
+#define FUSED_OP_INT4NE			2
+#define FUSED_OP_INT4LT			3
+#define FUSED_OP_INT4LE			4
+#define FUSED_OP_INT4GT			5
+#define FUSED_OP_INT4GE			6
+#define FUSED_OP_INT8EQ			7
+#define FUSED_OP_TEXTEQ			8
+
+/*
+ *		ExecFusedOpcodeFor
+ *
+ * Map an operator's implementation function to a fused opcode, or
+ * FUSED_OP_NONE if we have no inline implementation for it.  Only
+ * collation-independent, strict builtins whose semantics we can reproduce
+ * exactly belong here.
+ */
+static int
+ExecFusedOpcodeFor(Oid opfuncid)
+{
+	switch (opfuncid)
+	{
+		case F_INT4EQ:
+			return FUSED_OP_INT4EQ;
+		case F_INT4NE:
+			return FUSED_OP_INT4NE;
+		case F_INT4LT:
+			return FUSED_OP_INT4LT;
+		case F_INT4LE:
+			return FUSED_OP_INT4LE;
+		case F_INT4GT:
+			return FUSED_OP_INT4GT;
+		case F_INT4GE:
+			return FUSED_OP_INT4GE;
+		case F_INT8EQ:
+			return FUSED_OP_INT8EQ;
+		case F_TEXTEQ:
+			return FUSED_OP_TEXTEQ;
+	}
+	return FUSED_OP_NONE;
+}
+
+/*
+ * Fetch one argument of a fused operator.  The argument is known to be a
+ * plain user-column Var or a Const; see ExecOpQualifiesForSimplePath.
+ */
+static inline Datum
+ExecFusedOpFetchArg(ExprState *argstate, ExprContext *econtext, bool *isnull)
+{
+	if (IsA(argstate->expr, Var))
+	{
+		Var		   *variable = (Var *) argstate->expr;
+		TupleTableSlot *slot;
+
+		/* Get the input slot we want, as in ExecEvalScalarVar */
+		switch (variable->varno)
+		{
+			case INNER_VAR:		/* get the tuple from the inner node */
+				slot = econtext->ecxt_innertuple;
+				break;
+
+			case OUTER_VAR:		/* get the tuple from the outer node */
+				slot = econtext->ecxt_outertuple;
+				break;
+
+				/* INDEX_VAR is handled by default case */
+
+			default:			/* get the tuple from the relation being
+								 * scanned */
+				slot = econtext->ecxt_scantuple;
+				break;
+		}
+
+		return slot_getattr(slot, variable->varattno, isnull);
+	}
+	else
+	{
+		Const	   *con = (Const *) argstate->expr;
+
+		*isnull = con->constisnull;
+		return con->constvalue;
+	}
+}
+
+/*
+ *		ExecMakeFunctionResultFusedOp
+ *
+ * Like ExecMakeFunctionResultSimpleOp, but the operator itself is also
+ * evaluated inline, skipping the function-manager call entirely.  All the
+ * fused operators are strict, so a NULL input yields a NULL result, and
+ * none of them use their collation.  ExecEvalOper only installs this path
+ * when per-function statistics tracking is off, so skipping the pgstat
+ * hooks loses nothing.
+ */
+static Datum
+ExecMakeFunctionResultFusedOp(FuncExprState *fcache,
+							  ExprContext *econtext,
+							  bool *isNull,
+							  ExprDoneCond *isDone)
+{
+	Datum		arg0;
+	Datum		arg1;
+	bool		null0;
+	bool		null1;
+	bool		result;
+
+	if (isDone)
+		*isDone = ExprSingleResult;
+
+	arg0 = ExecFusedOpFetchArg((ExprState *) linitial(fcache->args),
+							   econtext, &null0);
+	arg1 = ExecFusedOpFetchArg((ExprState *) lsecond(fcache->args),
+							   econtext, &null1);
+
+	/* All fused operators are strict. */
+	if (null0 || null1)
+	{
+		*isNull = true;
+		return (Datum) 0;
+	}
+	*isNull = false;
+
+	switch (fcache->fused_opcode)
+	{
+		case FUSED_OP_INT4EQ:
+			result = DatumGetInt32(arg0) == DatumGetInt32(arg1);
+			break;
+		case FUSED_OP_INT4NE:
+			result = DatumGetInt32(arg0) != DatumGetInt32(arg1);
+			break;
+		case FUSED_OP_INT4LT:
+			result = DatumGetInt32(arg0) < DatumGetInt32(arg1);
+			break;
+		case FUSED_OP_INT4LE:
+			result = DatumGetInt32(arg0) <= DatumGetInt32(arg1);
+			break;
+		case FUSED_OP_INT4GT:
+			result = DatumGetInt32(arg0) > DatumGetInt32(arg1);
+			break;
+		case FUSED_OP_INT4GE:
+			result = DatumGetInt32(arg0) >= DatumGetInt32(arg1);
+			break;
+		case FUSED_OP_INT8EQ:
+			result = DatumGetInt64(arg0) == DatumGetInt64(arg1);
+			break;
+		case FUSED_OP_TEXTEQ:
+			{
+				text	   *targ0 = DatumGetTextPP(arg0);
+				text	   *targ1 = DatumGetTextPP(arg1);
+				Size		len = VARSIZE_ANY_EXHDR(targ0);
+
+				/* same byte-equality rule as texteq */
+				result = (len == VARSIZE_ANY_EXHDR(targ1) &&
+						  memcmp(VARDATA_ANY(targ0), VARDATA_ANY(targ1),
+								 len) == 0);
+
+				/* free any detoasted copies */
+				if ((Pointer) targ0 != DatumGetPointer(arg0))
+					pfree(targ0);
+				if ((Pointer) targ1 != DatumGetPointer(arg1))
+					pfree(targ1);
+				break;
+			}
+		default:
+			elog(ERROR, "unrecognized fused opcode: %d",
+				 fcache->fused_opcode);
+			result = false;		/* keep compiler quiet */
+			break;
+	}
+
+	return BoolGetDatum(result);
+}
+
 
 /*
  *		ExecMakeTableFunctionResult
@@ -2463,7 +2777,25 @@ ExecEvalOper(FuncExprState *fcache,
 	}
 	else
 	{
-		fcache->xprstate.evalfunc = (ExprStateEvalFunc) ExecMakeFunctionResultNoSets;
+		/*
+		 * If the argument shape is simple enough, later evaluations can use
+		 * the fast path; the first one goes through the general code so the
+		 * Vars get their one-time sanity checks.  When on top of that the
+		 * operator's implementation function is one we know how to fuse, and
+		 * per-function statistics aren't being collected for it, install the
+		 * fully inline path.
+		 */
+		if (ExecOpQualifiesForSimplePath(fcache))
+		{
+			fcache->fused_opcode = ExecFusedOpcodeFor(op->opfuncid);
+			if (fcache->fused_opcode != FUSED_OP_NONE &&
+				fcache->func.fn_stats == TRACK_FUNC_OFF)
+				fcache->xprstate.evalfunc = (ExprStateEvalFunc) ExecMakeFunctionResultFusedOp;
+			else
+				fcache->xprstate.evalfunc = (ExprStateEvalFunc) ExecMakeFunctionResultSimpleOp;
+		}
+		else
+			fcache->xprstate.evalfunc = (ExprStateEvalFunc) ExecMakeFunctionResultNoSets;
 		return ExecMakeFunctionResultNoSets(fcache, econtext, isNull, isDone);
 	}
 }
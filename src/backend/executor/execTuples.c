@@ -121,6 +121,7 @@ MakeTupleTableSlot(void)
 	slot->tts_mcxt = CurrentMemoryContext;
 	slot->tts_buffer = InvalidBuffer;
 	slot->tts_nvalid = 0;
+	slot->tts_arraySize = 0;
 	slot->tts_values = NULL;
 	slot->tts_isnull = NULL;
 	slot->tts_mintuple = NULL;
@@ -177,10 +178,9 @@ ExecResetTupleTable(List *tupleTable,	/* tuple table */
 		/* If shouldFree, release memory occupied by the slot itself */
 		if (shouldFree)
 		{
+			/* tts_isnull points into the tts_values allocation */
 			if (slot->tts_values)
 				pfree(slot->tts_values);
-			if (slot->tts_isnull)
-				pfree(slot->tts_isnull);
 			pfree(slot);
 		}
 	}
@@ -224,10 +224,9 @@ ExecDropSingleTupleTableSlot(TupleTableSlot *slot)
 	ExecClearTuple(slot);
 	if (slot->tts_tupleDescriptor)
 		ReleaseTupleDesc(slot->tts_tupleDescriptor);
+	/* tts_isnull points into the tts_values allocation */
 	if (slot->tts_values)
 		pfree(slot->tts_values);
-	if (slot->tts_isnull)
-		pfree(slot->tts_isnull);
 	pfree(slot);
 }
 
@@ -254,18 +253,10 @@ ExecSetSlotDescriptor(TupleTableSlot *slot,		/* slot to change */
 	/* For safety, make sure slot is empty before changing it */
 	ExecClearTuple(slot);
 
-	/*
-	 * Release any old descriptor.  Also release old Datum/isnull arrays if
-	 * present (we don't bother to check if they could be re-used).
-	 */
+	/* Release any old descriptor. */
 	if (slot->tts_tupleDescriptor)
 		ReleaseTupleDesc(slot->tts_tupleDescriptor);
 
-	if (slot->tts_values)
-		pfree(slot->tts_values);
-	if (slot->tts_isnull)
-		pfree(slot->tts_isnull);
-
 	/*
 	 * Install the new descriptor; if it's refcounted, bump its refcount.
 	 */
@@ -273,13 +264,25 @@ ExecSetSlotDescriptor(TupleTableSlot *slot,		/* slot to change */
 	PinTupleDesc(tupdesc);
 
 	/*
-	 * Allocate Datum/isnull arrays of the appropriate size.  These must have
-	 * the same lifetime as the slot, so allocate in the slot's own context.
+	 * Make sure the Datum/isnull arrays are large enough for the new
+	 * descriptor.  If the old arrays suffice, just keep them; slots on nodes
+	 * such as ModifyTable get rebound to descriptors of similar width many
+	 * times per query, and re-palloc'ing the arrays each time adds up.
+	 * Otherwise allocate both arrays as a single palloc chunk (tts_isnull
+	 * points into the tts_values allocation, so only tts_values is ever
+	 * pfree'd).  These must have the same lifetime as the slot, so allocate
+	 * in the slot's own context.
 	 */
-	slot->tts_values = (Datum *)
-		MemoryContextAlloc(slot->tts_mcxt, tupdesc->natts * sizeof(Datum));
-	slot->tts_isnull = (bool *)
-		MemoryContextAlloc(slot->tts_mcxt, tupdesc->natts * sizeof(bool));
+	if (tupdesc->natts > slot->tts_arraySize)
+	{
+		if (slot->tts_values)
+			pfree(slot->tts_values);
+		slot->tts_values = (Datum *)
+			MemoryContextAlloc(slot->tts_mcxt,
+							   tupdesc->natts * (sizeof(Datum) + sizeof(bool)));
+		slot->tts_isnull = (bool *) (slot->tts_values + tupdesc->natts);
+		slot->tts_arraySize = tupdesc->natts;
+	}
 }
 
 /* --------------------------------
@@ -798,19 +801,36 @@ ExecMaterializeSlot(TupleTableSlot *slot)
 TupleTableSlot *
 ExecCopySlot(TupleTableSlot *dstslot, TupleTableSlot *srcslot)
 {
-	HeapTuple	newTuple;
 	MemoryContext oldContext;
 
 	/*
-	 * There might be ways to optimize this when the source is virtual, but
-	 * for now just always build a physical copy.  Make sure it is in the
-	 * right context.
+	 * When the source has no regular physical tuple (it's virtual, or holds
+	 * only a minimal tuple), copy into the cheaper minimal-tuple format; it
+	 * is smaller to form and to copy, and consumers that really need a
+	 * regular tuple will get one built on demand by ExecFetchSlotTuple.
+	 * Otherwise build a regular physical copy.  Make sure the copy is in the
+	 * right context in either case.
 	 */
-	oldContext = MemoryContextSwitchTo(dstslot->tts_mcxt);
-	newTuple = ExecCopySlotTuple(srcslot);
-	MemoryContextSwitchTo(oldContext);
+	if (TTS_HAS_PHYSICAL_TUPLE(srcslot))
+	{
+		HeapTuple	newTuple;
+
+		oldContext = MemoryContextSwitchTo(dstslot->tts_mcxt);
+		newTuple = ExecCopySlotTuple(srcslot);
+		MemoryContextSwitchTo(oldContext);
+
+		return ExecStoreTuple(newTuple, dstslot, InvalidBuffer, true);
+	}
+	else
+	{
+		MinimalTuple newMinTuple;
 
-	return ExecStoreTuple(newTuple, dstslot, InvalidBuffer, true);
+		oldContext = MemoryContextSwitchTo(dstslot->tts_mcxt);
+		newMinTuple = ExecCopySlotMinimalTuple(srcslot);
+		MemoryContextSwitchTo(oldContext);
+
+		return ExecStoreMinimalTuple(newMinTuple, dstslot, true);
+	}
 }
 
 /* --------------------------------
@@ -47,6 +47,9 @@
 #include "utils/rel.h"
 
 
+/* GUC: cap on memory allocated under the per-query context, in kB (0 = none) */
+int			max_query_memory = 0;
+
 static bool get_last_attnums(Node *node, ProjectionInfo *projInfo);
 static void ShutdownExprContext(ExprContext *econtext, bool isCommit);
 
@@ -84,6 +87,15 @@ CreateExecutorState(void)
 									 ALLOCSET_DEFAULT_INITSIZE,
 									 ALLOCSET_DEFAULT_MAXSIZE);
 
+	/*
+	 * All working data of this Executor run lives under the per-query
+	 * context, so capping it implements max_query_memory.  Memory contexts
+	 * created before the executor starts (caches, the parsed plan etc.) are
+	 * outside the cap.
+	 */
+	if (max_query_memory > 0)
+		MemoryContextSetLimit(qcontext, (Size) max_query_memory * 1024);
+
 	/*
 	 * Make the EState node within the per-query context.  This way, we don't
 	 * need a separate pfree() operation for it at shutdown.
@@ -224,14 +236,16 @@ CreateExprContext(EState *estate)
 	econtext->ecxt_per_query_memory = estate->es_query_cxt;
 
 	/*
-	 * Create working memory for expression evaluation in this context.
+	 * Create working memory for expression evaluation in this context.  We
+	 * use a bump context since per-tuple memory is reclaimed wholesale by
+	 * ResetExprContext(), never chunk by chunk.
 	 */
 	econtext->ecxt_per_tuple_memory =
-		AllocSetContextCreate(estate->es_query_cxt,
-							  "ExprContext",
-							  ALLOCSET_DEFAULT_MINSIZE,
-							  ALLOCSET_DEFAULT_INITSIZE,
-							  ALLOCSET_DEFAULT_MAXSIZE);
+		BumpContextCreate(estate->es_query_cxt,
+						  "ExprContext",
+						  ALLOCSET_DEFAULT_MINSIZE,
+						  ALLOCSET_DEFAULT_INITSIZE,
+						  ALLOCSET_DEFAULT_MAXSIZE);
 
 	econtext->ecxt_param_exec_vals = estate->es_param_exec_vals;
 	econtext->ecxt_param_list_info = estate->es_param_list_info;
@@ -295,14 +309,15 @@ CreateStandaloneExprContext(void)
 	econtext->ecxt_per_query_memory = CurrentMemoryContext;
 
 	/*
-	 * Create working memory for expression evaluation in this context.
+	 * Create working memory for expression evaluation in this context.  As
+	 * in CreateExprContext, a reset-only bump context suffices.
 	 */
 	econtext->ecxt_per_tuple_memory =
-		AllocSetContextCreate(CurrentMemoryContext,
-							  "ExprContext",
-							  ALLOCSET_DEFAULT_MINSIZE,
-							  ALLOCSET_DEFAULT_INITSIZE,
-							  ALLOCSET_DEFAULT_MAXSIZE);
+		BumpContextCreate(CurrentMemoryContext,
+						  "ExprContext",
+						  ALLOCSET_DEFAULT_MINSIZE,
+						  ALLOCSET_DEFAULT_INITSIZE,
+						  ALLOCSET_DEFAULT_MAXSIZE);
 
 	econtext->ecxt_param_exec_vals = NULL;
 	econtext->ecxt_param_list_info = NULL;
@@ -148,7 +148,16 @@
  *	  sensitive to the grouping set for which the aggregate function is
  *	  currently being called.
  *
- *	  TODO: AGG_HASHED doesn't support multiple grouping sets yet.
+ *	  When hashing is used (AGG_HASHED) and more than one grouping set is
+ *	  present, we instead keep one hash table per grouping set and fill them
+ *	  all in a single pass over the unsorted input; each set's groups are then
+ *	  emitted table by table.  This avoids both the chained sorts and any
+ *	  repeated scans of the input, at the price of holding all the tables in
+ *	  memory at once (the planner only chooses this when they are expected to
+ *	  fit in work_mem, and the hashagg spill logic is not used in this mode).
+ *	  An empty grouping set gets no hash table; its single group is advanced
+ *	  for every input row, like AGG_PLAIN, so that it yields a row even for
+ *	  empty input.
  *
  * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
@@ -161,6 +170,7 @@
 
 #include "postgres.h"
 
+#include "access/genam.h"
 #include "access/htup_details.h"
 #include "catalog/objectaccess.h"
 #include "catalog/pg_aggregate.h"
@@ -174,6 +184,7 @@
 #include "optimizer/tlist.h"
 #include "parser/parse_agg.h"
 #include "parser/parse_coerce.h"
+#include "storage/buffile.h"
 #include "utils/acl.h"
 #include "utils/builtins.h"
 #include "utils/lsyscache.h"
@@ -429,6 +440,26 @@ typedef struct AggStatePerPhaseData
 	Sort	   *sortnode;		/* Sort node for input ordering for phase */
 }	AggStatePerPhaseData;
 
+/*
+ * AggStatePerHashData - per-hashtable state for hashed grouping sets
+ *
+ * When an AGG_HASHED node computes more than one grouping set, we keep one
+ * hash table per set, all filled during the same pass over the input.  Each
+ * table hashes and compares only its own set's subset of the grouping
+ * columns.  An empty grouping set gets no hash table (hashtable is NULL);
+ * its single group lives in aggstate->pergroup instead, so that it produces
+ * a row even when there is no input at all.
+ */
+typedef struct AggStatePerHashData
+{
+	TupleHashTable hashtable;	/* hash table with one entry per group */
+	TupleHashIterator hashiter; /* for iterating through the hash table */
+	int			numCols;		/* number of hash key columns */
+	AttrNumber *hashGrpColIdx;	/* hash key column numbers in input tuple */
+	FmgrInfo   *eqfunctions;	/* per-key-column equality fns */
+	FmgrInfo   *hashfunctions;	/* per-key-column hash fns */
+}	AggStatePerHashData;
+
 /*
  * To implement hashed aggregation, we need a hashtable that stores a
  * representative tuple and an array of AggStatePerGroup structs for each
@@ -444,6 +475,32 @@ typedef struct AggHashEntryData
 	AggStatePerGroupData pergroup[FLEXIBLE_ARRAY_MEMBER];
 }	AggHashEntryData;
 
+/*
+ * When the hash table grows past work_mem, we stop creating new entries and
+ * instead write input tuples belonging to unseen groups out to temp files,
+ * split into partitions by a range of their hash bits (much as nodeHashjoin.c
+ * splits its batches).  After the in-memory groups have been emitted, each
+ * partition is read back and aggregated in a fresh hash table; a partition
+ * that still doesn't fit is split again using the next range of hash bits.
+ */
+#define HASHAGG_SPILL_PARTITIONS	32
+#define HASHAGG_PARTITION_BITS		5
+
+/* spill partitions being written by the current pass over the input */
+typedef struct HashAggSpill
+{
+	int			used_bits;		/* number of high hash bits already used */
+	BufFile    *partitions[HASHAGG_SPILL_PARTITIONS];	/* output files */
+	int64		ntuples[HASHAGG_SPILL_PARTITIONS];		/* tuples per file */
+} HashAggSpill;
+
+/* one spilled partition waiting to be aggregated */
+typedef struct HashAggBatch
+{
+	int			used_bits;		/* number of high hash bits already used */
+	BufFile    *file;			/* tuples of one spilled partition */
+} HashAggBatch;
+
 static void initialize_phase(AggState *aggstate, int newphase);
 static TupleTableSlot *fetch_input_tuple(AggState *aggstate);
 static void initialize_aggregates(AggState *aggstate,
@@ -478,11 +535,22 @@ static TupleTableSlot *project_aggregates(AggState *aggstate);
 static Bitmapset *find_unaggregated_cols(AggState *aggstate);
 static bool find_unaggregated_cols_walker(Node *node, Bitmapset **colnos);
 static void build_hash_table(AggState *aggstate);
+static void build_hash_tables(AggState *aggstate);
 static AggHashEntry lookup_hash_entry(AggState *aggstate,
 				  TupleTableSlot *inputslot);
+static void lookup_hash_entries(AggState *aggstate,
+					TupleTableSlot *inputslot);
+static void advance_hashed_aggregates(AggState *aggstate);
 static TupleTableSlot *agg_retrieve_direct(AggState *aggstate);
 static void agg_fill_hash_table(AggState *aggstate);
+static bool agg_refill_hash_table(AggState *aggstate);
 static TupleTableSlot *agg_retrieve_hash_table(AggState *aggstate);
+static uint32 hashagg_tuple_hash(AggState *aggstate);
+static void hashagg_enter_spill_mode(AggState *aggstate);
+static void hashagg_spill_tuple(AggState *aggstate,
+					TupleTableSlot *inputslot, uint32 hashvalue);
+static void hashagg_finish_spill(AggState *aggstate);
+static void hashagg_reset_spill_state(AggState *aggstate);
 static Datum GetAggInitVal(Datum textInitVal, Oid transtype);
 static void build_pertrans_for_aggref(AggStatePerTrans pertrans,
 						  AggState *aggsate, EState *estate,
@@ -1414,10 +1482,19 @@ finalize_aggregates(AggState *aggstate,
 	int			aggno;
 
 	Assert(currentSet == 0 ||
-		   ((Agg *) aggstate->ss.ps.plan)->aggstrategy != AGG_HASHED);
+		   ((Agg *) aggstate->ss.ps.plan)->aggstrategy != AGG_HASHED ||
+		   aggstate->num_hashes > 0);
 
 	aggstate->current_set = currentSet;
 
+	/*
+	 * In hashed mode each hash table entry (or empty grouping set's slice of
+	 * aggstate->pergroup) holds just one set's transition values, so the
+	 * grouping set number must not offset into pergroup.
+	 */
+	if (((Agg *) aggstate->ss.ps.plan)->aggstrategy == AGG_HASHED)
+		currentSet = 0;
+
 	for (aggno = 0; aggno < aggstate->numaggs; aggno++)
 	{
 		AggStatePerAgg peragg = &peraggs[aggno];
@@ -1560,6 +1637,50 @@ build_hash_table(AggState *aggstate)
 											  tmpmem);
 }
 
+/*
+ * Initialize the per-grouping-set hash tables to empty.
+ *
+ * Each set's table lives in that set's aggcontext, so the ReScanExprContext
+ * calls in ExecReScanAgg release them all.  Empty grouping sets get no table
+ * at all; see lookup_hash_entries.
+ */
+static void
+build_hash_tables(AggState *aggstate)
+{
+	Agg		   *node = (Agg *) aggstate->ss.ps.plan;
+	MemoryContext tmpmem = aggstate->tmpcontext->ecxt_per_tuple_memory;
+	Size		entrysize;
+	long		nbuckets;
+	int			setno;
+
+	Assert(node->aggstrategy == AGG_HASHED);
+	Assert(aggstate->num_hashes > 0);
+
+	entrysize = offsetof(AggHashEntryData, pergroup) +
+		aggstate->numaggs * sizeof(AggStatePerGroupData);
+
+	/* node->numGroups estimates the total across all grouping sets */
+	nbuckets = Max(node->numGroups / aggstate->num_hashes, 1);
+
+	for (setno = 0; setno < aggstate->num_hashes; setno++)
+	{
+		AggStatePerHash perhash = &aggstate->perhash[setno];
+
+		if (perhash->numCols == 0)
+			continue;			/* empty grouping set */
+
+		perhash->hashtable =
+			BuildTupleHashTable(perhash->numCols,
+								perhash->hashGrpColIdx,
+								perhash->eqfunctions,
+								perhash->hashfunctions,
+								nbuckets,
+								entrysize,
+						 aggstate->aggcontexts[setno]->ecxt_per_tuple_memory,
+								tmpmem);
+	}
+}
+
 /*
  * Create a list of the tuple columns that actually need to be stored in
  * hashtable entries.  The incoming tuples from the child plan node will
@@ -1659,6 +1780,17 @@ lookup_hash_entry(AggState *aggstate, TupleTableSlot *inputslot)
 		hashslot->tts_isnull[varNumber] = inputslot->tts_isnull[varNumber];
 	}
 
+	/*
+	 * Once we've started spilling, no new groups may be added to the hash
+	 * table; tuples belonging to unseen groups get a NULL result here and are
+	 * routed to a spill partition by our caller, to be aggregated in a later
+	 * pass over the spill file.
+	 */
+	if (aggstate->hash_spill_mode)
+		return (AggHashEntry) LookupTupleHashEntry(aggstate->hashtable,
+												   hashslot,
+												   NULL);
+
 	/* find or create the hashtable entry using the filtered tuple */
 	entry = (AggHashEntry) LookupTupleHashEntry(aggstate->hashtable,
 												hashslot,
@@ -1668,11 +1800,159 @@ lookup_hash_entry(AggState *aggstate, TupleTableSlot *inputslot)
 	{
 		/* initialize aggregates for new tuple group */
 		initialize_aggregates(aggstate, entry->pergroup, 0);
+
+		/*
+		 * If the hash table has now grown past the memory budget, stop
+		 * admitting new groups and start spilling.  Existing entries stay
+		 * put and continue to be advanced, so their transition values remain
+		 * valid.
+		 */
+		if (MemoryContextMemAllocated(aggstate->aggcontexts[0]->ecxt_per_tuple_memory,
+									  true) > aggstate->hash_mem_limit)
+			hashagg_enter_spill_mode(aggstate);
 	}
 
 	return entry;
 }
 
+/*
+ * Find or create hashtable entries for the current input tuple in all
+ * grouping sets' hash tables, leaving each set's per-group working state in
+ * aggstate->hash_pergroups[].  For an empty grouping set, which has no hash
+ * table, we point at its fixed slice of aggstate->pergroup instead.
+ *
+ * Unlike the single-table case, we never spill here: the planner chooses
+ * hashed grouping sets only when it expects all the tables to fit in
+ * work_mem together.
+ *
+ * When called, CurrentMemoryContext should be the per-query context.
+ */
+static void
+lookup_hash_entries(AggState *aggstate, TupleTableSlot *inputslot)
+{
+	TupleTableSlot *hashslot = aggstate->hashslot;
+	ListCell   *l;
+	int			setno;
+
+	/* if first time through, initialize hashslot by cloning input slot */
+	if (hashslot->tts_tupleDescriptor == NULL)
+	{
+		ExecSetSlotDescriptor(hashslot, inputslot->tts_tupleDescriptor);
+		/* Make sure all unused columns are NULLs */
+		ExecStoreAllNullTuple(hashslot);
+	}
+
+	/* transfer just the needed columns into hashslot */
+	slot_getsomeattrs(inputslot, linitial_int(aggstate->hash_needed));
+	foreach(l, aggstate->hash_needed)
+	{
+		int			varNumber = lfirst_int(l) - 1;
+
+		hashslot->tts_values[varNumber] = inputslot->tts_values[varNumber];
+		hashslot->tts_isnull[varNumber] = inputslot->tts_isnull[varNumber];
+	}
+
+	for (setno = 0; setno < aggstate->num_hashes; setno++)
+	{
+		AggStatePerHash perhash = &aggstate->perhash[setno];
+		AggHashEntry entry;
+		bool		isnew;
+
+		if (perhash->hashtable == NULL)
+		{
+			/* empty grouping set: its one group aggregates every tuple */
+			aggstate->hash_pergroups[setno] =
+				&aggstate->pergroup[setno * aggstate->numtrans];
+			continue;
+		}
+
+		/*
+		 * Each table hashes and compares only its own set's key columns, so
+		 * the extra columns present in hashslot do no harm here.
+		 */
+		entry = (AggHashEntry) LookupTupleHashEntry(perhash->hashtable,
+													hashslot,
+													&isnew);
+
+		if (isnew)
+		{
+			/* initialize aggregates for the new group, in this set only */
+			int			transno;
+
+			aggstate->current_set = setno;
+			for (transno = 0; transno < aggstate->numtrans; transno++)
+				initialize_aggregate(aggstate,
+									 &aggstate->pertrans[transno],
+									 &entry->pergroup[transno]);
+		}
+
+		aggstate->hash_pergroups[setno] = entry->pergroup;
+	}
+}
+
+/*
+ * Advance each aggregate transition state for one input tuple, once per
+ * grouping set, using the per-set group states located by
+ * lookup_hash_entries.  This parallels advance_aggregates, except that each
+ * set's state comes from a separate hash table entry rather than from
+ * consecutive slices of a single pergroup array.
+ */
+static void
+advance_hashed_aggregates(AggState *aggstate)
+{
+	int			transno;
+	int			setno;
+	int			numTrans = aggstate->numtrans;
+
+	Assert(!aggstate->combineStates);
+
+	for (transno = 0; transno < numTrans; transno++)
+	{
+		AggStatePerTrans pertrans = &aggstate->pertrans[transno];
+		ExprState  *filter = pertrans->aggfilter;
+		FunctionCallInfo fcinfo = &pertrans->transfn_fcinfo;
+		int			numTransInputs = pertrans->numTransInputs;
+		int			i;
+		TupleTableSlot *slot;
+
+		/* Skip anything FILTERed out */
+		if (filter)
+		{
+			Datum		res;
+			bool		isnull;
+
+			res = ExecEvalExprSwitchContext(filter, aggstate->tmpcontext,
+											&isnull, NULL);
+			if (isnull || !DatumGetBool(res))
+				continue;
+		}
+
+		/* Evaluate the current input expressions for this aggregate */
+		slot = ExecProject(pertrans->evalproj, NULL);
+
+		/* DISTINCT/ORDER BY aggregates are not allowed with hashing */
+		Assert(pertrans->numSortCols == 0);
+
+		/* Load values into fcinfo */
+		/* Start from 1, since the 0th arg will be the transition value */
+		Assert(slot->tts_nvalid >= numTransInputs);
+		for (i = 0; i < numTransInputs; i++)
+		{
+			fcinfo->arg[i + 1] = slot->tts_values[i];
+			fcinfo->argnull[i + 1] = slot->tts_isnull[i];
+		}
+
+		for (setno = 0; setno < aggstate->num_hashes; setno++)
+		{
+			AggStatePerGroup pergroupstate = &aggstate->hash_pergroups[setno][transno];
+
+			aggstate->current_set = setno;
+
+			advance_transition_function(aggstate, pertrans, pergroupstate);
+		}
+	}
+}
+
 /*
  * ExecAgg -
  *
@@ -1885,6 +2165,8 @@ agg_retrieve_direct(AggState *aggstate)
 		}
 		else
 		{
+			bool		counted = false;
+
 			/*
 			 * We no longer care what group we just projected, the next
 			 * projection will always be the first (or only) grouping set
@@ -1893,134 +2175,173 @@ agg_retrieve_direct(AggState *aggstate)
 			aggstate->projected_set = 0;
 
 			/*
-			 * If we don't already have the first tuple of the new group,
-			 * fetch it from the outer plan.
+			 * For a bare COUNT(*) over an index-only scan, have the index
+			 * machinery count the matching entries directly (see index_count)
+			 * instead of feeding every tuple through the executor.  If the
+			 * index reports a lossy match we cannot verify the quals here, so
+			 * we rescan the child and fall back to the regular path for good.
 			 */
-			if (aggstate->grp_firstTuple == NULL)
+			if (aggstate->count_pushdown)
 			{
-				outerslot = fetch_input_tuple(aggstate);
-				if (!TupIsNull(outerslot))
+				IndexOnlyScanState *ioss = (IndexOnlyScanState *) outerPlanState(aggstate);
+				int64		count = index_count(ioss->ioss_ScanDesc);
+
+				if (count >= 0)
 				{
-					/*
-					 * Make a copy of the first input tuple; we will use this
-					 * for comparisons (in group mode) and for projection.
-					 */
-					aggstate->grp_firstTuple = ExecCopySlotTuple(outerslot);
+					MemoryContext oldContext;
+
+					initialize_aggregates(aggstate, pergroup, numReset);
+
+					/* install the count as the finished transition value */
+					oldContext = MemoryContextSwitchTo(
+								aggstate->aggcontexts[0]->ecxt_per_tuple_memory);
+					pergroup[0].transValue = Int64GetDatum(count);
+					MemoryContextSwitchTo(oldContext);
+					pergroup[0].transValueIsNull = false;
+					pergroup[0].noTransValue = false;
+
+					aggstate->agg_done = true;
+					counted = true;
 				}
 				else
 				{
-					/* outer plan produced no tuples at all */
-					if (hasGroupingSets)
-					{
-						/*
-						 * If there was no input at all, we need to project
-						 * rows only if there are grouping sets of size 0.
-						 * Note that this implies that there can't be any
-						 * references to ungrouped Vars, which would otherwise
-						 * cause issues with the empty output slot.
-						 *
-						 * XXX: This is no longer true, we currently deal with
-						 * this in finalize_aggregates().
-						 */
-						aggstate->input_done = true;
-
-						while (aggstate->phase->gset_lengths[aggstate->projected_set] > 0)
-						{
-							aggstate->projected_set += 1;
-							if (aggstate->projected_set >= numGroupingSets)
-							{
-								/*
-								 * We can't set agg_done here because we might
-								 * have more phases to do, even though the
-								 * input is empty. So we need to restart the
-								 * whole outer loop.
-								 */
-								break;
-							}
-						}
-
-						if (aggstate->projected_set >= numGroupingSets)
-							continue;
-					}
-					else
-					{
-						aggstate->agg_done = true;
-						/* If we are grouping, we should produce no tuples too */
-						if (node->aggstrategy != AGG_PLAIN)
-							return NULL;
-					}
+					ExecReScan((PlanState *) ioss);
+					aggstate->count_pushdown = false;
 				}
 			}
 
-			/*
-			 * Initialize working state for a new input tuple group.
-			 */
-			initialize_aggregates(aggstate, pergroup, numReset);
-
-			if (aggstate->grp_firstTuple != NULL)
+			if (!counted)
 			{
 				/*
-				 * Store the copied first input tuple in the tuple table slot
-				 * reserved for it.  The tuple will be deleted when it is
-				 * cleared from the slot.
-				 */
-				ExecStoreTuple(aggstate->grp_firstTuple,
-							   firstSlot,
-							   InvalidBuffer,
-							   true);
-				aggstate->grp_firstTuple = NULL;		/* don't keep two
-														 * pointers */
-
-				/* set up for first advance_aggregates call */
-				tmpcontext->ecxt_outertuple = firstSlot;
-
-				/*
-				 * Process each outer-plan tuple, and then fetch the next one,
-				 * until we exhaust the outer plan or cross a group boundary.
+				 * If we don't already have the first tuple of the new group,
+				 * fetch it from the outer plan.
 				 */
-				for (;;)
+				if (aggstate->grp_firstTuple == NULL)
 				{
-					if (!aggstate->combineStates)
-						advance_aggregates(aggstate, pergroup);
-					else
-						combine_aggregates(aggstate, pergroup);
-
-					/* Reset per-input-tuple context after each tuple */
-					ResetExprContext(tmpcontext);
-
 					outerslot = fetch_input_tuple(aggstate);
-					if (TupIsNull(outerslot))
+					if (!TupIsNull(outerslot))
+					{
+						/*
+						 * Make a copy of the first input tuple; we will use this
+						 * for comparisons (in group mode) and for projection.
+						 */
+						aggstate->grp_firstTuple = ExecCopySlotTuple(outerslot);
+					}
+					else
 					{
-						/* no more outer-plan tuples available */
+						/* outer plan produced no tuples at all */
 						if (hasGroupingSets)
 						{
+							/*
+							 * If there was no input at all, we need to project
+							 * rows only if there are grouping sets of size 0.
+							 * Note that this implies that there can't be any
+							 * references to ungrouped Vars, which would otherwise
+							 * cause issues with the empty output slot.
+							 *
+							 * XXX: This is no longer true, we currently deal with
+							 * this in finalize_aggregates().
+							 */
 							aggstate->input_done = true;
-							break;
+
+							while (aggstate->phase->gset_lengths[aggstate->projected_set] > 0)
+							{
+								aggstate->projected_set += 1;
+								if (aggstate->projected_set >= numGroupingSets)
+								{
+									/*
+									 * We can't set agg_done here because we might
+									 * have more phases to do, even though the
+									 * input is empty. So we need to restart the
+									 * whole outer loop.
+									 */
+									break;
+								}
+							}
+
+							if (aggstate->projected_set >= numGroupingSets)
+								continue;
 						}
 						else
 						{
 							aggstate->agg_done = true;
-							break;
+							/* If we are grouping, we should produce no tuples too */
+							if (node->aggstrategy != AGG_PLAIN)
+								return NULL;
 						}
 					}
-					/* set up for next advance_aggregates call */
-					tmpcontext->ecxt_outertuple = outerslot;
+				}
 
+				/*
+				 * Initialize working state for a new input tuple group.
+				 */
+				initialize_aggregates(aggstate, pergroup, numReset);
+
+				if (aggstate->grp_firstTuple != NULL)
+				{
 					/*
-					 * If we are grouping, check whether we've crossed a group
-					 * boundary.
+					 * Store the copied first input tuple in the tuple table slot
+					 * reserved for it.  The tuple will be deleted when it is
+					 * cleared from the slot.
 					 */
-					if (node->aggstrategy == AGG_SORTED)
+					ExecStoreTuple(aggstate->grp_firstTuple,
+								   firstSlot,
+								   InvalidBuffer,
+								   true);
+					aggstate->grp_firstTuple = NULL;		/* don't keep two
+															 * pointers */
+
+					/* set up for first advance_aggregates call */
+					tmpcontext->ecxt_outertuple = firstSlot;
+
+					/*
+					 * Process each outer-plan tuple, and then fetch the next one,
+					 * until we exhaust the outer plan or cross a group boundary.
+					 */
+					for (;;)
 					{
-						if (!execTuplesMatch(firstSlot,
-											 outerslot,
-											 node->numCols,
-											 node->grpColIdx,
-											 aggstate->phase->eqfunctions,
-										  tmpcontext->ecxt_per_tuple_memory))
+						if (!aggstate->combineStates)
+							advance_aggregates(aggstate, pergroup);
+						else
+							combine_aggregates(aggstate, pergroup);
+
+						/* Reset per-input-tuple context after each tuple */
+						ResetExprContext(tmpcontext);
+
+						outerslot = fetch_input_tuple(aggstate);
+						if (TupIsNull(outerslot))
 						{
-							aggstate->grp_firstTuple = ExecCopySlotTuple(outerslot);
-							break;
+							/* no more outer-plan tuples available */
+							if (hasGroupingSets)
+							{
+								aggstate->input_done = true;
+								break;
+							}
+							else
+							{
+								aggstate->agg_done = true;
+								break;
+							}
+						}
+						/* set up for next advance_aggregates call */
+						tmpcontext->ecxt_outertuple = outerslot;
+
+						/*
+						 * If we are grouping, check whether we've crossed a group
+						 * boundary.
+						 */
+						if (node->aggstrategy == AGG_SORTED)
+						{
+							if (!execTuplesMatch(firstSlot,
+												 outerslot,
+												 node->numCols,
+												 node->grpColIdx,
+												 aggstate->phase->eqfunctions,
+											  tmpcontext->ecxt_per_tuple_memory))
+							{
+								aggstate->grp_firstTuple = ExecCopySlotTuple(outerslot);
+								break;
+							}
 						}
 					}
 				}
@@ -2075,6 +2396,14 @@ agg_fill_hash_table(AggState *aggstate)
 	 */
 	tmpcontext = aggstate->tmpcontext;
 
+	/*
+	 * With multiple grouping sets, reset the pergroup states backing any
+	 * empty grouping sets; those groups aggregate every input row, like
+	 * AGG_PLAIN, so that they produce a row even for empty input.
+	 */
+	if (aggstate->num_hashes > 0)
+		initialize_aggregates(aggstate, aggstate->pergroup, 0);
+
 	/*
 	 * Process each outer-plan tuple, and then fetch the next one, until we
 	 * exhaust the outer plan.
@@ -2087,24 +2416,165 @@ agg_fill_hash_table(AggState *aggstate)
 		/* set up for advance_aggregates call */
 		tmpcontext->ecxt_outertuple = outerslot;
 
+		if (aggstate->num_hashes > 0)
+		{
+			/* Find or build each grouping set's entry for this tuple */
+			lookup_hash_entries(aggstate, outerslot);
+
+			/* Advance the aggregates, once per grouping set */
+			advance_hashed_aggregates(aggstate);
+
+			/* Reset per-input-tuple context after each tuple */
+			ResetExprContext(tmpcontext);
+			continue;
+		}
+
 		/* Find or build hashtable entry for this tuple's group */
 		entry = lookup_hash_entry(aggstate, outerslot);
 
-		/* Advance the aggregates */
-		if (!aggstate->combineStates)
-			advance_aggregates(aggstate, entry->pergroup);
+		if (entry != NULL)
+		{
+			/* Advance the aggregates */
+			if (!aggstate->combineStates)
+				advance_aggregates(aggstate, entry->pergroup);
+			else
+				combine_aggregates(aggstate, entry->pergroup);
+		}
 		else
-			combine_aggregates(aggstate, entry->pergroup);
+		{
+			/* group didn't fit in memory: stash the tuple for a later pass */
+			hashagg_spill_tuple(aggstate, outerslot,
+								hashagg_tuple_hash(aggstate));
+		}
 
 		/* Reset per-input-tuple context after each tuple */
 		ResetExprContext(tmpcontext);
 	}
 
 	aggstate->table_filled = true;
+
+	if (aggstate->num_hashes > 0)
+	{
+		int			setno;
+
+		/* Initialize to walk the first hash table */
+		for (setno = 0; setno < aggstate->num_hashes; setno++)
+		{
+			AggStatePerHash perhash = &aggstate->perhash[setno];
+
+			if (perhash->hashtable)
+				ResetTupleHashIterator(perhash->hashtable, &perhash->hashiter);
+		}
+		aggstate->current_hash = 0;
+		return;
+	}
+
+	/* convert any spill partitions written above into pending batches */
+	hashagg_finish_spill(aggstate);
+
 	/* Initialize to walk the hash table */
 	ResetTupleHashIterator(aggstate->hashtable, &aggstate->hashiter);
 }
 
+/*
+ * ExecAgg for hashed case: load the next batch of spilled tuples, if any,
+ * into a fresh hash table and prepare to emit its groups.  Returns false if
+ * no batches remain.
+ *
+ * A batch that again exceeds the memory budget is re-spilled, using the next
+ * range of hash bits to subdivide it further.
+ */
+static bool
+agg_refill_hash_table(AggState *aggstate)
+{
+	ExprContext *tmpcontext = aggstate->tmpcontext;
+	TupleTableSlot *slot = aggstate->hash_spill_slot;
+	HashAggBatch *batch;
+
+	if (aggstate->hash_batches == NIL)
+		return false;
+
+	batch = (HashAggBatch *) linitial(aggstate->hash_batches);
+	aggstate->hash_batches = list_delete_first(aggstate->hash_batches);
+	aggstate->hash_batch_used_bits = batch->used_bits;
+
+	/*
+	 * All groups of the previous pass have been emitted already, so we can
+	 * release their transition values and hash table and start over.  As in
+	 * ExecReScanAgg, resetting the hashtable context runs any registered agg
+	 * shutdown callbacks, which is fine since those groups are finished.
+	 */
+	ReScanExprContext(aggstate->aggcontexts[0]);
+	build_hash_table(aggstate);
+
+	/* if first time through, initialize the slot for reading spilled tuples */
+	if (slot->tts_tupleDescriptor == NULL)
+		ExecSetSlotDescriptor(slot,
+							  ExecGetResultType(outerPlanState(aggstate)));
+
+	for (;;)
+	{
+		uint32		header[2];
+		size_t		nread;
+		MinimalTuple tuple;
+		AggHashEntry entry;
+
+		CHECK_FOR_INTERRUPTS();
+
+		/* the stored hash value and the tuple's t_len word are both uint32 */
+		nread = BufFileRead(batch->file, (void *) header, sizeof(header));
+		if (nread == 0)
+			break;				/* end of batch */
+		if (nread != sizeof(header))
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not read from hash-agg temporary file: %m")));
+
+		tuple = (MinimalTuple) palloc(header[1]);
+		tuple->t_len = header[1];
+		nread = BufFileRead(batch->file,
+							(void *) ((char *) tuple + sizeof(uint32)),
+							header[1] - sizeof(uint32));
+		if (nread != header[1] - sizeof(uint32))
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not read from hash-agg temporary file: %m")));
+		ExecStoreMinimalTuple(tuple, slot, true);
+
+		/* set up for advance_aggregates call */
+		tmpcontext->ecxt_outertuple = slot;
+
+		entry = lookup_hash_entry(aggstate, slot);
+
+		if (entry != NULL)
+		{
+			if (!aggstate->combineStates)
+				advance_aggregates(aggstate, entry->pergroup);
+			else
+				combine_aggregates(aggstate, entry->pergroup);
+		}
+		else
+		{
+			/* re-spill, reusing the hash value computed on the way in */
+			hashagg_spill_tuple(aggstate, slot, header[0]);
+		}
+
+		ResetExprContext(tmpcontext);
+	}
+
+	BufFileClose(batch->file);
+	pfree(batch);
+
+	/* queue up any batches this pass had to re-spill */
+	hashagg_finish_spill(aggstate);
+
+	ExecClearTuple(slot);
+	/* Initialize to walk the new hash table */
+	ResetTupleHashIterator(aggstate->hashtable, &aggstate->hashiter);
+
+	return true;
+}
+
 /*
  * ExecAgg for hashed case: phase 2, retrieving groups from hash table
  */
@@ -2132,15 +2602,74 @@ agg_retrieve_hash_table(AggState *aggstate)
 	 */
 	while (!aggstate->agg_done)
 	{
-		/*
-		 * Find the next entry in the hash table
-		 */
-		entry = (AggHashEntry) ScanTupleHashTable(&aggstate->hashiter);
-		if (entry == NULL)
+		int			currentSet = 0;
+
+		if (aggstate->num_hashes > 0)
 		{
-			/* No more entries in hashtable, so done */
-			aggstate->agg_done = TRUE;
-			return NULL;
+			AggStatePerHash perhash;
+
+			/*
+			 * Emit the groups of each grouping set's hash table in turn.  An
+			 * empty grouping set has no hash table; it always produces
+			 * exactly one group, even when there was no input at all.
+			 */
+			if (aggstate->current_hash >= aggstate->num_hashes)
+			{
+				aggstate->agg_done = TRUE;
+				return NULL;
+			}
+
+			currentSet = aggstate->current_hash;
+			perhash = &aggstate->perhash[currentSet];
+
+			if (perhash->hashtable == NULL)
+			{
+				aggstate->current_hash++;
+
+				ResetExprContext(econtext);
+
+				/* No representative tuple; project from all-NULL columns */
+				ExecClearTuple(firstSlot);
+				prepare_projection_slot(aggstate, firstSlot, currentSet);
+
+				finalize_aggregates(aggstate, peragg,
+							 &aggstate->pergroup[currentSet * aggstate->numtrans],
+									currentSet);
+
+				econtext->ecxt_outertuple = firstSlot;
+				result = project_aggregates(aggstate);
+				if (result)
+					return result;
+				continue;
+			}
+
+			entry = (AggHashEntry) ScanTupleHashTable(&perhash->hashiter);
+			if (entry == NULL)
+			{
+				/* This set's table is exhausted; move on to the next one */
+				aggstate->current_hash++;
+				continue;
+			}
+		}
+		else
+		{
+			/*
+			 * Find the next entry in the hash table
+			 */
+			entry = (AggHashEntry) ScanTupleHashTable(&aggstate->hashiter);
+			if (entry == NULL)
+			{
+				/*
+				 * The current hash table is exhausted; if input was spilled,
+				 * aggregate the next batch and keep emitting groups from it.
+				 */
+				if (agg_refill_hash_table(aggstate))
+					continue;
+
+				/* No more entries in hashtable or spilled batches, so done */
+				aggstate->agg_done = TRUE;
+				return NULL;
+			}
 		}
 
 		/*
@@ -2160,9 +2689,16 @@ agg_retrieve_hash_table(AggState *aggstate)
 							  firstSlot,
 							  false);
 
+		/*
+		 * With grouping sets, null out columns the current set doesn't group
+		 * by, and publish grouped_cols for GROUPING().  (This is a no-op in
+		 * the single-table case, which has no grouped_cols.)
+		 */
+		prepare_projection_slot(aggstate, firstSlot, currentSet);
+
 		pergroup = entry->pergroup;
 
-		finalize_aggregates(aggstate, peragg, pergroup, 0);
+		finalize_aggregates(aggstate, peragg, pergroup, currentSet);
 
 		/*
 		 * Use the representative input tuple for any references to
@@ -2179,6 +2715,193 @@ agg_retrieve_hash_table(AggState *aggstate)
 	return NULL;
 }
 
+/*
+ * Compute the hash value of the current group, from the grouping columns
+ * already loaded into aggstate->hashslot by lookup_hash_entry.  This must
+ * match the hash computed by execGrouping.c for the hash table proper, so
+ * that all tuples of one group land in the same spill partition.
+ */
+static uint32
+hashagg_tuple_hash(AggState *aggstate)
+{
+	Agg		   *node = (Agg *) aggstate->ss.ps.plan;
+	TupleTableSlot *hashslot = aggstate->hashslot;
+	MemoryContext oldContext;
+	uint32		hashkey = 0;
+	int			i;
+
+	/* Use the temp context, in case any hash function leaks memory */
+	oldContext = MemoryContextSwitchTo(aggstate->tmpcontext->ecxt_per_tuple_memory);
+
+	for (i = 0; i < node->numCols; i++)
+	{
+		AttrNumber	att = node->grpColIdx[i];
+
+		/* rotate hashkey left 1 bit at each step */
+		hashkey = (hashkey << 1) | ((hashkey & 0x80000000) ? 1 : 0);
+
+		if (!hashslot->tts_isnull[att - 1])		/* treat nulls as having hash
+												 * key 0 */
+		{
+			uint32		hkey;
+
+			hkey = DatumGetUInt32(FunctionCall1(&aggstate->hashfunctions[i],
+										   hashslot->tts_values[att - 1]));
+			hashkey ^= hkey;
+		}
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	return hashkey;
+}
+
+/*
+ * Stop admitting new groups to the hash table and set up spill partitions
+ * for the tuples that don't belong to the groups already in it.
+ *
+ * We consume hash bits starting from the top so as not to disturb the hash
+ * table's own bucket assignment, which uses the low-order bits.
+ */
+static void
+hashagg_enter_spill_mode(AggState *aggstate)
+{
+	HashAggSpill *spill;
+
+	/*
+	 * If earlier passes have consumed all the hash bits, further splitting
+	 * cannot separate the remaining groups; carry on in memory, exceeding
+	 * the budget, rather than uselessly re-spilling a partition into itself.
+	 */
+	if (aggstate->hash_batch_used_bits + HASHAGG_PARTITION_BITS > 32)
+		return;
+
+	spill = (HashAggSpill *) palloc0(sizeof(HashAggSpill));
+	spill->used_bits = aggstate->hash_batch_used_bits;
+
+	aggstate->hash_spill = spill;
+	aggstate->hash_spill_mode = true;
+	aggstate->hash_spilled = true;
+}
+
+/*
+ * Write one input tuple to the spill partition selected by its hash value.
+ *
+ * As in nodeHashjoin.c, we store the hash value followed by the minimal
+ * tuple, whose first field is its length; that way the tuple can be reloaded
+ * without recomputing the hash.
+ */
+static void
+hashagg_spill_tuple(AggState *aggstate, TupleTableSlot *inputslot,
+					uint32 hashvalue)
+{
+	HashAggSpill *spill = aggstate->hash_spill;
+	MinimalTuple tuple;
+	BufFile    *file;
+	int			shift;
+	int			partition;
+	size_t		written;
+
+	Assert(spill != NULL);
+
+	shift = 32 - spill->used_bits - HASHAGG_PARTITION_BITS;
+	partition = (hashvalue >> shift) & (HASHAGG_SPILL_PARTITIONS - 1);
+
+	if (spill->partitions[partition] == NULL)
+		spill->partitions[partition] = BufFileCreateTemp(false);
+	file = spill->partitions[partition];
+
+	tuple = ExecFetchSlotMinimalTuple(inputslot);
+
+	written = BufFileWrite(file, (void *) &hashvalue, sizeof(uint32));
+	if (written != sizeof(uint32))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to hash-agg temporary file: %m")));
+
+	written = BufFileWrite(file, (void *) tuple, tuple->t_len);
+	if (written != tuple->t_len)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to hash-agg temporary file: %m")));
+
+	spill->ntuples[partition]++;
+}
+
+/*
+ * After a pass over the input (or over a batch) is complete, turn each
+ * nonempty spill partition into a pending batch and leave spill mode.
+ */
+static void
+hashagg_finish_spill(AggState *aggstate)
+{
+	HashAggSpill *spill = aggstate->hash_spill;
+	int			i;
+
+	if (spill == NULL)
+		return;
+
+	for (i = 0; i < HASHAGG_SPILL_PARTITIONS; i++)
+	{
+		HashAggBatch *batch;
+
+		if (spill->partitions[i] == NULL)
+			continue;
+
+		if (BufFileSeek(spill->partitions[i], 0, 0L, SEEK_SET))
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not rewind hash-agg temporary file: %m")));
+
+		batch = (HashAggBatch *) palloc(sizeof(HashAggBatch));
+		batch->file = spill->partitions[i];
+		batch->used_bits = spill->used_bits + HASHAGG_PARTITION_BITS;
+
+		aggstate->hash_batches = lappend(aggstate->hash_batches, batch);
+	}
+
+	pfree(spill);
+	aggstate->hash_spill = NULL;
+	aggstate->hash_spill_mode = false;
+}
+
+/*
+ * Release all spill state: open partition files, pending batches, and the
+ * bookkeeping that says spilling happened.  Used at node shutdown and rescan.
+ */
+static void
+hashagg_reset_spill_state(AggState *aggstate)
+{
+	ListCell   *lc;
+
+	if (aggstate->hash_spill != NULL)
+	{
+		int			i;
+
+		for (i = 0; i < HASHAGG_SPILL_PARTITIONS; i++)
+		{
+			if (aggstate->hash_spill->partitions[i] != NULL)
+				BufFileClose(aggstate->hash_spill->partitions[i]);
+		}
+		pfree(aggstate->hash_spill);
+		aggstate->hash_spill = NULL;
+	}
+
+	foreach(lc, aggstate->hash_batches)
+	{
+		HashAggBatch *batch = (HashAggBatch *) lfirst(lc);
+
+		BufFileClose(batch->file);
+		pfree(batch);
+	}
+	list_free(aggstate->hash_batches);
+	aggstate->hash_batches = NIL;
+
+	aggstate->hash_spill_mode = false;
+	aggstate->hash_spilled = false;
+	aggstate->hash_batch_used_bits = 0;
+}
+
 /* -----------------
  * ExecInitAgg
  *
@@ -2241,8 +2964,6 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 	 */
 	if (node->groupingSets)
 	{
-		Assert(node->aggstrategy != AGG_HASHED);
-
 		numGroupingSets = list_length(node->groupingSets);
 
 		foreach(l, node->chain)
@@ -2290,6 +3011,7 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 	ExecInitScanTupleSlot(estate, &aggstate->ss);
 	ExecInitResultTupleSlot(estate, &aggstate->ss.ps);
 	aggstate->hashslot = ExecInitExtraTupleSlot(estate);
+	aggstate->hash_spill_slot = ExecInitExtraTupleSlot(estate);
 	aggstate->sort_slot = ExecInitExtraTupleSlot(estate);
 
 	/*
@@ -2388,20 +3110,27 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 			i = 0;
 			foreach(l, aggnode->groupingSets)
 			{
-				int			current_length = list_length(lfirst(l));
+				List	   *gset = (List *) lfirst(l);
+				int			current_length = list_length(gset);
 				Bitmapset  *cols = NULL;
+				ListCell   *l2;
 
-				/* planner forces this to be correct */
-				for (j = 0; j < current_length; ++j)
-					cols = bms_add_member(cols, aggnode->grpColIdx[j]);
+				/*
+				 * The members of each grouping set are indexes into
+				 * grpColIdx; for the sorted strategies the planner forces
+				 * each set to be a prefix of it, but with hashing the sets
+				 * may pick out arbitrary subsets of the grouping columns.
+				 */
+				foreach(l2, gset)
+					cols = bms_add_member(cols,
+										  aggnode->grpColIdx[lfirst_int(l2)]);
 
 				phasedata->grouped_cols[i] = cols;
 				phasedata->gset_lengths[i] = current_length;
+
+				all_grouped_cols = bms_add_members(all_grouped_cols, cols);
 				++i;
 			}
-
-			all_grouped_cols = bms_add_members(all_grouped_cols,
-											   phasedata->grouped_cols[0]);
 		}
 		else
 		{
@@ -2467,13 +3196,68 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 
 	if (node->aggstrategy == AGG_HASHED)
 	{
-		build_hash_table(aggstate);
+		if (node->groupingSets)
+		{
+			/*
+			 * Hashed grouping sets: build one hash table per set, each
+			 * hashing and comparing just that set's grouping columns.
+			 */
+			int			setno = 0;
+
+			aggstate->num_hashes = numGroupingSets;
+			aggstate->perhash = (AggStatePerHash)
+				palloc0(sizeof(AggStatePerHashData) * numGroupingSets);
+			aggstate->hash_pergroups = (AggStatePerGroup *)
+				palloc0(sizeof(AggStatePerGroup) * numGroupingSets);
+
+			foreach(l, node->groupingSets)
+			{
+				List	   *gset = (List *) lfirst(l);
+				AggStatePerHash perhash = &aggstate->perhash[setno];
+				int			numCols = list_length(gset);
+				Oid		   *ops;
+				ListCell   *l2;
+
+				perhash->numCols = numCols;
+				perhash->hashGrpColIdx = (AttrNumber *)
+					palloc(numCols * sizeof(AttrNumber));
+				ops = (Oid *) palloc(numCols * sizeof(Oid));
+
+				j = 0;
+				foreach(l2, gset)
+				{
+					int			col = lfirst_int(l2);
+
+					perhash->hashGrpColIdx[j] = node->grpColIdx[col];
+					ops[j] = node->grpOperators[col];
+					j++;
+				}
+
+				if (numCols > 0)
+					execTuplesHashPrepare(numCols, ops,
+										  &perhash->eqfunctions,
+										  &perhash->hashfunctions);
+				pfree(ops);
+				setno++;
+			}
+
+			build_hash_tables(aggstate);
+		}
+		else
+			build_hash_table(aggstate);
 		aggstate->table_filled = false;
 		/* Compute the columns we actually need to hash on */
 		aggstate->hash_needed = find_hash_columns(aggstate);
+		/* Set the memory budget beyond which new groups spill to disk */
+		aggstate->hash_mem_limit = work_mem * 1024L;
 	}
-	else
+
+	if (node->aggstrategy != AGG_HASHED || node->groupingSets)
 	{
+		/*
+		 * Note that hashed grouping sets use this array too, but only for
+		 * any empty grouping sets, which have no hash table.
+		 */
 		AggStatePerGroup pergroup;
 
 		pergroup = (AggStatePerGroup) palloc0(sizeof(AggStatePerGroupData)
@@ -2727,6 +3511,36 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 	aggstate->numaggs = aggno + 1;
 	aggstate->numtrans = transno + 1;
 
+	/*
+	 * Detect whether this node is a bare COUNT(*) over an index-only scan,
+	 * in which case agg_retrieve_direct can have the index machinery count
+	 * the matching entries directly (see index_count) instead of pulling
+	 * every tuple through the executor.  The scan must have no filter qual
+	 * and no runtime keys, so that nothing requires per-tuple evaluation
+	 * and the scan descriptor is positioned without ExecProcNode ever
+	 * running.
+	 */
+	aggstate->count_pushdown = false;
+	if (node->aggstrategy == AGG_PLAIN &&
+		node->groupingSets == NIL &&
+		!aggstate->combineStates &&
+		aggstate->numaggs == 1 &&
+		aggstate->numtrans == 1 &&
+		outerPlanState(aggstate) != NULL &&
+		IsA(outerPlanState(aggstate), IndexOnlyScanState))
+	{
+		Aggref	   *aggref = peraggs[0].aggref;
+		IndexOnlyScanState *ioss = (IndexOnlyScanState *) outerPlanState(aggstate);
+		IndexOnlyScan *outerplan = (IndexOnlyScan *) outerPlan(node);
+
+		if (aggref->aggfnoid == 2803 &&		/* COUNT(*), see pg_proc.h */
+			aggref->aggfilter == NULL &&
+			outerplan->scan.plan.qual == NIL &&
+			outerplan->indexorderby == NIL &&
+			ioss->ioss_NumRuntimeKeys == 0)
+			aggstate->count_pushdown = true;
+	}
+
 	return aggstate;
 }
 
@@ -3155,6 +3969,9 @@ ExecEndAgg(AggState *node)
 		}
 	}
 
+	/* Release any hash-agg spill files still open */
+	hashagg_reset_spill_state(node);
+
 	/* And ensure any agg shutdown callbacks have been called */
 	for (setno = 0; setno < numGroupingSets; setno++)
 		ReScanExprContext(node->aggcontexts[setno]);
@@ -3201,11 +4018,25 @@ ExecReScanAgg(AggState *node)
 		/*
 		 * If we do have the hash table and the subplan does not have any
 		 * parameter changes, then we can just rescan the existing hash table;
-		 * no need to build it again.
+		 * no need to build it again.  But if the input was spilled, the table
+		 * holds only the last batch's groups, so we must start over.
 		 */
-		if (outerPlan->chgParam == NULL)
+		if (outerPlan->chgParam == NULL && !node->hash_spilled)
 		{
-			ResetTupleHashIterator(node->hashtable, &node->hashiter);
+			if (node->num_hashes > 0)
+			{
+				for (setno = 0; setno < node->num_hashes; setno++)
+				{
+					AggStatePerHash perhash = &node->perhash[setno];
+
+					if (perhash->hashtable)
+						ResetTupleHashIterator(perhash->hashtable,
+											   &perhash->hashiter);
+				}
+				node->current_hash = 0;
+			}
+			else
+				ResetTupleHashIterator(node->hashtable, &node->hashiter);
 			return;
 		}
 	}
@@ -3256,8 +4087,17 @@ ExecReScanAgg(AggState *node)
 
 	if (aggnode->aggstrategy == AGG_HASHED)
 	{
-		/* Rebuild an empty hash table */
-		build_hash_table(node);
+		/* Release any leftover spill files and forget spill state */
+		hashagg_reset_spill_state(node);
+
+		/*
+		 * Rebuild empty hash table(s).  Empty-set pergroups are reset when
+		 * the tables are refilled.
+		 */
+		if (node->num_hashes > 0)
+			build_hash_tables(node);
+		else
+			build_hash_table(node);
 		node->table_filled = false;
 	}
 	else
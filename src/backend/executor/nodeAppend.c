@@ -59,8 +59,37 @@
 
 #include "executor/execdebug.h"
 #include "executor/nodeAppend.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
+#include "optimizer/cost.h"
+#include "optimizer/predtest.h"
+#include "optimizer/prep.h"
+#include "rewrite/rewriteManip.h"
+#include "port/atomics.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+
+/*
+ * Shared state for a parallel-aware Append.  Participants claim entire
+ * subplans with a simple atomic counter; each claimed subplan is run to
+ * completion by its claimant before another is taken.
+ */
+typedef struct ParallelAppendState
+{
+	pg_atomic_uint32 pa_next_plan;		/* next unclaimed subplan */
+} ParallelAppendState;
+
+/* as_whichplan value meaning "no subplan currently claimed" */
+#define PA_INVALID_PLAN		(-1)
 
 static bool exec_append_initialize_next(AppendState *appendstate);
+static TupleTableSlot *exec_parallel_append(AppendState *node);
+static void exec_append_prune_subplans(AppendState *appendstate,
+						   EState *estate);
+static List *exec_append_get_check_constraints(Relation rel, Index varno);
+static Node *exec_append_bind_params_mutator(Node *node, void *context);
 
 
 /* ----------------------------------------------------------------
@@ -81,6 +110,24 @@ exec_append_initialize_next(AppendState *appendstate)
 	 */
 	whichplan = appendstate->as_whichplan;
 
+	/*
+	 * Step over subplans eliminated by runtime constraint exclusion; their
+	 * partition constraints cannot be satisfied by the current parameter
+	 * values, so executing them would be wasted work.
+	 */
+	if (appendstate->as_validplans != NULL)
+	{
+		while (whichplan >= 0 && whichplan < appendstate->as_nplans &&
+			   !bms_is_member(whichplan, appendstate->as_validplans))
+		{
+			if (ScanDirectionIsForward(appendstate->ps.state->es_direction))
+				whichplan++;
+			else
+				whichplan--;
+		}
+		appendstate->as_whichplan = whichplan;
+	}
+
 	if (whichplan < 0)
 	{
 		/*
@@ -175,6 +222,18 @@ ExecInitAppend(Append *node, EState *estate, int eflags)
 	ExecAssignResultTypeFromTL(&appendstate->ps);
 	appendstate->ps.ps_ProjInfo = NULL;
 
+	/*
+	 * When executing with bound parameters, see whether some child scans can
+	 * be ruled out now that actual parameter values are known.  Plan-time
+	 * constraint exclusion cannot do this for generic plans, so a prepared
+	 * point query over a large inheritance tree would otherwise execute one
+	 * scan per child.
+	 */
+	if (!(eflags & EXEC_FLAG_EXPLAIN_ONLY) &&
+		estate->es_param_list_info != NULL &&
+		constraint_exclusion != CONSTRAINT_EXCLUSION_OFF)
+		exec_append_prune_subplans(appendstate, estate);
+
 	/*
 	 * initialize to scan first subplan
 	 */
@@ -184,6 +243,189 @@ ExecInitAppend(Append *node, EState *estate, int eflags)
 	return appendstate;
 }
 
+/* ----------------------------------------------------------------
+ *		exec_append_prune_subplans
+ *
+ *		Runtime constraint exclusion.  For each subplan that is a plain
+ *		scan of a relation with CHECK constraints, substitute the values
+ *		of external parameters into the scan's quals and test whether the
+ *		quals contradict the constraints, exactly as plan-time constraint
+ *		exclusion does for constant quals.  Subplans that cannot produce
+ *		any rows are recorded in as_validplans (by omission) and are never
+ *		executed.  They are still initialized, so EXPLAIN and plan-tree
+ *		walkers see the full Append as before.
+ * ----------------------------------------------------------------
+ */
+static void
+exec_append_prune_subplans(AppendState *appendstate, EState *estate)
+{
+	ParamListInfo params = estate->es_param_list_info;
+	Bitmapset  *validplans = NULL;
+	bool		pruned = false;
+	int			i;
+
+	for (i = 0; i < appendstate->as_nplans; i++)
+	{
+		PlanState  *subnode = appendstate->appendplans[i];
+		Plan	   *subplan = subnode->plan;
+		Relation	rel = NULL;
+		List	   *constraints;
+		List	   *quals;
+
+		validplans = bms_add_member(validplans, i);
+
+		/* Only plain relation scans carry a partition constraint to test. */
+		switch (nodeTag(subnode))
+		{
+			case T_SeqScanState:
+			case T_SampleScanState:
+			case T_IndexScanState:
+			case T_IndexOnlyScanState:
+			case T_BitmapHeapScanState:
+			case T_TidScanState:
+				rel = ((ScanState *) subnode)->ss_currentRelation;
+				break;
+			default:
+				break;
+		}
+		if (rel == NULL)
+			continue;
+
+		constraints = exec_append_get_check_constraints(rel,
+											((Scan *) subplan)->scanrelid);
+		if (constraints == NIL)
+			continue;
+
+		/*
+		 * Collect the scan's restriction clauses.  For index scans the
+		 * interesting clauses usually live in the recheck qual rather than
+		 * the filter qual.
+		 */
+		quals = list_copy(subplan->qual);
+		if (IsA(subplan, IndexScan))
+			quals = list_concat(quals,
+						 list_copy(((IndexScan *) subplan)->indexqualorig));
+		else if (IsA(subplan, BitmapHeapScan))
+			quals = list_concat(quals,
+					  list_copy(((BitmapHeapScan *) subplan)->bitmapqualorig));
+		if (quals == NIL)
+			continue;
+
+		quals = (List *) exec_append_bind_params_mutator((Node *) quals,
+														 (void *) params);
+
+		/*
+		 * As in relation_excluded_by_constraints(): the relation can be
+		 * skipped if its constraints are refuted by the (now constant-
+		 * bearing) restriction clauses.  predicate_refuted_by() errs on the
+		 * side of not proving anything, so this cannot prune a subplan that
+		 * might return rows.
+		 */
+		if (predicate_refuted_by(constraints, quals))
+		{
+			validplans = bms_del_member(validplans, i);
+			pruned = true;
+		}
+	}
+
+	if (pruned)
+		appendstate->as_validplans = validplans;
+	else
+		bms_free(validplans);
+}
+
+/*
+ * Fetch the valid CHECK constraints of "rel" as an implicit-AND list of
+ * expressions, with Vars renumbered to the scan's range table index so they
+ * match up with the scan quals.  Mirrors the constraint preprocessing done
+ * by get_relation_constraints() in plancat.c.
+ */
+static List *
+exec_append_get_check_constraints(Relation rel, Index varno)
+{
+	List	   *result = NIL;
+	TupleConstr *constr = RelationGetDescr(rel)->constr;
+	int			i;
+
+	if (constr == NULL)
+		return NIL;
+
+	for (i = 0; i < constr->num_check; i++)
+	{
+		Node	   *cexpr;
+
+		/* NOT VALID constraints may not hold for every existing row */
+		if (!constr->check[i].ccvalid)
+			continue;
+
+		cexpr = stringToNode(constr->check[i].ccbin);
+
+		/*
+		 * Simplify and canonicalize so that predicate proofs see the same
+		 * form that plan-time constraint exclusion works with.
+		 */
+		cexpr = eval_const_expressions(NULL, cexpr);
+		cexpr = (Node *) canonicalize_qual((Expr *) cexpr);
+
+		ChangeVarNodes(cexpr, 1, varno, 0);
+
+		result = list_concat(result, make_ands_implicit((Expr *) cexpr));
+	}
+
+	return result;
+}
+
+/*
+ * Replace resolvable PARAM_EXTERN Params with Const nodes carrying the
+ * current parameter values.  Unresolvable Params (including PARAM_EXEC) are
+ * left alone; clauses containing them simply prove nothing.
+ */
+static Node *
+exec_append_bind_params_mutator(Node *node, void *context)
+{
+	ParamListInfo params = (ParamListInfo) context;
+
+	if (node == NULL)
+		return NULL;
+	if (IsA(node, Param))
+	{
+		Param	   *param = (Param *) node;
+
+		if (param->paramkind == PARAM_EXTERN &&
+			param->paramid > 0 && param->paramid <= params->numParams)
+		{
+			ParamExternData *prm = &params->params[param->paramid - 1];
+
+			/* give hook a chance in case parameter is dynamic */
+			if (!OidIsValid(prm->ptype) && params->paramFetch != NULL)
+				(*params->paramFetch) (params, param->paramid);
+
+			if (OidIsValid(prm->ptype) && prm->ptype == param->paramtype)
+			{
+				int16		typLen;
+				bool		typByVal;
+				Datum		pval;
+
+				get_typlenbyval(param->paramtype, &typLen, &typByVal);
+				if (prm->isnull || typByVal)
+					pval = prm->value;
+				else
+					pval = datumCopy(prm->value, typByVal, typLen);
+				return (Node *) makeConst(param->paramtype,
+										  param->paramtypmod,
+										  param->paramcollid,
+										  (int) typLen,
+										  pval,
+										  prm->isnull,
+										  typByVal);
+			}
+		}
+		/* fall through to let the mutator copy the node as-is */
+	}
+	return expression_tree_mutator(node, exec_append_bind_params_mutator,
+								   context);
+}
+
 /* ----------------------------------------------------------------
  *	   ExecAppend
  *
@@ -193,6 +435,10 @@ ExecInitAppend(Append *node, EState *estate, int eflags)
 TupleTableSlot *
 ExecAppend(AppendState *node)
 {
+	/* Parallel-aware Appends dispatch whole subplans to participants. */
+	if (node->as_pstate != NULL)
+		return exec_parallel_append(node);
+
 	for (;;)
 	{
 		PlanState  *subnode;
@@ -234,6 +480,56 @@ ExecAppend(AppendState *node)
 	}
 }
 
+/* ----------------------------------------------------------------
+ *		exec_parallel_append
+ *
+ *		Parallel-aware version of the ExecAppend loop.  Rather than every
+ *		participant stepping through all subplans, each participant claims
+ *		the next unclaimed subplan from shared memory and runs it to
+ *		completion, so independent children (e.g. the arms of a UNION ALL
+ *		over partitions) execute concurrently across the worker pool.
+ *		Claiming whole subplans keeps parallel-aware children correct too:
+ *		their shared scan state simply ends up consumed by one participant
+ *		instead of several.
+ * ----------------------------------------------------------------
+ */
+static TupleTableSlot *
+exec_parallel_append(AppendState *node)
+{
+	ParallelAppendState *pstate = node->as_pstate;
+
+	for (;;)
+	{
+		TupleTableSlot *result;
+
+		if (node->as_whichplan == PA_INVALID_PLAN)
+		{
+			int			nextplan;
+
+			/* Claim the next subplan nobody else has taken. */
+			for (;;)
+			{
+				nextplan = (int) pg_atomic_fetch_add_u32(&pstate->pa_next_plan,
+														 1);
+				if (nextplan >= node->as_nplans)
+					return ExecClearTuple(node->ps.ps_ResultTupleSlot);
+				/* respect runtime constraint exclusion */
+				if (node->as_validplans == NULL ||
+					bms_is_member(nextplan, node->as_validplans))
+					break;
+			}
+			node->as_whichplan = nextplan;
+		}
+
+		result = ExecProcNode(node->appendplans[node->as_whichplan]);
+		if (!TupIsNull(result))
+			return result;
+
+		/* This subplan is exhausted; go claim another. */
+		node->as_whichplan = PA_INVALID_PLAN;
+	}
+}
+
 /* ----------------------------------------------------------------
  *		ExecEndAppend
  *
@@ -287,4 +583,65 @@ ExecReScanAppend(AppendState *node)
 	}
 	node->as_whichplan = 0;
 	exec_append_initialize_next(node);
+
+	/*
+	 * For a parallel-aware Append, reopen the bidding on subplans.  This
+	 * runs only in the leader: by the time Gather rescans its subtree, any
+	 * workers from the previous pass have already been shut down.
+	 */
+	if (node->as_pstate != NULL)
+	{
+		pg_atomic_write_u32(&node->as_pstate->pa_next_plan, 0);
+		node->as_whichplan = PA_INVALID_PLAN;
+	}
+}
+
+/* ----------------------------------------------------------------
+ *						Parallel Append Support
+ * ----------------------------------------------------------------
+ */
+
+/* ----------------------------------------------------------------
+ *		ExecAppendEstimate
+ *
+ *		estimates the space required to serialize Append node.
+ * ----------------------------------------------------------------
+ */
+void
+ExecAppendEstimate(AppendState *node, ParallelContext *pcxt)
+{
+	shm_toc_estimate_chunk(&pcxt->estimator, sizeof(ParallelAppendState));
+	shm_toc_estimate_keys(&pcxt->estimator, 1);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecAppendInitializeDSM
+ *
+ *		Set up the shared subplan-dispatch state.
+ * ----------------------------------------------------------------
+ */
+void
+ExecAppendInitializeDSM(AppendState *node, ParallelContext *pcxt)
+{
+	ParallelAppendState *pstate;
+
+	pstate = shm_toc_allocate(pcxt->toc, sizeof(ParallelAppendState));
+	pg_atomic_init_u32(&pstate->pa_next_plan, 0);
+	shm_toc_insert(pcxt->toc, node->ps.plan->plan_node_id, pstate);
+
+	node->as_pstate = pstate;
+	node->as_whichplan = PA_INVALID_PLAN;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecAppendInitializeWorker
+ *
+ *		Attach to the shared subplan-dispatch state.
+ * ----------------------------------------------------------------
+ */
+void
+ExecAppendInitializeWorker(AppendState *node, shm_toc *toc)
+{
+	node->as_pstate = shm_toc_lookup(toc, node->ps.plan->plan_node_id);
+	node->as_whichplan = PA_INVALID_PLAN;
 }
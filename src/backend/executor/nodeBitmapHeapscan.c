@@ -32,6 +32,18 @@
  *		ExecInitBitmapHeapScan		creates and initializes state info.
  *		ExecReScanBitmapHeapScan	prepares to rescan the plan.
  *		ExecEndBitmapHeapScan		releases all storage.
+ *
+ * This node cannot yet run below Gather.  To parallelize it, the TIDBitmap
+ * would have to live in shared memory so one participant can build it and
+ * all of them can claim pages from a shared iterator.  tidbitmap.c builds
+ * its pagetable with a backend-local dynahash, and dsm.c hands out only
+ * fixed-size segments, with no allocator capable of growing a hash table
+ * inside one while the bitmap's final size is unknown at segment-creation
+ * time (the same gap noted in nodeHash.c for a shared hash join build).
+ * Once a dynamic shared allocator exists, the executor pieces are
+ * straightforward: estimate/initialize-DSM hooks in execParallel.c like
+ * the ones parallel seqscan uses, an atomically-advanced shared iterator
+ * position, and partial bitmap paths in the planner.
  */
 #include "postgres.h"
 
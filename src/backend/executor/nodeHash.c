@@ -17,6 +17,19 @@
  *		MultiExecHash	- generate an in-memory hash table of the relation
  *		ExecInitHash	- initialize node and subnodes
  *		ExecEndHash		- shutdown node and subnodes
+ *
+ * The hash table built here is private to the backend, so when a hash join
+ * appears below Gather, every worker builds its own copy of the inner
+ * relation.  Sharing one build among the workers is the obvious
+ * improvement, but it needs several pieces we don't have yet: a dynamic
+ * shared-memory allocator that can grow the bucket array and tuple chunks
+ * inside a DSM segment (dsm.c only hands out fixed-size raw segments), a
+ * barrier primitive so probing waits for the build phase and for batch
+ * transitions, and temp files that survive their creating backend so that
+ * multi-batch joins can hand spilled batches between participants (cf. the
+ * notes in nbtsort.c about the same temp-file ownership problem).  Until
+ * that infrastructure exists, the private build at least parallelizes the
+ * probe side correctly.
  */
 
 #include "postgres.h"
@@ -743,6 +756,11 @@ ExecHashIncreaseNumBatches(HashJoinTable hashtable)
 	 * Increasing nbatch will not fix it since there's no way to subdivide the
 	 * group any more finely. We have to just gut it out and hope the server
 	 * has enough RAM.
+	 *
+	 * Note that this only lasts while the offending batch is loaded:
+	 * ExecHashJoinNewBatch re-enables growth when it moves on, so one batch
+	 * dominated by a single skewed key doesn't condemn all later batches to
+	 * overflow work_mem as well.
 	 */
 	if (nfreed == 0 || nfreed == ninmemory)
 	{
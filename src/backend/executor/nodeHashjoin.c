@@ -808,6 +808,14 @@ ExecHashJoinNewBatch(HashJoinState *hjstate)
 
 	hashtable->curbatch = curbatch;
 
+	/*
+	 * If a previous batch couldn't be subdivided because all its tuples
+	 * shared one hashvalue, nbatch growth was shut off; that verdict says
+	 * nothing about the batches still ahead of us, so give each new batch a
+	 * fresh chance to repartition itself if it overflows work_mem.
+	 */
+	hashtable->growEnabled = true;
+
 	/*
 	 * Reload the hash table with the new inner batch (which could be empty)
 	 */
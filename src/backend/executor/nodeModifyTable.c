@@ -37,6 +37,7 @@
 
 #include "postgres.h"
 
+#include "access/heapam.h"
 #include "access/htup_details.h"
 #include "access/xact.h"
 #include "commands/trigger.h"
@@ -61,6 +62,28 @@ static bool ExecOnConflictUpdate(ModifyTableState *mtstate,
 					 EState *estate,
 					 bool canSetTag,
 					 TupleTableSlot **returning);
+static void ExecInsertBuffered(ModifyTableState *mtstate, TupleTableSlot *slot,
+				   EState *estate, bool canSetTag);
+static void ExecFlushBufferedInserts(ModifyTableState *mtstate,
+						 EState *estate);
+static TupleTableSlot *ExecFetchPrefetched(ModifyTableState *mtstate,
+				   PlanState *subplanstate, JunkFilter *junkfilter);
+static int	block_number_comparator(const void *arg1, const void *arg2);
+
+/*
+ * When rows can be batched through heap_multi_insert (see
+ * ExecInitModifyTable), flush the buffer after it reaches this many tuples
+ * or this much data, whichever comes first.  Same limits as COPY FROM uses.
+ */
+#define MT_MAX_BUFFERED_TUPLES		1000
+#define MT_MAX_BUFFERED_BYTES		65535
+
+/*
+ * Number of target rows UPDATE and DELETE pull ahead of processing so that
+ * the heap pages they touch can be prefetched in block order (see
+ * ExecFetchPrefetched).
+ */
+#define MT_PREFETCH_TUPLES			128
 
 /*
  * Verify that the tuples to be produced by INSERT or UPDATE match the
@@ -502,6 +525,269 @@ ExecInsert(ModifyTableState *mtstate,
 	return NULL;
 }
 
+/* ----------------------------------------------------------------
+ *		ExecInsertBuffered
+ *
+ *		Buffered variant of ExecInsert, used when ExecInitModifyTable
+ *		determined that rows can be batched through heap_multi_insert.
+ *		The row is checked against the table's constraints immediately,
+ *		so errors are still raised in row order, but the heap and index
+ *		insertions are deferred until enough rows have accumulated to
+ *		amortize the WAL and buffer-locking overhead across the batch.
+ * ----------------------------------------------------------------
+ */
+static void
+ExecInsertBuffered(ModifyTableState *mtstate, TupleTableSlot *slot,
+				   EState *estate, bool canSetTag)
+{
+	HeapTuple	tuple;
+	ResultRelInfo *resultRelInfo;
+	Relation	resultRelationDesc;
+	MemoryContext oldcontext;
+
+	/*
+	 * get information on the (current) result relation
+	 */
+	resultRelInfo = estate->es_result_relation_info;
+	resultRelationDesc = resultRelInfo->ri_RelationDesc;
+
+	/*
+	 * get the heap tuple out of the tuple table slot, making sure we have a
+	 * writable copy
+	 */
+	tuple = ExecMaterializeSlot(slot);
+
+	/*
+	 * Constraints might reference the tableoid column, so initialize
+	 * t_tableOid before evaluating them.
+	 */
+	tuple->t_tableOid = RelationGetRelid(resultRelationDesc);
+
+	/*
+	 * Check the constraints of the tuple
+	 */
+	if (resultRelationDesc->rd_att->constr)
+		ExecConstraints(resultRelInfo, slot, estate);
+
+	/*
+	 * Copy the tuple into the multi-insert context, which lives until the
+	 * next flush; the slot's own copy belongs to the subplan and won't
+	 * survive the next fetch.
+	 */
+	oldcontext = MemoryContextSwitchTo(mtstate->mt_multiInsertCxt);
+	tuple = heap_copytuple(tuple);
+	MemoryContextSwitchTo(oldcontext);
+
+	/* Add this tuple to the tuple buffer */
+	mtstate->mt_bufferedTuples[mtstate->mt_nBufferedTuples++] = tuple;
+	mtstate->mt_bufferedTuplesSize += tuple->t_len;
+
+	if (canSetTag)
+	{
+		(estate->es_processed)++;
+		estate->es_lastoid = InvalidOid;
+	}
+
+	/*
+	 * If the buffer filled up, flush it.  Also flush if the total size of
+	 * all the tuples in the buffer becomes large, to avoid using large
+	 * amounts of memory for the buffer when the tuples are exceptionally
+	 * wide.
+	 */
+	if (mtstate->mt_nBufferedTuples >= MT_MAX_BUFFERED_TUPLES ||
+		mtstate->mt_bufferedTuplesSize > MT_MAX_BUFFERED_BYTES)
+		ExecFlushBufferedInserts(mtstate, estate);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecFlushBufferedInserts
+ *
+ *		Write the rows buffered by ExecInsertBuffered to the heap with
+ *		a single heap_multi_insert call, then insert index entries and
+ *		fire any AFTER ROW INSERT triggers for them.
+ * ----------------------------------------------------------------
+ */
+static void
+ExecFlushBufferedInserts(ModifyTableState *mtstate, EState *estate)
+{
+	ResultRelInfo *resultRelInfo;
+	HeapTuple  *tuples = mtstate->mt_bufferedTuples;
+	int			ntuples = mtstate->mt_nBufferedTuples;
+	MemoryContext oldcontext;
+	int			i;
+
+	if (ntuples == 0)
+		return;
+
+	resultRelInfo = estate->es_result_relation_info;
+
+	/*
+	 * heap_multi_insert leaks memory, so switch to short-lived memory
+	 * context before calling it.
+	 */
+	oldcontext = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
+	heap_multi_insert(resultRelInfo->ri_RelationDesc,
+					  tuples,
+					  ntuples,
+					  estate->es_output_cid,
+					  0,
+					  NULL);
+	MemoryContextSwitchTo(oldcontext);
+
+	/*
+	 * Insert index entries.  When no AFTER ROW triggers are involved the
+	 * whole batch can go through ExecInsertIndexTuplesBatch; otherwise we
+	 * go row by row, since each trigger event needs its own tuple's
+	 * recheck list.
+	 */
+	if (resultRelInfo->ri_TrigDesc == NULL ||
+		!resultRelInfo->ri_TrigDesc->trig_insert_after_row)
+	{
+		if (resultRelInfo->ri_NumIndices > 0)
+			ExecInsertIndexTuplesBatch(mtstate->mt_multiInsertSlot,
+									   tuples, ntuples, estate);
+	}
+	else if (resultRelInfo->ri_NumIndices > 0)
+	{
+		for (i = 0; i < ntuples; i++)
+		{
+			List	   *recheckIndexes;
+
+			ExecStoreTuple(tuples[i], mtstate->mt_multiInsertSlot,
+						   InvalidBuffer, false);
+			recheckIndexes =
+				ExecInsertIndexTuples(mtstate->mt_multiInsertSlot,
+									  &(tuples[i]->t_self),
+									  estate, false, NULL, NIL);
+			ExecARInsertTriggers(estate, resultRelInfo, tuples[i],
+								 recheckIndexes);
+			list_free(recheckIndexes);
+		}
+	}
+	else
+	{
+		for (i = 0; i < ntuples; i++)
+			ExecARInsertTriggers(estate, resultRelInfo, tuples[i], NIL);
+	}
+
+	if (mtstate->canSetTag)
+		setLastTid(&(tuples[ntuples - 1]->t_self));
+
+	/* Release the buffered rows and reset for the next batch */
+	ExecClearTuple(mtstate->mt_multiInsertSlot);
+	mtstate->mt_nBufferedTuples = 0;
+	mtstate->mt_bufferedTuplesSize = 0;
+	MemoryContextReset(mtstate->mt_multiInsertCxt);
+}
+
+/* ----------------------------------------------------------------
+ *		ExecFetchPrefetched
+ *
+ *		Batched variant of the subplan fetch for UPDATE and DELETE, used
+ *		when ExecInitModifyTable determined that target rows can be pulled
+ *		ahead of processing.  A window of rows is accumulated, the heap
+ *		blocks their ctids point to are prefetched in block order, and the
+ *		rows are then replayed in their original order.  An UPDATE or
+ *		DELETE driven by an index scan otherwise touches its target pages
+ *		in effectively random order, one synchronous read at a time; the
+ *		sorted prefetch lets the kernel coalesce the reads.  Since rows are
+ *		replayed unreordered, the behavior visible to triggers, RETURNING
+ *		and EvalPlanQual is unchanged.
+ *
+ *		Returns the next target row, or NULL when the subplan is done.
+ * ----------------------------------------------------------------
+ */
+static TupleTableSlot *
+ExecFetchPrefetched(ModifyTableState *mtstate, PlanState *subplanstate,
+					JunkFilter *junkfilter)
+{
+	if (mtstate->mt_prefetchCount == 0 && !mtstate->mt_subplanDone)
+	{
+		BlockNumber blocks[MT_PREFETCH_TUPLES];
+		int			nblocks = 0;
+
+		/* accumulate a window of target rows and their heap blocks */
+		while (mtstate->mt_prefetchCount < MT_PREFETCH_TUPLES)
+		{
+			TupleTableSlot *slot = ExecProcNode(subplanstate);
+			Datum		datum;
+			bool		isNull;
+
+			if (TupIsNull(slot))
+			{
+				mtstate->mt_subplanDone = true;
+				break;
+			}
+
+			datum = ExecGetJunkAttribute(slot, junkfilter->jf_junkAttNo,
+										 &isNull);
+			if (!isNull)
+			{
+				ItemPointer tupleid = (ItemPointer) DatumGetPointer(datum);
+
+				blocks[nblocks++] = ItemPointerGetBlockNumber(tupleid);
+			}
+
+			tuplestore_puttupleslot(mtstate->mt_prefetchStore, slot);
+			mtstate->mt_prefetchCount++;
+		}
+
+#ifdef USE_PREFETCH
+		if (nblocks > 1)
+		{
+			BlockNumber lastBlock = InvalidBlockNumber;
+			Relation	relation =
+			mtstate->ps.state->es_result_relation_info->ri_RelationDesc;
+			int			i;
+
+			qsort(blocks, nblocks, sizeof(BlockNumber),
+				  block_number_comparator);
+
+			for (i = 0; i < nblocks; i++)
+			{
+				if (blocks[i] != lastBlock)
+				{
+					PrefetchBuffer(relation, MAIN_FORKNUM, blocks[i]);
+					lastBlock = blocks[i];
+				}
+			}
+		}
+#endif   /* USE_PREFETCH */
+	}
+
+	if (mtstate->mt_prefetchCount > 0)
+	{
+		tuplestore_gettupleslot(mtstate->mt_prefetchStore, true, false,
+								mtstate->mt_prefetchSlot);
+		mtstate->mt_prefetchCount--;
+
+		/* drop the stored copies once the window has been fully replayed */
+		if (mtstate->mt_prefetchCount == 0)
+			tuplestore_clear(mtstate->mt_prefetchStore);
+
+		return mtstate->mt_prefetchSlot;
+	}
+
+	return NULL;
+}
+
+/*
+ * qsort comparator for block numbers
+ */
+static int
+block_number_comparator(const void *arg1, const void *arg2)
+{
+	BlockNumber block1 = *(const BlockNumber *) arg1;
+	BlockNumber block2 = *(const BlockNumber *) arg2;
+
+	if (block1 < block2)
+		return -1;
+	else if (block1 > block2)
+		return 1;
+	else
+		return 0;
+}
+
 /* ----------------------------------------------------------------
  *		ExecDelete
  *
@@ -1360,7 +1646,10 @@ ExecModifyTable(ModifyTableState *node)
 		 */
 		ResetPerTupleExprContext(estate);
 
-		planSlot = ExecProcNode(subplanstate);
+		if (node->mt_canPrefetch)
+			planSlot = ExecFetchPrefetched(node, subplanstate, junkfilter);
+		else
+			planSlot = ExecProcNode(subplanstate);
 
 		if (TupIsNull(planSlot))
 		{
@@ -1459,9 +1748,15 @@ ExecModifyTable(ModifyTableState *node)
 		switch (operation)
 		{
 			case CMD_INSERT:
-				slot = ExecInsert(node, slot, planSlot,
+				if (node->mt_canMultiInsert)
+				{
+					ExecInsertBuffered(node, slot, estate, node->canSetTag);
+					slot = NULL;
+				}
+				else
+					slot = ExecInsert(node, slot, planSlot,
 								node->mt_arbiterindexes, node->mt_onconflict,
-								  estate, node->canSetTag);
+									  estate, node->canSetTag);
 				break;
 			case CMD_UPDATE:
 				slot = ExecUpdate(tupleid, oldtuple, slot, planSlot,
@@ -1487,6 +1782,10 @@ ExecModifyTable(ModifyTableState *node)
 		}
 	}
 
+	/* Write out any rows still waiting in the multi-insert buffer */
+	if (node->mt_canMultiInsert)
+		ExecFlushBufferedInserts(node, estate);
+
 	/* Restore es_result_relation_info before exiting */
 	estate->es_result_relation_info = saved_resultRelInfo;
 
@@ -1764,6 +2063,47 @@ ExecInitModifyTable(ModifyTable *node, EState *estate, int eflags)
 		}
 	}
 
+	/*
+	 * Determine whether INSERT can batch rows through heap_multi_insert,
+	 * which writes one WAL record per batch instead of one per row.  That is
+	 * only transparent when each row's insertion is self-contained: no
+	 * RETURNING or ON CONFLICT processing, no BEFORE/INSTEAD OF row triggers
+	 * (they could query the table and would miss not-yet-flushed rows), no
+	 * WITH CHECK OPTIONs, and a plain local table without OIDs.  AFTER ROW
+	 * triggers are fine; they are fired when the batch is flushed, just as
+	 * COPY does.
+	 */
+	resultRelInfo = mtstate->resultRelInfo;
+	mtstate->mt_canMultiInsert =
+		operation == CMD_INSERT &&
+		nplans == 1 &&
+		node->onConflictAction == ONCONFLICT_NONE &&
+		node->returningLists == NIL &&
+		node->withCheckOptionLists == NIL &&
+		resultRelInfo->ri_FdwRoutine == NULL &&
+		resultRelInfo->ri_RelationDesc->rd_rel->relkind == RELKIND_RELATION &&
+		!resultRelInfo->ri_RelationDesc->rd_rel->relhasoids &&
+		(resultRelInfo->ri_TrigDesc == NULL ||
+		 (!resultRelInfo->ri_TrigDesc->trig_insert_before_row &&
+		  !resultRelInfo->ri_TrigDesc->trig_insert_instead_row));
+
+	if (mtstate->mt_canMultiInsert)
+	{
+		mtstate->mt_bufferedTuples = (HeapTuple *)
+			palloc(MT_MAX_BUFFERED_TUPLES * sizeof(HeapTuple));
+		mtstate->mt_nBufferedTuples = 0;
+		mtstate->mt_bufferedTuplesSize = 0;
+		mtstate->mt_multiInsertCxt =
+			AllocSetContextCreate(estate->es_query_cxt,
+								  "ModifyTable multi-insert",
+								  ALLOCSET_DEFAULT_MINSIZE,
+								  ALLOCSET_DEFAULT_INITSIZE,
+								  ALLOCSET_DEFAULT_MAXSIZE);
+		mtstate->mt_multiInsertSlot = ExecInitExtraTupleSlot(estate);
+		ExecSetSlotDescriptor(mtstate->mt_multiInsertSlot,
+						 RelationGetDescr(resultRelInfo->ri_RelationDesc));
+	}
+
 	/* select first subplan */
 	mtstate->mt_whichplan = 0;
 	subplan = (Plan *) linitial(node->plans);
@@ -1866,6 +2206,43 @@ ExecInitModifyTable(ModifyTable *node, EState *estate, int eflags)
 		}
 	}
 
+	/*
+	 * Determine whether UPDATE and DELETE may pull target rows ahead of
+	 * processing so their heap blocks can be prefetched in block order (see
+	 * ExecFetchPrefetched).  Rows are replayed in their original order, so
+	 * this is transparent as long as the subplan's evaluation cannot observe
+	 * the side effects of row-level triggers fired for earlier rows; we
+	 * therefore require that no BEFORE or INSTEAD OF row triggers exist.
+	 * AFTER ROW triggers only queue events and are fine.  The ctid junk
+	 * attribute supplies the block numbers, so only plain tables qualify.
+	 */
+	resultRelInfo = mtstate->resultRelInfo;
+	mtstate->mt_canPrefetch =
+		(operation == CMD_UPDATE || operation == CMD_DELETE) &&
+		nplans == 1 &&
+		target_prefetch_pages > 0 &&
+		resultRelInfo->ri_FdwRoutine == NULL &&
+		resultRelInfo->ri_RelationDesc->rd_rel->relkind == RELKIND_RELATION &&
+		resultRelInfo->ri_junkFilter != NULL &&
+		AttributeNumberIsValid(resultRelInfo->ri_junkFilter->jf_junkAttNo) &&
+		(resultRelInfo->ri_TrigDesc == NULL ||
+		 (operation == CMD_UPDATE ?
+		  (!resultRelInfo->ri_TrigDesc->trig_update_before_row &&
+		   !resultRelInfo->ri_TrigDesc->trig_update_instead_row) :
+		  (!resultRelInfo->ri_TrigDesc->trig_delete_before_row &&
+		   !resultRelInfo->ri_TrigDesc->trig_delete_instead_row)));
+
+	if (mtstate->mt_canPrefetch)
+	{
+		mtstate->mt_prefetchStore = tuplestore_begin_heap(false, false,
+														  work_mem);
+		mtstate->mt_prefetchCount = 0;
+		mtstate->mt_subplanDone = false;
+		mtstate->mt_prefetchSlot = ExecInitExtraTupleSlot(estate);
+		ExecSetSlotDescriptor(mtstate->mt_prefetchSlot,
+							  ExecGetResultType(mtstate->mt_plans[0]));
+	}
+
 	/*
 	 * Set up a tuple table slot for use for trigger output tuples. In a plan
 	 * containing multiple ModifyTable nodes, all can share one such slot, so
@@ -1926,6 +2303,12 @@ ExecEndModifyTable(ModifyTableState *node)
 	 */
 	ExecClearTuple(node->ps.ps_ResultTupleSlot);
 
+	/*
+	 * Release the prefetch window, if one was set up
+	 */
+	if (node->mt_prefetchStore != NULL)
+		tuplestore_end(node->mt_prefetchStore);
+
 	/*
 	 * Terminate EPQ execution if active
 	 */
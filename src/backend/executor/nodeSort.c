@@ -18,9 +18,126 @@
 #include "executor/execdebug.h"
 #include "executor/nodeSort.h"
 #include "miscadmin.h"
+#include "utils/lsyscache.h"
 #include "utils/tuplesort.h"
 
 
+/* ----------------------------------------------------------------
+ *		ExecIncrementalSort
+ *
+ *		Variant of ExecSort used when the planner has told us (via
+ *		Sort.skipCols) that the input is already sorted by a prefix of
+ *		the sort key.  Rather than sorting the whole input at once, we
+ *		sort one group of equal leading keys at a time and stream each
+ *		group out as soon as it is complete.  This bounds the sort to
+ *		the size of the largest group and lets bounded (top-N) sorts
+ *		stop reading the input early.
+ *
+ *		Groups are discarded once drained, so this mode cannot support
+ *		backward scan, rewind, or mark/restore; ExecInitSort falls back
+ *		to a normal full sort when any of those are required.
+ * ----------------------------------------------------------------
+ */
+static TupleTableSlot *
+ExecIncrementalSort(SortState *node)
+{
+	Sort	   *plannode = (Sort *) node->ss.ps.plan;
+	PlanState  *outerNode = outerPlanState(node);
+	TupleTableSlot *pivot = node->ss.ss_ScanTupleSlot;
+	TupleTableSlot *slot;
+	Tuplesortstate *tuplesortstate;
+
+	/* guaranteed by the randomAccess check in ExecInitSort */
+	Assert(ScanDirectionIsForward(node->ss.ps.state->es_direction));
+
+	for (;;)
+	{
+		/*
+		 * If a group has been sorted, return its tuples until it is drained.
+		 */
+		if (node->sort_Done)
+		{
+			tuplesortstate = (Tuplesortstate *) node->tuplesortstate;
+			slot = node->ss.ps.ps_ResultTupleSlot;
+			if (tuplesort_gettupleslot(tuplesortstate, true, slot))
+			{
+				node->tuples_Emitted++;
+				return slot;
+			}
+
+			/* group exhausted; release its sort before starting the next */
+			tuplesort_end(tuplesortstate);
+			node->tuplesortstate = NULL;
+			node->sort_Done = false;
+		}
+
+		/* If the input is exhausted (or the bound reached), we are done. */
+		if (node->group_Done ||
+			(node->bounded && node->tuples_Emitted >= node->bound))
+			return ExecClearTuple(node->ss.ps.ps_ResultTupleSlot);
+
+		/*
+		 * Fetch the first tuple of the next group, unless the previous
+		 * group's scan already stashed it in the pivot slot.
+		 */
+		if (TupIsNull(pivot))
+		{
+			slot = ExecProcNode(outerNode);
+			if (TupIsNull(slot))
+			{
+				node->group_Done = true;
+				continue;
+			}
+			ExecCopySlot(pivot, slot);
+		}
+
+		/*
+		 * Sort this group.  The group shares its leading keys, so sorting on
+		 * the full sort key just orders it by the remaining columns.
+		 */
+		tuplesortstate = tuplesort_begin_heap(ExecGetResultType(outerNode),
+											  plannode->numCols,
+											  plannode->sortColIdx,
+											  plannode->sortOperators,
+											  plannode->collations,
+											  plannode->nullsFirst,
+											  work_mem,
+											  false);
+		if (node->bounded)
+			tuplesort_set_bound(tuplesortstate,
+								node->bound - node->tuples_Emitted);
+		node->tuplesortstate = (void *) tuplesortstate;
+
+		tuplesort_puttupleslot(tuplesortstate, pivot);
+
+		for (;;)
+		{
+			slot = ExecProcNode(outerNode);
+
+			if (TupIsNull(slot))
+			{
+				node->group_Done = true;
+				ExecClearTuple(pivot);
+				break;
+			}
+			if (!execTuplesMatch(slot, pivot,
+								 node->skipCols,
+								 plannode->sortColIdx,
+								 node->skipEqFuncs,
+					  node->ss.ps.ps_ExprContext->ecxt_per_tuple_memory))
+			{
+				/* first tuple of the next group; remember it for later */
+				ExecCopySlot(pivot, slot);
+				break;
+			}
+			tuplesort_puttupleslot(tuplesortstate, slot);
+		}
+
+		tuplesort_performsort(tuplesortstate);
+		node->sort_Done = true;
+	}
+}
+
 /* ----------------------------------------------------------------
  *		ExecSort
  *
@@ -49,6 +166,10 @@ ExecSort(SortState *node)
 	SO1_printf("ExecSort: %s\n",
 			   "entering routine");
 
+	/* group-at-a-time sorting is handled separately */
+	if (node->skipCols > 0)
+		return ExecIncrementalSort(node);
+
 	estate = node->ss.ps.state;
 	dir = estate->es_direction;
 	tuplesortstate = (Tuplesortstate *) node->tuplesortstate;
@@ -175,12 +296,17 @@ ExecInitSort(Sort *node, EState *estate, int eflags)
 	sortstate->bounded = false;
 	sortstate->sort_Done = false;
 	sortstate->tuplesortstate = NULL;
+	sortstate->skipCols = 0;
+	sortstate->skipEqFuncs = NULL;
+	sortstate->group_Done = false;
+	sortstate->tuples_Emitted = 0;
 
 	/*
 	 * Miscellaneous initialization
 	 *
 	 * Sort nodes don't initialize their ExprContexts because they never call
-	 * ExecQual or ExecProject.
+	 * ExecQual or ExecProject.  (Incremental sort creates one below, merely
+	 * to have a short-lived memory context for group comparisons.)
 	 */
 
 	/*
@@ -209,6 +335,34 @@ ExecInitSort(Sort *node, EState *estate, int eflags)
 	ExecAssignScanTypeFromOuterPlan(&sortstate->ss);
 	sortstate->ss.ps.ps_ProjInfo = NULL;
 
+	/*
+	 * Sort incrementally if the planner marked leading sort columns as
+	 * presorted, unless the caller needs random access to the result:
+	 * incremental sort discards each group as soon as it is drained, so it
+	 * cannot support rewind, backward scan, or mark/restore.  In that case
+	 * we silently fall back to a normal full sort.
+	 */
+	if (node->skipCols > 0 && !sortstate->randomAccess)
+	{
+		Oid		   *eqOperators;
+		int			i;
+
+		eqOperators = (Oid *) palloc(node->skipCols * sizeof(Oid));
+		for (i = 0; i < node->skipCols; i++)
+		{
+			eqOperators[i] =
+				get_equality_op_for_ordering_op(node->sortOperators[i], NULL);
+			if (!OidIsValid(eqOperators[i]))
+				elog(ERROR, "missing equality operator for ordering operator %u",
+					 node->sortOperators[i]);
+		}
+		sortstate->skipCols = node->skipCols;
+		sortstate->skipEqFuncs = execTuplesMatchPrepare(node->skipCols,
+														eqOperators);
+		pfree(eqOperators);
+		ExecAssignExprContext(estate, &sortstate->ss.ps);
+	}
+
 	SO1_printf("ExecInitSort: %s\n",
 			   "sort node initialized");
 
@@ -292,6 +446,38 @@ ExecReScanSort(SortState *node)
 {
 	PlanState  *outerPlan = outerPlanState(node);
 
+	/*
+	 * Incremental sort consumes its input progressively and discards each
+	 * group once drained, so if anything has been read we must always start
+	 * over from the top of the input.
+	 */
+	if (node->skipCols > 0)
+	{
+		if (!node->sort_Done && !node->group_Done &&
+			node->tuplesortstate == NULL &&
+			TupIsNull(node->ss.ss_ScanTupleSlot))
+			return;				/* never started; nothing to reset */
+
+		ExecClearTuple(node->ss.ps.ps_ResultTupleSlot);
+		ExecClearTuple(node->ss.ss_ScanTupleSlot);
+		node->sort_Done = false;
+		node->group_Done = false;
+		node->tuples_Emitted = 0;
+		if (node->tuplesortstate != NULL)
+		{
+			tuplesort_end((Tuplesortstate *) node->tuplesortstate);
+			node->tuplesortstate = NULL;
+		}
+
+		/*
+		 * if chgParam of subnode is not null then plan will be re-scanned by
+		 * first ExecProcNode.
+		 */
+		if (outerPlan->chgParam == NULL)
+			ExecReScan(outerPlan);
+		return;
+	}
+
 	/*
 	 * If we haven't sorted yet, just return. If outerplan's chgParam is not
 	 * NULL then it will be re-scanned by ExecProcNode, else no reason to
@@ -190,12 +190,17 @@ tqueueReceiveSlot(TupleTableSlot *slot, DestReceiver *self)
 		if (tqueue->mode != TUPLE_QUEUE_MODE_DATA)
 		{
 			tqueue->mode = TUPLE_QUEUE_MODE_DATA;
-			shm_mq_send(tqueue->handle, sizeof(char), &tqueue->mode, false);
+			shm_mq_send(tqueue->handle, sizeof(char), &tqueue->mode, false, false);
 		}
 	}
 
-	/* Send the tuple itself. */
-	shm_mq_send(tqueue->handle, tuple->t_len, tuple->t_data, false);
+	/*
+	 * Send the tuple itself.  We don't force a flush here; batching the
+	 * updates of the queue's write counter saves the leader a latch
+	 * operation per tuple.  tqueueShutdownReceiver flushes whatever is
+	 * still pending.
+	 */
+	shm_mq_send(tqueue->handle, tuple->t_len, tuple->t_data, false, false);
 }
 
 /*
@@ -404,7 +409,7 @@ tqueueSendTypmodInfo(TQueueDestReceiver * tqueue, int typmod,
 	if (tqueue->mode != TUPLE_QUEUE_MODE_CONTROL)
 	{
 		tqueue->mode = TUPLE_QUEUE_MODE_CONTROL;
-		shm_mq_send(tqueue->handle, sizeof(char), &tqueue->mode, false);
+		shm_mq_send(tqueue->handle, sizeof(char), &tqueue->mode, false, false);
 	}
 
 	/* Assemble a control message. */
@@ -418,7 +423,7 @@ tqueueSendTypmodInfo(TQueueDestReceiver * tqueue, int typmod,
 							   sizeof(FormData_pg_attribute));
 
 	/* Send control message. */
-	shm_mq_send(tqueue->handle, buf.len, buf.data, false);
+	shm_mq_send(tqueue->handle, buf.len, buf.data, false, false);
 }
 
 /*
@@ -438,6 +443,8 @@ tqueueShutdownReceiver(DestReceiver *self)
 {
 	TQueueDestReceiver *tqueue = (TQueueDestReceiver *) self;
 
+	/* Let the receiver see any tuples that are still unflushed. */
+	shm_mq_flush(tqueue->handle);
 	shm_mq_detach(shm_mq_get_queue(tqueue->handle));
 }
 
@@ -203,6 +203,29 @@ pq_init(void)
 
 }
 
+/* --------------------------------
+ *		pq_reset - reinitialize libpq when a pooled backend is reused
+ *
+ * Called after a new client socket has been installed in MyProcPort.
+ * Discards any buffered traffic belonging to the previous connection and
+ * puts the new socket into the usual nonblocking mode.
+ * --------------------------------
+ */
+void
+pq_reset(void)
+{
+	PqSendPointer = PqSendStart = PqRecvPointer = PqRecvLength = 0;
+	PqCommBusy = false;
+	PqCommReadingMsg = false;
+	DoingCopyOut = false;
+
+#ifndef WIN32
+	if (!pg_set_noblock(MyProcPort->sock))
+		ereport(COMMERROR,
+				(errmsg("could not set socket to nonblocking mode: %m")));
+#endif
+}
+
 /* --------------------------------
  *		socket_comm_reset - reset libpq during error recovery
  *
@@ -40,10 +40,10 @@
 
 #include <limits.h>
 
+#include "access/hash.h"
 #include "access/htup_details.h"
 #include "nodes/bitmapset.h"
 #include "nodes/tidbitmap.h"
-#include "utils/hsearch.h"
 
 /*
  * The maximum number of tuples per page is not large (typically 256 with
@@ -60,10 +60,10 @@
  * and has the bit set for a given page, there must not be a per-page entry
  * for that page in the page table.
  *
- * We actually store both exact pages and lossy chunks in the same hash
- * table, using identical data structures.  (This is because dynahash.c's
- * memory management doesn't allow space to be transferred easily from one
- * hashtable to another.)  Therefore it's best if PAGES_PER_CHUNK is the
+ * We actually store both exact pages and lossy chunks in the same page
+ * table, using identical data structures.  (This lets an exact page be
+ * turned into a chunk header in place, without moving any memory around.)
+ * Therefore it's best if PAGES_PER_CHUNK is the
  * same as MAX_TUPLES_PER_PAGE, or at least not too different.  But we
  * also want PAGES_PER_CHUNK to be a power of 2 to avoid expensive integer
  * remainder operations.  So, define it like this:
@@ -81,37 +81,52 @@
 #define WORDS_PER_CHUNK  ((PAGES_PER_CHUNK - 1) / BITS_PER_BITMAPWORD + 1)
 
 /*
- * The hashtable entries are represented by this data structure.  For
+ * The page table entries are represented by this data structure.  For
  * an exact page, blockno is the page number and bit k of the bitmap
  * represents tuple offset k+1.  For a lossy chunk, blockno is the first
  * page in the chunk (this must be a multiple of PAGES_PER_CHUNK) and
  * bit k represents page blockno+k.  Note that it is not possible to
  * have exact storage for the first page of a chunk if we are using
  * lossy storage for any page in the chunk's range, since the same
- * hashtable entry has to serve both purposes.
+ * page table entry has to serve both purposes.
  *
  * recheck is used only on exact pages --- it indicates that although
  * only the stated tuples need be checked, the full index qual condition
  * must be checked for each (ie, these are candidate matches).
+ *
+ * The entries are kept by value in an open-addressing hash table (see
+ * below), so each one also carries a slot status.  PTE_EMPTY must be
+ * zero so that a freshly zeroed table reads as all-empty.  Deleted
+ * entries are tombstoned rather than physically removed; tombstones are
+ * recycled by inserts and discarded whenever the table is rebuilt.
  */
+#define PTE_EMPTY		0		/* slot has never held an entry */
+#define PTE_USED		1		/* slot holds a live entry */
+#define PTE_DELETED		2		/* slot held an entry, since deleted */
+
 typedef struct PagetableEntry
 {
-	BlockNumber blockno;		/* page number (hashtable key) */
+	BlockNumber blockno;		/* page number (hash key) */
 	bool		ischunk;		/* T = lossy storage, F = exact */
 	bool		recheck;		/* should the tuples be rechecked? */
+	uint8		status;			/* PTE_EMPTY/PTE_USED/PTE_DELETED */
 	bitmapword	words[Max(WORDS_PER_PAGE, WORDS_PER_CHUNK)];
 } PagetableEntry;
 
 /*
- * dynahash.c is optimized for relatively large, long-lived hash tables.
- * This is not ideal for TIDBitMap, particularly when we are using a bitmap
- * scan on the inside of a nestloop join: a bitmap may well live only long
- * enough to accumulate one entry in such cases.  We therefore avoid creating
- * an actual hashtable until we need two pagetable entries.  When just one
- * pagetable entry is needed, we store it in a fixed field of TIDBitMap.
- * (NOTE: we don't get rid of the hashtable if the bitmap later shrinks down
- * to zero or one page again.  So, status can be TBM_HASH even when nentries
- * is zero or one.)
+ * We store the entries directly in a simple open-addressing hash table
+ * with linear probing, rather than using dynahash.c.  dynahash charges
+ * every entry a HASHELEMENT header, a bucket pointer and palloc chunk
+ * overhead, which for entries this size wastes roughly a third of the
+ * memory budget; storing them by value lets considerably larger TID sets
+ * stay exact within the same work_mem.  Even so, creating the table is a
+ * moderately expensive proposition, and a bitmap scan on the inside of a
+ * nestloop join may well live only long enough to accumulate one entry.
+ * We therefore avoid creating the table until we need two pagetable
+ * entries.  When just one pagetable entry is needed, we store it in a
+ * fixed field of TIDBitMap.  (NOTE: we don't get rid of the table if the
+ * bitmap later shrinks down to zero or one page again.  So, status can be
+ * TBM_HASH even when nentries is zero or one.)
  */
 typedef enum
 {
@@ -128,8 +143,10 @@ struct TIDBitmap
 	NodeTag		type;			/* to make it a valid Node */
 	MemoryContext mcxt;			/* memory context containing me */
 	TBMStatus	status;			/* see codes above */
-	HTAB	   *pagetable;		/* hash table of PagetableEntry's */
-	int			nentries;		/* number of entries in pagetable */
+	PagetableEntry *pagetable;	/* open-addressing array of entries */
+	uint32		pagetablesize;	/* # of slots in pagetable (power of 2) */
+	uint32		pagetableused;	/* # of used + tombstoned slots */
+	int			nentries;		/* number of live entries in pagetable */
 	int			maxentries;		/* limit on same to meet maxbytes */
 	int			npages;			/* number of exact entries in pagetable */
 	int			nchunks;		/* number of lossy entries in pagetable */
@@ -167,6 +184,12 @@ static bool tbm_page_is_lossy(const TIDBitmap *tbm, BlockNumber pageno);
 static void tbm_mark_page_lossy(TIDBitmap *tbm, BlockNumber pageno);
 static void tbm_lossify(TIDBitmap *tbm);
 static int	tbm_comparator(const void *left, const void *right);
+static PagetableEntry *tbm_hash_lookup(const TIDBitmap *tbm,
+				BlockNumber blockno);
+static PagetableEntry *tbm_hash_insert(TIDBitmap *tbm, BlockNumber blockno,
+				bool *found);
+static bool tbm_hash_delete(TIDBitmap *tbm, BlockNumber blockno);
+static void tbm_hash_rebuild(TIDBitmap *tbm);
 
 
 /*
@@ -189,14 +212,14 @@ tbm_create(long maxbytes)
 	tbm->status = TBM_EMPTY;
 
 	/*
-	 * Estimate number of hashtable entries we can have within maxbytes. This
-	 * estimates the hash overhead at MAXALIGN(sizeof(HASHELEMENT)) plus a
-	 * pointer per hash entry, which is crude but good enough for our purpose.
-	 * Also count an extra Pointer per entry for the arrays created during
-	 * iteration readout.
+	 * Estimate number of pagetable entries we can have within maxbytes.  The
+	 * entries are stored by value in the open-addressing table, which we keep
+	 * no more than three-quarters full, so charge each entry one-third extra
+	 * for the vacant slots.  Also count an extra Pointer per entry for the
+	 * arrays created during iteration readout.
 	 */
 	nbuckets = maxbytes /
-		(MAXALIGN(sizeof(HASHELEMENT)) + MAXALIGN(sizeof(PagetableEntry))
+		(sizeof(PagetableEntry) + sizeof(PagetableEntry) / 3
 		 + sizeof(Pointer) + sizeof(Pointer));
 	nbuckets = Min(nbuckets, INT_MAX - 1);		/* safety limit */
 	nbuckets = Max(nbuckets, 16);		/* sanity limit */
@@ -206,38 +229,32 @@ tbm_create(long maxbytes)
 }
 
 /*
- * Actually create the hashtable.  Since this is a moderately expensive
+ * Actually create the page table.  Since this is a moderately expensive
  * proposition, we don't do it until we have to.
  */
 static void
 tbm_create_pagetable(TIDBitmap *tbm)
 {
-	HASHCTL		hash_ctl;
-
 	Assert(tbm->status != TBM_HASH);
 	Assert(tbm->pagetable == NULL);
 
-	/* Create the hashtable proper */
-	MemSet(&hash_ctl, 0, sizeof(hash_ctl));
-	hash_ctl.keysize = sizeof(BlockNumber);
-	hash_ctl.entrysize = sizeof(PagetableEntry);
-	hash_ctl.hcxt = tbm->mcxt;
-	tbm->pagetable = hash_create("TIDBitmap",
-								 128,	/* start small and extend */
-								 &hash_ctl,
-								 HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
-
-	/* If entry1 is valid, push it into the hashtable */
+	/* Create the table proper; start small and extend */
+	tbm->pagetablesize = 128;
+	tbm->pagetableused = 0;
+	tbm->pagetable = (PagetableEntry *)
+		MemoryContextAllocZero(tbm->mcxt,
+							   tbm->pagetablesize * sizeof(PagetableEntry));
+
+	/* If entry1 is valid, push it into the table */
 	if (tbm->status == TBM_ONE_PAGE)
 	{
 		PagetableEntry *page;
 		bool		found;
 
-		page = (PagetableEntry *) hash_search(tbm->pagetable,
-											  (void *) &tbm->entry1.blockno,
-											  HASH_ENTER, &found);
+		page = tbm_hash_insert(tbm, tbm->entry1.blockno, &found);
 		Assert(!found);
 		memcpy(page, &tbm->entry1, sizeof(PagetableEntry));
+		page->status = PTE_USED;
 	}
 
 	tbm->status = TBM_HASH;
@@ -250,7 +267,7 @@ void
 tbm_free(TIDBitmap *tbm)
 {
 	if (tbm->pagetable)
-		hash_destroy(tbm->pagetable);
+		pfree(tbm->pagetable);
 	if (tbm->spages)
 		pfree(tbm->spages);
 	if (tbm->schunks)
@@ -357,13 +374,16 @@ tbm_union(TIDBitmap *a, const TIDBitmap *b)
 		tbm_union_page(a, &b->entry1);
 	else
 	{
-		HASH_SEQ_STATUS status;
-		PagetableEntry *bpage;
+		uint32		i;
 
 		Assert(b->status == TBM_HASH);
-		hash_seq_init(&status, b->pagetable);
-		while ((bpage = (PagetableEntry *) hash_seq_search(&status)) != NULL)
-			tbm_union_page(a, bpage);
+		for (i = 0; i < b->pagetablesize; i++)
+		{
+			PagetableEntry *bpage = &b->pagetable[i];
+
+			if (bpage->status == PTE_USED)
+				tbm_union_page(a, bpage);
+		}
 	}
 }
 
@@ -449,13 +469,15 @@ tbm_intersect(TIDBitmap *a, const TIDBitmap *b)
 	}
 	else
 	{
-		HASH_SEQ_STATUS status;
-		PagetableEntry *apage;
+		uint32		i;
 
 		Assert(a->status == TBM_HASH);
-		hash_seq_init(&status, a->pagetable);
-		while ((apage = (PagetableEntry *) hash_seq_search(&status)) != NULL)
+		for (i = 0; i < a->pagetablesize; i++)
 		{
+			PagetableEntry *apage = &a->pagetable[i];
+
+			if (apage->status != PTE_USED)
+				continue;
 			if (tbm_intersect_page(a, apage, b))
 			{
 				/* Page or chunk is now empty, remove it from a */
@@ -464,10 +486,8 @@ tbm_intersect(TIDBitmap *a, const TIDBitmap *b)
 				else
 					a->npages--;
 				a->nentries--;
-				if (hash_search(a->pagetable,
-								(void *) &apage->blockno,
-								HASH_REMOVE, NULL) == NULL)
-					elog(ERROR, "hash table corrupted");
+				if (!tbm_hash_delete(a, apage->blockno))
+					elog(ERROR, "page table corrupted");
 			}
 		}
 	}
@@ -606,10 +626,9 @@ tbm_begin_iterate(TIDBitmap *tbm)
 	 */
 	if (tbm->status == TBM_HASH && !tbm->iterating)
 	{
-		HASH_SEQ_STATUS status;
-		PagetableEntry *page;
 		int			npages;
 		int			nchunks;
+		uint32		i;
 
 		if (!tbm->spages && tbm->npages > 0)
 			tbm->spages = (PagetableEntry **)
@@ -620,10 +639,13 @@ tbm_begin_iterate(TIDBitmap *tbm)
 				MemoryContextAlloc(tbm->mcxt,
 								   tbm->nchunks * sizeof(PagetableEntry *));
 
-		hash_seq_init(&status, tbm->pagetable);
 		npages = nchunks = 0;
-		while ((page = (PagetableEntry *) hash_seq_search(&status)) != NULL)
+		for (i = 0; i < tbm->pagetablesize; i++)
 		{
+			PagetableEntry *page = &tbm->pagetable[i];
+
+			if (page->status != PTE_USED)
+				continue;
 			if (page->ischunk)
 				tbm->schunks[nchunks++] = page;
 			else
@@ -791,9 +813,7 @@ tbm_find_pageentry(const TIDBitmap *tbm, BlockNumber pageno)
 		return page;
 	}
 
-	page = (PagetableEntry *) hash_search(tbm->pagetable,
-										  (void *) &pageno,
-										  HASH_FIND, NULL);
+	page = tbm_hash_lookup(tbm, pageno);
 	if (page == NULL)
 		return NULL;
 	if (page->ischunk)
@@ -834,16 +854,16 @@ tbm_get_pageentry(TIDBitmap *tbm, BlockNumber pageno)
 		}
 
 		/* Look up or create an entry */
-		page = (PagetableEntry *) hash_search(tbm->pagetable,
-											  (void *) &pageno,
-											  HASH_ENTER, &found);
+		page = tbm_hash_insert(tbm, pageno, &found);
 	}
 
 	/* Initialize it if not present before */
 	if (!found)
 	{
-		MemSet(page, 0, sizeof(PagetableEntry));
+		MemSet(page->words, 0, sizeof(page->words));
 		page->blockno = pageno;
+		page->ischunk = false;
+		page->recheck = false;
 		/* must count it too */
 		tbm->nentries++;
 		tbm->npages++;
@@ -869,9 +889,7 @@ tbm_page_is_lossy(const TIDBitmap *tbm, BlockNumber pageno)
 
 	bitno = pageno % PAGES_PER_CHUNK;
 	chunk_pageno = pageno - bitno;
-	page = (PagetableEntry *) hash_search(tbm->pagetable,
-										  (void *) &chunk_pageno,
-										  HASH_FIND, NULL);
+	page = tbm_hash_lookup(tbm, chunk_pageno);
 	if (page != NULL && page->ischunk)
 	{
 		int			wordnum = WORDNUM(bitno);
@@ -912,9 +930,7 @@ tbm_mark_page_lossy(TIDBitmap *tbm, BlockNumber pageno)
 	 */
 	if (bitno != 0)
 	{
-		if (hash_search(tbm->pagetable,
-						(void *) &pageno,
-						HASH_REMOVE, NULL) != NULL)
+		if (tbm_hash_delete(tbm, pageno))
 		{
 			/* It was present, so adjust counts */
 			tbm->nentries--;
@@ -923,16 +939,15 @@ tbm_mark_page_lossy(TIDBitmap *tbm, BlockNumber pageno)
 	}
 
 	/* Look up or create entry for chunk-header page */
-	page = (PagetableEntry *) hash_search(tbm->pagetable,
-										  (void *) &chunk_pageno,
-										  HASH_ENTER, &found);
+	page = tbm_hash_insert(tbm, chunk_pageno, &found);
 
 	/* Initialize it if not present before */
 	if (!found)
 	{
-		MemSet(page, 0, sizeof(PagetableEntry));
+		MemSet(page->words, 0, sizeof(page->words));
 		page->blockno = chunk_pageno;
 		page->ischunk = true;
+		page->recheck = false;
 		/* must count it too */
 		tbm->nentries++;
 		tbm->nchunks++;
@@ -940,9 +955,9 @@ tbm_mark_page_lossy(TIDBitmap *tbm, BlockNumber pageno)
 	else if (!page->ischunk)
 	{
 		/* chunk header page was formerly non-lossy, make it lossy */
-		MemSet(page, 0, sizeof(PagetableEntry));
-		page->blockno = chunk_pageno;
+		MemSet(page->words, 0, sizeof(page->words));
 		page->ischunk = true;
+		page->recheck = false;
 		/* we assume it had some tuple bit(s) set, so mark it lossy */
 		page->words[0] = ((bitmapword) 1 << 0);
 		/* adjust counts */
@@ -962,8 +977,8 @@ tbm_mark_page_lossy(TIDBitmap *tbm, BlockNumber pageno)
 static void
 tbm_lossify(TIDBitmap *tbm)
 {
-	HASH_SEQ_STATUS status;
-	PagetableEntry *page;
+	PagetableEntry *oldtable;
+	uint32		i;
 
 	/*
 	 * XXX Really stupid implementation: this just lossifies pages in
@@ -977,34 +992,44 @@ tbm_lossify(TIDBitmap *tbm)
 	Assert(!tbm->iterating);
 	Assert(tbm->status == TBM_HASH);
 
-	hash_seq_init(&status, tbm->pagetable);
-	while ((page = (PagetableEntry *) hash_seq_search(&status)) != NULL)
+	oldtable = tbm->pagetable;
+	i = 0;
+	while (i < tbm->pagetablesize)
 	{
-		if (page->ischunk)
-			continue;			/* already a chunk header */
-
-		/*
-		 * If the page would become a chunk header, we won't save anything by
-		 * converting it to lossy, so skip it.
-		 */
-		if ((page->blockno % PAGES_PER_CHUNK) == 0)
-			continue;
-
-		/* This does the dirty work ... */
-		tbm_mark_page_lossy(tbm, page->blockno);
+		PagetableEntry *page = &tbm->pagetable[i];
 
-		if (tbm->nentries <= tbm->maxentries / 2)
+		if (page->status == PTE_USED &&
+			!page->ischunk &&
+			(page->blockno % PAGES_PER_CHUNK) != 0)
 		{
-			/* we have done enough */
-			hash_seq_term(&status);
-			break;
-		}
+			/*
+			 * Convert it to lossy.  (If the page were its own chunk header,
+			 * we wouldn't save anything by converting it, which is why such
+			 * pages are excluded above.)
+			 */
+			tbm_mark_page_lossy(tbm, page->blockno);
+
+			if (tbm->nentries <= tbm->maxentries / 2)
+			{
+				/* we have done enough */
+				break;
+			}
 
-		/*
-		 * Note: tbm_mark_page_lossy may have inserted a lossy chunk into the
-		 * hashtable.  We can continue the same seq_search scan since we do
-		 * not care whether we visit lossy chunks or not.
-		 */
+			/*
+			 * tbm_mark_page_lossy may have inserted a lossy chunk into the
+			 * page table.  Visiting the chunk again is harmless (the ischunk
+			 * test skips it), but if the insertion rebuilt the table our
+			 * scan position is meaningless, so start over.  Each pass
+			 * converts at least one exact page, so this terminates.
+			 */
+			if (tbm->pagetable != oldtable)
+			{
+				oldtable = tbm->pagetable;
+				i = 0;
+				continue;
+			}
+		}
+		i++;
 	}
 
 	/*
@@ -1021,6 +1046,148 @@ tbm_lossify(TIDBitmap *tbm)
 		tbm->maxentries = Min(tbm->nentries, (INT_MAX - 1) / 2) * 2;
 }
 
+/*
+ * tbm_hash_lookup - find the entry for a block number, if any
+ *
+ * Returns NULL if the page table contains no live entry for blockno.
+ */
+static PagetableEntry *
+tbm_hash_lookup(const TIDBitmap *tbm, BlockNumber blockno)
+{
+	uint32		mask = tbm->pagetablesize - 1;
+	uint32		idx;
+
+	idx = DatumGetUInt32(hash_uint32((uint32) blockno)) & mask;
+	for (;;)
+	{
+		PagetableEntry *entry = &tbm->pagetable[idx];
+
+		if (entry->status == PTE_EMPTY)
+			return NULL;
+		if (entry->status == PTE_USED && entry->blockno == blockno)
+			return entry;
+		/* keep probing past tombstones and collisions */
+		idx = (idx + 1) & mask;
+	}
+}
+
+/*
+ * tbm_hash_insert - find or create the entry for a block number
+ *
+ * On return, *found says whether the entry already existed.  A new entry
+ * has only its blockno and status fields set; the caller is responsible
+ * for initializing the rest (a recycled tombstone may hold stale data).
+ */
+static PagetableEntry *
+tbm_hash_insert(TIDBitmap *tbm, BlockNumber blockno, bool *found)
+{
+	PagetableEntry *freeslot = NULL;
+	uint32		mask;
+	uint32		idx;
+
+	/* Rebuild the table when it is getting crowded */
+	if (tbm->pagetableused >= tbm->pagetablesize - tbm->pagetablesize / 4)
+		tbm_hash_rebuild(tbm);
+
+	mask = tbm->pagetablesize - 1;
+	idx = DatumGetUInt32(hash_uint32((uint32) blockno)) & mask;
+	for (;;)
+	{
+		PagetableEntry *entry = &tbm->pagetable[idx];
+
+		if (entry->status == PTE_EMPTY)
+		{
+			/* Not present; use the first tombstone seen, if any */
+			if (freeslot == NULL)
+			{
+				freeslot = entry;
+				tbm->pagetableused++;	/* consuming a virgin slot */
+			}
+			freeslot->blockno = blockno;
+			freeslot->status = PTE_USED;
+			*found = false;
+			return freeslot;
+		}
+		if (entry->status == PTE_DELETED)
+		{
+			if (freeslot == NULL)
+				freeslot = entry;
+		}
+		else if (entry->blockno == blockno)
+		{
+			*found = true;
+			return entry;
+		}
+		idx = (idx + 1) & mask;
+	}
+}
+
+/*
+ * tbm_hash_delete - remove the entry for a block number
+ *
+ * Returns TRUE if an entry was present.  The slot is tombstoned, not
+ * physically cleared, so that probe sequences passing through it still
+ * find entries beyond it; tombstones are discarded at the next rebuild.
+ */
+static bool
+tbm_hash_delete(TIDBitmap *tbm, BlockNumber blockno)
+{
+	PagetableEntry *entry;
+
+	entry = tbm_hash_lookup(tbm, blockno);
+	if (entry == NULL)
+		return false;
+	entry->status = PTE_DELETED;
+	return true;
+}
+
+/*
+ * tbm_hash_rebuild - rehash into a clean table
+ *
+ * Double the table size if the live entries justify it; otherwise keep
+ * the same size and merely get rid of accumulated tombstones.
+ */
+static void
+tbm_hash_rebuild(TIDBitmap *tbm)
+{
+	PagetableEntry *oldtable = tbm->pagetable;
+	uint32		oldsize = tbm->pagetablesize;
+	uint32		newsize;
+	uint32		newmask;
+	uint32		i;
+
+	if ((uint32) tbm->nentries >= oldsize / 2)
+		newsize = oldsize * 2;
+	else
+		newsize = oldsize;
+	newmask = newsize - 1;
+
+	/* allow >1GB tables, since work_mem can legitimately call for that */
+	tbm->pagetable = (PagetableEntry *)
+		MemoryContextAllocExtended(tbm->mcxt,
+								   (Size) newsize * sizeof(PagetableEntry),
+								   MCXT_ALLOC_HUGE | MCXT_ALLOC_ZERO);
+	tbm->pagetablesize = newsize;
+	tbm->pagetableused = 0;
+
+	for (i = 0; i < oldsize; i++)
+	{
+		PagetableEntry *entry = &oldtable[i];
+		uint32		idx;
+
+		if (entry->status != PTE_USED)
+			continue;
+		/* probe for an empty slot; the new table has no tombstones */
+		idx = DatumGetUInt32(hash_uint32((uint32) entry->blockno)) & newmask;
+		while (tbm->pagetable[idx].status != PTE_EMPTY)
+			idx = (idx + 1) & newmask;
+		memcpy(&tbm->pagetable[idx], entry, sizeof(PagetableEntry));
+		tbm->pagetableused++;
+	}
+
+	pfree(oldtable);
+}
+
 /*
  * qsort comparator to handle PagetableEntry pointers.
  */
@@ -98,6 +98,14 @@ static bool choose_hashed_grouping(PlannerInfo *root,
 					   double path_rows, int path_width,
 					   Path *cheapest_path, Path *sorted_path,
 					   double dNumGroups, AggClauseCosts *agg_costs);
+static bool choose_hashed_grouping_sets(PlannerInfo *root,
+							double tuple_fraction,
+							double path_rows, int path_width,
+							Path *cheapest_path, double dNumGroups,
+							AggClauseCosts *agg_costs,
+							List *rollup_groupclauses, List *rollup_lists);
+static List *remap_hashed_grouping_sets(Query *parse, int maxref,
+						   List *rollup_groupclauses, List *rollup_lists);
 static bool choose_hashed_distinct(PlannerInfo *root,
 					   double tuple_fraction, double limit_tuples,
 					   double path_rows, int path_width,
@@ -1862,13 +1870,23 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 		{
 			/*
 			 * If grouping, decide whether to use sorted or hashed grouping.
-			 * If grouping sets are present, we can currently do only sorted
-			 * grouping.
+			 * Grouping sets can be hashed too: rather than the sort-chained
+			 * plan re-sorting the input once per rollup, one unsorted pass
+			 * fills a hash table per grouping set, provided all the sets are
+			 * hashable and the tables are expected to fit in work_mem
+			 * together.
 			 */
 
 			if (parse->groupingSets)
 			{
-				use_hashed_grouping = false;
+				use_hashed_grouping =
+					choose_hashed_grouping_sets(root,
+												tuple_fraction,
+												path_rows, path_width,
+												cheapest_path, dNumGroups,
+												&agg_costs,
+												rollup_groupclauses,
+												rollup_lists);
 			}
 			else
 			{
@@ -2040,6 +2058,20 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 			 */
 			if (use_hashed_grouping)
 			{
+				List	   *hash_sets = NIL;
+
+				/*
+				 * For hashed grouping sets, flatten the rollup lists into a
+				 * single list of sets remapped onto parse->groupClause
+				 * order; the executor builds one hash table per set and
+				 * fills them all in one pass over the unsorted input.
+				 */
+				if (parse->groupingSets)
+					hash_sets = remap_hashed_grouping_sets(parse,
+														   maxref,
+														   rollup_groupclauses,
+														   rollup_lists);
+
 				/* Hashed aggregate plan --- no sort needed */
 				result_plan = (Plan *) make_agg(root,
 												tlist,
@@ -2049,7 +2081,7 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 												numGroupCols,
 												groupColIdx,
 									extract_grouping_ops(parse->groupClause),
-												NIL,
+												hash_sets,
 												numGroups,
 												false,
 												true,
@@ -2246,6 +2278,12 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 											   current_pathkeys))
 					{
 						/* we do indeed need to sort */
+						/* exploit any presorted prefix of the input */
+						if (enable_incrementalsort &&
+							sort_plan->numCols == list_length(window_pathkeys))
+							sort_plan->skipCols =
+								pathkeys_common(window_pathkeys,
+												current_pathkeys);
 						result_plan = (Plan *) sort_plan;
 						current_pathkeys = window_pathkeys;
 					}
@@ -2390,6 +2428,9 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 
 			if (!pathkeys_contained_in(needed_pathkeys, current_pathkeys))
 			{
+				List	   *input_pathkeys = current_pathkeys;
+				Sort	   *sort_plan;
+
 				if (list_length(root->distinct_pathkeys) >=
 					list_length(root->sort_pathkeys))
 					current_pathkeys = root->distinct_pathkeys;
@@ -2401,10 +2442,16 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 												 current_pathkeys));
 				}
 
-				result_plan = (Plan *) make_sort_from_pathkeys(root,
-															   result_plan,
-															current_pathkeys,
-															   -1.0);
+				sort_plan = make_sort_from_pathkeys(root,
+													result_plan,
+													current_pathkeys,
+													-1.0);
+				/* exploit any presorted prefix, as for the ORDER BY sort */
+				if (enable_incrementalsort &&
+					sort_plan->numCols == list_length(current_pathkeys))
+					sort_plan->skipCols = pathkeys_common(current_pathkeys,
+														  input_pathkeys);
+				result_plan = (Plan *) sort_plan;
 			}
 
 			result_plan = (Plan *) make_unique(result_plan,
@@ -2422,10 +2469,25 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 	{
 		if (!pathkeys_contained_in(root->sort_pathkeys, current_pathkeys))
 		{
-			result_plan = (Plan *) make_sort_from_pathkeys(root,
-														   result_plan,
-														 root->sort_pathkeys,
-														   limit_tuples);
+			Sort	   *sort_plan;
+
+			sort_plan = make_sort_from_pathkeys(root,
+												result_plan,
+												root->sort_pathkeys,
+												limit_tuples);
+
+			/*
+			 * If the input is already sorted by a prefix of the required
+			 * pathkeys, tell the executor so it can sort incrementally, one
+			 * group of equal leading keys at a time.  This is only safe when
+			 * no pathkey was dropped while building the sort columns (else
+			 * the prefix correspondence is lost).
+			 */
+			if (enable_incrementalsort &&
+				sort_plan->numCols == list_length(root->sort_pathkeys))
+				sort_plan->skipCols = pathkeys_common(root->sort_pathkeys,
+													  current_pathkeys);
+			result_plan = (Plan *) sort_plan;
 			current_pathkeys = root->sort_pathkeys;
 		}
 	}
@@ -2502,6 +2564,59 @@ remap_groupColIdx(PlannerInfo *root, List *groupClause)
 	return new_grpColIdx;
 }
 
+/*
+ * Flatten rollup_lists into a single list of grouping sets for a hashed
+ * grouping-sets Agg node, remapping each set's members from positions in its
+ * own rollup's groupclause to positions in parse->groupClause, which is the
+ * column order of the hashed Agg node's grpColIdx.
+ */
+static List *
+remap_hashed_grouping_sets(Query *parse, int maxref,
+						   List *rollup_groupclauses, List *rollup_lists)
+{
+	int		   *ref_to_colnum_map;
+	List	   *result = NIL;
+	ListCell   *lc,
+			   *lc2;
+	int			ref = 0;
+
+	ref_to_colnum_map = (int *) palloc0((maxref + 1) * sizeof(int));
+
+	foreach(lc, parse->groupClause)
+	{
+		SortGroupClause *gc = lfirst(lc);
+
+		ref_to_colnum_map[gc->tleSortGroupRef] = ref++;
+	}
+
+	forboth(lc, rollup_groupclauses, lc2, rollup_lists)
+	{
+		List	   *groupClause = (List *) lfirst(lc);
+		ListCell   *lc_set;
+
+		foreach(lc_set, (List *) lfirst(lc2))
+		{
+			List	   *gset = (List *) lfirst(lc_set);
+			List	   *newset = NIL;
+			ListCell   *lc3;
+
+			foreach(lc3, gset)
+			{
+				SortGroupClause *gc = list_nth(groupClause, lfirst_int(lc3));
+
+				newset = lappend_int(newset,
+									 ref_to_colnum_map[gc->tleSortGroupRef]);
+			}
+
+			result = lappend(result, newset);
+		}
+	}
+
+	pfree(ref_to_colnum_map);
+
+	return result;
+}
+
 /*
  * Build Agg and Sort nodes to implement sorted grouping with one or more
  * grouping sets.  A plain GROUP BY or just the presence of aggregates counts
@@ -3827,6 +3942,131 @@ choose_hashed_grouping(PlannerInfo *root,
 	return false;
 }
 
+/*
+ * choose_hashed_grouping_sets - use one-pass hashed grouping for grouping sets?
+ *
+ * The sort-based alternative is a chain that re-sorts the entire input once
+ * per rollup (see build_grouping_chain).  If every grouping set is hashable
+ * and the combined hash tables are expected to fit in work_mem --- the
+ * executor cannot spill in this mode --- then a single unsorted pass filling
+ * one hash table per set often wins; decide by an estimated cost comparison,
+ * as choose_hashed_grouping does.
+ *
+ * Returns TRUE to select hashing, FALSE to select the sorted chain.
+ */
+static bool
+choose_hashed_grouping_sets(PlannerInfo *root,
+							double tuple_fraction,
+							double path_rows, int path_width,
+							Path *cheapest_path, double dNumGroups,
+							AggClauseCosts *agg_costs,
+							List *rollup_groupclauses, List *rollup_lists)
+{
+	Query	   *parse = root->parse;
+	int			numGroupCols = list_length(parse->groupClause);
+	double		numSets = 0.0;
+	Size		hashentrysize;
+	Path		hashed_p;
+	Path		sorted_p;
+	ListCell   *lc,
+			   *lc2;
+
+	/*
+	 * As in choose_hashed_grouping, hashing is only possible when every
+	 * grouping column has a hashable equality operator and there are no
+	 * DISTINCT/ORDER BY/ordered-set aggregates.  Unlike plain GROUP BY we
+	 * need not error out when hashing is impossible, since the sorted chain
+	 * always remains workable (the parser checked sortability already).
+	 */
+	if (agg_costs->numOrderedAggs != 0 ||
+		!grouping_is_hashable(parse->groupClause))
+		return false;
+
+	/* Prefer sorting when enable_hashagg is off */
+	if (!enable_hashagg)
+		return false;
+
+	/*
+	 * Don't do it if it doesn't look like all the hash tables together will
+	 * fit into work_mem; nodeAgg.c does not spill when keeping one table per
+	 * grouping set.
+	 */
+
+	/* Estimate per-hash-entry space at tuple width... */
+	hashentrysize = MAXALIGN(path_width) + MAXALIGN(SizeofMinimalTupleHeader);
+	/* plus space for pass-by-ref transition values... */
+	hashentrysize += agg_costs->transitionSpace;
+	/* plus the per-hash-entry overhead */
+	hashentrysize += hash_agg_entry_size(agg_costs->numAggs);
+
+	if (hashentrysize * dNumGroups > work_mem * 1024L)
+		return false;
+
+	foreach(lc, rollup_lists)
+		numSets += (double) list_length((List *) lfirst(lc));
+
+	/*
+	 * Cost the hashed alternative: one pass over the cheapest-total input,
+	 * probing a hash table and advancing the transition functions once per
+	 * grouping set for each input row.  Scaling up the tuple count passed to
+	 * cost_agg charges those per-tuple costs once per set.
+	 */
+	cost_agg(&hashed_p, root, AGG_HASHED, agg_costs,
+			 numGroupCols, dNumGroups,
+			 cheapest_path->startup_cost, cheapest_path->total_cost,
+			 path_rows * numSets);
+
+	/*
+	 * Cost the sorted alternative the way build_grouping_chain will run it:
+	 * one sort of the whole input plus one AGG_SORTED pass per rollup.  We
+	 * ignore any useful pre-ordering of the input here, which at worst
+	 * overstates one of the sorts; we also ignore any final ORDER BY sort,
+	 * since with more than one grouping set neither alternative produces
+	 * usefully ordered output.
+	 */
+	sorted_p.startup_cost = cheapest_path->startup_cost;
+	sorted_p.total_cost = cheapest_path->total_cost;
+
+	forboth(lc, rollup_groupclauses, lc2, rollup_lists)
+	{
+		List	   *groupClause = (List *) lfirst(lc);
+		List	   *gsets = (List *) lfirst(lc2);
+		int			nCols = list_length(groupClause);
+		double		nSetGroups;
+		Path		work_p;
+
+		/* Assume this rollup emits its proportional share of the groups */
+		nSetGroups = dNumGroups * list_length(gsets) / numSets;
+
+		if (nCols > 0)
+		{
+			cost_sort(&work_p, root, NIL, 0.0,
+					  path_rows, path_width,
+					  0.0, work_mem, -1.0);
+			sorted_p.total_cost += work_p.total_cost;
+		}
+
+		cost_agg(&work_p, root, AGG_SORTED, agg_costs,
+				 nCols, nSetGroups,
+				 0.0, 0.0,
+				 path_rows);
+		sorted_p.total_cost += work_p.total_cost;
+	}
+
+	/*
+	 * Now make the decision using the top-level tuple fraction.  (With more
+	 * than one grouping set the caller has already forced it to 0, making
+	 * this a comparison of total costs.)
+	 */
+	if (compare_fractional_path_costs(&hashed_p, &sorted_p,
+									  tuple_fraction) < 0)
+	{
+		/* Hashed is cheaper, so use it */
+		return true;
+	}
+	return false;
+}
+
 /*
  * choose_hashed_distinct - should we use hashing for DISTINCT?
  *
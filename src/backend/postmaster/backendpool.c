@@ -0,0 +1,679 @@
+/*-------------------------------------------------------------------------
+ *
+ * backendpool.c
+ *	  Pool of reusable backends shared between client connections.
+ *
+ * With process-per-connection, every connection pays for a fork and a full
+ * backend initialization, which is why external poolers such as pgbouncer
+ * are commonly put in front of gateway nodes.  The backend pool removes the
+ * need for that extra hop in the common case: when a client disconnects,
+ * its backend can park itself in a bounded shared-memory pool instead of
+ * exiting, and a subsequently forked backend that finds a parked backend
+ * serving the same database and user hands its client socket over (via
+ * SCM_RIGHTS on a per-slot UNIX socket) and exits before touching shared
+ * memory.  The receiving backend re-authenticates the new client against
+ * pg_hba.conf, applies the startup-packet options and resumes its command
+ * loop, so the price of the new connection is one cheap short-lived fork
+ * instead of a complete backend initialization.
+ *
+ * Reuse is session-granular and keyed on (database, user): a parked backend
+ * is bound to its database, and matching the user as well means all
+ * login-time privilege checks made by the original initialization remain
+ * valid.  SSL and GSSAPI connections are never pooled, since their
+ * transport state cannot be passed between processes, and neither are
+ * connections carrying command-line options in the startup packet, because
+ * such settings cannot be taken back when the backend is reused.
+ *
+ * Known limitation: RESET ALL returns settings to the values established at
+ * session start, so a setting supplied in one client's startup packet and
+ * not overridden by the next client's persists into the reused session.
+ *
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/postmaster/backendpool.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <unistd.h>
+#include <sys/socket.h>
+#ifdef HAVE_SYS_UN_H
+#include <sys/un.h>
+#endif
+
+#include "access/xact.h"
+#include "commands/discard.h"
+#include "libpq/auth.h"
+#include "libpq/ip.h"
+#include "libpq/libpq.h"
+#include "libpq/pqformat.h"
+#include "miscadmin.h"
+#include "postmaster/backendpool.h"
+#include "postmaster/postmaster.h"
+#include "replication/walsender.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "tcop/tcopprot.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/timeout.h"
+#include "utils/timestamp.h"
+
+/* GUC: number of pool slots, 0 disables the pool */
+int			backend_pool_size = 0;
+
+/*
+ * Slot states.  FREE slots have no backend; IDLE slots have a parked backend
+ * listening on the slot's socket; HANDOFF marks a slot claimed by a donor
+ * that is about to connect, so other donors keep away; BUSY slots belong to
+ * backends currently serving a client.
+ */
+#define BPS_FREE	0
+#define BPS_IDLE	1
+#define BPS_HANDOFF 2
+#define BPS_BUSY	3
+
+typedef struct BackendPoolSlot
+{
+	int			state;
+	pid_t		pid;
+	char		database[NAMEDATALEN];
+	char		user[NAMEDATALEN];
+} BackendPoolSlot;
+
+typedef struct BackendPoolData
+{
+	slock_t		lock;
+	BackendPoolSlot slots[FLEXIBLE_ARRAY_MEMBER];
+} BackendPoolData;
+
+static BackendPoolData *BackendPool = NULL;
+
+/* this backend's slot, or -1 if it never parked */
+static int	MyPoolSlot = -1;
+static pgsocket poolListenSock = PGINVALID_SOCKET;
+
+/*
+ * Fixed header of the handoff message sent over the slot socket; it is
+ * followed by nstrings NUL-terminated strings: database name, user name,
+ * then the startup packet's GUC options as alternating names and values.
+ * The client socket itself travels as SCM_RIGHTS ancillary data.
+ */
+typedef struct HandoffMessage
+{
+	uint32		len;			/* total message length, header included */
+	ProtocolVersion proto;
+	SockAddr	raddr;
+	SockAddr	laddr;
+	int			nstrings;
+} HandoffMessage;
+
+#ifdef HAVE_UNIX_SOCKETS
+static void pool_socket_path(char *path, size_t pathlen, int slot);
+static void pool_release_slot(int code, Datum arg);
+static bool pool_claim_slot(void);
+static bool pool_send_client(pgsocket sock, int clientfd, char *data, int len);
+static bool pool_read(pgsocket sock, char *buf, int len, int *clientfd);
+static bool pool_attach_client(pgsocket connfd);
+#endif
+
+Size
+BackendPoolShmemSize(void)
+{
+	if (backend_pool_size <= 0)
+		return 0;
+	return add_size(offsetof(BackendPoolData, slots),
+					mul_size(backend_pool_size, sizeof(BackendPoolSlot)));
+}
+
+void
+BackendPoolShmemInit(void)
+{
+	bool		found;
+
+	if (backend_pool_size <= 0)
+		return;
+
+	BackendPool = (BackendPoolData *)
+		ShmemInitStruct("Backend Pool", BackendPoolShmemSize(), &found);
+	if (!found)
+	{
+		memset(BackendPool, 0, BackendPoolShmemSize());
+		SpinLockInit(&BackendPool->lock);
+	}
+}
+
+#ifdef HAVE_UNIX_SOCKETS
+
+/*
+ * Per-slot socket path; backends run with the data directory as cwd, so a
+ * relative path keeps us clear of sun_path length limits.
+ */
+static void
+pool_socket_path(char *path, size_t pathlen, int slot)
+{
+	snprintf(path, pathlen, "pg_pool.%d", slot);
+}
+
+/*
+ * on_shmem_exit callback: give the slot back and remove its socket.
+ */
+static void
+pool_release_slot(int code, Datum arg)
+{
+	char		path[MAXPGPATH];
+
+	if (MyPoolSlot < 0)
+		return;
+
+	SpinLockAcquire(&BackendPool->lock);
+	if (BackendPool->slots[MyPoolSlot].pid == MyProcPid)
+	{
+		BackendPool->slots[MyPoolSlot].state = BPS_FREE;
+		BackendPool->slots[MyPoolSlot].pid = 0;
+	}
+	SpinLockRelease(&BackendPool->lock);
+
+	if (poolListenSock != PGINVALID_SOCKET)
+		close(poolListenSock);
+	pool_socket_path(path, sizeof(path), MyPoolSlot);
+	unlink(path);
+	MyPoolSlot = -1;
+}
+
+/*
+ * Claim a free slot and create its listening socket.  Returns false if the
+ * pool is full or the socket cannot be set up.
+ */
+static bool
+pool_claim_slot(void)
+{
+	int			i;
+	char		path[MAXPGPATH];
+	struct sockaddr_un addr;
+
+	SpinLockAcquire(&BackendPool->lock);
+	for (i = 0; i < backend_pool_size; i++)
+	{
+		if (BackendPool->slots[i].state == BPS_FREE)
+		{
+			BackendPool->slots[i].state = BPS_BUSY;
+			BackendPool->slots[i].pid = MyProcPid;
+			strlcpy(BackendPool->slots[i].database,
+					MyProcPort->database_name, NAMEDATALEN);
+			strlcpy(BackendPool->slots[i].user,
+					MyProcPort->user_name, NAMEDATALEN);
+			break;
+		}
+	}
+	SpinLockRelease(&BackendPool->lock);
+
+	if (i >= backend_pool_size)
+		return false;
+
+	MyPoolSlot = i;
+	on_shmem_exit(pool_release_slot, 0);
+
+	pool_socket_path(path, sizeof(path), MyPoolSlot);
+	unlink(path);
+
+	poolListenSock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (poolListenSock == PGINVALID_SOCKET)
+	{
+		ereport(LOG,
+				(errcode_for_socket_access(),
+				 errmsg("could not create backend pool socket: %m")));
+		return false;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strlcpy(addr.sun_path, path, sizeof(addr.sun_path));
+	if (bind(poolListenSock, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+		listen(poolListenSock, 2) < 0)
+	{
+		ereport(LOG,
+				(errcode_for_socket_access(),
+				 errmsg("could not bind backend pool socket \"%s\": %m",
+						path)));
+		close(poolListenSock);
+		poolListenSock = PGINVALID_SOCKET;
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Donor side: send the handoff message, with the client socket attached to
+ * the first chunk as ancillary data.
+ */
+static bool
+pool_send_client(pgsocket sock, int clientfd, char *data, int len)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	char		cbuf[CMSG_SPACE(sizeof(int))];
+	struct cmsghdr *cmsg;
+	int			sent;
+
+	iov.iov_base = data;
+	iov.iov_len = len;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &clientfd, sizeof(int));
+
+	sent = sendmsg(sock, &msg, 0);
+	if (sent < 0)
+		return false;
+	while (sent < len)
+	{
+		int			n = send(sock, data + sent, len - sent, 0);
+
+		if (n <= 0)
+			return false;
+		sent += n;
+	}
+	return true;
+}
+
+/*
+ * Recipient side: read exactly len bytes, picking up the passed client
+ * socket from ancillary data whenever it shows up.
+ */
+static bool
+pool_read(pgsocket sock, char *buf, int len, int *clientfd)
+{
+	int			rcvd = 0;
+
+	while (rcvd < len)
+	{
+		struct msghdr msg;
+		struct iovec iov;
+		char		cbuf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr *cmsg;
+		int			n;
+
+		iov.iov_base = buf + rcvd;
+		iov.iov_len = len - rcvd;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = cbuf;
+		msg.msg_controllen = sizeof(cbuf);
+
+		n = recvmsg(sock, &msg, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		rcvd += n;
+
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+			 cmsg = CMSG_NXTHDR(&msg, cmsg))
+		{
+			if (cmsg->cmsg_level == SOL_SOCKET &&
+				cmsg->cmsg_type == SCM_RIGHTS)
+				memcpy(clientfd, CMSG_DATA(cmsg), sizeof(int));
+		}
+	}
+	return true;
+}
+
+#endif   /* HAVE_UNIX_SOCKETS */
+
+/*
+ * BackendPoolHandoff
+ *		Try to pass our client to an already initialized parked backend.
+ *
+ * Called early in PostgresMain, before shared-memory initialization.  On
+ * success the caller should simply exit; the parked backend owns the client
+ * from here on.  Returns false, leaving no trace, whenever the connection
+ * is not poolable or no suitable parked backend exists.
+ */
+bool
+BackendPoolHandoff(Port *port)
+{
+#ifdef HAVE_UNIX_SOCKETS
+	int			i;
+	pid_t		pid = 0;
+	char		path[MAXPGPATH];
+	struct sockaddr_un addr;
+	pgsocket	sock;
+	StringInfoData payload;
+	HandoffMessage hdr;
+	char	   *buf;
+	ListCell   *lc;
+	bool		ok;
+
+	if (backend_pool_size <= 0 || BackendPool == NULL ||
+		!IsUnderPostmaster || am_walsender ||
+		port == NULL || port->sock == PGINVALID_SOCKET ||
+		port->ssl_in_use || port->gss != NULL ||
+		port->cmdline_options != NULL ||
+		port->database_name == NULL || port->user_name == NULL)
+		return false;
+
+	/* find and claim an idle backend serving the same database and user */
+	SpinLockAcquire(&BackendPool->lock);
+	for (i = 0; i < backend_pool_size; i++)
+	{
+		BackendPoolSlot *slot = &BackendPool->slots[i];
+
+		if (slot->state == BPS_IDLE &&
+			strcmp(slot->database, port->database_name) == 0 &&
+			strcmp(slot->user, port->user_name) == 0)
+		{
+			slot->state = BPS_HANDOFF;
+			pid = slot->pid;
+			break;
+		}
+	}
+	SpinLockRelease(&BackendPool->lock);
+
+	if (i >= backend_pool_size)
+		return false;
+
+	pool_socket_path(path, sizeof(path), i);
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock != PGINVALID_SOCKET)
+	{
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strlcpy(addr.sun_path, path, sizeof(addr.sun_path));
+		if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+		{
+			close(sock);
+			sock = PGINVALID_SOCKET;
+		}
+	}
+	if (sock == PGINVALID_SOCKET)
+	{
+		/* parked backend presumed dead: retire the slot and do it ourselves */
+		SpinLockAcquire(&BackendPool->lock);
+		if (BackendPool->slots[i].state == BPS_HANDOFF &&
+			BackendPool->slots[i].pid == pid)
+		{
+			BackendPool->slots[i].state = BPS_FREE;
+			BackendPool->slots[i].pid = 0;
+		}
+		SpinLockRelease(&BackendPool->lock);
+		return false;
+	}
+
+	initStringInfo(&payload);
+	appendBinaryStringInfo(&payload, port->database_name,
+						   strlen(port->database_name) + 1);
+	appendBinaryStringInfo(&payload, port->user_name,
+						   strlen(port->user_name) + 1);
+	foreach(lc, port->guc_options)
+	{
+		char	   *str = (char *) lfirst(lc);
+
+		appendBinaryStringInfo(&payload, str, strlen(str) + 1);
+	}
+
+	hdr.len = sizeof(hdr) + payload.len;
+	hdr.proto = port->proto;
+	hdr.raddr = port->raddr;
+	hdr.laddr = port->laddr;
+	hdr.nstrings = 2 + list_length(port->guc_options);
+
+	buf = palloc(hdr.len);
+	memcpy(buf, &hdr, sizeof(hdr));
+	memcpy(buf + sizeof(hdr), payload.data, payload.len);
+
+	ok = pool_send_client(sock, port->sock, buf, hdr.len);
+	close(sock);
+	if (!ok)
+	{
+		ereport(LOG,
+				(errcode_for_socket_access(),
+				 errmsg("could not hand connection over to pooled backend %d: %m",
+						(int) pid)));
+		return false;
+	}
+
+	return true;
+#else
+	return false;
+#endif   /* HAVE_UNIX_SOCKETS */
+}
+
+#ifdef HAVE_UNIX_SOCKETS
+
+/*
+ * Install the handed-over client into MyProcPort, authenticate it and send
+ * the startup responses.  Authentication failure does not return.
+ */
+static bool
+pool_attach_client(pgsocket connfd)
+{
+	HandoffMessage hdr;
+	int			clientfd = -1;
+	char	   *body;
+	char	   *p;
+	int			i;
+	Port	   *port = MyProcPort;
+	char		remote_host[NI_MAXHOST];
+	char		remote_port[NI_MAXSERV];
+	GucContext	gucctx;
+	ListCell   *gucopts;
+	StringInfoData keybuf;
+
+	if (!pool_read(connfd, (char *) &hdr, sizeof(hdr), &clientfd) ||
+		hdr.len <= sizeof(hdr) || hdr.len > 65536 || hdr.nstrings < 2)
+	{
+		if (clientfd >= 0)
+			close(clientfd);
+		return false;
+	}
+	body = palloc(hdr.len - sizeof(hdr));
+	if (!pool_read(connfd, body, hdr.len - sizeof(hdr), &clientfd) ||
+		clientfd < 0 || body[hdr.len - sizeof(hdr) - 1] != '\0')
+	{
+		if (clientfd >= 0)
+			close(clientfd);
+		return false;
+	}
+
+	/* replace the dead connection with the new client */
+	port->sock = clientfd;
+	port->proto = FrontendProtocol = hdr.proto;
+	port->raddr = hdr.raddr;
+	port->laddr = hdr.laddr;
+	port->SessionStartTime = GetCurrentTimestamp();
+
+	remote_host[0] = '\0';
+	remote_port[0] = '\0';
+	(void) pg_getnameinfo_all(&port->raddr.addr, port->raddr.salen,
+							  remote_host, sizeof(remote_host),
+							  remote_port, sizeof(remote_port),
+							  NI_NUMERICHOST | NI_NUMERICSERV);
+	if (port->remote_host)
+		free(port->remote_host);
+	if (port->remote_port)
+		free(port->remote_port);
+	port->remote_host = strdup(remote_host);
+	port->remote_port = strdup(remote_port);
+	port->remote_hostname = NULL;
+
+	/* startup-packet strings, long-lived like ProcessStartupPacket's */
+	if (port->database_name)
+		pfree(port->database_name);
+	if (port->user_name)
+		pfree(port->user_name);
+	list_free_deep(port->guc_options);
+	port->guc_options = NIL;
+
+	p = body;
+	port->database_name = MemoryContextStrdup(TopMemoryContext, p);
+	p += strlen(p) + 1;
+	port->user_name = MemoryContextStrdup(TopMemoryContext, p);
+	p += strlen(p) + 1;
+	for (i = 2; i < hdr.nstrings; i++)
+	{
+		if (p >= body + (hdr.len - sizeof(hdr)))
+		{
+			close(clientfd);
+			return false;
+		}
+		port->guc_options = lappend(port->guc_options,
+								  MemoryContextStrdup(TopMemoryContext, p));
+		p += strlen(p) + 1;
+	}
+	pfree(body);
+
+	whereToSendOutput = DestRemote;
+	pq_reset();
+
+	/*
+	 * Authenticate the new client against pg_hba.conf, then apply its
+	 * startup options.  This mirrors PerformAuthentication and
+	 * process_startup_options; database access (e.g. password lookup,
+	 * superuser check) requires a transaction.
+	 */
+	ClientAuthInProgress = true;
+	enable_timeout_after(STATEMENT_TIMEOUT, AuthenticationTimeout * 1000);
+	StartTransactionCommand();
+	ClientAuthentication(port);	/* might not return, if failure */
+
+	gucctx = superuser() ? PGC_SU_BACKEND : PGC_BACKEND;
+	gucopts = list_head(port->guc_options);
+	while (gucopts)
+	{
+		char	   *name;
+		char	   *value;
+
+		name = lfirst(gucopts);
+		gucopts = lnext(gucopts);
+		value = lfirst(gucopts);
+		gucopts = lnext(gucopts);
+		SetConfigOption(name, value, gucctx, PGC_S_CLIENT);
+	}
+	CommitTransactionCommand();
+	disable_timeout(STATEMENT_TIMEOUT, false);
+	ClientAuthInProgress = false;
+
+	if (Log_connections)
+		ereport(LOG,
+				(errmsg("connection authorized: user=%s database=%s (pooled backend)",
+						port->user_name, port->database_name)));
+
+	/*
+	 * Re-report all GUC_REPORT settings and our cancellation key; the main
+	 * loop will follow with ReadyForQuery.  The key is this backend's own,
+	 * so query cancel keeps working for the new client.
+	 */
+	BeginReportingGUCOptions();
+	if (PG_PROTOCOL_MAJOR(FrontendProtocol) >= 2)
+	{
+		pq_beginmessage(&keybuf, 'K');
+		pq_sendint(&keybuf, (int32) MyProcPid, sizeof(int32));
+		pq_sendint(&keybuf, (int32) MyCancelKey, sizeof(int32));
+		pq_endmessage(&keybuf);
+	}
+
+	return true;
+}
+
+#endif   /* HAVE_UNIX_SOCKETS */
+
+/*
+ * BackendPoolPark
+ *		Park this backend in the pool and wait for the next client.
+ *
+ * Called from the main loop when the client goes away.  Returns true once a
+ * new client has been attached and greeted (the caller still sends the
+ * initial ReadyForQuery); returns false when the backend cannot or should
+ * not be reused, in which case the caller exits as usual.
+ */
+bool
+BackendPoolPark(void)
+{
+#ifdef HAVE_UNIX_SOCKETS
+	pgsocket	connfd;
+
+	if (backend_pool_size <= 0 || BackendPool == NULL ||
+		!IsUnderPostmaster || am_walsender ||
+		MyProcPort == NULL || MyProcPort->ssl_in_use ||
+		MyProcPort->gss != NULL || MyProcPort->cmdline_options != NULL ||
+		MyProcPort->database_name == NULL || MyProcPort->user_name == NULL)
+		return false;
+
+	if (MyPoolSlot < 0 && !pool_claim_slot())
+		return false;
+
+	/*
+	 * Reset the session as DISCARD ALL would, before another client can see
+	 * it.  An open (possibly failed) transaction is simply rolled back.
+	 */
+	AbortOutOfAnyTransaction();
+	StartTransactionCommand();
+	DiscardAll(true);
+	CommitTransactionCommand();
+
+	/* drop the old connection */
+	if (MyProcPort->sock != PGINVALID_SOCKET)
+	{
+		close(MyProcPort->sock);
+		MyProcPort->sock = PGINVALID_SOCKET;
+	}
+
+	SpinLockAcquire(&BackendPool->lock);
+	BackendPool->slots[MyPoolSlot].state = BPS_IDLE;
+	SpinLockRelease(&BackendPool->lock);
+
+	for (;;)
+	{
+		int			rc;
+
+		rc = WaitLatchOrSocket(MyLatch,
+							   WL_LATCH_SET | WL_SOCKET_READABLE |
+							   WL_POSTMASTER_DEATH,
+							   poolListenSock, -1L);
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+		if (rc & WL_LATCH_SET)
+		{
+			ResetLatch(MyLatch);
+			CHECK_FOR_INTERRUPTS();	/* exits on pending die() */
+			continue;
+		}
+		if (rc & WL_SOCKET_READABLE)
+			break;
+	}
+
+	connfd = accept(poolListenSock, NULL, NULL);
+
+	SpinLockAcquire(&BackendPool->lock);
+	BackendPool->slots[MyPoolSlot].state = BPS_BUSY;
+	SpinLockRelease(&BackendPool->lock);
+
+	if (connfd == PGINVALID_SOCKET)
+		return false;
+
+	if (!pool_attach_client(connfd))
+	{
+		close(connfd);
+		return false;
+	}
+	close(connfd);
+	return true;
+#else
+	return false;
+#endif   /* HAVE_UNIX_SOCKETS */
+}
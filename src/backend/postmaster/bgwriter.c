@@ -111,6 +111,7 @@ BackgroundWriterMain(void)
 	sigjmp_buf	local_sigjmp_buf;
 	MemoryContext bgwriter_context;
 	bool		prev_hibernate;
+	WritebackContext wb_context;
 
 	/*
 	 * Properly accept or ignore signals the postmaster might send us.
@@ -224,6 +225,12 @@ BackgroundWriterMain(void)
 		 * It's not clear we need it elsewhere, but shouldn't hurt.
 		 */
 		smgrcloseall();
+
+		/*
+		 * Discard any pending writeback requests; the buffers they refer to
+		 * were written before the error, so losing the hints is harmless.
+		 */
+		WritebackContextInit(&wb_context, &bgwriter_flush_after);
 	}
 
 	/* We can now handle ereport(ERROR) */
@@ -239,6 +246,12 @@ BackgroundWriterMain(void)
 	 */
 	prev_hibernate = false;
 
+	/*
+	 * Initialize the context we'll use to coalesce and issue kernel
+	 * writeback requests for the buffers we clean.
+	 */
+	WritebackContextInit(&wb_context, &bgwriter_flush_after);
+
 	/*
 	 * Loop forever
 	 */
@@ -269,7 +282,7 @@ BackgroundWriterMain(void)
 		/*
 		 * Do one cycle of dirty-buffer writing.
 		 */
-		can_hibernate = BgBufferSync();
+		can_hibernate = BgBufferSync(&wb_context);
 
 		/*
 		 * Send off activity statistics to the stats collector
@@ -277,6 +277,15 @@ WalWriterMain(void)
 		else if (left_till_hibernate > 0)
 			left_till_hibernate--;
 
+		/*
+		 * Also keep a pool of preallocated future WAL segments, so that
+		 * backends needing to switch to a new segment rarely have to create
+		 * and zero-fill one in their commit path.  Once the pool is full
+		 * this amounts to one open()/close() per segment per cycle.
+		 */
+		if (wal_prealloc_segments > 0)
+			PreallocXlogFiles(GetXLogWriteRecPtr());
+
 		/*
 		 * Sleep until we are signaled or WalWriterDelay has elapsed.  If we
 		 * haven't done anything useful for quite some time, lengthen the
@@ -47,6 +47,7 @@ typedef struct
 	bool		includewal;
 	uint32		maxrate;
 	bool		sendtblspcmapfile;
+	const char *only_tablespace;	/* OID string, "base", or NULL for all */
 } basebackup_options;
 
 
@@ -121,6 +122,7 @@ perform_base_backup(basebackup_options *opt, DIR *tblspcdir)
 	char	   *tblspc_map_file = NULL;
 	int			datadirpathlen;
 	List	   *tablespaces = NIL;
+	List	   *sendlist = NIL;
 
 	datadirpathlen = strlen(DataDir);
 
@@ -162,8 +164,41 @@ perform_base_backup(basebackup_options *opt, DIR *tblspcdir)
 		ti->size = opt->progress ? sendDir(".", 1, true, tablespaces, true) : -1;
 		tablespaces = lappend(tablespaces, ti);
 
+		/*
+		 * If the client asked for a single tablespace, narrow the list of
+		 * streams we send (and announce) to that one.  This lets a
+		 * provisioning tool open several connections and fetch the
+		 * tablespaces of a large cluster in parallel, or re-fetch just the
+		 * one whose transfer failed, instead of restarting the whole backup.
+		 * The full list must still be passed to sendDir() below, so that
+		 * tablespaces located inside PGDATA are omitted from the base
+		 * directory's stream as usual.
+		 */
+		if (opt->only_tablespace != NULL)
+		{
+			List	   *filtered = NIL;
+
+			foreach(lc, tablespaces)
+			{
+				ti = (tablespaceinfo *) lfirst(lc);
+
+				if (ti->path == NULL
+					? strcmp(opt->only_tablespace, "base") == 0
+					: strcmp(opt->only_tablespace, ti->oid) == 0)
+					filtered = lappend(filtered, ti);
+			}
+			if (filtered == NIL)
+				ereport(ERROR,
+						(errcode(ERRCODE_UNDEFINED_OBJECT),
+						 errmsg("tablespace \"%s\" is not part of this backup",
+								opt->only_tablespace)));
+			sendlist = filtered;
+		}
+		else
+			sendlist = tablespaces;
+
 		/* Send tablespace header */
-		SendBackupHeader(tablespaces);
+		SendBackupHeader(sendlist);
 
 		/* Setup and activate network throttling, if client requested it */
 		if (opt->maxrate > 0)
@@ -190,7 +225,7 @@ perform_base_backup(basebackup_options *opt, DIR *tblspcdir)
 		}
 
 		/* Send off our tablespaces one by one */
-		foreach(lc, tablespaces)
+		foreach(lc, sendlist)
 		{
 			tablespaceinfo *ti = (tablespaceinfo *) lfirst(lc);
 			StringInfoData buf;
@@ -511,6 +546,7 @@ parse_basebackup_options(List *options, basebackup_options *opt)
 	bool		o_wal = false;
 	bool		o_maxrate = false;
 	bool		o_tablespace_map = false;
+	bool		o_only_tablespace = false;
 
 	MemSet(opt, 0, sizeof(*opt));
 	foreach(lopt, options)
@@ -590,12 +626,31 @@ parse_basebackup_options(List *options, basebackup_options *opt)
 			opt->sendtblspcmapfile = true;
 			o_tablespace_map = true;
 		}
+		else if (strcmp(defel->defname, "only_tablespace") == 0)
+		{
+			if (o_only_tablespace)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("duplicate option \"%s\"", defel->defname)));
+			opt->only_tablespace = strVal(defel->arg);
+			o_only_tablespace = true;
+		}
 		else
 			elog(ERROR, "option \"%s\" not recognized",
 				 defel->defname);
 	}
 	if (opt->label == NULL)
 		opt->label = "base backup";
+
+	/*
+	 * WAL is appended to the main data directory's tar stream, so it cannot
+	 * be combined with a filter that excludes the main data directory.
+	 */
+	if (opt->includewal && opt->only_tablespace != NULL &&
+		strcmp(opt->only_tablespace, "base") != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_SYNTAX_ERROR),
+				 errmsg("WAL can only be included when ONLY_TABLESPACE selects the main data directory")));
 }
 
 
@@ -1111,7 +1111,17 @@ SnapBuildProcessRunningXacts(SnapBuild *builder, XLogRecPtr lsn, xl_running_xact
 	if (builder->state < SNAPBUILD_CONSISTENT)
 	{
 		/* returns false if there's no point in performing cleanup just yet */
-		if (!SnapBuildFindSnapshot(builder, lsn, running))
+		bool		maintain = SnapBuildFindSnapshot(builder, lsn, running);
+
+		/*
+		 * Also dump the current state while we're still assembling the
+		 * snapshot. That way a restarting walsender can pick up the wait for
+		 * the remaining in-progress transactions where we left off, instead
+		 * of starting from scratch. A no-op while we're in the START state.
+		 */
+		SnapBuildSerialize(builder, lsn);
+
+		if (!maintain)
 			return;
 	}
 	else
@@ -1451,10 +1461,12 @@ SnapBuildSerialize(SnapBuild *builder, XLogRecPtr lsn)
 		   builder->last_serialized_snapshot <= lsn);
 
 	/*
-	 * no point in serializing if we cannot continue to work immediately after
-	 * restoring the snapshot
+	 * No point in serializing while we're in the START state, there's nothing
+	 * to resume from. Full, not yet consistent, snapshots are worth dumping
+	 * though: they contain the set of transactions we're still waiting on, so
+	 * a restarting walsender can continue the wait instead of beginning anew.
 	 */
-	if (builder->state < SNAPBUILD_CONSISTENT)
+	if (builder->state < SNAPBUILD_FULL_SNAPSHOT)
 		return;
 
 	/*
@@ -1747,11 +1759,15 @@ SnapBuildRestore(SnapBuild *builder, XLogRecPtr lsn)
 	 */
 
 	/*
-	 * We are only interested in consistent snapshots for now, comparing
-	 * whether one incomplete snapshot is more "advanced" seems to be
-	 * unnecessarily complex.
+	 * A full, not yet consistent, snapshot is only interesting if we have no
+	 * state of our own yet; comparing whether one incomplete snapshot is more
+	 * "advanced" than another seems to be unnecessarily complex.
 	 */
-	if (ondisk.builder.state < SNAPBUILD_CONSISTENT)
+	if (ondisk.builder.state < SNAPBUILD_FULL_SNAPSHOT)
+		goto snapshot_not_interesting;
+
+	if (ondisk.builder.state < SNAPBUILD_CONSISTENT &&
+		builder->state != SNAPBUILD_START)
 		goto snapshot_not_interesting;
 
 	/*
@@ -1783,6 +1799,9 @@ SnapBuildRestore(SnapBuild *builder, XLogRecPtr lsn)
 		pfree(builder->running.xip);
 	builder->running.xcnt_space = ondisk.builder.running.xcnt_space;
 	builder->running.xip = ondisk.builder.running.xip;
+	/* needed for the fast range check when still waiting on transactions */
+	builder->running.xmin = ondisk.builder.running.xmin;
+	builder->running.xmax = ondisk.builder.running.xmax;
 
 	/* our snapshot is not interesting anymore, build a new one */
 	if (builder->snapshot != NULL)
@@ -1794,12 +1813,21 @@ SnapBuildRestore(SnapBuild *builder, XLogRecPtr lsn)
 
 	ReorderBufferSetRestartPoint(builder->reorder, lsn);
 
-	Assert(builder->state == SNAPBUILD_CONSISTENT);
+	Assert(builder->state >= SNAPBUILD_FULL_SNAPSHOT);
 
-	ereport(LOG,
-			(errmsg("logical decoding found consistent point at %X/%X",
-					(uint32) (lsn >> 32), (uint32) lsn),
-			 errdetail("Logical decoding will begin using saved snapshot.")));
+	if (builder->state == SNAPBUILD_CONSISTENT)
+		ereport(LOG,
+				(errmsg("logical decoding found consistent point at %X/%X",
+						(uint32) (lsn >> 32), (uint32) lsn),
+				 errdetail("Logical decoding will begin using saved snapshot.")));
+	else
+		ereport(LOG,
+				(errmsg("logical decoding resuming from saved snapshot at %X/%X",
+						(uint32) (lsn >> 32), (uint32) lsn),
+				 errdetail_plural("%u transaction needs to finish.",
+								  "%u transactions need to finish.",
+								  builder->running.xcnt,
+								  (uint32) builder->running.xcnt)));
 	return true;
 
 snapshot_not_interesting:
@@ -72,6 +72,7 @@ Node *replication_parse_result;
 %token K_MAX_RATE
 %token K_WAL
 %token K_TABLESPACE_MAP
+%token K_ONLY_TABLESPACE
 %token K_TIMELINE
 %token K_PHYSICAL
 %token K_LOGICAL
@@ -125,7 +126,7 @@ identify_system:
 
 /*
  * BASE_BACKUP [LABEL '<label>'] [PROGRESS] [FAST] [WAL] [NOWAIT]
- * [MAX_RATE %d] [TABLESPACE_MAP]
+ * [MAX_RATE %d] [TABLESPACE_MAP] [ONLY_TABLESPACE '<oid>']
  */
 base_backup:
 			K_BASE_BACKUP base_backup_opt_list
@@ -180,6 +181,11 @@ base_backup_opt:
 				  $$ = makeDefElem("tablespace_map",
 								   (Node *)makeInteger(TRUE));
 				}
+			| K_ONLY_TABLESPACE SCONST
+				{
+				  $$ = makeDefElem("only_tablespace",
+								   (Node *)makeString($2));
+				}
 			;
 
 create_replication_slot:
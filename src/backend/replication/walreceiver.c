@@ -43,25 +43,30 @@
  */
 #include "postgres.h"
 
+#include <fcntl.h>
 #include <signal.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 #include "access/htup_details.h"
 #include "access/timeline.h"
 #include "access/transam.h"
 #include "access/xlog_internal.h"
 #include "catalog/pg_type.h"
+#include "common/pg_lzcompress.h"
 #include "funcapi.h"
 #include "libpq/pqformat.h"
 #include "libpq/pqsignal.h"
 #include "miscadmin.h"
 #include "replication/walreceiver.h"
 #include "replication/walsender.h"
+#include "storage/fd.h"
 #include "storage/ipc.h"
 #include "storage/pmsignal.h"
 #include "storage/procarray.h"
 #include "utils/builtins.h"
 #include "utils/guc.h"
+#include "utils/memutils.h"
 #include "utils/pg_lsn.h"
 #include "utils/ps_status.h"
 #include "utils/resowner.h"
@@ -95,6 +100,29 @@ static TimeLineID recvFileTLI = 0;
 static XLogSegNo recvSegNo = 0;
 static uint32 recvOff = 0;
 
+/*
+ * Segments fully written but not yet fsynced. Instead of fsyncing every
+ * segment at the switch to its successor, we keep the file descriptors open
+ * and sync the whole batch at the next flush point: when the stream goes
+ * idle, when we are dying, or when the batch is full. During catch-up the
+ * receiver then streams continuously instead of stalling at each segment
+ * boundary, and the kernel gets to write the batch back as one sequential
+ * sweep. The flush position reported upstream only advances after the whole
+ * batch is synced, and a segment's .done file is created only at that point,
+ * so crash safety is unaffected.
+ */
+#define WALRCV_MAX_DIRTY_SEGS 8
+
+typedef struct
+{
+	int			fd;
+	XLogSegNo	segno;
+	TimeLineID	tli;
+} WalRcvDirtySeg;
+
+static WalRcvDirtySeg dirtySegs[WALRCV_MAX_DIRTY_SEGS];
+static int	nDirtySegs = 0;
+
 /*
  * Flags set by interrupt handlers of walreceiver for later service in the
  * main loop.
@@ -143,6 +171,7 @@ static void WalRcvDie(int code, Datum arg);
 static void XLogWalRcvProcessMsg(unsigned char type, char *buf, Size len);
 static void XLogWalRcvWrite(char *buf, Size nbytes, XLogRecPtr recptr);
 static void XLogWalRcvFlush(bool dying);
+static void XLogWalRcvPreallocSegment(XLogSegNo segno);
 static void XLogWalRcvSendReply(bool force, bool requestReply);
 static void XLogWalRcvSendHSFeedback(bool immed);
 static void ProcessWalSndrMessage(XLogRecPtr walEnd, TimestampTz sendTime);
@@ -827,6 +856,44 @@ XLogWalRcvProcessMsg(unsigned char type, char *buf, Size len)
 				XLogWalRcvWrite(buf, len, dataStart);
 				break;
 			}
+		case 'z':				/* compressed WAL records */
+			{
+				char	   *raw;
+				int32		rawlen;
+
+				/* copy message to StringInfo */
+				hdrlen = sizeof(int64) + sizeof(int64) + sizeof(int64) + sizeof(int32);
+				if (len < hdrlen)
+					ereport(ERROR,
+							(errcode(ERRCODE_PROTOCOL_VIOLATION),
+							 errmsg_internal("invalid compressed WAL message received from primary")));
+				appendBinaryStringInfo(&incoming_message, buf, hdrlen);
+
+				/* read the fields */
+				dataStart = pq_getmsgint64(&incoming_message);
+				walEnd = pq_getmsgint64(&incoming_message);
+				sendTime = IntegerTimestampToTimestampTz(
+										  pq_getmsgint64(&incoming_message));
+				rawlen = pq_getmsgint(&incoming_message, 4);
+				ProcessWalSndrMessage(walEnd, sendTime);
+
+				if (rawlen <= 0 || !AllocSizeIsValid((Size) rawlen))
+					ereport(ERROR,
+							(errcode(ERRCODE_PROTOCOL_VIOLATION),
+							 errmsg_internal("invalid compressed WAL message received from primary")));
+
+				buf += hdrlen;
+				len -= hdrlen;
+
+				raw = palloc(rawlen);
+				if (pglz_decompress(buf, len, raw, rawlen) != rawlen)
+					ereport(ERROR,
+							(errcode(ERRCODE_PROTOCOL_VIOLATION),
+							 errmsg_internal("could not decompress WAL message received from primary")));
+				XLogWalRcvWrite(raw, rawlen, dataStart);
+				pfree(raw);
+				break;
+			}
 		case 'k':				/* Keepalive */
 			{
 				/* copy message to StringInfo */
@@ -876,35 +943,20 @@ XLogWalRcvWrite(char *buf, Size nbytes, XLogRecPtr recptr)
 			bool		use_existent;
 
 			/*
-			 * fsync() and close current file before we switch to next one. We
-			 * would otherwise have to reopen this file to fsync it later
+			 * Park the finished segment in the dirty batch, keeping its file
+			 * descriptor open, instead of fsyncing it before the switch; the
+			 * next flush syncs, closes and archive-notifies the whole batch.
+			 * If the batch is full, flush it now to bound the number of open
+			 * descriptors.
 			 */
 			if (recvFile >= 0)
 			{
-				char		xlogfname[MAXFNAMELEN];
-
-				XLogWalRcvFlush(false);
-
-				/*
-				 * XLOG segment files will be re-read by recovery in startup
-				 * process soon, so we don't advise the OS to release cache
-				 * pages associated with the file like XLogFileClose() does.
-				 */
-				if (close(recvFile) != 0)
-					ereport(PANIC,
-							(errcode_for_file_access(),
-							 errmsg("could not close log segment %s: %m",
-									XLogFileNameP(recvFileTLI, recvSegNo))));
-
-				/*
-				 * Create .done file forcibly to prevent the streamed segment
-				 * from being archived later.
-				 */
-				XLogFileName(xlogfname, recvFileTLI, recvSegNo);
-				if (XLogArchiveMode != ARCHIVE_MODE_ALWAYS)
-					XLogArchiveForceDone(xlogfname);
-				else
-					XLogArchiveNotify(xlogfname);
+				if (nDirtySegs == WALRCV_MAX_DIRTY_SEGS)
+					XLogWalRcvFlush(false);
+				dirtySegs[nDirtySegs].fd = recvFile;
+				dirtySegs[nDirtySegs].segno = recvSegNo;
+				dirtySegs[nDirtySegs].tli = recvFileTLI;
+				nDirtySegs++;
 			}
 			recvFile = -1;
 
@@ -914,6 +966,12 @@ XLogWalRcvWrite(char *buf, Size nbytes, XLogRecPtr recptr)
 			recvFile = XLogFileInit(recvSegNo, &use_existent, true);
 			recvFileTLI = ThisTimeLineID;
 			recvOff = 0;
+
+			/*
+			 * Get the successor segment ready while this one fills, so the
+			 * next switch doesn't stall in XLogFileInit()'s zero-fill.
+			 */
+			XLogWalRcvPreallocSegment(recvSegNo + 1);
 		}
 
 		/* Calculate the start offset of the received logs */
@@ -964,6 +1022,74 @@ XLogWalRcvWrite(char *buf, Size nbytes, XLogRecPtr recptr)
 	}
 }
 
+/*
+ * Preallocate the given WAL segment with posix_fallocate(), so that the
+ * coming switch to it finds the file in place and XLogFileInit() skips its
+ * zero-fill, which writes a whole segment of zeroes through the WAL stream's
+ * own write path. With file system support the preallocation is nearly free,
+ * and a fallocated segment reads back as zeroes exactly like a zero-filled
+ * one, so recovery treats both the same.
+ *
+ * Like XLogFileInit(), prepare the file under a temporary name first and
+ * install it under the real name only when fully prepared, so a crash cannot
+ * leave a short segment file behind. Failure here is never an error: we just
+ * fall back to the ordinary zero-fill at the switch.
+ */
+static void
+XLogWalRcvPreallocSegment(XLogSegNo segno)
+{
+#ifdef HAVE_POSIX_FALLOCATE
+	char		path[MAXPGPATH];
+	char		tmppath[MAXPGPATH];
+	struct stat stat_buf;
+	int			fd;
+
+	XLogFilePath(path, recvFileTLI, segno);
+	if (stat(path, &stat_buf) == 0)
+		return;					/* already there, e.g. a recycled segment */
+
+	snprintf(tmppath, MAXPGPATH, XLOGDIR "/xlogtemp.%d", (int) getpid());
+	unlink(tmppath);
+
+	fd = BasicOpenFile(tmppath, O_RDWR | O_CREAT | O_EXCL | PG_BINARY,
+					   S_IRUSR | S_IWUSR);
+	if (fd < 0)
+	{
+		ereport(LOG,
+				(errcode_for_file_access(),
+				 errmsg("could not create file \"%s\": %m", tmppath)));
+		return;
+	}
+
+	if (posix_fallocate(fd, 0, XLogSegSize) != 0 ||
+		pg_fsync(fd) != 0)
+	{
+		close(fd);
+		unlink(tmppath);
+		return;
+	}
+
+	if (close(fd) != 0)
+	{
+		unlink(tmppath);
+		return;
+	}
+
+#if HAVE_WORKING_LINK
+	if (link(tmppath, path) < 0)
+	{
+		/* presumably lost a race against someone else creating the segment */
+		unlink(tmppath);
+		return;
+	}
+	unlink(tmppath);
+#else
+	if (rename(tmppath, path) < 0)
+		return;
+#endif
+#endif   /* HAVE_POSIX_FALLOCATE */
+}
+
 /*
  * Flush the log to disk.
  *
@@ -973,11 +1099,47 @@ XLogWalRcvWrite(char *buf, Size nbytes, XLogRecPtr recptr)
 static void
 XLogWalRcvFlush(bool dying)
 {
-	if (LogstreamResult.Flush < LogstreamResult.Write)
+	if (LogstreamResult.Flush < LogstreamResult.Write || nDirtySegs > 0)
 	{
 		WalRcvData *walrcv = WalRcv;
+		int			i;
 
-		issue_xlog_fsync(recvFile, recvSegNo);
+		/*
+		 * First sync, close and archive-notify the batch of finished
+		 * segments in write order; only after that is the whole range up to
+		 * LogstreamResult.Write known to be durable.
+		 *
+		 * XLOG segment files will be re-read by recovery in startup process
+		 * soon, so we don't advise the OS to release cache pages associated
+		 * with the file like XLogFileClose() does.
+		 */
+		for (i = 0; i < nDirtySegs; i++)
+		{
+			char		xlogfname[MAXFNAMELEN];
+
+			issue_xlog_fsync(dirtySegs[i].fd, dirtySegs[i].segno);
+
+			if (close(dirtySegs[i].fd) != 0)
+				ereport(PANIC,
+						(errcode_for_file_access(),
+						 errmsg("could not close log segment %s: %m",
+								XLogFileNameP(dirtySegs[i].tli,
+											  dirtySegs[i].segno))));
+
+			/*
+			 * Create .done file forcibly to prevent the streamed segment
+			 * from being archived later.
+			 */
+			XLogFileName(xlogfname, dirtySegs[i].tli, dirtySegs[i].segno);
+			if (XLogArchiveMode != ARCHIVE_MODE_ALWAYS)
+				XLogArchiveForceDone(xlogfname);
+			else
+				XLogArchiveNotify(xlogfname);
+		}
+		nDirtySegs = 0;
+
+		if (recvFile >= 0)
+			issue_xlog_fsync(recvFile, recvSegNo);
 
 		LogstreamResult.Flush = LogstreamResult.Write;
 
@@ -50,6 +50,7 @@
 
 #include "catalog/pg_type.h"
 #include "commands/dbcommands.h"
+#include "common/pg_lzcompress.h"
 #include "funcapi.h"
 #include "libpq/libpq.h"
 #include "libpq/pqformat.h"
@@ -108,6 +109,7 @@ int			max_wal_senders = 0;	/* the maximum number of concurrent walsenders */
 int			wal_sender_timeout = 60 * 1000;		/* maximum time to send one
 												 * WAL data message */
 bool		log_replication_commands = false;
+bool		wal_sender_compression = false;		/* compress outgoing stream? */
 
 /*
  * State for WalSndWakeupRequest
@@ -213,6 +215,7 @@ static void WalSndCheckTimeOut(TimestampTz now);
 static long WalSndComputeSleeptime(TimestampTz now);
 static void WalSndPrepareWrite(LogicalDecodingContext *ctx, XLogRecPtr lsn, TransactionId xid, bool last_write);
 static void WalSndWriteData(LogicalDecodingContext *ctx, XLogRecPtr lsn, TransactionId xid, bool last_write);
+static void WalSndCompressMessage(StringInfo msg);
 static XLogRecPtr WalSndWaitForWal(XLogRecPtr loc);
 
 static void XLogRead(char *buf, XLogRecPtr startptr, Size count);
@@ -1032,6 +1035,62 @@ StartLogicalReplication(StartReplicationCmd *cmd)
 	EndCommand("COPY 0", DestRemote);
 }
 
+/*
+ * The fixed part of an XLogData message: msgtype byte, dataStart, walEnd
+ * and sendtime.  It is identical in the compressed variant, so the
+ * fill-in-the-timestamp-last trick works on both.
+ */
+#define XLOGDATA_MESSAGE_HDRSZ	(1 + sizeof(int64) * 3)
+
+/* don't bother compressing payloads smaller than this */
+#define XLOGDATA_COMPRESS_MIN	128
+
+/*
+ * If stream compression is enabled and worthwhile, rewrite the given
+ * XLogData ('w') message in place into the compressed variant ('z'): the
+ * same header, then the payload's raw length as an int32, then the payload
+ * compressed with pglz.  If pglz can't shrink the payload, the message is
+ * left alone, so receivers must continue to accept plain 'w' messages.
+ *
+ * Only receivers that have set the wal_sender_compression GUC on their
+ * replication connection ever see 'z' messages, so enabling it doubles as
+ * the capability negotiation.
+ */
+static void
+WalSndCompressMessage(StringInfo msg)
+{
+	static char *zbuf = NULL;
+	static Size zbufsize = 0;
+	int32		rawlen = msg->len - XLOGDATA_MESSAGE_HDRSZ;
+	int32		zlen;
+	Size		needed;
+
+	if (!wal_sender_compression || rawlen < XLOGDATA_COMPRESS_MIN)
+		return;
+
+	/* keep a scratch buffer big enough for the worst case */
+	needed = PGLZ_MAX_OUTPUT(rawlen);
+	if (zbufsize < needed)
+	{
+		if (zbuf != NULL)
+			pfree(zbuf);
+		zbuf = MemoryContextAlloc(TopMemoryContext, needed);
+		zbufsize = needed;
+	}
+
+	zlen = pglz_compress(msg->data + XLOGDATA_MESSAGE_HDRSZ, rawlen,
+						 zbuf, PGLZ_strategy_default);
+
+	/* send uncompressed if there are no savings to be had */
+	if (zlen < 0 || zlen + (int32) sizeof(int32) >= rawlen)
+		return;
+
+	msg->data[0] = 'z';
+	msg->len = XLOGDATA_MESSAGE_HDRSZ;
+	pq_sendint(msg, rawlen, 4);
+	appendBinaryStringInfo(msg, zbuf, zlen);
+}
+
 /*
  * LogicalDecodingContext 'prepare_write' callback.
  *
@@ -1071,6 +1130,9 @@ static void
 WalSndWriteData(LogicalDecodingContext *ctx, XLogRecPtr lsn, TransactionId xid,
 				bool last_write)
 {
+	/* compress the payload if the receiver asked for that */
+	WalSndCompressMessage(ctx->out);
+
 	/* output previously gathered data in a CopyData packet */
 	pq_putmessage_noblock('d', ctx->out->data, ctx->out->len);
 
@@ -2383,6 +2445,9 @@ XLogSendPhysical(void)
 	output_message.len += nbytes;
 	output_message.data[output_message.len] = '\0';
 
+	/* compress the payload if the receiver asked for that */
+	WalSndCompressMessage(&output_message);
+
 	/*
 	 * Fill the send timestamp last, so that it is taken as late as possible.
 	 */
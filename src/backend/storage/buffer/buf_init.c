@@ -14,8 +14,39 @@
  */
 #include "postgres.h"
 
+#include <unistd.h>
+#ifndef WIN32
+#include <sys/wait.h>
+#endif
+
 #include "storage/bufmgr.h"
 #include "storage/buf_internals.h"
+#include "storage/ipc.h"
+
+/*
+ * Buffer header initialization is parallelized across forked helper
+ * processes when the pool is large enough for the serial loop to visibly
+ * delay postmaster startup. Writing each descriptor range from a separate
+ * process also first-touches that shared memory from different CPUs, so
+ * the kernel's first-touch policy spreads the descriptor array across
+ * NUMA nodes instead of backing it all from the postmaster's node.
+ *
+ * The parallel path requires fork() and real spinlocks: with the
+ * semaphore-based spinlock fallback, SpinLockInit allocates process-local
+ * state that must not be set up in a short-lived child.
+ */
+#if !defined(WIN32) && defined(HAVE_SPINLOCKS)
+#define USE_PARALLEL_BUFINIT
+#endif
+
+/* pools below this size are always initialized serially (4M is 32GB) */
+#define PARALLEL_BUFINIT_MIN_BUFFERS (4 * 1024 * 1024)
+#define PARALLEL_BUFINIT_MAX_WORKERS 8
+
+static void InitBufferDescriptorRange(int start, int end);
+#ifdef USE_PARALLEL_BUFINIT
+static bool ParallelInitBufferDescriptors(void);
+#endif
 
 
 BufferDescPadded *BufferDescriptors;
@@ -23,6 +54,8 @@ char	   *BufferBlocks;
 LWLockMinimallyPadded *BufferIOLWLockArray = NULL;
 LWLockTranche BufferIOLWLockTranche;
 LWLockTranche BufferContentLWLockTranche;
+WritebackContext BackendWritebackContext;
+CkptSortItem *CkptBufferIds;
 
 
 /*
@@ -69,7 +102,8 @@ InitBufferPool(void)
 {
 	bool		foundBufs,
 				foundDescs,
-				foundIOLocks;
+				foundIOLocks,
+				foundBufCkpt;
 
 	/* Align descriptors to a cacheline boundary. */
 	BufferDescriptors = (BufferDescPadded *)
@@ -103,53 +137,164 @@ InitBufferPool(void)
 	LWLockRegisterTranche(LWTRANCHE_BUFFER_CONTENT,
 						  &BufferContentLWLockTranche);
 
-	if (foundDescs || foundBufs || foundIOLocks)
+	/*
+	 * The array used to sort to-be-checkpointed buffer ids is located in
+	 * shared memory, to avoid having to allocate significant amounts of
+	 * memory at runtime. As that'd be in the middle of a checkpoint, or when
+	 * the checkpointer is restarted, memory allocation failures would be
+	 * painful.
+	 */
+	CkptBufferIds = (CkptSortItem *)
+		ShmemInitStruct("Checkpoint BufferIds",
+						NBuffers * sizeof(CkptSortItem), &foundBufCkpt);
+
+	if (foundDescs || foundBufs || foundIOLocks || foundBufCkpt)
 	{
 		/* should find all of these, or none of them */
-		Assert(foundDescs && foundBufs && foundIOLocks);
+		Assert(foundDescs && foundBufs && foundIOLocks && foundBufCkpt);
 		/* note: this path is only taken in EXEC_BACKEND case */
 	}
 	else
 	{
-		int			i;
+		/*
+		 * Initialize all the buffer headers, in parallel for large pools.
+		 * Header initialization consists of plain stores into memory nobody
+		 * else is looking at yet, so if the parallel path cannot run or
+		 * fails partway through we can simply (re)do the whole loop
+		 * serially.
+		 */
+#ifdef USE_PARALLEL_BUFINIT
+		if (!ParallelInitBufferDescriptors())
+#endif
+			InitBufferDescriptorRange(0, NBuffers);
+
+		/* Correct last entry of linked list */
+		GetBufferDescriptor(NBuffers - 1)->freeNext = FREENEXT_END_OF_LIST;
+	}
+
+	/* Init other shared buffer-management stuff */
+	StrategyInitialize(!foundDescs);
+
+	/* Initialize per-backend file flush context */
+	WritebackContextInit(&BackendWritebackContext,
+						 &backend_flush_after);
+}
+
+/*
+ * Initialize the buffer headers with ids in [start, end).
+ */
+static void
+InitBufferDescriptorRange(int start, int end)
+{
+	int			i;
+
+	for (i = start; i < end; i++)
+	{
+		BufferDesc *buf = GetBufferDescriptor(i);
+
+		CLEAR_BUFFERTAG(buf->tag);
+
+		pg_atomic_init_u32(&buf->state, 0);
+		buf->wait_backend_pid = 0;
+
+		buf->buf_id = i;
 
 		/*
-		 * Initialize all the buffer headers.
+		 * Initially link all the buffers together as unused. Subsequent
+		 * management of this list is done by freelist.c.
 		 */
-		for (i = 0; i < NBuffers; i++)
-		{
-			BufferDesc *buf = GetBufferDescriptor(i);
+		buf->freeNext = i + 1;
+
+		LWLockInitialize(BufferDescriptorGetContentLock(buf),
+						 LWTRANCHE_BUFFER_CONTENT);
+
+		LWLockInitialize(BufferDescriptorGetIOLock(buf),
+						 LWTRANCHE_BUFFER_IO_IN_PROGRESS);
+	}
+}
+
+#ifdef USE_PARALLEL_BUFINIT
+/*
+ * Initialize the buffer headers using forked helper processes, one
+ * descriptor range per process. Returns false without touching anything if
+ * the pool is too small or the machine has a single CPU, and false after
+ * partial initialization if forking or a worker failed; in both cases the
+ * caller falls back to the serial loop, which is safe to run over
+ * already-initialized descriptors.
+ *
+ * This runs during shared memory initialization, before any child of the
+ * postmaster exists and while signals are blocked, so the short-lived
+ * workers cannot be reaped behind our back and inherit the blocked mask.
+ */
+static bool
+ParallelInitBufferDescriptors(void)
+{
+	long		ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	pid_t		workerPids[PARALLEL_BUFINIT_MAX_WORKERS];
+	int			launched = 0;
+	int			nworkers;
+	int			chunkSize;
+	bool		failed = false;
+	int			i;
 
-			CLEAR_BUFFERTAG(buf->tag);
-			buf->flags = 0;
-			buf->usage_count = 0;
-			buf->refcount = 0;
-			buf->wait_backend_pid = 0;
+	if (ncpus < 2 || NBuffers < PARALLEL_BUFINIT_MIN_BUFFERS)
+		return false;
 
-			SpinLockInit(&buf->buf_hdr_lock);
+	nworkers = Min((int) ncpus, PARALLEL_BUFINIT_MAX_WORKERS);
+	chunkSize = (NBuffers + nworkers - 1) / nworkers;
 
-			buf->buf_id = i;
+	/* range 0 is handled by this process itself, below */
+	for (i = 1; i < nworkers; i++)
+	{
+		pid_t		pid = fork();
+
+		if (pid == 0)
+		{
+			int			start = i * chunkSize;
+			int			end = Min(start + chunkSize, NBuffers);
 
 			/*
-			 * Initially link all the buffers together as unused. Subsequent
-			 * management of this list is done by freelist.c.
+			 * We share the parent's memory and must not run its exit
+			 * callbacks; do the assigned range and leave quietly.
 			 */
-			buf->freeNext = i + 1;
+			on_exit_reset();
+			InitBufferDescriptorRange(start, end);
+			_exit(0);
+		}
+		else if (pid < 0)
+		{
+			failed = true;
+			break;
+		}
 
-			LWLockInitialize(BufferDescriptorGetContentLock(buf),
-							 LWTRANCHE_BUFFER_CONTENT);
+		workerPids[launched++] = pid;
+	}
+
+	InitBufferDescriptorRange(0, Min(chunkSize, NBuffers));
+
+	for (i = 0; i < launched; i++)
+	{
+		int			status;
 
-			LWLockInitialize(BufferDescriptorGetIOLock(buf),
-							 LWTRANCHE_BUFFER_IO_IN_PROGRESS);
+		while (waitpid(workerPids[i], &status, 0) < 0)
+		{
+			if (errno != EINTR)
+			{
+				failed = true;
+				break;
+			}
 		}
 
-		/* Correct last entry of linked list */
-		GetBufferDescriptor(NBuffers - 1)->freeNext = FREENEXT_END_OF_LIST;
+		if (!failed && (!WIFEXITED(status) || WEXITSTATUS(status) != 0))
+			failed = true;
 	}
 
-	/* Init other shared buffer-management stuff */
-	StrategyInitialize(!foundDescs);
+	if (failed)
+		elog(LOG, "parallel buffer initialization failed, retrying serially");
+
+	return !failed;
 }
+#endif   /* USE_PARALLEL_BUFINIT */
 
 /*
  * BufferShmemSize
@@ -185,5 +330,8 @@ BufferShmemSize(void)
 	/* to allow aligning the above */
 	size = add_size(size, PG_CACHE_LINE_SIZE);
 
+	/* size of checkpoint sort array in bufmgr.c */
+	size = add_size(size, mul_size(NBuffers, sizeof(CkptSortItem)));
+
 	return size;
 }
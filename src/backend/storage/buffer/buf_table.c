@@ -23,6 +23,7 @@
 
 #include "storage/bufmgr.h"
 #include "storage/buf_internals.h"
+#include "storage/shmem.h"
 
 
 /* entry for buffer lookup hashtable */
@@ -34,6 +35,45 @@ typedef struct
 
 static HTAB *SharedBufHash;
 
+/*
+ * In front of the partitioned hash table we keep a direct-mapped cache of
+ * recent tag -> buffer ID translations that can be consulted without taking
+ * any lock.  Entries are written by backends holding the partition lock
+ * (in BufTableInsert/BufTableDelete, and refreshed on BufTableLookup hits),
+ * but read completely unlocked, so a reader may observe a torn or stale
+ * entry.  That is acceptable because BufTableCacheLookup results are only
+ * hints: the caller must pin the indicated buffer and recheck its identity
+ * in the buffer header before believing the translation (see BufferAlloc).
+ * Collisions simply overwrite; the hash table remains the authority and a
+ * cache miss just means taking the locked path.
+ */
+typedef struct
+{
+	BufferTag	tag;
+	int			id;				/* -1 if the slot is empty */
+} BufMapCacheEnt;
+
+static BufMapCacheEnt *BufMapCache;
+static uint32 BufMapCacheMask;	/* number of slots - 1 */
+
+/* Number of cache slots for a mapping table of 'size' entries */
+static uint32
+BufMapCacheSlots(int size)
+{
+	uint32		nslots = 2;
+
+	/* power of 2, at least twice the table size to keep collisions rare */
+	while (nslots < (uint32) size * 2)
+		nslots <<= 1;
+	return nslots;
+}
+
+static inline BufMapCacheEnt *
+BufMapCacheSlot(uint32 hashcode)
+{
+	return BufMapCache + (hashcode & BufMapCacheMask);
+}
+
 
 /*
  * Estimate space needed for mapping hashtable
@@ -42,7 +82,9 @@ static HTAB *SharedBufHash;
 Size
 BufTableShmemSize(int size)
 {
-	return hash_estimate_size(size, sizeof(BufferLookupEnt));
+	return add_size(hash_estimate_size(size, sizeof(BufferLookupEnt)),
+					mul_size(BufMapCacheSlots(size),
+							 sizeof(BufMapCacheEnt)));
 }
 
 /*
@@ -65,6 +107,24 @@ InitBufTable(int size)
 								  size, size,
 								  &info,
 								  HASH_ELEM | HASH_BLOBS | HASH_PARTITION);
+
+	{
+		uint32		nslots = BufMapCacheSlots(size);
+		bool		found;
+
+		BufMapCacheMask = nslots - 1;
+		BufMapCache = (BufMapCacheEnt *)
+			ShmemInitStruct("Buffer Lookup Cache",
+							mul_size(nslots, sizeof(BufMapCacheEnt)),
+							&found);
+		if (!found)
+		{
+			uint32		i;
+
+			for (i = 0; i < nslots; i++)
+				BufMapCache[i].id = -1;
+		}
+	}
 }
 
 /*
@@ -103,9 +163,44 @@ BufTableLookup(BufferTag *tagPtr, uint32 hashcode)
 	if (!result)
 		return -1;
 
+	/*
+	 * Refresh the lock-free cache, so that the next access to this block can
+	 * hopefully skip the partition lock.  We only hold the partition lock in
+	 * shared mode here, so two lookups may write the same slot concurrently;
+	 * a torn entry is fine, since readers validate against the buffer header.
+	 */
+	{
+		BufMapCacheEnt *slot = BufMapCacheSlot(hashcode);
+
+		slot->tag = *tagPtr;
+		slot->id = result->id;
+	}
+
 	return result->id;
 }
 
+/*
+ * BufTableCacheLookup
+ *		Consult the lock-free mapping cache for the given tag; return the
+ *		buffer ID hint, or -1 on a cache miss
+ *
+ * Requires no lock, and therefore returns only a HINT: the entry may be
+ * stale or torn.  The caller must pin the returned buffer and verify its
+ * header still carries this tag before using it, falling back to the locked
+ * BufTableLookup path otherwise.
+ */
+int
+BufTableCacheLookup(BufferTag *tagPtr, uint32 hashcode)
+{
+	BufMapCacheEnt ent = *BufMapCacheSlot(hashcode);
+
+	if (ent.id < 0 || ent.id >= NBuffers ||
+		!BUFFERTAGS_EQUAL(ent.tag, *tagPtr))
+		return -1;
+
+	return ent.id;
+}
+
 /*
  * BufTableInsert
  *		Insert a hashtable entry for given tag and buffer ID,
@@ -137,6 +232,13 @@ BufTableInsert(BufferTag *tagPtr, uint32 hashcode, int buf_id)
 
 	result->id = buf_id;
 
+	{
+		BufMapCacheEnt *slot = BufMapCacheSlot(hashcode);
+
+		slot->tag = *tagPtr;
+		slot->id = buf_id;
+	}
+
 	return -1;
 }
 
@@ -160,4 +262,16 @@ BufTableDelete(BufferTag *tagPtr, uint32 hashcode)
 
 	if (!result)				/* shouldn't happen */
 		elog(ERROR, "shared buffer hash table corrupted");
+
+	/*
+	 * Evict the cached translation, if it is still ours.  A concurrent
+	 * writer of a colliding tag may resurrect a stale-looking entry here;
+	 * that is as harmless as any other stale cache content.
+	 */
+	{
+		BufMapCacheEnt *slot = BufMapCacheSlot(hashcode);
+
+		if (BUFFERTAGS_EQUAL(slot->tag, *tagPtr))
+			slot->id = -1;
+	}
 }
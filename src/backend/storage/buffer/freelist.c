@@ -22,6 +22,45 @@
 
 #define INT_ACCESS_ONCE(var)	((int)(*((volatile int *)&(var))))
 
+/* GUC variable: number of clock sweep partitions, normally one per socket */
+int			BufferPoolPartitions = 1;
+
+/* GUC variables: buffer ring sizes (in kB) for the access strategies */
+int			bulk_read_ring_size = 256;
+int			bulk_write_ring_size = 16384;
+int			vacuum_ring_size = 256;
+
+/*
+ * Per-partition clock sweep state.  With buffer_pool_partitions > 1 the
+ * buffer array is carved into contiguous slices and each slice gets its own
+ * clock hand, so that backends bound to different partitions don't fight
+ * over a single hot cache line for the hand and, on NUMA machines, mostly
+ * touch buffer headers within their own slice.  We can't portably ask the
+ * kernel for node-local memory, but first-touch placement of the (large,
+ * contiguous) buffer arrays means a per-socket partition count keeps most
+ * victim traffic on the local node.
+ *
+ * Each partition's state is padded out to a cache line so that hands in
+ * adjacent partitions don't false-share.
+ */
+typedef struct ClockSweepPartition
+{
+	/*
+	 * Clock sweep hand: index of next buffer to consider grabbing, relative
+	 * to the partition's first buffer.  Note that this isn't a concrete
+	 * buffer - we only ever increase the value. So, to get an actual buffer,
+	 * it needs to be used modulo the partition size.
+	 */
+	pg_atomic_uint32 nextVictimBuffer;
+
+	uint32		completePasses; /* Complete cycles of this partition's sweep */
+} ClockSweepPartition;
+
+typedef union ClockSweepPartitionPadded
+{
+	ClockSweepPartition partition;
+	char		pad[PG_CACHE_LINE_SIZE];
+} ClockSweepPartitionPadded;
 
 /*
  * The shared freelist control information.
@@ -31,12 +70,11 @@ typedef struct
 	/* Spinlock: protects the values below */
 	slock_t		buffer_strategy_lock;
 
-	/*
-	 * Clock sweep hand: index of next buffer to consider grabbing. Note that
-	 * this isn't a concrete buffer - we only ever increase the value. So, to
-	 * get an actual buffer, it needs to be used modulo NBuffers.
-	 */
-	pg_atomic_uint32 nextVictimBuffer;
+	/* Number of clock sweep partitions in use; fixed at startup */
+	int			numPartitions;
+
+	/* Per-partition clock sweep hands */
+	ClockSweepPartitionPadded partitions[MAX_BUFFER_POOL_PARTITIONS];
 
 	int			firstFreeBuffer;	/* Head of list of unused buffers */
 	int			lastFreeBuffer; /* Tail of list of unused buffers */
@@ -50,8 +88,35 @@ typedef struct
 	 * Statistics.  These counters should be wide enough that they can't
 	 * overflow during a single bgwriter cycle.
 	 */
-	uint32		completePasses; /* Complete cycles of the clock sweep */
 	pg_atomic_uint32 numBufferAllocs;	/* Buffers allocated since last reset */
+	pg_atomic_uint32 numBackendWrites;	/* Dirty clock-sweep victims written
+										 * by backends since last reset */
+
+	/*
+	 * Buffer-pressure statistics, published by the background writer for the
+	 * pg_stat_buffer_pressure view.  Protected by buffer_strategy_lock.
+	 */
+	uint64		totalBackendWrites;		/* cumulative backend victim writes */
+	float		smoothedAllocRate;		/* allocs per bgwriter cycle */
+	float		smoothedBackendWriteRate;		/* backend writes per cycle */
+
+	/*
+	 * Per-strategy-type ring statistics for the pg_stat_buffer_rings view.
+	 * Backends bump the atomic counters locklessly; readers reap them into
+	 * the wide totals under buffer_strategy_lock, following the same scheme
+	 * as numBackendWrites/totalBackendWrites above.  Slot 0 (BAS_NORMAL)
+	 * stays unused.
+	 */
+	struct
+	{
+		pg_atomic_uint32 numAllocs;		/* buffers requested via the ring */
+		pg_atomic_uint32 numHits;		/* requests satisfied from the ring */
+		pg_atomic_uint32 numEvictWrites;		/* dirty ring buffers written
+												 * to permit reuse */
+		uint64		totalAllocs;	/* reaped totals; see above */
+		uint64		totalHits;
+		uint64		totalEvictWrites;
+	}			ringStats[BAS_NUM_STRATEGIES];
 
 	/*
 	 * Bgworker process to be notified upon activity or -1 if none. See
@@ -63,6 +128,9 @@ typedef struct
 /* Pointers to shared state */
 static BufferStrategyControl *StrategyControl = NULL;
 
+/* This backend's home partition, assigned on first StrategyGetBuffer() */
+static int	MyClockSweepPartition = -1;
+
 /*
  * Private (non-shared) state for managing a ring of shared buffers to re-use.
  * This is currently the only kind of BufferAccessStrategy object, but someday
@@ -98,19 +166,44 @@ typedef struct BufferAccessStrategyData
 
 
 /* Prototypes for internal functions */
-static BufferDesc *GetBufferFromRing(BufferAccessStrategy strategy);
+static BufferDesc *GetBufferFromRing(BufferAccessStrategy strategy,
+				  uint32 *buf_state);
 static void AddBufferToRing(BufferAccessStrategy strategy,
 				BufferDesc *buf);
 
+/*
+ * ClockSweepPartitionBase - first buffer id belonging to a partition
+ *
+ * Partitions are contiguous, near-equal slices of the buffer array.  Using
+ * the rounded-down product for the boundary distributes any remainder of
+ * NBuffers / numPartitions evenly across the partitions.
+ */
+static inline int
+ClockSweepPartitionBase(int partition)
+{
+	return (int) (((uint64) NBuffers * partition) / StrategyControl->numPartitions);
+}
+
+/*
+ * ClockSweepPartitionSize - number of buffers belonging to a partition
+ */
+static inline int
+ClockSweepPartitionSize(int partition)
+{
+	return ClockSweepPartitionBase(partition + 1) - ClockSweepPartitionBase(partition);
+}
+
 /*
  * ClockSweepTick - Helper routine for StrategyGetBuffer()
  *
- * Move the clock hand one buffer ahead of its current position and return the
- * id of the buffer now under the hand.
+ * Move the given partition's clock hand one buffer ahead of its current
+ * position and return the id of the buffer now under the hand.
  */
 static inline uint32
-ClockSweepTick(void)
+ClockSweepTick(int partition)
 {
+	ClockSweepPartition *sweep = &StrategyControl->partitions[partition].partition;
+	uint32		partitionSize = ClockSweepPartitionSize(partition);
 	uint32		victim;
 
 	/*
@@ -118,15 +211,14 @@ ClockSweepTick(void)
 	 * doing this, this can lead to buffers being returned slightly out of
 	 * apparent order.
 	 */
-	victim =
-		pg_atomic_fetch_add_u32(&StrategyControl->nextVictimBuffer, 1);
+	victim = pg_atomic_fetch_add_u32(&sweep->nextVictimBuffer, 1);
 
-	if (victim >= NBuffers)
+	if (victim >= partitionSize)
 	{
 		uint32		originalVictim = victim;
 
 		/* always wrap what we look up in BufferDescriptors */
-		victim = victim % NBuffers;
+		victim = victim % partitionSize;
 
 		/*
 		 * If we're the one that just caused a wraparound, force
@@ -154,17 +246,17 @@ ClockSweepTick(void)
 				 */
 				SpinLockAcquire(&StrategyControl->buffer_strategy_lock);
 
-				wrapped = expected % NBuffers;
+				wrapped = expected % partitionSize;
 
-				success = pg_atomic_compare_exchange_u32(&StrategyControl->nextVictimBuffer,
+				success = pg_atomic_compare_exchange_u32(&sweep->nextVictimBuffer,
 														 &expected, wrapped);
 				if (success)
-					StrategyControl->completePasses++;
+					sweep->completePasses++;
 				SpinLockRelease(&StrategyControl->buffer_strategy_lock);
 			}
 		}
 	}
-	return victim;
+	return ClockSweepPartitionBase(partition) + victim;
 }
 
 /*
@@ -177,14 +269,19 @@ ClockSweepTick(void)
  *	strategy is a BufferAccessStrategy object, or NULL for default strategy.
  *
  *	To ensure that no one else can pin the buffer before we do, we must
- *	return the buffer with the buffer header spinlock still held.
+ *	return the buffer with the buffer header spinlock still held.  The
+ *	buffer's locked state word is returned in *buf_state.
  */
 BufferDesc *
-StrategyGetBuffer(BufferAccessStrategy strategy)
+StrategyGetBuffer(BufferAccessStrategy strategy, uint32 *buf_state)
 {
 	BufferDesc *buf;
 	int			bgwprocno;
 	int			trycounter;
+	int			numPartitions = StrategyControl->numPartitions;
+	int			partition;
+	int			partitionsLeft;
+	uint32		local_buf_state;	/* to avoid repeated (de-)referencing */
 
 	/*
 	 * If given a strategy object, see whether it can select a buffer. We
@@ -192,7 +289,7 @@ StrategyGetBuffer(BufferAccessStrategy strategy)
 	 */
 	if (strategy != NULL)
 	{
-		buf = GetBufferFromRing(strategy);
+		buf = GetBufferFromRing(strategy, buf_state);
 		if (buf != NULL)
 			return buf;
 	}
@@ -279,58 +376,83 @@ StrategyGetBuffer(BufferAccessStrategy strategy)
 			 * it before we got to it.  It's probably impossible altogether as
 			 * of 8.3, but we'd better check anyway.)
 			 */
-			LockBufHdr(buf);
-			if (buf->refcount == 0 && buf->usage_count == 0)
+			local_buf_state = LockBufHdr(buf);
+			if (BUF_STATE_GET_REFCOUNT(local_buf_state) == 0
+				&& BUF_STATE_GET_USAGECOUNT(local_buf_state) == 0)
 			{
 				if (strategy != NULL)
 					AddBufferToRing(strategy, buf);
+				*buf_state = local_buf_state;
 				return buf;
 			}
-			UnlockBufHdr(buf);
+			UnlockBufHdr(buf, local_buf_state);
 
 		}
 	}
 
-	/* Nothing on the freelist, so run the "clock sweep" algorithm */
-	trycounter = NBuffers;
+	/*
+	 * Nothing on the freelist, so run the "clock sweep" algorithm.
+	 *
+	 * We sweep our home partition first, which keeps each backend's victim
+	 * traffic - and the buffer headers it dirties - within one slice of the
+	 * buffer array.  Assigning partitions round-robin by pgprocno spreads
+	 * the backends evenly across the slices.  Only if our own partition
+	 * turns out to be entirely pinned do we move on to the others.
+	 */
+	if (MyClockSweepPartition < 0)
+		MyClockSweepPartition =
+			(MyProc != NULL ? MyProc->pgprocno : 0) % numPartitions;
+	partition = MyClockSweepPartition;
+	partitionsLeft = numPartitions;
+	trycounter = ClockSweepPartitionSize(partition);
 	for (;;)
 	{
 
-		buf = GetBufferDescriptor(ClockSweepTick());
+		buf = GetBufferDescriptor(ClockSweepTick(partition));
 
 		/*
 		 * If the buffer is pinned or has a nonzero usage_count, we cannot use
 		 * it; decrement the usage_count (unless pinned) and keep scanning.
 		 */
-		LockBufHdr(buf);
-		if (buf->refcount == 0)
+		local_buf_state = LockBufHdr(buf);
+		if (BUF_STATE_GET_REFCOUNT(local_buf_state) == 0)
 		{
-			if (buf->usage_count > 0)
+			if (BUF_STATE_GET_USAGECOUNT(local_buf_state) != 0)
 			{
-				buf->usage_count--;
-				trycounter = NBuffers;
+				local_buf_state -= BUF_USAGECOUNT_ONE;
+				trycounter = ClockSweepPartitionSize(partition);
 			}
 			else
 			{
 				/* Found a usable buffer */
 				if (strategy != NULL)
 					AddBufferToRing(strategy, buf);
+				*buf_state = local_buf_state;
 				return buf;
 			}
 		}
 		else if (--trycounter == 0)
 		{
+			UnlockBufHdr(buf, local_buf_state);
+
 			/*
-			 * We've scanned all the buffers without making any state changes,
-			 * so all the buffers are pinned (or were when we looked at them).
-			 * We could hope that someone will free one eventually, but it's
+			 * We've scanned this whole partition without making any state
+			 * changes, so all of its buffers are pinned (or were when we
+			 * looked at them).  Fall back to the next partition; if we've
+			 * been through all of them, all the buffers are pinned.  We
+			 * could hope that someone will free one eventually, but it's
 			 * probably better to fail than to risk getting stuck in an
 			 * infinite loop.
 			 */
-			UnlockBufHdr(buf);
+			if (--partitionsLeft > 0)
+			{
+				partition = (partition + 1) % numPartitions;
+				trycounter = ClockSweepPartitionSize(partition);
+				continue;
+			}
 			elog(ERROR, "no unpinned buffers available");
 		}
-		UnlockBufHdr(buf);
+		UnlockBufHdr(buf, local_buf_state);
 	}
 }
 
@@ -364,39 +486,140 @@ StrategyFreeBuffer(BufferDesc *buf)
  * BufferSync() will proceed circularly around the buffer array from there.
  *
  * In addition, we return the completed-pass count (which is effectively
- * the higher-order bits of nextVictimBuffer) and the count of recent buffer
- * allocs if non-NULL pointers are passed.  The alloc count is reset after
- * being read.
+ * the higher-order bits of nextVictimBuffer) and the counts of recent buffer
+ * allocs and backend victim writes if non-NULL pointers are passed.  Those
+ * counts are reset after being read.
  */
 int
-StrategySyncStart(uint32 *complete_passes, uint32 *num_buf_alloc)
+StrategySyncStart(uint32 *complete_passes, uint32 *num_buf_alloc,
+				  uint32 *num_backend_writes)
 {
-	uint32		nextVictimBuffer;
+	uint64		totalTicks = 0;
 	int			result;
+	int			i;
 
 	SpinLockAcquire(&StrategyControl->buffer_strategy_lock);
-	nextVictimBuffer = pg_atomic_read_u32(&StrategyControl->nextVictimBuffer);
-	result = nextVictimBuffer % NBuffers;
 
-	if (complete_passes)
+	/*
+	 * With more than one partition there is no single clock hand, so we
+	 * synthesize one: sum up how many buffers each partition's sweep has
+	 * visited in total and fold that back into a global pass count and
+	 * position.  The raw hand value already includes any wraparounds whose
+	 * completePasses increment is still pending, c.f. ClockSweepTick(), so
+	 * this is exact.  BgBufferSync() only uses the result to estimate sweep
+	 * speed from deltas between calls, for which any monotonically advancing
+	 * measure of total progress works; with one partition this degenerates
+	 * to exactly the pre-partitioning behavior.
+	 */
+	for (i = 0; i < StrategyControl->numPartitions; i++)
 	{
-		*complete_passes = StrategyControl->completePasses;
+		ClockSweepPartition *sweep = &StrategyControl->partitions[i].partition;
 
-		/*
-		 * Additionally add the number of wraparounds that happened before
-		 * completePasses could be incremented. C.f. ClockSweepTick().
-		 */
-		*complete_passes += nextVictimBuffer / NBuffers;
+		totalTicks += (uint64) sweep->completePasses * ClockSweepPartitionSize(i);
+		totalTicks += pg_atomic_read_u32(&sweep->nextVictimBuffer);
 	}
+	result = (int) (totalTicks % NBuffers);
+
+	if (complete_passes)
+		*complete_passes = (uint32) (totalTicks / NBuffers);
 
 	if (num_buf_alloc)
 	{
 		*num_buf_alloc = pg_atomic_exchange_u32(&StrategyControl->numBufferAllocs, 0);
 	}
+	if (num_backend_writes)
+	{
+		*num_backend_writes = pg_atomic_exchange_u32(&StrategyControl->numBackendWrites, 0);
+		StrategyControl->totalBackendWrites += *num_backend_writes;
+	}
 	SpinLockRelease(&StrategyControl->buffer_strategy_lock);
 	return result;
 }
 
+/*
+ * StrategyReportBackendWrite -- count a backend write of a victim buffer
+ *
+ * Called by BufferAlloc when a backend had to write a dirty clock-sweep
+ * victim itself, i.e. whenever the background writer failed to clean ahead
+ * of the sweep.  BgBufferSync() reaps the count via StrategySyncStart() and
+ * uses it to adjust its pacing.
+ */
+void
+StrategyReportBackendWrite(void)
+{
+	pg_atomic_fetch_add_u32(&StrategyControl->numBackendWrites, 1);
+}
+
+/*
+ * StrategyReportPressure -- publish the bgwriter's smoothed rate estimates
+ *
+ * Called by BgBufferSync() once per cycle so that the rates it paces itself
+ * by can be inspected through the pg_stat_buffer_pressure view.
+ */
+void
+StrategyReportPressure(float smoothed_alloc, float smoothed_backend_writes)
+{
+	SpinLockAcquire(&StrategyControl->buffer_strategy_lock);
+	StrategyControl->smoothedAllocRate = smoothed_alloc;
+	StrategyControl->smoothedBackendWriteRate = smoothed_backend_writes;
+	SpinLockRelease(&StrategyControl->buffer_strategy_lock);
+}
+
+/*
+ * StrategyGetPressureStats -- fetch data for the pg_stat_buffer_pressure view
+ */
+void
+StrategyGetPressureStats(uint64 *total_backend_writes, double *alloc_rate,
+						 double *backend_write_rate)
+{
+	SpinLockAcquire(&StrategyControl->buffer_strategy_lock);
+	*total_backend_writes = StrategyControl->totalBackendWrites +
+		pg_atomic_read_u32(&StrategyControl->numBackendWrites);
+	*alloc_rate = StrategyControl->smoothedAllocRate;
+	*backend_write_rate = StrategyControl->smoothedBackendWriteRate;
+	SpinLockRelease(&StrategyControl->buffer_strategy_lock);
+}
+
+/*
+ * StrategyReportRingWrite -- count a write forced by buffer ring reuse
+ *
+ * Called by BufferAlloc when a dirty victim had to be written and the
+ * victim was supplied by the strategy's ring, i.e. the write is the price
+ * of recycling a ring slot rather than of general cache pressure.
+ */
+void
+StrategyReportRingWrite(BufferAccessStrategy strategy)
+{
+	if (strategy == NULL || !strategy->current_was_in_ring)
+		return;
+	pg_atomic_fetch_add_u32(&StrategyControl->ringStats[strategy->btype].numEvictWrites, 1);
+}
+
+/*
+ * StrategyGetRingStats -- fetch data for the pg_stat_buffer_rings view
+ *
+ * Reaps the atomic counters for the given strategy type into the wide
+ * totals and returns the totals.
+ */
+void
+StrategyGetRingStats(int btype, uint64 *allocs, uint64 *hits,
+					 uint64 *evict_writes)
+{
+	Assert(btype > BAS_NORMAL && btype < BAS_NUM_STRATEGIES);
+
+	SpinLockAcquire(&StrategyControl->buffer_strategy_lock);
+	StrategyControl->ringStats[btype].totalAllocs +=
+		pg_atomic_exchange_u32(&StrategyControl->ringStats[btype].numAllocs, 0);
+	StrategyControl->ringStats[btype].totalHits +=
+		pg_atomic_exchange_u32(&StrategyControl->ringStats[btype].numHits, 0);
+	StrategyControl->ringStats[btype].totalEvictWrites +=
+		pg_atomic_exchange_u32(&StrategyControl->ringStats[btype].numEvictWrites, 0);
+	*allocs = StrategyControl->ringStats[btype].totalAllocs;
+	*hits = StrategyControl->ringStats[btype].totalHits;
+	*evict_writes = StrategyControl->ringStats[btype].totalEvictWrites;
+	SpinLockRelease(&StrategyControl->buffer_strategy_lock);
+}
+
 /*
  * StrategyNotifyBgWriter -- set or clear allocation notification latch
  *
@@ -475,6 +698,8 @@ StrategyInitialize(bool init)
 
 	if (!found)
 	{
+		int			i;
+
 		/*
 		 * Only done once, usually in postmaster
 		 */
@@ -489,12 +714,34 @@ StrategyInitialize(bool init)
 		StrategyControl->firstFreeBuffer = 0;
 		StrategyControl->lastFreeBuffer = NBuffers - 1;
 
-		/* Initialize the clock sweep pointer */
-		pg_atomic_init_u32(&StrategyControl->nextVictimBuffer, 0);
+		/*
+		 * Initialize the clock sweep partitions.  Don't let a partition end
+		 * up with no buffers at all when shared_buffers is tiny.
+		 */
+		StrategyControl->numPartitions = Min(BufferPoolPartitions, NBuffers);
+		for (i = 0; i < StrategyControl->numPartitions; i++)
+		{
+			ClockSweepPartition *sweep = &StrategyControl->partitions[i].partition;
+
+			pg_atomic_init_u32(&sweep->nextVictimBuffer, 0);
+			sweep->completePasses = 0;
+		}
 
 		/* Clear statistics */
-		StrategyControl->completePasses = 0;
 		pg_atomic_init_u32(&StrategyControl->numBufferAllocs, 0);
+		pg_atomic_init_u32(&StrategyControl->numBackendWrites, 0);
+		StrategyControl->totalBackendWrites = 0;
+		StrategyControl->smoothedAllocRate = 0;
+		StrategyControl->smoothedBackendWriteRate = 0;
+		for (i = 0; i < BAS_NUM_STRATEGIES; i++)
+		{
+			pg_atomic_init_u32(&StrategyControl->ringStats[i].numAllocs, 0);
+			pg_atomic_init_u32(&StrategyControl->ringStats[i].numHits, 0);
+			pg_atomic_init_u32(&StrategyControl->ringStats[i].numEvictWrites, 0);
+			StrategyControl->ringStats[i].totalAllocs = 0;
+			StrategyControl->ringStats[i].totalHits = 0;
+			StrategyControl->ringStats[i].totalEvictWrites = 0;
+		}
 
 		/* No pending notification */
 		StrategyControl->bgwprocno = -1;
@@ -522,10 +769,11 @@ GetAccessStrategy(BufferAccessStrategyType btype)
 	int			ring_size;
 
 	/*
-	 * Select ring size to use.  See buffer/README for rationales.
+	 * Select ring size to use, from the GUC for the strategy type.  See
+	 * buffer/README for rationales behind the defaults.
 	 *
-	 * Note: if you change the ring size for BAS_BULKREAD, see also
-	 * SYNC_SCAN_REPORT_INTERVAL in access/heap/syncscan.c.
+	 * Note: if you reduce the ring size for BAS_BULKREAD much below its
+	 * default, see also SYNC_SCAN_REPORT_INTERVAL in access/heap/syncscan.c.
 	 */
 	switch (btype)
 	{
@@ -534,13 +782,13 @@ GetAccessStrategy(BufferAccessStrategyType btype)
 			return NULL;
 
 		case BAS_BULKREAD:
-			ring_size = 256 * 1024 / BLCKSZ;
+			ring_size = (int) (((int64) bulk_read_ring_size * 1024) / BLCKSZ);
 			break;
 		case BAS_BULKWRITE:
-			ring_size = 16 * 1024 * 1024 / BLCKSZ;
+			ring_size = (int) (((int64) bulk_write_ring_size * 1024) / BLCKSZ);
 			break;
 		case BAS_VACUUM:
-			ring_size = 256 * 1024 / BLCKSZ;
+			ring_size = (int) (((int64) vacuum_ring_size * 1024) / BLCKSZ);
 			break;
 
 		default:
@@ -551,6 +799,7 @@ GetAccessStrategy(BufferAccessStrategyType btype)
 
 	/* Make sure ring isn't an undue fraction of shared buffers */
 	ring_size = Min(NBuffers / 8, ring_size);
+	ring_size = Max(ring_size, 1);
 
 	/* Allocate the object and initialize all elements to zeroes */
 	strategy = (BufferAccessStrategy)
@@ -585,10 +834,13 @@ FreeAccessStrategy(BufferAccessStrategy strategy)
  * The bufhdr spin lock is held on the returned buffer.
  */
 static BufferDesc *
-GetBufferFromRing(BufferAccessStrategy strategy)
+GetBufferFromRing(BufferAccessStrategy strategy, uint32 *buf_state)
 {
 	BufferDesc *buf;
 	Buffer		bufnum;
+	uint32		local_buf_state;	/* to avoid repeated (de-)referencing */
+
+	pg_atomic_fetch_add_u32(&StrategyControl->ringStats[strategy->btype].numAllocs, 1);
 
 	/* Advance to next ring slot */
 	if (++strategy->current >= strategy->ring_size)
@@ -616,13 +868,16 @@ GetBufferFromRing(BufferAccessStrategy strategy)
 	 * shouldn't re-use it.
 	 */
 	buf = GetBufferDescriptor(bufnum - 1);
-	LockBufHdr(buf);
-	if (buf->refcount == 0 && buf->usage_count <= 1)
+	local_buf_state = LockBufHdr(buf);
+	if (BUF_STATE_GET_REFCOUNT(local_buf_state) == 0
+		&& BUF_STATE_GET_USAGECOUNT(local_buf_state) <= 1)
 	{
 		strategy->current_was_in_ring = true;
+		pg_atomic_fetch_add_u32(&StrategyControl->ringStats[strategy->btype].numHits, 1);
+		*buf_state = local_buf_state;
 		return buf;
 	}
-	UnlockBufHdr(buf);
+	UnlockBufHdr(buf, local_buf_state);
 
 	/*
 	 * Tell caller to allocate a new buffer with the normal allocation
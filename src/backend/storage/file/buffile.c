@@ -587,6 +587,27 @@ BufFileSeekBlock(BufFile *file, long blknum)
 					   SEEK_SET);
 }
 
+/*
+ * BufFilePrefetch --- ask the kernel to read a block into its cache
+ *
+ * Initiates asynchronous read of the n'th BLCKSZ-sized block of the file.
+ * This is a hint only: it does nothing if prefetch support is not compiled
+ * in, and any error from the kernel is ignored, since a failed prefetch
+ * merely loses the overlap of I/O with computation.
+ */
+void
+BufFilePrefetch(BufFile *file, long blknum)
+{
+#ifdef USE_PREFETCH
+	int			fileno = (int) (blknum / BUFFILE_SEG_SIZE);
+	off_t		offset = (off_t) (blknum % BUFFILE_SEG_SIZE) * BLCKSZ;
+
+	if (fileno < 0 || fileno >= file->numFiles)
+		return;
+	(void) FilePrefetch(file->files[fileno], offset, BLCKSZ);
+#endif   /* USE_PREFETCH */
+}
+
 #ifdef NOT_USED
 /*
  * BufFileTellBlock --- block-oriented tell
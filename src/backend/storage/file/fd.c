@@ -1289,6 +1289,78 @@ FilePrefetch(File file, off_t offset, int amount)
 #endif
 }
 
+/*
+ * FileFallocate - reserve file space without changing the apparent EOF.
+ *
+ * Currently the only implementation uses fallocate(FALLOC_FL_KEEP_SIZE),
+ * which is Linux-specific; elsewhere we fail with ENOSYS and the caller
+ * is expected to treat the reservation as merely advisory.  Note that
+ * posix_fallocate() is no substitute here: it moves the file's EOF, which
+ * would fool mdnblocks() into counting never-written blocks.
+ */
+int
+FileFallocate(File file, off_t offset, off_t amount)
+{
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+	int			returnCode;
+
+	Assert(FileIsValid(file));
+
+	DO_DB(elog(LOG, "FileFallocate: %d (%s) " INT64_FORMAT " " INT64_FORMAT,
+			   file, VfdCache[file].fileName,
+			   (int64) offset, (int64) amount));
+
+	returnCode = FileAccess(file);
+	if (returnCode < 0)
+		return returnCode;
+
+	do
+	{
+		returnCode = fallocate(VfdCache[file].fd, FALLOC_FL_KEEP_SIZE,
+							   offset, amount);
+	} while (returnCode != 0 && errno == EINTR);
+
+	return returnCode;
+#else
+	Assert(FileIsValid(file));
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/*
+ * FileWriteback - hint the OS to start writing out a given range of the file.
+ * The logical seek position is unaffected, and we don't wait for completion.
+ *
+ * An offset and amount of zero mean the whole file.  This is only a hint:
+ * it's a no-op on platforms without sync_file_range(), and any write errors
+ * will surface in the eventual fsync.  (We deliberately don't fall back on
+ * posix_fadvise(DONTNEED) as pg_flush_data does, since that also kicks the
+ * data out of the OS cache, which would be counterproductive here.)
+ */
+void
+FileWriteback(File file, off_t offset, off_t amount)
+{
+#if defined(HAVE_SYNC_FILE_RANGE)
+	int			returnCode;
+
+	Assert(FileIsValid(file));
+
+	DO_DB(elog(LOG, "FileWriteback: %d (%s) " INT64_FORMAT " " INT64_FORMAT,
+			   file, VfdCache[file].fileName,
+			   (int64) offset, (int64) amount));
+
+	returnCode = FileAccess(file);
+	if (returnCode < 0)
+		return;
+
+	(void) sync_file_range(VfdCache[file].fd, offset, amount,
+						   SYNC_FILE_RANGE_WRITE);
+#else
+	Assert(FileIsValid(file));
+#endif
+}
+
 int
 FileRead(File file, char *buffer, int amount)
 {
@@ -65,6 +65,7 @@
 #include "portability/mem.h"
 #include "storage/dsm_impl.h"
 #include "storage/fd.h"
+#include "storage/pg_shmem.h"
 #include "utils/guc.h"
 #include "utils/memutils.h"
 #include "postmaster/postmaster.h"
@@ -89,6 +90,9 @@ static bool dsm_impl_mmap(dsm_op op, dsm_handle handle, Size request_size,
 			  void **impl_private, void **mapped_address,
 			  Size *mapped_size, int elevel);
 #endif
+#ifndef WIN32
+static void dsm_impl_prefault(char *address, Size size);
+#endif
 static int	errcode_for_dynamic_shared_memory(void);
 
 const struct config_enum_entry dynamic_shared_memory_options[] = {
@@ -111,6 +115,9 @@ const struct config_enum_entry dynamic_shared_memory_options[] = {
 /* Implementation selector. */
 int			dynamic_shared_memory_type;
 
+/* Fault in newly created segments eagerly? */
+bool		dynamic_shared_memory_prefault = false;
+
 /* Size of buffer to be used for zero-filling. */
 #define ZBUFFER_SIZE				8192
 
@@ -390,6 +397,9 @@ dsm_impl_posix(dsm_op op, dsm_handle handle, Size request_size,
 	*mapped_size = request_size;
 	close(fd);
 
+	if (op == DSM_OP_CREATE && dynamic_shared_memory_prefault)
+		dsm_impl_prefault(address, request_size);
+
 	return true;
 }
 #endif
@@ -502,7 +512,38 @@ dsm_impl_sysv(dsm_op op, dsm_handle handle, Size request_size,
 			segsize = request_size;
 		}
 
-		if ((ident = shmget(key, segsize, flags)) == -1)
+		ident = -1;
+#ifdef SHM_HUGETLB
+		/*
+		 * Give new segments the same huge page treatment as the main shared
+		 * memory segment; see CreateAnonymousSegment.  Parallel query faults
+		 * in a fresh segment at every query start, and backing it with huge
+		 * pages cuts the number of page faults that takes considerably.
+		 */
+		if (op == DSM_OP_CREATE && huge_pages != HUGE_PAGES_OFF)
+		{
+			/* round up to a multiple of the most common huge page size */
+			int			hugepagesize = 2 * 1024 * 1024;
+			Size		hugesize = segsize;
+
+			if (hugesize % hugepagesize != 0)
+				hugesize += hugepagesize - (hugesize % hugepagesize);
+
+			ident = shmget(key, hugesize, flags | SHM_HUGETLB);
+			if (ident != -1)
+				request_size = hugesize;
+			else if (huge_pages == HUGE_PAGES_TRY && errno != EEXIST)
+				elog(DEBUG1, "shmget with SHM_HUGETLB failed, huge pages disabled: %m");
+		}
+
+		if (ident == -1 &&
+			(op != DSM_OP_CREATE || huge_pages != HUGE_PAGES_ON))
+			ident = shmget(key, segsize, flags);
+#else
+		ident = shmget(key, segsize, flags);
+#endif
+
+		if (ident == -1)
 		{
 			if (errno != EEXIST)
 			{
@@ -584,6 +625,9 @@ dsm_impl_sysv(dsm_op op, dsm_handle handle, Size request_size,
 	*mapped_address = address;
 	*mapped_size = request_size;
 
+	if (op == DSM_OP_CREATE && dynamic_shared_memory_prefault)
+		dsm_impl_prefault(address, request_size);
+
 	return true;
 }
 #endif
@@ -982,10 +1026,41 @@ dsm_impl_mmap(dsm_op op, dsm_handle handle, Size request_size,
 	*mapped_size = request_size;
 	CloseTransientFile(fd);
 
+	if (op == DSM_OP_CREATE && dynamic_shared_memory_prefault)
+		dsm_impl_prefault(address, request_size);
+
 	return true;
 }
 #endif
 
+#ifndef WIN32
+/*
+ * Fault in all pages of a newly created segment.
+ *
+ * The operating system allocates memory for a fresh segment lazily, so by
+ * default the first pass over it -- typically the initial scan or hash
+ * build of a parallel query -- takes a soft page fault for every page it
+ * touches.  When dynamic_shared_memory_prefault is enabled we instead
+ * write one byte per page while the segment is still all-zeroes, moving
+ * that cost to segment creation where it overlaps with worker startup.
+ * This must only be done for DSM_OP_CREATE; at any later point the
+ * segment may contain valid data.
+ */
+static void
+dsm_impl_prefault(char *address, Size size)
+{
+	volatile char *touch = (volatile char *) address;
+	Size		offset;
+
+	/*
+	 * Step by 4kB, the smallest page size in common use.  On systems with
+	 * larger pages we merely touch some pages more than once.
+	 */
+	for (offset = 0; offset < size; offset += 4096)
+		touch[offset] = 0;
+}
+#endif
+
 /*
  * Implementation-specific actions that must be performed when a segment
  * is to be preserved until postmaster shutdown.
@@ -54,6 +54,7 @@
 #include "access/xtm.h"
 #include "catalog/catalog.h"
 #include "miscadmin.h"
+#include "port/atomics.h"
 #include "storage/proc.h"
 #include "storage/procarray.h"
 #include "storage/spin.h"
@@ -100,6 +101,47 @@ static ProcArrayStruct *procArray;
 static PGPROC *allProcs;
 static PGXACT *allPgXact;
 
+/*
+ * Shared snapshot cache.  When snapshot_caching is enabled, the most recently
+ * computed snapshot is published here and other backends can reuse it without
+ * taking ProcArrayLock, as long as no transaction has entered or left the
+ * "running" set since.  state_version counts changes to everything a snapshot
+ * is computed from; snapshot_version records the state_version the published
+ * contents correspond to.  The cache is valid exactly when the two match.
+ *
+ * Publishers of the contents hold ProcArrayLock in shared mode and arbitrate
+ * among themselves with the publishing flag, while every invalidator holds
+ * the lock exclusively, so the two never overlap.  A lock-free reader that
+ * observes equal versions before copying the contents and again after
+ * advertising its xmin therefore holds an untorn snapshot that no completed
+ * transaction postdates.
+ */
+typedef struct SnapshotCacheData
+{
+	pg_atomic_uint64 state_version; /* bumped on every relevant change */
+	pg_atomic_uint64 snapshot_version;		/* state_version of contents */
+	pg_atomic_uint32 publishing;	/* 1 while contents are being filled */
+
+	TransactionId xmin;
+	TransactionId xmax;
+	TransactionId globalxmin;
+	TransactionId replication_slot_xmin;
+	TransactionId replication_slot_catalog_xmin;
+	uint32		xcnt;
+	int32		subxcnt;
+	bool		suboverflowed;
+
+	/* GetMaxSnapshotXidCount() xids, then GetMaxSnapshotSubxidCount() more */
+	TransactionId xids[FLEXIBLE_ARRAY_MEMBER];
+} SnapshotCacheData;
+
+/* GUC variable */
+bool		snapshot_caching = false;
+
+static SnapshotCacheData *snapshotCache;
+static TransactionId *snapshotCacheXip;
+static TransactionId *snapshotCacheSubxip;
+
 /*
  * Bookkeeping for tracking emulated transactions in recovery
  */
@@ -175,6 +217,33 @@ static inline void ProcArrayEndTransactionInternal(PGPROC *proc,
 								PGXACT *pgxact, TransactionId latestXid);
 static void ProcArrayGroupClearXid(PGPROC *proc, TransactionId latestXid);
 
+/* Primitives for the shared snapshot cache */
+static bool GetSnapshotDataReuse(Snapshot snapshot);
+static bool GetCachedSnapshotData(Snapshot snapshot);
+static void PublishCachedSnapshot(TransactionId xmin, TransactionId xmax,
+					  TransactionId globalxmin,
+					  TransactionId replication_slot_xmin,
+					  TransactionId replication_slot_catalog_xmin,
+					  TransactionId *xip, uint32 xcnt,
+					  TransactionId *subxip, int32 subxcnt,
+					  bool suboverflowed);
+
+/*
+ * InvalidateCachedSnapshot
+ *		Mark the shared snapshot cache as out of date.
+ *
+ * Call this after changing anything a snapshot is computed from: the set of
+ * running (sub)transactions, latestCompletedXid, or the replication slot
+ * xmins.  Callers hold ProcArrayLock exclusively.  The recovery-only paths
+ * that change this state need no bump, because the cache is neither read nor
+ * published while in recovery and shared memory starts out invalid.
+ */
+static inline void
+InvalidateCachedSnapshot(void)
+{
+	pg_atomic_fetch_add_u64(&snapshotCache->state_version, 1);
+}
+
 /*
  * Report shared-memory space needed by CreateSharedProcArray.
  */
@@ -214,6 +283,13 @@ ProcArrayShmemSize(void)
 						mul_size(sizeof(bool), TOTAL_MAX_CACHED_SUBXIDS));
 	}
 
+	/* Size of the shared snapshot cache */
+	size = add_size(size, offsetof(SnapshotCacheData, xids));
+	size = add_size(size,
+					mul_size(sizeof(TransactionId),
+							 add_size(PROCARRAY_MAXPROCS,
+									  TOTAL_MAX_CACHED_SUBXIDS)));
+
 	return size;
 }
 
@@ -266,6 +342,24 @@ CreateSharedProcArray(void)
 							&found);
 	}
 
+	/* Create or attach to the shared snapshot cache */
+	snapshotCache = (SnapshotCacheData *)
+		ShmemInitStruct("Snapshot Cache",
+						add_size(offsetof(SnapshotCacheData, xids),
+								 mul_size(sizeof(TransactionId),
+										  add_size(PROCARRAY_MAXPROCS,
+												   TOTAL_MAX_CACHED_SUBXIDS))),
+						&found);
+	if (!found)
+	{
+		/* contents are not yet published: leave the versions mismatched */
+		pg_atomic_init_u64(&snapshotCache->state_version, 1);
+		pg_atomic_init_u64(&snapshotCache->snapshot_version, 0);
+		pg_atomic_init_u32(&snapshotCache->publishing, 0);
+	}
+	snapshotCacheXip = snapshotCache->xids;
+	snapshotCacheSubxip = snapshotCache->xids + PROCARRAY_MAXPROCS;
+
 	/* Register and initialize fields of ProcLWLockTranche */
 	ProcLWLockTranche.name = "proc";
 	ProcLWLockTranche.array_base = (char *) (ProcGlobal->allProcs) +
@@ -322,6 +416,8 @@ ProcArrayAdd(PGPROC *proc)
 	arrayP->pgprocnos[index] = proc->pgprocno;
 	arrayP->numProcs++;
 
+	InvalidateCachedSnapshot();
+
 	LWLockRelease(ProcArrayLock);
 }
 
@@ -373,6 +469,7 @@ ProcArrayRemove(PGPROC *proc, TransactionId latestXid)
 					(arrayP->numProcs - index - 1) * sizeof(int));
 			arrayP->pgprocnos[arrayP->numProcs - 1] = -1;		/* for debugging */
 			arrayP->numProcs--;
+			InvalidateCachedSnapshot();
 			LWLockRelease(ProcArrayLock);
 			return;
 		}
@@ -472,6 +569,8 @@ ProcArrayEndTransactionInternal(PGPROC *proc, PGXACT *pgxact,
 	if (TransactionIdPrecedes(ShmemVariableCache->latestCompletedXid,
 							  latestXid))
 		ShmemVariableCache->latestCompletedXid = latestXid;
+
+	InvalidateCachedSnapshot();
 }
 
 /*
@@ -975,6 +1074,8 @@ ProcArrayApplyXidAssignment(TransactionId topxid,
 bool
 TransactionIdIsInProgress(TransactionId xid)
 {
+	if (TransactionManagerIsDefault())
+		return PgTransactionIdIsInProgress(xid);
 	return TM->IsInProgress(xid);
 }
 
@@ -1269,6 +1370,8 @@ TransactionIdIsActive(TransactionId xid)
 TransactionId
 GetOldestXmin(Relation rel, bool ignoreVacuum)
 {
+	if (TransactionManagerIsDefault())
+		return PgGetOldestXmin(rel, ignoreVacuum);
 	return TM->GetOldestXmin(rel, ignoreVacuum);
 }
 
@@ -1486,9 +1589,247 @@ GetMaxSnapshotSubxidCount(void)
 Snapshot
 GetSnapshotData(Snapshot snapshot)
 {
+	if (TransactionManagerIsDefault())
+		return PgGetSnapshotData(snapshot);
 	return TM->GetSnapshot(snapshot);
 }
 
+/*
+ * GetSnapshotDataReuse
+ *		Detect whether the previous contents of this snapshot struct are
+ *		still an accurate answer, and freshen them in place if so.
+ *
+ * Each GetSnapshotData fill records the state version it was computed from
+ * in the snapshot itself.  If the shared counter has not moved since, no
+ * transaction has entered or left the running set: every XID the snapshot
+ * lists as running still is, everything it considered finished still is, and
+ * XIDs assigned in the meantime are >= xmax and thus treated as running
+ * either way.  Only the per-statement fields (curcid, refcounts) need
+ * updating, sparing us even the copy out of the shared cache.
+ *
+ * The xmin re-advertisement follows the same seqlock protocol as
+ * GetCachedSnapshotData below: publish, barrier, re-check.  If the re-check
+ * passes, our xmin was installed before any later transaction end could have
+ * let the global xmin horizon advance past it.
+ */
+static bool
+GetSnapshotDataReuse(Snapshot snapshot)
+{
+	uint64		stateVersion;
+	bool		xminInstalled = false;
+
+	if (snapshot->snapStateVersion == 0)
+		return false;			/* never filled, imported, or recovery-shaped */
+
+	stateVersion = pg_atomic_read_u64(&snapshotCache->state_version);
+	if (stateVersion != snapshot->snapStateVersion)
+		return false;
+
+	/* we may be in a new transaction with no advertised xmin yet */
+	if (!TransactionIdIsValid(MyPgXact->xmin))
+	{
+		MyPgXact->xmin = snapshot->xmin;
+		xminInstalled = true;
+	}
+
+	pg_memory_barrier();
+
+	if (pg_atomic_read_u64(&snapshotCache->state_version) != stateVersion)
+	{
+		if (xminInstalled)
+			MyPgXact->xmin = InvalidTransactionId;
+		return false;
+	}
+
+	if (xminInstalled)
+		TransactionXmin = snapshot->xmin;
+	RecentXmin = snapshot->xmin;
+
+	snapshot->curcid = GetCurrentCommandId(false);
+
+	snapshot->active_count = 0;
+	snapshot->regd_count = 0;
+	snapshot->copied = false;
+
+	return true;
+}
+
+/*
+ * GetCachedSnapshotData
+ *		Try to satisfy GetSnapshotData from the shared snapshot cache,
+ *		without taking ProcArrayLock.
+ *
+ * The protocol against concurrent changes is seqlock-like: we check that the
+ * cache matches the current state version, copy the contents, advertise our
+ * xmin, and then re-check both versions.  Invalidators bump state_version
+ * only after completing their change (while holding ProcArrayLock
+ * exclusively), so if the re-check passes, no transaction entered or left
+ * the running set while we copied, the contents were not overwritten under
+ * us, and the xmin we advertised was installed before any later transaction
+ * end could have let the global xmin horizon advance past it — the same
+ * guarantee the locked path gets from holding ProcArrayLock across the scan.
+ *
+ * Returns true and fills the snapshot on success.  On failure (stale cache
+ * or concurrent change) the caller must fall back to the locked path.
+ */
+static bool
+GetCachedSnapshotData(Snapshot snapshot)
+{
+	uint64		stateVersion;
+	TransactionId xmin;
+	TransactionId xmax;
+	TransactionId globalxmin;
+	TransactionId replication_slot_xmin;
+	TransactionId replication_slot_catalog_xmin;
+	uint32		xcnt;
+	int32		subxcnt;
+	bool		suboverflowed;
+	bool		xminInstalled = false;
+
+	stateVersion = pg_atomic_read_u64(&snapshotCache->state_version);
+	if (pg_atomic_read_u64(&snapshotCache->snapshot_version) != stateVersion)
+		return false;
+
+	pg_read_barrier();
+
+	/*
+	 * Copy the contents.  A publisher may start overwriting them for a newer
+	 * state version while we read; the re-check below rejects such a copy.
+	 * Clamp the counts first so a torn read cannot overrun the arrays.
+	 */
+	xcnt = snapshotCache->xcnt;
+	subxcnt = snapshotCache->subxcnt;
+	if (xcnt > (uint32) GetMaxSnapshotXidCount() ||
+		subxcnt < 0 || subxcnt > GetMaxSnapshotSubxidCount())
+		return false;
+
+	xmin = snapshotCache->xmin;
+	xmax = snapshotCache->xmax;
+	globalxmin = snapshotCache->globalxmin;
+	replication_slot_xmin = snapshotCache->replication_slot_xmin;
+	replication_slot_catalog_xmin = snapshotCache->replication_slot_catalog_xmin;
+	suboverflowed = snapshotCache->suboverflowed;
+
+	memcpy(snapshot->xip, snapshotCacheXip, xcnt * sizeof(TransactionId));
+	memcpy(snapshot->subxip, snapshotCacheSubxip,
+		   subxcnt * sizeof(TransactionId));
+
+	/* advertise our xmin before the final validation, as the locked path
+	 * does while still holding ProcArrayLock */
+	if (!TransactionIdIsValid(MyPgXact->xmin))
+	{
+		MyPgXact->xmin = xmin;
+		xminInstalled = true;
+	}
+
+	pg_memory_barrier();
+
+	if (pg_atomic_read_u64(&snapshotCache->state_version) != stateVersion ||
+		pg_atomic_read_u64(&snapshotCache->snapshot_version) != stateVersion)
+	{
+		/* retracting the advertised xmin is harmless: it only ever makes
+		 * the global xmin horizon more conservative */
+		if (xminInstalled)
+			MyPgXact->xmin = InvalidTransactionId;
+		return false;
+	}
+
+	if (xminInstalled)
+		TransactionXmin = xmin;
+
+	if (TransactionIdPrecedes(xmin, globalxmin))
+		globalxmin = xmin;
+
+	RecentGlobalXmin = globalxmin - vacuum_defer_cleanup_age;
+	if (!TransactionIdIsNormal(RecentGlobalXmin))
+		RecentGlobalXmin = FirstNormalTransactionId;
+
+	if (TransactionIdIsValid(replication_slot_xmin) &&
+		NormalTransactionIdPrecedes(replication_slot_xmin, RecentGlobalXmin))
+		RecentGlobalXmin = replication_slot_xmin;
+
+	RecentGlobalDataXmin = RecentGlobalXmin;
+
+	if (TransactionIdIsNormal(replication_slot_catalog_xmin) &&
+		NormalTransactionIdPrecedes(replication_slot_catalog_xmin,
+									RecentGlobalXmin))
+		RecentGlobalXmin = replication_slot_catalog_xmin;
+
+	RecentXmin = xmin;
+
+	snapshot->xmin = xmin;
+	snapshot->xmax = xmax;
+	snapshot->xcnt = xcnt;
+	snapshot->subxcnt = subxcnt;
+	snapshot->suboverflowed = suboverflowed;
+	snapshot->takenDuringRecovery = false;
+	snapshot->snapStateVersion = stateVersion;
+
+	snapshot->curcid = GetCurrentCommandId(false);
+
+	snapshot->active_count = 0;
+	snapshot->regd_count = 0;
+	snapshot->copied = false;
+
+	return true;
+}
+
+/*
+ * PublishCachedSnapshot
+ *		Store a freshly computed snapshot into the shared snapshot cache.
+ *
+ * The caller must hold ProcArrayLock (shared suffices) and must not have an
+ * assigned XID: the snapshot it computed excludes its own XIDs, and the
+ * cache is consumed by every backend.  state_version cannot move while we
+ * hold the lock, since all invalidators hold it exclusively.  The publishing
+ * flag arbitrates between concurrent publishers; losing the race just means
+ * another backend is storing the same contents.
+ */
+static void
+PublishCachedSnapshot(TransactionId xmin, TransactionId xmax,
+					  TransactionId globalxmin,
+					  TransactionId replication_slot_xmin,
+					  TransactionId replication_slot_catalog_xmin,
+					  TransactionId *xip, uint32 xcnt,
+					  TransactionId *subxip, int32 subxcnt,
+					  bool suboverflowed)
+{
+	uint64		stateVersion;
+	uint32		expected = 0;
+
+	Assert(!TransactionIdIsValid(MyPgXact->xid));
+
+	stateVersion = pg_atomic_read_u64(&snapshotCache->state_version);
+	if (pg_atomic_read_u64(&snapshotCache->snapshot_version) == stateVersion)
+		return;					/* already current */
+
+	if (!pg_atomic_compare_exchange_u32(&snapshotCache->publishing,
+										&expected, 1))
+		return;					/* another backend is filling it */
+
+	/* re-check now that we own the flag */
+	if (pg_atomic_read_u64(&snapshotCache->snapshot_version) != stateVersion)
+	{
+		snapshotCache->xmin = xmin;
+		snapshotCache->xmax = xmax;
+		snapshotCache->globalxmin = globalxmin;
+		snapshotCache->replication_slot_xmin = replication_slot_xmin;
+		snapshotCache->replication_slot_catalog_xmin = replication_slot_catalog_xmin;
+		snapshotCache->xcnt = xcnt;
+		snapshotCache->subxcnt = subxcnt;
+		snapshotCache->suboverflowed = suboverflowed;
+		memcpy(snapshotCacheXip, xip, xcnt * sizeof(TransactionId));
+		memcpy(snapshotCacheSubxip, subxip, subxcnt * sizeof(TransactionId));
+
+		/* everything must be in place before the version becomes visible */
+		pg_write_barrier();
+		pg_atomic_write_u64(&snapshotCache->snapshot_version, stateVersion);
+	}
+
+	pg_memory_barrier();
+	pg_atomic_write_u32(&snapshotCache->publishing, 0);
+}
+
 /*
  * GetSnapshotData -- returns information about running transactions.
  *
@@ -1535,11 +1876,22 @@ PgGetSnapshotData(Snapshot snapshot)
 	int			count = 0;
 	int			subcount = 0;
 	bool		suboverflowed = false;
+	uint64		stateVersion = 0;
 	volatile TransactionId replication_slot_xmin = InvalidTransactionId;
 	volatile TransactionId replication_slot_catalog_xmin = InvalidTransactionId;
 
 	Assert(snapshot != NULL);
 
+	/*
+	 * If no transaction has completed since this snapshot struct was last
+	 * filled, its contents are still an accurate answer and we can skip the
+	 * proc array scan and the shared-cache copy altogether.  Read-committed
+	 * transactions issuing many statements against a quiet write load hit
+	 * this case most of the time.
+	 */
+	if (snapshot_caching && GetSnapshotDataReuse(snapshot))
+		return snapshot;
+
 	/*
 	 * Allocating space for maxProcs xids is usually overkill; numProcs would
 	 * be sufficient.  But it seems better to do the malloc while not holding
@@ -1572,6 +1924,20 @@ PgGetSnapshotData(Snapshot snapshot)
 					 errmsg("out of memory")));
 	}
 
+	/*
+	 * See if the shared snapshot cache can spare us the lock and the proc
+	 * array scan.  We don't use it once our transaction has an assigned XID:
+	 * published snapshots are built by backends without one, so our own XID
+	 * would not be filtered out of the xip array.  (The current-transaction
+	 * checks in tqual.c would mask that, but other snapshot consumers expect
+	 * snapshots identical to what the scan below produces.)
+	 */
+	if (snapshot_caching &&
+		!TransactionIdIsValid(MyPgXact->xid) &&
+		!RecoveryInProgress() &&
+		GetCachedSnapshotData(snapshot))
+		return snapshot;
+
 	/*
 	 * It is sufficient to get shared lock on ProcArrayLock, even if we are
 	 * going to set MyPgXact->xmin.
@@ -1726,9 +2092,30 @@ PgGetSnapshotData(Snapshot snapshot)
 	replication_slot_xmin = procArray->replication_slot_xmin;
 	replication_slot_catalog_xmin = procArray->replication_slot_catalog_xmin;
 
+	/*
+	 * Remember which state version we computed this snapshot from, so that
+	 * GetSnapshotDataReuse can later recognize it as still current.  The
+	 * version cannot move while we hold ProcArrayLock, since invalidators
+	 * hold it exclusively.  Recovery-shaped snapshots are never reused: the
+	 * recovery-only paths that change the KnownAssignedXids machinery do not
+	 * bump the version.
+	 */
+	if (!snapshot->takenDuringRecovery)
+		stateVersion = pg_atomic_read_u64(&snapshotCache->state_version);
+
 	if (!TransactionIdIsValid(MyPgXact->xmin))
 		MyPgXact->xmin = TransactionXmin = xmin;
 
+	/* share what we computed, if it can serve other backends as-is */
+	if (snapshot_caching &&
+		!snapshot->takenDuringRecovery &&
+		!TransactionIdIsValid(MyPgXact->xid))
+		PublishCachedSnapshot(xmin, xmax, globalxmin,
+							  replication_slot_xmin,
+							  replication_slot_catalog_xmin,
+							  snapshot->xip, count,
+							  snapshot->subxip, subcount, suboverflowed);
+
 	LWLockRelease(ProcArrayLock);
 
 	/*
@@ -1767,6 +2154,7 @@ PgGetSnapshotData(Snapshot snapshot)
 	snapshot->xcnt = count;
 	snapshot->subxcnt = subcount;
 	snapshot->suboverflowed = suboverflowed;
+	snapshot->snapStateVersion = stateVersion;
 
 	snapshot->curcid = GetCurrentCommandId(false);
 
@@ -2906,6 +3294,8 @@ ProcArraySetReplicationSlotXmin(TransactionId xmin, TransactionId catalog_xmin,
 	procArray->replication_slot_xmin = xmin;
 	procArray->replication_slot_catalog_xmin = catalog_xmin;
 
+	InvalidateCachedSnapshot();
+
 	if (!already_locked)
 		LWLockRelease(ProcArrayLock);
 }
@@ -3011,6 +3401,8 @@ XidCacheRemoveRunningXids(TransactionId xid,
 							  latestXid))
 		ShmemVariableCache->latestCompletedXid = latestXid;
 
+	InvalidateCachedSnapshot();
+
 	LWLockRelease(ProcArrayLock);
 }
 
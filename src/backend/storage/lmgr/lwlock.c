@@ -76,14 +76,17 @@
  */
 #include "postgres.h"
 
+#include "funcapi.h"
 #include "miscadmin.h"
 #include "pg_trace.h"
+#include "portability/instr_time.h"
 #include "postmaster/postmaster.h"
 #include "replication/slot.h"
 #include "storage/ipc.h"
 #include "storage/predicate.h"
 #include "storage/proc.h"
 #include "storage/spin.h"
+#include "utils/builtins.h"
 #include "utils/memutils.h"
 
 #ifdef LWLOCK_STATS
@@ -159,6 +162,42 @@ NamedLWLockTranche *NamedLWLockTrancheArray = NULL;
 
 static bool lock_named_request_allowed = true;
 
+/*
+ * When track_lwlock_waits is enabled, we accumulate a histogram of
+ * semaphore-wait durations in shared memory, with power-of-two microsecond
+ * buckets, split by tranche.  Bucket b counts waits that lasted less than
+ * 2^b usec (and, for b > 0, at least 2^(b-1) usec).  Tranche IDs at or
+ * beyond LW_WAIT_HIST_TRANCHES are folded into the last slot, which the
+ * pg_stat_lwlock_waits view labels "other".
+ *
+ * The histogram is examined and updated without any lock; the counters are
+ * atomics, so concurrent updates cannot be lost, though a reader may see
+ * counts from an update that is still partially applied.  That is fine for
+ * statistics.
+ */
+bool		track_lwlock_waits = false;
+
+#define LW_WAIT_HIST_TRANCHES	64
+#define LW_WAIT_HIST_BUCKETS	24
+
+typedef struct LWLockWaitStats
+{
+	pg_atomic_uint64 counts[LW_WAIT_HIST_TRANCHES][LW_WAIT_HIST_BUCKETS];
+} LWLockWaitStats;
+
+/*
+ * The histogram lives in the shmem area allocated by CreateLWLocks, just
+ * before the dynamic-allocation counters.  Deriving its address from
+ * MainLWLockArray means EXEC_BACKEND children need no extra setup beyond
+ * the restore of MainLWLockArray they do already.
+ */
+#define GetLWLockWaitStats() \
+	((LWLockWaitStats *) \
+	 ((char *) MainLWLockArray - \
+	  MAXALIGN(3 * sizeof(int) + sizeof(LWLockWaitStats))))
+
+static void LWLockReportWaitTime(LWLock *lock, instr_time wait_start);
+
 #ifdef LWLOCK_STATS
 typedef struct lwlock_stats_key
 {
@@ -402,8 +441,12 @@ LWLockShmemSize(void)
 	/* Space for the LWLock array. */
 	size = mul_size(numLocks, sizeof(LWLockPadded));
 
-	/* Space for dynamic allocation counter, plus room for alignment. */
-	size = add_size(size, 3 * sizeof(int) + LWLOCK_PADDED_SIZE);
+	/*
+	 * Space for the dynamic allocation counters and the wait-time histogram,
+	 * plus room for alignment.
+	 */
+	size = add_size(size, MAXALIGN(3 * sizeof(int) + sizeof(LWLockWaitStats)) +
+					LWLOCK_PADDED_SIZE);
 
 	/* space for named tranches. */
 	size = add_size(size, mul_size(NamedLWLockTrancheRequests, sizeof(NamedLWLockTranche)));
@@ -437,6 +480,7 @@ CreateLWLocks(void)
 		int			numNamedLocks = NumLWLocksByNamedTranches();
 		Size		spaceLocks = LWLockShmemSize();
 		LWLockPadded *lock;
+		LWLockWaitStats *waitstats;
 		int		   *LWLockCounter;
 		char	   *ptr;
 		int			id;
@@ -445,8 +489,11 @@ CreateLWLocks(void)
 		/* Allocate space */
 		ptr = (char *) ShmemAlloc(spaceLocks);
 
-		/* Leave room for dynamic allocation of locks and tranches */
-		ptr += 3 * sizeof(int);
+		/*
+		 * Leave room for dynamic allocation of locks and tranches, and for
+		 * the wait-time histogram.
+		 */
+		ptr += MAXALIGN(3 * sizeof(int) + sizeof(LWLockWaitStats));
 
 		/* Ensure desired alignment of LWLock array */
 		ptr += LWLOCK_PADDED_SIZE - ((uintptr_t) ptr) % LWLOCK_PADDED_SIZE;
@@ -469,6 +516,12 @@ CreateLWLocks(void)
 		LWLockCounter[1] = numLocks;
 		LWLockCounter[2] = LWTRANCHE_FIRST_USER_DEFINED;
 
+		/* Zero the wait-time histogram, stored just before the counters. */
+		waitstats = GetLWLockWaitStats();
+		for (id = 0; id < LW_WAIT_HIST_TRANCHES; id++)
+			for (j = 0; j < LW_WAIT_HIST_BUCKETS; j++)
+				pg_atomic_init_u64(&waitstats->counts[id][j], 0);
+
 		/* Initialize named tranches. */
 		if (NamedLWLockTrancheRequests > 0)
 		{
@@ -780,6 +833,66 @@ LWLockAttemptLock(LWLock *lock, LWLockMode mode)
 	pg_unreachable();
 }
 
+/*
+ * Spin briefly before parking on the semaphore.
+ *
+ * Most LWLocks are held for much less time than a context switch costs, so
+ * a waiter that parks immediately often pays for a sleep/wakeup cycle just
+ * to find the lock long since free.  Spin for a bounded number of
+ * iterations first, watching the state word and attempting the lock only
+ * once it looks acquirable (an unconditional compare-and-exchange loop
+ * would keep stealing the cache line from the holder).
+ *
+ * The spin budget is learned separately per tranche, since hold times are
+ * a property of what the lock protects: when spinning wins we raise the
+ * tranche's budget rapidly, and when we spin the budget out without getting
+ * the lock we halve it, so tranches with long hold times quickly decay to a
+ * token spin.  The budgets are per-backend, like spins_per_delay in
+ * s_lock.c, so no shared state is needed.  Tranche IDs at or beyond
+ * LW_SPIN_TRANCHES share the last slot, as in the wait histogram above.
+ *
+ * Returns true if the lock was acquired.
+ */
+#define LW_SPIN_TRANCHES	64
+#define LW_SPIN_MIN			10
+#define LW_SPIN_DEFAULT		100
+#define LW_SPIN_MAX			1000
+
+static int	lwlock_spin_budget[LW_SPIN_TRANCHES];
+
+static bool
+LWLockAttemptSpin(LWLock *lock, LWLockMode mode)
+{
+	int			tranche = Min(lock->tranche, LW_SPIN_TRANCHES - 1);
+	int			budget = lwlock_spin_budget[tranche];
+	int			i;
+
+	if (budget == 0)
+		budget = LW_SPIN_DEFAULT;		/* nothing learned yet */
+
+	for (i = 0; i < budget; i++)
+	{
+		uint32		state = pg_atomic_read_u32(&lock->state);
+
+		if (mode == LW_EXCLUSIVE ?
+			(state & LW_LOCK_MASK) == 0 :
+			(state & LW_VAL_EXCLUSIVE) == 0)
+		{
+			if (!LWLockAttemptLock(lock, mode))
+			{
+				/* spinning paid off; be more patient with this tranche */
+				lwlock_spin_budget[tranche] = Min(budget + 100, LW_SPIN_MAX);
+				return true;
+			}
+		}
+		SPIN_DELAY();
+	}
+
+	/* hold times are too long to spin out; back off quickly */
+	lwlock_spin_budget[tranche] = Max(budget / 2, LW_SPIN_MIN);
+	return false;
+}
+
 /*
  * Wakeup all the lockers that currently have a chance to acquire the lock.
  */
@@ -1045,6 +1158,7 @@ LWLockAcquire(LWLock *lock, LWLockMode mode)
 	PGPROC	   *proc = MyProc;
 	bool		result = true;
 	int			extraWaits = 0;
+	instr_time	wait_start;
 #ifdef LWLOCK_STATS
 	lwlock_stats *lwstats;
 
@@ -1113,6 +1227,17 @@ LWLockAcquire(LWLock *lock, LWLockMode mode)
 			break;				/* got the lock */
 		}
 
+		/*
+		 * Spin a while before going through the trouble of queueing and
+		 * sleeping; short-held locks are usually free again before a sleep
+		 * would even begin.
+		 */
+		if (LWLockAttemptSpin(lock, mode))
+		{
+			LOG_LWDEBUG("LWLockAcquire", lock, "acquired lock by spinning");
+			break;				/* got the lock */
+		}
+
 		/*
 		 * Ok, at this point we couldn't grab the lock on the first try. We
 		 * cannot simply queue ourselves to the end of the list and wait to be
@@ -1157,6 +1282,11 @@ LWLockAcquire(LWLock *lock, LWLockMode mode)
 		lwstats->block_count++;
 #endif
 
+		if (track_lwlock_waits)
+			INSTR_TIME_SET_CURRENT(wait_start);
+		else
+			INSTR_TIME_SET_ZERO(wait_start);
+
 		TRACE_POSTGRESQL_LWLOCK_WAIT_START(T_NAME(lock), T_ID(lock), mode);
 
 		for (;;)
@@ -1181,6 +1311,9 @@ LWLockAcquire(LWLock *lock, LWLockMode mode)
 
 		TRACE_POSTGRESQL_LWLOCK_WAIT_DONE(T_NAME(lock), T_ID(lock), mode);
 
+		if (track_lwlock_waits)
+			LWLockReportWaitTime(lock, wait_start);
+
 		LOG_LWDEBUG("LWLockAcquire", lock, "awakened");
 
 		/* Now loop back and try to acquire lock again. */
@@ -1270,6 +1403,7 @@ LWLockAcquireOrWait(LWLock *lock, LWLockMode mode)
 	PGPROC	   *proc = MyProc;
 	bool		mustwait;
 	int			extraWaits = 0;
+	instr_time	wait_start;
 #ifdef LWLOCK_STATS
 	lwlock_stats *lwstats;
 
@@ -1315,6 +1449,11 @@ LWLockAcquireOrWait(LWLock *lock, LWLockMode mode)
 #ifdef LWLOCK_STATS
 			lwstats->block_count++;
 #endif
+			if (track_lwlock_waits)
+				INSTR_TIME_SET_CURRENT(wait_start);
+			else
+				INSTR_TIME_SET_ZERO(wait_start);
+
 			TRACE_POSTGRESQL_LWLOCK_WAIT_START(T_NAME(lock), T_ID(lock), mode);
 
 			for (;;)
@@ -1335,6 +1474,9 @@ LWLockAcquireOrWait(LWLock *lock, LWLockMode mode)
 #endif
 			TRACE_POSTGRESQL_LWLOCK_WAIT_DONE(T_NAME(lock), T_ID(lock), mode);
 
+			if (track_lwlock_waits)
+				LWLockReportWaitTime(lock, wait_start);
+
 			LOG_LWDEBUG("LWLockAcquireOrWait", lock, "awakened");
 		}
 		else
@@ -1461,6 +1603,7 @@ LWLockWaitForVar(LWLock *lock, uint64 *valptr, uint64 oldval, uint64 *newval)
 	PGPROC	   *proc = MyProc;
 	int			extraWaits = 0;
 	bool		result = false;
+	instr_time	wait_start;
 #ifdef LWLOCK_STATS
 	lwlock_stats *lwstats;
 
@@ -1539,6 +1682,11 @@ LWLockWaitForVar(LWLock *lock, uint64 *valptr, uint64 oldval, uint64 *newval)
 		lwstats->block_count++;
 #endif
 
+		if (track_lwlock_waits)
+			INSTR_TIME_SET_CURRENT(wait_start);
+		else
+			INSTR_TIME_SET_ZERO(wait_start);
+
 		TRACE_POSTGRESQL_LWLOCK_WAIT_START(T_NAME(lock), T_ID(lock),
 										   LW_EXCLUSIVE);
 
@@ -1562,6 +1710,9 @@ LWLockWaitForVar(LWLock *lock, uint64 *valptr, uint64 oldval, uint64 *newval)
 		TRACE_POSTGRESQL_LWLOCK_WAIT_DONE(T_NAME(lock), T_ID(lock),
 										  LW_EXCLUSIVE);
 
+		if (track_lwlock_waits)
+			LWLockReportWaitTime(lock, wait_start);
+
 		LOG_LWDEBUG("LWLockWaitForVar", lock, "awakened");
 
 		/* Now loop back and check the status of the lock again. */
@@ -1794,3 +1945,121 @@ LWLockHeldByMe(LWLock *l)
 	}
 	return false;
 }
+
+/*
+ * LWLockReportWaitTime - charge a completed semaphore wait to the histogram
+ *
+ * Called from the wait loops when track_lwlock_waits is on.  Since we only
+ * get here after having actually slept on the semaphore, the cost of reading
+ * the clock is negligible compared to the wait itself; the uncontended fast
+ * path pays nothing.
+ */
+static void
+LWLockReportWaitTime(LWLock *lock, instr_time wait_start)
+{
+	instr_time	wait_time;
+	uint64		wait_us;
+	int			bucket;
+	int			tranche;
+
+	INSTR_TIME_SET_CURRENT(wait_time);
+	INSTR_TIME_SUBTRACT(wait_time, wait_start);
+	wait_us = INSTR_TIME_GET_MICROSEC(wait_time);
+
+	bucket = 0;
+	while (wait_us > 0 && bucket < LW_WAIT_HIST_BUCKETS - 1)
+	{
+		wait_us >>= 1;
+		bucket++;
+	}
+
+	tranche = Min(lock->tranche, LW_WAIT_HIST_TRANCHES - 1);
+
+	pg_atomic_fetch_add_u64(&GetLWLockWaitStats()->counts[tranche][bucket], 1);
+}
+
+/*
+ * pg_stat_get_lwlock_wait_histogram - produce a view of the wait-time
+ * histogram, one row per (tranche, bucket) pair with a nonzero count.
+ *
+ * A row (tranche, wait_us_lt, count) says that 'count' waits on locks of
+ * 'tranche' lasted less than wait_us_lt (but at least wait_us_lt/2, except
+ * in the first bucket) microseconds.  Counts survive until the next
+ * postmaster restart; there is no reset function.
+ */
+Datum
+pg_stat_get_lwlock_wait_histogram(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	LWLockWaitStats *waitstats = GetLWLockWaitStats();
+	int			i;
+	int			j;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	for (i = 0; i < LW_WAIT_HIST_TRANCHES; i++)
+	{
+		const char *name;
+
+		/*
+		 * Label the slot with the tranche's name if this backend knows it;
+		 * the overflow slot, and tranches registered only in other backends,
+		 * are reported as "other".
+		 */
+		if (i < LW_WAIT_HIST_TRANCHES - 1 &&
+			i < LWLockTranchesAllocated &&
+			LWLockTrancheArray[i] != NULL)
+			name = LWLockTrancheArray[i]->name;
+		else
+			name = "other";
+
+		for (j = 0; j < LW_WAIT_HIST_BUCKETS; j++)
+		{
+			Datum		values[3];
+			bool		nulls[3];
+			uint64		count;
+
+			count = pg_atomic_read_u64(&waitstats->counts[i][j]);
+			if (count == 0)
+				continue;
+
+			MemSet(nulls, 0, sizeof(nulls));
+			values[0] = CStringGetTextDatum(name);
+			values[1] = Int64GetDatum(((int64) 1) << j);
+			values[2] = Int64GetDatum((int64) count);
+
+			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+		}
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
@@ -516,6 +516,29 @@ mdextend(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum,
 
 	Assert(seekpos < (off_t) BLCKSZ * RELSEG_SIZE);
 
+	/*
+	 * If the relation has a preallocation policy, reserve file space ahead
+	 * of the write in large chunks.  The reservation doesn't move the
+	 * apparent EOF, so mdnblocks() still reports only written blocks; it
+	 * just lets the filesystem hand out a few large extents instead of
+	 * growing the file a page at a time, which keeps later sequential scans
+	 * from seeking all over a fragmented file.  Failure is no error --- the
+	 * filesystem may simply not support the reservation --- but don't keep
+	 * retrying on every extension.
+	 */
+	if (forknum == MAIN_FORKNUM && reln->smgr_prealloc > 0 &&
+		blocknum >= reln->smgr_prealloc_upto)
+	{
+		BlockNumber chunk = Min((BlockNumber) reln->smgr_prealloc,
+						 (BlockNumber) RELSEG_SIZE - blocknum % RELSEG_SIZE);
+
+		if (FileFallocate(v->mdfd_vfd, seekpos,
+						  (off_t) BLCKSZ * chunk) == 0)
+			reln->smgr_prealloc_upto = blocknum + chunk;
+		else
+			reln->smgr_prealloc_upto = InvalidBlockNumber;
+	}
+
 	/*
 	 * Note: because caller usually obtained blocknum by calling mdnblocks,
 	 * which did a seek(SEEK_END), this seek is often redundant and will be
@@ -662,6 +685,58 @@ mdprefetch(SMgrRelation reln, ForkNumber forknum, BlockNumber blocknum)
 #endif   /* USE_PREFETCH */
 }
 
+/*
+ * mdwriteback() -- Tell the kernel to write pages back to storage.
+ *
+ * This accepts a range of blocks because flushing several pages at once is
+ * considerably more efficient than doing so individually.
+ */
+void
+mdwriteback(SMgrRelation reln, ForkNumber forknum,
+			BlockNumber blocknum, BlockNumber nblocks)
+{
+	/*
+	 * Issue flush requests in as few requests as possible; have to split at
+	 * segment boundaries though, since those are actually separate files.
+	 */
+	while (nblocks > 0)
+	{
+		BlockNumber nflush = nblocks;
+		off_t		seekpos;
+		MdfdVec    *v;
+		int			segnum_start,
+					segnum_end;
+
+		v = _mdfd_getseg(reln, forknum, blocknum, true /* not used */ ,
+						 EXTENSION_RETURN_NULL);
+
+		/*
+		 * We might be flushing buffers of already removed relations, that's
+		 * ok, just ignore that case.
+		 */
+		if (!v)
+			return;
+
+		/* compute offset inside the current segment */
+		segnum_start = blocknum / RELSEG_SIZE;
+
+		/* compute number of desired writes within the current segment */
+		segnum_end = (blocknum + nblocks - 1) / RELSEG_SIZE;
+		if (segnum_start != segnum_end)
+			nflush = RELSEG_SIZE - (blocknum % ((BlockNumber) RELSEG_SIZE));
+
+		Assert(nflush >= 1);
+		Assert(nflush <= nblocks);
+
+		seekpos = (off_t) BLCKSZ *(blocknum % ((BlockNumber) RELSEG_SIZE));
+
+		FileWriteback(v->mdfd_vfd, seekpos, (off_t) BLCKSZ * nflush);
+
+		nblocks -= nflush;
+		blocknum += nflush;
+	}
+}
+
 
 /*
  *	mdread() -- Read the specified block from a relation.
@@ -1062,6 +1137,49 @@ mdsync(void)
 	/* Set flag to detect failure if we don't reach the end of the loop */
 	mdsync_in_progress = true;
 
+	/*
+	 * Before the blocking fsync pass below, make a quick pass over all the
+	 * files we're going to sync and hint the kernel to begin writing them
+	 * out.  The kernel can then drive writeback on all the underlying
+	 * volumes concurrently, and the serial fsyncs mostly just wait for I/O
+	 * that is already in flight rather than starting each file's writeback
+	 * only when its turn comes.  This is strictly a hint: failures are
+	 * ignored here (FileWriteback is a no-op where unsupported), since any
+	 * real errors will be reported by the fsyncs.  Note we must not consume
+	 * the request bitmaps, so we iterate them nondestructively.
+	 */
+	if (enableFsync)
+	{
+		hash_seq_init(&hstat, pendingOpsTable);
+		while ((entry = (PendingOperationEntry *) hash_seq_search(&hstat)) != NULL)
+		{
+			ForkNumber	forknum;
+
+			/* Skip entries that were queued after this checkpoint began */
+			if (entry->cycle_ctr == mdsync_cycle_ctr)
+				continue;
+
+			for (forknum = 0; forknum <= MAX_FORKNUM; forknum++)
+			{
+				int			segno = -1;
+
+				while ((segno = bms_next_member(entry->requests[forknum],
+												segno)) >= 0)
+				{
+					SMgrRelation reln;
+					MdfdVec    *seg;
+
+					reln = smgropen(entry->rnode, InvalidBackendId);
+					seg = _mdfd_getseg(reln, forknum,
+							 (BlockNumber) segno * (BlockNumber) RELSEG_SIZE,
+									   false, EXTENSION_RETURN_NULL);
+					if (seg != NULL)
+						FileWriteback(seg->mdfd_vfd, 0, 0);
+				}
+			}
+		}
+	}
+
 	/* Now scan the hashtable for fsync requests to process */
 	absorb_counter = FSYNCS_PER_ABSORB;
 	hash_seq_init(&hstat, pendingOpsTable);
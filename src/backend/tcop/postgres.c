@@ -36,12 +36,14 @@
 #include "rusagestub.h"
 #endif
 
+#include "access/hash.h"
 #include "access/parallel.h"
 #include "access/printtup.h"
 #include "access/xact.h"
 #include "catalog/pg_type.h"
 #include "commands/async.h"
 #include "commands/prepare.h"
+#include "lib/ilist.h"
 #include "libpq/libpq.h"
 #include "libpq/pqformat.h"
 #include "libpq/pqsignal.h"
@@ -54,6 +56,7 @@
 #include "parser/parser.h"
 #include "pg_getopt.h"
 #include "postmaster/autovacuum.h"
+#include "postmaster/backendpool.h"
 #include "postmaster/postmaster.h"
 #include "replication/slot.h"
 #include "replication/walsender.h"
@@ -96,6 +99,9 @@ int			max_stack_depth = 100;
 /* wait N seconds to allow attach from a debugger */
 int			PostAuthDelay = 0;
 
+/* GUC: max number of simple-protocol queries whose plans are cached, 0 = off */
+int			simple_query_cache_size = 0;
+
 
 
 /* ----------------
@@ -155,6 +161,25 @@ static bool ignore_till_sync = false;
  */
 static CachedPlanSource *unnamed_stmt_psrc = NULL;
 
+/*
+ * Cache of saved plans for simple-protocol queries, keyed by a hash of the
+ * query text.  Clients which only speak the simple protocol resend identical
+ * SQL over and over; caching the plancache entry recovers most of the
+ * advantage of extended-protocol prepared statements for them.  Entries are
+ * kept on an LRU list (most recently used at the head) and the cache is
+ * bounded by the simple_query_cache_size GUC.
+ */
+typedef struct CachedSimpleQuery
+{
+	uint32		query_hash;		/* hash of query text (hash table key) */
+	CachedPlanSource *psrc;		/* saved plancache entry for the query */
+	dlist_node	lru_node;		/* position in LRU list */
+} CachedSimpleQuery;
+
+static HTAB *simple_query_hash = NULL;
+static dlist_head simple_query_lru = DLIST_STATIC_INIT(simple_query_lru);
+static int	simple_query_count = 0;
+
 /* assorted command-line switches */
 static const char *userDoption = NULL;	/* -D switch */
 static bool EchoQuery = false;	/* -E switch */
@@ -186,6 +211,9 @@ static bool IsTransactionExitStmt(Node *parsetree);
 static bool IsTransactionExitStmtList(List *parseTrees);
 static bool IsTransactionStmtList(List *parseTrees);
 static void drop_unnamed_stmt(void);
+static bool simple_query_is_cacheable(Node *parsetree);
+static CachedPlanSource *lookup_cached_simple_query(const char *query_string);
+static void store_cached_simple_query(CachedPlanSource *psrc);
 static void SigHupHandler(SIGNAL_ARGS);
 static void log_disconnections(int code, Datum arg);
 
@@ -864,6 +892,113 @@ pg_plan_queries(List *querytrees, int cursorOptions, ParamListInfo boundParams)
 }
 
 
+/*
+ * Is this raw statement a candidate for the simple-query plan cache?
+ *
+ * We only cache optimizable statements: those are the ones where skipping
+ * analysis and planning buys anything, and restricting to them keeps
+ * utility-command side effects out of the plancache.
+ */
+static bool
+simple_query_is_cacheable(Node *parsetree)
+{
+	return IsA(parsetree, SelectStmt) ||
+		IsA(parsetree, InsertStmt) ||
+		IsA(parsetree, UpdateStmt) ||
+		IsA(parsetree, DeleteStmt);
+}
+
+/*
+ * Remove one entry from the simple-query plan cache.
+ */
+static void
+drop_cached_simple_query(CachedSimpleQuery *entry)
+{
+	DropCachedPlan(entry->psrc);
+	dlist_delete(&entry->lru_node);
+	hash_search(simple_query_hash, &entry->query_hash, HASH_REMOVE, NULL);
+	simple_query_count--;
+}
+
+/*
+ * Find a cached plan for the given query text, or NULL if there is none.
+ * A hit moves the entry to the head of the LRU list.
+ */
+static CachedPlanSource *
+lookup_cached_simple_query(const char *query_string)
+{
+	uint32		query_hash;
+	CachedSimpleQuery *entry;
+
+	if (simple_query_hash == NULL)
+		return NULL;
+
+	query_hash = DatumGetUInt32(hash_any((const unsigned char *) query_string,
+										 strlen(query_string)));
+	entry = (CachedSimpleQuery *) hash_search(simple_query_hash, &query_hash,
+											  HASH_FIND, NULL);
+	if (entry == NULL)
+		return NULL;
+
+	/* different query texts can collide on the hash; require exact match */
+	if (strcmp(entry->psrc->query_string, query_string) != 0)
+		return NULL;
+
+	dlist_delete(&entry->lru_node);
+	dlist_push_head(&simple_query_lru, &entry->lru_node);
+
+	return entry->psrc;
+}
+
+/*
+ * Enter a saved plancache entry into the simple-query plan cache, evicting
+ * the least recently used entries if the cache is full.
+ */
+static void
+store_cached_simple_query(CachedPlanSource *psrc)
+{
+	uint32		query_hash;
+	CachedSimpleQuery *entry;
+	bool		found;
+
+	if (simple_query_hash == NULL)
+	{
+		HASHCTL		hash_ctl;
+
+		MemSet(&hash_ctl, 0, sizeof(hash_ctl));
+		hash_ctl.keysize = sizeof(uint32);
+		hash_ctl.entrysize = sizeof(CachedSimpleQuery);
+		simple_query_hash = hash_create("Simple query plan cache",
+										64,
+										&hash_ctl,
+										HASH_ELEM | HASH_BLOBS);
+	}
+
+	while (simple_query_count >= simple_query_cache_size)
+	{
+		CachedSimpleQuery *victim;
+
+		victim = dlist_container(CachedSimpleQuery, lru_node,
+								 dlist_tail_node(&simple_query_lru));
+		drop_cached_simple_query(victim);
+	}
+
+	query_hash = DatumGetUInt32(hash_any((const unsigned char *) psrc->query_string,
+										 strlen(psrc->query_string)));
+	entry = (CachedSimpleQuery *) hash_search(simple_query_hash, &query_hash,
+											  HASH_ENTER, &found);
+	if (found)
+	{
+		/* hash collision with a different query text: replace the old entry */
+		DropCachedPlan(entry->psrc);
+		dlist_delete(&entry->lru_node);
+		simple_query_count--;
+	}
+	entry->psrc = psrc;
+	dlist_push_head(&simple_query_lru, &entry->lru_node);
+	simple_query_count++;
+}
+
 /*
  * exec_simple_query
  *
@@ -961,6 +1096,8 @@ exec_simple_query(const char *query_string)
 		char		completionTag[COMPLETION_TAG_BUFSIZE];
 		List	   *querytree_list,
 				   *plantree_list;
+		CachedPlanSource *psrc = NULL;
+		CachedPlan *cplan = NULL;
 		Portal		portal;
 		DestReceiver *receiver;
 		int16		format;
@@ -1016,11 +1153,52 @@ exec_simple_query(const char *query_string)
 		 */
 		oldcontext = MemoryContextSwitchTo(MessageContext);
 
-		querytree_list = pg_analyze_and_rewrite(parsetree, query_string,
-												NULL, 0);
+		if (simple_query_cache_size > 0 && isTopLevel &&
+			simple_query_is_cacheable(parsetree))
+		{
+			/*
+			 * Use the simple-query plan cache: identical query text reuses
+			 * the saved plancache entry, skipping analysis and planning the
+			 * same way a client-side prepared statement would.  The
+			 * plancache takes care of invalidation and replanning.
+			 */
+			psrc = lookup_cached_simple_query(query_string);
+			if (psrc == NULL)
+			{
+				/*
+				 * Not cached yet: build and save a plancache entry, exactly
+				 * as exec_parse_message would for a named statement with no
+				 * parameters.  CreateCachedPlan copies the raw parse tree
+				 * before analysis scribbles on it.  On error anywhere before
+				 * SaveCachedPlan the entry is cleaned up with MessageContext.
+				 */
+				psrc = CreateCachedPlan(parsetree, query_string, commandTag);
 
-		plantree_list = pg_plan_queries(querytree_list,
-										CURSOR_OPT_PARALLEL_OK, NULL);
+				querytree_list = pg_analyze_and_rewrite(parsetree,
+														query_string,
+														NULL, 0);
+
+				CompleteCachedPlan(psrc, querytree_list, NULL,
+								   NULL, 0, NULL, NULL,
+								   CURSOR_OPT_PARALLEL_OK,
+								   false);
+
+				SaveCachedPlan(psrc);
+				store_cached_simple_query(psrc);
+			}
+
+			/* Get a plan, planning it now if it isn't valid anymore */
+			cplan = GetCachedPlan(psrc, NULL, false);
+			plantree_list = cplan->stmt_list;
+		}
+		else
+		{
+			querytree_list = pg_analyze_and_rewrite(parsetree, query_string,
+													NULL, 0);
+
+			plantree_list = pg_plan_queries(querytree_list,
+											CURSOR_OPT_PARALLEL_OK, NULL);
+		}
 
 		/* Done with the snapshot used for parsing/planning */
 		if (snapshot_set)
@@ -1039,15 +1217,16 @@ exec_simple_query(const char *query_string)
 
 		/*
 		 * We don't have to copy anything into the portal, because everything
-		 * we are passing here is in MessageContext, which will outlive the
-		 * portal anyway.
+		 * we are passing here is either in MessageContext, which will outlive
+		 * the portal anyway, or (for a cached plan) protected by the plan
+		 * refcount which the portal assumes responsibility for.
 		 */
 		PortalDefineQuery(portal,
 						  NULL,
 						  query_string,
 						  commandTag,
 						  plantree_list,
-						  NULL);
+						  cplan);
 
 		/*
 		 * Start the portal.  No parameters here.
@@ -3671,8 +3850,20 @@ PostgresMain(int argc, char *argv[],
 
 		/* Initialize MaxBackends (if under postmaster, was done already) */
 		InitializeMaxBackends();
+
+		/* Same for the number of fast-path lock groups. */
+		InitializeFastPathLocks();
 	}
 
+	/*
+	 * If a parked backend of the backend pool is already serving this
+	 * database and user, pass the client over to it and exit before paying
+	 * for a full backend initialization.  (No-op unless backend_pool_size
+	 * is set.)
+	 */
+	if (IsUnderPostmaster && BackendPoolHandoff(MyProcPort))
+		proc_exit(0);
+
 	/* Early initialization */
 	BaseInit();
 
@@ -4233,6 +4424,18 @@ PostgresMain(int argc, char *argv[],
 				if (whereToSendOutput == DestRemote)
 					whereToSendOutput = DestNone;
 
+				/*
+				 * If the backend pool is enabled, try to park this backend
+				 * and serve the next client instead of exiting.  On success
+				 * a new client is attached and greeted; it still expects
+				 * the initial ReadyForQuery.
+				 */
+				if (BackendPoolPark())
+				{
+					send_ready_for_query = true;
+					break;
+				}
+
 				/*
 				 * NOTE: if you are tempted to add more code here, DON'T!
 				 * Whatever you had in mind to do should be set up as an
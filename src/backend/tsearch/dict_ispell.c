@@ -16,13 +16,14 @@
 #include "commands/defrem.h"
 #include "tsearch/dicts/spell.h"
 #include "tsearch/ts_locale.h"
+#include "tsearch/ts_shared.h"
 #include "tsearch/ts_utils.h"
 
 
 typedef struct
 {
 	StopList	stoplist;
-	IspellDict	obj;
+	IspellDict *dict;			/* backend-local or shared, see dispell_init */
 } DictISpell;
 
 Datum
@@ -30,40 +31,33 @@ dispell_init(PG_FUNCTION_ARGS)
 {
 	List	   *dictoptions = (List *) PG_GETARG_POINTER(0);
 	DictISpell *d;
-	bool		affloaded = false,
-				dictloaded = false,
-				stoploaded = false;
+	char	   *dictfile = NULL,
+			   *afffile = NULL;
+	bool		stoploaded = false;
+	IspellDict *shared;
 	ListCell   *l;
 
 	d = (DictISpell *) palloc0(sizeof(DictISpell));
 
-	NIStartBuild(&(d->obj));
-
 	foreach(l, dictoptions)
 	{
 		DefElem    *defel = (DefElem *) lfirst(l);
 
 		if (pg_strcasecmp(defel->defname, "DictFile") == 0)
 		{
-			if (dictloaded)
+			if (dictfile)
 				ereport(ERROR,
 						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 						 errmsg("multiple DictFile parameters")));
-			NIImportDictionary(&(d->obj),
-							 get_tsearch_config_filename(defGetString(defel),
-														 "dict"));
-			dictloaded = true;
+			dictfile = defGetString(defel);
 		}
 		else if (pg_strcasecmp(defel->defname, "AffFile") == 0)
 		{
-			if (affloaded)
+			if (afffile)
 				ereport(ERROR,
 						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 						 errmsg("multiple AffFile parameters")));
-			NIImportAffixes(&(d->obj),
-							get_tsearch_config_filename(defGetString(defel),
-														"affix"));
-			affloaded = true;
+			afffile = defGetString(defel);
 		}
 		else if (pg_strcasecmp(defel->defname, "StopWords") == 0)
 		{
@@ -83,25 +77,44 @@ dispell_init(PG_FUNCTION_ARGS)
 		}
 	}
 
-	if (affloaded && dictloaded)
-	{
-		NISortDictionary(&(d->obj));
-		NISortAffixes(&(d->obj));
-	}
-	else if (!affloaded)
-	{
+	if (!afffile)
 		ereport(ERROR,
 				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 				 errmsg("missing AffFile parameter")));
-	}
-	else
-	{
+	if (!dictfile)
 		ereport(ERROR,
 				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 				 errmsg("missing DictFile parameter")));
-	}
 
-	NIFinishBuild(&(d->obj));
+	/*
+	 * If some backend has already compiled this dictionary into shared
+	 * memory, use that copy and skip the whole build.  The stop list stays
+	 * backend-local: it is cheap, and not part of the compiled dictionary.
+	 */
+	shared = ts_dict_shmem_lookup(dictfile, afffile);
+	if (!shared)
+	{
+		IspellDict *dict = (IspellDict *) palloc0(sizeof(IspellDict));
+
+		NIStartBuild(dict);
+		NIImportDictionary(dict,
+						   get_tsearch_config_filename(dictfile, "dict"));
+		NIImportAffixes(dict,
+						get_tsearch_config_filename(afffile, "affix"));
+		NISortDictionary(dict);
+		NISortAffixes(dict);
+		NIFinishBuild(dict);
+
+		/*
+		 * Try to publish the result for other backends.  On success the
+		 * shared copy is used here too; the local one is reclaimed when the
+		 * dictionary's cache context is eventually dropped.
+		 */
+		shared = ts_dict_shmem_store(dictfile, afffile, dict);
+		d->dict = shared ? shared : dict;
+	}
+	else
+		d->dict = shared;
 
 	PG_RETURN_POINTER(d);
 }
@@ -121,7 +134,7 @@ dispell_lexize(PG_FUNCTION_ARGS)
 		PG_RETURN_POINTER(NULL);
 
 	txt = lowerstr_with_len(in, len);
-	res = NINormalizeWord(&(d->obj), txt);
+	res = NINormalizeWord(d->dict, txt);
 
 	if (res == NULL)
 		PG_RETURN_POINTER(NULL);
@@ -1821,3 +1821,278 @@ NINormalizeWord(IspellDict *Conf, char *word)
 
 	return lres;
 }
+
+
+/*
+ * Support for keeping a compiled dictionary in shared memory.
+ *
+ * A compiled IspellDict is a web of pointers into the dictionary's memory
+ * context: the affix array, the prefix/suffix trees, the word tree and the
+ * affix-flag strings all reference each other.  The functions below measure
+ * such a dictionary and reproduce it in one caller-supplied contiguous
+ * chunk, fixing up all internal pointers.  Since the main shared memory
+ * segment is mapped at the same address in every backend, the copy can then
+ * be used by all of them directly.
+ *
+ * The one thing that cannot be moved this way is a compiled regex: regex_t
+ * hides malloc'ed state behind private pointers.  Affixes whose mask is
+ * empty (issimple) or expressible as a regis need no regex, and real-world
+ * hunspell affix files rarely produce anything else, so dictionaries
+ * containing true regex affixes are simply declared unshareable; callers
+ * must test NIDictShareable() and fall back to a backend-local copy.
+ */
+
+static char *
+copyString(const char *str, char **ptr)
+{
+	char	   *copy = *ptr;
+	Size		len = strlen(str) + 1;
+
+	memcpy(copy, str, len);
+	*ptr += MAXALIGN(len);
+	return copy;
+}
+
+static Size
+regisSize(Regis *r)
+{
+	Size		size = 0;
+	RegisNode  *rn;
+
+	for (rn = r->node; rn; rn = rn->next)
+		size += MAXALIGN(RNHDRSZ + rn->len + 1);
+	return size;
+}
+
+static void
+regisCopy(Regis *dst, Regis *src, char **ptr)
+{
+	RegisNode  *rn;
+	RegisNode **prev;
+
+	*dst = *src;
+	prev = &dst->node;
+	for (rn = src->node; rn; rn = rn->next)
+	{
+		RegisNode  *copy = (RegisNode *) *ptr;
+
+		*ptr += MAXALIGN(RNHDRSZ + rn->len + 1);
+		memcpy(copy, rn, RNHDRSZ + rn->len + 1);
+		copy->next = NULL;
+		*prev = copy;
+		prev = &copy->next;
+	}
+}
+
+static Size
+spnodeSize(SPNode *node)
+{
+	Size		size;
+	uint32		i;
+
+	if (node == NULL)
+		return 0;
+	size = MAXALIGN(SPNHDRSZ + node->length * sizeof(SPNodeData));
+	for (i = 0; i < node->length; i++)
+		size += spnodeSize(node->data[i].node);
+	return size;
+}
+
+static SPNode *
+spnodeCopy(SPNode *node, char **ptr)
+{
+	SPNode	   *copy;
+	uint32		i;
+
+	if (node == NULL)
+		return NULL;
+	copy = (SPNode *) *ptr;
+	*ptr += MAXALIGN(SPNHDRSZ + node->length * sizeof(SPNodeData));
+	memcpy(copy, node, SPNHDRSZ + node->length * sizeof(SPNodeData));
+	for (i = 0; i < node->length; i++)
+		copy->data[i].node = spnodeCopy(node->data[i].node, ptr);
+	return copy;
+}
+
+static Size
+affixnodeSize(AffixNode *node)
+{
+	Size		size;
+	uint32		i;
+
+	if (node == NULL)
+		return 0;
+	size = MAXALIGN(ANHRDSZ + node->length * sizeof(AffixNodeData));
+	for (i = 0; i < node->length; i++)
+	{
+		if (node->data[i].aff)
+			size += MAXALIGN(node->data[i].naff * sizeof(AFFIX *));
+		size += affixnodeSize(node->data[i].node);
+	}
+	return size;
+}
+
+static AffixNode *
+affixnodeCopy(AffixNode *node, AFFIX *oldAffix, AFFIX *newAffix, char **ptr)
+{
+	AffixNode  *copy;
+	uint32		i;
+
+	if (node == NULL)
+		return NULL;
+	copy = (AffixNode *) *ptr;
+	*ptr += MAXALIGN(ANHRDSZ + node->length * sizeof(AffixNodeData));
+	memcpy(copy, node, ANHRDSZ + node->length * sizeof(AffixNodeData));
+	for (i = 0; i < node->length; i++)
+	{
+		if (node->data[i].aff)
+		{
+			AFFIX	  **aff = (AFFIX **) *ptr;
+			uint32		j;
+
+			*ptr += MAXALIGN(node->data[i].naff * sizeof(AFFIX *));
+			/* relocate the pointers into the affix array */
+			for (j = 0; j < node->data[i].naff; j++)
+				aff[j] = newAffix + (node->data[i].aff[j] - oldAffix);
+			copy->data[i].aff = aff;
+		}
+		copy->data[i].node = affixnodeCopy(node->data[i].node,
+										   oldAffix, newAffix, ptr);
+	}
+	return copy;
+}
+
+/*
+ * Can this compiled dictionary be reproduced in shared memory?
+ */
+bool
+NIDictShareable(IspellDict *Conf)
+{
+	int			i;
+
+	for (i = 0; i < Conf->naffixes; i++)
+	{
+		AFFIX	   *affix = Conf->Affix + i;
+
+		if (!affix->issimple && !affix->isregis)
+			return false;		/* compiled regex, see above */
+	}
+	return true;
+}
+
+/*
+ * Space needed by NIDictCopy for this dictionary.
+ */
+Size
+NIDictSize(IspellDict *Conf)
+{
+	Size		size = MAXALIGN(sizeof(IspellDict));
+	int			i;
+
+	size += MAXALIGN(Conf->naffixes * sizeof(AFFIX));
+	for (i = 0; i < Conf->naffixes; i++)
+	{
+		AFFIX	   *affix = Conf->Affix + i;
+
+		size += MAXALIGN(strlen(affix->find) + 1);
+		size += MAXALIGN(strlen(affix->repl) + 1);
+		if (affix->isregis)
+			size += regisSize(&affix->reg.regis);
+	}
+	size += affixnodeSize(Conf->Suffix);
+	size += affixnodeSize(Conf->Prefix);
+	size += spnodeSize(Conf->Dictionary);
+	size += MAXALIGN(Conf->nAffixData * sizeof(char *));
+	for (i = 0; i < Conf->nAffixData; i++)
+		size += MAXALIGN(strlen(Conf->AffixData[i]) + 1);
+	if (Conf->CompoundAffix)
+	{
+		CMPDAffix  *comp;
+
+		for (comp = Conf->CompoundAffix; comp->affix; comp++)
+			;
+		size += MAXALIGN((comp - Conf->CompoundAffix + 1) * sizeof(CMPDAffix));
+	}
+	return size;
+}
+
+/*
+ * Reproduce the compiled dictionary in the NIDictSize()-sized chunk at
+ * 'dest', and return it.  The result contains no references to the source
+ * dictionary or its memory context.
+ */
+IspellDict *
+NIDictCopy(IspellDict *Conf, void *dest)
+{
+	char	   *ptr = (char *) dest;
+	IspellDict *copy;
+	int			i;
+
+	copy = (IspellDict *) ptr;
+	ptr += MAXALIGN(sizeof(IspellDict));
+	memcpy(copy, Conf, sizeof(IspellDict));
+
+	/* build-time state must not leak into the copy */
+	copy->buildCxt = NULL;
+	copy->Spell = NULL;
+	copy->nspell = 0;
+	copy->mspell = 0;
+	copy->firstfree = NULL;
+	copy->avail = 0;
+
+	copy->Affix = (AFFIX *) ptr;
+	ptr += MAXALIGN(Conf->naffixes * sizeof(AFFIX));
+	for (i = 0; i < Conf->naffixes; i++)
+	{
+		AFFIX	   *src = Conf->Affix + i;
+		AFFIX	   *dst = copy->Affix + i;
+
+		*dst = *src;
+		dst->find = copyString(src->find, &ptr);
+		dst->repl = copyString(src->repl, &ptr);
+		if (src->isregis)
+			regisCopy(&dst->reg.regis, &src->reg.regis, &ptr);
+	}
+
+	copy->Suffix = affixnodeCopy(Conf->Suffix, Conf->Affix, copy->Affix, &ptr);
+	copy->Prefix = affixnodeCopy(Conf->Prefix, Conf->Affix, copy->Affix, &ptr);
+	copy->Dictionary = spnodeCopy(Conf->Dictionary, &ptr);
+
+	copy->AffixData = (char **) ptr;
+	ptr += MAXALIGN(Conf->nAffixData * sizeof(char *));
+	for (i = 0; i < Conf->nAffixData; i++)
+		copy->AffixData[i] = copyString(Conf->AffixData[i], &ptr);
+	copy->lenAffixData = copy->nAffixData = Conf->nAffixData;
+
+	if (Conf->CompoundAffix)
+	{
+		CMPDAffix  *comp;
+		int			ncomp;
+
+		for (comp = Conf->CompoundAffix; comp->affix; comp++)
+			;
+		ncomp = comp - Conf->CompoundAffix + 1;
+		copy->CompoundAffix = (CMPDAffix *) ptr;
+		ptr += MAXALIGN(ncomp * sizeof(CMPDAffix));
+		memcpy(copy->CompoundAffix, Conf->CompoundAffix,
+			   ncomp * sizeof(CMPDAffix));
+		/* entries point at repl strings of the affix array */
+		for (i = 0; i < ncomp; i++)
+		{
+			if (Conf->CompoundAffix[i].affix)
+			{
+				int			j;
+
+				for (j = 0; j < Conf->naffixes; j++)
+					if (Conf->Affix[j].repl == Conf->CompoundAffix[i].affix)
+						break;
+				Assert(j < Conf->naffixes);
+				copy->CompoundAffix[i].affix = copy->Affix[j].repl;
+			}
+		}
+	}
+
+	Assert(ptr == (char *) dest + NIDictSize(Conf));
+
+	return copy;
+}
@@ -0,0 +1,193 @@
+/*-------------------------------------------------------------------------
+ *
+ * ts_shared.c
+ *	  Text search dictionaries in shared memory.
+ *
+ * Compiling a large hunspell dictionary takes on the order of 100ms and
+ * tens of megabytes of memory, repeated in every backend that uses it.
+ * When shared_dictionary_size is set, the first backend to compile an
+ * ispell dictionary publishes the compiled result in a reserved area of
+ * the main shared memory segment, and later backends use that read-only
+ * copy directly; the segment is mapped at the same address everywhere, so
+ * the internal pointers stay valid (see NIDictCopy in spell.c).
+ *
+ * The area is append-only: dictionaries are keyed by their affix and
+ * dictionary file names and live until the next server restart, matching
+ * the lifetime of the files' contents in already-running backends.  If a
+ * dictionary does not fit into the remaining space, its compiling backend
+ * just keeps its local copy, as does every backend when the area is
+ * disabled.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *	  src/backend/tsearch/ts_shared.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "miscadmin.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "tsearch/ts_shared.h"
+
+
+/* GUC variable: kilobytes reserved for compiled dictionaries, 0 disables */
+int			shared_dictionary_size = 0;
+
+/*
+ * Entries form a linked list through the area, each directly followed by
+ * the dictionary it describes.  Offsets are relative to the start of the
+ * area, so the header itself can be examined without chasing pointers.
+ */
+typedef struct TsearchDictEntry
+{
+	Size		next;			/* offset of next entry, or 0 if last */
+	Size		dict;			/* offset of the compiled dictionary */
+	char		dictfile[MAXPGPATH];	/* DictFile parameter */
+	char		afffile[MAXPGPATH];		/* AffFile parameter */
+} TsearchDictEntry;
+
+typedef struct TsearchShmemStruct
+{
+	Size		size;			/* usable bytes in area[] */
+	Size		used;			/* bytes handed out so far */
+	Size		firstEntry;		/* offset of first entry, or 0 if none */
+	char		area[FLEXIBLE_ARRAY_MEMBER];
+} TsearchShmemStruct;
+
+static TsearchShmemStruct *TsearchShmem = NULL;
+
+Size
+TsearchShmemSize(void)
+{
+	if (shared_dictionary_size <= 0)
+		return 0;
+	return add_size(offsetof(TsearchShmemStruct, area),
+					mul_size((Size) shared_dictionary_size, 1024));
+}
+
+void
+TsearchShmemInit(void)
+{
+	bool		found;
+
+	if (shared_dictionary_size <= 0)
+		return;
+
+	TsearchShmem = (TsearchShmemStruct *)
+		ShmemInitStruct("Shared Dictionaries", TsearchShmemSize(), &found);
+	if (!found)
+	{
+		TsearchShmem->size = (Size) shared_dictionary_size * 1024;
+		TsearchShmem->used = 0;
+		TsearchShmem->firstEntry = 0;
+	}
+}
+
+/*
+ * Search the area for a dictionary compiled from the given file pair.
+ * Returns NULL if there is none (or the area is disabled).
+ */
+IspellDict *
+ts_dict_shmem_lookup(const char *dictfile, const char *afffile)
+{
+	IspellDict *result = NULL;
+	Size		offset;
+
+	if (TsearchShmem == NULL)
+		return NULL;
+
+	LWLockAcquire(TsearchDictLock, LW_SHARED);
+	for (offset = TsearchShmem->firstEntry; offset != 0;)
+	{
+		TsearchDictEntry *entry = (TsearchDictEntry *) (TsearchShmem->area + offset - 1);
+
+		if (strcmp(entry->dictfile, dictfile) == 0 &&
+			strcmp(entry->afffile, afffile) == 0)
+		{
+			result = (IspellDict *) (TsearchShmem->area + entry->dict);
+			break;
+		}
+		offset = entry->next;
+	}
+	LWLockRelease(TsearchDictLock);
+
+	return result;
+}
+
+/*
+ * Publish a freshly compiled dictionary in the area and return the shared
+ * copy, or NULL if it cannot be shared: the area is disabled, the
+ * dictionary contains regex affixes, or it does not fit into the space
+ * remaining.  If another backend published the same file pair concurrently,
+ * its copy is returned instead of storing a second one.
+ */
+IspellDict *
+ts_dict_shmem_store(const char *dictfile, const char *afffile,
+					IspellDict *dict)
+{
+	TsearchDictEntry *entry;
+	IspellDict *result;
+	Size		offset;
+	Size		dictSize;
+	Size		needed;
+
+	if (TsearchShmem == NULL)
+		return NULL;
+	if (strlen(dictfile) >= MAXPGPATH || strlen(afffile) >= MAXPGPATH)
+		return NULL;
+	if (!NIDictShareable(dict))
+	{
+		ereport(DEBUG1,
+				(errmsg("dictionary \"%s\" contains regex affixes and cannot be shared",
+						dictfile)));
+		return NULL;
+	}
+
+	dictSize = NIDictSize(dict);
+	needed = add_size(MAXALIGN(sizeof(TsearchDictEntry)), dictSize);
+
+	LWLockAcquire(TsearchDictLock, LW_EXCLUSIVE);
+
+	/* someone may have beaten us to it while we were compiling */
+	for (offset = TsearchShmem->firstEntry; offset != 0;)
+	{
+		entry = (TsearchDictEntry *) (TsearchShmem->area + offset - 1);
+		if (strcmp(entry->dictfile, dictfile) == 0 &&
+			strcmp(entry->afffile, afffile) == 0)
+		{
+			result = (IspellDict *) (TsearchShmem->area + entry->dict);
+			LWLockRelease(TsearchDictLock);
+			return result;
+		}
+		offset = entry->next;
+	}
+
+	if (MAXALIGN(TsearchShmem->used) + needed > TsearchShmem->size)
+	{
+		LWLockRelease(TsearchDictLock);
+		ereport(LOG,
+				(errmsg("dictionary \"%s\" does not fit into shared memory",
+						dictfile),
+				 errhint("Consider increasing shared_dictionary_size.")));
+		return NULL;
+	}
+
+	offset = MAXALIGN(TsearchShmem->used);
+	entry = (TsearchDictEntry *) (TsearchShmem->area + offset);
+	strlcpy(entry->dictfile, dictfile, MAXPGPATH);
+	strlcpy(entry->afffile, afffile, MAXPGPATH);
+	entry->dict = offset + MAXALIGN(sizeof(TsearchDictEntry));
+	result = NIDictCopy(dict, TsearchShmem->area + entry->dict);
+
+	/* link in only once the copy is complete */
+	entry->next = TsearchShmem->firstEntry;
+	TsearchShmem->firstEntry = offset + 1;	/* distinguish offset 0 from "none" */
+	TsearchShmem->used = offset + needed;
+
+	LWLockRelease(TsearchDictLock);
+
+	return result;
+}
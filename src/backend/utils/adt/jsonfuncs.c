@@ -17,6 +17,7 @@
 #include <limits.h>
 
 #include "access/htup_details.h"
+#include "access/tuptoaster.h"
 #include "catalog/pg_type.h"
 #include "fmgr.h"
 #include "funcapi.h"
@@ -33,6 +34,15 @@
 #include "utils/memutils.h"
 #include "utils/typcache.h"
 
+/*
+ * Detoast a jsonb argument through the shared untoast cache, so that
+ * extracting several keys from the same wide column detoasts it only once.
+ * The result may be owned by the cache and must be treated as read-only;
+ * see heap_tuple_untoast_attr_cached().
+ */
+#define PG_GETARG_JSONB_CACHED(x) \
+	((Jsonb *) heap_tuple_untoast_attr_cached((struct varlena *) DatumGetPointer(PG_GETARG_DATUM(x))))
+
 /* semantic action functions for json_object_keys */
 static void okeys_object_field_start(void *state, char *fname, bool isnull);
 static void okeys_array_start(void *state);
@@ -488,7 +498,7 @@ json_object_field(PG_FUNCTION_ARGS)
 Datum
 jsonb_object_field(PG_FUNCTION_ARGS)
 {
-	Jsonb	   *jb = PG_GETARG_JSONB(0);
+	Jsonb	   *jb = PG_GETARG_JSONB_CACHED(0);
 	text	   *key = PG_GETARG_TEXT_PP(1);
 	JsonbValue *v;
 
@@ -524,7 +534,7 @@ json_object_field_text(PG_FUNCTION_ARGS)
 Datum
 jsonb_object_field_text(PG_FUNCTION_ARGS)
 {
-	Jsonb	   *jb = PG_GETARG_JSONB(0);
+	Jsonb	   *jb = PG_GETARG_JSONB_CACHED(0);
 	text	   *key = PG_GETARG_TEXT_PP(1);
 	JsonbValue *v;
 
@@ -590,7 +600,7 @@ json_array_element(PG_FUNCTION_ARGS)
 Datum
 jsonb_array_element(PG_FUNCTION_ARGS)
 {
-	Jsonb	   *jb = PG_GETARG_JSONB(0);
+	Jsonb	   *jb = PG_GETARG_JSONB_CACHED(0);
 	int			element = PG_GETARG_INT32(1);
 	JsonbValue *v;
 
@@ -633,7 +643,7 @@ json_array_element_text(PG_FUNCTION_ARGS)
 Datum
 jsonb_array_element_text(PG_FUNCTION_ARGS)
 {
-	Jsonb	   *jb = PG_GETARG_JSONB(0);
+	Jsonb	   *jb = PG_GETARG_JSONB_CACHED(0);
 	int			element = PG_GETARG_INT32(1);
 	JsonbValue *v;
 
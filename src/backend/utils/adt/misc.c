@@ -35,6 +35,7 @@
 #include "storage/proc.h"
 #include "storage/procarray.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/ruleutils.h"
 #include "tcop/tcopprot.h"
 #include "utils/acl.h"
@@ -196,6 +197,18 @@ current_query(PG_FUNCTION_ARGS)
 		PG_RETURN_NULL();
 }
 
+/*
+ * pg_backend_memory_allocated()
+ *	Report the total bytes of memory currently allocated (at block
+ *	granularity) by this backend's memory contexts.  Useful to gauge how
+ *	far work_mem or max_query_memory is from actual consumption.
+ */
+Datum
+pg_backend_memory_allocated(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_INT64((int64) MemoryContextMemAllocated(TopMemoryContext, true));
+}
+
 /*
  * Send a signal to another backend.
  *
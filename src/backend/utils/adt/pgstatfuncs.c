@@ -15,11 +15,14 @@
 #include "postgres.h"
 
 #include "access/htup_details.h"
+#include "access/slru.h"
 #include "catalog/pg_type.h"
 #include "funcapi.h"
 #include "libpq/ip.h"
 #include "miscadmin.h"
 #include "pgstat.h"
+#include "storage/buf_internals.h"
+#include "storage/bufmgr.h"
 #include "utils/acl.h"
 #include "utils/builtins.h"
 #include "utils/inet.h"
@@ -90,6 +93,10 @@ extern Datum pg_stat_get_db_blk_write_time(PG_FUNCTION_ARGS);
 
 extern Datum pg_stat_get_archiver(PG_FUNCTION_ARGS);
 
+extern Datum pg_stat_get_buffer_pressure(PG_FUNCTION_ARGS);
+extern Datum pg_stat_get_buffer_rings(PG_FUNCTION_ARGS);
+extern Datum pg_stat_get_slru(PG_FUNCTION_ARGS);
+
 extern Datum pg_stat_get_bgwriter_timed_checkpoints(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_bgwriter_requested_checkpoints(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_checkpoint_write_time(PG_FUNCTION_ARGS);
@@ -1775,3 +1782,202 @@ pg_stat_get_archiver(PG_FUNCTION_ARGS)
 	PG_RETURN_DATUM(HeapTupleGetDatum(
 								   heap_form_tuple(tupdesc, values, nulls)));
 }
+
+/*
+ * Report buffer-cleaning pressure, i.e. how well the background writer is
+ * keeping ahead of the clock sweep.  backend_writes counts dirty victim
+ * buffers that backends had to write themselves in BufferAlloc; the rates
+ * are the bgwriter's smoothed per-cycle estimates, and pressure is their
+ * ratio.  A pressure approaching 1 means nearly every allocation of a dirty
+ * buffer is being paid for by a backend.
+ */
+Datum
+pg_stat_get_buffer_pressure(PG_FUNCTION_ARGS)
+{
+	TupleDesc	tupdesc;
+	Datum		values[4];
+	bool		nulls[4];
+	uint64		backend_writes;
+	double		alloc_rate;
+	double		backend_write_rate;
+	double		pressure;
+
+	/* Initialise values and NULL flags arrays */
+	MemSet(values, 0, sizeof(values));
+	MemSet(nulls, 0, sizeof(nulls));
+
+	/* Initialise attributes information in the tuple descriptor */
+	tupdesc = CreateTemplateTupleDesc(4, false);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 1, "backend_writes",
+					   INT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 2, "alloc_rate",
+					   FLOAT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 3, "backend_write_rate",
+					   FLOAT8OID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) 4, "pressure",
+					   FLOAT8OID, -1, 0);
+
+	BlessTupleDesc(tupdesc);
+
+	StrategyGetPressureStats(&backend_writes, &alloc_rate,
+							 &backend_write_rate);
+
+	if (alloc_rate > 0)
+		pressure = backend_write_rate / alloc_rate;
+	else
+		pressure = 0;
+
+	values[0] = Int64GetDatum((int64) backend_writes);
+	values[1] = Float8GetDatum(alloc_rate);
+	values[2] = Float8GetDatum(backend_write_rate);
+	values[3] = Float8GetDatum(pressure);
+
+	/* Returns the record as Datum */
+	PG_RETURN_DATUM(HeapTupleGetDatum(
+								   heap_form_tuple(tupdesc, values, nulls)));
+}
+
+/*
+ * Report buffer access strategy ring statistics, one row per ring-using
+ * strategy type.  allocs counts buffers requested through the ring,
+ * ring_hits the requests satisfied by recycling a ring slot, and
+ * evict_writes the dirty ring buffers a backend had to write in order to
+ * recycle their slots.
+ */
+Datum
+pg_stat_get_buffer_rings(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		MemoryContext oldcontext;
+		TupleDesc	tupdesc;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		tupdesc = CreateTemplateTupleDesc(4, false);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 1, "strategy",
+						   TEXTOID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 2, "allocs",
+						   INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 3, "ring_hits",
+						   INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 4, "evict_writes",
+						   INT8OID, -1, 0);
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+		/* one row per ring-using strategy type */
+		funcctx->max_calls = BAS_NUM_STRATEGIES - BAS_BULKREAD;
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+
+	if (funcctx->call_cntr < funcctx->max_calls)
+	{
+		int			btype = BAS_BULKREAD + (int) funcctx->call_cntr;
+		const char *name;
+		uint64		allocs;
+		uint64		hits;
+		uint64		evict_writes;
+		Datum		values[4];
+		bool		nulls[4];
+		HeapTuple	tuple;
+
+		switch (btype)
+		{
+			case BAS_BULKREAD:
+				name = "bulkread";
+				break;
+			case BAS_BULKWRITE:
+				name = "bulkwrite";
+				break;
+			case BAS_VACUUM:
+				name = "vacuum";
+				break;
+			default:
+				name = "unknown";
+				break;
+		}
+
+		StrategyGetRingStats(btype, &allocs, &hits, &evict_writes);
+
+		MemSet(nulls, 0, sizeof(nulls));
+		values[0] = CStringGetTextDatum(name);
+		values[1] = Int64GetDatum((int64) allocs);
+		values[2] = Int64GetDatum((int64) hits);
+		values[3] = Int64GetDatum((int64) evict_writes);
+
+		tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+		SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+	}
+
+	SRF_RETURN_DONE(funcctx);
+}
+
+/*
+ * Report SLRU buffer cache statistics, one row per SLRU.  blks_hit counts
+ * page requests satisfied from a buffer already in memory, blks_read and
+ * blks_written count physical page I/O.  A low hit fraction for subtrans or
+ * multixact suggests raising the corresponding *_buffers setting.
+ */
+Datum
+pg_stat_get_slru(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		MemoryContext oldcontext;
+		TupleDesc	tupdesc;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		tupdesc = CreateTemplateTupleDesc(4, false);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 1, "name",
+						   TEXTOID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 2, "blks_hit",
+						   INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 3, "blks_read",
+						   INT8OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 4, "blks_written",
+						   INT8OID, -1, 0);
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+		/* one row per SLRU in the cluster */
+		funcctx->max_calls = SimpleLruStatsCount();
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+
+	if (funcctx->call_cntr < funcctx->max_calls)
+	{
+		const char *name;
+		uint64		blks_hit;
+		uint64		blks_read;
+		uint64		blks_written;
+		Datum		values[4];
+		bool		nulls[4];
+		HeapTuple	tuple;
+
+		SimpleLruGetStats((int) funcctx->call_cntr, &name,
+						  &blks_hit, &blks_read, &blks_written);
+
+		MemSet(nulls, 0, sizeof(nulls));
+		values[0] = CStringGetTextDatum(name);
+		values[1] = Int64GetDatum((int64) blks_hit);
+		values[2] = Int64GetDatum((int64) blks_read);
+		values[3] = Int64GetDatum((int64) blks_written);
+
+		tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+		SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+	}
+
+	SRF_RETURN_DONE(funcctx);
+}
@@ -3184,7 +3184,13 @@ RelationSetNewRelfilenode(Relation relation, char persistence,
  *		before we can get the relcache set up.
  */
 
-#define INITRELCACHESIZE		400
+/*
+ * The relcache routinely holds thousands of entries in sharded schemas,
+ * where every query touches a batch of shard relations.  Sizing the hash
+ * generously up front avoids repeated directory expansions during the
+ * first few queries of each backend; the idle-backend cost is trivial.
+ */
+#define INITRELCACHESIZE		1024
 
 void
 RelationCacheInitialize(void)
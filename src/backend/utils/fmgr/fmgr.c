@@ -2235,7 +2235,7 @@ struct varlena *
 pg_detoast_datum(struct varlena * datum)
 {
 	if (VARATT_IS_EXTENDED(datum))
-		return heap_tuple_untoast_attr(datum);
+		return heap_tuple_untoast_attr_memo(datum);
 	else
 		return datum;
 }
@@ -2267,7 +2267,7 @@ struct varlena *
 pg_detoast_datum_packed(struct varlena * datum)
 {
 	if (VARATT_IS_COMPRESSED(datum) || VARATT_IS_EXTERNAL(datum))
-		return heap_tuple_untoast_attr(datum);
+		return heap_tuple_untoast_attr_memo(datum);
 	else
 		return datum;
 }
@@ -505,6 +505,37 @@ InitializeMaxBackends(void)
 		elog(ERROR, "too many backends configured");
 }
 
+/*
+ * Initialize the number of fast-path lock groups per backend.
+ *
+ * This must be called after max_locks_per_transaction has taken its final
+ * value, and before shared memory size is determined.
+ *
+ * Note that in EXEC_BACKEND environment, the value is passed down from
+ * postmaster to subprocesses via BackendParameters in SubPostmasterMain; only
+ * postmaster itself and processes not under postmaster control should call
+ * this.
+ */
+void
+InitializeFastPathLocks(void)
+{
+	Assert(FastPathLockGroupsPerBackend == 0);
+
+	/*
+	 * Based on the max_locks_per_transaction GUC, as that's a good indicator
+	 * of the number of relations a backend is expected to lock, size the
+	 * fast-path array so it can roughly cover that many relation locks.  The
+	 * group count must be a power of two so that all backends map a given
+	 * relation to the same group.
+	 */
+	FastPathLockGroupsPerBackend = 1;
+	while (FastPathLockGroupsPerBackend < FP_LOCK_GROUPS_PER_BACKEND_MAX &&
+		   FastPathLockGroupsPerBackend * FP_LOCK_SLOTS_PER_GROUP < max_locks_per_xact)
+		FastPathLockGroupsPerBackend *= 2;
+
+	Assert(FastPathLockGroupsPerBackend <= FP_LOCK_GROUPS_PER_BACKEND_MAX);
+}
+
 /*
  * Early initialization of a backend (either standalone or under postmaster).
  * This happens even before InitPostgres.
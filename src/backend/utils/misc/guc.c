@@ -28,6 +28,9 @@
 
 #include "access/commit_ts.h"
 #include "access/gin.h"
+#include "access/heapam.h"
+#include "access/multixact.h"
+#include "access/subtrans.h"
 #include "access/transam.h"
 #include "access/twophase.h"
 #include "access/xact.h"
@@ -37,6 +40,7 @@
 #include "commands/vacuum.h"
 #include "commands/variable.h"
 #include "commands/trigger.h"
+#include "executor/executor.h"
 #include "funcapi.h"
 #include "libpq/auth.h"
 #include "libpq/be-fsstubs.h"
@@ -53,11 +57,13 @@
 #include "parser/scansup.h"
 #include "pgstat.h"
 #include "postmaster/autovacuum.h"
+#include "postmaster/backendpool.h"
 #include "postmaster/bgworker.h"
 #include "postmaster/bgwriter.h"
 #include "postmaster/postmaster.h"
 #include "postmaster/syslogger.h"
 #include "postmaster/walwriter.h"
+#include "replication/reorderbuffer.h"
 #include "replication/slot.h"
 #include "replication/syncrep.h"
 #include "replication/walreceiver.h"
@@ -68,9 +74,11 @@
 #include "storage/fd.h"
 #include "storage/pg_shmem.h"
 #include "storage/proc.h"
+#include "storage/procarray.h"
 #include "storage/predicate.h"
 #include "tcop/tcopprot.h"
 #include "tsearch/ts_cache.h"
+#include "tsearch/ts_shared.h"
 #include "utils/builtins.h"
 #include "utils/bytea.h"
 #include "utils/guc_tables.h"
@@ -379,6 +387,19 @@ static const struct config_enum_entry huge_pages_options[] = {
 	{NULL, 0, false}
 };
 
+static const struct config_enum_entry wal_compression_options[] = {
+	{"pglz", WAL_COMPRESSION_PGLZ, false},
+	{"off", WAL_COMPRESSION_NONE, false},
+	{"on", WAL_COMPRESSION_PGLZ, false},
+	{"true", WAL_COMPRESSION_PGLZ, true},
+	{"false", WAL_COMPRESSION_NONE, true},
+	{"yes", WAL_COMPRESSION_PGLZ, true},
+	{"no", WAL_COMPRESSION_NONE, true},
+	{"1", WAL_COMPRESSION_PGLZ, true},
+	{"0", WAL_COMPRESSION_NONE, true},
+	{NULL, 0, false}
+};
+
 static const struct config_enum_entry force_parallel_mode_options[] = {
 	{"off", FORCE_PARALLEL_OFF, false},
 	{"on", FORCE_PARALLEL_ON, false},
@@ -831,6 +852,15 @@ static struct config_bool ConfigureNamesBool[] =
 		true,
 		NULL, NULL, NULL
 	},
+	{
+		{"enable_incrementalsort", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables the planner's use of incremental sort steps."),
+			NULL
+		},
+		&enable_incrementalsort,
+		true,
+		NULL, NULL, NULL
+	},
 	{
 		{"enable_hashagg", PGC_USERSET, QUERY_TUNING_METHOD,
 			gettext_noop("Enables the planner's use of hashed aggregation plans."),
@@ -999,16 +1029,6 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
-	{
-		{"wal_compression", PGC_SUSET, WAL_SETTINGS,
-			gettext_noop("Compresses full-page writes written in WAL file."),
-			NULL
-		},
-		&wal_compression,
-		false,
-		NULL, NULL, NULL
-	},
-
 	{
 		{"log_checkpoints", PGC_SIGHUP, LOGGING_WHAT,
 			gettext_noop("Logs each checkpoint."),
@@ -1045,6 +1065,17 @@ static struct config_bool ConfigureNamesBool[] =
 		false,
 		NULL, NULL, NULL
 	},
+	{
+		{"wal_sender_compression", PGC_USERSET, REPLICATION_SENDING,
+			gettext_noop("Compresses outgoing WAL stream data messages."),
+			gettext_noop("Set by a standby on its replication connection; "
+						 "setting it promises that the receiver understands "
+						 "compressed stream messages.")
+		},
+		&wal_sender_compression,
+		false,
+		NULL, NULL, NULL
+	},
 	{
 		{"debug_assertions", PGC_INTERNAL, PRESET_OPTIONS,
 			gettext_noop("Shows whether the running server has assertion checks enabled."),
@@ -1069,6 +1100,18 @@ static struct config_bool ConfigureNamesBool[] =
 		false,
 		NULL, NULL, NULL
 	},
+	{
+		{"snapshot_caching", PGC_SIGHUP, LOCK_MANAGEMENT,
+			gettext_noop("Serves MVCC snapshots from a shared cache when possible."),
+			gettext_noop("While the set of running transactions is unchanged, backends "
+						 "reuse the last computed snapshot instead of scanning the "
+						 "procarray under ProcArrayLock.")
+		},
+		&snapshot_caching,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"restart_after_crash", PGC_SIGHUP, ERROR_HANDLING_OPTIONS,
 			gettext_noop("Reinitialize server after backend crash."),
@@ -1202,6 +1245,15 @@ static struct config_bool ConfigureNamesBool[] =
 		false,
 		NULL, NULL, NULL
 	},
+	{
+		{"track_lwlock_waits", PGC_SUSET, STATS_COLLECTOR,
+			gettext_noop("Collects timing statistics for lightweight lock waits."),
+			NULL
+		},
+		&track_lwlock_waits,
+		false,
+		NULL, NULL, NULL
+	},
 
 	{
 		{"update_process_title", PGC_SUSET, PROCESS_TITLE,
@@ -1621,6 +1673,18 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"dynamic_shared_memory_prefault", PGC_USERSET, RESOURCES_MEM,
+			gettext_noop("Faults in dynamic shared memory segments when they are created."),
+			gettext_noop("This avoids page-fault storms during the first pass "
+						 "over a new segment, at the cost of paying the full "
+						 "allocation cost up front.")
+		},
+		&dynamic_shared_memory_prefault,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"data_checksums", PGC_INTERNAL, PRESET_OPTIONS,
 			gettext_noop("Shows whether data checksums are turned on for this cluster."),
@@ -1684,6 +1748,18 @@ static struct config_int ConfigureNamesInt[] =
 		8, 1, INT_MAX,
 		NULL, NULL, NULL
 	},
+	{
+		{"simple_query_cache_size", PGC_USERSET, QUERY_TUNING_OTHER,
+			gettext_noop("Sets the number of simple-protocol queries whose "
+						 "plans are cached."),
+			gettext_noop("Identical query text sent through the simple "
+						 "protocol reuses the cached plan, skipping parse "
+						 "analysis and planning. Zero disables the cache.")
+		},
+		&simple_query_cache_size,
+		0, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
 	{
 		{"join_collapse_limit", PGC_USERSET, QUERY_TUNING_OTHER,
 			gettext_noop("Sets the FROM-list size beyond which JOIN "
@@ -1809,6 +1885,18 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"backend_pool_size", PGC_POSTMASTER, CONN_AUTH_SETTINGS,
+			gettext_noop("Sets the number of backends kept for reuse across connections."),
+			gettext_noop("When a client disconnects, up to this many backends park themselves "
+						 "and serve later connections to the same database and user, skipping "
+						 "backend startup. Zero disables the pool.")
+		},
+		&backend_pool_size,
+		0, 0, MAX_BACKENDS,
+		NULL, NULL, NULL
+	},
+
 	/*
 	 * We sometimes multiply the number of shared buffers by two without
 	 * checking for overflow, so we mustn't allow more than INT_MAX / 2.
@@ -1824,6 +1912,96 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"shared_dictionary_size", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the amount of shared memory reserved for compiled text search dictionaries."),
+			gettext_noop("Zero disables sharing, leaving each backend to compile "
+						 "its own copy of the dictionaries it uses."),
+			GUC_UNIT_KB
+		},
+		&shared_dictionary_size,
+		0, 0, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"subtrans_buffers", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the number of shared memory buffers used for the subtransaction cache."),
+			gettext_noop("Larger values help savepoint-heavy workloads that "
+						 "look up many subtransaction parents."),
+			GUC_UNIT_BLOCKS
+		},
+		&subtrans_buffers,
+		NUM_SUBTRANS_BUFFERS, 4, 1024,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"multixact_offset_buffers", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the number of shared memory buffers used for the multixact offset cache."),
+			NULL,
+			GUC_UNIT_BLOCKS
+		},
+		&multixact_offset_buffers,
+		NUM_MXACTOFFSET_BUFFERS, 4, 1024,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"multixact_member_buffers", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the number of shared memory buffers used for the multixact member cache."),
+			NULL,
+			GUC_UNIT_BLOCKS
+		},
+		&multixact_member_buffers,
+		NUM_MXACTMEMBER_BUFFERS, 4, 1024,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"buffer_pool_partitions", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the number of clock sweep partitions in the buffer pool."),
+			gettext_noop("Setting this to the number of NUMA nodes reduces "
+						 "cross-node traffic on buffer replacement.")
+		},
+		&BufferPoolPartitions,
+		1, 1, MAX_BUFFER_POOL_PARTITIONS,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"bulk_read_ring_size", PGC_USERSET, RESOURCES_MEM,
+			gettext_noop("Sets the buffer ring size used by large sequential scans."),
+			gettext_noop("The ring is never allowed to exceed one eighth of shared_buffers."),
+			GUC_UNIT_KB
+		},
+		&bulk_read_ring_size,
+		256, BLCKSZ / 1024, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"bulk_write_ring_size", PGC_USERSET, RESOURCES_MEM,
+			gettext_noop("Sets the buffer ring size used by bulk writes such as COPY IN."),
+			gettext_noop("The ring is never allowed to exceed one eighth of shared_buffers."),
+			GUC_UNIT_KB
+		},
+		&bulk_write_ring_size,
+		16384, BLCKSZ / 1024, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"vacuum_ring_size", PGC_USERSET, RESOURCES_MEM,
+			gettext_noop("Sets the buffer ring size used by VACUUM."),
+			gettext_noop("The ring is never allowed to exceed one eighth of shared_buffers."),
+			GUC_UNIT_KB
+		},
+		&vacuum_ring_size,
+		256, BLCKSZ / 1024, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"temp_buffers", PGC_USERSET, RESOURCES_MEM,
 			gettext_noop("Sets the maximum number of temporary buffers used by each session."),
@@ -1887,6 +2065,19 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"max_query_memory", PGC_USERSET, RESOURCES_MEM,
+			gettext_noop("Sets the maximum memory a single query may allocate."),
+			gettext_noop("Queries whose executor memory contexts grow past "
+						 "this limit are aborted with an out-of-memory error. "
+						 "Zero disables the limit."),
+			GUC_UNIT_KB
+		},
+		&max_query_memory,
+		0, 0, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"maintenance_work_mem", PGC_USERSET, RESOURCES_MEM,
 			gettext_noop("Sets the maximum memory to be used for maintenance operations."),
@@ -1898,6 +2089,18 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"logical_decoding_work_mem", PGC_USERSET, RESOURCES_MEM,
+			gettext_noop("Sets the maximum memory to be used for logical decoding."),
+			gettext_noop("This much memory can be used by each internal "
+						 "reorder buffer before spilling to disk."),
+			GUC_UNIT_KB
+		},
+		&logical_decoding_work_mem,
+		65536, 64, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
 	/*
 	 * We use the hopefully-safely-small value of 100kB as the compiled-in
 	 * default for max_stack_depth.  InitializeGUCOptions will increase it if
@@ -1965,6 +2168,19 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"opportunistic_prune_limit", PGC_USERSET, RESOURCES,
+			gettext_noop("Limits the number of heap pages a statement prunes "
+						 "opportunistically."),
+			gettext_noop("Once a statement has pruned this many pages, further "
+						 "prunable pages it visits are left for later statements "
+						 "or for vacuum. Zero disables the limit.")
+		},
+		&opportunistic_prune_limit,
+		0, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"vacuum_cost_delay", PGC_USERSET, RESOURCES_VACUUM_DELAY,
 			gettext_noop("Vacuum cost delay in milliseconds."),
@@ -2208,6 +2424,17 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"checkpoint_flush_after", PGC_SIGHUP, WAL_CHECKPOINTS,
+			gettext_noop("Number of pages after which previously performed writes are flushed to disk."),
+			NULL,
+			GUC_UNIT_BLOCKS
+		},
+		&checkpoint_flush_after,
+		DEFAULT_CHECKPOINT_FLUSH_AFTER, 0, WRITEBACK_MAX_PENDING_FLUSHES,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"checkpoint_warning", PGC_SIGHUP, WAL_CHECKPOINTS,
 			gettext_noop("Enables warnings if checkpoint segments are filled more "
@@ -2233,6 +2460,29 @@ static struct config_int ConfigureNamesInt[] =
 		check_wal_buffers, NULL, NULL
 	},
 
+	{
+		{"wal_insert_locks", PGC_POSTMASTER, WAL_SETTINGS,
+			gettext_noop("Sets the number of WAL insertion locks."),
+			gettext_noop("More locks allow more concurrent WAL insertions, but "
+						 "make flushing the WAL somewhat more expensive.")
+		},
+		&wal_insert_locks,
+		8, 1, 256,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"wal_prealloc_segments", PGC_SIGHUP, WAL_SETTINGS,
+			gettext_noop("Sets the number of future WAL segments kept preallocated."),
+			gettext_noop("Segments are pre-created by background processes so that "
+						 "backends switching to a new segment rarely have to "
+						 "create and zero-fill one themselves.")
+		},
+		&wal_prealloc_segments,
+		1, 0, 1024,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"wal_writer_delay", PGC_SIGHUP, WAL_SETTINGS,
 			gettext_noop("WAL writer sleep time between WAL flushes."),
@@ -2357,6 +2607,17 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"bgwriter_flush_after", PGC_SIGHUP, RESOURCES_BGWRITER,
+			gettext_noop("Number of pages after which previously performed writes are flushed to disk."),
+			NULL,
+			GUC_UNIT_BLOCKS
+		},
+		&bgwriter_flush_after,
+		DEFAULT_BGWRITER_FLUSH_AFTER, 0, WRITEBACK_MAX_PENDING_FLUSHES,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"effective_io_concurrency",
 			PGC_USERSET,
@@ -2373,6 +2634,17 @@ static struct config_int ConfigureNamesInt[] =
 		check_effective_io_concurrency, assign_effective_io_concurrency, NULL
 	},
 
+	{
+		{"backend_flush_after", PGC_USERSET, RESOURCES_ASYNCHRONOUS,
+			gettext_noop("Number of pages after which previously performed writes are flushed to disk."),
+			NULL,
+			GUC_UNIT_BLOCKS
+		},
+		&backend_flush_after,
+		DEFAULT_BACKEND_FLUSH_AFTER, 0, WRITEBACK_MAX_PENDING_FLUSHES,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"max_worker_processes",
 			PGC_POSTMASTER,
@@ -2485,6 +2757,17 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"recovery_prefetch", PGC_SIGHUP, WAL_SETTINGS,
+			gettext_noop("Sets the number of data blocks prefetched ahead of WAL replay."),
+			gettext_noop("Zero disables prefetching during recovery."),
+			GUC_UNIT_BLOCKS
+		},
+		&recovery_prefetch,
+		32, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"wal_segment_size", PGC_INTERNAL, PRESET_OPTIONS,
 			gettext_noop("Shows the number of pages per write ahead log segment."),
@@ -2568,6 +2851,16 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"max_parallel_vacuum_workers", PGC_USERSET, RESOURCES_ASYNCHRONOUS,
+			gettext_noop("Sets the maximum number of parallel workers used to vacuum indexes."),
+			gettext_noop("Zero disables parallel index vacuuming.")
+		},
+		&max_parallel_vacuum_workers,
+		0, 0, MAX_BACKENDS,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"autovacuum_work_mem", PGC_SIGHUP, RESOURCES_MEM,
 			gettext_noop("Sets the maximum memory to be used by each autovacuum worker process."),
@@ -3635,6 +3928,16 @@ static struct config_enum ConfigureNamesEnum[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"wal_compression", PGC_SUSET, WAL_SETTINGS,
+			gettext_noop("Set the method used to compress full-page writes in the WAL."),
+			NULL
+		},
+		&wal_compression,
+		WAL_COMPRESSION_NONE, wal_compression_options,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"dynamic_shared_memory_type", PGC_POSTMASTER, RESOURCES_MEM,
 			gettext_noop("Selects the dynamic shared memory implementation used."),
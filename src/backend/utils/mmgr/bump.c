@@ -0,0 +1,701 @@
+/*-------------------------------------------------------------------------
+ *
+ * bump.c
+ *	  Bump (arena) allocator definitions.
+ *
+ * Bump is a MemoryContext implementation designed for contexts that are
+ * only ever reset as a whole, such as the executor's per-tuple contexts.
+ * Allocation is a simple pointer bump within the current block, so both
+ * palloc() and MemoryContextReset() are considerably cheaper than in an
+ * AllocSet.  The price is that pfree() returns no memory: freed space is
+ * simply wasted until the next reset.  That is acceptable for the intended
+ * use, where the context is reset once per tuple anyway, but it makes this
+ * context type unsuitable for anything long-lived that frees and
+ * reallocates pieces repeatedly.
+ *
+ * Chunks still carry the StandardChunkHeader required of all memory
+ * context types, so pfree() and repalloc() on a bump chunk are safe:
+ * pfree() is a no-op, and repalloc() allocates a fresh chunk and copies
+ * the data across, abandoning the old space.  Code running in a per-tuple
+ * context (e.g. detoasting, or growing a StringInfo) may therefore be used
+ * unmodified.
+ *
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * IDENTIFICATION
+ *	  src/backend/utils/mmgr/bump.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "utils/memdebug.h"
+#include "utils/memutils.h"
+
+
+#define BUMP_BLOCKHDRSZ	MAXALIGN(sizeof(BumpBlockData))
+#define BUMP_CHUNKHDRSZ	STANDARDCHUNKHEADERSIZE
+
+/*
+ * Requests larger than this get their own dedicated block rather than
+ * being bumped into a shared one, so that a single big allocation doesn't
+ * force us to abandon the tail of the current block.
+ */
+#define BUMP_CHUNK_LIMIT	(8 * 1024)
+
+typedef struct BumpBlockData *BumpBlock;
+
+/*
+ * BumpContext is our standard implementation of the reset-only context.
+ */
+typedef struct BumpContext
+{
+	MemoryContextData header;	/* Standard memory-context fields */
+	/* Info about storage allocated in this context: */
+	BumpBlock	blocks;			/* head of list is the active block */
+	/* Allocation parameters for this context: */
+	Size		initBlockSize;	/* initial block size */
+	Size		maxBlockSize;	/* maximum block size */
+	Size		nextBlockSize;	/* next block size to allocate */
+	BumpBlock	keeper;			/* if not NULL, keep this block over resets */
+} BumpContext;
+
+typedef BumpContext *BumpSet;
+
+#define BumpIsValid(set) PointerIsValid(set)
+
+/*
+ * BumpBlockData
+ *		A block of storage serving bump allocations.
+ *
+ * Chunks are laid out consecutively from the start of the block's data
+ * area; freeptr points just past the last one.  Unlike aset.c there are
+ * no freelists: space between freeptr and endptr is the only free space.
+ */
+typedef struct BumpBlockData
+{
+	BumpSet		bset;			/* bump set that owns this block */
+	BumpBlock	next;			/* next block in bump set's blocks list */
+	char	   *freeptr;		/* start of free space in this block */
+	char	   *endptr;			/* end of space in this block */
+}	BumpBlockData;
+
+
+/*
+ * These functions implement the MemoryContext API for Bump contexts.
+ */
+static void *BumpAlloc(MemoryContext context, Size size);
+static void BumpFree(MemoryContext context, void *pointer);
+static void *BumpRealloc(MemoryContext context, void *pointer, Size size);
+static void BumpInit(MemoryContext context);
+static void BumpReset(MemoryContext context);
+static void BumpDelete(MemoryContext context);
+static Size BumpGetChunkSpace(MemoryContext context, void *pointer);
+static bool BumpIsEmpty(MemoryContext context);
+static void BumpStats(MemoryContext context, int level, bool print,
+		  MemoryContextCounters *totals);
+
+#ifdef MEMORY_CONTEXT_CHECKING
+static void BumpCheck(MemoryContext context);
+#endif
+
+/*
+ * This is the virtual function table for Bump contexts.
+ */
+static MemoryContextMethods BumpMethods = {
+	BumpAlloc,
+	BumpFree,
+	BumpRealloc,
+	BumpInit,
+	BumpReset,
+	BumpDelete,
+	BumpGetChunkSpace,
+	BumpIsEmpty,
+	BumpStats
+#ifdef MEMORY_CONTEXT_CHECKING
+	,BumpCheck
+#endif
+};
+
+
+/* ----------
+ * Debug macros
+ * ----------
+ */
+
+#ifdef CLOBBER_FREED_MEMORY
+
+/* Wipe freed memory for debugging purposes */
+static void
+wipe_mem(void *ptr, size_t size)
+{
+	VALGRIND_MAKE_MEM_UNDEFINED(ptr, size);
+	memset(ptr, 0x7F, size);
+	VALGRIND_MAKE_MEM_NOACCESS(ptr, size);
+}
+#endif
+
+#ifdef MEMORY_CONTEXT_CHECKING
+
+static void
+set_sentinel(void *base, Size offset)
+{
+	char	   *ptr = (char *) base + offset;
+
+	VALGRIND_MAKE_MEM_UNDEFINED(ptr, 1);
+	*ptr = 0x7E;
+	VALGRIND_MAKE_MEM_NOACCESS(ptr, 1);
+}
+
+static bool
+sentinel_ok(const void *base, Size offset)
+{
+	const char *ptr = (const char *) base + offset;
+	bool		ret;
+
+	VALGRIND_MAKE_MEM_DEFINED(ptr, 1);
+	ret = *ptr == 0x7E;
+	VALGRIND_MAKE_MEM_NOACCESS(ptr, 1);
+
+	return ret;
+}
+#endif
+
+
+/*
+ * Public routines
+ */
+
+
+/*
+ * BumpContextCreate
+ *		Create a new Bump context.
+ *
+ * parent: parent context, or NULL if top-level context
+ * name: name of context (for debugging --- string will be copied)
+ * minContextSize: minimum context size
+ * initBlockSize: initial allocation block size
+ * maxBlockSize: maximum allocation block size
+ *
+ * The parameters have the same meaning as for AllocSetContextCreate, and
+ * a nonzero minContextSize likewise causes a keeper block to be allocated
+ * immediately and retained over resets.
+ */
+MemoryContext
+BumpContextCreate(MemoryContext parent,
+				  const char *name,
+				  Size minContextSize,
+				  Size initBlockSize,
+				  Size maxBlockSize)
+{
+	BumpSet		set;
+
+	/*
+	 * First, validate allocation parameters.  (If we're going to throw an
+	 * error, we should do so before the context is created, not after.)  We
+	 * somewhat arbitrarily enforce a minimum 1K block size.
+	 */
+	if (initBlockSize != MAXALIGN(initBlockSize) ||
+		initBlockSize < 1024 ||
+		maxBlockSize != MAXALIGN(maxBlockSize) ||
+		maxBlockSize < initBlockSize ||
+		!AllocHugeSizeIsValid(maxBlockSize))		/* must be safe to double */
+		elog(ERROR, "invalid memory context parameters");
+
+	/* Do the type-independent part of context creation */
+	set = (BumpSet) MemoryContextCreate(T_BumpContext,
+										sizeof(BumpContext),
+										&BumpMethods,
+										parent,
+										name);
+
+	/* Fill in BumpContext-specific header fields */
+	set->initBlockSize = initBlockSize;
+	set->maxBlockSize = maxBlockSize;
+	set->nextBlockSize = initBlockSize;
+
+	/*
+	 * Grab always-allocated space, if requested
+	 */
+	if (minContextSize > BUMP_BLOCKHDRSZ + BUMP_CHUNKHDRSZ)
+	{
+		Size		blksize = MAXALIGN(minContextSize);
+		BumpBlock	block;
+
+		block = (BumpBlock) malloc(blksize);
+		if (block == NULL)
+		{
+			MemoryContextStats(TopMemoryContext);
+			ereport(ERROR,
+					(errcode(ERRCODE_OUT_OF_MEMORY),
+					 errmsg("out of memory"),
+					 errdetail("Failed while creating memory context \"%s\".",
+							   name)));
+		}
+		block->bset = set;
+		block->freeptr = ((char *) block) + BUMP_BLOCKHDRSZ;
+		block->endptr = ((char *) block) + blksize;
+		block->next = set->blocks;
+		set->blocks = block;
+		/* Mark block as not to be released at reset time */
+		set->keeper = block;
+		set->header.mem_allocated += blksize;
+
+		/* Mark unallocated space NOACCESS; leave the block header alone. */
+		VALGRIND_MAKE_MEM_NOACCESS(block->freeptr,
+								   blksize - BUMP_BLOCKHDRSZ);
+	}
+
+	return (MemoryContext) set;
+}
+
+/*
+ * BumpInit
+ *		Context-type-specific initialization routine.
+ *
+ * This is called by MemoryContextCreate() after setting up the
+ * generic MemoryContext fields and before linking the new context
+ * into the context tree.  We must do whatever is needed to make the
+ * new context minimally valid for deletion.  We must *not* risk
+ * failure --- thus, for example, allocating more memory is not cool.
+ * (BumpContextCreate can allocate memory when it gets control back,
+ * however.)
+ */
+static void
+BumpInit(MemoryContext context)
+{
+	/*
+	 * Since MemoryContextCreate already zeroed the context node, we don't
+	 * have to do anything here: it's already OK.
+	 */
+}
+
+/*
+ * BumpReset
+ *		Frees all memory which is allocated in the given set.
+ *
+ * The code simply frees all the blocks in the set - there are no
+ * freelists to rebuild.  If the set has a keeper block, that is retained.
+ */
+static void
+BumpReset(MemoryContext context)
+{
+	BumpSet		set = (BumpSet) context;
+	BumpBlock	block;
+
+	AssertArg(BumpIsValid(set));
+
+	block = set->blocks;
+
+	/* New blocks list is either empty or just the keeper block */
+	set->blocks = set->keeper;
+
+	while (block != NULL)
+	{
+		BumpBlock	next = block->next;
+
+		if (block == set->keeper)
+		{
+			/* Reset the block, but don't return it to malloc */
+			char	   *datastart = ((char *) block) + BUMP_BLOCKHDRSZ;
+
+#ifdef CLOBBER_FREED_MEMORY
+			wipe_mem(datastart, block->freeptr - datastart);
+#else
+			/* wipe_mem() would have done this */
+			VALGRIND_MAKE_MEM_NOACCESS(datastart, block->freeptr - datastart);
+#endif
+			block->freeptr = datastart;
+			block->next = NULL;
+		}
+		else
+		{
+			/* Normal case, release the block */
+			set->header.mem_allocated -= block->endptr - ((char *) block);
+
+#ifdef CLOBBER_FREED_MEMORY
+			wipe_mem(block, block->freeptr - ((char *) block));
+#endif
+			free(block);
+		}
+		block = next;
+	}
+
+	/* Reset block size allocation sequence, too */
+	set->nextBlockSize = set->initBlockSize;
+}
+
+/*
+ * BumpDelete
+ *		Frees all memory which is allocated in the given set,
+ *		in preparation for deletion of the set.
+ *
+ * Unlike BumpReset, this *must* free all resources of the set.
+ * But note we are not responsible for deleting the context node itself.
+ */
+static void
+BumpDelete(MemoryContext context)
+{
+	BumpSet		set = (BumpSet) context;
+	BumpBlock	block = set->blocks;
+
+	AssertArg(BumpIsValid(set));
+
+	/* Make it look empty, just in case... */
+	set->blocks = NULL;
+	set->keeper = NULL;
+
+	while (block != NULL)
+	{
+		BumpBlock	next = block->next;
+
+		set->header.mem_allocated -= block->endptr - ((char *) block);
+
+#ifdef CLOBBER_FREED_MEMORY
+		wipe_mem(block, block->freeptr - ((char *) block));
+#endif
+		free(block);
+		block = next;
+	}
+}
+
+/*
+ * BumpAlloc
+ *		Returns pointer to allocated memory of given size or NULL if
+ *		request could not be completed; memory is added to the set.
+ *
+ * No request may exceed:
+ *		MAXALIGN_DOWN(SIZE_MAX) - BUMP_BLOCKHDRSZ - BUMP_CHUNKHDRSZ
+ * All callers use MemoryContextAlloc* interfaces, which check for that.
+ */
+static void *
+BumpAlloc(MemoryContext context, Size size)
+{
+	BumpSet		set = (BumpSet) context;
+	BumpBlock	block;
+	StandardChunkHeader *chunk;
+	Size		chunk_size = MAXALIGN(size);
+	Size		needed = BUMP_CHUNKHDRSZ + chunk_size;
+
+	AssertArg(BumpIsValid(set));
+
+	/*
+	 * If requested size exceeds the limit for shared blocks, give the chunk
+	 * its own dedicated block.  The block is inserted *after* the active
+	 * block (if any), so the active block's remaining free space stays
+	 * available for subsequent small requests.
+	 */
+	if (chunk_size > BUMP_CHUNK_LIMIT)
+	{
+		Size		blksize = needed + BUMP_BLOCKHDRSZ;
+
+		MemoryContextCheckLimit(&set->header, blksize);
+		block = (BumpBlock) malloc(blksize);
+		if (block == NULL)
+			return NULL;
+		block->bset = set;
+		block->freeptr = block->endptr = ((char *) block) + blksize;
+		set->header.mem_allocated += blksize;
+
+		if (set->blocks != NULL)
+		{
+			block->next = set->blocks->next;
+			set->blocks->next = block;
+		}
+		else
+		{
+			block->next = NULL;
+			set->blocks = block;
+		}
+
+		chunk = (StandardChunkHeader *)
+			(((char *) block) + BUMP_BLOCKHDRSZ);
+		chunk->context = context;
+		chunk->size = chunk_size;
+#ifdef MEMORY_CONTEXT_CHECKING
+		chunk->requested_size = size;
+		VALGRIND_MAKE_MEM_NOACCESS(&chunk->requested_size,
+								   sizeof(chunk->requested_size));
+		/* set mark to catch clobber of "unused" space */
+		if (size < chunk_size)
+			set_sentinel(((char *) chunk) + BUMP_CHUNKHDRSZ, size);
+#endif
+#ifdef RANDOMIZE_ALLOCATED_MEMORY
+		/* leave it uninitialized; bump space is never recycled */
+#endif
+
+		return (void *) (((char *) chunk) + BUMP_CHUNKHDRSZ);
+	}
+
+	/*
+	 * Bump within the active block, if there's room.  Otherwise start a new
+	 * block; any space remaining in the old active block is simply wasted
+	 * until reset, which is the bump allocator's basic trade-off.
+	 */
+	block = set->blocks;
+	if (block == NULL || needed > (Size) (block->endptr - block->freeptr))
+	{
+		Size		blksize;
+
+		/* Get size of new block, doubling as in aset.c */
+		blksize = set->nextBlockSize;
+		set->nextBlockSize <<= 1;
+		if (set->nextBlockSize > set->maxBlockSize)
+			set->nextBlockSize = set->maxBlockSize;
+
+		/* Shouldn't happen given BUMP_CHUNK_LIMIT, but be safe */
+		while (blksize < needed + BUMP_BLOCKHDRSZ)
+			blksize <<= 1;
+
+		MemoryContextCheckLimit(&set->header, blksize);
+		block = (BumpBlock) malloc(blksize);
+		if (block == NULL)
+			return NULL;
+		block->bset = set;
+		block->freeptr = ((char *) block) + BUMP_BLOCKHDRSZ;
+		block->endptr = ((char *) block) + blksize;
+		block->next = set->blocks;
+		set->blocks = block;
+		set->header.mem_allocated += blksize;
+
+		/* Mark unallocated space NOACCESS. */
+		VALGRIND_MAKE_MEM_NOACCESS(block->freeptr,
+								   blksize - BUMP_BLOCKHDRSZ);
+	}
+
+	chunk = (StandardChunkHeader *) block->freeptr;
+	block->freeptr += needed;
+	Assert(block->freeptr <= block->endptr);
+
+	/* We need the chunk header to be addressable to fill it in. */
+	VALGRIND_MAKE_MEM_UNDEFINED(chunk, BUMP_CHUNKHDRSZ);
+	chunk->context = context;
+	chunk->size = chunk_size;
+#ifdef MEMORY_CONTEXT_CHECKING
+	chunk->requested_size = size;
+	VALGRIND_MAKE_MEM_NOACCESS(&chunk->requested_size,
+							   sizeof(chunk->requested_size));
+	/* set mark to catch clobber of "unused" space */
+	if (size < chunk_size)
+		set_sentinel(((char *) chunk) + BUMP_CHUNKHDRSZ, size);
+#endif
+
+	return (void *) (((char *) chunk) + BUMP_CHUNKHDRSZ);
+}
+
+/*
+ * BumpFree
+ *		Does nothing, other than sanity checks.
+ *
+ * A bump context reclaims space only at reset time.  Making pfree() a
+ * no-op rather than an error lets general-purpose code (detoasting,
+ * string building, etc.) run in a per-tuple bump context unmodified.
+ */
+static void
+BumpFree(MemoryContext context, void *pointer)
+{
+#ifdef MEMORY_CONTEXT_CHECKING
+	StandardChunkHeader *chunk = (StandardChunkHeader *)
+	((char *) pointer - BUMP_CHUNKHDRSZ);
+
+	VALGRIND_MAKE_MEM_DEFINED(&chunk->requested_size,
+							  sizeof(chunk->requested_size));
+	/* Test for someone scribbling on unused space in chunk */
+	if (chunk->requested_size < chunk->size)
+		if (!sentinel_ok(pointer, chunk->requested_size))
+			elog(WARNING, "detected write past chunk end in %s %p",
+				 ((BumpSet) context)->header.name, chunk);
+	VALGRIND_MAKE_MEM_NOACCESS(&chunk->requested_size,
+							   sizeof(chunk->requested_size));
+#endif
+}
+
+/*
+ * BumpRealloc
+ *		Returns new pointer to allocated memory of given size or NULL if
+ *		request could not be completed; this memory is added to the set.
+ *		Memory associated with given pointer is NOT returned to the set;
+ *		it remains wasted until the next reset.
+ */
+static void *
+BumpRealloc(MemoryContext context, void *pointer, Size size)
+{
+	StandardChunkHeader *chunk = (StandardChunkHeader *)
+	((char *) pointer - BUMP_CHUNKHDRSZ);
+	Size		oldsize = chunk->size;
+	void	   *newPointer;
+
+	if (oldsize >= MAXALIGN(size))
+	{
+		/* Still fits in the existing chunk; just update bookkeeping. */
+#ifdef MEMORY_CONTEXT_CHECKING
+		VALGRIND_MAKE_MEM_DEFINED(&chunk->requested_size,
+								  sizeof(chunk->requested_size));
+		chunk->requested_size = size;
+		VALGRIND_MAKE_MEM_NOACCESS(&chunk->requested_size,
+								   sizeof(chunk->requested_size));
+		if (size < oldsize)
+			set_sentinel(pointer, size);
+#endif
+		return pointer;
+	}
+
+	/* Allocate a fresh chunk and copy the data across. */
+	newPointer = BumpAlloc(context, size);
+	if (newPointer == NULL)
+		return NULL;
+
+	VALGRIND_MAKE_MEM_DEFINED(pointer, oldsize);
+	memcpy(newPointer, pointer, oldsize);
+
+	/* The old chunk is abandoned, not freed; see BumpFree */
+
+	return newPointer;
+}
+
+/*
+ * BumpGetChunkSpace
+ *		Given a currently-allocated chunk, determine the total space
+ *		it occupies (including all memory-allocation overhead).
+ */
+static Size
+BumpGetChunkSpace(MemoryContext context, void *pointer)
+{
+	StandardChunkHeader *chunk = (StandardChunkHeader *)
+	((char *) pointer - BUMP_CHUNKHDRSZ);
+
+	return chunk->size + BUMP_CHUNKHDRSZ;
+}
+
+/*
+ * BumpIsEmpty
+ *		Is a BumpContext empty of any allocated space?
+ */
+static bool
+BumpIsEmpty(MemoryContext context)
+{
+	BumpSet		set = (BumpSet) context;
+
+	/*
+	 * Empty means no blocks at all, or just an untouched keeper block.
+	 */
+	if (set->blocks == NULL)
+		return true;
+	if (set->blocks == set->keeper && set->blocks->next == NULL &&
+		set->blocks->freeptr == ((char *) set->blocks) + BUMP_BLOCKHDRSZ)
+		return true;
+	return false;
+}
+
+/*
+ * BumpStats
+ *		Compute stats about memory consumption of a bump context.
+ *
+ * level: recursion level (0 at top level); used for print indentation.
+ * print: true to print stats to stderr.
+ * totals: if not NULL, add stats about this context into *totals.
+ */
+static void
+BumpStats(MemoryContext context, int level, bool print,
+		  MemoryContextCounters *totals)
+{
+	BumpSet		set = (BumpSet) context;
+	Size		nblocks = 0;
+	Size		totalspace = 0;
+	Size		freespace = 0;
+	BumpBlock	block;
+
+	for (block = set->blocks; block != NULL; block = block->next)
+	{
+		nblocks++;
+		totalspace += block->endptr - ((char *) block);
+		freespace += block->endptr - block->freeptr;
+	}
+
+	if (print)
+	{
+		int			i;
+
+		for (i = 0; i < level; i++)
+			fprintf(stderr, "  ");
+		fprintf(stderr,
+				"%s: %zu total in %zd blocks; %zu free; %zu used\n",
+				set->header.name, totalspace, nblocks, freespace,
+				totalspace - freespace);
+	}
+
+	if (totals)
+	{
+		totals->nblocks += nblocks;
+		totals->totalspace += totalspace;
+		totals->freespace += freespace;
+	}
+}
+
+
+#ifdef MEMORY_CONTEXT_CHECKING
+
+/*
+ * BumpCheck
+ *		Walk through chunks and check consistency of memory.
+ *
+ * NOTE: report errors as WARNING, *not* ERROR or FATAL.  Otherwise you'll
+ * find yourself in an infinite loop when trouble occurs, because this
+ * routine will be entered again when elog cleanup tries to release memory!
+ */
+static void
+BumpCheck(MemoryContext context)
+{
+	BumpSet		set = (BumpSet) context;
+	char	   *name = set->header.name;
+	BumpBlock	block;
+
+	for (block = set->blocks; block != NULL; block = block->next)
+	{
+		char	   *bpoz = ((char *) block) + BUMP_BLOCKHDRSZ;
+
+		if (block->bset != set)
+			elog(WARNING, "problem in bump %s: bogus bset link in block %p",
+				 name, block);
+		if (block->freeptr < bpoz || block->freeptr > block->endptr)
+			elog(WARNING, "problem in bump %s: corrupt freeptr in block %p",
+				 name, block);
+
+		/*
+		 * Chunks are laid out consecutively, so we can walk them.
+		 */
+		while (bpoz < block->freeptr)
+		{
+			StandardChunkHeader *chunk = (StandardChunkHeader *) bpoz;
+			Size		chsize,
+						dsize;
+
+			chsize = chunk->size;		/* aligned chunk size */
+			VALGRIND_MAKE_MEM_DEFINED(&chunk->requested_size,
+									  sizeof(chunk->requested_size));
+			dsize = chunk->requested_size;		/* real data */
+
+			if (dsize > chsize)
+				elog(WARNING, "problem in bump %s: req size > alloc size for chunk %p in block %p",
+					 name, chunk, block);
+			if (chsize != MAXALIGN(chsize))
+				elog(WARNING, "problem in bump %s: bogus chunk size for chunk %p in block %p",
+					 name, chunk, block);
+			if (chunk->context != (MemoryContext) set)
+				elog(WARNING, "problem in bump %s: bogus context link in chunk %p in block %p",
+					 name, chunk, block);
+
+			/* check for overwrite of "unallocated" space */
+			if (dsize < chsize && !sentinel_ok(chunk, BUMP_CHUNKHDRSZ + dsize))
+				elog(WARNING, "problem in bump %s: detected write past chunk %p end in block %p",
+					 name, chunk, block);
+
+			bpoz += BUMP_CHUNKHDRSZ + chsize;
+		}
+	}
+}
+
+#endif   /* MEMORY_CONTEXT_CHECKING */
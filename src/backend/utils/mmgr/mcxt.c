@@ -474,6 +474,88 @@ MemoryContextIsEmpty(MemoryContext context)
 	return (*context->methods->is_empty) (context);
 }
 
+/*
+ * MemoryContextMemAllocated
+ *		Return the total amount of memory obtained from malloc() by this
+ *		context, optionally including its descendants.
+ *
+ * This is cheap to compute because allocation and release of blocks keep
+ * mem_allocated up to date; no walk of the context's internal structures is
+ * needed.  Note it reflects space obtained from the OS, not space handed out
+ * to palloc callers, so freelisted chunks still count.
+ */
+Size
+MemoryContextMemAllocated(MemoryContext context, bool recurse)
+{
+	Size		total = context->mem_allocated;
+
+	AssertArg(MemoryContextIsValid(context));
+
+	if (recurse)
+	{
+		MemoryContext child;
+
+		for (child = context->firstchild;
+			 child != NULL;
+			 child = child->nextchild)
+			total += MemoryContextMemAllocated(child, true);
+	}
+
+	return total;
+}
+
+/*
+ * MemoryContextSetLimit
+ *		Limit the total amount of memory obtained from malloc() by the
+ *		context and its descendants.  Block allocations that would push the
+ *		total past 'limit' bytes raise an out-of-memory error for the
+ *		offending backend instead of driving the whole server into the OOM
+ *		killer's arms.  A limit of 0 removes the cap.
+ *
+ * Enforcement is block-grained: the number compared against the limit is
+ * the one MemoryContextMemAllocated() reports, so allocations served from a
+ * context's freelists or from block space already obtained are never
+ * rejected.
+ */
+void
+MemoryContextSetLimit(MemoryContext context, Size limit)
+{
+	AssertArg(MemoryContextIsValid(context));
+
+	context->limit = limit;
+}
+
+/*
+ * MemoryContextCheckLimit
+ *		Error out if growing 'context' by 'added' more bytes would push any
+ *		limited ancestor (including the context itself) past its limit.
+ *
+ * The allocators call this before they obtain a new block from malloc(), so
+ * failing here leaves the context structures untouched.  The walk up the
+ * parent chain is short and only happens per block, not per chunk.
+ */
+void
+MemoryContextCheckLimit(MemoryContext context, Size added)
+{
+	MemoryContext c;
+
+	for (c = context; c != NULL; c = c->parent)
+	{
+		if (c->limit != 0)
+		{
+			Size		total = MemoryContextMemAllocated(c, true);
+
+			if (total + added > c->limit)
+				ereport(ERROR,
+						(errcode(ERRCODE_OUT_OF_MEMORY),
+						 errmsg("memory allocated under context \"%s\" exceeds its limit of %zu kB",
+								c->name, c->limit / 1024),
+						 errdetail("Failed while requesting %zu more bytes with %zu bytes already allocated.",
+								   added, total)));
+		}
+	}
+}
+
 /*
  * MemoryContextStats
  *		Print statistics about the named context and all its descendants.
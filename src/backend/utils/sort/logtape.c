@@ -134,6 +134,8 @@ typedef struct LogicalTape
 	long		curBlockNumber; /* this block's logical blk# within tape */
 	int			pos;			/* next read/write position in buffer */
 	int			nbytes;			/* total # of valid bytes in buffer */
+	long		prefetchNext;	/* next logical blk# to advise the kernel
+								 * about (see ltsPrefetchTape) */
 } LogicalTape;
 
 /*
@@ -188,6 +190,15 @@ static long ltsRecallNextBlockNum(LogicalTapeSet *lts,
 static long ltsRecallPrevBlockNum(LogicalTapeSet *lts,
 					  IndirectBlock *indirect);
 static void ltsDumpBuffer(LogicalTapeSet *lts, LogicalTape *lt);
+static void ltsPrefetchTape(LogicalTapeSet *lts, LogicalTape *lt);
+
+/*
+ * Number of upcoming data blocks of a tape to advise the kernel about
+ * while reading sequentially.  At BLCKSZ = 8K this is 256kB of read-ahead
+ * per input tape, enough to keep the disk busy during the CPU-bound parts
+ * of a merge without evicting much else from the OS cache.
+ */
+#define PREFETCH_TAPE_DISTANCE	32
 
 
 /*
@@ -503,6 +514,51 @@ ltsRecallPrevBlockNum(LogicalTapeSet *lts,
 }
 
 
+/*
+ * Issue kernel read-ahead advice for the next few data blocks of a tape.
+ *
+ * The bottom-level indirect block already holds the physical block numbers
+ * of up to BLOCKS_PER_INDIR_BLOCK upcoming data blocks, so we can tell the
+ * kernel where a sequential read is headed without disturbing any read
+ * state: slot nextSlot holds logical block curBlockNumber + 1, and so on.
+ * We remember in prefetchNext how far the advice has gotten, so each block
+ * is advised only once per pass; blocks beyond the current bottom indirect
+ * block are simply not advised until it is reloaded.
+ *
+ * This is called whenever a read loads a new data block into the tape
+ * buffer.  Advised blocks cannot have been released yet (release happens
+ * as they are read), so at worst a block recycled to the write side after
+ * being advised costs one useless kernel readahead.
+ */
+static void
+ltsPrefetchTape(LogicalTapeSet *lts, LogicalTape *lt)
+{
+#ifdef USE_PREFETCH
+	IndirectBlock *indirect = lt->indirect;
+	long		target;
+	int			slot;
+
+	if (indirect == NULL)
+		return;
+
+	target = lt->curBlockNumber + PREFETCH_TAPE_DISTANCE;
+	if (lt->prefetchNext <= lt->curBlockNumber)
+		lt->prefetchNext = lt->curBlockNumber + 1;
+
+	slot = indirect->nextSlot +
+		(int) (lt->prefetchNext - lt->curBlockNumber - 1);
+	for (; slot < BLOCKS_PER_INDIR_BLOCK && lt->prefetchNext <= target;
+		 slot++, lt->prefetchNext++)
+	{
+		long		datablocknum = indirect->ptrs[slot];
+
+		if (datablocknum == -1L)
+			break;
+		BufFilePrefetch(lts->pfile, datablocknum);
+	}
+#endif   /* USE_PREFETCH */
+}
+
 /*
  * Create a set of logical tapes in a temporary underlying file.
  *
@@ -549,6 +605,7 @@ LogicalTapeSetCreate(int ntapes)
 		lt->curBlockNumber = 0L;
 		lt->pos = 0;
 		lt->nbytes = 0;
+		lt->prefetchNext = 0L;
 	}
 	return lts;
 }
@@ -713,6 +770,7 @@ LogicalTapeRewind(LogicalTapeSet *lts, int tapenum, bool forWrite)
 		lt->curBlockNumber = 0L;
 		lt->pos = 0;
 		lt->nbytes = 0;
+		lt->prefetchNext = 0L;
 		if (datablocknum != -1L)
 		{
 			ltsReadBlock(lts, datablocknum, (void *) lt->buffer);
@@ -720,6 +778,7 @@ LogicalTapeRewind(LogicalTapeSet *lts, int tapenum, bool forWrite)
 				ltsReleaseBlock(lts, datablocknum);
 			lt->nbytes = (lt->curBlockNumber < lt->numFullBlocks) ?
 				BLCKSZ : lt->lastBlockBytes;
+			ltsPrefetchTape(lts, lt);
 		}
 	}
 	else
@@ -754,6 +813,7 @@ LogicalTapeRewind(LogicalTapeSet *lts, int tapenum, bool forWrite)
 		lt->curBlockNumber = 0L;
 		lt->pos = 0;
 		lt->nbytes = 0;
+		lt->prefetchNext = 0L;
 	}
 }
 
@@ -793,6 +853,7 @@ LogicalTapeRead(LogicalTapeSet *lts, int tapenum,
 				BLCKSZ : lt->lastBlockBytes;
 			if (lt->nbytes <= 0)
 				break;			/* EOF (possible here?) */
+			ltsPrefetchTape(lts, lt);
 		}
 
 		nthistime = lt->nbytes - lt->pos;
@@ -412,6 +412,9 @@ SetTransactionSnapshot(Snapshot sourcesnap, TransactionId sourcexid,
 	CurrentSnapshot->takenDuringRecovery = sourcesnap->takenDuringRecovery;
 	/* NB: curcid should NOT be copied, it's a local matter */
 
+	/* imported contents must not be mistaken for a reusable local snapshot */
+	CurrentSnapshot->snapStateVersion = 0;
+
 	/*
 	 * Now we have to fix what GetSnapshotData did with MyPgXact->xmin and
 	 * TransactionXmin.  There is a race condition: to make sure we are not
@@ -1529,14 +1532,22 @@ SerializeSnapshot(Snapshot snapshot, char *start_address)
  * RestoreSnapshot
  *		Restore a serialized snapshot from the specified address.
  *
- * The copy is palloc'd in TopTransactionContext and has initial refcounts set
- * to 0.  The returned snapshot has the copied flag set.
+ * Only the fixed-size SnapshotData is palloc'd (in TopTransactionContext,
+ * with initial refcounts set to 0); the XID arrays are used directly at
+ * their serialized location.  The caller must therefore keep the serialized
+ * data (in practice, the dynamic shared memory segment holding it) mapped
+ * for as long as the returned snapshot is in use.  All current callers
+ * restore from a parallel query's segment, which easily satisfies that.
+ * We can't hand out the serialized data as a ready-made SnapshotData
+ * instead, because refcounts and curcid are backend-local state and the
+ * cooperating workers would clobber each other's.
+ *
+ * The returned snapshot has the copied flag set.
  */
 Snapshot
 RestoreSnapshot(char *start_address)
 {
 	SerializedSnapshotData *serialized_snapshot;
-	Size		size;
 	Snapshot	snapshot;
 	TransactionId *serialized_xids;
 
@@ -1544,13 +1555,9 @@ RestoreSnapshot(char *start_address)
 	serialized_xids = (TransactionId *)
 		(start_address + sizeof(SerializedSnapshotData));
 
-	/* We allocate any XID arrays needed in the same palloc block. */
-	size = sizeof(SnapshotData)
-		+ serialized_snapshot->xcnt * sizeof(TransactionId)
-		+ serialized_snapshot->subxcnt * sizeof(TransactionId);
-
 	/* Copy all required fields */
-	snapshot = (Snapshot) MemoryContextAlloc(TopTransactionContext, size);
+	snapshot = (Snapshot) MemoryContextAlloc(TopTransactionContext,
+											 sizeof(SnapshotData));
 	snapshot->satisfies = HeapTupleSatisfiesMVCC;
 	snapshot->xmin = serialized_snapshot->xmin;
 	snapshot->xmax = serialized_snapshot->xmax;
@@ -1562,21 +1569,13 @@ RestoreSnapshot(char *start_address)
 	snapshot->takenDuringRecovery = serialized_snapshot->takenDuringRecovery;
 	snapshot->curcid = serialized_snapshot->curcid;
 
-	/* Copy XIDs, if present. */
+	/* Reference XIDs in place, if present. */
 	if (serialized_snapshot->xcnt > 0)
-	{
-		snapshot->xip = (TransactionId *) (snapshot + 1);
-		memcpy(snapshot->xip, serialized_xids,
-			   serialized_snapshot->xcnt * sizeof(TransactionId));
-	}
+		snapshot->xip = serialized_xids;
 
-	/* Copy SubXIDs, if present. */
+	/* Likewise for SubXIDs. */
 	if (serialized_snapshot->subxcnt > 0)
-	{
-		snapshot->subxip = snapshot->xip + serialized_snapshot->xcnt;
-		memcpy(snapshot->subxip, serialized_xids + serialized_snapshot->xcnt,
-			   serialized_snapshot->subxcnt * sizeof(TransactionId));
-	}
+		snapshot->subxip = serialized_xids + serialized_snapshot->xcnt;
 
 	/* Set the copied flag so that the caller will set refcounts correctly. */
 	snapshot->regd_count = 0;
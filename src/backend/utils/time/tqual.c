@@ -1458,6 +1458,8 @@ HeapTupleIsSurelyDead(HeapTuple htup, TransactionId OldestXmin)
 bool
 XidInMVCCSnapshot(TransactionId xid, Snapshot snapshot)
 {
+	if (TransactionManagerIsDefault())
+		return PgXidInMVCCSnapshot(xid, snapshot);
 	return TM->IsInSnapshot(xid, snapshot);
 }
 
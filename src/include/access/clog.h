@@ -33,6 +33,8 @@ typedef int XidStatus;
 extern void TransactionIdSetTreeStatus(TransactionId xid, int nsubxids,
 				   TransactionId *subxids, XidStatus status, XLogRecPtr lsn);
 extern XidStatus TransactionIdGetStatus(TransactionId xid, XLogRecPtr *lsn);
+extern void TransactionIdGetStatusBulk(int nxids, TransactionId *xids,
+						   XidStatus *statuses, XLogRecPtr *lsns);
 
 extern Size CLOGShmemBuffers(void);
 extern Size CLOGShmemSize(void);
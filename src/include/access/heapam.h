@@ -32,6 +32,9 @@
 
 typedef struct BulkInsertStateData *BulkInsertState;
 
+/* force heap_update to relocate the new tuple version (see heapam.c) */
+extern bool heap_relocate_update;
+
 /*
  * Possible lock modes for a tuple.
  */
@@ -179,6 +182,8 @@ extern void simple_heap_update(Relation relation, ItemPointer otid,
 extern void heap_sync(Relation relation);
 
 /* in heap/pruneheap.c */
+extern int	opportunistic_prune_limit;
+
 extern void heap_page_prune_opt(Relation relation, Buffer buffer);
 extern int heap_page_prune(Relation relation, Buffer buffer,
 				TransactionId OldestXmin,
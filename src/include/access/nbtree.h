@@ -615,6 +615,15 @@ typedef struct BTScanOpaqueData
 	int		   *killedItems;	/* currPos.items indexes of killed items */
 	int			numKilled;		/* number of currently stored items */
 
+	/*
+	 * Leaf page where the previous _bt_first of this scan started, or
+	 * InvalidBlockNumber.  This survives rescans so that repeated probes
+	 * with nearby keys (eg, a nestloop inner indexscan over sorted outer
+	 * rows) can revalidate the remembered leaf instead of re-descending
+	 * from the root each time.
+	 */
+	BlockNumber lastStartBlkno; /* descent shortcut hint */
+
 	/*
 	 * If we are doing an index-only scan, these are the tuple storage
 	 * workspaces for the currPos and markPos respectively.  Each is of size
@@ -65,13 +65,13 @@ typedef struct SlruSharedData
 
 	/*
 	 * Arrays holding info for each buffer slot.  Page number is undefined
-	 * when status is EMPTY, as is page_lru_count.
+	 * when status is EMPTY, as is page_recently_used.
 	 */
 	char	  **page_buffer;
 	SlruPageStatus *page_status;
 	bool	   *page_dirty;
 	int		   *page_number;
-	int		   *page_lru_count;
+	bool	   *page_recently_used;
 
 	/*
 	 * Optional array of WAL flush LSNs associated with entries in the SLRU
@@ -84,16 +84,24 @@ typedef struct SlruSharedData
 	XLogRecPtr *group_lsn;
 	int			lsn_groups_per_page;
 
-	/*----------
-	 * We mark a page "most recently used" by setting
-	 *		page_lru_count[slotno] = ++cur_lru_count;
-	 * The oldest page is therefore the one with the highest value of
-	 *		cur_lru_count - page_lru_count[slotno]
-	 * The counts will eventually wrap around, but this calculation still
-	 * works as long as no page's age exceeds INT_MAX counts.
-	 *----------
+	/*
+	 * Page replacement runs a clock sweep over the slots: every access sets
+	 * the slot's page_recently_used flag, and the sweep clears flags as it
+	 * passes until it finds a slot whose flag is already clear.  This is the
+	 * position of the sweep hand; it is advanced only while the control lock
+	 * is held exclusively.
 	 */
-	int			cur_lru_count;
+	int			next_victim_slot;
+
+	/*
+	 * Buffer usage counters, for monitoring cache effectiveness.  These are
+	 * normally bumped with the control lock held exclusively; the shared-lock
+	 * fast path in SimpleLruReadPage_ReadOnly() may occasionally lose an
+	 * increment, which is acceptable for statistics.
+	 */
+	uint64		blks_hit;		/* page requests satisfied from a buffer */
+	uint64		blks_read;		/* pages physically read in */
+	uint64		blks_written;	/* pages physically written out */
 
 	/*
 	 * latest_page_number is the page number of the current end of the log;
@@ -166,4 +174,9 @@ extern bool SlruScanDirCbReportPresence(SlruCtl ctl, char *filename,
 extern bool SlruScanDirCbDeleteAll(SlruCtl ctl, char *filename, int segpage,
 					   void *data);
 
+/* Access to per-SLRU usage counters, for pg_stat_get_slru() */
+extern int	SimpleLruStatsCount(void);
+extern void SimpleLruGetStats(int index, const char **name,
+				  uint64 *blks_hit, uint64 *blks_read, uint64 *blks_written);
+
 #endif   /* SLRU_H */
@@ -78,6 +78,9 @@ typedef struct tupleDesc
 	int32		tdtypmod;		/* typmod for tuple type */
 	bool		tdhasoid;		/* tuple has oid attribute in its header */
 	int			tdrefcount;		/* reference count, or -1 if not counting */
+	int			tdnfixed;		/* number of leading attributes deformable at
+								 * precomputed fixed offsets, or -1 if not
+								 * computed yet; see TupleDescFixedPrefix() */
 }	*TupleDesc;
 
 
@@ -112,6 +115,8 @@ extern void DecrTupleDescRefCount(TupleDesc tupdesc);
 
 extern bool equalTupleDescs(TupleDesc tupdesc1, TupleDesc tupdesc2);
 
+extern int	TupleDescFixedPrefix(TupleDesc tupdesc);
+
 extern void TupleDescInitEntry(TupleDesc desc,
 				   AttrNumber attributeNumber,
 				   const char *attributeName,
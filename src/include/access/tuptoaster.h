@@ -163,6 +163,27 @@ extern struct varlena *heap_tuple_fetch_attr(struct varlena * attr);
  */
 extern struct varlena *heap_tuple_untoast_attr(struct varlena * attr);
 
+/* ----------
+ * heap_tuple_untoast_attr_cached() -
+ *
+ *		Like heap_tuple_untoast_attr, but repeated requests for the same
+ *		external value are served from a small cache.  The result may be
+ *		owned by the cache: read-only, not to be pfree'd, valid only
+ *		until the next call.
+ * ----------
+ */
+extern struct varlena *heap_tuple_untoast_attr_cached(struct varlena * attr);
+
+/* ----------
+ * heap_tuple_untoast_attr_memo() -
+ *
+ *		Caching variant with the same result semantics as
+ *		heap_tuple_untoast_attr: the result is always a fresh palloc'd
+ *		copy.  Values detoasted repeatedly are served from the cache.
+ * ----------
+ */
+extern struct varlena *heap_tuple_untoast_attr_memo(struct varlena * attr);
+
 /* ----------
  * heap_tuple_untoast_attr_slice() -
  *
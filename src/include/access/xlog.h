@@ -96,16 +96,26 @@ extern bool reachedConsistency;
 extern int	min_wal_size;
 extern int	max_wal_size;
 extern int	wal_keep_segments;
+extern int	wal_prealloc_segments;
+extern int	wal_insert_locks;
 extern int	XLOGbuffers;
 extern int	XLogArchiveTimeout;
 extern int	wal_retrieve_retry_interval;
+extern int	recovery_prefetch;
 extern char *XLogArchiveCommand;
 extern bool EnableHotStandby;
 extern bool fullPageWrites;
 extern bool wal_log_hints;
-extern bool wal_compression;
+extern int	wal_compression;
 extern bool log_checkpoints;
 
+/* Compression algorithms for full-page images */
+typedef enum WalCompression
+{
+	WAL_COMPRESSION_NONE = 0,	/* don't compress full-page images */
+	WAL_COMPRESSION_PGLZ		/* compress them with pglz */
+} WalCompression;
+
 extern int	CheckPointSegments;
 
 /* Archive modes */
@@ -216,6 +226,7 @@ extern bool XLogBackgroundFlush(void);
 extern bool XLogNeedsFlush(XLogRecPtr RecPtr);
 extern int	XLogFileInit(XLogSegNo segno, bool *use_existent, bool use_lock);
 extern int	XLogFileOpen(XLogSegNo segno);
+extern void PreallocXlogFiles(XLogRecPtr endptr);
 
 extern void CheckXLogRemoved(XLogSegNo segno, TimeLineID tli);
 extern XLogSegNo XLogGetLastRemovedSegno(void);
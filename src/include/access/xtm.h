@@ -71,6 +71,14 @@ typedef struct
 
 	/* Get transaction manager name */
 	char const *(*GetName) (void);
+
+	/*
+	 * Get status of several transactions at once (bulk counterpart of
+	 * GetTransactionStatus, encapsulation of TransactionIdGetStatusBulk in
+	 * clog.c).  May be left NULL, in which case GetTransactionStatus is
+	 * called for each xid in turn.
+	 */
+	void		(*GetTransactionStatusBulk) (int nxids, TransactionId *xids, XidStatus *statuses, XLogRecPtr *lsns);
 }	TransactionManager;
 
 /* Get pointer to transaction manager: actually returns content of TM variable */
@@ -80,12 +88,23 @@ extern TransactionManager *TM;	/* Current transaction manager (can be
 								 * substituted by extensions) */
 extern TransactionManager PgTM; /* Standard PostgreSQL transaction manager */
 
+/*
+ * Fastpath test for the common case of no DTM extension loaded.  While TM
+ * still points at PgTM, the wrappers around the hot visibility calls use
+ * this to call the standard implementation directly (and, within the same
+ * translation unit, to let the compiler inline it) instead of paying for an
+ * indirect call through the function-pointer table on every tuple.
+ */
+#define TransactionManagerIsDefault()	(TM == &PgTM)
+
 /* Standard PostgreSQL function implementing TM interface */
 extern bool PgXidInMVCCSnapshot(TransactionId xid, Snapshot snapshot);
 
 extern void PgTransactionIdSetTreeStatus(TransactionId xid, int nsubxids,
 				   TransactionId *subxids, XidStatus status, XLogRecPtr lsn);
 extern XidStatus PgTransactionIdGetStatus(TransactionId xid, XLogRecPtr *lsn);
+extern void PgTransactionIdGetStatusBulk(int nxids, TransactionId *xids,
+							XidStatus *statuses, XLogRecPtr *lsns);
 
 extern Snapshot PgGetSnapshotData(Snapshot snapshot);
 
@@ -53,6 +53,6 @@
  */
 
 /*							yyyymmddN */
-#define CATALOG_VERSION_NO	201602071
+#define CATALOG_VERSION_NO	201608307
 
 #endif
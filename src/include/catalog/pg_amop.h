@@ -1116,4 +1116,15 @@ DATA(insert (	4104	603  603 12 s	  2572	  3580 0 ));
 /* we could, but choose not to, supply entries for strategies 13 and 14 */
 DATA(insert (	4104	603  600  7 s	   433	  3580 0 ));
 
+/* bloom integer */
+DATA(insert (	4115	 23   23 1 s		96	  3580 0 ));
+DATA(insert (	4115	 20   20 1 s	   410	  3580 0 ));
+/* bloom text */
+DATA(insert (	4116	 25   25 1 s		98	  3580 0 ));
+/* bloom datetime */
+DATA(insert (	4117   1114 1114 1 s	  2060	  3580 0 ));
+DATA(insert (	4117   1184 1184 1 s	  1320	  3580 0 ));
+/* bloom uuid */
+DATA(insert (	4118   2950 2950 1 s	  2972	  3580 0 ));
+
 #endif   /* PG_AMOP_H */
@@ -664,5 +664,33 @@ DATA(insert (	4104   603	 603  3  4107 ));
 DATA(insert (	4104   603	 603  4  4108 ));
 DATA(insert (	4104   603	 603  11 4067 ));
 DATA(insert (	4104   603	 603  13  187 ));
+/* bloom integer */
+DATA(insert (	4115	23	  23  1  4111 ));
+DATA(insert (	4115	23	  23  2  4112 ));
+DATA(insert (	4115	23	  23  3  4113 ));
+DATA(insert (	4115	23	  23  4  4114 ));
+DATA(insert (	4115	20	  20  1  4111 ));
+DATA(insert (	4115	20	  20  2  4112 ));
+DATA(insert (	4115	20	  20  3  4113 ));
+DATA(insert (	4115	20	  20  4  4114 ));
+/* bloom text */
+DATA(insert (	4116	25	  25  1  4111 ));
+DATA(insert (	4116	25	  25  2  4112 ));
+DATA(insert (	4116	25	  25  3  4113 ));
+DATA(insert (	4116	25	  25  4  4114 ));
+/* bloom datetime */
+DATA(insert (	4117  1114	1114  1  4111 ));
+DATA(insert (	4117  1114	1114  2  4112 ));
+DATA(insert (	4117  1114	1114  3  4113 ));
+DATA(insert (	4117  1114	1114  4  4114 ));
+DATA(insert (	4117  1184	1184  1  4111 ));
+DATA(insert (	4117  1184	1184  2  4112 ));
+DATA(insert (	4117  1184	1184  3  4113 ));
+DATA(insert (	4117  1184	1184  4  4114 ));
+/* bloom uuid */
+DATA(insert (	4118  2950	2950  1  4111 ));
+DATA(insert (	4118  2950	2950  2  4112 ));
+DATA(insert (	4118  2950	2950  3  4113 ));
+DATA(insert (	4118  2950	2950  4  4114 ));
 
 #endif   /* PG_AMPROC_H */
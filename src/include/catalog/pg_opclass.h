@@ -271,5 +271,12 @@ DATA(insert (	3580	pg_lsn_minmax_ops		PGNSP PGUID 4082  3220 t 3220 ));
 /* no brin opclass for enum, tsvector, tsquery, jsonb */
 DATA(insert (	3580	box_inclusion_ops		PGNSP PGUID 4104   603 t 603 ));
 /* no brin opclass for the geometric types except box */
+/* bloom opclasses, for equality-only pruning of poorly correlated columns */
+DATA(insert (	3580	int4_bloom_ops			PGNSP PGUID 4115	23 f 0 ));
+DATA(insert (	3580	int8_bloom_ops			PGNSP PGUID 4115	20 f 0 ));
+DATA(insert (	3580	text_bloom_ops			PGNSP PGUID 4116	25 f 0 ));
+DATA(insert (	3580	timestamp_bloom_ops		PGNSP PGUID 4117  1114 f 0 ));
+DATA(insert (	3580	timestamptz_bloom_ops	PGNSP PGUID 4117  1184 f 0 ));
+DATA(insert (	3580	uuid_bloom_ops			PGNSP PGUID 4118  2950 f 0 ));
 
 #endif   /* PG_OPCLASS_H */
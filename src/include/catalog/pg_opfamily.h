@@ -182,5 +182,9 @@ DATA(insert OID = 4081 (	3580	uuid_minmax_ops			PGNSP PGUID ));
 DATA(insert OID = 4103 (	3580	range_inclusion_ops		PGNSP PGUID ));
 DATA(insert OID = 4082 (	3580	pg_lsn_minmax_ops		PGNSP PGUID ));
 DATA(insert OID = 4104 (	3580	box_inclusion_ops		PGNSP PGUID ));
+DATA(insert OID = 4115 (	3580	integer_bloom_ops		PGNSP PGUID ));
+DATA(insert OID = 4116 (	3580	text_bloom_ops			PGNSP PGUID ));
+DATA(insert OID = 4117 (	3580	datetime_bloom_ops		PGNSP PGUID ));
+DATA(insert OID = 4118 (	3580	uuid_bloom_ops			PGNSP PGUID ));
 
 #endif   /* PG_OPFAMILY_H */
@@ -2716,6 +2716,8 @@ DATA(insert OID = 3317 (  pg_stat_get_wal_receiver	PGNSP PGUID 12 1 0 0 0 f f f
 DESCR("statistics: information about WAL receiver");
 DATA(insert OID = 2026 (  pg_backend_pid				PGNSP PGUID 12 1 0 0 0 f f f f t f s r 0 0 23 "" _null_ _null_ _null_ _null_ _null_ pg_backend_pid _null_ _null_ _null_ ));
 DESCR("statistics: current backend PID");
+DATA(insert OID = 4120 (  pg_backend_memory_allocated	PGNSP PGUID 12 1 0 0 0 f f f f t f v r 0 0 20 "" _null_ _null_ _null_ _null_ _null_ pg_backend_memory_allocated _null_ _null_ _null_ ));
+DESCR("bytes of memory allocated by the current backend");
 DATA(insert OID = 1937 (  pg_stat_get_backend_pid		PGNSP PGUID 12 1 0 0 0 f f f f t f s r 1 0 23 "23" _null_ _null_ _null_ _null_ _null_ pg_stat_get_backend_pid _null_ _null_ _null_ ));
 DESCR("statistics: PID of backend");
 DATA(insert OID = 1938 (  pg_stat_get_backend_dbid		PGNSP PGUID 12 1 0 0 0 f f f f t f s r 1 0 26 "23" _null_ _null_ _null_ _null_ _null_ pg_stat_get_backend_dbid _null_ _null_ _null_ ));
@@ -2782,6 +2784,14 @@ DATA(insert OID = 2845 (  pg_stat_get_db_blk_write_time PGNSP PGUID 12 1 0 0 0 f
 DESCR("statistics: block write time, in msec");
 DATA(insert OID = 3195 (  pg_stat_get_archiver		PGNSP PGUID 12 1 0 0 0 f f f f f f s r 0 0 2249 "" "{20,25,1184,20,25,1184,1184}" "{o,o,o,o,o,o,o}" "{archived_count,last_archived_wal,last_archived_time,failed_count,last_failed_wal,last_failed_time,stats_reset}" _null_ _null_ pg_stat_get_archiver _null_ _null_ _null_ ));
 DESCR("statistics: information about WAL archiver");
+DATA(insert OID = 4109 (  pg_stat_get_lwlock_wait_histogram PGNSP PGUID 12 1 100 0 0 f f f f t t v s 0 0 2249 "" "{25,20,20}" "{o,o,o}" "{tranche,wait_us_lt,count}" _null_ _null_ pg_stat_get_lwlock_wait_histogram _null_ _null_ _null_ ));
+DESCR("statistics: histogram of lwlock wait times");
+DATA(insert OID = 4110 (  pg_stat_get_buffer_pressure PGNSP PGUID 12 1 0 0 0 f f f f f f s r 0 0 2249 "" "{20,701,701,701}" "{o,o,o,o}" "{backend_writes,alloc_rate,backend_write_rate,pressure}" _null_ _null_ pg_stat_get_buffer_pressure _null_ _null_ _null_ ));
+DESCR("statistics: buffer-cleaning pressure seen by the bgwriter");
+DATA(insert OID = 4119 (  pg_stat_get_buffer_rings PGNSP PGUID 12 1 3 0 0 f f f f f t s r 0 0 2249 "" "{25,20,20,20}" "{o,o,o,o}" "{strategy,allocs,ring_hits,evict_writes}" _null_ _null_ pg_stat_get_buffer_rings _null_ _null_ _null_ ));
+DESCR("statistics: buffer access strategy ring usage");
+DATA(insert OID = 4121 (  pg_stat_get_slru PGNSP PGUID 12 1 8 0 0 f f f f f t s r 0 0 2249 "" "{25,20,20,20}" "{o,o,o,o}" "{name,blks_hit,blks_read,blks_written}" _null_ _null_ pg_stat_get_slru _null_ _null_ _null_ ));
+DESCR("statistics: per-SLRU buffer cache usage");
 DATA(insert OID = 2769 ( pg_stat_get_bgwriter_timed_checkpoints PGNSP PGUID 12 1 0 0 0 f f f f t f s r 0 0 20 "" _null_ _null_ _null_ _null_ _null_ pg_stat_get_bgwriter_timed_checkpoints _null_ _null_ _null_ ));
 DESCR("statistics: number of timed checkpoints started by the bgwriter");
 DATA(insert OID = 2770 ( pg_stat_get_bgwriter_requested_checkpoints PGNSP PGUID 12 1 0 0 0 f f f f t f s r 0 0 20 "" _null_ _null_ _null_ _null_ _null_ pg_stat_get_bgwriter_requested_checkpoints _null_ _null_ _null_ ));
@@ -4178,6 +4188,16 @@ DESCR("BRIN inclusion support");
 DATA(insert OID = 4108 ( brin_inclusion_union	PGNSP PGUID 12 1 0 0 0 f f f f t f i s 3 0 16 "2281 2281 2281" _null_ _null_ _null_ _null_ _null_ brin_inclusion_union _null_ _null_ _null_ ));
 DESCR("BRIN inclusion support");
 
+/* BRIN bloom */
+DATA(insert OID = 4111 ( brin_bloom_opcinfo		PGNSP PGUID 12 1 0 0 0 f f f f t f i s 1 0 2281 "2281" _null_ _null_ _null_ _null_ _null_ brin_bloom_opcinfo _null_ _null_ _null_ ));
+DESCR("BRIN bloom support");
+DATA(insert OID = 4112 ( brin_bloom_add_value	PGNSP PGUID 12 1 0 0 0 f f f f t f i s 4 0 16 "2281 2281 2281 2281" _null_ _null_ _null_ _null_ _null_ brin_bloom_add_value _null_ _null_ _null_ ));
+DESCR("BRIN bloom support");
+DATA(insert OID = 4113 ( brin_bloom_consistent	PGNSP PGUID 12 1 0 0 0 f f f f t f i s 3 0 16 "2281 2281 2281" _null_ _null_ _null_ _null_ _null_ brin_bloom_consistent _null_ _null_ _null_ ));
+DESCR("BRIN bloom support");
+DATA(insert OID = 4114 ( brin_bloom_union		PGNSP PGUID 12 1 0 0 0 f f f f t f i s 3 0 16 "2281 2281 2281" _null_ _null_ _null_ _null_ _null_ brin_bloom_union _null_ _null_ _null_ ));
+DESCR("BRIN bloom support");
+
 /* userlock replacements */
 DATA(insert OID = 2880 (  pg_advisory_lock				PGNSP PGUID 12 1 0 0 0 f f f f t f v u 1 0 2278 "20" _null_ _null_ _null_ _null_ _null_ pg_advisory_lock_int8 _null_ _null_ _null_ ));
 DESCR("obtain exclusive advisory lock");
@@ -4533,6 +4553,8 @@ DATA(insert OID = 3088 (  gin_tsquery_consistent PGNSP PGUID 12 1 0 0 0 f f f f
 DESCR("GIN tsvector support (obsolete)");
 DATA(insert OID = 3789 (  gin_clean_pending_list PGNSP PGUID 12 1 0 0 0 f f f f t f v s 1 0 20 "2205" _null_ _null_ _null_ _null_ _null_ gin_clean_pending_list _null_ _null_ _null_ ));
 DESCR("clean up GIN pending list");
+DATA(insert OID = 4122 (  pg_incremental_cluster PGNSP PGUID 12 1 0 0 0 f f f f t f v u 2 0 20 "2205 23" _null_ _null_ _null_ _null_ _null_ pg_incremental_cluster _null_ _null_ _null_ ));
+DESCR("move a batch of tuples toward clustered index order");
 
 DATA(insert OID = 3662 (  tsquery_lt			PGNSP PGUID 12 1 0 0 0 f f f f t f i s 2 0 16 "3615 3615" _null_ _null_ _null_ _null_ _null_ tsquery_lt _null_ _null_ _null_ ));
 DATA(insert OID = 3663 (  tsquery_le			PGNSP PGUID 12 1 0 0 0 f f f f t f i s 2 0 16 "3615 3615" _null_ _null_ _null_ _null_ _null_ tsquery_le _null_ _null_ _null_ ));
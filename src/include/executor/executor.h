@@ -95,6 +95,9 @@ extern PGDLLIMPORT ExecutorEnd_hook_type ExecutorEnd_hook;
 typedef bool (*ExecutorCheckPerms_hook_type) (List *, bool);
 extern PGDLLIMPORT ExecutorCheckPerms_hook_type ExecutorCheckPerms_hook;
 
+/* GUC: limit on per-query memory context, in kB; 0 disables the limit */
+extern int	max_query_memory;
+
 
 /*
  * prototypes from functions in execAmi.c
@@ -365,6 +368,8 @@ extern void UnregisterExprContextCallback(ExprContext *econtext,
  */
 extern void ExecOpenIndices(ResultRelInfo *resultRelInfo, bool speculative);
 extern void ExecCloseIndices(ResultRelInfo *resultRelInfo);
+extern void ExecInsertIndexTuplesBatch(TupleTableSlot *slot, HeapTuple *tuples,
+						   int ntuples, EState *estate);
 extern List *ExecInsertIndexTuples(TupleTableSlot *slot, ItemPointer tupleid,
 					  EState *estate, bool noDupErr, bool *specConflict,
 					  List *arbiterIndexes);
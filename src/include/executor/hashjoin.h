@@ -151,7 +151,8 @@ typedef struct HashJoinTableData
 	int			nbatch_original;	/* nbatch when we started inner scan */
 	int			nbatch_outstart;	/* nbatch when we started outer scan */
 
-	bool		growEnabled;	/* flag to shut off nbatch increases */
+	bool		growEnabled;	/* flag to shut off nbatch increases (reset
+								 * at each batch switch) */
 
 	double		totalTuples;	/* # tuples obtained from inner plan */
 	double		skewTuples;		/* # tuples inserted into skew tuples */
@@ -721,6 +721,15 @@ typedef struct FuncExprState
 	 */
 	bool		shutdown_reg;	/* a shutdown callback is registered */
 
+	/*
+	 * For a two-argument operator whose implementation function is one of a
+	 * handful of hot builtin comparators, ExecEvalOper stores a nonzero
+	 * fused opcode here and evaluation dispatches to an inline
+	 * implementation instead of going through the function manager.  See
+	 * ExecMakeFunctionResultFusedOp in execQual.c.
+	 */
+	int			fused_opcode;
+
 	/*
 	 * Call parameter structure for the function.  This has been initialized
 	 * (by InitFunctionCallInfoData) if func.fn_oid is valid.  It also saves
@@ -1134,6 +1143,20 @@ typedef struct ModifyTableState
 										 * tlist  */
 	TupleTableSlot *mt_conflproj;		/* CONFLICT ... SET ... projection
 										 * target */
+	bool		mt_canMultiInsert;		/* batch INSERT through
+										 * heap_multi_insert? */
+	HeapTuple  *mt_bufferedTuples;		/* rows awaiting insertion */
+	int			mt_nBufferedTuples;		/* number of buffered rows */
+	Size		mt_bufferedTuplesSize;	/* their total t_len */
+	TupleTableSlot *mt_multiInsertSlot; /* scratch slot for index inserts and
+										 * triggers at flush time */
+	MemoryContext mt_multiInsertCxt;	/* storage for buffered rows */
+	bool		mt_canPrefetch; /* batch UPDATE/DELETE target rows to
+								 * prefetch their heap pages in block order */
+	Tuplestorestate *mt_prefetchStore;	/* rows pulled ahead of processing */
+	int			mt_prefetchCount;		/* rows currently in the store */
+	bool		mt_subplanDone; /* subplan exhausted while filling window */
+	TupleTableSlot *mt_prefetchSlot;	/* slot for replaying stored rows */
 } ModifyTableState;
 
 /* ----------------
@@ -1141,14 +1164,22 @@ typedef struct ModifyTableState
  *
  *		nplans			how many plans are in the array
  *		whichplan		which plan is being executed (0 .. n-1)
+ *		validplans		subplans surviving runtime constraint exclusion,
+ *						or NULL if all subplans must be scanned
+ *		pstate			shared coordination state when the Append is
+ *						parallel-aware, or NULL when executing serially
  * ----------------
  */
+struct ParallelAppendState;		/* private in nodeAppend.c */
+
 typedef struct AppendState
 {
 	PlanState	ps;				/* its first field is NodeTag */
 	PlanState **appendplans;	/* array of PlanStates for my inputs */
 	int			as_nplans;
 	int			as_whichplan;
+	Bitmapset  *as_validplans;
+	struct ParallelAppendState *as_pstate;
 } AppendState;
 
 /* ----------------
@@ -1815,6 +1846,11 @@ typedef struct SortState
 	bool		bounded_Done;	/* value of bounded we did the sort with */
 	int64		bound_Done;		/* value of bound we did the sort with */
 	void	   *tuplesortstate; /* private state of tuplesort.c */
+	int			skipCols;		/* if > 0, sort incrementally by groups of
+								 * this many equal leading columns */
+	FmgrInfo   *skipEqFuncs;	/* equality functions for those columns */
+	bool		group_Done;		/* incremental sort: input exhausted? */
+	int64		tuples_Emitted; /* incremental sort: tuples returned */
 } SortState;
 
 /* ---------------------
@@ -1845,6 +1881,7 @@ typedef struct AggStatePerAggData *AggStatePerAgg;
 typedef struct AggStatePerTransData *AggStatePerTrans;
 typedef struct AggStatePerGroupData *AggStatePerGroup;
 typedef struct AggStatePerPhaseData *AggStatePerPhase;
+typedef struct AggStatePerHashData *AggStatePerHash;
 
 typedef struct AggState
 {
@@ -1863,6 +1900,8 @@ typedef struct AggState
 	AggStatePerTrans curpertrans;	/* currently active trans state */
 	bool		input_done;		/* indicates end of input */
 	bool		agg_done;		/* indicates completion of Agg scan */
+	bool		count_pushdown; /* bare COUNT(*) over an index-only scan can
+								 * be counted by the index AM directly */
 	bool		combineStates;	/* input tuples contain transition states */
 	bool		finalizeAggs;	/* should we call the finalfn on agg states? */
 	int			projected_set;	/* The last projected grouping set */
@@ -1885,6 +1924,18 @@ typedef struct AggState
 	List	   *hash_needed;	/* list of columns needed in hash table */
 	bool		table_filled;	/* hash table filled yet? */
 	TupleHashIterator hashiter; /* for iterating through hash table */
+	bool		hash_spill_mode;	/* new groups now spill to disk? */
+	bool		hash_spilled;	/* any spilling happened this scan? */
+	int			hash_batch_used_bits;	/* hash bits consumed by prior spills */
+	Size		hash_mem_limit; /* bytes of hash memory allowed */
+	struct HashAggSpill *hash_spill;	/* spill partitions of current pass */
+	List	   *hash_batches;	/* pending HashAggBatch structs */
+	TupleTableSlot *hash_spill_slot;	/* slot for reloading spilled tuples */
+	/* these fields are used when hashing multiple grouping sets: */
+	int			num_hashes;		/* number of hash tables (0 if single) */
+	AggStatePerHash perhash;	/* array of per-hashtable data */
+	int			current_hash;	/* set whose table is being emitted */
+	AggStatePerGroup *hash_pergroups;	/* this tuple's group in each table */
 } AggState;
 
 /* ----------------
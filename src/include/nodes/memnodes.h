@@ -76,6 +76,10 @@ typedef struct MemoryContextData
 	/* these two fields are placed here to minimize alignment wastage: */
 	bool		isReset;		/* T = no space alloced since last reset */
 	bool		allowInCritSection;		/* allow palloc in critical section */
+	Size		mem_allocated;	/* track memory allocated for this context */
+	Size		limit;			/* if not 0, cap on mem_allocated of this
+								 * context plus descendants, enforced when a
+								 * new block is obtained from malloc() */
 	MemoryContextMethods *methods;		/* virtual function table */
 	MemoryContext parent;		/* NULL if no parent (toplevel context) */
 	MemoryContext firstchild;	/* head of linked list of children */
@@ -96,6 +100,7 @@ typedef struct MemoryContextData
  */
 #define MemoryContextIsValid(context) \
 	((context) != NULL && \
-	 (IsA((context), AllocSetContext)))
+	 (IsA((context), AllocSetContext) || \
+	  IsA((context), BumpContext)))
 
 #endif   /* MEMNODES_H */
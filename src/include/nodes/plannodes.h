@@ -680,6 +680,10 @@ typedef struct Sort
 {
 	Plan		plan;
 	int			numCols;		/* number of sort-key columns */
+	int			skipCols;		/* number of leading sort-key columns the
+								 * input is already sorted by; if > 0 the
+								 * executor sorts incrementally, one group of
+								 * equal leading keys at a time */
 	AttrNumber *sortColIdx;		/* their indexes in the target list */
 	Oid		   *sortOperators;	/* OIDs of operators to sort them by */
 	Oid		   *collations;		/* OIDs of collations */
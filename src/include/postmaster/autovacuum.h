@@ -14,6 +14,17 @@
 #ifndef AUTOVACUUM_H
 #define AUTOVACUUM_H
 
+/*
+ * Other processes can request maintenance work to be done by an autovacuum
+ * worker; the worker performs it the next time it processes the requesting
+ * database.  Currently the only such chore is flushing a GIN index's pending
+ * list into the main index structure.
+ */
+typedef enum
+{
+	AVW_GinCleanPendingList
+} AutoVacuumWorkItemType;
+
 
 /* GUC variables */
 extern bool autovacuum_start_daemon;
@@ -53,6 +64,10 @@ extern void AutoVacWorkerFailed(void);
 /* autovacuum cost-delay balancer */
 extern void AutoVacuumUpdateDelay(void);
 
+/* called from backends to queue maintenance work for a worker */
+extern bool AutoVacuumRequestWork(AutoVacuumWorkItemType type,
+					  Oid relationId);
+
 #ifdef EXEC_BACKEND
 extern void AutoVacLauncherMain(int argc, char *argv[]) pg_attribute_noreturn();
 extern void AutoVacWorkerMain(int argc, char *argv[]) pg_attribute_noreturn();
@@ -0,0 +1,27 @@
+/*-------------------------------------------------------------------------
+ *
+ * backendpool.h
+ *	  Pool of reusable backends shared between client connections.
+ *
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ * Portions Copyright (c) 1994, Regents of the University of California
+ *
+ * src/include/postmaster/backendpool.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef BACKENDPOOL_H
+#define BACKENDPOOL_H
+
+#include "libpq/libpq-be.h"
+
+/* GUC */
+extern int	backend_pool_size;
+
+extern Size BackendPoolShmemSize(void);
+extern void BackendPoolShmemInit(void);
+extern bool BackendPoolHandoff(Port *port);
+extern bool BackendPoolPark(void);
+
+#endif   /* BACKENDPOOL_H */
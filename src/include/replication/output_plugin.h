@@ -57,6 +57,10 @@ typedef void (*LogicalDecodeBeginCB) (
 
 /*
  * Callback for every individual change in a successful transaction.
+ *
+ * The change, including its tuple buffers, is owned by the reorder buffer
+ * and is recycled when the callback returns: read tuple data in place, but
+ * do not free it or keep pointers into it afterwards.
  */
 typedef void (*LogicalDecodeChangeCB) (
 											 struct LogicalDecodingContext *,
@@ -80,6 +84,16 @@ typedef bool (*LogicalDecodeFilterByOriginCB) (
 											 struct LogicalDecodingContext *,
 													  RepOriginId origin_id);
 
+/*
+ * Filter changes by the relation they affect, before the change is queued in
+ * the reorder buffer.  Called while reading WAL, with no snapshot set up, so
+ * the callback must not access system catalogs and can judge only by the
+ * physical relfilenode.
+ */
+typedef bool (*LogicalDecodeFilterByRelFileNodeCB) (
+											 struct LogicalDecodingContext *,
+													  RelFileNode *relnode);
+
 /*
  * Called to shutdown an output plugin.
  */
@@ -97,6 +111,7 @@ typedef struct OutputPluginCallbacks
 	LogicalDecodeChangeCB change_cb;
 	LogicalDecodeCommitCB commit_cb;
 	LogicalDecodeFilterByOriginCB filter_by_origin_cb;
+	LogicalDecodeFilterByRelFileNodeCB filter_by_relfilenode_cb;
 	LogicalDecodeShutdownCB shutdown_cb;
 } OutputPluginCallbacks;
 
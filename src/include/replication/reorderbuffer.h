@@ -17,22 +17,36 @@
 #include "utils/snapshot.h"
 #include "utils/timestamp.h"
 
-/* an individual tuple, stored in one chunk of memory */
+/* GUC variable */
+extern int	logical_decoding_work_mem;
+
+/*
+ * An individual tuple, stored in one chunk of memory, with the tuple data
+ * directly following the struct.
+ *
+ * Output plugins may read the tuple in place via ->tuple for the duration of
+ * the change callback; the buffer is owned by the reorder buffer and is
+ * recycled as soon as the callback returns, so plugins must neither free it
+ * nor keep pointers into it across callbacks.
+ */
 typedef struct ReorderBufferTupleBuf
 {
 	/* position in preallocated list */
 	slist_node	node;
 
-	/* tuple, stored sequentially */
+	/* tuple header, the interesting bit for users of logical decoding */
 	HeapTupleData tuple;
-	union
-	{
-		HeapTupleHeaderData header;
-		char		data[MaxHeapTupleSize];
-		double		align_it;	/* ensure t_data is MAXALIGN'd */
-	}			t_data;
+
+	/* pre-allocated size of tuple buffer, different from tuple size */
+	Size		alloc_tuple_size;
+
+	/* actual tuple data follows */
 } ReorderBufferTupleBuf;
 
+/* pointer to the data stored in a TupleBuf */
+#define ReorderBufferTupleBufData(p) \
+	((HeapTupleHeader) MAXALIGN(((char *) p) + sizeof(ReorderBufferTupleBuf)))
+
 /*
  * Types of the change passed to a 'change' callback.
  *
@@ -65,6 +79,9 @@ enum ReorderBufferChangeType
  * The same struct is also used internally for other purposes but that should
  * never be visible outside reorderbuffer.c.
  */
+/* forward declaration so ReorderBufferChange can point at its transaction */
+typedef struct ReorderBufferTXN ReorderBufferTXN;
+
 typedef struct ReorderBufferChange
 {
 	XLogRecPtr	lsn;
@@ -72,6 +89,13 @@ typedef struct ReorderBufferChange
 	/* The type of change. */
 	enum ReorderBufferChangeType action;
 
+	/*
+	 * Transaction this change belongs to, set when the change is queued onto
+	 * the transaction's ->changes list. NULL before that, and for changes
+	 * that only ever live on ->tuplecids; used for memory accounting.
+	 */
+	ReorderBufferTXN *txn;
+
 	RepOriginId origin_id;
 
 	/*
@@ -125,7 +149,7 @@ typedef struct ReorderBufferChange
 	dlist_node	node;
 } ReorderBufferChange;
 
-typedef struct ReorderBufferTXN
+struct ReorderBufferTXN
 {
 	/*
 	 * The transactions transaction id, can be a toplevel or sub xid.
@@ -248,7 +272,14 @@ typedef struct ReorderBufferTXN
 	 */
 	dlist_node	node;
 
-} ReorderBufferTXN;
+	/*
+	 * Size of this transaction's changes currently held in memory, in bytes.
+	 * Changes of subtransactions are accounted to the subtransaction, not
+	 * here.
+	 */
+	Size		size;
+
+};
 
 /* so we can define the callbacks used inside struct ReorderBuffer itself */
 typedef struct ReorderBuffer ReorderBuffer;
@@ -335,13 +366,20 @@ struct ReorderBuffer
 	/* buffer for disk<->memory conversions */
 	char	   *outbuf;
 	Size		outbufsize;
+
+	/*
+	 * Memory used by all transactions' changes currently held in memory,
+	 * compared against logical_decoding_work_mem to decide when to spill the
+	 * largest transaction to disk.
+	 */
+	Size		size;
 };
 
 
 ReorderBuffer *ReorderBufferAllocate(void);
 void		ReorderBufferFree(ReorderBuffer *);
 
-ReorderBufferTupleBuf *ReorderBufferGetTupleBuf(ReorderBuffer *);
+ReorderBufferTupleBuf *ReorderBufferGetTupleBuf(ReorderBuffer *, Size tuple_len);
 void		ReorderBufferReturnTupleBuf(ReorderBuffer *, ReorderBufferTupleBuf *tuple);
 ReorderBufferChange *ReorderBufferGetChange(ReorderBuffer *);
 void		ReorderBufferReturnChange(ReorderBuffer *, ReorderBufferChange *);
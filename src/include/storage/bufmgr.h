@@ -29,7 +29,8 @@ typedef enum BufferAccessStrategyType
 	BAS_BULKREAD,				/* Large read-only scan (hint bit updates are
 								 * ok) */
 	BAS_BULKWRITE,				/* Large multi-block write (e.g. COPY IN) */
-	BAS_VACUUM					/* VACUUM */
+	BAS_VACUUM,					/* VACUUM */
+	BAS_NUM_STRATEGIES			/* number of strategy types; must be last */
 } BufferAccessStrategyType;
 
 /* Possible modes for ReadBufferExtended() */
@@ -48,6 +49,9 @@ typedef enum
 /* in globals.c ... this duplicates miscadmin.h */
 extern PGDLLIMPORT int NBuffers;
 
+/* forward declared, to avoid having to expose buf_internals.h here */
+struct WritebackContext;
+
 /* in bufmgr.c */
 extern bool zero_damaged_pages;
 extern int	bgwriter_lru_maxpages;
@@ -55,9 +59,19 @@ extern double bgwriter_lru_multiplier;
 extern bool track_io_timing;
 extern int	target_prefetch_pages;
 
+extern int	checkpoint_flush_after;
+extern int	backend_flush_after;
+extern int	bgwriter_flush_after;
+
 /* in buf_init.c */
 extern PGDLLIMPORT char *BufferBlocks;
 
+/* in freelist.c */
+extern int	BufferPoolPartitions;
+extern int	bulk_read_ring_size;
+extern int	bulk_write_ring_size;
+extern int	vacuum_ring_size;
+
 /* in guc.c */
 extern int	effective_io_concurrency;
 
@@ -69,6 +83,30 @@ extern PGDLLIMPORT int32 *LocalRefCount;
 /* upper limit for effective_io_concurrency */
 #define MAX_IO_CONCURRENCY 1000
 
+/*
+ * upper limit for the *_flush_after GUCs, and the size of a
+ * WritebackContext's pending-request array
+ */
+#define WRITEBACK_MAX_PENDING_FLUSHES 256
+
+/*
+ * Default values for the *_flush_after GUCs.  Writeback control is only
+ * useful where pg_flush_data can actually initiate writeback without
+ * blocking, so it's disabled by default on platforms without
+ * sync_file_range().
+ */
+#ifdef HAVE_SYNC_FILE_RANGE
+#define DEFAULT_CHECKPOINT_FLUSH_AFTER 32
+#define DEFAULT_BGWRITER_FLUSH_AFTER 64
+#else
+#define DEFAULT_CHECKPOINT_FLUSH_AFTER 0
+#define DEFAULT_BGWRITER_FLUSH_AFTER 0
+#endif   /* HAVE_SYNC_FILE_RANGE */
+#define DEFAULT_BACKEND_FLUSH_AFTER 0
+
+/* upper limit for buffer_pool_partitions */
+#define MAX_BUFFER_POOL_PARTITIONS 64
+
 /* special block number for ReadBuffer() */
 #define P_NEW	InvalidBlockNumber		/* grow the file to get a new page */
 
@@ -209,7 +247,7 @@ extern bool HoldingBufferPinThatDelaysRecovery(void);
 extern void AbortBufferIO(void);
 
 extern void BufmgrCommit(void);
-extern bool BgBufferSync(void);
+extern bool BgBufferSync(struct WritebackContext *wb_context);
 
 extern void AtProcExit_LocalBuffers(void);
 
@@ -39,8 +39,9 @@
 #define USE_DSM_MMAP
 #endif
 
-/* GUC. */
+/* GUCs. */
 extern int	dynamic_shared_memory_type;
+extern bool dynamic_shared_memory_prefault;
 
 /*
  * Directory for on-disk state.
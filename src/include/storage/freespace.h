@@ -27,6 +27,10 @@ extern BlockNumber RecordAndGetPageWithFreeSpace(Relation rel,
 							  Size spaceNeeded);
 extern void RecordPageWithFreeSpace(Relation rel, BlockNumber heapBlk,
 						Size spaceAvail);
+extern void UpdateFreeSpaceMap(Relation rel,
+				   BlockNumber startBlkNum,
+				   BlockNumber endBlkNum,
+				   Size freespace);
 extern void XLogRecordPageWithFreeSpace(RelFileNode rnode, BlockNumber heapBlk,
 							Size spaceAvail);
 
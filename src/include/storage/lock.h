@@ -520,6 +520,7 @@ extern void GrantLock(LOCK *lock, PROCLOCK *proclock, LOCKMODE lockmode);
 extern void GrantAwaitedLock(void);
 extern void RemoveFromWaitQueue(PGPROC *proc, uint32 hashcode);
 extern Size LockShmemSize(void);
+extern int	LockWaiterCount(const LOCKTAG *locktag);
 extern LockData *GetLockStatusData(void);
 
 extern xl_standby_lock *GetRunningTransactionLocks(int *nlocks);
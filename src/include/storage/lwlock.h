@@ -172,6 +172,9 @@ typedef enum LWLockMode
 extern bool Trace_lwlocks;
 #endif
 
+/* GUC variable */
+extern bool track_lwlock_waits;
+
 extern bool LWLockAcquire(LWLock *lock, LWLockMode mode);
 extern bool LWLockConditionalAcquire(LWLock *lock, LWLockMode mode);
 extern bool LWLockAcquireOrWait(LWLock *lock, LWLockMode mode);
@@ -20,6 +20,9 @@
 #include "utils/snapshot.h"
 
 
+/* GUC variable */
+extern bool snapshot_caching;
+
 extern Size ProcArrayShmemSize(void);
 extern void CreateSharedProcArray(void);
 extern void ProcArrayAdd(PGPROC *proc);
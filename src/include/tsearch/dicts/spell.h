@@ -169,6 +169,10 @@ typedef struct
 
 extern TSLexeme *NINormalizeWord(IspellDict *Conf, char *word);
 
+extern bool NIDictShareable(IspellDict *Conf);
+extern Size NIDictSize(IspellDict *Conf);
+extern IspellDict *NIDictCopy(IspellDict *Conf, void *dest);
+
 extern void NIStartBuild(IspellDict *Conf);
 extern void NIImportAffixes(IspellDict *Conf, const char *filename);
 extern void NIImportDictionary(IspellDict *Conf, const char *filename);
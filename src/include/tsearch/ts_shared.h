@@ -0,0 +1,28 @@
+/*-------------------------------------------------------------------------
+ *
+ * ts_shared.h
+ *	  Text search dictionaries in shared memory.
+ *
+ * Portions Copyright (c) 1996-2016, PostgreSQL Global Development Group
+ *
+ * src/include/tsearch/ts_shared.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef _PG_TS_SHARED_H_
+#define _PG_TS_SHARED_H_
+
+#include "tsearch/dicts/spell.h"
+
+/* GUC: kilobytes of shared memory for compiled dictionaries, 0 disables */
+extern int	shared_dictionary_size;
+
+extern Size TsearchShmemSize(void);
+extern void TsearchShmemInit(void);
+
+extern IspellDict *ts_dict_shmem_lookup(const char *dictfile,
+					 const char *afffile);
+extern IspellDict *ts_dict_shmem_store(const char *dictfile,
+					const char *afffile, IspellDict *dict);
+
+#endif   /* _PG_TS_SHARED_H_ */
@@ -496,6 +496,7 @@ extern Datum pg_num_nulls(PG_FUNCTION_ARGS);
 extern Datum pg_num_nonnulls(PG_FUNCTION_ARGS);
 extern Datum current_database(PG_FUNCTION_ARGS);
 extern Datum current_query(PG_FUNCTION_ARGS);
+extern Datum pg_backend_memory_allocated(PG_FUNCTION_ARGS);
 extern Datum pg_cancel_backend(PG_FUNCTION_ARGS);
 extern Datum pg_terminate_backend(PG_FUNCTION_ARGS);
 extern Datum pg_reload_conf(PG_FUNCTION_ARGS);
@@ -1175,6 +1176,9 @@ extern Datum pg_advisory_unlock_int4(PG_FUNCTION_ARGS);
 extern Datum pg_advisory_unlock_shared_int4(PG_FUNCTION_ARGS);
 extern Datum pg_advisory_unlock_all(PG_FUNCTION_ARGS);
 
+/* lwlock.c */
+extern Datum pg_stat_get_lwlock_wait_histogram(PG_FUNCTION_ARGS);
+
 /* txid.c */
 extern Datum txid_snapshot_in(PG_FUNCTION_ARGS);
 extern Datum txid_snapshot_out(PG_FUNCTION_ARGS);
@@ -1270,6 +1274,9 @@ extern Datum pg_identify_object_as_address(PG_FUNCTION_ARGS);
 /* catalog/objectaddress.c */
 extern Datum pg_get_object_address(PG_FUNCTION_ARGS);
 
+/* commands/cluster.c */
+extern Datum pg_incremental_cluster(PG_FUNCTION_ARGS);
+
 /* commands/constraint.c */
 extern Datum unique_key_recheck(PG_FUNCTION_ARGS);
 
@@ -203,6 +203,7 @@ typedef struct StdRdOptions
 	AutoVacOpts autovacuum;		/* autovacuum-related options */
 	bool		user_catalog_table;		/* use as an additional catalog
 										 * relation */
+	int			prealloc_blocks;	/* file space to reserve ahead, in blocks */
 } StdRdOptions;
 
 #define HEAP_MIN_FILLFACTOR			10
@@ -230,6 +231,15 @@ typedef struct StdRdOptions
 #define RelationGetTargetPageFreeSpace(relation, defaultff) \
 	(BLCKSZ * (100 - RelationGetFillFactor(relation, defaultff)) / 100)
 
+/*
+ * RelationGetPreallocBlocks
+ *		Returns the relation's file-space preallocation chunk, in blocks.
+ *		Note multiple eval of argument!
+ */
+#define RelationGetPreallocBlocks(relation, defaultpb) \
+	((relation)->rd_options ? \
+	 ((StdRdOptions *) (relation)->rd_options)->prealloc_blocks : (defaultpb))
+
 /*
  * RelationIsUsedAsCatalogTable
  *		Returns whether the relation should be treated as a catalog table
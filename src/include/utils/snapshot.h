@@ -91,6 +91,15 @@ typedef struct SnapshotData
 	bool		takenDuringRecovery;	/* recovery-shaped snapshot? */
 	bool		copied;			/* false if it's a static snapshot */
 
+	/*
+	 * Snapshot-cache state version the contents were computed from, or 0 if
+	 * they did not come from GetSnapshotData (imported or recovery-shaped
+	 * snapshots).  While this still matches the shared counter, no
+	 * transaction has entered or left the running set and GetSnapshotData may
+	 * hand back the same contents unchanged; see GetSnapshotDataReuse().
+	 */
+	uint64		snapStateVersion;
+
 	CommandId	curcid;			/* in my xact, CID < curcid are visible */
 
 	/*
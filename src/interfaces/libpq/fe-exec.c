@@ -39,7 +39,8 @@ char	   *const pgresStatus[] = {
 	"PGRES_NONFATAL_ERROR",
 	"PGRES_FATAL_ERROR",
 	"PGRES_COPY_BOTH",
-	"PGRES_SINGLE_TUPLE"
+	"PGRES_SINGLE_TUPLE",
+	"PGRES_TUPLES_CHUNK"
 };
 
 /*
@@ -180,6 +181,7 @@ PQmakeEmptyPGresult(PGconn *conn, ExecStatusType status)
 			case PGRES_COPY_IN:
 			case PGRES_COPY_BOTH:
 			case PGRES_SINGLE_TUPLE:
+			case PGRES_TUPLES_CHUNK:
 				/* non-error cases */
 				break;
 			default:
@@ -709,6 +711,9 @@ pqClearAsyncResult(PGconn *conn)
 	if (conn->next_result)
 		PQclear(conn->next_result);
 	conn->next_result = NULL;
+	if (conn->chunk_result)
+		PQclear(conn->chunk_result);
+	conn->chunk_result = NULL;
 }
 
 /*
@@ -1006,6 +1011,12 @@ pqSaveParameterStatus(PGconn *conn, const char *name, const char *value)
  * stashing the previous result in conn->next_result so that it becomes
  * active again after pqPrepareAsyncResult().  This allows the result metadata
  * (column descriptions) to be carried forward to each result row.
+ *
+ * In chunked-rows mode we do the same thing, except that the per-chunk
+ * result accumulates up to conn->rowChunkSize rows (in conn->chunk_result)
+ * before being handed to the client.  Accumulating rows in one result lets
+ * them share that result's allocation blocks, which is much cheaper than
+ * one PGresult per row.
  */
 int
 pqRowProcessor(PGconn *conn, const char **errmsgp)
@@ -1019,7 +1030,9 @@ pqRowProcessor(PGconn *conn, const char **errmsgp)
 	/*
 	 * In single-row mode, make a new PGresult that will hold just this one
 	 * row; the original conn->result is left unchanged so that it can be used
-	 * again as the template for future rows.
+	 * again as the template for future rows.  In chunked-rows mode, do that
+	 * only for the first row of a chunk; later rows of the chunk are added to
+	 * the already-created result.
 	 */
 	if (conn->singleRowMode)
 	{
@@ -1030,6 +1043,20 @@ pqRowProcessor(PGconn *conn, const char **errmsgp)
 		if (!res)
 			return 0;
 	}
+	else if (conn->rowChunkSize > 0)
+	{
+		if (conn->chunk_result == NULL)
+		{
+			res = PQcopyResult(res,
+							   PG_COPYRES_ATTRS | PG_COPYRES_EVENTS |
+							   PG_COPYRES_NOTICEHOOKS);
+			if (!res)
+				return 0;
+			conn->chunk_result = res;
+		}
+		else
+			res = conn->chunk_result;
+	}
 
 	/*
 	 * Basically we just allocate space in the PGresult for each field and
@@ -1079,7 +1106,8 @@ pqRowProcessor(PGconn *conn, const char **errmsgp)
 
 	/*
 	 * Success.  In single-row mode, make the result available to the client
-	 * immediately.
+	 * immediately.  In chunked-rows mode, do so once the chunk is full; a
+	 * final partial chunk is emitted when CommandComplete is received.
 	 */
 	if (conn->singleRowMode)
 	{
@@ -1091,13 +1119,28 @@ pqRowProcessor(PGconn *conn, const char **errmsgp)
 		/* And mark the result ready to return */
 		conn->asyncStatus = PGASYNC_READY;
 	}
+	else if (conn->rowChunkSize > 0 && res->ntups >= conn->rowChunkSize)
+	{
+		/* Change result status to special chunk value */
+		res->resultStatus = PGRES_TUPLES_CHUNK;
+		/* Stash old result for re-use later */
+		conn->next_result = conn->result;
+		conn->result = res;
+		conn->chunk_result = NULL;
+		/* And mark the result ready to return */
+		conn->asyncStatus = PGASYNC_READY;
+	}
 
 	return 1;
 
 fail:
 	/* release locally allocated PGresult, if we made one */
 	if (res != conn->result)
+	{
+		if (res == conn->chunk_result)
+			conn->chunk_result = NULL;
 		PQclear(res);
+	}
 	return 0;
 }
 
@@ -1370,8 +1413,9 @@ PQsendQueryStart(PGconn *conn)
 	conn->result = NULL;
 	conn->next_result = NULL;
 
-	/* reset single-row processing mode */
+	/* reset single-row and chunked-rows processing modes */
 	conn->singleRowMode = false;
+	conn->rowChunkSize = 0;
 
 	/* ready to send command message */
 	return true;
@@ -1598,12 +1642,46 @@ PQsetSingleRowMode(PGconn *conn)
 		return 0;
 	if (conn->result)
 		return 0;
+	if (conn->rowChunkSize > 0)
+		return 0;
 
 	/* OK, set flag */
 	conn->singleRowMode = true;
 	return 1;
 }
 
+/*
+ * Select chunked-rows processing mode: results are returned to the client
+ * in chunks of up to chunkSize rows apiece.  This amortizes the per-result
+ * overhead of single-row mode while still bounding the amount of data
+ * materialized at any one time.
+ */
+int
+PQsetChunkedRowsMode(PGconn *conn, int chunkSize)
+{
+	/*
+	 * Only allow setting the mode when we have launched a query and not yet
+	 * received any results, same as PQsetSingleRowMode.
+	 */
+	if (!conn)
+		return 0;
+	if (chunkSize <= 0)
+		return 0;
+	if (conn->asyncStatus != PGASYNC_BUSY)
+		return 0;
+	if (conn->queryclass != PGQUERY_SIMPLE &&
+		conn->queryclass != PGQUERY_EXTENDED)
+		return 0;
+	if (conn->result)
+		return 0;
+	if (conn->singleRowMode)
+		return 0;
+
+	/* OK, set flag */
+	conn->rowChunkSize = chunkSize;
+	return 1;
+}
+
 /*
  * Consume any available input from the backend
  * 0 return: some kind of trouble
@@ -491,6 +491,20 @@ pqParseInput2(PGconn *conn)
 			switch (id)
 			{
 				case 'C':		/* command complete */
+					if (conn->chunk_result != NULL)
+					{
+						/*
+						 * Return any final partial chunk of rows before the
+						 * command-complete result; leave this message
+						 * unconsumed so it is reparsed afterwards.
+						 */
+						conn->next_result = conn->result;
+						conn->result = conn->chunk_result;
+						conn->result->resultStatus = PGRES_TUPLES_CHUNK;
+						conn->chunk_result = NULL;
+						conn->asyncStatus = PGASYNC_READY;
+						return;
+					}
 					if (pqGets(&conn->workBuffer, conn))
 						return;
 					if (conn->result == NULL)
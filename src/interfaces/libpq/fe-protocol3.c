@@ -197,6 +197,21 @@ pqParseInput3(PGconn *conn)
 			switch (id)
 			{
 				case 'C':		/* command complete */
+					if (conn->chunk_result != NULL)
+					{
+						/*
+						 * We have a final partial chunk of rows to return
+						 * before the command-complete result.  Leave this
+						 * message unconsumed; it will be reparsed after the
+						 * application collects the chunk.
+						 */
+						conn->next_result = conn->result;
+						conn->result = conn->chunk_result;
+						conn->result->resultStatus = PGRES_TUPLES_CHUNK;
+						conn->chunk_result = NULL;
+						conn->asyncStatus = PGASYNC_READY;
+						return;
+					}
 					if (pqGets(&conn->workBuffer, conn))
 						return;
 					if (conn->result == NULL)
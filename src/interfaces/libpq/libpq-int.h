@@ -356,6 +356,8 @@ struct pg_conn
 	bool		nonblocking;	/* whether this connection is using nonblock
 								 * sending semantics */
 	bool		singleRowMode;	/* return current query result row-by-row? */
+	int			rowChunkSize;	/* # rows per chunked result (0 = whole
+								 * resultset at once) */
 	char		copy_is_binary; /* 1 = copy binary, 0 = copy text */
 	int			copy_already_done;		/* # bytes already returned in COPY
 										 * OUT */
@@ -420,6 +422,8 @@ struct pg_conn
 	/* Status for asynchronous result construction */
 	PGresult   *result;			/* result being constructed */
 	PGresult   *next_result;	/* next result (used in single-row mode) */
+	PGresult   *chunk_result;	/* partially-filled chunk of rows (used in
+								 * chunked-rows mode) */
 
 	/* Assorted state for SSL, GSS, etc */
 
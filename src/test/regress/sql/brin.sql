@@ -421,3 +421,172 @@ UPDATE brintest SET textcol = '' WHERE textcol IS NOT NULL;
 SELECT brin_summarize_new_values('brintest'); -- error, not an index
 SELECT brin_summarize_new_values('tenk1_unique1'); -- error, not a BRIN index
 SELECT brin_summarize_new_values('brinidx'); -- ok, no change expected
+
+-- Tests for the bloom opclasses
+CREATE TABLE brintest_bloom (int4col integer,
+	int8col bigint,
+	textcol text,
+	timestampcol timestamp without time zone,
+	timestamptzcol timestamp with time zone,
+	uuidcol uuid
+) WITH (fillfactor=10);
+
+INSERT INTO brintest_bloom SELECT
+	twothousand,
+	142857 * tenthous,
+	repeat(stringu1, 8),
+	timestamp '1942-07-23 03:05:09' + tenthous * interval '36.38 hours',
+	timestamptz '1972-10-10 03:00' + thousand * interval '1 hour',
+	format('%s%s-%s-%s-%s-%s%s%s', to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'))::uuid
+FROM tenk1 ORDER BY unique2 LIMIT 100;
+
+-- the bloom opclasses are not the type defaults, so they must be accepted
+-- by name here
+CREATE INDEX brinidx_bloom ON brintest_bloom USING brin (
+	int4col int4_bloom_ops,
+	int8col int8_bloom_ops,
+	textcol text_bloom_ops,
+	timestampcol timestamp_bloom_ops,
+	timestamptzcol timestamptz_bloom_ops,
+	uuidcol uuid_bloom_ops
+) with (pages_per_range = 1);
+
+SELECT opcname, opcdefault FROM pg_opclass
+  WHERE opcname LIKE '%\_bloom\_ops' ORDER BY opcname;
+
+-- each column gets one probe for a stored value, which the filter must not
+-- lose, and one for an absent value, where any false positive must be
+-- removed by the heap recheck
+CREATE TABLE brinopers_bloom (colname name, typ text,
+	op text[], value text[], matches int[],
+	check (cardinality(op) = cardinality(value)),
+	check (cardinality(op) = cardinality(matches)));
+
+INSERT INTO brinopers_bloom VALUES
+	('int4col', 'int4',
+	 '{=, =}',
+	 '{800, -1}',
+	 '{1, 0}'),
+	('int8col', 'int8',
+	 '{=, =}',
+	 '{1257141600, -1}',
+	 '{1, 0}'),
+	('textcol', 'text',
+	 '{=, =}',
+	 '{BNAAAABNAAAABNAAAABNAAAABNAAAABNAAAABNAAAABNAAAA, AAAAAA}',
+	 '{1, 0}'),
+	('timestampcol', 'timestamp',
+	 '{=, =}',
+	 '{1964-03-24 19:26:45, 1901-01-01 00:00:00}',
+	 '{1, 0}'),
+	('timestamptzcol', 'timestamptz',
+	 '{=, =}',
+	 '{1972-10-19 09:00:00-07, 1901-01-01 00:00:00-00}',
+	 '{1, 0}'),
+	('uuidcol', 'uuid',
+	 '{=, =}',
+	 '{52225222-5222-5222-5222-522252225222, ffffffff-ffff-ffff-ffff-ffffffffffff}',
+	 '{1, 0}');
+
+DO $x$
+DECLARE
+	r record;
+	r2 record;
+	cond text;
+	count int;
+	mismatch bool;
+	plan_ok bool;
+	plan_line text;
+BEGIN
+	FOR r IN SELECT colname, oper, typ, value[ordinality], matches[ordinality] FROM brinopers_bloom, unnest(op) WITH ORDINALITY AS oper LOOP
+		mismatch := false;
+
+		-- prepare the condition
+		cond := format('%I %s %L::%s', r.colname, r.oper, r.value, r.typ);
+
+		-- run the query using the brin index
+		CREATE TEMP TABLE brin_result_bloom (cid tid);
+		SET enable_seqscan = 0;
+		SET enable_bitmapscan = 1;
+
+		plan_ok := false;
+		FOR plan_line IN EXECUTE format($y$EXPLAIN SELECT ctid FROM brintest_bloom WHERE %s $y$, cond) LOOP
+			IF plan_line LIKE 'Bitmap Heap Scan on brintest_bloom%' THEN
+				plan_ok := true;
+			END IF;
+		END LOOP;
+		IF NOT plan_ok THEN
+			RAISE WARNING 'did not get bitmap indexscan plan for %', r;
+		END IF;
+
+		EXECUTE format($y$INSERT INTO brin_result_bloom SELECT ctid FROM brintest_bloom WHERE %s $y$, cond);
+
+		-- run the query using a seqscan
+		CREATE TEMP TABLE brin_result_bloom_ss (cid tid);
+		SET enable_seqscan = 1;
+		SET enable_bitmapscan = 0;
+
+		plan_ok := false;
+		FOR plan_line IN EXECUTE format($y$EXPLAIN SELECT ctid FROM brintest_bloom WHERE %s $y$, cond) LOOP
+			IF plan_line LIKE 'Seq Scan on brintest_bloom%' THEN
+				plan_ok := true;
+			END IF;
+		END LOOP;
+		IF NOT plan_ok THEN
+			RAISE WARNING 'did not get seqscan plan for %', r;
+		END IF;
+
+		EXECUTE format($y$INSERT INTO brin_result_bloom_ss SELECT ctid FROM brintest_bloom WHERE %s $y$, cond);
+
+		-- make sure both return the same results
+		PERFORM * FROM brin_result_bloom EXCEPT ALL SELECT * FROM brin_result_bloom_ss;
+		GET DIAGNOSTICS count = ROW_COUNT;
+		IF count <> 0 THEN
+			mismatch = true;
+		END IF;
+		PERFORM * FROM brin_result_bloom_ss EXCEPT ALL SELECT * FROM brin_result_bloom;
+		GET DIAGNOSTICS count = ROW_COUNT;
+		IF count <> 0 THEN
+			mismatch = true;
+		END IF;
+
+		-- report the results of each scan to make the differences obvious
+		IF mismatch THEN
+			RAISE WARNING 'something not right in %: count %', r, count;
+			SET enable_seqscan = 1;
+			SET enable_bitmapscan = 0;
+			FOR r2 IN EXECUTE 'SELECT ' || r.colname || ' FROM brintest_bloom WHERE ' || cond LOOP
+				RAISE NOTICE 'seqscan: %', r2;
+			END LOOP;
+
+			SET enable_seqscan = 0;
+			SET enable_bitmapscan = 1;
+			FOR r2 IN EXECUTE 'SELECT ' || r.colname || ' FROM brintest_bloom WHERE ' || cond LOOP
+				RAISE NOTICE 'bitmapscan: %', r2;
+			END LOOP;
+		END IF;
+
+		-- make sure we found expected number of matches
+		SELECT count(*) INTO count FROM brin_result_bloom;
+		IF count != r.matches THEN RAISE WARNING 'unexpected number of results % for %', count, r; END IF;
+
+		-- drop the temporary tables
+		DROP TABLE brin_result_bloom;
+		DROP TABLE brin_result_bloom_ss;
+	END LOOP;
+END;
+$x$;
+
+-- the new rows must become visible to the index once summarized
+INSERT INTO brintest_bloom SELECT
+	twothousand,
+	142857 * tenthous,
+	repeat(stringu1, 42),
+	timestamp '1942-07-23 03:05:09' + tenthous * interval '36.38 hours',
+	timestamptz '1972-10-10 03:00' + thousand * interval '1 hour',
+	format('%s%s-%s-%s-%s-%s%s%s', to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'), to_char(tenthous, 'FM0000'))::uuid
+FROM tenk1 ORDER BY unique2 LIMIT 5 OFFSET 5;
+
+VACUUM brintest_bloom;  -- force a summarization cycle in brinidx_bloom
+
+SELECT brin_summarize_new_values('brinidx_bloom');
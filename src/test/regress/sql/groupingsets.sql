@@ -224,4 +224,37 @@ select array(select row(v.a,s1.*) from (select two,four, count(*) from onek grou
 select sum(ten) from onek group by two, rollup(four::text) order by 1;
 select sum(ten) from onek group by rollup(four::text), two order by 1;
 
+-- Hashed implementation of grouping sets: all sets are filled in a single
+-- pass over unsorted input, using one hash table per non-empty set
+set enable_sort = false;
+explain (costs off)
+  select a, b, grouping(a,b), sum(v), count(*)
+    from gstest1 group by rollup (a,b);
+select a, b, grouping(a,b), sum(v), count(*)
+  from gstest1 group by rollup (a,b) order by 3,1,2;
+
+-- the empty grouping set must produce its row even for empty input
+explain (costs off)
+  select a, b, sum(v), count(*)
+    from gstest_empty group by grouping sets ((a,b),());
+select a, b, sum(v), count(*)
+  from gstest_empty group by grouping sets ((a,b),());
+select sum(v), count(*)
+  from gstest_empty group by grouping sets ((),(),());
+reset enable_sort;
+
+-- disabling hashed aggregation falls back to the sorted chain
+set enable_hashagg = false;
+explain (costs off)
+  select a, b, grouping(a,b), sum(v), count(*)
+    from gstest1 group by rollup (a,b);
+reset enable_hashagg;
+
+-- ordered aggregates force the sorted chain even when sorting is discouraged
+set enable_sort = false;
+explain (costs off)
+  select a, array_agg(v order by v)
+    from gstest1 group by grouping sets ((a),());
+reset enable_sort;
+
 -- end